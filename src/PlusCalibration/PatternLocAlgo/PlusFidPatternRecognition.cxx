@@ -6,6 +6,7 @@ See License.txt for details.
 
 #include "PlusConfigure.h"
 #include "PlusFidPatternRecognition.h"
+#include "PlusThreadPool.h"
 #include "vtkMath.h"
 #include "vtkPoints.h"
 #include "vtkLine.h"
@@ -13,6 +14,9 @@ See License.txt for details.
 #include "vtkIGSIOTrackedFrameList.h"
 #include "igsioTrackedFrame.h"
 
+#include <algorithm>
+#include <atomic>
+
 static const double DOT_STEPS  = 4.0;
 static const double DOT_RADIUS = 6.0;
 
@@ -79,15 +83,31 @@ PlusStatus PlusFidPatternRecognition::RecognizePattern(igsioTrackedFrame* tracke
 {
   LOG_TRACE("FidPatternRecognition::RecognizePattern");
 
+  if (RecognizePatternInFrame(trackedFrame, m_FidSegmentation, m_FidLineFinder, m_FidLabeling, patternRecognitionError, frameIndex) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  SetFiducialPointsCoordinatePx(trackedFrame, m_FidLabeling.GetFoundDotsCoordinateValue());
+
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+
+PlusStatus PlusFidPatternRecognition::RecognizePatternInFrame(igsioTrackedFrame* trackedFrame, PlusFidSegmentation& fidSegmentation, PlusFidLineFinder& fidLineFinder, PlusFidLabeling& fidLabeling, PatternRecognitionError& patternRecognitionError, unsigned int frameIndex)
+{
+  LOG_TRACE("FidPatternRecognition::RecognizePatternInFrame");
+
   patternRecognitionError = PATTERN_RECOGNITION_ERROR_NO_ERROR;
 
-  m_FidSegmentation.Clear();
-  m_FidLineFinder.Clear();
-  m_FidLabeling.Clear();
+  fidSegmentation.Clear();
+  fidLineFinder.Clear();
+  fidLabeling.Clear();
 
-  m_FidSegmentation.SetFrameSize(trackedFrame->GetFrameSize());
-  m_FidLineFinder.SetFrameSize(trackedFrame->GetFrameSize());
-  m_FidLabeling.SetFrameSize(trackedFrame->GetFrameSize());
+  fidSegmentation.SetFrameSize(trackedFrame->GetFrameSize());
+  fidLineFinder.SetFrameSize(trackedFrame->GetFrameSize());
+  fidLabeling.SetFrameSize(trackedFrame->GetFrameSize());
 
   if (trackedFrame->GetImageData()->GetVTKScalarPixelType() != VTK_UNSIGNED_CHAR)
   {
@@ -99,14 +119,14 @@ PlusStatus PlusFidPatternRecognition::RecognizePattern(igsioTrackedFrame* tracke
   int bytes = trackedFrame->GetFrameSize()[0] * trackedFrame->GetFrameSize()[1] * sizeof(PlusFidSegmentation::PixelType);
   PlusFidSegmentation::PixelType* image = reinterpret_cast<PlusFidSegmentation::PixelType*>(trackedFrame->GetImageData()->GetScalarPointer());
 
-  memcpy(m_FidSegmentation.GetWorking(), image, bytes);
-  memcpy(m_FidSegmentation.GetUnalteredImage(), image, bytes);
+  memcpy(fidSegmentation.GetWorking(), image, bytes);
+  memcpy(fidSegmentation.GetUnalteredImage(), image, bytes);
 
   //Start of the segmentation
-  m_FidSegmentation.MorphologicalOperations();
-  m_FidSegmentation.Suppress(m_FidSegmentation.GetWorking(), m_FidSegmentation.GetThresholdImagePercent() / 100.00);
+  fidSegmentation.MorphologicalOperations();
+  fidSegmentation.Suppress(fidSegmentation.GetWorking(), fidSegmentation.GetThresholdImagePercent() / 100.00);
   bool tooManyCandidates = false;
-  bool clusteringSuccessful = m_FidSegmentation.Cluster(tooManyCandidates);
+  bool clusteringSuccessful = fidSegmentation.Cluster(tooManyCandidates);
   if (tooManyCandidates)
   {
     patternRecognitionError = PATTERN_RECOGNITION_ERROR_TOO_MANY_CANDIDATES;
@@ -118,30 +138,34 @@ PlusStatus PlusFidPatternRecognition::RecognizePattern(igsioTrackedFrame* tracke
 
   //End of the segmentation
 
-  m_FidSegmentation.SetCandidateFidValues(m_FidSegmentation.GetDotsVector());
+  fidSegmentation.SetCandidateFidValues(fidSegmentation.GetDotsVector());
 
-  m_FidLineFinder.SetCandidateFidValues(m_FidSegmentation.GetCandidateFidValues());
-  m_FidLineFinder.SetDotsVector(m_FidSegmentation.GetDotsVector());
-  m_FidLabeling.SetDotsVector(m_FidSegmentation.GetDotsVector());
+  fidLineFinder.SetCandidateFidValues(fidSegmentation.GetCandidateFidValues());
+  fidLineFinder.SetDotsVector(fidSegmentation.GetDotsVector());
+  fidLabeling.SetDotsVector(fidSegmentation.GetDotsVector());
 
-  m_FidLineFinder.FindLines();
+  fidLineFinder.FindLines();
 
-  if (m_FidLineFinder.GetLinesVector().size() > 3)
+  if (fidLineFinder.GetLinesVector().size() > 3)
   {
-    m_FidLabeling.SetLinesVector(m_FidLineFinder.GetLinesVector());
-    m_FidLabeling.FindPattern();
+    fidLabeling.SetLinesVector(fidLineFinder.GetLinesVector());
+    fidLabeling.FindPattern();
   }
 
-  if (m_FidSegmentation.GetDebugOutput())
+  if (fidSegmentation.GetDebugOutput())
   {
     //Displays the result dots
-    m_FidSegmentation.WritePossibleFiducialOverlayImage(m_FidLabeling.GetFoundDotsCoordinateValue(), m_FidSegmentation.GetUnalteredImage(), "foundFiducials", frameIndex);
-    m_FidSegmentation.WritePossibleFiducialOverlayImage(m_FidSegmentation.GetCandidateFidValues(), m_FidSegmentation.GetUnalteredImage(), "candidateFiducials", frameIndex);   //Display all candidates dots
+    fidSegmentation.WritePossibleFiducialOverlayImage(fidLabeling.GetFoundDotsCoordinateValue(), fidSegmentation.GetUnalteredImage(), "foundFiducials", frameIndex);
+    fidSegmentation.WritePossibleFiducialOverlayImage(fidSegmentation.GetCandidateFidValues(), fidSegmentation.GetUnalteredImage(), "candidateFiducials", frameIndex);   //Display all candidates dots
   }
 
-  // Set results
-  std::vector< std::vector<double> > fiducials = m_FidLabeling.GetFoundDotsCoordinateValue();
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
 
+void PlusFidPatternRecognition::SetFiducialPointsCoordinatePx(igsioTrackedFrame* trackedFrame, const std::vector< std::vector<double> >& fiducials)
+{
   vtkSmartPointer<vtkPoints> fiducialPoints = vtkSmartPointer<vtkPoints>::New();
   fiducialPoints->SetNumberOfPoints(fiducials.size());
 
@@ -152,8 +176,6 @@ PlusStatus PlusFidPatternRecognition::RecognizePattern(igsioTrackedFrame* tracke
   fiducialPoints->Modified();
 
   trackedFrame->SetFiducialPointsCoordinatePx(fiducialPoints);
-
-  return PLUS_SUCCESS;
 }
 
 //-----------------------------------------------------------------------------
@@ -172,29 +194,107 @@ PlusStatus PlusFidPatternRecognition::RecognizePattern(vtkIGSIOTrackedFrameList*
     return PLUS_FAIL;
   }
 
+  // Collect the frames that are not segmented yet
+  std::vector<unsigned int> frameIndices;
+  for (unsigned int currentFrameIndex = 0; currentFrameIndex < trackedFrameList->GetNumberOfTrackedFrames(); currentFrameIndex++)
+  {
+    if (trackedFrameList->GetTrackedFrame(currentFrameIndex)->GetFiducialPointsCoordinatePx() == NULL)
+    {
+      frameIndices.push_back(currentFrameIndex);
+    }
+  }
+
+  // Debug output is written by a single thread to keep the order of the generated files
+  int numberOfWorkers = m_FidSegmentation.GetDebugOutput() ? 1 : std::min<int>(PlusThreadPool::GetNumberOfThreadsToUse(m_FidSegmentation.GetNumberOfThreads()), frameIndices.size());
+
+  // Each worker has its own copy of the algorithm objects, as they store the intermediate results of the frame
+  // that is being processed. A single worker uses the objects of this class directly.
+  std::vector<PlusFidSegmentation> workerSegmentations;
+  std::vector<PlusFidLineFinder> workerLineFinders;
+  std::vector<PlusFidLabeling> workerLabelings;
+  if (numberOfWorkers > 1)
+  {
+    workerSegmentations.assign(numberOfWorkers, m_FidSegmentation);
+    workerLineFinders.assign(numberOfWorkers, m_FidLineFinder);
+    workerLabelings.assign(numberOfWorkers, m_FidLabeling);
+    for (int worker = 0; worker < numberOfWorkers; worker++)
+    {
+      // Frames are already processed in parallel, do not start more threads for each frame
+      workerSegmentations[worker].SetNumberOfThreads(1);
+    }
+  }
+
+  struct FrameResult
+  {
+    PlusStatus Status;
+    PatternRecognitionError Error;
+    std::vector< std::vector<double> > Fiducials;
+  };
+  std::vector<FrameResult> frameResults(frameIndices.size());
+  std::atomic<unsigned int> nextFrame(0);
+  int lastFrameWorker = 0;
+
+  auto recognizeFrames = [&](int worker)
+  {
+    PlusFidSegmentation& fidSegmentation = (numberOfWorkers > 1 ? workerSegmentations[worker] : m_FidSegmentation);
+    PlusFidLineFinder& fidLineFinder = (numberOfWorkers > 1 ? workerLineFinders[worker] : m_FidLineFinder);
+    PlusFidLabeling& fidLabeling = (numberOfWorkers > 1 ? workerLabelings[worker] : m_FidLabeling);
+    for (unsigned int i = nextFrame++; i < frameIndices.size(); i = nextFrame++)
+    {
+      FrameResult& result = frameResults[i];
+      result.Status = RecognizePatternInFrame(trackedFrameList->GetTrackedFrame(frameIndices[i]), fidSegmentation, fidLineFinder, fidLabeling, result.Error, frameIndices[i]);
+      if (result.Status == PLUS_SUCCESS)
+      {
+        result.Fiducials = fidLabeling.GetFoundDotsCoordinateValue();
+      }
+      if (i + 1 == frameIndices.size())
+      {
+        // frames are handed out in increasing order, so the last frame is the last one processed by this worker
+        lastFrameWorker = worker;
+      }
+    }
+  };
+
+  // Each block of the parallel loop is one worker
+  PlusThreadPool::ParallelFor(0, numberOfWorkers, numberOfWorkers, [&](int firstWorker, int endWorker)
+  {
+    for (int worker = firstWorker; worker < endWorker; worker++)
+    {
+      recognizeFrames(worker);
+    }
+  });
+
+  if (numberOfWorkers > 1)
+  {
+    // Keep the state of the algorithm objects as if the frames were processed in order by this object
+    int numberOfThreads = m_FidSegmentation.GetNumberOfThreads();
+    m_FidSegmentation = workerSegmentations[lastFrameWorker];
+    m_FidSegmentation.SetNumberOfThreads(numberOfThreads);
+    m_FidLineFinder = workerLineFinders[lastFrameWorker];
+    m_FidLabeling = workerLabelings[lastFrameWorker];
+  }
+
+  // Merge the results in frame order
   PlusStatus status = PLUS_SUCCESS;
   if (numberOfSuccessfullySegmentedImages)
   {
     *numberOfSuccessfullySegmentedImages = 0;
   }
 
-  for (unsigned int currentFrameIndex = 0; currentFrameIndex < trackedFrameList->GetNumberOfTrackedFrames(); currentFrameIndex++)
+  for (unsigned int i = 0; i < frameIndices.size(); i++)
   {
+    unsigned int currentFrameIndex = frameIndices[i];
     igsioTrackedFrame* trackedFrame = trackedFrameList->GetTrackedFrame(currentFrameIndex);
 
-    // segment only non segmented frames
-    if (trackedFrame->GetFiducialPointsCoordinatePx() != NULL)
+    patternRecognitionError = frameResults[i].Error;
+    if (frameResults[i].Status == PLUS_SUCCESS)
     {
-      continue;
+      SetFiducialPointsCoordinatePx(trackedFrame, frameResults[i].Fiducials);
     }
-
-    if (RecognizePattern(trackedFrame, patternRecognitionError, currentFrameIndex) != PLUS_SUCCESS)
+    else if (patternRecognitionError != PATTERN_RECOGNITION_ERROR_TOO_MANY_CANDIDATES)
     {
-      if (patternRecognitionError != PATTERN_RECOGNITION_ERROR_TOO_MANY_CANDIDATES)
-      {
-        LOG_ERROR("Recognizing pattern failed on frame " << currentFrameIndex);
-        status = PLUS_FAIL;
-      }
+      LOG_ERROR("Recognizing pattern failed on frame " << currentFrameIndex);
+      status = PLUS_FAIL;
     }
 
     if (numberOfSuccessfullySegmentedImages)
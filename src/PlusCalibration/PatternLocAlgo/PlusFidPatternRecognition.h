@@ -44,7 +44,10 @@ public:
 
   /*!
   Run pattern recognition on a tracked frame list.
-  It only segments the tracked frames which were not already segmented
+  It only segments the tracked frames which were not already segmented.
+  Frames are processed in parallel (see PlusFidSegmentation::SetNumberOfThreads), each thread uses its own copy of
+  the segmentation, line finder and labeling objects. Results, errors and the state of the algorithm objects
+  after the call are the same as if the frames were processed one after the other.
   \param trackedFrameList Tracked frame list to segment
   \param numberOfSuccessfullySegmentedImages Out parameter holding the number of segmented images in this call (it is only equals the number of all segmented images in the tracked frame if it was not segmented at all)
   \param segmentedFramesIndices Indices of the frames that were properly segmented
@@ -95,6 +98,16 @@ public:
   /*! Reads the phantom definition and computes the NWires intersection if needed */
   PlusStatus ReadPhantomDefinition(vtkXMLDataElement* rootConfigElement);
 
+protected:
+  /*!
+  Segment a frame and find the pattern using the provided algorithm objects. The tracked frame is not modified,
+  so it can be called from multiple threads at the same time if each thread uses its own algorithm objects.
+  */
+  static PlusStatus RecognizePatternInFrame(igsioTrackedFrame* trackedFrame, PlusFidSegmentation& fidSegmentation, PlusFidLineFinder& fidLineFinder, PlusFidLabeling& fidLabeling, PatternRecognitionError& patternRecognitionError, unsigned int frameIndex);
+
+  /*! Store the found fiducial positions in the tracked frame */
+  static void SetFiducialPointsCoordinatePx(igsioTrackedFrame* trackedFrame, const std::vector< std::vector<double> >& fiducials);
+
 protected:
 
   PlusFidSegmentation           m_FidSegmentation;
@@ -7,11 +7,19 @@
 #include "PlusConfigure.h"
 
 #include "PlusFidSegmentation.h"
+#include "PlusThreadPool.h"
 #include "vtkMath.h"
 
 #include <limits.h>
 #include <iostream>
 #include <algorithm>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  // SSE2 is available on all x86-64 processors
+  #define PLUS_FID_SEGMENTATION_SSE2
+  #include <emmintrin.h>
+#endif
 
 #include "itkRGBPixel.h"
 #include "itkImage.h"
@@ -41,6 +49,213 @@ const int PlusFidSegmentation::DEFAULT_NUMBER_OF_MAXIMUM_FIDUCIAL_POINT_CANDIDAT
 
 //-----------------------------------------------------------------------------
 
+namespace
+{
+  typedef PlusFidSegmentation::PixelType PixelType;
+
+  //-----------------------------------------------------------------------------
+  // Pixel-wise operators of erosion and dilation, for single pixels and for 16 pixels at once
+  struct MinimumOperator
+  {
+    static inline PixelType Apply(PixelType a, PixelType b) { return a < b ? a : b; }
+#ifdef PLUS_FID_SEGMENTATION_SSE2
+    static inline __m128i Apply(__m128i a, __m128i b) { return _mm_min_epu8(a, b); }
+#endif
+  };
+
+  struct MaximumOperator
+  {
+    static inline PixelType Apply(PixelType a, PixelType b) { return a > b ? a : b; }
+#ifdef PLUS_FID_SEGMENTATION_SSE2
+    static inline __m128i Apply(__m128i a, __m128i b) { return _mm_max_epu8(a, b); }
+#endif
+  };
+
+  //-----------------------------------------------------------------------------
+  // dest[i] = Operator(a[i], b[i]) for i in [0, count)
+  template <class Operator>
+  inline void CombinePixels(PixelType* dest, const PixelType* a, const PixelType* b, int count)
+  {
+    int i = 0;
+#ifdef PLUS_FID_SEGMENTATION_SSE2
+    for (; i + 16 <= count; i += 16)
+    {
+      __m128i result = Operator::Apply(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), result);
+    }
+#endif
+    for (; i < count; i++)
+    {
+      dest[i] = Operator::Apply(a[i], b[i]);
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  /*
+    Erosion or dilation with a horizontal bar (2*barSize+1 pixels) by the van Herk/Gil-Werman algorithm.
+    Each row in the region of interest (extended by barSize on both sides) is split into blocks of the bar length.
+    forward contains the running min/max from the start of the block, backward from the end of the block.
+    Any bar position overlaps at most two blocks, so its min/max is a single operation: backward at the start
+    of the bar and forward at the end of the bar.
+    Bars are clipped at the left border of the image (the region of interest may start closer to it than barSize).
+  */
+  template <class Operator>
+  void MorphologyAlongRows(PixelType* dest, const PixelType* image, const FrameSizeType& frameSize, const std::array<unsigned int, 4>& roi,
+                           unsigned int barSize, PixelType* forward, PixelType* backward, int numberOfThreads)
+  {
+    memset(dest, 0, frameSize[1]*frameSize[0]*sizeof(PixelType));
+
+    const int width = frameSize[0];
+    const int bar = barSize;
+    const int barLength = 2 * bar + 1;
+    const int lineStart = std::max(static_cast<int>(roi[0]) - bar, 0);
+    const int lineEnd = roi[2] + bar;
+    // Bars of the columns before firstFullColumn reach over the left border of the image
+    const int firstFullColumn = std::min(std::max(static_cast<int>(roi[0]), bar), static_cast<int>(roi[2]));
+
+    PlusThreadPool::ParallelFor(roi[1], roi[3], numberOfThreads, [&](unsigned int firstRow, unsigned int endRow)
+    {
+      for (unsigned int ir = firstRow; ir < endRow; ir++)
+      {
+        const PixelType* imageRow = image + ir * width;
+        PixelType* forwardRow = forward + ir * width;
+        PixelType* backwardRow = backward + ir * width;
+        for (int blockStart = lineStart; blockStart < lineEnd; blockStart += barLength)
+        {
+          const int blockEnd = std::min(blockStart + barLength, lineEnd);
+          forwardRow[blockStart] = imageRow[blockStart];
+          for (int ic = blockStart + 1; ic < blockEnd; ic++)
+          {
+            forwardRow[ic] = Operator::Apply(forwardRow[ic - 1], imageRow[ic]);
+          }
+          backwardRow[blockEnd - 1] = imageRow[blockEnd - 1];
+          for (int ic = blockEnd - 2; ic >= blockStart; ic--)
+          {
+            backwardRow[ic] = Operator::Apply(backwardRow[ic + 1], imageRow[ic]);
+          }
+        }
+        // A clipped bar starts at the first pixel of the row, which is the start of the first block
+        for (int ic = roi[0]; ic < firstFullColumn; ic++)
+        {
+          dest[ir * width + ic] = forwardRow[ic + bar];
+        }
+        if (firstFullColumn < static_cast<int>(roi[2]))
+        {
+          CombinePixels<Operator>(dest + ir * width + firstFullColumn, backwardRow + firstFullColumn - bar, forwardRow + firstFullColumn + bar, roi[2] - firstFullColumn);
+        }
+      }
+    });
+  }
+
+  //-----------------------------------------------------------------------------
+  // Min/max along a vertical or diagonal bar that reaches over the top or left border of the image, only the pixels inside the image are used
+  template <class Operator>
+  PixelType ClippedBarAcrossRows(const PixelType* image, int width, int ir, int ic, int bar, int columnStep)
+  {
+    int firstStep = std::max(-bar, -ir);
+    int lastStep = bar;
+    if (columnStep > 0)
+    {
+      firstStep = std::max(firstStep, -ic);
+    }
+    else if (columnStep < 0)
+    {
+      lastStep = std::min(lastStep, ic);
+    }
+    PixelType value = image[(ir + firstStep) * width + ic + firstStep * columnStep];
+    for (int k = firstStep + 1; k <= lastStep; k++)
+    {
+      value = Operator::Apply(value, image[(ir + k) * width + ic + k * columnStep]);
+    }
+    return value;
+  }
+
+  //-----------------------------------------------------------------------------
+  /*
+    Erosion or dilation with a vertical (columnStep = 0) or diagonal (columnStep = 1: 135 deg, columnStep = -1: 45 deg) bar
+    by the van Herk/Gil-Werman algorithm. The bar covers pixels (ir + k, ic + k * columnStep), k = -barSize..barSize.
+    Rows are split into blocks of the bar length and the running min/max along the bar direction is computed
+    for all columns of a row at once, which allows vectorization of the operations.
+    Bars that reach over the top or left border of the image are clipped and computed pixel by pixel.
+  */
+  template <class Operator>
+  void MorphologyAcrossRows(PixelType* dest, const PixelType* image, const FrameSizeType& frameSize, const std::array<unsigned int, 4>& roi,
+                            unsigned int barSize, int columnStep, PixelType* forward, PixelType* backward, int numberOfThreads)
+  {
+    memset(dest, 0, frameSize[1]*frameSize[0]*sizeof(PixelType));
+
+    const int width = frameSize[0];
+    const int bar = barSize;
+    const int barLength = 2 * bar + 1;
+    const int rowStart = std::max(static_cast<int>(roi[1]) - bar, 0);
+    const int rowEnd = roi[3] + bar;
+    // Diagonal bars reach barSize columns to the left and right of the region of interest
+    const int columnStart = std::max(static_cast<int>(roi[0]) - bar * std::abs(columnStep), 0);
+    const int columnEnd = roi[2] + bar * std::abs(columnStep);
+    // Columns that have a predecessor along the bar direction in the previous row (and successor in the next row)
+    const int forwardColumnStart = columnStep > 0 ? columnStart + 1 : columnStart;
+    const int forwardColumnEnd = columnStep < 0 ? columnEnd - 1 : columnEnd;
+    const int backwardColumnStart = columnStep < 0 ? columnStart + 1 : columnStart;
+    const int backwardColumnEnd = columnStep > 0 ? columnEnd - 1 : columnEnd;
+    const int numberOfBlocks = (rowEnd - rowStart + barLength - 1) / barLength;
+
+    // Running min/max within each block of rows. The blocks are independent from each other.
+    // Pixels without predecessor (successor) in the block are only needed for bars that would reach outside
+    // of the extended region of interest, therefore they are just initialized with the image value.
+    PlusThreadPool::ParallelFor(0, numberOfBlocks, numberOfThreads, [&](unsigned int firstBlock, unsigned int endBlock)
+    {
+      for (unsigned int block = firstBlock; block < endBlock; block++)
+      {
+        const int blockStart = rowStart + block * barLength;
+        const int blockEnd = std::min(blockStart + barLength, rowEnd);
+        memcpy(forward + blockStart * width + columnStart, image + blockStart * width + columnStart, (columnEnd - columnStart) * sizeof(PixelType));
+        for (int ir = blockStart + 1; ir < blockEnd; ir++)
+        {
+          PixelType* forwardRow = forward + ir * width;
+          const PixelType* imageRow = image + ir * width;
+          forwardRow[columnStart] = imageRow[columnStart];
+          forwardRow[columnEnd - 1] = imageRow[columnEnd - 1];
+          CombinePixels<Operator>(forwardRow + forwardColumnStart, forwardRow - width + forwardColumnStart - columnStep,
+                                  imageRow + forwardColumnStart, forwardColumnEnd - forwardColumnStart);
+        }
+        memcpy(backward + (blockEnd - 1) * width + columnStart, image + (blockEnd - 1) * width + columnStart, (columnEnd - columnStart) * sizeof(PixelType));
+        for (int ir = blockEnd - 2; ir >= blockStart; ir--)
+        {
+          PixelType* backwardRow = backward + ir * width;
+          const PixelType* imageRow = image + ir * width;
+          backwardRow[columnStart] = imageRow[columnStart];
+          backwardRow[columnEnd - 1] = imageRow[columnEnd - 1];
+          CombinePixels<Operator>(backwardRow + backwardColumnStart, backwardRow + width + backwardColumnStart + columnStep,
+                                  imageRow + backwardColumnStart, backwardColumnEnd - backwardColumnStart);
+        }
+      }
+    });
+
+    // The bar centered at (ir, ic) starts at (ir - barSize, ic - barSize * columnStep) and ends at (ir + barSize, ic + barSize * columnStep)
+    const int firstFullColumn = std::min(columnStep == 0 ? static_cast<int>(roi[0]) : std::max(static_cast<int>(roi[0]), bar), static_cast<int>(roi[2]));
+    PlusThreadPool::ParallelFor(roi[1], roi[3], numberOfThreads, [&](unsigned int firstRow, unsigned int endRow)
+    {
+      for (unsigned int ir = firstRow; ir < endRow; ir++)
+      {
+        const int rowFirstFullColumn = (static_cast<int>(ir) >= bar ? firstFullColumn : static_cast<int>(roi[2]));
+        for (int ic = roi[0]; ic < rowFirstFullColumn; ic++)
+        {
+          dest[ir * width + ic] = ClippedBarAcrossRows<Operator>(image, width, ir, ic, bar, columnStep);
+        }
+        if (rowFirstFullColumn < static_cast<int>(roi[2]))
+        {
+          CombinePixels<Operator>(dest + ir * width + rowFirstFullColumn,
+                                  backward + (ir - bar) * width + rowFirstFullColumn - bar * columnStep,
+                                  forward + (ir + bar) * width + rowFirstFullColumn + bar * columnStep,
+                                  roi[2] - rowFirstFullColumn);
+        }
+      }
+    });
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 PlusFidSegmentation::PlusFidSegmentation()
   : m_UseOriginalImageIntensityForDotIntensityScore(false)
   , m_NumberOfMaximumFiducialPointCandidates(DEFAULT_NUMBER_OF_MAXIMUM_FIDUCIAL_POINT_CANDIDATES)
@@ -57,6 +272,7 @@ PlusFidSegmentation::PlusFidSegmentation()
   , m_Eroded(new PlusFidSegmentation::PixelType[1])
   , m_UnalteredImage(new PlusFidSegmentation::PixelType[1])
   , m_DebugOutput(false)
+  , m_NumberOfThreads(0)
 {
   //Initialization of member variables
   m_FrameSize[0] = 0;
@@ -101,6 +317,72 @@ PlusFidSegmentation::~PlusFidSegmentation()
 
 //-----------------------------------------------------------------------------
 
+PlusFidSegmentation::PlusFidSegmentation(const PlusFidSegmentation& other)
+  : m_Working(new PlusFidSegmentation::PixelType[1])
+  , m_Dilated(new PlusFidSegmentation::PixelType[1])
+  , m_Eroded(new PlusFidSegmentation::PixelType[1])
+  , m_UnalteredImage(new PlusFidSegmentation::PixelType[1])
+{
+  *this = other;
+}
+
+//-----------------------------------------------------------------------------
+
+PlusFidSegmentation& PlusFidSegmentation::operator=(const PlusFidSegmentation& other)
+{
+  if (this == &other)
+  {
+    return *this;
+  }
+
+  m_FrameSize = other.m_FrameSize;
+  m_RegionOfInterest = other.m_RegionOfInterest;
+  m_UseOriginalImageIntensityForDotIntensityScore = other.m_UseOriginalImageIntensityForDotIntensityScore;
+  m_NumberOfMaximumFiducialPointCandidates = other.m_NumberOfMaximumFiducialPointCandidates;
+  m_ThresholdImagePercent = other.m_ThresholdImagePercent;
+  m_MorphologicalOpeningBarSizeMm = other.m_MorphologicalOpeningBarSizeMm;
+  m_MorphologicalOpeningCircleRadiusMm = other.m_MorphologicalOpeningCircleRadiusMm;
+  m_PossibleFiducialsImageFilename = other.m_PossibleFiducialsImageFilename;
+  m_FiducialGeometry = other.m_FiducialGeometry;
+  m_MorphologicalCircle = other.m_MorphologicalCircle;
+  m_ApproximateSpacingMmPerPixel = other.m_ApproximateSpacingMmPerPixel;
+  memcpy(m_ImageScalingTolerancePercent, other.m_ImageScalingTolerancePercent, sizeof(m_ImageScalingTolerancePercent));
+  memcpy(m_ImageNormalVectorInPhantomFrameEstimation, other.m_ImageNormalVectorInPhantomFrameEstimation, sizeof(m_ImageNormalVectorInPhantomFrameEstimation));
+  memcpy(m_ImageNormalVectorInPhantomFrameMaximumRotationAngleDeg, other.m_ImageNormalVectorInPhantomFrameMaximumRotationAngleDeg, sizeof(m_ImageNormalVectorInPhantomFrameMaximumRotationAngleDeg));
+  memcpy(m_ImageToPhantomTransform, other.m_ImageToPhantomTransform, sizeof(m_ImageToPhantomTransform));
+  m_DotsFound = other.m_DotsFound;
+  m_FoundDotsCoordinateValue = other.m_FoundDotsCoordinateValue;
+  m_NumDots = other.m_NumDots;
+  m_CandidateFidValues = other.m_CandidateFidValues;
+  m_DotsVector = other.m_DotsVector;
+  m_DebugOutput = other.m_DebugOutput;
+  m_NumberOfThreads = other.m_NumberOfThreads;
+  m_MorphologyForwardBuffer.resize(other.m_MorphologyForwardBuffer.size());
+  m_MorphologyBackwardBuffer.resize(other.m_MorphologyBackwardBuffer.size());
+
+  // Image buffers are owned by each instance
+  delete[] m_Dilated;
+  delete[] m_Eroded;
+  delete[] m_Working;
+  delete[] m_UnalteredImage;
+  long size = std::max<long>(1, m_FrameSize[0] * m_FrameSize[1]);
+  m_Dilated = new PlusFidSegmentation::PixelType[size];
+  m_Eroded = new PlusFidSegmentation::PixelType[size];
+  m_Working = new PlusFidSegmentation::PixelType[size];
+  m_UnalteredImage = new PlusFidSegmentation::PixelType[size];
+  if (m_FrameSize[0] != 0 && m_FrameSize[1] != 0)
+  {
+    memcpy(m_Dilated, other.m_Dilated, size * sizeof(PlusFidSegmentation::PixelType));
+    memcpy(m_Eroded, other.m_Eroded, size * sizeof(PlusFidSegmentation::PixelType));
+    memcpy(m_Working, other.m_Working, size * sizeof(PlusFidSegmentation::PixelType));
+    memcpy(m_UnalteredImage, other.m_UnalteredImage, size * sizeof(PlusFidSegmentation::PixelType));
+  }
+
+  return *this;
+}
+
+//-----------------------------------------------------------------------------
+
 void PlusFidSegmentation::UpdateParameters()
 {
   LOG_TRACE("FidSegmentation::UpdateParameters");
@@ -206,6 +488,7 @@ PlusStatus PlusFidSegmentation::ReadConfiguration(vtkXMLDataElement* configData)
   }
 
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfMaximumFiducialPointCandidates, segmentationParameters);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfThreads, segmentationParameters);
 
   UpdateParameters();
 
@@ -241,6 +524,8 @@ void PlusFidSegmentation::SetFrameSize(const FrameSizeType& frameSize)
   m_Eroded = new PlusFidSegmentation::PixelType[size];
   m_Working = new PlusFidSegmentation::PixelType[size];
   m_UnalteredImage = new PlusFidSegmentation::PixelType[size];
+  m_MorphologyForwardBuffer.resize(size);
+  m_MorphologyBackwardBuffer.resize(size);
 
   // Set ROI to the largest possible if not already set
   if ((m_RegionOfInterest[0] == 0) || (m_RegionOfInterest[1] == 0) || (m_RegionOfInterest[2] == 0) || (m_RegionOfInterest[3] == 0))
@@ -299,88 +584,12 @@ unsigned int PlusFidSegmentation::GetMorphologicalOpeningBarSizePx()
 
 //-----------------------------------------------------------------------------
 
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::ErodePoint0(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::ErodePoint0");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = UCHAR_MAX;
-  unsigned int p = ir * m_FrameSize[0] + clampMinBarSize(ic, barSize); // current pixel - bar size (position of the start of the bar)
-  unsigned int p_max = ir * m_FrameSize[0] + ic + barSize; // current pixel +  bar size (position of the end  of the bar)
-
-  //find lowest intensity in bar shaped area in image
-  for (; p <= p_max; p++)
-  {
-    if (image[p] < dval)
-    {
-      dval = image[p];
-    }
-    if (image[p] == 0)
-    {
-      break;
-    }
-  }
-
-  return dval;
-}
-
-//-----------------------------------------------------------------------------
-
 void PlusFidSegmentation::Erode0(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image)
 {
   //LOG_TRACE("FidSegmentation::Erode0");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  for (unsigned int ir = m_RegionOfInterest[1]; ir < m_RegionOfInterest[3]; ir++)
-  {
-    unsigned int ic = m_RegionOfInterest[0];
-    unsigned int p_base = ir * m_FrameSize[0];
-
-    PlusFidSegmentation::PixelType dval = ErodePoint0(image, ir, ic);   // find lowest pixel intensity in surrounding region ( positions +/- 8 of current pixel position)
-    dest[p_base + ic] = dval; // p_base+ic = current pixel
-
-    for (ic++; ic < m_RegionOfInterest[2]; ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[p_base + ic + barSize];
-      PlusFidSegmentation::PixelType del_val = image[p_base + clampMinBarSize(ic - 1, barSize)];
-
-      dval = new_val <= dval ? new_val  : // dval = new val if new val is less than or equal to dval
-             del_val > dval ? std::min(dval, new_val) :   // if del val is greater than dval, dval= min of dval and new val
-             ErodePoint0(image, ir, ic);   //else dval = result of erode function
-
-      dest[ir * m_FrameSize[0] + ic] = dval; // update new "eroded" picture
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::ErodePoint45(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::ErodePoint45");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  PlusFidSegmentation::PixelType dval = UCHAR_MAX;
-
-  unsigned int p = (ir + barSize) * m_FrameSize[0] + clampMinBarSize(ic, barSize);
-  unsigned int p_max = clampMinBarSize(ir, barSize) * m_FrameSize[0] + ic + barSize;
-
-  for (; p >= p_max; p = p - m_FrameSize[0] + 1)
-  {
-    if (image[p] < dval)
-    {
-      dval = image[p];
-    }
-    if (image[p] == 0)
-    {
-      break;
-    }
-  }
-  return dval;
+  MorphologyAlongRows<MinimumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(),
+                                       &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -389,77 +598,8 @@ void PlusFidSegmentation::Erode45(PlusFidSegmentation::PixelType* dest, PlusFidS
 {
   //LOG_TRACE("FidSegmentation::Erode45");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  /* Down the left side. */
-  for (unsigned int sr = m_RegionOfInterest[1]; sr < m_RegionOfInterest[3]; sr++)
-  {
-    unsigned int ir = sr;
-    unsigned int ic = m_RegionOfInterest[0];
-
-    PlusFidSegmentation::PixelType dval = ErodePoint45(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ir--, ic++; ir >= m_RegionOfInterest[1] && ic < m_RegionOfInterest[2]; ir--, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[ clampMinBarSize(ir, barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[(ir + 1 + barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val <= dval ? new_val :
-             del_val > dval ? std::min(dval, new_val) :
-             ErodePoint45(image, ir, ic);
-
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-
-  /* Across the bottom */
-  for (unsigned int sc = m_RegionOfInterest[0]; sc < m_RegionOfInterest[2]; sc++)
-  {
-    unsigned int ic = sc;
-    unsigned int ir = m_RegionOfInterest[3] - 1;
-
-    PlusFidSegmentation::PixelType dval = ErodePoint45(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ir--, ic++; ir >= m_RegionOfInterest[1] && ic < m_RegionOfInterest[2]; ir--, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[clampMinBarSize(ir, barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[(ir + 1 + barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val <= dval ? new_val :
-             del_val > dval ? std::min(dval, new_val) :
-             ErodePoint45(image, ir, ic);
-
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::ErodePoint90(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::ErodePoint90");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = UCHAR_MAX;
-  unsigned int p = clampMinBarSize(ir, barSize) * m_FrameSize[0] + ic;
-  unsigned int p_max = (ir + barSize) * m_FrameSize[0] + ic;
-
-  for (; p <= p_max; p += m_FrameSize[0])
-  {
-    if (image[p] < dval)
-    {
-      dval = image[p];
-    }
-    if (image[p] == 0)
-    {
-      break;
-    }
-  }
-  return dval;
+  MorphologyAcrossRows<MinimumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(), -1,
+                                        &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -468,54 +608,8 @@ void PlusFidSegmentation::Erode90(PlusFidSegmentation::PixelType* dest, PlusFidS
 {
   //LOG_TRACE("FidSegmentation::Erode90");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  for (unsigned int ic = m_RegionOfInterest[0]; ic < m_RegionOfInterest[2]; ic++)
-  {
-    unsigned int ir = m_RegionOfInterest[1];
-
-    PlusFidSegmentation::PixelType dval = ErodePoint90(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ir++; ir < m_RegionOfInterest[3]; ir++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[(ir + barSize) * m_FrameSize[0] + ic];
-      PlusFidSegmentation::PixelType del_val = image[clampMinBarSize(ir -1, barSize) * m_FrameSize[0] + ic];
-
-      dval = new_val <= dval ? new_val :
-             del_val > dval ? std::min(dval, new_val) :
-             ErodePoint90(image, ir, ic);
-
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::ErodePoint135(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::ErodePoint135");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = UCHAR_MAX;
-  unsigned int p = clampMinBarSize(ir, barSize) * m_FrameSize[0] + clampMinBarSize(ic, barSize);
-  unsigned int p_max = (ir + barSize) * m_FrameSize[0] + ic + barSize;
-
-  for (; p <= p_max; p = p + m_FrameSize[0] + 1)
-  {
-    if (image[p] < dval)
-    {
-      dval = image[p];
-    }
-    if (image[p] == 0)
-    {
-      break;
-    }
-  }
-  return dval;
+  MorphologyAcrossRows<MinimumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(), 0,
+                                        &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -524,53 +618,8 @@ void PlusFidSegmentation::Erode135(PlusFidSegmentation::PixelType* dest, PlusFid
 {
   //LOG_TRACE("FidSegmentation::Erode135");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  /* Up the left side. */
-  for (unsigned int sr = m_RegionOfInterest[3] - 1; sr >= m_RegionOfInterest[1]; sr--)
-  {
-    unsigned int ir = sr;
-    unsigned int ic = m_RegionOfInterest[0];
-
-    PlusFidSegmentation::PixelType dval = ErodePoint135(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ir++, ic++; ir < m_RegionOfInterest[3] && ic < m_RegionOfInterest[2]; ir++, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[(ir + barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[clampMinBarSize(ir -1, barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val <= dval ? new_val :
-             del_val > dval ? std::min(dval, new_val) :
-             ErodePoint135(image, ir, ic);
-
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-
-  /* Across the top. */
-  for (unsigned int sc = m_RegionOfInterest[0]; sc < m_RegionOfInterest[2]; sc++)
-  {
-    unsigned int ic = sc;
-    unsigned int ir = m_RegionOfInterest[1];
-
-    PlusFidSegmentation::PixelType dval = ErodePoint135(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ir++, ic++; ir < m_RegionOfInterest[3] && ic < m_RegionOfInterest[2]; ir++, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[(ir + barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[clampMinBarSize(ir -1, barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val <= dval ? new_val :
-             del_val > dval ? std::min(dval, new_val) :
-             ErodePoint135(image, ir, ic);
-
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
+  MorphologyAcrossRows<MinimumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(), 1,
+                                        &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -583,53 +632,34 @@ void PlusFidSegmentation::ErodeCircle(PlusFidSegmentation::PixelType* dest, Plus
 
   memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
 
-  for (unsigned int ir = m_RegionOfInterest[1]; ir < m_RegionOfInterest[3]; ir++)
+  PlusThreadPool::ParallelFor(m_RegionOfInterest[1], m_RegionOfInterest[3], m_NumberOfThreads, [&](unsigned int firstRow, unsigned int endRow)
   {
-    for (unsigned int ic = m_RegionOfInterest[0]; ic < m_RegionOfInterest[2]; ic++)
+    for (unsigned int ir = firstRow; ir < endRow; ir++)
     {
-      PlusFidSegmentation::PixelType dval = UCHAR_MAX;
-      for (unsigned int sp = 0; sp < slen; sp++)
+      for (unsigned int ic = m_RegionOfInterest[0]; ic < m_RegionOfInterest[2]; ic++)
       {
-        int sr = ir + m_MorphologicalCircle[sp].X;
-        int sc = ic + m_MorphologicalCircle[sp].Y;
-        PlusFidSegmentation::PixelType pixSrc = image[sr * m_FrameSize[0] + sc];
-
-        if (pixSrc < dval)
+        PlusFidSegmentation::PixelType dval = UCHAR_MAX;
+        for (unsigned int sp = 0; sp < slen; sp++)
         {
-          dval = pixSrc;
-        }
+          int sr = ir + m_MorphologicalCircle[sp].X;
+          int sc = ic + m_MorphologicalCircle[sp].Y;
+          PlusFidSegmentation::PixelType pixSrc = image[sr * m_FrameSize[0] + sc];
 
-        if (pixSrc == 0)
-        {
-          break;
-        }
-      }
-
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::DilatePoint0(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::DilatePoint0");
+          if (pixSrc < dval)
+          {
+            dval = pixSrc;
+          }
 
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = 0;
-  unsigned int p = ir * m_FrameSize[0] + clampMinBarSize(ic, barSize);
-  unsigned int p_max = ir * m_FrameSize[0] + ic + barSize;
+          if (pixSrc == 0)
+          {
+            break;
+          }
+        }
 
-  for (; p <= p_max; p++)
-  {
-    if (image[p] > dval)
-    {
-      dval = image[p];
+        dest[ir * m_FrameSize[0] + ic] = dval;
+      }
     }
-  }
-
-  return dval;
+  });
 }
 
 //-----------------------------------------------------------------------------
@@ -638,65 +668,8 @@ void PlusFidSegmentation::Dilate0(PlusFidSegmentation::PixelType* dest, PlusFidS
 {
   //LOG_TRACE("FidSegmentation::Dilate0");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  for (unsigned int ir = m_RegionOfInterest[1]; ir < m_RegionOfInterest[3]; ir++)
-  {
-    unsigned int ic = m_RegionOfInterest[0];
-    unsigned int p_base = ir * m_FrameSize[0];
-
-    PlusFidSegmentation::PixelType dval = DilatePoint0(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ic++; ic < m_RegionOfInterest[2]; ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[p_base + ic + barSize];
-      PlusFidSegmentation::PixelType del_val = image[p_base + clampMinBarSize(ic - 1, barSize)];
-
-      dval = new_val >= dval ? new_val :
-             (del_val < dval ? std::max(dval, new_val) :
-              DilatePoint0(image, ir, ic));
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::DilatePoint45(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::DilatePoint45");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = 0;
-  unsigned int p = (ir + barSize) * m_FrameSize[0] + clampMinBarSize(ic, barSize);
-  unsigned int p_max = clampMinBarSize(ir, barSize) * m_FrameSize[0] + ic + barSize;
-
-  while (p >= p_max)
-  {
-    if (image[p] > dval)
-    {
-      dval = image[p];
-    }
-    if (p - m_FrameSize[0] + 1 > p)
-    {
-      // unsigned int underflow, adjust
-      p = 0;
-    }
-    else
-    {
-      p = p - m_FrameSize[0] + 1;
-    }
-  }
-
-  return dval;
-}
-
-inline unsigned int PlusFidSegmentation::clampMinBarSize(unsigned int ir, unsigned int barSize) {
-  int irMinusBar = (int)ir - (int)barSize;
-  return (unsigned int)irMinusBar < 0 ? 0 : irMinusBar;
+  MorphologyAlongRows<MaximumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(),
+                                       &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -705,70 +678,8 @@ void PlusFidSegmentation::Dilate45(PlusFidSegmentation::PixelType* dest, PlusFid
 {
   //LOG_TRACE("FidSegmentation::Dilate45");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  /* Down the left side. */
-  for (unsigned int sr = m_RegionOfInterest[1]; sr < m_RegionOfInterest[3]; sr++)
-  {
-    unsigned int ir = sr;
-    unsigned int ic = m_RegionOfInterest[0];
-
-
-    PlusFidSegmentation::PixelType dval = DilatePoint45(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval ;
-    for (ir--, ic++; ir >= m_RegionOfInterest[1] && ic < m_RegionOfInterest[2]; ir--, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[clampMinBarSize(ir, barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[(ir + 1 + barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val >= dval ? new_val :
-             (del_val < dval ? std::max(dval, new_val) :
-              DilatePoint45(image, ir, ic));
-      dest[ir * m_FrameSize[0] + ic] = dval ;
-    }
-  }
-
-  /* Across the bottom */
-  for (unsigned int sc = m_RegionOfInterest[0]; sc < m_RegionOfInterest[2]; sc++)
-  {
-    unsigned int ic = sc;
-    unsigned int ir = m_RegionOfInterest[3] - 1;
-
-    PlusFidSegmentation::PixelType dval = DilatePoint45(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval ;
-    for (ir--, ic++; ir >= m_RegionOfInterest[1] && ic < m_RegionOfInterest[2]; ir--, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[clampMinBarSize(ir, barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[(ir + 1 + barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val >= dval ? new_val :
-             (del_val < dval ? std::max(dval, new_val) :
-              DilatePoint45(image, ir, ic));
-      dest[ir * m_FrameSize[0] + ic] = dval ;
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::DilatePoint90(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::DilatePoint90");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = 0;
-  unsigned int p = clampMinBarSize(ir, barSize) * m_FrameSize[0] + ic;
-  unsigned int p_max = (ir + barSize) * m_FrameSize[0] + ic;
-
-  for (; p <= p_max; p += m_FrameSize[0])
-  {
-    if (image[p] > dval)
-    {
-      dval = image[p];
-    }
-  }
-  return dval;
+  MorphologyAcrossRows<MaximumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(), -1,
+                                        &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -777,48 +688,8 @@ void PlusFidSegmentation::Dilate90(PlusFidSegmentation::PixelType* dest, PlusFid
 {
   //LOG_TRACE("FidSegmentation::Dilate90");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  for (unsigned int ic = m_RegionOfInterest[0]; ic < m_RegionOfInterest[2]; ic++)
-  {
-    unsigned int ir = m_RegionOfInterest[1];
-
-    PlusFidSegmentation::PixelType dval = DilatePoint90(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval ;
-    for (ir++; ir < m_RegionOfInterest[3]; ir++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[(ir + barSize) * m_FrameSize[0] + ic];
-      PlusFidSegmentation::PixelType del_val = image[clampMinBarSize(ir -1, barSize) * m_FrameSize[0] + ic];
-
-      dval = new_val >= dval ? new_val :
-             (del_val < dval ? std::max(dval, new_val) :
-              DilatePoint90(image, ir, ic));
-
-      dest[ir * m_FrameSize[0] + ic] = dval ;
-    }
-  }
-}
-
-//-----------------------------------------------------------------------------
-
-inline PlusFidSegmentation::PixelType PlusFidSegmentation::DilatePoint135(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic)
-{
-  //LOG_TRACE("FidSegmentation::DilatePoint135");
-
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-  PlusFidSegmentation::PixelType dval = 0;
-  unsigned int p = clampMinBarSize(ir, barSize) * m_FrameSize[0] + clampMinBarSize(ic, barSize);
-  unsigned int p_max = (ir + barSize) * m_FrameSize[0] + ic + barSize;
-
-  for (; p <= p_max; p = p + m_FrameSize[0] + 1)
-  {
-    if (image[p] > dval)
-    {
-      dval = image[p];
-    }
-  }
-  return dval;
+  MorphologyAcrossRows<MaximumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(), 0,
+                                        &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -827,48 +698,8 @@ void PlusFidSegmentation::Dilate135(PlusFidSegmentation::PixelType* dest, PlusFi
 {
   //LOG_TRACE("FidSegmentation::Dilate135");
 
-  memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-  const unsigned int barSize = GetMorphologicalOpeningBarSizePx();
-
-  /* Up the left side. */
-  for (unsigned int sr = m_RegionOfInterest[3] - 1; sr >= m_RegionOfInterest[1]; sr--)
-  {
-    unsigned int ir = sr;
-    unsigned int ic = m_RegionOfInterest[0];
-
-    PlusFidSegmentation::PixelType dval = DilatePoint135(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval ;
-    for (ir++, ic++; ir < m_RegionOfInterest[3] && ic < m_RegionOfInterest[2]; ir++, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[(ir + barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[clampMinBarSize(ir -1, barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val >= dval ? new_val :
-             (del_val < dval ? std::max(dval, new_val) :
-              DilatePoint135(image, ir, ic));
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
-
-  /* Across the top. */
-  for (unsigned int sc = m_RegionOfInterest[0]; sc < m_RegionOfInterest[2]; sc++)
-  {
-    unsigned int ic = sc;
-    unsigned int ir = m_RegionOfInterest[1];
-
-    PlusFidSegmentation::PixelType dval = DilatePoint135(image, ir, ic);
-    dest[ir * m_FrameSize[0] + ic] = dval;
-    for (ir++, ic++; ir < m_RegionOfInterest[3] && ic < m_RegionOfInterest[2]; ir++, ic++)
-    {
-      PlusFidSegmentation::PixelType new_val = image[(ir + barSize) * m_FrameSize[0] + (ic + barSize)];
-      PlusFidSegmentation::PixelType del_val = image[clampMinBarSize(ir -1, barSize) * m_FrameSize[0] + clampMinBarSize(ic -1, barSize)];
-
-      dval = new_val >= dval ? new_val :
-             (del_val < dval ? std::max(dval, new_val) :
-              DilatePoint135(image, ir, ic));
-      dest[ir * m_FrameSize[0] + ic] = dval;
-    }
-  }
+  MorphologyAcrossRows<MaximumOperator>(dest, image, m_FrameSize, m_RegionOfInterest, GetMorphologicalOpeningBarSizePx(), 1,
+                                        &m_MorphologyForwardBuffer[0], &m_MorphologyBackwardBuffer[0], m_NumberOfThreads);
 }
 
 //-----------------------------------------------------------------------------
@@ -944,36 +775,39 @@ void PlusFidSegmentation::DilateCircle(PlusFidSegmentation::PixelType* dest, Plu
   delete [] sr_exist;
 
   memset(dest, 0, m_FrameSize[1]*m_FrameSize[0]*sizeof(PlusFidSegmentation::PixelType));
-  for (unsigned int ir = m_RegionOfInterest[1]; ir < m_RegionOfInterest[3]; ir++)
+  PlusThreadPool::ParallelFor(m_RegionOfInterest[1], m_RegionOfInterest[3], m_NumberOfThreads, [&](unsigned int firstRow, unsigned int endRow)
   {
-    unsigned int ic = m_RegionOfInterest[0];
-
-    PlusFidSegmentation::PixelType dval = DilatePoint(image, ir, ic, shape, slen);
-    PlusFidSegmentation::PixelType last = dest[ir * m_FrameSize[0] + ic] = dval;
-
-    for (ic++; ic < m_RegionOfInterest[2]; ic++)
+    for (unsigned int ir = firstRow; ir < endRow; ir++)
     {
-      PlusFidSegmentation::PixelType dval = DilatePoint(image, ir, ic, newDots, nNewDots);
+      unsigned int ic = m_RegionOfInterest[0];
 
-      if (dval < last)
+      PlusFidSegmentation::PixelType dval = DilatePoint(image, ir, ic, shape, slen);
+      PlusFidSegmentation::PixelType last = dest[ir * m_FrameSize[0] + ic] = dval;
+
+      for (ic++; ic < m_RegionOfInterest[2]; ic++)
       {
-        for (int sp = 0; sp < nOldDots; sp++)
+        PlusFidSegmentation::PixelType dval = DilatePoint(image, ir, ic, newDots, nNewDots);
+
+        if (dval < last)
         {
-          unsigned int sr = ir + oldDots[sp].Y;
-          unsigned int sc = ic + oldDots[sp].X;
-          if (image[sr * m_FrameSize[0] + sc] > dval)
+          for (int sp = 0; sp < nOldDots; sp++)
           {
-            dval = image[sr * m_FrameSize[0] + sc];
-          }
-          if (image[sr * m_FrameSize[0] + sc] == last)
-          {
-            break;
+            unsigned int sr = ir + oldDots[sp].Y;
+            unsigned int sc = ic + oldDots[sp].X;
+            if (image[sr * m_FrameSize[0] + sc] > dval)
+            {
+              dval = image[sr * m_FrameSize[0] + sc];
+            }
+            if (image[sr * m_FrameSize[0] + sc] == last)
+            {
+              break;
+            }
           }
         }
+        last = dest[ir * m_FrameSize[0] + ic] = dval ;
       }
-      last = dest[ir * m_FrameSize[0] + ic] = dval ;
     }
-  }
+  });
   delete [] newDots;
   delete [] oldDots;
 }
@@ -1200,7 +1034,18 @@ void PlusFidSegmentation::Subtract(PlusFidSegmentation::PixelType* image, PlusFi
 {
   //LOG_TRACE("FidSegmentation::Subtract");
 
-  for (unsigned int pos = m_FrameSize[1] * m_FrameSize[0]; pos > 0; pos--)
+  unsigned int pos = m_FrameSize[1] * m_FrameSize[0];
+#ifdef PLUS_FID_SEGMENTATION_SSE2
+  // Saturating subtraction of 16 pixels at once
+  for (; pos >= 16; pos -= 16)
+  {
+    __m128i result = _mm_subs_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(image)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(vals)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(image), result);
+    image += 16;
+    vals += 16;
+  }
+#endif
+  for (; pos > 0; pos--)
   {
     *image = *vals > *image ? 0 : *image - *vals;
     image++;
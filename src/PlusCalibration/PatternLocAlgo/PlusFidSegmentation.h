@@ -11,6 +11,7 @@
 #include "PlusConfigure.h"
 #include "vtkXMLDataElement.h"
 #include <string.h>
+#include <vector>
 
 //-----------------------------------------------------------------------------
 
@@ -70,6 +71,10 @@ public:
   PlusFidSegmentation();
   virtual ~PlusFidSegmentation();
 
+  /*! Copy all parameters and the current state. The copy allocates its own image buffers, so it can be used on another thread. */
+  PlusFidSegmentation(const PlusFidSegmentation& other);
+  PlusFidSegmentation& operator=(const PlusFidSegmentation& other);
+
   /* Read the configuration file */
   PlusStatus ReadConfiguration(vtkXMLDataElement* rootConfigElement);
 
@@ -86,23 +91,19 @@ public:
   /*! Check and modify if necessary the region of interest */
   void ValidateRegionOfInterest();
 
-  /*! Morphological operations performed by the algorithm */
-  inline PlusFidSegmentation::PixelType ErodePoint0(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
+  /*!
+    Morphological operations performed by the algorithm. The bar shaped structuring elements (0, 45, 90, 135 deg)
+    are computed by the van Herk/Gil-Werman algorithm, so the cost per pixel does not depend on the bar size.
+    Only the region of interest is computed, pixels outside of it are set to 0.
+  */
   void Erode0(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType ErodePoint45(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Erode45(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType ErodePoint90(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Erode90(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType ErodePoint135(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Erode135(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
   void ErodeCircle(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType DilatePoint0(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Dilate0(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType DilatePoint45(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Dilate45(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType DilatePoint90(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Dilate90(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
-  inline PlusFidSegmentation::PixelType DilatePoint135(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic);
   void Dilate135(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
   inline PlusFidSegmentation::PixelType DilatePoint(PlusFidSegmentation::PixelType* image, unsigned int ir, unsigned int ic, PlusCoordinate2D* shape, int slen);
   void DilateCircle(PlusFidSegmentation::PixelType* dest, PlusFidSegmentation::PixelType* image);
@@ -171,6 +172,18 @@ public:
   /*! Get the size of the bar for the morphological operations */
   unsigned int GetMorphologicalOpeningBarSizePx();
 
+  /*! Get the circle shaped structuring element (offsets from the center pixel) */
+  const std::vector<PlusCoordinate2D>& GetMorphologicalCircle() const { return m_MorphologicalCircle; };
+
+  /*!
+    Set the number of threads used for the morphological operations. If 0 (default) then the number of hardware threads is used.
+    PlusFidPatternRecognition uses the same number of threads for processing frames of a tracked frame list in parallel.
+  */
+  void SetNumberOfThreads(int value) { m_NumberOfThreads = value; };
+
+  /*! Get the number of threads used for the morphological operations. If 0 then the number of hardware threads is used. */
+  int GetNumberOfThreads() { return m_NumberOfThreads; };
+
   /*! Get the size of the frame as an array */
   FrameSizeType GetFrameSize() { return m_FrameSize; };
 
@@ -262,7 +275,12 @@ protected:
 
   bool m_DebugOutput;
 
-  unsigned int clampMinBarSize(unsigned int ir, unsigned int barSize);
+  /*! Number of threads used for the morphological operations, 0 means the number of hardware threads */
+  int m_NumberOfThreads;
+
+  /*! Work buffers of the van Herk/Gil-Werman algorithm (running min/max from the start and from the end of each block), reused between frames */
+  std::vector<PlusFidSegmentation::PixelType> m_MorphologyForwardBuffer;
+  std::vector<PlusFidSegmentation::PixelType> m_MorphologyBackwardBuffer;
 };
 
 #endif // _FIDUCIAL_SEGMENTATION_H
@@ -0,0 +1,201 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PatternLocParallelTest.cxx
+  \brief Checks that pattern recognition on a tracked frame list gives the same results on one and on multiple threads
+
+  The image sequence is segmented twice: once on a single thread and once on multiple threads.
+  The found fiducial positions of every frame, the number and indices of successfully segmented frames,
+  the returned error and the state of the algorithm after the call must be identical.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusFidPatternRecognition.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkIGSIOSequenceIO.h"
+#include "vtkIGSIOTrackedFrameList.h"
+
+// VTK includes
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+  struct RecognitionResult
+  {
+    PlusStatus Status;
+    PlusFidPatternRecognition::PatternRecognitionError Error;
+    int NumberOfSuccessfullySegmentedImages;
+    std::vector<unsigned int> SegmentedFramesIndices;
+    std::vector< std::vector<double> > LastFrameFoundDots;
+    double ElapsedTimeSec;
+  };
+
+  //-----------------------------------------------------------------------------
+  PlusStatus RecognizePattern(vtkXMLDataElement* configRootElement, const std::string& inputImageSequenceFileName, int numberOfThreads,
+                              vtkIGSIOTrackedFrameList* trackedFrameList, RecognitionResult& result)
+  {
+    if (vtkIGSIOSequenceIO::Read(inputImageSequenceFileName, trackedFrameList) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read sequence metafile: " << inputImageSequenceFileName);
+      return PLUS_FAIL;
+    }
+
+    PlusFidPatternRecognition patternRecognition;
+    if (patternRecognition.ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read pattern recognition configuration");
+      return PLUS_FAIL;
+    }
+    patternRecognition.GetFidSegmentation()->SetNumberOfThreads(numberOfThreads);
+
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    result.Status = patternRecognition.RecognizePattern(trackedFrameList, result.Error, &result.NumberOfSuccessfullySegmentedImages, &result.SegmentedFramesIndices);
+    result.ElapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+    result.LastFrameFoundDots = patternRecognition.GetFidLabeling()->GetFoundDotsCoordinateValue();
+    return PLUS_SUCCESS;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  std::string inputConfigFileName;
+  std::string inputImageSequenceFileName;
+  int numberOfThreads = 0;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  args.AddArgument("--config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputConfigFileName, "Calibration configuration file name");
+  args.AddArgument("--img-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputImageSequenceFileName, "Filename of the input image sequence. Segmentation will be performed for all frames of the sequence.");
+  args.AddArgument("--number-of-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of threads of the multithreaded measurement. If 0 then the number of hardware threads is used (default: 0)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (inputImageSequenceFileName.empty() || inputConfigFileName.empty())
+  {
+    std::cerr << "At lease one of the following parameters is missing: --img-seq-file, --config-file" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (numberOfThreads <= 0)
+  {
+    // Make sure that multiple workers are used even on a single-core machine
+    numberOfThreads = std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::New();
+  if (PlusXmlUtils::ReadDeviceSetConfigurationFromFile(configRootElement, inputConfigFileName.c_str()) == PLUS_FAIL)
+  {
+    LOG_ERROR("Unable to read configuration from file " << inputConfigFileName);
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> singleThreadedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> multiThreadedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  RecognitionResult singleThreadedResult;
+  RecognitionResult multiThreadedResult;
+  if (RecognizePattern(configRootElement, inputImageSequenceFileName, 1, singleThreadedFrameList, singleThreadedResult) != PLUS_SUCCESS
+      || RecognizePattern(configRootElement, inputImageSequenceFileName, numberOfThreads, multiThreadedFrameList, multiThreadedResult) != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Pattern recognition of " << singleThreadedFrameList->GetNumberOfTrackedFrames() << " frames: "
+           << singleThreadedResult.ElapsedTimeSec << " sec on 1 thread, "
+           << multiThreadedResult.ElapsedTimeSec << " sec on " << numberOfThreads << " threads (speedup: "
+           << singleThreadedResult.ElapsedTimeSec / std::max(multiThreadedResult.ElapsedTimeSec, 1e-9) << ")");
+
+  int numberOfErrors(0);
+  if (singleThreadedResult.Status != multiThreadedResult.Status || singleThreadedResult.Error != multiThreadedResult.Error)
+  {
+    LOG_ERROR("Returned status or error differs: " << singleThreadedResult.Status << "/" << singleThreadedResult.Error
+              << " (1 thread) vs. " << multiThreadedResult.Status << "/" << multiThreadedResult.Error << " (" << numberOfThreads << " threads)");
+    numberOfErrors++;
+  }
+  if (singleThreadedResult.NumberOfSuccessfullySegmentedImages != multiThreadedResult.NumberOfSuccessfullySegmentedImages
+      || singleThreadedResult.SegmentedFramesIndices != multiThreadedResult.SegmentedFramesIndices)
+  {
+    LOG_ERROR("Successfully segmented frames differ: " << singleThreadedResult.NumberOfSuccessfullySegmentedImages
+              << " (1 thread) vs. " << multiThreadedResult.NumberOfSuccessfullySegmentedImages << " (" << numberOfThreads << " threads)");
+    numberOfErrors++;
+  }
+  if (singleThreadedResult.LastFrameFoundDots != multiThreadedResult.LastFrameFoundDots)
+  {
+    LOG_ERROR("Labeling state after processing the last frame differs");
+    numberOfErrors++;
+  }
+
+  for (unsigned int frameIndex = 0; frameIndex < singleThreadedFrameList->GetNumberOfTrackedFrames(); frameIndex++)
+  {
+    vtkPoints* singleThreadedPoints = singleThreadedFrameList->GetTrackedFrame(frameIndex)->GetFiducialPointsCoordinatePx();
+    vtkPoints* multiThreadedPoints = multiThreadedFrameList->GetTrackedFrame(frameIndex)->GetFiducialPointsCoordinatePx();
+    if ((singleThreadedPoints == NULL) != (multiThreadedPoints == NULL))
+    {
+      LOG_ERROR("Frame " << frameIndex << " is segmented only on " << (singleThreadedPoints == NULL ? "multiple threads" : "a single thread"));
+      numberOfErrors++;
+      continue;
+    }
+    if (singleThreadedPoints == NULL)
+    {
+      continue;
+    }
+    if (singleThreadedPoints->GetNumberOfPoints() != multiThreadedPoints->GetNumberOfPoints())
+    {
+      LOG_ERROR("Number of fiducials differs in frame " << frameIndex << ": " << singleThreadedPoints->GetNumberOfPoints()
+                << " (1 thread) vs. " << multiThreadedPoints->GetNumberOfPoints() << " (" << numberOfThreads << " threads)");
+      numberOfErrors++;
+      continue;
+    }
+    for (vtkIdType pointIndex = 0; pointIndex < singleThreadedPoints->GetNumberOfPoints(); pointIndex++)
+    {
+      double singleThreadedPoint[3] = {0, 0, 0};
+      double multiThreadedPoint[3] = {0, 0, 0};
+      singleThreadedPoints->GetPoint(pointIndex, singleThreadedPoint);
+      multiThreadedPoints->GetPoint(pointIndex, multiThreadedPoint);
+      if (singleThreadedPoint[0] != multiThreadedPoint[0] || singleThreadedPoint[1] != multiThreadedPoint[1])
+      {
+        LOG_ERROR("Fiducial " << pointIndex << " position differs in frame " << frameIndex << ": (" << singleThreadedPoint[0] << ", " << singleThreadedPoint[1]
+                  << ") (1 thread) vs. (" << multiThreadedPoint[0] << ", " << multiThreadedPoint[1] << ") (" << numberOfThreads << " threads)");
+        numberOfErrors++;
+      }
+    }
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,294 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusFidSegmentationBenchmark.cxx
+  \brief Measures the speed of the morphological operations of PlusFidSegmentation
+
+  Every frame of the input sequence is processed with a straightforward per-pixel window
+  scan (reference), with the optimized implementation on a single thread and with the optimized
+  implementation on multiple threads. The results of the optimized implementation must be
+  identical to the reference; the processing times are reported for each measurement.
+  With --roi-near-image-border the region of interest starts closer to the image border than the bar size,
+  which tests that the bars are clipped at the border.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusFidSegmentation.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkIGSIOSequenceIO.h"
+#include "vtkIGSIOTrackedFrameList.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  typedef PlusFidSegmentation::PixelType PixelType;
+
+  //-----------------------------------------------------------------------------
+  // Minimum (erode) or maximum (dilate) of the pixels along a bar centered on each pixel of the region of interest.
+  // The bar is barSize pixels long in both directions, one step along the bar moves rowStep rows and columnStep columns.
+  // Pixels of the bar that are outside of the image are ignored.
+  void ReferenceBarOperation(PixelType* dest, const PixelType* image, const FrameSizeType& frameSize, const unsigned int roi[4],
+                             int barSize, int rowStep, int columnStep, bool dilate)
+  {
+    memset(dest, 0, frameSize[0] * frameSize[1] * sizeof(PixelType));
+    for (int r = roi[1]; r < static_cast<int>(roi[3]); r++)
+    {
+      for (int c = roi[0]; c < static_cast<int>(roi[2]); c++)
+      {
+        PixelType value = dilate ? 0 : UCHAR_MAX;
+        for (int k = -barSize; k <= barSize; k++)
+        {
+          int row = r + k * rowStep;
+          int column = c + k * columnStep;
+          if (row < 0 || column < 0 || row >= static_cast<int>(frameSize[1]) || column >= static_cast<int>(frameSize[0]))
+          {
+            continue;
+          }
+          PixelType pixel = image[row * frameSize[0] + column];
+          value = dilate ? std::max(value, pixel) : std::min(value, pixel);
+        }
+        dest[r * frameSize[0] + c] = value;
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  // Erosion uses the X coordinate of the circle as row offset, dilation as column offset (same as PlusFidSegmentation)
+  void ReferenceCircleOperation(PixelType* dest, const PixelType* image, const FrameSizeType& frameSize, const unsigned int roi[4],
+                                const std::vector<PlusCoordinate2D>& circle, bool dilate)
+  {
+    memset(dest, 0, frameSize[0] * frameSize[1] * sizeof(PixelType));
+    for (int r = roi[1]; r < static_cast<int>(roi[3]); r++)
+    {
+      for (int c = roi[0]; c < static_cast<int>(roi[2]); c++)
+      {
+        PixelType value = dilate ? 0 : UCHAR_MAX;
+        for (std::vector<PlusCoordinate2D>::const_iterator dot = circle.begin(); dot != circle.end(); ++dot)
+        {
+          int rowOffset = dilate ? dot->Y : dot->X;
+          int columnOffset = dilate ? dot->X : dot->Y;
+          PixelType pixel = image[(r + rowOffset) * frameSize[0] + c + columnOffset];
+          value = dilate ? std::max(value, pixel) : std::min(value, pixel);
+        }
+        dest[r * frameSize[0] + c] = value;
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  // Same sequence of operations as PlusFidSegmentation::MorphologicalOperations, result is written to working
+  void ReferenceMorphologicalOperations(std::vector<PixelType>& working, const FrameSizeType& frameSize, const unsigned int roi[4],
+                                        int barSize, const std::vector<PlusCoordinate2D>& circle)
+  {
+    std::vector<PixelType> eroded(working.size());
+    std::vector<PixelType> dilated(working.size());
+    // Bar directions: 0, 45, 90, 135 deg
+    const int rowSteps[4] = {0, -1, 1, 1};
+    const int columnSteps[4] = {1, 1, 0, 1};
+    for (int direction = 0; direction < 4; direction++)
+    {
+      ReferenceBarOperation(&eroded[0], &working[0], frameSize, roi, barSize, rowSteps[direction], columnSteps[direction], false);
+      ReferenceBarOperation(&dilated[0], &eroded[0], frameSize, roi, barSize, rowSteps[direction], columnSteps[direction], true);
+      for (unsigned int i = 0; i < working.size(); i++)
+      {
+        working[i] = dilated[i] > working[i] ? 0 : working[i] - dilated[i];
+      }
+    }
+    ReferenceCircleOperation(&eroded[0], &working[0], frameSize, roi, circle, false);
+    ReferenceCircleOperation(&working[0], &eroded[0], frameSize, roi, circle, true);
+  }
+
+  //-----------------------------------------------------------------------------
+  // Returns processing time in seconds
+  double RunMorphologicalOperations(PlusFidSegmentation& segmentation, const PixelType* image, unsigned int numberOfPixels, int numberOfRepetitions,
+                                    std::vector<PixelType>& result)
+  {
+    double elapsedTimeSec = 0;
+    for (int repetition = 0; repetition < numberOfRepetitions; repetition++)
+    {
+      memcpy(segmentation.GetWorking(), image, numberOfPixels * sizeof(PixelType));
+      double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+      segmentation.MorphologicalOperations();
+      elapsedTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+    }
+    result.assign(segmentation.GetWorking(), segmentation.GetWorking() + numberOfPixels);
+    return elapsedTimeSec / numberOfRepetitions;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  std::string inputConfigFileName;
+  std::string inputImageSequenceFileName;
+  int numberOfThreads = 0;
+  int numberOfRepetitions = 3;
+  int maxNumberOfFrames = 10;
+  bool roiNearImageBorder(false);
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  args.AddArgument("--config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputConfigFileName, "Configuration file name containing the segmentation parameters");
+  args.AddArgument("--img-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputImageSequenceFileName, "Filename of the input image sequence");
+  args.AddArgument("--number-of-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of threads of the multithreaded measurement. If 0 then the number of hardware threads is used (default: 0)");
+  args.AddArgument("--number-of-repetitions", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfRepetitions, "Number of times each frame is processed in each optimized measurement (default: 3)");
+  args.AddArgument("--max-number-of-frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxNumberOfFrames, "Maximum number of frames processed from the input sequence (default: 10)");
+  args.AddArgument("--roi-near-image-border", vtksys::CommandLineArguments::NO_ARGUMENT, &roiNearImageBorder, "Start the region of interest at half of the bar size from the top left corner of the image");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (inputImageSequenceFileName.empty() || inputConfigFileName.empty())
+  {
+    std::cerr << "At lease one of the following parameters is missing: --img-seq-file, --config-file" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (numberOfThreads <= 0)
+  {
+    numberOfThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  numberOfRepetitions = std::max(1, numberOfRepetitions);
+
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::New();
+  if (PlusXmlUtils::ReadDeviceSetConfigurationFromFile(configRootElement, inputConfigFileName.c_str()) == PLUS_FAIL)
+  {
+    LOG_ERROR("Unable to read configuration from file " << inputConfigFileName);
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  if (vtkIGSIOSequenceIO::Read(inputImageSequenceFileName, trackedFrameList) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to read sequence metafile: " << inputImageSequenceFileName);
+    return EXIT_FAILURE;
+  }
+
+  PlusFidSegmentation segmentation;
+  if (segmentation.ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to read segmentation configuration from file " << inputConfigFileName);
+    return EXIT_FAILURE;
+  }
+
+  int numberOfErrors(0);
+  double sumReferenceTimeSec(0), sumSingleThreadedTimeSec(0), sumMultiThreadedTimeSec(0);
+  unsigned int numberOfFrames = std::min(trackedFrameList->GetNumberOfTrackedFrames(), static_cast<unsigned int>(std::max(1, maxNumberOfFrames)));
+  LOG_INFO("Processing " << numberOfFrames << " frames, multithreaded measurement uses " << numberOfThreads << " threads");
+  LOG_INFO("Frame | Reference (ms) | 1 thread (ms) | N threads (ms) | Speedup");
+  for (unsigned int frameIndex = 0; frameIndex < numberOfFrames; frameIndex++)
+  {
+    igsioTrackedFrame* trackedFrame = trackedFrameList->GetTrackedFrame(frameIndex);
+    if (trackedFrame->GetImageData()->GetVTKScalarPixelType() != VTK_UNSIGNED_CHAR)
+    {
+      LOG_ERROR("Only 8-bit images are supported (frame " << frameIndex << ")");
+      numberOfErrors++;
+      continue;
+    }
+
+    FrameSizeType frameSize = trackedFrame->GetFrameSize();
+    unsigned int numberOfPixels = frameSize[0] * frameSize[1];
+    const PixelType* image = reinterpret_cast<PixelType*>(trackedFrame->GetImageData()->GetScalarPointer());
+    segmentation.SetFrameSize(frameSize);
+    unsigned int roiOrigin = segmentation.GetMorphologicalOpeningBarSizePx() / 2;
+    if (roiNearImageBorder)
+    {
+      // Bars of the pixels near the top left corner of the region of interest reach over the image border
+      segmentation.SetRegionOfInterest(roiOrigin, roiOrigin, 0, 0);
+    }
+
+    std::vector<PixelType> singleThreadedResult;
+    std::vector<PixelType> multiThreadedResult;
+    segmentation.SetNumberOfThreads(1);
+    double singleThreadedTimeSec = RunMorphologicalOperations(segmentation, image, numberOfPixels, numberOfRepetitions, singleThreadedResult);
+    segmentation.SetNumberOfThreads(numberOfThreads);
+    double multiThreadedTimeSec = RunMorphologicalOperations(segmentation, image, numberOfPixels, numberOfRepetitions, multiThreadedResult);
+
+    // The region of interest is validated by MorphologicalOperations, so it is only retrieved afterwards
+    unsigned int roi[4] = {0, 0, 0, 0};
+    segmentation.GetRegionOfInterest(roi[0], roi[1], roi[2], roi[3]);
+    if (roiNearImageBorder && (roiOrigin == 0 || roi[0] != roiOrigin || roi[1] != roiOrigin))
+    {
+      LOG_ERROR("Region of interest origin near the image border is not kept: requested (" << roiOrigin << ", " << roiOrigin << "), actual (" << roi[0] << ", " << roi[1] << ")");
+      numberOfErrors++;
+    }
+    std::vector<PixelType> referenceResult(image, image + numberOfPixels);
+    double referenceTimeSec = 0;
+    if (roi[2] > 0 && roi[3] > 0 && roi[0] < roi[2] && roi[1] < roi[3])
+    {
+      double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+      ReferenceMorphologicalOperations(referenceResult, frameSize, roi, segmentation.GetMorphologicalOpeningBarSizePx(), segmentation.GetMorphologicalCircle());
+      referenceTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+    }
+
+    if (singleThreadedResult != referenceResult)
+    {
+      LOG_ERROR("Result of the single-threaded morphological operations differs from the reference (frame " << frameIndex << ")");
+      numberOfErrors++;
+    }
+    if (multiThreadedResult != referenceResult)
+    {
+      LOG_ERROR("Result of the morphological operations on " << numberOfThreads << " threads differs from the reference (frame " << frameIndex << ")");
+      numberOfErrors++;
+    }
+
+    sumReferenceTimeSec += referenceTimeSec;
+    sumSingleThreadedTimeSec += singleThreadedTimeSec;
+    sumMultiThreadedTimeSec += multiThreadedTimeSec;
+
+    std::ostringstream row;
+    row << std::setw(5) << frameIndex << " | " << std::setw(14) << std::fixed << std::setprecision(2) << referenceTimeSec * 1000.0
+        << " | " << std::setw(13) << singleThreadedTimeSec * 1000.0
+        << " | " << std::setw(14) << multiThreadedTimeSec * 1000.0
+        << " | " << referenceTimeSec / std::max(multiThreadedTimeSec, 1e-9);
+    LOG_INFO(row.str());
+  }
+
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(2) << "Total: reference " << sumReferenceTimeSec * 1000.0 << " ms, 1 thread " << sumSingleThreadedTimeSec * 1000.0
+          << " ms, " << numberOfThreads << " threads " << sumMultiThreadedTimeSec * 1000.0 << " ms, speedup " << sumReferenceTimeSec / std::max(sumMultiThreadedTimeSec, 1e-9);
+  LOG_INFO(summary.str());
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
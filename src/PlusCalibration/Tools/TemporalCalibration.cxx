@@ -199,6 +199,7 @@ int main(int argc, char** argv)
   std::vector<int> clipRectOrigin;
   std::vector<int> clipRectSize;
   std::string inputBaselineFileName;
+  std::string lagSearchMethod("BRUTE_FORCE");
 
   vtksys::CommandLineArguments args;
   args.Initialize(argc, argv);
@@ -216,6 +217,7 @@ int main(int argc, char** argv)
   args.AddArgument("--intermediate-file-output-dir", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &intermediateFileOutputDirectory, "Directory into which the intermediate files are written");
   args.AddArgument("--clip-rect-origin", vtksys::CommandLineArguments::MULTI_ARGUMENT, &clipRectOrigin, "Origin of the clipping rectangle");
   args.AddArgument("--clip-rect-size", vtksys::CommandLineArguments::MULTI_ARGUMENT, &clipRectSize, "Size of the clipping rectangle");
+  args.AddArgument("--lag-search-method", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &lagSearchMethod, "Method for finding the time offset: BRUTE_FORCE (evaluate alignment metric for each offset) or FFT (compute correlation for all offsets by FFT then refine by local search). Default: BRUTE_FORCE");
   args.AddArgument("--baseline-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputBaselineFileName, "Input xml baseline file name with path");
 
   if (!args.Parse())
@@ -312,6 +314,19 @@ int main(int argc, char** argv)
   testTemporalCalibrationObject->SetSaveIntermediateImages(saveIntermediateImages);
   testTemporalCalibrationObject->SetIntermediateFilesOutputDirectory(intermediateFileOutputDirectory);
   testTemporalCalibrationObject->SetMaximumMovingLagSec(maxTimeOffsetSec);
+  if (igsioCommon::IsEqualInsensitive(lagSearchMethod, "FFT"))
+  {
+    testTemporalCalibrationObject->SetLagSearchMethod(vtkPlusTemporalCalibrationAlgo::LAG_SEARCH_METHOD_FFT);
+  }
+  else if (igsioCommon::IsEqualInsensitive(lagSearchMethod, "BRUTE_FORCE"))
+  {
+    testTemporalCalibrationObject->SetLagSearchMethod(vtkPlusTemporalCalibrationAlgo::LAG_SEARCH_METHOD_BRUTE_FORCE);
+  }
+  else
+  {
+    LOG_ERROR("Invalid lag search method: " << lagSearchMethod << ". Valid values: BRUTE_FORCE, FFT");
+    exit(EXIT_FAILURE);
+  }
 
   if (clipRectOrigin.size() > 0 || clipRectSize.size() > 0)
   {
@@ -15,7 +15,10 @@
 #include "vtkTable.h"
 #include "vtkPlusTemporalCalibrationAlgo.h"
 #include "vtkIGSIOTrackedFrameList.h"
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_fft_1d.h"
 #include <algorithm>
+#include <complex>
 #include <fstream>
 #include <iostream>
 
@@ -37,6 +40,8 @@ namespace
   const double MINIMUM_SAMPLING_RESOLUTION_SEC = 0.00001;
   const double DEFAULT_SAMPLING_RESOLUTION_SEC = 0.001;
   const double DEFAULT_MAX_MOVING_LAG_SEC = 0.5;
+  // Minimum half-width of the local search around the FFT correlation peak, in sampling resolution steps
+  const int FFT_LOCAL_SEARCH_MIN_STEPS = 3;
 
   enum SignalAlignmentMetricType
   {
@@ -59,6 +64,50 @@ namespace
     AMPLITUDE
   };
   MetricNormalizationType METRIC_NORMALIZATION = STD;
+
+  //-----------------------------------------------------------------------------
+  // Returns the position of the maximum of sign*values with sub-sample accuracy, by fitting a parabola to the maximum and its two neighbors
+  double FindPeakPositionSubSample(const std::vector<double>& values, double sign)
+  {
+    int peakIndex = 0;
+    for (int i = 1; i < static_cast<int>(values.size()); ++i)
+    {
+      if (sign * values[i] > sign * values[peakIndex])
+      {
+        peakIndex = i;
+      }
+    }
+    if (peakIndex == 0 || peakIndex == static_cast<int>(values.size()) - 1)
+    {
+      // The peak is at the boundary of the search range, cannot be refined
+      return peakIndex;
+    }
+    double before = sign * values[peakIndex - 1];
+    double peak = sign * values[peakIndex];
+    double after = sign * values[peakIndex + 1];
+    double curvature = before - 2 * peak + after;
+    if (curvature > -1e-12)
+    {
+      return peakIndex;
+    }
+    return peakIndex + 0.5 * (before - after) / curvature;
+  }
+
+  //-----------------------------------------------------------------------------
+  // Alignment metric of two STD-normalized signals of numberOfSamples length that have the specified correlation coefficient
+  double CorrelationCoefficientToAlignmentMetric(double correlationCoefficient, int numberOfSamples)
+  {
+    switch (SIGNAL_ALIGNMENT_METRIC)
+    {
+      case SSD:
+        return -2.0 * (numberOfSamples - 1) * (1.0 - correlationCoefficient);
+      case CORRELATION:
+        return (numberOfSamples - 1) * correlationCoefficient;
+      default:
+        // SAD cannot be computed from the correlation coefficient
+        return correlationCoefficient;
+    }
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -68,6 +117,7 @@ vtkPlusTemporalCalibrationAlgo::vtkPlusTemporalCalibrationAlgo()
   , SaveIntermediateImages(false)
   , IntermediateFilesOutputDirectory(vtkPlusConfig::GetInstance()->GetOutputDirectory())
   , SamplingResolutionSec(DEFAULT_SAMPLING_RESOLUTION_SEC)
+  , LagSearchMethod(LAG_SEARCH_METHOD_BRUTE_FORCE)
   , BestCorrelationValue(0.0)
   , BestCorrelationLagIndex(-1)
   , BestCorrelationTimeOffset(0.0)
@@ -180,6 +230,18 @@ void vtkPlusTemporalCalibrationAlgo::SetMaximumMovingLagSec(double maxLagSec)
   this->MaxMovingLagSec = maxLagSec;
 }
 
+//-----------------------------------------------------------------------------
+void vtkPlusTemporalCalibrationAlgo::SetLagSearchMethod(LAG_SEARCH_METHOD method)
+{
+  this->LagSearchMethod = method;
+}
+
+//-----------------------------------------------------------------------------
+vtkPlusTemporalCalibrationAlgo::LAG_SEARCH_METHOD vtkPlusTemporalCalibrationAlgo::GetLagSearchMethod() const
+{
+  return this->LagSearchMethod;
+}
+
 //-----------------------------------------------------------------------------
 void vtkPlusTemporalCalibrationAlgo::SetIntermediateFilesOutputDirectory(const std::string& outputDirectory)
 {
@@ -509,6 +571,171 @@ void vtkPlusTemporalCalibrationAlgo::ComputeCorrelationBetweenFixedAndMovingSign
   LOG_DEBUG("numberOfSamples=" << corrValues.size());
 }
 
+//-----------------------------------------------------------------------------
+void vtkPlusTemporalCalibrationAlgo::ResampleSignalUniformly(const std::deque<double>& timestamps, const std::deque<double>& values,
+    double startTime, double stepSizeSec, int numberOfSamples, std::vector<double>& resampledSignalValues)
+{
+  // Same linear interpolation and clamping as the piecewise function in ResampleSignalLinearly, but in a single pass
+  resampledSignalValues.resize(numberOfSamples);
+  unsigned int segmentStartIndex = 0;
+  for (int i = 0; i < numberOfSamples; ++i)
+  {
+    double t = startTime + i * stepSizeSec;
+    if (t <= timestamps.front())
+    {
+      resampledSignalValues[i] = values.front();
+      continue;
+    }
+    if (t >= timestamps.back())
+    {
+      resampledSignalValues[i] = values.back();
+      continue;
+    }
+    while (timestamps[segmentStartIndex + 1] < t)
+    {
+      ++segmentStartIndex;
+    }
+    double segmentLengthSec = timestamps[segmentStartIndex + 1] - timestamps[segmentStartIndex];
+    double weight = (segmentLengthSec > 0) ? (t - timestamps[segmentStartIndex]) / segmentLengthSec : 0.0;
+    resampledSignalValues[i] = values[segmentStartIndex] + weight * (values[segmentStartIndex + 1] - values[segmentStartIndex]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusTemporalCalibrationAlgo::ComputeCorrelationBetweenFixedAndMovingSignalFft(double& bestTimeOffset, double& bestTimeOffsetInverted,
+    std::deque<double>& corrTimeOffsets, std::deque<double>& corrValues, std::deque<double>& corrValuesInverted)
+{
+  const double stepSizeSec = this->SamplingResolutionSec;
+  if (stepSizeSec < TIMESTAMP_EPSILON_SEC)
+  {
+    LOG_ERROR("Sampling resolution is too small: " << stepSizeSec << " sec");
+    return PLUS_FAIL;
+  }
+  if (this->FixedSignal.signalTimestamps.size() < 2 || this->MovingSignal.signalTimestamps.size() < 2)
+  {
+    LOG_ERROR("Cannot compute correlation, not enough fixed or moving signal values");
+    return PLUS_FAIL;
+  }
+
+  // Resample the fixed signal over its time range and the moving signal over the same range extended by the maximum lag
+  // on both sides, so that the moving signal values for all the tested offsets are available on the same grid.
+  double fixedStartTime = this->FixedSignal.signalTimestamps.front();
+  int numberOfFixedSamples = static_cast<int>(std::floor((this->FixedSignal.signalTimestamps.back() - fixedStartTime) / stepSizeSec)) + 1;
+  int maxLagSteps = static_cast<int>(std::floor(this->MaxMovingLagSec / stepSizeSec + 0.5));
+  int numberOfMovingSamples = numberOfFixedSamples + 2 * maxLagSteps;
+  if (numberOfFixedSamples < 3)
+  {
+    LOG_ERROR("Cannot compute correlation, fixed signal is too short for the sampling resolution of " << stepSizeSec << " sec");
+    return PLUS_FAIL;
+  }
+
+  std::vector<double> fixedValues;
+  ResampleSignalUniformly(this->FixedSignal.signalTimestamps, this->FixedSignal.signalValues, fixedStartTime, stepSizeSec, numberOfFixedSamples, fixedValues);
+  std::vector<double> movingValues;
+  ResampleSignalUniformly(this->MovingSignal.signalTimestamps, this->MovingSignal.signalValues, fixedStartTime - maxLagSteps * stepSizeSec, stepSizeSec, numberOfMovingSamples, movingValues);
+
+  // Remove the mean of the signals. The fixed signal must have zero mean so that the correlation with the moving signal
+  // window is not affected by the mean of the window. Removing the moving signal mean just improves numerical accuracy.
+  double fixedMean = 0;
+  for (int i = 0; i < numberOfFixedSamples; ++i)
+  {
+    fixedMean += fixedValues[i];
+  }
+  fixedMean /= numberOfFixedSamples;
+  double fixedSumSquares = 0;
+  for (int i = 0; i < numberOfFixedSamples; ++i)
+  {
+    fixedValues[i] -= fixedMean;
+    fixedSumSquares += fixedValues[i] * fixedValues[i];
+  }
+  if (fixedSumSquares < 1e-10)
+  {
+    LOG_ERROR("Cannot compute correlation, fixed signal is constant");
+    return PLUS_FAIL;
+  }
+  double movingMean = 0;
+  for (int i = 0; i < numberOfMovingSamples; ++i)
+  {
+    movingMean += movingValues[i];
+  }
+  movingMean /= numberOfMovingSamples;
+  for (int i = 0; i < numberOfMovingSamples; ++i)
+  {
+    movingValues[i] -= movingMean;
+  }
+
+  // Compute the correlation for all offsets as the convolution of the moving signal with the reversed fixed signal.
+  // The transform size is large enough to prevent circular wrap-around. Using convolution (instead of multiplying by the
+  // conjugate spectrum) makes the result independent of the sign convention of the forward transform.
+  int fftSize = 1;
+  while (fftSize < numberOfFixedSamples + numberOfMovingSamples - 1)
+  {
+    fftSize *= 2;
+  }
+  vnl_vector<std::complex<double> > fixedSpectrum(fftSize, std::complex<double>(0.0, 0.0));
+  vnl_vector<std::complex<double> > movingSpectrum(fftSize, std::complex<double>(0.0, 0.0));
+  for (int i = 0; i < numberOfFixedSamples; ++i)
+  {
+    fixedSpectrum[numberOfFixedSamples - 1 - i] = fixedValues[i];
+  }
+  for (int i = 0; i < numberOfMovingSamples; ++i)
+  {
+    movingSpectrum[i] = movingValues[i];
+  }
+  vnl_fft_1d<double> fft(fftSize);
+  fft.fwd_transform(fixedSpectrum);
+  fft.fwd_transform(movingSpectrum);
+  for (int i = 0; i < fftSize; ++i)
+  {
+    movingSpectrum[i] *= fixedSpectrum[i];
+  }
+  fft.bwd_transform(movingSpectrum); // not normalized, result is scaled by fftSize
+
+  // Running sums of the moving signal for computing the standard deviation of each moving signal window
+  std::vector<double> movingCumulativeSum(numberOfMovingSamples + 1, 0.0);
+  std::vector<double> movingCumulativeSumSquares(numberOfMovingSamples + 1, 0.0);
+  for (int i = 0; i < numberOfMovingSamples; ++i)
+  {
+    movingCumulativeSum[i + 1] = movingCumulativeSum[i] + movingValues[i];
+    movingCumulativeSumSquares[i + 1] = movingCumulativeSumSquares[i] + movingValues[i] * movingValues[i];
+  }
+
+  // Correlation coefficient for each offset. Offset index i corresponds to (i - maxLagSteps) * stepSizeSec time offset.
+  int numberOfOffsets = 2 * maxLagSteps + 1;
+  std::vector<double> correlationCoefficients(numberOfOffsets, 0.0);
+  for (int i = 0; i < numberOfOffsets; ++i)
+  {
+    double crossCorrelation = movingSpectrum[i + numberOfFixedSamples - 1].real() / fftSize;
+    double windowSum = movingCumulativeSum[i + numberOfFixedSamples] - movingCumulativeSum[i];
+    double windowSumSquares = movingCumulativeSumSquares[i + numberOfFixedSamples] - movingCumulativeSumSquares[i];
+    double windowVariance = windowSumSquares - windowSum * windowSum / numberOfFixedSamples;
+    if (windowVariance > 1e-10)
+    {
+      correlationCoefficients[i] = crossCorrelation / std::sqrt(fixedSumSquares * windowVariance);
+    }
+  }
+
+  // Negating the moving signal negates the correlation coefficient, therefore the best offset for sign convention #2 is at the minimum
+  bestTimeOffset = (FindPeakPositionSubSample(correlationCoefficients, 1.0) - maxLagSteps) * stepSizeSec;
+  bestTimeOffsetInverted = (FindPeakPositionSubSample(correlationCoefficients, -1.0) - maxLagSteps) * stepSizeSec;
+
+  int numberOfFixedSignalValues = this->FixedSignal.signalValues.size();
+  corrTimeOffsets.resize(numberOfOffsets);
+  corrValues.resize(numberOfOffsets);
+  corrValuesInverted.resize(numberOfOffsets);
+  for (int i = 0; i < numberOfOffsets; ++i)
+  {
+    corrTimeOffsets[i] = (i - maxLagSteps) * stepSizeSec;
+    corrValues[i] = CorrelationCoefficientToAlignmentMetric(correlationCoefficients[i], numberOfFixedSignalValues);
+    corrValuesInverted[i] = CorrelationCoefficientToAlignmentMetric(-correlationCoefficients[i], numberOfFixedSignalValues);
+  }
+
+  LOG_DEBUG("FFT correlation: fftSize=" << fftSize << ", numberOfOffsets=" << numberOfOffsets);
+  LOG_DEBUG("FFT correlation best time offset: " << bestTimeOffset << " (sign convention #1), " << bestTimeOffsetInverted << " (sign convention #2)");
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
 double vtkPlusTemporalCalibrationAlgo::ComputeAlignmentMetric(const std::deque<double>& signalA, const std::deque<double>& signalB)
 {
   if (signalA.size() != signalB.size())
@@ -699,14 +926,38 @@ PlusStatus vtkPlusTemporalCalibrationAlgo::ComputeMovingSignalLagSec(TEMPORAL_CA
 
   double searchRangeFineStep = imageFramePeriodSec * 3;
 
-  //  Compute cross correlation with sign convention #1
-  LOG_DEBUG("ComputeCorrelationBetweenFixedAndMovingSignal(sign convention #1)");
   double bestCorrelationValue = 0;
   double bestCorrelationTimeOffset = 0;
   double bestCorrelationNormalizationFactor = 1.0;
   std::deque<double> corrTimeOffsets;
   std::deque<double> corrValues;
-  ComputeCorrelationBetweenFixedAndMovingSignal(-this->MaxMovingLagSec, this->MaxMovingLagSec, imageFramePeriodSec, bestCorrelationValue, bestCorrelationTimeOffset, bestCorrelationNormalizationFactor, corrTimeOffsets, corrValues);
+  double bestCorrelationValueInvertedTracker(0);
+  double bestCorrelationTimeOffsetInvertedTracker(0);
+  double bestCorrelationNormalizationFactorInvertedTracker(1.0);
+  std::deque<double> corrTimeOffsetsInvertedTracker;
+  std::deque<double> corrValuesInvertedTracker;
+
+  if (this->LagSearchMethod == LAG_SEARCH_METHOD_FFT)
+  {
+    // The FFT provides the best offset for both sign conventions at sampling resolution accuracy,
+    // so instead of the coarse search only a small neighborhood has to be checked in the fine search
+    LOG_DEBUG("ComputeCorrelationBetweenFixedAndMovingSignalFft");
+    if (ComputeCorrelationBetweenFixedAndMovingSignalFft(bestCorrelationTimeOffset, bestCorrelationTimeOffsetInvertedTracker, corrTimeOffsets, corrValues, corrValuesInvertedTracker) != PLUS_SUCCESS)
+    {
+      error = TEMPORAL_CALIBRATION_ERROR_CORRELATION_RESULT_EMPTY;
+      LOG_ERROR("Failed to compute correlation between fixed and moving signals");
+      return PLUS_FAIL;
+    }
+    corrTimeOffsetsInvertedTracker = corrTimeOffsets;
+    searchRangeFineStep = std::max(FFT_LOCAL_SEARCH_MIN_STEPS * this->SamplingResolutionSec, imageFramePeriodSec * 0.5);
+  }
+
+  //  Compute cross correlation with sign convention #1
+  LOG_DEBUG("ComputeCorrelationBetweenFixedAndMovingSignal(sign convention #1)");
+  if (this->LagSearchMethod == LAG_SEARCH_METHOD_BRUTE_FORCE)
+  {
+    ComputeCorrelationBetweenFixedAndMovingSignal(-this->MaxMovingLagSec, this->MaxMovingLagSec, imageFramePeriodSec, bestCorrelationValue, bestCorrelationTimeOffset, bestCorrelationNormalizationFactor, corrTimeOffsets, corrValues);
+  }
   std::deque<double> corrTimeOffsetsFine;
   std::deque<double> corrValuesFine;
   ComputeCorrelationBetweenFixedAndMovingSignal(bestCorrelationTimeOffset - searchRangeFineStep, bestCorrelationTimeOffset + searchRangeFineStep, this->SamplingResolutionSec, bestCorrelationValue, bestCorrelationTimeOffset, bestCorrelationNormalizationFactor, corrTimeOffsetsFine, corrValuesFine);
@@ -719,21 +970,19 @@ PlusStatus vtkPlusTemporalCalibrationAlgo::ComputeMovingSignalLagSec(TEMPORAL_CA
   {
     this->MovingSignal.signalValues.at(i) *= -1;
   }
-  double bestCorrelationValueInvertedTracker(0);
-  double bestCorrelationTimeOffsetInvertedTracker(0);
-  double bestCorrelationNormalizationFactorInvertedTracker(1.0);
-  std::deque<double> corrTimeOffsetsInvertedTracker;
-  std::deque<double> corrValuesInvertedTracker;
-  ComputeCorrelationBetweenFixedAndMovingSignal(
-    -this->MaxMovingLagSec,
-    this->MaxMovingLagSec,
-    imageFramePeriodSec,
-    bestCorrelationValueInvertedTracker,
-    bestCorrelationTimeOffsetInvertedTracker,
-    bestCorrelationNormalizationFactorInvertedTracker,
-    corrTimeOffsetsInvertedTracker,
-    corrValuesInvertedTracker
-  );
+  if (this->LagSearchMethod == LAG_SEARCH_METHOD_BRUTE_FORCE)
+  {
+    ComputeCorrelationBetweenFixedAndMovingSignal(
+      -this->MaxMovingLagSec,
+      this->MaxMovingLagSec,
+      imageFramePeriodSec,
+      bestCorrelationValueInvertedTracker,
+      bestCorrelationTimeOffsetInvertedTracker,
+      bestCorrelationNormalizationFactorInvertedTracker,
+      corrTimeOffsetsInvertedTracker,
+      corrValuesInvertedTracker
+    );
+  }
   std::deque<double> corrTimeOffsetsInvertedTrackerFine;
   std::deque<double> corrValuesInvertedTrackerFine;
   ComputeCorrelationBetweenFixedAndMovingSignal(
@@ -894,6 +1143,9 @@ PlusStatus vtkPlusTemporalCalibrationAlgo::ReadConfiguration(vtkXMLDataElement*
   }
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(SaveIntermediateImages, calibrationParameters);
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, MaximumMovingLagSec, calibrationParameters);
+  XML_READ_ENUM2_ATTRIBUTE_OPTIONAL(LagSearchMethod, calibrationParameters,
+                                    "BRUTE_FORCE", LAG_SEARCH_METHOD_BRUTE_FORCE,
+                                    "FFT", LAG_SEARCH_METHOD_FFT);
 
   if (calibrationParameters != NULL)
   {
@@ -11,6 +11,7 @@
 #include "vtkPlusCalibrationExport.h"
 
 #include <deque>
+#include <vector>
 
 #include "vtkObject.h"
 
@@ -62,6 +63,12 @@ public:
     // (e.g., bottom of water tank)
   };
 
+  enum LAG_SEARCH_METHOD
+  {
+    LAG_SEARCH_METHOD_BRUTE_FORCE, // Evaluate the alignment metric for each candidate lag (coarse sweep with the video frame period, then fine sweep)
+    LAG_SEARCH_METHOD_FFT          // Compute the correlation for all lags at once by FFT, then refine the best lag with a short local search
+  };
+
   struct SignalType
   {
     vtkIGSIOTrackedFrameList* frameList;
@@ -105,6 +112,14 @@ public:
   /*! Sets the maximum allowable time lag between the corresponding tracker and video frames. Default is 2 seconds */
   void SetMaximumMovingLagSec(double maxLagSec);
 
+  /*!
+    Sets the method that is used for finding the lag that best aligns the signals. Default is LAG_SEARCH_METHOD_BRUTE_FORCE.
+    LAG_SEARCH_METHOD_FFT resamples both signals once with SamplingResolutionSec, computes the correlation for all lags in O(N log N),
+    and only evaluates the alignment metric directly in a small neighborhood of the correlation peak.
+  */
+  void SetLagSearchMethod(LAG_SEARCH_METHOD method);
+  LAG_SEARCH_METHOD GetLagSearchMethod() const;
+
   /*! Enable/disable saving of intermediate images for debugging. Need to call before SetVideoFrames. */
   void SetSaveIntermediateImages(bool saveIntermediateImages);
 
@@ -151,6 +166,19 @@ protected:
   PlusStatus NormalizeMetricValues(std::deque<double>& signal, double& normalizationFactor, double startTime, double stopTime, const std::deque<double>& timestamps);
   void ComputeCorrelationBetweenFixedAndMovingSignal(double minTrackerLagSec, double maxTrackerLagSec, double stepSizeSec, double& bestCorrelationValue, double& bestCorrelationTimeOffset, double& bestCorrelationNormalizationFactor, std::deque<double>& corrTimeOffsets, std::deque<double>& corrValues);
 
+  /*!
+    Find the lag that maximizes the correlation between the fixed and moving signals using FFT. The signals are resampled
+    on a uniform grid with SamplingResolutionSec spacing, the correlation is computed for all lags within MaxMovingLagSec,
+    and the peak is refined by fitting a parabola to its neighbors. Lags are returned for both sign conventions (the second one
+    is for the negated moving signal). corrTimeOffsets and corrValues are filled with the alignment metric that corresponds to
+    the computed correlation coefficients (with sign convention #1 and #2 respectively), for plotting.
+  */
+  PlusStatus ComputeCorrelationBetweenFixedAndMovingSignalFft(double& bestTimeOffset, double& bestTimeOffsetInverted,
+      std::deque<double>& corrTimeOffsets, std::deque<double>& corrValues, std::deque<double>& corrValuesInverted);
+
+  /*! Resample a signal at numberOfSamples uniformly spaced time points starting at startTime. Values are clamped outside the signal time range. */
+  void ResampleSignalUniformly(const std::deque<double>& timestamps, const std::deque<double>& values, double startTime, double stepSizeSec, int numberOfSamples, std::vector<double>& resampledSignalValues);
+
   double ComputeAlignmentMetric(const std::deque<double>& signalA, const std::deque<double>& signalB);
 
   PlusStatus ConstructTableSignal(std::deque<double>& x, std::deque<double>& y, vtkTable* table, double timeCorrection);
@@ -174,6 +202,9 @@ protected:
   /*! Resolution used for re-sampling [s]*/
   double SamplingResolutionSec;
 
+  /*! Method used for finding the best lag */
+  LAG_SEARCH_METHOD LagSearchMethod;
+
   /*! The computed signal correlation values (corresponding to the better sign convention) */
   std::deque<double> CorrelationValues;
   /*! The time-offsets used to compute the correlations */
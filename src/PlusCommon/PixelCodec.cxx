@@ -0,0 +1,362 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PixelCodec.h"
+#include "PixelCodecKernels.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #define PIXELCODEC_X86
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  // jpeglib.h requires FILE and size_t to be defined
+  #include <csetjmp>
+  #include <cstdio>
+  #include <jpeglib.h>
+#endif
+
+//----------------------------------------------------------------------------
+namespace PixelCodecKernels
+{
+  void GetScalarFunctions(ConversionFunctions& functions)
+  {
+    functions.RGBToBGR = ScalarRGBToBGR;
+    functions.RGBA32ToRGB24 = ScalarRGBA32ToRGB24;
+    functions.RGBA32ToBGR24 = ScalarRGBA32ToBGR24;
+    functions.RGB24ToGray = ScalarRGB24ToGray;
+    functions.RGBA32ToGray = ScalarRGBA32ToGray;
+    functions.YUV422pToRGB24 = ScalarYUV422pToRGB24;
+    functions.YUV422pToGray = ScalarYUV422pToGray;
+  }
+}
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /*! Most advanced instruction set that is supported by the CPU and enabled by the operating system */
+  PixelCodec::InstructionSet DetectCpuInstructionSet()
+  {
+#ifdef PIXELCODEC_X86
+    unsigned int registers1[4] = {0, 0, 0, 0}; // eax, ebx, ecx, edx
+    unsigned int registers7[4] = {0, 0, 0, 0};
+    unsigned long long enabledStates = 0;
+#if defined(_MSC_VER)
+    int info[4] = {0, 0, 0, 0};
+    __cpuid(info, 0);
+    int maximumLeaf = info[0];
+    __cpuid(info, 1);
+    std::copy(info, info + 4, registers1);
+    if (maximumLeaf >= 7)
+    {
+      __cpuidex(info, 7, 0);
+      std::copy(info, info + 4, registers7);
+    }
+#else
+    unsigned int maximumLeaf = __get_cpuid_max(0, NULL);
+    if (maximumLeaf < 1)
+    {
+      return PixelCodec::InstructionSet_Scalar;
+    }
+    __cpuid(1, registers1[0], registers1[1], registers1[2], registers1[3]);
+    if (maximumLeaf >= 7)
+    {
+      __cpuid_count(7, 0, registers7[0], registers7[1], registers7[2], registers7[3]);
+    }
+#endif
+    const bool ssse3 = (registers1[2] & (1u << 9)) != 0;
+    const bool osxsave = (registers1[2] & (1u << 27)) != 0;
+    const bool avx = (registers1[2] & (1u << 28)) != 0;
+    const bool avx2 = (registers7[1] & (1u << 5)) != 0;
+    if (osxsave)
+    {
+      // The operating system has to save the YMM registers on context switch
+#if defined(_MSC_VER)
+      enabledStates = _xgetbv(0);
+#else
+      unsigned int eax = 0;
+      unsigned int edx = 0;
+      __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+      enabledStates = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+    if (avx && avx2 && (enabledStates & 0x6) == 0x6)
+    {
+      return PixelCodec::InstructionSet_AVX2;
+    }
+    if (ssse3)
+    {
+      return PixelCodec::InstructionSet_SSSE3;
+    }
+#endif
+    return PixelCodec::InstructionSet_Scalar;
+  }
+
+  //----------------------------------------------------------------------------
+  struct ConversionFunctionTables
+  {
+    ConversionFunctionTables()
+    {
+      // Instruction sets that are not available use the scalar implementation
+      for (int i = 0; i <= PixelCodec::InstructionSet_AVX2; i++)
+      {
+        PixelCodecKernels::GetScalarFunctions(Functions[i]);
+      }
+      SupportedInstructionSet = PixelCodec::InstructionSet_Scalar;
+      PixelCodec::InstructionSet cpuInstructionSet = DetectCpuInstructionSet();
+      if (cpuInstructionSet >= PixelCodec::InstructionSet_SSSE3 && PixelCodecKernels::GetSSSE3Functions(Functions[PixelCodec::InstructionSet_SSSE3]))
+      {
+        SupportedInstructionSet = PixelCodec::InstructionSet_SSSE3;
+        if (cpuInstructionSet >= PixelCodec::InstructionSet_AVX2 && PixelCodecKernels::GetAVX2Functions(Functions[PixelCodec::InstructionSet_AVX2]))
+        {
+          SupportedInstructionSet = PixelCodec::InstructionSet_AVX2;
+        }
+      }
+    }
+    PixelCodecKernels::ConversionFunctions Functions[PixelCodec::InstructionSet_AVX2 + 1];
+    PixelCodec::InstructionSet SupportedInstructionSet;
+  };
+
+  //----------------------------------------------------------------------------
+  const ConversionFunctionTables& GetConversionFunctionTables()
+  {
+    static ConversionFunctionTables tables;
+    return tables;
+  }
+
+  std::atomic<int> MaximumInstructionSet(PixelCodec::InstructionSet_AVX2);
+
+  //----------------------------------------------------------------------------
+  const PixelCodecKernels::ConversionFunctions& GetConversionFunctions()
+  {
+    return GetConversionFunctionTables().Functions[PixelCodec::GetInstructionSet()];
+  }
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  //----------------------------------------------------------------------------
+  struct JpegErrorManager
+  {
+    jpeg_error_mgr Base;
+    jmp_buf JumpBuffer;
+    char Message[JMSG_LENGTH_MAX];
+  };
+
+  //----------------------------------------------------------------------------
+  void JpegErrorExit(j_common_ptr cinfo)
+  {
+    JpegErrorManager* errorManager = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, errorManager->Message);
+    longjmp(errorManager->JumpBuffer, 1);
+  }
+
+  //----------------------------------------------------------------------------
+  void JpegOutputMessage(j_common_ptr)
+  {
+    // Warnings (e.g., a few corrupt bytes in a frame of a USB camera) are not reported, the frame is still usable
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+  Decode a JPEG image directly into the output buffer.
+  No C++ objects with destructors are allowed in this function, as the error handler of libjpeg uses longjmp.
+  */
+  bool DecodeJpeg(const unsigned char* s, unsigned int inputSizeBytes, J_COLOR_SPACE outputColorSpace, int numberOfComponents,
+                  int width, int height, unsigned char* d, JpegErrorManager& errorManager)
+  {
+    jpeg_decompress_struct cinfo;
+    cinfo.err = jpeg_std_error(&errorManager.Base);
+    errorManager.Base.error_exit = JpegErrorExit;
+    errorManager.Base.output_message = JpegOutputMessage;
+    errorManager.Message[0] = 0;
+    if (setjmp(errorManager.JumpBuffer))
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(s), inputSizeBytes);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = outputColorSpace;
+    jpeg_calc_output_dimensions(&cinfo);
+    if (static_cast<int>(cinfo.output_width) != width || static_cast<int>(cinfo.output_height) != height)
+    {
+      snprintf(errorManager.Message, JMSG_LENGTH_MAX, "Frame size is %ux%u, expected %dx%d", cinfo.output_width, cinfo.output_height, width, height);
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+    jpeg_start_decompress(&cinfo);
+    const size_t rowSizeBytes = static_cast<size_t>(width) * numberOfComponents;
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+      JSAMPROW row = d + cinfo.output_scanline * rowSizeBytes;
+      jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+  }
+#endif
+}
+
+//----------------------------------------------------------------------------
+PixelCodec::InstructionSet PixelCodec::GetSupportedInstructionSet()
+{
+  return GetConversionFunctionTables().SupportedInstructionSet;
+}
+
+//----------------------------------------------------------------------------
+PixelCodec::InstructionSet PixelCodec::GetInstructionSet()
+{
+  return static_cast<InstructionSet>(std::min<int>(MaximumInstructionSet, GetSupportedInstructionSet()));
+}
+
+//----------------------------------------------------------------------------
+PixelCodec::InstructionSet PixelCodec::SetMaximumInstructionSet(InstructionSet maximumInstructionSet)
+{
+  MaximumInstructionSet = maximumInstructionSet;
+  return GetInstructionSet();
+}
+
+//----------------------------------------------------------------------------
+std::string PixelCodec::GetInstructionSetAsString(InstructionSet instructionSet)
+{
+  switch (instructionSet)
+  {
+    case InstructionSet_Scalar:
+      return "Scalar";
+    case InstructionSet_SSSE3:
+      return "SSSE3";
+    case InstructionSet_AVX2:
+      return "AVX2";
+    default:
+      return "Unknown";
+  }
+}
+
+//----------------------------------------------------------------------------
+bool PixelCodec::IsMJPGDecodingSupported()
+{
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  return true;
+#else
+  return false;
+#endif
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::RGBToBGR(int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().RGBToBGR(width * height, s, d);
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::BGRA32ToRGB24(int width, int height, unsigned char* s, unsigned char* d)
+{
+  // Swapping the first and third components is the same operation in both directions
+  GetConversionFunctions().RGBA32ToBGR24(width * height, s, d);
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::RGBA32ToBGR24(int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().RGBA32ToBGR24(width * height, s, d);
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::RGBA32ToRGB24(int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().RGBA32ToRGB24(width * height, s, d);
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::RGB24ToGray(int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().RGB24ToGray(width * height, s, d);
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::RGBA32ToGray(int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().RGBA32ToGray(width * height, s, d);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PixelCodec::MJPGToRGB24(ComponentOrdering outputOrdering, int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes)
+{
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  if (inputSizeBytes == 0)
+  {
+    LOG_ERROR("MJPEG decoding failed: size of the compressed frame is not specified");
+    return PLUS_FAIL;
+  }
+  bool swapRedAndBlue = false;
+#ifdef JCS_EXTENSIONS
+  J_COLOR_SPACE outputColorSpace = (outputOrdering == ComponentOrder_BGR ? JCS_EXT_BGR : JCS_RGB);
+#else
+  J_COLOR_SPACE outputColorSpace = JCS_RGB;
+  swapRedAndBlue = (outputOrdering == ComponentOrder_BGR);
+#endif
+  JpegErrorManager errorManager;
+  if (!DecodeJpeg(s, inputSizeBytes, outputColorSpace, 3, width, height, d, errorManager))
+  {
+    LOG_ERROR("MJPEG decoding failed: " << errorManager.Message);
+    return PLUS_FAIL;
+  }
+  if (swapRedAndBlue)
+  {
+    RGBToBGR(width, height, d, d);
+  }
+  return PLUS_SUCCESS;
+#else
+  LOG_ERROR("MJPEG decoding is not supported. Build Plus with PLUS_USE_LIBJPEG_TURBO enabled.");
+  return PLUS_FAIL;
+#endif
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PixelCodec::MJPGToGray(int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes)
+{
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  if (inputSizeBytes == 0)
+  {
+    LOG_ERROR("MJPEG decoding failed: size of the compressed frame is not specified");
+    return PLUS_FAIL;
+  }
+  JpegErrorManager errorManager;
+  if (!DecodeJpeg(s, inputSizeBytes, JCS_GRAYSCALE, 1, width, height, d, errorManager))
+  {
+    LOG_ERROR("MJPEG decoding failed: " << errorManager.Message);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+#else
+  LOG_ERROR("MJPEG decoding is not supported. Build Plus with PLUS_USE_LIBJPEG_TURBO enabled.");
+  return PLUS_FAIL;
+#endif
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PixelCodec::YUV422pToRGB24(ComponentOrdering outputOrdering, int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().YUV422pToRGB24(outputOrdering == ComponentOrder_BGR, height * (width / 2), s, d);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void PixelCodec::YUV422pToGray(int width, int height, unsigned char* s, unsigned char* d)
+{
+  GetConversionFunctions().YUV422pToGray(height * (width / 2), s, d);
+}
@@ -8,24 +8,11 @@ See License.txt for details.
 #define __PixelCodec_h
 
 #include "PlusConfigure.h"
+#include "vtkPlusCommonExport.h"
+#include "PixelCodecYUV.h"
 
 #include <iomanip>
-
-// Helper macros for YUY2 conversion (source: http://sundararajana.blogspot.ca/2007/12/yuy2-to-rgb24-conversion.html)
-#define FIXNUM 16
-#define FIX(a, b) ((int)((a)*(1<<(b))))
-#define UNFIX(a, b) ((a+(1<<(b-1)))>>(b))
-// Approximate 255 by 256
-#define ICCIRUV(x) (((x)<<8)/224)
-#define ICCIRY(x) ((((x)-16)<<8)/219)
-// Clip out-range values
-#define CLIP(t) (((t)>255)?255:(((t)<0)?0:(t)))
-#define GET_R_FROM_YUV(y, u, v) UNFIX((FIX(1.0, FIXNUM)*(y) + FIX(1.402, FIXNUM)*(v)), FIXNUM)
-#define GET_G_FROM_YUV(y, u, v) UNFIX((FIX(1.0, FIXNUM)*(y) + FIX(-0.344, FIXNUM)*(u) + FIX(-0.714, FIXNUM)*(v)), FIXNUM)
-#define GET_B_FROM_YUV(y, u, v) UNFIX((FIX(1.0, FIXNUM)*(y) + FIX(1.772, FIXNUM)*(u)), FIXNUM)
-#define GET_Y_FROM_RGB(r, g, b) UNFIX((FIX(0.299, FIXNUM)*(r) + FIX(0.587, FIXNUM)*(g) + FIX(0.114, FIXNUM)*(b)), FIXNUM)
-#define GET_U_FROM_RGB(r, g, b) UNFIX((FIX(-0.169, FIXNUM)*(r) + FIX(-0.331, FIXNUM)*(g) + FIX(0.500, FIXNUM)*(b)), FIXNUM)
-#define GET_V_FROM_RGB(r, g, b) UNFIX((FIX(0.500, FIXNUM)*(r) + FIX(-0.419, FIXNUM)*(g) + FIX(-0.081, FIXNUM)*(b)), FIXNUM)
+#include <string>
 
 // VFW compressed formats are listed at http://www.webartz.com/fourcc/
 static const long VTK_BI_UYVY = 0x59565955;
@@ -41,9 +28,16 @@ static const long VTK_BI_YUY2 = 0x32595559;
 /*!
 \class PixelCodec
 \brief A utility class that contains static functions for converting between various pixel encodings
+
+Conversions are implemented using SSSE3 and AVX2 instructions as well. The most advanced instruction set
+that is supported by the CPU is selected at runtime; all implementations provide exactly the same output.
+
+MJPG frames are decoded by libjpeg-turbo, if Plus is built with PLUS_USE_LIBJPEG_TURBO.
+Decoding requires the size of the compressed frame (inputSizeBytes).
+
 \ingroup PlusLibCommon
 */
-class PixelCodec
+class vtkPlusCommonExport PixelCodec
 {
 public:
   enum ComponentOrdering
@@ -63,6 +57,30 @@ public:
     PixelEncoding_MJPG
   };
 
+  enum InstructionSet
+  {
+    InstructionSet_Scalar,
+    InstructionSet_SSSE3,
+    InstructionSet_AVX2
+  };
+
+  /*! Most advanced instruction set that is supported by both the CPU and this build */
+  static InstructionSet GetSupportedInstructionSet();
+
+  /*! Instruction set that is currently used by the conversion functions */
+  static InstructionSet GetInstructionSet();
+
+  /*!
+  Limit the instruction set that is used by the conversion functions (e.g., for testing or benchmarking).
+  Returns the instruction set that will be used, which is never more advanced than the supported one.
+  */
+  static InstructionSet SetMaximumInstructionSet(InstructionSet maximumInstructionSet);
+
+  static std::string GetInstructionSetAsString(InstructionSet instructionSet);
+
+  /*! Returns true if MJPG frames can be decoded (Plus is built with libjpeg-turbo) */
+  static bool IsMJPGDecodingSupported();
+
   //----------------------------------------------------------------------------
   static bool IsConvertToGraySupported(int inputCompression)
   {
@@ -143,7 +161,8 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  static inline PlusStatus ConvertToGray(int inputCompression, int width, int height, unsigned char* s, unsigned char* d)
+  /*! inputSizeBytes is only needed for compressed (BI_JPEG) input */
+  static inline PlusStatus ConvertToGray(int inputCompression, int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes = 0)
   {
     switch (inputCompression)
     {
@@ -156,8 +175,7 @@ public:
         YUV422pToGray(width, height, s, d);
         break;
       case BI_JPEG:
-        // TODO
-        break;
+        return MJPGToGray(width, height, s, d, inputSizeBytes);
       default:
         LOG_ERROR("Unknown compression type: " << inputCompression);
         return PLUS_FAIL;
@@ -166,7 +184,8 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  static inline PlusStatus ConvertToGray(PixelEncoding inputCompression, int width, int height, unsigned char* s, unsigned char* d)
+  /*! inputSizeBytes is only needed for compressed (MJPG) input */
+  static inline PlusStatus ConvertToGray(PixelEncoding inputCompression, int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes = 0)
   {
     switch (inputCompression)
     {
@@ -184,8 +203,7 @@ public:
         YUV422pToGray(width, height, s, d);
         break;
       case PixelEncoding_MJPG:
-        LOG_ERROR("MJPG to grayscale conversion is not yet supported");
-        break;
+        return MJPGToGray(width, height, s, d, inputSizeBytes);
       default:
         LOG_ERROR("Unknown compression type: " << inputCompression);
         return PLUS_FAIL;
@@ -194,7 +212,8 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  static inline PlusStatus ConvertToBGR24(ComponentOrdering outputOrdering, PixelEncoding inputCompression, int width, int height, unsigned char* s, unsigned char* d)
+  /*! inputSizeBytes is only needed for compressed (MJPG) input */
+  static inline PlusStatus ConvertToBGR24(ComponentOrdering outputOrdering, PixelEncoding inputCompression, int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes = 0)
   {
     switch (inputCompression)
     {
@@ -235,7 +254,7 @@ public:
         return YUV422pToRGB24(outputOrdering, width, height, s, d);
         break;
       case PixelEncoding_MJPG:
-        return MJPGToRGB24(outputOrdering, width, height, s, d);
+        return MJPGToRGB24(outputOrdering, width, height, s, d, inputSizeBytes);
         break;
       default:
         LOG_ERROR("Unknown compression type: " << inputCompression);
@@ -245,52 +264,16 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  static inline void RGBToBGR(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    for (int i = 0; i < width * height; i++)
-    {
-      *(d++) = s[2];
-      *(d++) = s[1];
-      *(d++) = s[0];
-      s += 3;
-    }
-  }
+  static void RGBToBGR(int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
-  static inline void BGRA32ToRGB24(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    for (int i = 0; i < width * height; i++)
-    {
-      *(d++) = s[2];
-      *(d++) = s[1];
-      *(d++) = s[0];
-      s += 4; // ignore alpha channel
-    }
-  }
+  static void BGRA32ToRGB24(int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
-  static inline void RGBA32ToBGR24(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    for (int i = 0; i < width * height; i++)
-    {
-      *(d++) = s[2];
-      *(d++) = s[1];
-      *(d++) = s[0];
-      s += 4; // ignore alpha channel
-    }
-  }
+  static void RGBA32ToBGR24(int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
-  static inline void RGBA32ToRGB24(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    for (int i = 0; i < width * height; i++)
-    {
-      *(d++) = *(s++);
-      *(d++) = *(s++);
-      *(d++) = *(s++);
-      s++; // ignore alpha channel
-    }
-  }
+  static void RGBA32ToRGB24(int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
   /*!
@@ -298,15 +281,7 @@ public:
   Note that this method computes the intensity (simple averaging of the RGB components).
   This is not equivalent with the perceived luminance of color images (e.g., 0.21R + 0.72G + 0.07B or 0.30R + 0.59G + 0.11B)
   */
-  static inline void RGB24ToGray(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    for (int i = 0; i < width * height; i++)
-    {
-      *d = ((unsigned short)(s[0]) + s[1] + s[2]) / 3;
-      d++;
-      s += 3;
-    }
-  }
+  static void RGB24ToGray(int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
   /*!
@@ -314,15 +289,7 @@ public:
   Note that this method computes the intensity (simple averaging of the RGB components).
   This is not equivalent with the perceived luminance of color images (e.g., 0.21R + 0.72G + 0.07B or 0.30R + 0.59G + 0.11B)
   */
-  static inline void RGBA32ToGray(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    for (int i = 0; i < width * height; i++)
-    {
-      *d = ((unsigned short)(s[0]) + s[1] + s[2]) / 3;
-      d++;
-      s += 4;
-    }
-  }
+  static void RGBA32ToGray(int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
   /*! Conversion from YUV to RGB space
@@ -372,11 +339,15 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  static PlusStatus MJPGToRGB24(ComponentOrdering outputOrdering, int width, int height, unsigned char* s, unsigned char* d)
-  {
-    LOG_ERROR("MJPEG is not supported yet");
-    return PLUS_FAIL;
-  }
+  /*! Decode an MJPG frame (a JPEG image) of the specified size to RGB24 or BGR24 */
+  static PlusStatus MJPGToRGB24(ComponentOrdering outputOrdering, int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes = 0);
+
+  //----------------------------------------------------------------------------
+  /*!
+  Decode an MJPG frame (a JPEG image) of the specified size to grayscale.
+  The luminance channel of the JPEG image is used, which is not the same as the intensity computed by the other grayscale conversions.
+  */
+  static PlusStatus MJPGToGray(int width, int height, unsigned char* s, unsigned char* d, unsigned int inputSizeBytes = 0);
 
   //----------------------------------------------------------------------------
   /*!
@@ -384,55 +355,7 @@ public:
   YUY2 coding is typically used for webcams
   source: http://sundararajana.blogspot.ca/2007/12/yuy2-to-rgb24-conversion.html
   */
-  static PlusStatus YUV422pToRGB24(ComponentOrdering outputOrdering, int width, int height, unsigned char* s, unsigned char* d)
-  {
-    unsigned char* p_dest;
-    unsigned char y1, u, y2, v;
-    int Y1, Y2, U, V;
-    unsigned char r, g, b;
-
-    p_dest = d;
-
-    int size = height * (width / 2);
-    unsigned long srcIndex = 0;
-    unsigned long dstIndex = 0;
-
-    for (int i = 0 ; i < size ; i++)
-    {
-      y1 = s[srcIndex];
-      u = s[srcIndex + 1];
-      y2 = s[srcIndex + 2];
-      v = s[srcIndex + 3];
-
-      Y1 = ICCIRY(y1);
-      U = ICCIRUV(u - 128);
-      Y2 = ICCIRY(y2);
-      V = ICCIRUV(v - 128);
-
-      r = CLIP(GET_R_FROM_YUV(Y1, U, V));
-      g = CLIP(GET_G_FROM_YUV(Y1, U, V));
-      b = CLIP(GET_B_FROM_YUV(Y1, U, V));
-
-      p_dest[dstIndex] = outputOrdering == ComponentOrder_BGR ? b : r;
-      p_dest[dstIndex + 1] = g;
-      p_dest[dstIndex + 2] = outputOrdering == ComponentOrder_BGR ? r : b;
-
-      dstIndex += 3;
-
-      r = CLIP(GET_R_FROM_YUV(Y2, U, V));
-      g = CLIP(GET_G_FROM_YUV(Y2, U, V));
-      b = CLIP(GET_B_FROM_YUV(Y2, U, V));
-
-      p_dest[dstIndex] = outputOrdering == ComponentOrder_BGR ? b : r;
-      p_dest[dstIndex + 1] = g;
-      p_dest[dstIndex + 2] = outputOrdering == ComponentOrder_BGR ? r : b;
-
-      dstIndex += 3;
-      srcIndex += 4;
-    }
-
-    return PLUS_SUCCESS;
-  }
+  static PlusStatus YUV422pToRGB24(ComponentOrdering outputOrdering, int width, int height, unsigned char* s, unsigned char* d);
 
   //----------------------------------------------------------------------------
   /*!
@@ -440,49 +363,7 @@ public:
   YUY2 coding is typically used for webcams
   source: http://sundararajana.blogspot.ca/2007/12/yuy2-to-rgb24-conversion.html
   */
-  static void YUV422pToGray(int width, int height, unsigned char* s, unsigned char* d)
-  {
-    int i;
-    unsigned char* p_dest;
-    unsigned char y1, u, y2, v;
-    int Y1, Y2, U, V;
-    unsigned char r, g, b;
-
-    p_dest = d;
-
-    int size = height * (width / 2);
-    unsigned long srcIndex = 0;
-    unsigned long dstIndex = 0;
-
-    for (i = 0 ; i < size ; i++)
-    {
-      y1 = s[srcIndex];
-      u = s[srcIndex + 1];
-      y2 = s[srcIndex + 2];
-      v = s[srcIndex + 3];
-
-      Y1 = ICCIRY(y1);
-      U = ICCIRUV(u - 128);
-      Y2 = ICCIRY(y2);
-      V = ICCIRUV(v - 128);
-
-      r = CLIP(GET_R_FROM_YUV(Y1, U, V));
-      g = CLIP(GET_G_FROM_YUV(Y1, U, V));
-      b = CLIP(GET_B_FROM_YUV(Y1, U, V));
-
-      p_dest[dstIndex] = (int(b) + g + r) / 3;
-      dstIndex ++;
-
-      r = CLIP(GET_R_FROM_YUV(Y2, U, V));
-      g = CLIP(GET_G_FROM_YUV(Y2, U, V));
-      b = CLIP(GET_B_FROM_YUV(Y2, U, V));
-
-      p_dest[dstIndex] = (int(b) + g + r) / 3;
-
-      dstIndex ++;
-      srcIndex += 4;
-    }
-  }
+  static void YUV422pToGray(int width, int height, unsigned char* s, unsigned char* d);
 
 private:
   PixelCodec(); // prevent instantiation
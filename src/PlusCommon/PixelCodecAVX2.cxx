@@ -0,0 +1,274 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+// This file is compiled with AVX2 instructions enabled. The functions may only be called
+// if the CPU supports AVX2 (see PixelCodec::GetSupportedInstructionSet).
+// The algorithms are the same as in PixelCodecSSSE3.cxx, each 128-bit lane processes the same
+// number of pixels as one SSSE3 register.
+
+// Only PixelCodecKernels.h and the intrinsics header may be included (see PixelCodecKernels.h)
+#include "PixelCodecKernels.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /*! Load two unaligned 128-bit values to the lower and upper lanes */
+  inline __m256i LoadLanes(const unsigned char* lower, const unsigned char* upper)
+  {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lower))),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(upper)), 1);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Store the lower and upper lanes. The upper lane is stored last, so it may overwrite the end of the lower lane. */
+  inline void StoreLanes(unsigned char* lower, unsigned char* upper, __m256i values)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lower), _mm256_castsi256_si128(values));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(upper), _mm256_extracti128_si256(values, 1));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Store the 8 bytes of the lower 64 bits of both lanes (16 bytes) */
+  inline void StoreLowerHalfOfLanes(unsigned char* d, __m256i values)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d), _mm256_castsi256_si128(_mm256_permute4x64_epi64(values, _MM_SHUFFLE(3, 1, 2, 0))));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Exact integer division by 3 of 16-bit values in the range of [0, 765] */
+  inline __m256i DivideBy3(__m256i values)
+  {
+    return _mm256_srli_epi16(_mm256_mulhi_epu16(values, _mm256_set1_epi16(static_cast<short>(0xAAAB))), 1);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Average of the first three components of 8 pixels in each lane, see the SSSE3 implementation */
+  inline __m256i AverageComponents(__m256i a, __m256i b, __m256i shuffleMask)
+  {
+    a = _mm256_shuffle_epi8(a, shuffleMask);
+    b = _mm256_shuffle_epi8(b, shuffleMask);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i c0c1 = _mm256_unpacklo_epi32(a, b);
+    __m256i c2 = _mm256_unpackhi_epi32(a, b);
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(c0c1, zero), _mm256_unpackhi_epi8(c0c1, zero)), _mm256_unpacklo_epi8(c2, zero));
+    return DivideBy3(sum);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBToBGR(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    const __m256i shuffleMask = _mm256_setr_epi8(
+                                  2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,
+                                  2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    int i = 0;
+    for (; i + 10 <= numberOfPixels; i += 8)
+    {
+      __m256i pixels = LoadLanes(s + 3 * i, s + 3 * i + 12);
+      StoreLanes(d + 3 * i, d + 3 * i + 12, _mm256_shuffle_epi8(pixels, shuffleMask));
+    }
+    PixelCodecKernels::ScalarRGBToBGR(numberOfPixels - i, s + 3 * i, d + 3 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Returns the number of converted pixels */
+  inline int RGBA32To24(int numberOfPixels, const unsigned char* s, unsigned char* d, __m256i shuffleMask)
+  {
+    int i = 0;
+    for (; i + 10 <= numberOfPixels; i += 8)
+    {
+      __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 4 * i));
+      StoreLanes(d + 3 * i, d + 3 * i + 12, _mm256_shuffle_epi8(pixels, shuffleMask));
+    }
+    return i;
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBA32ToRGB24(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    int i = RGBA32To24(numberOfPixels, s, d, _mm256_setr_epi8(
+                         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    PixelCodecKernels::ScalarRGBA32ToRGB24(numberOfPixels - i, s + 4 * i, d + 3 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBA32ToBGR24(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    int i = RGBA32To24(numberOfPixels, s, d, _mm256_setr_epi8(
+                         2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                         2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    PixelCodecKernels::ScalarRGBA32ToBGR24(numberOfPixels - i, s + 4 * i, d + 3 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGB24ToGray(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    const __m256i shuffleMask = _mm256_setr_epi8(
+                                  0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1,
+                                  0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 18 <= numberOfPixels; i += 16)
+    {
+      __m256i a = LoadLanes(s + 3 * i, s + 3 * i + 24);
+      __m256i b = LoadLanes(s + 3 * i + 12, s + 3 * i + 36);
+      __m256i gray = AverageComponents(a, b, shuffleMask);
+      StoreLowerHalfOfLanes(d + i, _mm256_packus_epi16(gray, gray));
+    }
+    PixelCodecKernels::ScalarRGB24ToGray(numberOfPixels - i, s + 3 * i, d + i);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBA32ToGray(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    const __m256i shuffleMask = _mm256_setr_epi8(
+                                  0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, -1, -1, -1, -1,
+                                  0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 16 <= numberOfPixels; i += 16)
+    {
+      __m256i a = LoadLanes(s + 4 * i, s + 4 * i + 32);
+      __m256i b = LoadLanes(s + 4 * i + 16, s + 4 * i + 48);
+      __m256i gray = AverageComponents(a, b, shuffleMask);
+      StoreLowerHalfOfLanes(d + i, _mm256_packus_epi16(gray, gray));
+    }
+    PixelCodecKernels::ScalarRGBA32ToGray(numberOfPixels - i, s + 4 * i, d + i);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! ((x << 8) / divisor), rounded towards zero */
+  inline __m256i ScaleAndDivide(__m256i x, __m256 divisor)
+  {
+    return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_slli_epi32(x, 8)), divisor));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! ((x + 32768) >> 16) */
+  inline __m256i Unfix(__m256i x)
+  {
+    return _mm256_srai_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(32768)), 16);
+  }
+
+  //----------------------------------------------------------------------------
+  inline __m256i InterleavePixels(__m256i first, __m256i second)
+  {
+    return _mm256_packs_epi32(_mm256_unpacklo_epi32(first, second), _mm256_unpackhi_epi32(first, second));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Convert 8 YUY2 pixel pairs to 16 RGB pixels (16-bit values, not clipped), see the SSSE3 implementation */
+  inline void YUV422pToRGB(__m256i yuv, __m256i& r, __m256i& g, __m256i& b)
+  {
+    const __m256i y1 = _mm256_shuffle_epi8(yuv, _mm256_setr_epi8(
+                                             0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1,
+                                             0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1));
+    const __m256i u = _mm256_shuffle_epi8(yuv, _mm256_setr_epi8(
+                                            1, -1, -1, -1, 5, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1,
+                                            1, -1, -1, -1, 5, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1));
+    const __m256i y2 = _mm256_shuffle_epi8(yuv, _mm256_setr_epi8(
+                                             2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1,
+                                             2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1));
+    const __m256i v = _mm256_shuffle_epi8(yuv, _mm256_setr_epi8(
+                                            3, -1, -1, -1, 7, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1,
+                                            3, -1, -1, -1, 7, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1));
+
+    const __m256 yDivisor = _mm256_set1_ps(219.0f);
+    const __m256 uvDivisor = _mm256_set1_ps(224.0f);
+    const __m256i Y1 = ScaleAndDivide(_mm256_sub_epi32(y1, _mm256_set1_epi32(16)), yDivisor);
+    const __m256i Y2 = ScaleAndDivide(_mm256_sub_epi32(y2, _mm256_set1_epi32(16)), yDivisor);
+    const __m256i U = ScaleAndDivide(_mm256_sub_epi32(u, _mm256_set1_epi32(128)), uvDivisor);
+    const __m256i V = ScaleAndDivide(_mm256_sub_epi32(v, _mm256_set1_epi32(128)), uvDivisor);
+
+    const __m256i UV = _mm256_or_si256(_mm256_and_si256(U, _mm256_set1_epi32(0xFFFF)), _mm256_slli_epi32(V, 16));
+
+    const __m256i rOffset = _mm256_add_epi32(V, Unfix(_mm256_madd_epi16(UV, _mm256_set1_epi32(26345 << 16))));
+    const __m256i gOffset = _mm256_sub_epi32(Unfix(_mm256_madd_epi16(UV, _mm256_set1_epi32((18744 << 16) | (-22544 & 0xFFFF)))), V);
+    const __m256i bOffset = _mm256_add_epi32(_mm256_slli_epi32(U, 1), Unfix(_mm256_madd_epi16(UV, _mm256_set1_epi32(-14943 & 0xFFFF))));
+
+    r = InterleavePixels(_mm256_add_epi32(Y1, rOffset), _mm256_add_epi32(Y2, rOffset));
+    g = InterleavePixels(_mm256_add_epi32(Y1, gOffset), _mm256_add_epi32(Y2, gOffset));
+    b = InterleavePixels(_mm256_add_epi32(Y1, bOffset), _mm256_add_epi32(Y2, bOffset));
+  }
+
+  //----------------------------------------------------------------------------
+  void YUV422pToRGB24(bool bgrOrder, int numberOfPixelPairs, const unsigned char* s, unsigned char* d)
+  {
+    const __m256i c0c1Mask0 = _mm256_setr_epi8(
+                                0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5,
+                                0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+    const __m256i c2Mask0 = _mm256_setr_epi8(
+                              -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1,
+                              -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m256i c0c1Mask1 = _mm256_setr_epi8(
+                                13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i c2Mask1 = _mm256_setr_epi8(
+                              -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1,
+                              -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 8 <= numberOfPixelPairs; i += 8)
+    {
+      __m256i r, g, b;
+      YUV422pToRGB(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 4 * i)), r, g, b);
+      __m256i c0c1 = _mm256_packus_epi16(bgrOrder ? b : r, g);
+      __m256i c2 = _mm256_packus_epi16(bgrOrder ? r : b, bgrOrder ? r : b);
+      // Each lane contains 8 pixels (16 + 8 bytes)
+      __m256i first = _mm256_or_si256(_mm256_shuffle_epi8(c0c1, c0c1Mask0), _mm256_shuffle_epi8(c2, c2Mask0));
+      __m256i second = _mm256_or_si256(_mm256_shuffle_epi8(c0c1, c0c1Mask1), _mm256_shuffle_epi8(c2, c2Mask1));
+      unsigned char* output = d + 6 * i;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(first));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(output + 16), _mm256_castsi256_si128(second));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 24), _mm256_extracti128_si256(first, 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(output + 40), _mm256_extracti128_si256(second, 1));
+    }
+    PixelCodecKernels::ScalarYUV422pToRGB24(bgrOrder, numberOfPixelPairs - i, s + 4 * i, d + 6 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  void YUV422pToGray(int numberOfPixelPairs, const unsigned char* s, unsigned char* d)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxValue = _mm256_set1_epi16(255);
+    int i = 0;
+    for (; i + 8 <= numberOfPixelPairs; i += 8)
+    {
+      __m256i r, g, b;
+      YUV422pToRGB(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 4 * i)), r, g, b);
+      r = _mm256_max_epi16(_mm256_min_epi16(r, maxValue), zero);
+      g = _mm256_max_epi16(_mm256_min_epi16(g, maxValue), zero);
+      b = _mm256_max_epi16(_mm256_min_epi16(b, maxValue), zero);
+      __m256i gray = DivideBy3(_mm256_add_epi16(_mm256_add_epi16(r, g), b));
+      StoreLowerHalfOfLanes(d + 2 * i, _mm256_packus_epi16(gray, gray));
+    }
+    PixelCodecKernels::ScalarYUV422pToGray(numberOfPixelPairs - i, s + 4 * i, d + 2 * i);
+  }
+}
+
+//----------------------------------------------------------------------------
+bool PixelCodecKernels::GetAVX2Functions(ConversionFunctions& functions)
+{
+  functions.RGBToBGR = RGBToBGR;
+  functions.RGBA32ToRGB24 = RGBA32ToRGB24;
+  functions.RGBA32ToBGR24 = RGBA32ToBGR24;
+  functions.RGB24ToGray = RGB24ToGray;
+  functions.RGBA32ToGray = RGBA32ToGray;
+  functions.YUV422pToRGB24 = YUV422pToRGB24;
+  functions.YUV422pToGray = YUV422pToGray;
+  return true;
+}
+
+#else
+
+//----------------------------------------------------------------------------
+bool PixelCodecKernels::GetAVX2Functions(ConversionFunctions&)
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PixelCodecKernels_h
+#define __PixelCodecKernels_h
+
+// Only plain C declarations and macros may be included here (no PlusConfigure.h, VTK or STL headers):
+// the instruction set specific translation units include this header, and any inline function with
+// external linkage (e.g., an STL template) compiled with AVX2 enabled could be picked by the linker
+// for the whole library and crash on CPUs that do not support AVX2.
+#include "PixelCodecYUV.h"
+
+/*!
+\namespace PixelCodecKernels
+\brief Pixel conversion functions that PixelCodec dispatches to (internal to PixelCodec)
+
+Each instruction set specific implementation is compiled in a separate translation unit with the corresponding
+compiler flags. The scalar functions in this header are used by all implementations (e.g., for the pixels
+that do not fill a whole vector register); they have internal linkage so that the linker does not mix
+copies compiled with different instruction sets.
+
+All implementations must produce exactly the same output as the scalar functions.
+\ingroup PlusLibCommon
+*/
+namespace PixelCodecKernels
+{
+  struct ConversionFunctions
+  {
+    void (*RGBToBGR)(int numberOfPixels, const unsigned char* s, unsigned char* d);
+    void (*RGBA32ToRGB24)(int numberOfPixels, const unsigned char* s, unsigned char* d);
+    void (*RGBA32ToBGR24)(int numberOfPixels, const unsigned char* s, unsigned char* d);
+    void (*RGB24ToGray)(int numberOfPixels, const unsigned char* s, unsigned char* d);
+    void (*RGBA32ToGray)(int numberOfPixels, const unsigned char* s, unsigned char* d);
+    void (*YUV422pToRGB24)(bool bgrOrder, int numberOfPixelPairs, const unsigned char* s, unsigned char* d);
+    void (*YUV422pToGray)(int numberOfPixelPairs, const unsigned char* s, unsigned char* d);
+  };
+
+  void GetScalarFunctions(ConversionFunctions& functions);
+  /*! Returns false if the SSSE3 implementation is not available in this build (e.g., not an x86 platform) */
+  bool GetSSSE3Functions(ConversionFunctions& functions);
+  /*! Returns false if the AVX2 implementation is not available in this build */
+  bool GetAVX2Functions(ConversionFunctions& functions);
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarRGBToBGR(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    // The first component is read before the output is written, so that in-place conversion works
+    for (int i = 0; i < numberOfPixels; i++)
+    {
+      unsigned char first = s[0];
+      *(d++) = s[2];
+      *(d++) = s[1];
+      *(d++) = first;
+      s += 3;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarRGBA32ToRGB24(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    for (int i = 0; i < numberOfPixels; i++)
+    {
+      *(d++) = *(s++);
+      *(d++) = *(s++);
+      *(d++) = *(s++);
+      s++; // ignore alpha channel
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarRGBA32ToBGR24(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    for (int i = 0; i < numberOfPixels; i++)
+    {
+      *(d++) = s[2];
+      *(d++) = s[1];
+      *(d++) = s[0];
+      s += 4; // ignore alpha channel
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarRGB24ToGray(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    for (int i = 0; i < numberOfPixels; i++)
+    {
+      *d = ((unsigned short)(s[0]) + s[1] + s[2]) / 3;
+      d++;
+      s += 3;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarRGBA32ToGray(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    for (int i = 0; i < numberOfPixels; i++)
+    {
+      *d = ((unsigned short)(s[0]) + s[1] + s[2]) / 3;
+      d++;
+      s += 4;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarYUV422pToRGB24(bool bgrOrder, int numberOfPixelPairs, const unsigned char* s, unsigned char* d)
+  {
+    for (int i = 0 ; i < numberOfPixelPairs ; i++)
+    {
+      int Y1 = ICCIRY(s[0]);
+      int U = ICCIRUV(s[1] - 128);
+      int Y2 = ICCIRY(s[2]);
+      int V = ICCIRUV(s[3] - 128);
+
+      unsigned char r = CLIP(GET_R_FROM_YUV(Y1, U, V));
+      unsigned char g = CLIP(GET_G_FROM_YUV(Y1, U, V));
+      unsigned char b = CLIP(GET_B_FROM_YUV(Y1, U, V));
+      d[0] = bgrOrder ? b : r;
+      d[1] = g;
+      d[2] = bgrOrder ? r : b;
+
+      r = CLIP(GET_R_FROM_YUV(Y2, U, V));
+      g = CLIP(GET_G_FROM_YUV(Y2, U, V));
+      b = CLIP(GET_B_FROM_YUV(Y2, U, V));
+      d[3] = bgrOrder ? b : r;
+      d[4] = g;
+      d[5] = bgrOrder ? r : b;
+
+      d += 6;
+      s += 4;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  static inline void ScalarYUV422pToGray(int numberOfPixelPairs, const unsigned char* s, unsigned char* d)
+  {
+    for (int i = 0 ; i < numberOfPixelPairs ; i++)
+    {
+      int Y1 = ICCIRY(s[0]);
+      int U = ICCIRUV(s[1] - 128);
+      int Y2 = ICCIRY(s[2]);
+      int V = ICCIRUV(s[3] - 128);
+
+      unsigned char r = CLIP(GET_R_FROM_YUV(Y1, U, V));
+      unsigned char g = CLIP(GET_G_FROM_YUV(Y1, U, V));
+      unsigned char b = CLIP(GET_B_FROM_YUV(Y1, U, V));
+      d[0] = (int(b) + g + r) / 3;
+
+      r = CLIP(GET_R_FROM_YUV(Y2, U, V));
+      g = CLIP(GET_G_FROM_YUV(Y2, U, V));
+      b = CLIP(GET_B_FROM_YUV(Y2, U, V));
+      d[1] = (int(b) + g + r) / 3;
+
+      d += 2;
+      s += 4;
+    }
+  }
+}
+
+#endif
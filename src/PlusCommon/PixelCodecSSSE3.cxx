@@ -0,0 +1,233 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+// This file is compiled with SSSE3 instructions enabled. The functions may only be called
+// if the CPU supports SSSE3 (see PixelCodec::GetSupportedInstructionSet).
+
+// Only PixelCodecKernels.h and the intrinsics header may be included (see PixelCodecKernels.h)
+#include "PixelCodecKernels.h"
+
+#if defined(__SSSE3__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+
+#include <tmmintrin.h>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /*! Exact integer division by 3 of 16-bit values in the range of [0, 765] */
+  inline __m128i DivideBy3(__m128i values)
+  {
+    return _mm_srli_epi16(_mm_mulhi_epu16(values, _mm_set1_epi16(static_cast<short>(0xAAAB))), 1);
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+  Average of the first three components of 8 pixels (as 16-bit values).
+  The shuffle mask moves the components of 4 pixels of a and b to (c0 c0 c0 c0 c1 c1 c1 c1 c2 c2 c2 c2 0 0 0 0).
+  */
+  inline __m128i AverageComponents(__m128i a, __m128i b, __m128i shuffleMask)
+  {
+    a = _mm_shuffle_epi8(a, shuffleMask);
+    b = _mm_shuffle_epi8(b, shuffleMask);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i c0c1 = _mm_unpacklo_epi32(a, b);
+    __m128i c2 = _mm_unpackhi_epi32(a, b);
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(c0c1, zero), _mm_unpackhi_epi8(c0c1, zero)), _mm_unpacklo_epi8(c2, zero));
+    return DivideBy3(sum);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBToBGR(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    // The last 4 bytes are copied unchanged (so that in-place conversion works), they are overwritten in the next iteration
+    const __m128i shuffleMask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    int i = 0;
+    for (; i + 6 <= numberOfPixels; i += 4)
+    {
+      __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 3 * i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 3 * i), _mm_shuffle_epi8(pixels, shuffleMask));
+    }
+    PixelCodecKernels::ScalarRGBToBGR(numberOfPixels - i, s + 3 * i, d + 3 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Returns the number of converted pixels. The last 4 bytes of each 16-byte store are overwritten in the next iteration. */
+  inline int RGBA32To24(int numberOfPixels, const unsigned char* s, unsigned char* d, __m128i shuffleMask)
+  {
+    int i = 0;
+    for (; i + 6 <= numberOfPixels; i += 4)
+    {
+      __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4 * i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 3 * i), _mm_shuffle_epi8(pixels, shuffleMask));
+    }
+    return i;
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBA32ToRGB24(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    int i = RGBA32To24(numberOfPixels, s, d, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    PixelCodecKernels::ScalarRGBA32ToRGB24(numberOfPixels - i, s + 4 * i, d + 3 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBA32ToBGR24(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    int i = RGBA32To24(numberOfPixels, s, d, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    PixelCodecKernels::ScalarRGBA32ToBGR24(numberOfPixels - i, s + 4 * i, d + 3 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGB24ToGray(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    const __m128i shuffleMask = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 10 <= numberOfPixels; i += 8)
+    {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 3 * i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 3 * i + 12));
+      __m128i gray = AverageComponents(a, b, shuffleMask);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(gray, gray));
+    }
+    PixelCodecKernels::ScalarRGB24ToGray(numberOfPixels - i, s + 3 * i, d + i);
+  }
+
+  //----------------------------------------------------------------------------
+  void RGBA32ToGray(int numberOfPixels, const unsigned char* s, unsigned char* d)
+  {
+    const __m128i shuffleMask = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 8 <= numberOfPixels; i += 8)
+    {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4 * i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4 * i + 16));
+      __m128i gray = AverageComponents(a, b, shuffleMask);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(gray, gray));
+    }
+    PixelCodecKernels::ScalarRGBA32ToGray(numberOfPixels - i, s + 4 * i, d + i);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! ((x << 8) / divisor), rounded towards zero. The float quotient of these small integers never rounds across an integer. */
+  inline __m128i ScaleAndDivide(__m128i x, __m128 divisor)
+  {
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_slli_epi32(x, 8)), divisor));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! ((x + 32768) >> 16) */
+  inline __m128i Unfix(__m128i x)
+  {
+    return _mm_srai_epi32(_mm_add_epi32(x, _mm_set1_epi32(32768)), 16);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Interleave the values of the first and second pixels of the pixel pairs and convert them to 16-bit */
+  inline __m128i InterleavePixels(__m128i first, __m128i second)
+  {
+    return _mm_packs_epi32(_mm_unpacklo_epi32(first, second), _mm_unpackhi_epi32(first, second));
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+  Convert 4 YUY2 pixel pairs to 8 RGB pixels (16-bit values, not clipped).
+  Computes exactly the same values as GET_R/G/B_FROM_YUV. The fixed-point coefficients that do not fit
+  into 16 bits are split to a multiple of 65536 and a 16-bit remainder, so that _mm_madd_epi16 can be used.
+  */
+  inline void YUV422pToRGB(__m128i yuv, __m128i& r, __m128i& g, __m128i& b)
+  {
+    const __m128i y1 = _mm_shuffle_epi8(yuv, _mm_setr_epi8(0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1));
+    const __m128i u = _mm_shuffle_epi8(yuv, _mm_setr_epi8(1, -1, -1, -1, 5, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1));
+    const __m128i y2 = _mm_shuffle_epi8(yuv, _mm_setr_epi8(2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1));
+    const __m128i v = _mm_shuffle_epi8(yuv, _mm_setr_epi8(3, -1, -1, -1, 7, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1));
+
+    // ICCIRY and ICCIRUV
+    const __m128 yDivisor = _mm_set1_ps(219.0f);
+    const __m128 uvDivisor = _mm_set1_ps(224.0f);
+    const __m128i Y1 = ScaleAndDivide(_mm_sub_epi32(y1, _mm_set1_epi32(16)), yDivisor);
+    const __m128i Y2 = ScaleAndDivide(_mm_sub_epi32(y2, _mm_set1_epi32(16)), yDivisor);
+    const __m128i U = ScaleAndDivide(_mm_sub_epi32(u, _mm_set1_epi32(128)), uvDivisor);
+    const __m128i V = ScaleAndDivide(_mm_sub_epi32(v, _mm_set1_epi32(128)), uvDivisor);
+
+    // U in the low, V in the high 16 bits
+    const __m128i UV = _mm_or_si128(_mm_and_si128(U, _mm_set1_epi32(0xFFFF)), _mm_slli_epi32(V, 16));
+
+    // 91881 = 65536 + 26345
+    const __m128i rOffset = _mm_add_epi32(V, Unfix(_mm_madd_epi16(UV, _mm_set1_epi32(26345 << 16))));
+    // -46792 = -65536 + 18744
+    const __m128i gOffset = _mm_sub_epi32(Unfix(_mm_madd_epi16(UV, _mm_set1_epi32((18744 << 16) | (-22544 & 0xFFFF)))), V);
+    // 116129 = 2 * 65536 - 14943
+    const __m128i bOffset = _mm_add_epi32(_mm_slli_epi32(U, 1), Unfix(_mm_madd_epi16(UV, _mm_set1_epi32(-14943 & 0xFFFF))));
+
+    r = InterleavePixels(_mm_add_epi32(Y1, rOffset), _mm_add_epi32(Y2, rOffset));
+    g = InterleavePixels(_mm_add_epi32(Y1, gOffset), _mm_add_epi32(Y2, gOffset));
+    b = InterleavePixels(_mm_add_epi32(Y1, bOffset), _mm_add_epi32(Y2, bOffset));
+  }
+
+  //----------------------------------------------------------------------------
+  void YUV422pToRGB24(bool bgrOrder, int numberOfPixelPairs, const unsigned char* s, unsigned char* d)
+  {
+    // Masks that interleave (c0 x 8, c1 x 8) and (c2 x 8) to 8 3-component pixels
+    const __m128i c0c1Mask0 = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+    const __m128i c2Mask0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i c0c1Mask1 = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i c2Mask1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 4 <= numberOfPixelPairs; i += 4)
+    {
+      __m128i r, g, b;
+      YUV422pToRGB(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4 * i)), r, g, b);
+      // _mm_packus_epi16 clips the values to [0, 255]
+      __m128i c0c1 = _mm_packus_epi16(bgrOrder ? b : r, g);
+      __m128i c2 = _mm_packus_epi16(bgrOrder ? r : b, bgrOrder ? r : b);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 6 * i), _mm_or_si128(_mm_shuffle_epi8(c0c1, c0c1Mask0), _mm_shuffle_epi8(c2, c2Mask0)));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 6 * i + 16), _mm_or_si128(_mm_shuffle_epi8(c0c1, c0c1Mask1), _mm_shuffle_epi8(c2, c2Mask1)));
+    }
+    PixelCodecKernels::ScalarYUV422pToRGB24(bgrOrder, numberOfPixelPairs - i, s + 4 * i, d + 6 * i);
+  }
+
+  //----------------------------------------------------------------------------
+  void YUV422pToGray(int numberOfPixelPairs, const unsigned char* s, unsigned char* d)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxValue = _mm_set1_epi16(255);
+    int i = 0;
+    for (; i + 4 <= numberOfPixelPairs; i += 4)
+    {
+      __m128i r, g, b;
+      YUV422pToRGB(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4 * i)), r, g, b);
+      r = _mm_max_epi16(_mm_min_epi16(r, maxValue), zero);
+      g = _mm_max_epi16(_mm_min_epi16(g, maxValue), zero);
+      b = _mm_max_epi16(_mm_min_epi16(b, maxValue), zero);
+      __m128i gray = DivideBy3(_mm_add_epi16(_mm_add_epi16(r, g), b));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 2 * i), _mm_packus_epi16(gray, gray));
+    }
+    PixelCodecKernels::ScalarYUV422pToGray(numberOfPixelPairs - i, s + 4 * i, d + 2 * i);
+  }
+}
+
+//----------------------------------------------------------------------------
+bool PixelCodecKernels::GetSSSE3Functions(ConversionFunctions& functions)
+{
+  functions.RGBToBGR = RGBToBGR;
+  functions.RGBA32ToRGB24 = RGBA32ToRGB24;
+  functions.RGBA32ToBGR24 = RGBA32ToBGR24;
+  functions.RGB24ToGray = RGB24ToGray;
+  functions.RGBA32ToGray = RGBA32ToGray;
+  functions.YUV422pToRGB24 = YUV422pToRGB24;
+  functions.YUV422pToGray = YUV422pToGray;
+  return true;
+}
+
+#else
+
+//----------------------------------------------------------------------------
+bool PixelCodecKernels::GetSSSE3Functions(ConversionFunctions&)
+{
+  return false;
+}
+
+#endif
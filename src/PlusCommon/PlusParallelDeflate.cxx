@@ -0,0 +1,337 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusParallelDeflate.h"
+#include "PlusThreadPool.h"
+
+// IGSIO includes
+#include <vtkIGSIOAccurateTimer.h>
+
+// VTK includes
+#include <vtk_zlib.h>
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  const unsigned int DEFAULT_CHUNK_SIZE_BYTES = 1024 * 1024;
+  const unsigned int MIN_CHUNK_SIZE_BYTES = 32 * 1024;
+  const unsigned int MAX_CHUNK_SIZE_BYTES = 256 * 1024 * 1024;
+  /*! Minimal gzip header: deflate method, no flags, no modification time, unknown operating system */
+  const unsigned char GZIP_HEADER[10] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff };
+
+  //----------------------------------------------------------------------------
+  void WriteUInt32LittleEndian(std::ostream& output, unsigned long value)
+  {
+    unsigned char bytes[4] =
+    {
+      static_cast<unsigned char>(value & 0xff),
+      static_cast<unsigned char>((value >> 8) & 0xff),
+      static_cast<unsigned char>((value >> 16) & 0xff),
+      static_cast<unsigned char>((value >> 24) & 0xff)
+    };
+    output.write(reinterpret_cast<const char*>(bytes), 4);
+  }
+}
+
+//----------------------------------------------------------------------------
+struct PlusParallelDeflate::ChunkInput
+{
+  ChunkInput() : Data(NULL), Size(0) {}
+  /*! Buffer that owns the data if it was read from a stream, empty if the data is in the caller's memory */
+  std::shared_ptr<std::vector<unsigned char> > Buffer;
+  const unsigned char* Data;
+  unsigned int Size;
+};
+
+//----------------------------------------------------------------------------
+struct PlusParallelDeflate::CompressedChunk
+{
+  CompressedChunk() : Crc(0), InputSize(0), CompressionTimeSec(0.0), Success(false) {}
+  std::vector<unsigned char> Data;
+  unsigned long Crc;
+  unsigned int InputSize;
+  double CompressionTimeSec;
+  bool Success;
+};
+
+//----------------------------------------------------------------------------
+PlusParallelDeflate::PlusParallelDeflate()
+  : NumberOfThreads(0)
+  , ChunkSizeBytes(DEFAULT_CHUNK_SIZE_BYTES)
+  , CompressionLevel(Z_DEFAULT_COMPRESSION)
+  , NumberOfInputBytes(0)
+  , NumberOfOutputBytes(0)
+  , ElapsedTimeSec(0.0)
+  , CompressionTimeSec(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusParallelDeflate::~PlusParallelDeflate()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusParallelDeflate::SetNumberOfThreads(unsigned int numberOfThreads)
+{
+  this->NumberOfThreads = numberOfThreads;
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusParallelDeflate::GetNumberOfThreads() const
+{
+  if (this->NumberOfThreads > 0)
+  {
+    return this->NumberOfThreads;
+  }
+  unsigned int hardwareThreads = std::thread::hardware_concurrency();
+  return (hardwareThreads > 0 ? hardwareThreads : 1);
+}
+
+//----------------------------------------------------------------------------
+void PlusParallelDeflate::SetChunkSizeBytes(unsigned int chunkSizeBytes)
+{
+  this->ChunkSizeBytes = std::min(std::max(chunkSizeBytes, MIN_CHUNK_SIZE_BYTES), MAX_CHUNK_SIZE_BYTES);
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusParallelDeflate::GetChunkSizeBytes() const
+{
+  return this->ChunkSizeBytes;
+}
+
+//----------------------------------------------------------------------------
+void PlusParallelDeflate::SetCompressionLevel(int level)
+{
+  this->CompressionLevel = level;
+}
+
+//----------------------------------------------------------------------------
+int PlusParallelDeflate::GetCompressionLevel() const
+{
+  return this->CompressionLevel;
+}
+
+//----------------------------------------------------------------------------
+void PlusParallelDeflate::SetProgressCallback(const ProgressCallbackType& callback)
+{
+  this->ProgressCallback = callback;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusParallelDeflate::GetNumberOfInputBytes() const
+{
+  return this->NumberOfInputBytes;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusParallelDeflate::GetNumberOfOutputBytes() const
+{
+  return this->NumberOfOutputBytes;
+}
+
+//----------------------------------------------------------------------------
+double PlusParallelDeflate::GetElapsedTimeSec() const
+{
+  return this->ElapsedTimeSec;
+}
+
+//----------------------------------------------------------------------------
+double PlusParallelDeflate::GetCompressionTimeSec() const
+{
+  return this->CompressionTimeSec;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusParallelDeflate::Compress(std::istream& input, unsigned long long numberOfBytes, std::ostream& output)
+{
+  return this->CompressChunks(numberOfBytes, [&input](unsigned long long offset, unsigned int size, ChunkInput & chunk) -> PlusStatus
+  {
+    chunk.Buffer = std::make_shared<std::vector<unsigned char> >(size);
+    if (size > 0 && !input.read(reinterpret_cast<char*>(&(*chunk.Buffer)[0]), size))
+    {
+      LOG_ERROR("Failed to read " << size << " bytes from the input at offset " << offset);
+      return PLUS_FAIL;
+    }
+    chunk.Data = (size > 0 ? &(*chunk.Buffer)[0] : NULL);
+    chunk.Size = size;
+    return PLUS_SUCCESS;
+  }, output);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusParallelDeflate::Compress(const unsigned char* data, unsigned long long numberOfBytes, std::ostream& output)
+{
+  return this->CompressChunks(numberOfBytes, [data](unsigned long long offset, unsigned int size, ChunkInput & chunk) -> PlusStatus
+  {
+    chunk.Data = data + offset;
+    chunk.Size = size;
+    return PLUS_SUCCESS;
+  }, output);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusParallelDeflate::CompressChunks(unsigned long long numberOfBytes, const std::function<PlusStatus(unsigned long long offset, unsigned int size, ChunkInput& chunk)>& getChunk, std::ostream& output)
+{
+  double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+  this->NumberOfInputBytes = 0;
+  this->NumberOfOutputBytes = 0;
+  this->CompressionTimeSec = 0.0;
+
+  const unsigned int numberOfThreads = this->GetNumberOfThreads();
+  if (this->ThreadPool.get() == NULL || this->ThreadPool->GetNumberOfThreads() != numberOfThreads)
+  {
+    this->ThreadPool.reset(new PlusThreadPool(numberOfThreads));
+  }
+  // An empty input is compressed as one empty chunk, because the stream must contain a final block
+  const unsigned long long numberOfChunks = std::max<unsigned long long>(1, (numberOfBytes + this->ChunkSizeBytes - 1) / this->ChunkSizeBytes);
+
+  output.write(reinterpret_cast<const char*>(GZIP_HEADER), sizeof(GZIP_HEADER));
+  this->NumberOfOutputBytes += sizeof(GZIP_HEADER);
+
+  unsigned long crc = crc32(0L, Z_NULL, 0);
+  PlusStatus status = PLUS_SUCCESS;
+
+  // Chunks that are being compressed, in the order they have to be written.
+  // At most one chunk per thread is in progress, which limits the memory usage.
+  std::deque<std::future<CompressedChunk> > pendingChunks;
+  unsigned long long nextChunkIndex = 0;
+  while (nextChunkIndex < numberOfChunks || !pendingChunks.empty())
+  {
+    if (status == PLUS_SUCCESS && nextChunkIndex < numberOfChunks && pendingChunks.size() < numberOfThreads)
+    {
+      unsigned long long offset = nextChunkIndex * this->ChunkSizeBytes;
+      unsigned int size = static_cast<unsigned int>(std::min<unsigned long long>(this->ChunkSizeBytes, numberOfBytes - offset));
+      ChunkInput chunk;
+      if (getChunk(offset, size, chunk) != PLUS_SUCCESS)
+      {
+        status = PLUS_FAIL;
+        continue;
+      }
+      bool lastChunk = (nextChunkIndex + 1 == numberOfChunks);
+      const int compressionLevel = this->CompressionLevel;
+      pendingChunks.push_back(this->ThreadPool->Submit([chunk, lastChunk, compressionLevel]() { return PlusParallelDeflate::CompressChunk(chunk, lastChunk, compressionLevel); }));
+      nextChunkIndex++;
+      continue;
+    }
+    if (pendingChunks.empty())
+    {
+      // Failed before all the chunks were started
+      break;
+    }
+
+    CompressedChunk compressedChunk = pendingChunks.front().get();
+    pendingChunks.pop_front();
+    this->CompressionTimeSec += compressedChunk.CompressionTimeSec;
+    if (status != PLUS_SUCCESS)
+    {
+      // Only wait for the completion of the already started chunks
+      continue;
+    }
+    if (!compressedChunk.Success)
+    {
+      LOG_ERROR("Failed to compress data chunk");
+      status = PLUS_FAIL;
+      continue;
+    }
+    if (!compressedChunk.Data.empty())
+    {
+      output.write(reinterpret_cast<const char*>(&compressedChunk.Data[0]), compressedChunk.Data.size());
+    }
+    crc = crc32_combine(crc, compressedChunk.Crc, compressedChunk.InputSize);
+    this->NumberOfInputBytes += compressedChunk.InputSize;
+    this->NumberOfOutputBytes += compressedChunk.Data.size();
+    if (this->ProgressCallback)
+    {
+      this->ProgressCallback(this->NumberOfInputBytes, numberOfBytes);
+    }
+  }
+
+  if (status == PLUS_SUCCESS)
+  {
+    // gzip trailer: checksum and size of the uncompressed data (modulo 2^32)
+    WriteUInt32LittleEndian(output, crc);
+    WriteUInt32LittleEndian(output, static_cast<unsigned long>(this->NumberOfInputBytes & 0xffffffffULL));
+    this->NumberOfOutputBytes += 8;
+    output.flush();
+    if (!output)
+    {
+      LOG_ERROR("Failed to write compressed data");
+      status = PLUS_FAIL;
+    }
+  }
+
+  this->ElapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusParallelDeflate::CompressedChunk PlusParallelDeflate::CompressChunk(const ChunkInput& chunk, bool lastChunk, int compressionLevel)
+{
+  double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+  CompressedChunk result;
+  result.InputSize = chunk.Size;
+  result.Crc = crc32(0L, Z_NULL, 0);
+  if (chunk.Size > 0)
+  {
+    result.Crc = crc32(result.Crc, chunk.Data, chunk.Size);
+  }
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // Negative window bits: raw deflate stream, the gzip header and trailer are written for the whole stream
+  if (deflateInit2(&stream, compressionLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    return result;
+  }
+
+  // deflateBound does not include the empty block that the sync flush appends
+  result.Data.resize(deflateBound(&stream, chunk.Size) + 16);
+  stream.next_in = const_cast<Bytef*>(chunk.Data);
+  stream.avail_in = chunk.Size;
+  stream.next_out = &result.Data[0];
+  stream.avail_out = static_cast<uInt>(result.Data.size());
+
+  // Chunks other than the last one end with a sync flush: it aligns the output to a byte boundary
+  // without marking the last block, so the next chunk's compressed data can be simply appended.
+  const int flush = (lastChunk ? Z_FINISH : Z_SYNC_FLUSH);
+  while (true)
+  {
+    int ret = deflate(&stream, flush);
+    bool completed = (lastChunk ? ret == Z_STREAM_END : (ret == Z_OK && stream.avail_in == 0 && stream.avail_out > 0));
+    if (completed)
+    {
+      result.Success = true;
+      break;
+    }
+    if ((ret != Z_OK && ret != Z_BUF_ERROR) || stream.avail_out > 0)
+    {
+      // Error or no progress is possible
+      break;
+    }
+    // Output buffer is full, extend it
+    size_t usedSize = result.Data.size();
+    result.Data.resize(usedSize * 2);
+    stream.next_out = &result.Data[usedSize];
+    stream.avail_out = static_cast<uInt>(result.Data.size() - usedSize);
+  }
+  result.Data.resize(result.Data.size() - stream.avail_out);
+  deflateEnd(&stream);
+
+  result.CompressionTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+  return result;
+}
@@ -0,0 +1,100 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusParallelDeflate_h
+#define __PlusParallelDeflate_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusCommonExport.h"
+
+// STL includes
+#include <functional>
+#include <iosfwd>
+#include <memory>
+
+class PlusThreadPool;
+
+/*!
+  \class PlusParallelDeflate
+  \brief Compresses data to gzip format using multiple threads
+
+  The input is split into fixed-size chunks, which are compressed independently by worker threads and
+  written to the output in their original order. Each chunk is flushed to a byte boundary and the checksums
+  of the chunks are combined, so the output is one standard gzip stream that can be read by any gzip
+  decompressor (including the readers of the sequence files). Compression ratio is slightly lower than
+  single-threaded compression, because repeated patterns are not searched across chunk boundaries.
+  The worker threads are created at the first Compress call and reused by the next calls.
+
+  \ingroup PlusLibCommon
+*/
+class vtkPlusCommonExport PlusParallelDeflate
+{
+public:
+  PlusParallelDeflate();
+  virtual ~PlusParallelDeflate();
+
+  /*! Number of threads that compress chunks in parallel. 0 means the number of hardware threads. */
+  void SetNumberOfThreads(unsigned int numberOfThreads);
+  unsigned int GetNumberOfThreads() const;
+
+  /*! Size of the independently compressed chunks. Smaller chunks use less memory but reduce the compression ratio. */
+  void SetChunkSizeBytes(unsigned int chunkSizeBytes);
+  unsigned int GetChunkSizeBytes() const;
+
+  /*! zlib compression level (1 = fastest, 9 = best compression) */
+  void SetCompressionLevel(int level);
+  int GetCompressionLevel() const;
+
+  /*! Called from the calling thread of Compress after each chunk is written to the output */
+  typedef std::function<void(unsigned long long numberOfCompressedBytes, unsigned long long numberOfBytes)> ProgressCallbackType;
+  void SetProgressCallback(const ProgressCallbackType& callback);
+
+  /*! Compress numberOfBytes bytes read from the input stream and write the gzip stream to the output */
+  PlusStatus Compress(std::istream& input, unsigned long long numberOfBytes, std::ostream& output);
+
+  /*! Compress a memory buffer and write the gzip stream to the output */
+  PlusStatus Compress(const unsigned char* data, unsigned long long numberOfBytes, std::ostream& output);
+
+  /*! Number of uncompressed bytes in the last Compress call */
+  unsigned long long GetNumberOfInputBytes() const;
+  /*! Number of bytes written to the output in the last Compress call (including the gzip header and trailer) */
+  unsigned long long GetNumberOfOutputBytes() const;
+  /*! Wall clock time of the last Compress call */
+  double GetElapsedTimeSec() const;
+  /*! Sum of the time spent with compression in all threads in the last Compress call (approximately the CPU time) */
+  double GetCompressionTimeSec() const;
+
+protected:
+  struct ChunkInput;
+  struct CompressedChunk;
+
+  /*!
+    Compress the chunks that are provided by getChunk and write them in order to the output.
+    getChunk is called from the calling thread, in the order of the chunks.
+  */
+  PlusStatus CompressChunks(unsigned long long numberOfBytes, const std::function<PlusStatus(unsigned long long offset, unsigned int size, ChunkInput& chunk)>& getChunk, std::ostream& output);
+
+  static CompressedChunk CompressChunk(const ChunkInput& chunk, bool lastChunk, int compressionLevel);
+
+  unsigned int NumberOfThreads;
+  unsigned int ChunkSizeBytes;
+  int CompressionLevel;
+  ProgressCallbackType ProgressCallback;
+
+  /*! Worker threads that compress the chunks, kept between Compress calls */
+  std::unique_ptr<PlusThreadPool> ThreadPool;
+
+  unsigned long long NumberOfInputBytes;
+  unsigned long long NumberOfOutputBytes;
+  double ElapsedTimeSec;
+  double CompressionTimeSec;
+
+private:
+  PlusParallelDeflate(const PlusParallelDeflate&);
+  void operator=(const PlusParallelDeflate&);
+};
+
+#endif
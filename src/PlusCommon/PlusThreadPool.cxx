@@ -0,0 +1,166 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusThreadPool.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+  /*! State of a ParallelFor call. Tasks of the shared pool may start after the call is completed, so they share the ownership. */
+  struct ParallelForState
+  {
+    ParallelForState(int numberOfBlocks) : NumberOfBlocks(numberOfBlocks), NextBlock(0), NumberOfCompletedBlocks(0) {}
+    const int NumberOfBlocks;
+    std::atomic<int> NextBlock;
+    int NumberOfCompletedBlocks;
+    std::mutex CompletedMutex;
+    std::condition_variable Completed;
+  };
+
+  //----------------------------------------------------------------------------
+  /*! Process blocks until all of them are taken. processRange is not accessed after the last block is completed. */
+  void ProcessParallelForBlocks(ParallelForState& state, int begin, int end, const std::function<void(int, int)>& processRange)
+  {
+    const int numberOfIndices = end - begin;
+    for (int block = state.NextBlock++; block < state.NumberOfBlocks; block = state.NextBlock++)
+    {
+      processRange(begin + static_cast<int>(static_cast<long long>(numberOfIndices) * block / state.NumberOfBlocks),
+                   begin + static_cast<int>(static_cast<long long>(numberOfIndices) * (block + 1) / state.NumberOfBlocks));
+      bool allCompleted = false;
+      {
+        std::lock_guard<std::mutex> completedLock(state.CompletedMutex);
+        allCompleted = (++state.NumberOfCompletedBlocks == state.NumberOfBlocks);
+      }
+      if (allCompleted)
+      {
+        state.Completed.notify_all();
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusThreadPool::PlusThreadPool(unsigned int numberOfThreads /*= 0*/)
+  : StopRequested(false)
+{
+  if (numberOfThreads == 0)
+  {
+    numberOfThreads = std::thread::hardware_concurrency();
+  }
+  numberOfThreads = std::max(numberOfThreads, 1u);
+  this->WorkerThreads.reserve(numberOfThreads);
+  for (unsigned int i = 0; i < numberOfThreads; ++i)
+  {
+    this->WorkerThreads.push_back(std::thread(&PlusThreadPool::WorkerThreadMain, this));
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusThreadPool::~PlusThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> tasksLock(this->TasksMutex);
+    this->StopRequested = true;
+  }
+  this->TasksChanged.notify_all();
+  for (std::vector<std::thread>::iterator it = this->WorkerThreads.begin(); it != this->WorkerThreads.end(); ++it)
+  {
+    it->join();
+  }
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusThreadPool::GetNumberOfThreads() const
+{
+  return static_cast<unsigned int>(this->WorkerThreads.size());
+}
+
+//----------------------------------------------------------------------------
+int PlusThreadPool::GetNumberOfThreadsToUse(int numberOfThreads)
+{
+  if (numberOfThreads > 0)
+  {
+    return numberOfThreads;
+  }
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+//----------------------------------------------------------------------------
+PlusThreadPool& PlusThreadPool::GetSharedInstance()
+{
+  // The calling thread of ParallelFor also processes blocks, so one thread less is enough.
+  // The pool is never deleted: joining threads during static destruction may deadlock (e.g., when a DLL is unloaded on Windows).
+  static PlusThreadPool* sharedInstance = new PlusThreadPool(static_cast<unsigned int>(std::max(1, GetNumberOfThreadsToUse(0) - 1)));
+  return *sharedInstance;
+}
+
+//----------------------------------------------------------------------------
+void PlusThreadPool::ParallelFor(int begin, int end, int numberOfThreads, const std::function<void(int, int)>& processRange)
+{
+  if (end <= begin)
+  {
+    return;
+  }
+  const int numberOfBlocks = std::min(GetNumberOfThreadsToUse(numberOfThreads), end - begin);
+  if (numberOfBlocks == 1)
+  {
+    processRange(begin, end);
+    return;
+  }
+
+  std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>(numberOfBlocks);
+  PlusThreadPool& pool = GetSharedInstance();
+  const int numberOfHelpers = std::min<int>(numberOfBlocks - 1, pool.GetNumberOfThreads());
+  for (int helper = 0; helper < numberOfHelpers; ++helper)
+  {
+    // processRange is captured by reference: it is only called for blocks that are completed before this function returns
+    pool.Enqueue([state, begin, end, &processRange]() { ProcessParallelForBlocks(*state, begin, end, processRange); });
+  }
+  ProcessParallelForBlocks(*state, begin, end, processRange);
+
+  std::unique_lock<std::mutex> completedLock(state->CompletedMutex);
+  state->Completed.wait(completedLock, [&state]() { return state->NumberOfCompletedBlocks == state->NumberOfBlocks; });
+}
+
+//----------------------------------------------------------------------------
+void PlusThreadPool::Enqueue(const std::function<void()>& task)
+{
+  {
+    std::lock_guard<std::mutex> tasksLock(this->TasksMutex);
+    if (this->StopRequested)
+    {
+      LOG_ERROR("Task is submitted to a thread pool that is being destroyed, it is not executed");
+      return;
+    }
+    this->Tasks.push_back(task);
+  }
+  this->TasksChanged.notify_one();
+}
+
+//----------------------------------------------------------------------------
+void PlusThreadPool::WorkerThreadMain()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> tasksLock(this->TasksMutex);
+      this->TasksChanged.wait(tasksLock, [this]() { return this->StopRequested || !this->Tasks.empty(); });
+      if (this->Tasks.empty())
+      {
+        // Stop is requested and all the submitted tasks are completed
+        return;
+      }
+      task = this->Tasks.front();
+      this->Tasks.pop_front();
+    }
+    task();
+  }
+}
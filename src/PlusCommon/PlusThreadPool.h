@@ -0,0 +1,86 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusThreadPool_h
+#define __PlusThreadPool_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusCommonExport.h"
+
+// STL includes
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*!
+  \class PlusThreadPool
+  \brief Fixed number of worker threads that execute submitted tasks in submission order
+
+  The worker threads are started when the pool is created and kept until it is destroyed, so tasks can be
+  submitted at a high rate (for example for each chunk of a file or each frame of a video) without the cost of
+  creating a thread for each of them. Tasks that are submitted after the destruction started are not executed.
+
+  ParallelFor splits a loop (for example over the scan lines of an image) into blocks that are processed by the
+  calling thread and the threads of a pool that is shared by all the image processing algorithms.
+
+  \ingroup PlusLibCommon
+*/
+class vtkPlusCommonExport PlusThreadPool
+{
+public:
+  /*! Start the worker threads. 0 means the number of hardware threads. */
+  explicit PlusThreadPool(unsigned int numberOfThreads = 0);
+  /*! Complete the already submitted tasks and stop the worker threads */
+  virtual ~PlusThreadPool();
+
+  unsigned int GetNumberOfThreads() const;
+
+  /*! Returns numberOfThreads if it is positive, otherwise the number of hardware threads */
+  static int GetNumberOfThreadsToUse(int numberOfThreads);
+
+  /*! Pool that is used by ParallelFor. Its threads are started at the first call. */
+  static PlusThreadPool& GetSharedInstance();
+
+  /*!
+    Calls processRange(blockBegin, blockEnd) for consecutive blocks of [begin, end) and waits until all of them are completed.
+    The range is split into numberOfThreads blocks (see GetNumberOfThreadsToUse), at most one block per index.
+    The calling thread processes blocks as well, so the call completes even if all the threads of the shared pool are busy.
+  */
+  static void ParallelFor(int begin, int end, int numberOfThreads, const std::function<void(int, int)>& processRange);
+
+  /*! Queue a task for execution. The returned future provides the result (or the exception) of the task. */
+  template<class Function>
+  std::future<typename std::result_of<Function()>::type> Submit(Function task)
+  {
+    typedef typename std::result_of<Function()>::type ResultType;
+    std::shared_ptr<std::packaged_task<ResultType()> > packagedTask = std::make_shared<std::packaged_task<ResultType()> >(task);
+    std::future<ResultType> result = packagedTask->get_future();
+    this->Enqueue([packagedTask]() { (*packagedTask)(); });
+    return result;
+  }
+
+protected:
+  void Enqueue(const std::function<void()>& task);
+  void WorkerThreadMain();
+
+  std::vector<std::thread> WorkerThreads;
+  std::deque<std::function<void()> > Tasks;
+  std::mutex TasksMutex;
+  std::condition_variable TasksChanged;
+  bool StopRequested;
+
+private:
+  PlusThreadPool(const PlusThreadPool&);
+  void operator=(const PlusThreadPool&);
+};
+
+#endif
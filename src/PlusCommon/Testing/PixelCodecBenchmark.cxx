@@ -0,0 +1,241 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PixelCodecBenchmark.cxx
+  \brief Measures the throughput of the PixelCodec conversions with each instruction set that the CPU supports.
+
+  For each conversion the throughput (megapixels per second) and the speedup compared to the scalar implementation
+  are printed. If Plus is built with libjpeg-turbo then the MJPG decoding throughput is measured as well.
+*/
+
+#include "PlusConfigure.h"
+#include "PixelCodec.h"
+#include "vtkIGSIOAccurateTimer.h"
+
+// VTK includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  #include <cstdio>
+  #include <jpeglib.h>
+#endif
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  void YUY2ToRGB24(int width, int height, unsigned char* s, unsigned char* d)
+  {
+    PixelCodec::YUV422pToRGB24(PixelCodec::ComponentOrder_RGB, width, height, s, d);
+  }
+
+  struct Conversion
+  {
+    const char* Name;
+    int InputBytesPerPixel;
+    int OutputBytesPerPixel;
+    void (*Convert)(int width, int height, unsigned char* s, unsigned char* d);
+  };
+
+  const Conversion CONVERSIONS[] =
+  {
+    {"RGBToBGR", 3, 3, PixelCodec::RGBToBGR},
+    {"BGRA32ToRGB24", 4, 3, PixelCodec::BGRA32ToRGB24},
+    {"RGBA32ToRGB24", 4, 3, PixelCodec::RGBA32ToRGB24},
+    {"RGB24ToGray", 3, 1, PixelCodec::RGB24ToGray},
+    {"RGBA32ToGray", 4, 1, PixelCodec::RGBA32ToGray},
+    {"YUY2ToRGB24", 2, 3, YUY2ToRGB24},
+    {"YUY2ToGray", 2, 1, PixelCodec::YUV422pToGray}
+  };
+  const int NUMBER_OF_CONVERSIONS = sizeof(CONVERSIONS) / sizeof(CONVERSIONS[0]);
+
+  //----------------------------------------------------------------------------
+  /*! Returns the throughput in megapixels per second */
+  double MeasureThroughput(const Conversion& conversion, int width, int height, int numberOfIterations)
+  {
+    std::vector<unsigned char> input(width * height * conversion.InputBytesPerPixel);
+    unsigned int randomState = 12345;
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+      randomState = randomState * 1103515245 + 12345;
+      input[i] = static_cast<unsigned char>(randomState >> 16);
+    }
+    std::vector<unsigned char> output(width * height * conversion.OutputBytesPerPixel);
+    // Warm up (page faults, CPU frequency)
+    conversion.Convert(width, height, &input[0], &output[0]);
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (int i = 0; i < numberOfIterations; ++i)
+    {
+      conversion.Convert(width, height, &input[0], &output[0]);
+    }
+    double elapsedTimeSec = std::max(vtkIGSIOAccurateTimer::GetSystemTime() - startTime, 1e-6);
+    return static_cast<double>(width) * height * numberOfIterations / elapsedTimeSec / 1.0e6;
+  }
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  //----------------------------------------------------------------------------
+  /*! Encode a synthetic camera-like image (smooth gradients with some noise) */
+  void EncodeJpeg(int width, int height, std::vector<unsigned char>& jpegData)
+  {
+    std::vector<unsigned char> rgbImage(width * height * 3);
+    unsigned int randomState = 12345;
+    for (int y = 0; y < height; ++y)
+    {
+      for (int x = 0; x < width; ++x)
+      {
+        randomState = randomState * 1103515245 + 12345;
+        int noise = static_cast<int>((randomState >> 16) & 0x0f);
+        unsigned char* pixel = &rgbImage[(y * width + x) * 3];
+        pixel[0] = static_cast<unsigned char>(x * 200 / width + noise);
+        pixel[1] = static_cast<unsigned char>(y * 200 / height + noise);
+        pixel[2] = static_cast<unsigned char>(((x + y) % 128) + noise);
+      }
+    }
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr errorManager;
+    cinfo.err = jpeg_std_error(&errorManager);
+    jpeg_create_compress(&cinfo);
+    unsigned char* outputBuffer = NULL;
+    unsigned long outputSize = 0;
+    jpeg_mem_dest(&cinfo, &outputBuffer, &outputSize);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+      JSAMPROW row = &rgbImage[cinfo.next_scanline * width * 3];
+      jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    jpegData.assign(outputBuffer, outputBuffer + outputSize);
+    free(outputBuffer);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Returns the number of decoded frames per second or a negative value if decoding failed */
+  double MeasureMJPGDecodingFrameRate(bool grayOutput, int width, int height, int numberOfIterations)
+  {
+    std::vector<unsigned char> jpegData;
+    EncodeJpeg(width, height, jpegData);
+    std::vector<unsigned char> output(width * height * 3);
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (int i = 0; i < numberOfIterations; ++i)
+    {
+      PlusStatus status = grayOutput
+                          ? PixelCodec::ConvertToGray(PixelCodec::PixelEncoding_MJPG, width, height, &jpegData[0], &output[0], static_cast<unsigned int>(jpegData.size()))
+                          : PixelCodec::ConvertToBGR24(PixelCodec::ComponentOrder_RGB, PixelCodec::PixelEncoding_MJPG, width, height, &jpegData[0], &output[0], static_cast<unsigned int>(jpegData.size()));
+      if (status != PLUS_SUCCESS)
+      {
+        return -1;
+      }
+    }
+    double elapsedTimeSec = std::max(vtkIGSIOAccurateTimer::GetSystemTime() - startTime, 1e-6);
+    return numberOfIterations / elapsedTimeSec;
+  }
+#endif
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  int width = 1920;
+  int height = 1080;
+  int numberOfIterations = 100;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--width", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &width, "Width of the test image in pixels (default: 1920).");
+  args.AddArgument("--height", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &height, "Height of the test image in pixels (default: 1080).");
+  args.AddArgument("--iterations", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfIterations, "Number of conversions of each type (default: 100).");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (width <= 0 || height <= 0 || numberOfIterations <= 0)
+  {
+    LOG_ERROR("Image size and number of iterations must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  int numberOfErrors(0);
+  PixelCodec::InstructionSet supportedInstructionSet = PixelCodec::GetSupportedInstructionSet();
+  LOG_INFO("Converting " << width << "x" << height << " images, supported instruction set: " << PixelCodec::GetInstructionSetAsString(supportedInstructionSet));
+  LOG_INFO("Conversion      | Instruction set | Throughput (Mpixel/s) | Speedup");
+  for (int conversionIndex = 0; conversionIndex < NUMBER_OF_CONVERSIONS; ++conversionIndex)
+  {
+    double scalarThroughput = 0;
+    for (int instructionSet = PixelCodec::InstructionSet_Scalar; instructionSet <= supportedInstructionSet; ++instructionSet)
+    {
+      PixelCodec::SetMaximumInstructionSet(static_cast<PixelCodec::InstructionSet>(instructionSet));
+      double throughput = MeasureThroughput(CONVERSIONS[conversionIndex], width, height, numberOfIterations);
+      if (instructionSet == PixelCodec::InstructionSet_Scalar)
+      {
+        scalarThroughput = throughput;
+      }
+      std::ostringstream row;
+      row << std::left << std::setw(15) << CONVERSIONS[conversionIndex].Name
+          << " | " << std::setw(15) << PixelCodec::GetInstructionSetAsString(static_cast<PixelCodec::InstructionSet>(instructionSet))
+          << std::right << std::fixed << std::setprecision(2)
+          << " | " << std::setw(21) << throughput
+          << " | " << std::setw(7) << throughput / scalarThroughput;
+      LOG_INFO(row.str());
+    }
+  }
+  PixelCodec::SetMaximumInstructionSet(supportedInstructionSet);
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  for (int grayOutput = 0; grayOutput <= 1; ++grayOutput)
+  {
+    double frameRate = MeasureMJPGDecodingFrameRate(grayOutput != 0, width, height, numberOfIterations);
+    if (frameRate < 0)
+    {
+      LOG_ERROR("MJPG decoding failed");
+      numberOfErrors++;
+      continue;
+    }
+    LOG_INFO("MJPG decoding to " << (grayOutput ? "grayscale" : "RGB24") << ": " << std::fixed << std::setprecision(1) << frameRate << " frames/s");
+  }
+#else
+  LOG_INFO("MJPG decoding is not measured, Plus is built without libjpeg-turbo");
+#endif
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,313 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PixelCodecTest.cxx
+  \brief Verifies the pixel format conversions of PixelCodec.
+
+  The output of the scalar implementation is compared to golden checksums, computed from the original
+  scalar implementation. The output of all SIMD implementations that the CPU supports must be exactly
+  the same as the output of the scalar implementation, for image sizes that are not multiples of the vector size as well.
+  If Plus is built with libjpeg-turbo then an encoded synthetic image is decoded with the MJPG decoder.
+*/
+
+#include "PlusConfigure.h"
+#include "PixelCodec.h"
+
+// VTK includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <vector>
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  #include <cstdio>
+  #include <jpeglib.h>
+#endif
+
+namespace
+{
+  const int GOLDEN_IMAGE_WIDTH = 322;
+  const int GOLDEN_IMAGE_HEIGHT = 37;
+
+  //----------------------------------------------------------------------------
+  void YUY2ToRGB24(int width, int height, unsigned char* s, unsigned char* d)
+  {
+    PixelCodec::YUV422pToRGB24(PixelCodec::ComponentOrder_RGB, width, height, s, d);
+  }
+
+  //----------------------------------------------------------------------------
+  void YUY2ToBGR24(int width, int height, unsigned char* s, unsigned char* d)
+  {
+    PixelCodec::YUV422pToRGB24(PixelCodec::ComponentOrder_BGR, width, height, s, d);
+  }
+
+  struct Conversion
+  {
+    const char* Name;
+    int InputBytesPerPixel;
+    int OutputBytesPerPixel;
+    void (*Convert)(int width, int height, unsigned char* s, unsigned char* d);
+    /*! FNV-1a hash of the output of the golden image */
+    unsigned int GoldenChecksum;
+  };
+
+  const Conversion CONVERSIONS[] =
+  {
+    {"RGBToBGR", 3, 3, PixelCodec::RGBToBGR, 0xf3a63000},
+    {"BGRA32ToRGB24", 4, 3, PixelCodec::BGRA32ToRGB24, 0x067630a1},
+    {"RGBA32ToBGR24", 4, 3, PixelCodec::RGBA32ToBGR24, 0x067630a1},
+    {"RGBA32ToRGB24", 4, 3, PixelCodec::RGBA32ToRGB24, 0x89af743d},
+    {"RGB24ToGray", 3, 1, PixelCodec::RGB24ToGray, 0xf210e5a1},
+    {"RGBA32ToGray", 4, 1, PixelCodec::RGBA32ToGray, 0xc2f6ea4f},
+    {"YUY2ToRGB24", 2, 3, YUY2ToRGB24, 0xf068635d},
+    {"YUY2ToBGR24", 2, 3, YUY2ToBGR24, 0xc106a415},
+    {"YUY2ToGray", 2, 1, PixelCodec::YUV422pToGray, 0x9d0eb7b4}
+  };
+  const int NUMBER_OF_CONVERSIONS = sizeof(CONVERSIONS) / sizeof(CONVERSIONS[0]);
+
+  //----------------------------------------------------------------------------
+  void GenerateInput(std::vector<unsigned char>& data, unsigned int seed)
+  {
+    unsigned int randomState = seed;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+      // Linear congruential generator, only the higher bits are used
+      randomState = randomState * 1103515245 + 12345;
+      data[i] = static_cast<unsigned char>(randomState >> 16);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  unsigned int ComputeChecksum(const std::vector<unsigned char>& data)
+  {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+      hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  //----------------------------------------------------------------------------
+  void Convert(const Conversion& conversion, int width, int height, std::vector<unsigned char>& output)
+  {
+    std::vector<unsigned char> input(width * height * conversion.InputBytesPerPixel);
+    GenerateInput(input, width * 1000 + height);
+    // Pixels that are not converted (last column of YUY2 images with odd width) remain zero
+    output.assign(width * height * conversion.OutputBytesPerPixel, 0);
+    conversion.Convert(width, height, &input[0], &output[0]);
+  }
+
+  //----------------------------------------------------------------------------
+  int TestGoldenChecksums()
+  {
+    int numberOfErrors = 0;
+    PixelCodec::SetMaximumInstructionSet(PixelCodec::InstructionSet_Scalar);
+    for (int i = 0; i < NUMBER_OF_CONVERSIONS; ++i)
+    {
+      std::vector<unsigned char> output;
+      Convert(CONVERSIONS[i], GOLDEN_IMAGE_WIDTH, GOLDEN_IMAGE_HEIGHT, output);
+      unsigned int checksum = ComputeChecksum(output);
+      if (checksum != CONVERSIONS[i].GoldenChecksum)
+      {
+        LOG_ERROR(CONVERSIONS[i].Name << ": output checksum mismatch (expected: 0x" << std::hex << CONVERSIONS[i].GoldenChecksum << ", actual: 0x" << checksum << std::dec << ")");
+        numberOfErrors++;
+      }
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestInstructionSet(PixelCodec::InstructionSet instructionSet)
+  {
+    const int imageSizes[][2] = { {1, 1}, {2, 1}, {7, 3}, {17, 1}, {33, 5}, {GOLDEN_IMAGE_WIDTH, GOLDEN_IMAGE_HEIGHT}, {640, 480} };
+    const int numberOfImageSizes = sizeof(imageSizes) / sizeof(imageSizes[0]);
+    std::string instructionSetName = PixelCodec::GetInstructionSetAsString(instructionSet);
+    int numberOfErrors = 0;
+    for (int i = 0; i < NUMBER_OF_CONVERSIONS; ++i)
+    {
+      for (int sizeIndex = 0; sizeIndex < numberOfImageSizes; ++sizeIndex)
+      {
+        int width = imageSizes[sizeIndex][0];
+        int height = imageSizes[sizeIndex][1];
+        std::vector<unsigned char> referenceOutput;
+        PixelCodec::SetMaximumInstructionSet(PixelCodec::InstructionSet_Scalar);
+        Convert(CONVERSIONS[i], width, height, referenceOutput);
+        std::vector<unsigned char> output;
+        PixelCodec::SetMaximumInstructionSet(instructionSet);
+        Convert(CONVERSIONS[i], width, height, output);
+        if (output != referenceOutput)
+        {
+          LOG_ERROR(CONVERSIONS[i].Name << " (" << instructionSetName << "): output of " << width << "x" << height << " image is different from the scalar implementation");
+          numberOfErrors++;
+        }
+      }
+    }
+
+    // In-place conversion
+    std::vector<unsigned char> image(GOLDEN_IMAGE_WIDTH * GOLDEN_IMAGE_HEIGHT * 3);
+    GenerateInput(image, 1);
+    std::vector<unsigned char> referenceOutput(image.size());
+    PixelCodec::SetMaximumInstructionSet(instructionSet);
+    PixelCodec::RGBToBGR(GOLDEN_IMAGE_WIDTH, GOLDEN_IMAGE_HEIGHT, &image[0], &referenceOutput[0]);
+    PixelCodec::RGBToBGR(GOLDEN_IMAGE_WIDTH, GOLDEN_IMAGE_HEIGHT, &image[0], &image[0]);
+    if (image != referenceOutput)
+    {
+      LOG_ERROR("RGBToBGR (" << instructionSetName << "): in-place conversion failed");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  //----------------------------------------------------------------------------
+  void EncodeJpeg(const std::vector<unsigned char>& rgbImage, int width, int height, std::vector<unsigned char>& jpegData)
+  {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr errorManager;
+    cinfo.err = jpeg_std_error(&errorManager);
+    jpeg_create_compress(&cinfo);
+    unsigned char* outputBuffer = NULL;
+    unsigned long outputSize = 0;
+    jpeg_mem_dest(&cinfo, &outputBuffer, &outputSize);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 95, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+      JSAMPROW row = const_cast<unsigned char*>(&rgbImage[cinfo.next_scanline * width * 3]);
+      jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    jpegData.assign(outputBuffer, outputBuffer + outputSize);
+    free(outputBuffer);
+  }
+
+  //----------------------------------------------------------------------------
+  int TestMJPGDecoding()
+  {
+    const double MAX_MEAN_ABSOLUTE_DIFFERENCE = 2.0;
+    const int width = GOLDEN_IMAGE_WIDTH;
+    const int height = GOLDEN_IMAGE_HEIGHT;
+    std::vector<unsigned char> rgbImage(width * height * 3);
+    for (int y = 0; y < height; ++y)
+    {
+      for (int x = 0; x < width; ++x)
+      {
+        unsigned char* pixel = &rgbImage[(y * width + x) * 3];
+        pixel[0] = static_cast<unsigned char>(x * 255 / width);
+        pixel[1] = static_cast<unsigned char>(y * 255 / height);
+        pixel[2] = static_cast<unsigned char>(128 + (x - y) / 4);
+      }
+    }
+    std::vector<unsigned char> jpegData;
+    EncodeJpeg(rgbImage, width, height, jpegData);
+
+    int numberOfErrors = 0;
+    std::vector<unsigned char> rgbOutput(rgbImage.size());
+    std::vector<unsigned char> bgrOutput(rgbImage.size());
+    std::vector<unsigned char> grayOutput(width * height);
+    if (PixelCodec::ConvertToBGR24(PixelCodec::ComponentOrder_RGB, PixelCodec::PixelEncoding_MJPG, width, height, &jpegData[0], &rgbOutput[0], static_cast<unsigned int>(jpegData.size())) != PLUS_SUCCESS
+        || PixelCodec::ConvertToBGR24(PixelCodec::ComponentOrder_BGR, PixelCodec::PixelEncoding_MJPG, width, height, &jpegData[0], &bgrOutput[0], static_cast<unsigned int>(jpegData.size())) != PLUS_SUCCESS
+        || PixelCodec::ConvertToGray(PixelCodec::PixelEncoding_MJPG, width, height, &jpegData[0], &grayOutput[0], static_cast<unsigned int>(jpegData.size())) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("MJPG decoding failed");
+      return 1;
+    }
+
+    double sumOfColorDifferences = 0;
+    double sumOfGrayDifferences = 0;
+    bool componentOrderMatches = true;
+    for (int i = 0; i < width * height; ++i)
+    {
+      for (int c = 0; c < 3; ++c)
+      {
+        sumOfColorDifferences += fabs(static_cast<double>(rgbOutput[i * 3 + c]) - rgbImage[i * 3 + c]);
+        componentOrderMatches = componentOrderMatches && (rgbOutput[i * 3 + c] == bgrOutput[i * 3 + 2 - c]);
+      }
+      double luminance = 0.299 * rgbImage[i * 3] + 0.587 * rgbImage[i * 3 + 1] + 0.114 * rgbImage[i * 3 + 2];
+      sumOfGrayDifferences += fabs(grayOutput[i] - luminance);
+    }
+    double meanColorDifference = sumOfColorDifferences / (width * height * 3);
+    double meanGrayDifference = sumOfGrayDifferences / (width * height);
+    LOG_INFO("MJPG decoding: mean absolute difference of RGB components = " << meanColorDifference << ", luminance = " << meanGrayDifference);
+    if (meanColorDifference > MAX_MEAN_ABSOLUTE_DIFFERENCE || meanGrayDifference > MAX_MEAN_ABSOLUTE_DIFFERENCE)
+    {
+      LOG_ERROR("Decoded MJPG image is too different from the original image");
+      numberOfErrors++;
+    }
+    if (!componentOrderMatches)
+    {
+      LOG_ERROR("RGB and BGR outputs of the MJPG decoder do not match");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+#endif
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  numberOfErrors += TestGoldenChecksums();
+
+  PixelCodec::InstructionSet supportedInstructionSet = PixelCodec::GetSupportedInstructionSet();
+  LOG_INFO("Supported instruction set: " << PixelCodec::GetInstructionSetAsString(supportedInstructionSet));
+  for (int instructionSet = PixelCodec::InstructionSet_SSSE3; instructionSet <= supportedInstructionSet; ++instructionSet)
+  {
+    numberOfErrors += TestInstructionSet(static_cast<PixelCodec::InstructionSet>(instructionSet));
+  }
+  PixelCodec::SetMaximumInstructionSet(supportedInstructionSet);
+
+#ifdef PLUS_USE_LIBJPEG_TURBO
+  numberOfErrors += TestMJPGDecoding();
+#else
+  LOG_INFO("MJPG decoding is not tested, Plus is built without libjpeg-turbo");
+#endif
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
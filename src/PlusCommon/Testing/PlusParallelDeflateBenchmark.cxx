@@ -0,0 +1,222 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusParallelDeflateBenchmark.cxx
+  \brief Measures the throughput of PlusParallelDeflate with different numbers of threads and verifies
+  that the output is a valid gzip stream that decompresses to the original data.
+
+  The input is synthetic ultrasound-like image data (smooth intensity profile with speckle noise).
+  For each thread count the compression speed (MB/s of uncompressed data), the time spent compressing
+  in all threads (approximately the CPU time) and the compression ratio are printed.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusParallelDeflate.h"
+
+// VTK includes
+#include <vtk_zlib.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  const int FRAME_WIDTH = 640;
+  const int FRAME_HEIGHT = 480;
+
+  //----------------------------------------------------------------------------
+  void GenerateTestData(std::vector<unsigned char>& data)
+  {
+    unsigned int randomState = 12345;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+      size_t frameIndex = i / (FRAME_WIDTH * FRAME_HEIGHT);
+      int row = static_cast<int>((i / FRAME_WIDTH) % FRAME_HEIGHT);
+      // Linear congruential generator, only the higher bits are used as noise
+      randomState = randomState * 1103515245 + 12345;
+      int speckle = static_cast<int>((randomState >> 16) & 0x1f);
+      int intensity = 160 - row / 4 + static_cast<int>(frameIndex % 16) + speckle;
+      data[i] = static_cast<unsigned char>(std::max(0, std::min(255, intensity)));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool VerifyCompressedData(const std::string& compressedData, const std::vector<unsigned char>& originalData)
+  {
+    std::vector<unsigned char> decompressedData(originalData.size() + 1);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 + MAX_WBITS: decode gzip header and trailer (including checksum verification)
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    {
+      LOG_ERROR("Failed to initialize decompression");
+      return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressedData.data()));
+    stream.avail_in = static_cast<uInt>(compressedData.size());
+    stream.next_out = &decompressedData[0];
+    stream.avail_out = static_cast<uInt>(decompressedData.size());
+    int ret = inflate(&stream, Z_FINISH);
+    uLong decompressedSize = stream.total_out;
+    inflateEnd(&stream);
+
+    if (ret != Z_STREAM_END)
+    {
+      LOG_ERROR("Decompression of the gzip stream failed (error code " << ret << ")");
+      return false;
+    }
+    if (decompressedSize != originalData.size() || !std::equal(originalData.begin(), originalData.end(), decompressedData.begin()))
+    {
+      LOG_ERROR("Decompressed data does not match the original data");
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  int dataSizeMb = 64;
+  int maxNumberOfThreads = 0;
+  int chunkSizeKb = 1024;
+  int compressionLevel = Z_DEFAULT_COMPRESSION;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--data-size-mb", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &dataSizeMb, "Size of the uncompressed test data in MB (default: 64).");
+  args.AddArgument("--max-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxNumberOfThreads, "Maximum number of compression threads to test (default: number of hardware threads).");
+  args.AddArgument("--chunk-size-kb", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &chunkSizeKb, "Size of the independently compressed chunks in kB (default: 1024).");
+  args.AddArgument("--compression-level", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &compressionLevel, "zlib compression level, 1-9 (default: zlib default level).");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (dataSizeMb <= 0 || chunkSizeKb <= 0)
+  {
+    LOG_ERROR("Data size and chunk size must be positive");
+    exit(EXIT_FAILURE);
+  }
+  if (maxNumberOfThreads <= 0)
+  {
+    maxNumberOfThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  std::vector<unsigned char> data(static_cast<size_t>(dataSizeMb) * 1024 * 1024);
+  GenerateTestData(data);
+
+  // Test thread counts: 1, 2, 4, ... and the maximum
+  std::vector<int> threadCounts;
+  for (int numberOfThreads = 1; numberOfThreads < maxNumberOfThreads; numberOfThreads *= 2)
+  {
+    threadCounts.push_back(numberOfThreads);
+  }
+  threadCounts.push_back(maxNumberOfThreads);
+
+  int numberOfErrors(0);
+  std::string referenceCompressedData;
+  double singleThreadElapsedTimeSec = 0;
+
+  LOG_INFO("Compressing " << dataSizeMb << " MB in " << chunkSizeKb << " kB chunks");
+  LOG_INFO("Threads | Throughput (MB/s) | Speedup | Compression time in all threads (s) | Wall time (s) | Ratio");
+  for (std::vector<int>::iterator threadCountIt = threadCounts.begin(); threadCountIt != threadCounts.end(); ++threadCountIt)
+  {
+    PlusParallelDeflate compressor;
+    compressor.SetNumberOfThreads(*threadCountIt);
+    compressor.SetChunkSizeBytes(static_cast<unsigned int>(chunkSizeKb) * 1024);
+    compressor.SetCompressionLevel(compressionLevel);
+    unsigned long long reportedNumberOfCompressedBytes = 0;
+    compressor.SetProgressCallback([&reportedNumberOfCompressedBytes](unsigned long long numberOfCompressedBytes, unsigned long long numberOfBytes)
+    {
+      reportedNumberOfCompressedBytes = numberOfCompressedBytes;
+    });
+
+    std::ostringstream compressedStream;
+    if (compressor.Compress(&data[0], data.size(), compressedStream) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Compression failed with " << *threadCountIt << " threads");
+      numberOfErrors++;
+      continue;
+    }
+    std::string compressedData = compressedStream.str();
+    if (compressedData.size() != compressor.GetNumberOfOutputBytes())
+    {
+      LOG_ERROR("Reported output size (" << compressor.GetNumberOfOutputBytes() << ") does not match the actual size (" << compressedData.size() << ")");
+      numberOfErrors++;
+    }
+    if (!VerifyCompressedData(compressedData, data))
+    {
+      LOG_ERROR("Invalid output with " << *threadCountIt << " threads");
+      numberOfErrors++;
+    }
+    if (reportedNumberOfCompressedBytes != data.size())
+    {
+      LOG_ERROR("Progress reported " << reportedNumberOfCompressedBytes << " compressed bytes at the end, expected " << data.size());
+      numberOfErrors++;
+    }
+    // Chunk boundaries do not depend on the number of threads, so the output must be the same
+    if (referenceCompressedData.empty())
+    {
+      referenceCompressedData = compressedData;
+      singleThreadElapsedTimeSec = compressor.GetElapsedTimeSec();
+    }
+    else if (compressedData != referenceCompressedData)
+    {
+      LOG_ERROR("Output with " << *threadCountIt << " threads is different from the single-threaded output");
+      numberOfErrors++;
+    }
+
+    double elapsedTimeSec = std::max(compressor.GetElapsedTimeSec(), 1e-6);
+    std::ostringstream row;
+    row << std::fixed << std::setprecision(2) << std::setw(7) << *threadCountIt
+        << " | " << std::setw(17) << (data.size() / 1.0e6) / elapsedTimeSec
+        << " | " << std::setw(7) << singleThreadElapsedTimeSec / elapsedTimeSec
+        << " | " << std::setw(36) << compressor.GetCompressionTimeSec()
+        << " | " << std::setw(13) << elapsedTimeSec
+        << " | " << static_cast<double>(data.size()) / compressedData.size();
+    LOG_INFO(row.str());
+
+    // The worker threads are reused by the next call, which must produce the same output
+    std::ostringstream recompressedStream;
+    if (compressor.Compress(&data[0], data.size(), recompressedStream) != PLUS_SUCCESS || recompressedStream.str() != compressedData)
+    {
+      LOG_ERROR("Repeated compression with " << *threadCountIt << " threads gives different output");
+      numberOfErrors++;
+    }
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
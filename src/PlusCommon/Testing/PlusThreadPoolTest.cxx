@@ -0,0 +1,143 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusThreadPoolTest.cxx
+  \brief Checks that PlusThreadPool executes the submitted tasks and that ParallelFor processes each index
+  of the range exactly once, with any number of threads and also when it is called from a parallel loop.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusThreadPool.h"
+
+// VTK includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <atomic>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  int TestSubmit()
+  {
+    PlusThreadPool pool(3);
+    std::vector<std::future<int> > results;
+    for (int i = 0; i < 100; ++i)
+    {
+      results.push_back(pool.Submit([i]() { return i * i; }));
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+      int result = results[i].get();
+      if (result != i * i)
+      {
+        LOG_ERROR("Task " << i << " returned " << result << ", expected " << i * i);
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestParallelFor(int begin, int end, int numberOfThreads)
+  {
+    std::vector<std::atomic<int> > visitCounts(end > 0 ? end : 0);
+    for (int i = 0; i < static_cast<int>(visitCounts.size()); ++i)
+    {
+      visitCounts[i] = 0;
+    }
+    PlusThreadPool::ParallelFor(begin, end, numberOfThreads, [&visitCounts](int blockBegin, int blockEnd)
+    {
+      for (int i = blockBegin; i < blockEnd; ++i)
+      {
+        visitCounts[i]++;
+      }
+    });
+    for (int i = 0; i < static_cast<int>(visitCounts.size()); ++i)
+    {
+      int expectedCount = (i >= begin ? 1 : 0);
+      if (visitCounts[i] != expectedCount)
+      {
+        LOG_ERROR("ParallelFor(" << begin << ", " << end << ", " << numberOfThreads << ") processed index " << i << " " << visitCounts[i] << " times, expected " << expectedCount);
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestNestedParallelFor()
+  {
+    // More outer blocks than pool threads: the inner loops must complete even if all pool threads are busy
+    const int numberOfOuterIndices = 4 * PlusThreadPool::GetNumberOfThreadsToUse(0);
+    std::atomic<int> numberOfProcessedInnerIndices(0);
+    PlusThreadPool::ParallelFor(0, numberOfOuterIndices, numberOfOuterIndices, [&numberOfProcessedInnerIndices](int blockBegin, int blockEnd)
+    {
+      for (int i = blockBegin; i < blockEnd; ++i)
+      {
+        PlusThreadPool::ParallelFor(0, 100, 0, [&numberOfProcessedInnerIndices](int innerBegin, int innerEnd)
+        {
+          numberOfProcessedInnerIndices += innerEnd - innerBegin;
+        });
+      }
+    });
+    if (numberOfProcessedInnerIndices != numberOfOuterIndices * 100)
+    {
+      LOG_ERROR("Nested ParallelFor processed " << numberOfProcessedInnerIndices << " indices, expected " << numberOfOuterIndices * 100);
+      return 1;
+    }
+    return 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors = TestSubmit();
+  const int numberOfThreadsToTest[] = { 0, 1, 2, 3, 7, 64, 1000 };
+  for (unsigned int i = 0; i < sizeof(numberOfThreadsToTest) / sizeof(numberOfThreadsToTest[0]); ++i)
+  {
+    numberOfErrors += TestParallelFor(0, 480, numberOfThreadsToTest[i]);
+    numberOfErrors += TestParallelFor(27, 589, numberOfThreadsToTest[i]);
+    numberOfErrors += TestParallelFor(5, 6, numberOfThreadsToTest[i]);
+    numberOfErrors += TestParallelFor(10, 10, numberOfThreadsToTest[i]);
+  }
+  numberOfErrors += TestNestedParallelFor();
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
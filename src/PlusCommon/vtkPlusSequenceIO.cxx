@@ -5,6 +5,7 @@
 =========================================================Plus=header=end*/
 
 #include "PlusConfigure.h"
+#include "PlusParallelDeflate.h"
 #include "vtkPlusSequenceIO.h"
 
 #include <vtkIGSIOSequenceIO.h>
@@ -12,6 +13,79 @@
 /// VTK includes
 #include <vtkNew.h>
 
+/// STL includes
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace
+{
+  const std::string NRRD_ENCODING_FIELD = "encoding:";
+  const std::string NRRD_DATA_FILE_FIELD = "data file:";
+
+  //----------------------------------------------------------------------------
+  /*! Compress the input file starting from the specified offset and write the gzip stream to the output */
+  igsioStatus CompressFileData(const std::string& inputFilePath, std::streamoff offset, std::ostream& output, unsigned int numberOfThreads, const std::function<void(double)>& progressCallback)
+  {
+    std::ifstream input(inputFilePath.c_str(), std::ios::binary);
+    if (!input)
+    {
+      LOG_ERROR("Cannot open file for compression: " << inputFilePath);
+      return PLUS_FAIL;
+    }
+    input.seekg(0, std::ios::end);
+    std::streamoff fileSize = input.tellg();
+    input.seekg(offset, std::ios::beg);
+    if (fileSize < offset)
+    {
+      LOG_ERROR("Image data is missing from file: " << inputFilePath);
+      return PLUS_FAIL;
+    }
+
+    PlusParallelDeflate compressor;
+    compressor.SetNumberOfThreads(numberOfThreads);
+    if (progressCallback)
+    {
+      compressor.SetProgressCallback([&progressCallback](unsigned long long numberOfCompressedBytes, unsigned long long numberOfBytes)
+      {
+        progressCallback(numberOfBytes > 0 ? 100.0 * numberOfCompressedBytes / numberOfBytes : 100.0);
+      });
+    }
+    if (compressor.Compress(input, static_cast<unsigned long long>(fileSize - offset), output) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to compress image data of file: " << inputFilePath);
+      return PLUS_FAIL;
+    }
+    LOG_DEBUG("Compressed " << compressor.GetNumberOfInputBytes() << " bytes to " << compressor.GetNumberOfOutputBytes() << " bytes in "
+              << compressor.GetElapsedTimeSec() << " sec using " << compressor.GetNumberOfThreads() << " threads");
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+    Replace a file by the temporary file that contains its new content.
+    The temporary file is renamed over the original file in one step, so the original file is kept if the replacement fails.
+  */
+  igsioStatus ReplaceFile(const std::string& tempFilePath, const std::string& filePath)
+  {
+#ifdef _WIN32
+    bool replaced = (MoveFileExA(tempFilePath.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0);
+#else
+    bool replaced = (std::rename(tempFilePath.c_str(), filePath.c_str()) == 0);
+#endif
+    if (!replaced)
+    {
+      LOG_ERROR("Failed to replace file " << filePath << " by " << tempFilePath);
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+}
+
 //----------------------------------------------------------------------------
 igsioStatus vtkPlusSequenceIO::Write(const std::string& filename, vtkIGSIOTrackedFrameList* frameList, US_IMAGE_ORIENTATION orientationInFile/*=US_IMG_ORIENT_MF*/, bool useCompression/*=true*/, bool enableImageDataWrite/*=true*/)
 {
@@ -50,3 +124,144 @@ igsioStatus vtkPlusSequenceIO::Read(const std::string& trackedSequenceDataFileNa
   }
   return vtkIGSIOSequenceIO::Read(trackedSequenceDataFilePath, frameList);
 }
+
+//----------------------------------------------------------------------------
+igsioStatus vtkPlusSequenceIO::CompressImageDataInParallel(const std::string& filename, unsigned int numberOfThreads /*= 0*/, const std::function<void(double progressPercent)>& progressCallback /*= std::function<void(double)>()*/)
+{
+  std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(filename));
+  if (extension != ".nrrd" && extension != ".nhdr")
+  {
+    LOG_ERROR("Parallel compression is only supported for NRRD files: " << filename);
+    return PLUS_FAIL;
+  }
+
+  // Read the header lines, the header ends with an empty line (or at the end of a detached header file)
+  std::ifstream headerFile(filename.c_str(), std::ios::binary);
+  if (!headerFile)
+  {
+    LOG_ERROR("Cannot open sequence file: " << filename);
+    return PLUS_FAIL;
+  }
+  std::vector<std::string> headerLines;
+  std::string headerEndLine;
+  std::string line;
+  int encodingLineIndex = -1;
+  int dataFileLineIndex = -1;
+  while (std::getline(headerFile, line))
+  {
+    // Line endings are preserved, only the field values are replaced
+    std::string lineEnding = (!line.empty() && line[line.size() - 1] == '\r') ? "\r" : "";
+    std::string lineContent = line.substr(0, line.size() - lineEnding.size());
+    if (lineContent.empty())
+    {
+      headerEndLine = line;
+      break;
+    }
+    if (lineContent.compare(0, NRRD_ENCODING_FIELD.size(), NRRD_ENCODING_FIELD) == 0)
+    {
+      std::string encoding = igsioCommon::Trim(lineContent.substr(NRRD_ENCODING_FIELD.size()));
+      if (encoding == "gzip" || encoding == "gz")
+      {
+        LOG_DEBUG("Image data is already compressed in file: " << filename);
+        return PLUS_SUCCESS;
+      }
+      if (encoding != "raw")
+      {
+        LOG_ERROR("Parallel compression is not supported for " << encoding << " encoding in file: " << filename);
+        return PLUS_FAIL;
+      }
+      encodingLineIndex = static_cast<int>(headerLines.size());
+      line = NRRD_ENCODING_FIELD + " gzip" + lineEnding;
+    }
+    else if (lineContent.compare(0, NRRD_DATA_FILE_FIELD.size(), NRRD_DATA_FILE_FIELD) == 0)
+    {
+      dataFileLineIndex = static_cast<int>(headerLines.size());
+    }
+    headerLines.push_back(line);
+  }
+  if (encodingLineIndex < 0)
+  {
+    LOG_ERROR("Encoding field is not found in the header of file: " << filename);
+    return PLUS_FAIL;
+  }
+  std::streamoff dataOffset = headerFile.tellg();
+  headerFile.close();
+
+  std::string tempFilePath = filename + ".tmp";
+  std::ofstream outputFile(tempFilePath.c_str(), std::ios::binary);
+  if (!outputFile)
+  {
+    LOG_ERROR("Cannot create temporary file: " << tempFilePath);
+    return PLUS_FAIL;
+  }
+
+  std::string dataFilePath;
+  std::string compressedDataFilePath;
+  if (dataFileLineIndex >= 0)
+  {
+    // Detached data: compress the data file and refer to the compressed file in the header
+    std::string& dataFileLine = headerLines[dataFileLineIndex];
+    std::string lineEnding = (dataFileLine[dataFileLine.size() - 1] == '\r') ? "\r" : "";
+    std::string dataFileName = igsioCommon::Trim(dataFileLine.substr(NRRD_DATA_FILE_FIELD.size(), dataFileLine.size() - NRRD_DATA_FILE_FIELD.size() - lineEnding.size()));
+    if (dataFileName.empty() || dataFileName.find(' ') != std::string::npos)
+    {
+      LOG_ERROR("Parallel compression is only supported for a single detached data file in file: " << filename);
+      outputFile.close();
+      vtksys::SystemTools::RemoveFile(tempFilePath);
+      return PLUS_FAIL;
+    }
+    dataFilePath = vtksys::SystemTools::FileIsFullPath(dataFileName) ? dataFileName : vtksys::SystemTools::GetFilenamePath(filename) + "/" + dataFileName;
+    compressedDataFilePath = dataFilePath + ".gz";
+    dataFileLine = NRRD_DATA_FILE_FIELD + " " + dataFileName + ".gz" + lineEnding;
+
+    std::ofstream compressedDataFile(compressedDataFilePath.c_str(), std::ios::binary);
+    if (!compressedDataFile || CompressFileData(dataFilePath, 0, compressedDataFile, numberOfThreads, progressCallback) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to compress data file: " << dataFilePath);
+      compressedDataFile.close();
+      outputFile.close();
+      vtksys::SystemTools::RemoveFile(compressedDataFilePath);
+      vtksys::SystemTools::RemoveFile(tempFilePath);
+      return PLUS_FAIL;
+    }
+  }
+
+  for (std::vector<std::string>::iterator it = headerLines.begin(); it != headerLines.end(); ++it)
+  {
+    outputFile << *it << "\n";
+  }
+  PlusStatus status = PLUS_SUCCESS;
+  if (dataFileLineIndex < 0)
+  {
+    // Attached data: the compressed data follows the header
+    outputFile << headerEndLine << "\n";
+    status = CompressFileData(filename, dataOffset, outputFile, numberOfThreads, progressCallback);
+  }
+  outputFile.close();
+  if (status != PLUS_SUCCESS || !outputFile)
+  {
+    LOG_ERROR("Failed to write compressed sequence file: " << tempFilePath);
+    vtksys::SystemTools::RemoveFile(tempFilePath);
+    if (!compressedDataFilePath.empty())
+    {
+      vtksys::SystemTools::RemoveFile(compressedDataFilePath);
+    }
+    return PLUS_FAIL;
+  }
+
+  if (ReplaceFile(tempFilePath, filename) != PLUS_SUCCESS)
+  {
+    // The original file still refers to the uncompressed data
+    vtksys::SystemTools::RemoveFile(tempFilePath);
+    if (!compressedDataFilePath.empty())
+    {
+      vtksys::SystemTools::RemoveFile(compressedDataFilePath);
+    }
+    return PLUS_FAIL;
+  }
+  if (!dataFilePath.empty())
+  {
+    vtksys::SystemTools::RemoveFile(dataFilePath);
+  }
+  return PLUS_SUCCESS;
+}
@@ -9,6 +9,9 @@
 
 #include "igsioCommon.h"
 
+// STL includes
+#include <functional>
+
 /*!
   \class vtkPlusSequenceIO
   \brief Class to abstract away specific sequence file read/write details
@@ -26,6 +29,14 @@ public:
   /*! Read file contents into the object */
   static igsioStatus Read(const std::string& filename, vtkIGSIOTrackedFrameList* frameList);
 
+  /*!
+    Compress the image data of an uncompressed NRRD sequence file in place, using multiple threads (see PlusParallelDeflate).
+    The file is changed to gzip encoding, so it can be read the same way as files that are written with compression.
+    If numberOfThreads is 0 then all hardware threads are used.
+    progressCallback is called from the calling thread with the completed percentage (0-100) of the image data.
+  */
+  static igsioStatus CompressImageDataInParallel(const std::string& filename, unsigned int numberOfThreads = 0, const std::function<void(double progressPercent)>& progressCallback = std::function<void(double)>());
+
 protected:
   vtkPlusSequenceIO();
   virtual ~vtkPlusSequenceIO();
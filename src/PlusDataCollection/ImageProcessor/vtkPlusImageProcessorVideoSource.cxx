@@ -37,6 +37,7 @@ vtkPlusImageProcessorVideoSource::vtkPlusImageProcessorVideoSource()
 
   // The data capture thread will be used to regularly read the frames and process them
   this->StartThreadForInternalUpdates = true;
+  this->UpdateOnNewInputData = true;
 }
 
 //----------------------------------------------------------------------------
@@ -295,9 +295,6 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalUpdate()
     cv::undistort(*this->Frame, *this->UndistortedFrame, *this->CameraMatrix, *this->DistortionCoefficients);
   }
 
-  // BGR -> RGB color
-  cv::cvtColor(*this->UndistortedFrame, *this->UndistortedFrame, cv::COLOR_BGR2RGB);
-
   vtkPlusDataSource* aSource(nullptr);
   if (this->GetFirstActiveOutputVideoSource(aSource) == PLUS_FAIL || aSource == nullptr)
   {
@@ -314,9 +311,37 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalUpdate()
     aSource->SetInputFrameSize(this->UndistortedFrame->cols, this->UndistortedFrame->rows, 1);
   }
 
-  // Add the frame to the stream buffer
+  // Convert the frame into a frame reserved in the stream buffer, the buffer is not locked during the conversion
+  if (aSource->ReserveItem(this->ReservedFrame) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to reserve a frame in the buffer. Skipping frame.");
+    return PLUS_FAIL;
+  }
+
   FrameSizeType frameSize = { static_cast<unsigned int>(this->UndistortedFrame->cols), static_cast<unsigned int>(this->UndistortedFrame->rows), 1 };
-  if (aSource->AddItem(this->UndistortedFrame->data, aSource->GetInputImageOrientation(), frameSize, VTK_UNSIGNED_CHAR, 3, US_IMG_RGB_COLOR, 0, this->FrameNumber) == PLUS_FAIL)
+  FrameSizeType reservedFrameSize = { 0, 0, 0 };
+  this->ReservedFrame.GetFrame().GetFrameSize(reservedFrameSize);
+  if (aSource->GetInputImageOrientation() == aSource->GetOutputImageOrientation()
+      && !igsioCommon::IsClippingRequested(aSource->GetClipRectangleOrigin(), aSource->GetClipRectangleSize())
+      && reservedFrameSize == frameSize)
+  {
+    // BGR -> RGB color, written directly into the reserved frame
+    cv::Mat reservedImage(this->UndistortedFrame->rows, this->UndistortedFrame->cols, CV_8UC3, this->ReservedFrame.GetScalarPointer());
+    cv::cvtColor(*this->UndistortedFrame, reservedImage, cv::COLOR_BGR2RGB);
+  }
+  else
+  {
+    // BGR -> RGB color, then reorient and clip into the reserved frame
+    cv::cvtColor(*this->UndistortedFrame, *this->UndistortedFrame, cv::COLOR_BGR2RGB);
+    if (aSource->WriteReservedItem(this->ReservedFrame, this->UndistortedFrame->data, aSource->GetInputImageOrientation(), frameSize, VTK_UNSIGNED_CHAR, 3, US_IMG_RGB_COLOR, 0) != PLUS_SUCCESS)
+    {
+      aSource->ReleaseReservation(this->ReservedFrame);
+      return PLUS_FAIL;
+    }
+  }
+
+  // Add the frame to the stream buffer
+  if (aSource->CommitReservedItem(this->ReservedFrame, this->FrameNumber) == PLUS_FAIL)
   {
     return PLUS_FAIL;
   }
@@ -84,6 +84,8 @@ protected:
   std::shared_ptr<cv::VideoCapture> Capture;
   std::shared_ptr<cv::Mat>          Frame;
   std::shared_ptr<cv::Mat>          UndistortedFrame;
+  /*! Frame reserved in the buffer of the video source, the captured frame is converted into it without locking the buffer */
+  StreamBufferItemReservation       ReservedFrame;
   cv::VideoCaptureAPIs              RequestedCaptureAPI;
   bool                              AutofocusEnabled;
   bool                              AutoexposureEnabled;
@@ -0,0 +1,579 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusBufferSnapshotWriter.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkIGSIOMetaImageSequenceIO.h"
+#include "vtkIGSIOSequenceIO.h"
+#include "vtkIGSIOSequenceIOBase.h"
+#include "vtkIGSIOTrackedFrameList.h"
+#include "vtkPlusBuffer.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusDevice.h"
+#include "vtkPlusSequenceIO.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  const double NEGLIGIBLE_TIME_DIFFERENCE = 0.00001; // in seconds, used for comparing between exact timestamps
+  const unsigned int DEFAULT_BATCH_SIZE = 16;
+}
+
+//----------------------------------------------------------------------------
+PlusBufferSnapshotWriter::Progress::Progress()
+  : State(STATE_IDLE)
+  , NumberOfFrames(0)
+  , NumberOfWrittenFrames(0)
+  , ElapsedTimeSec(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusBufferSnapshotWriter::PlusBufferSnapshotWriter()
+  : IsVideoSnapshot(false)
+  , NumberOfFrames(0)
+  , BatchSize(DEFAULT_BATCH_SIZE)
+  , CancelRequested(false)
+  , StartTimeSec(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusBufferSnapshotWriter::~PlusBufferSnapshotWriter()
+{
+  this->Cancel();
+}
+
+//----------------------------------------------------------------------------
+void PlusBufferSnapshotWriter::Clear()
+{
+  if (this->WriterThread.joinable())
+  {
+    this->WriterThread.join();
+  }
+  this->Sources.clear();
+  this->NumberOfFrames = 0;
+  this->ToolReferenceFrameName.clear();
+  this->IsVideoSnapshot = false;
+  std::lock_guard<std::mutex> progressLock(this->ProgressMutex);
+  this->CurrentProgress = Progress();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::TakeVideoSnapshot(vtkPlusBuffer* buffer)
+{
+  if (buffer == NULL)
+  {
+    LOG_ERROR("Unable to take buffer snapshot: buffer is NULL");
+    return PLUS_FAIL;
+  }
+  if (this->IsWriting())
+  {
+    LOG_ERROR("Unable to take buffer snapshot: the previous snapshot is still being written");
+    return PLUS_FAIL;
+  }
+  this->Clear();
+
+  // Items are filled in place, copying them would copy the pixel data
+  this->Sources.resize(1);
+  SourceSnapshot& source = this->Sources[0];
+  source.Id = (buffer->GetDescriptiveName() != NULL ? buffer->GetDescriptiveName() : "");
+  source.LocalTimeOffsetSec = buffer->GetLocalTimeOffsetSec();
+  if (buffer->GetStreamBufferItemSnapshot(source.Items) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to take buffer snapshot: failed to get the buffer items");
+    this->Sources.clear();
+    return PLUS_FAIL;
+  }
+
+  this->IsVideoSnapshot = true;
+  this->NumberOfFrames = static_cast<unsigned int>(source.Items.size());
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::TakeToolsSnapshot(vtkPlusDevice* device)
+{
+  if (device == NULL)
+  {
+    LOG_ERROR("Unable to take tools snapshot: device is NULL");
+    return PLUS_FAIL;
+  }
+  if (device->GetNumberOfTools() == 0)
+  {
+    LOG_ERROR("Unable to take tools snapshot: there are no active tools");
+    return PLUS_FAIL;
+  }
+  if (this->IsWriting())
+  {
+    LOG_ERROR("Unable to take tools snapshot: the previous snapshot is still being written");
+    return PLUS_FAIL;
+  }
+  this->Clear();
+
+  this->Sources.resize(device->GetNumberOfTools());
+  int numberOfFrames(-1);
+  std::vector<SourceSnapshot>::iterator source = this->Sources.begin();
+  for (DataSourceContainerConstIterator it = device->GetToolIteratorBegin(); it != device->GetToolIteratorEnd(); ++it, ++source)
+  {
+    source->Id = it->second->GetId();
+    source->LocalTimeOffsetSec = it->second->GetLocalTimeOffsetSec();
+    if (it->second->GetStreamBufferItemSnapshot(source->Items) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to take tools snapshot: failed to get the buffer items of tool " << source->Id);
+      this->Sources.clear();
+      return PLUS_FAIL;
+    }
+    // Use the lowest number of items
+    if (numberOfFrames < 0 || numberOfFrames > static_cast<int>(source->Items.size()))
+    {
+      numberOfFrames = static_cast<int>(source->Items.size());
+    }
+  }
+
+  this->IsVideoSnapshot = false;
+  this->NumberOfFrames = static_cast<unsigned int>(numberOfFrames);
+  this->ToolReferenceFrameName = device->GetToolReferenceFrameName();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusBufferSnapshotWriter::GetNumberOfFrames() const
+{
+  return this->NumberOfFrames;
+}
+
+//----------------------------------------------------------------------------
+StreamBufferItem* PlusBufferSnapshotWriter::GetItemAtTime(SourceSnapshot& source, double timestamp)
+{
+  std::vector<StreamBufferItem>& items = source.Items;
+
+  // Items are sorted by timestamp, find the first item that is not earlier than the requested time
+  size_t lower = 0;
+  size_t upper = items.size();
+  while (lower < upper)
+  {
+    size_t middle = (lower + upper) / 2;
+    if (items[middle].GetFilteredTimestamp(source.LocalTimeOffsetSec) < timestamp)
+    {
+      lower = middle + 1;
+    }
+    else
+    {
+      upper = middle;
+    }
+  }
+
+  // The closest item is either this item or the previous one
+  StreamBufferItem* closestItem = NULL;
+  double closestTimeDifference = 0;
+  for (size_t index = (lower > 0 ? lower - 1 : 0); index <= lower && index < items.size(); ++index)
+  {
+    double timeDifference = fabs(items[index].GetFilteredTimestamp(source.LocalTimeOffsetSec) - timestamp);
+    if (closestItem == NULL || timeDifference < closestTimeDifference)
+    {
+      closestItem = &items[index];
+      closestTimeDifference = timeDifference;
+    }
+  }
+
+  if (closestItem == NULL || closestTimeDifference > NEGLIGIBLE_TIME_DIFFERENCE)
+  {
+    return NULL;
+  }
+  return closestItem;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::GetTrackedFrame(unsigned int frameIndex, igsioTrackedFrame& trackedFrame)
+{
+  if (frameIndex >= this->NumberOfFrames)
+  {
+    LOG_ERROR("Unable to get tracked frame " << frameIndex << " from snapshot: the snapshot contains " << this->NumberOfFrames << " frames");
+    return PLUS_FAIL;
+  }
+
+  SourceSnapshot& mainSource = this->Sources[0];
+  StreamBufferItem& bufferItem = mainSource.Items[frameIndex];
+
+  if (this->IsVideoSnapshot)
+  {
+    // Add image data
+    if (bufferItem.ShareFrameWith(*trackedFrame.GetImageData()) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to get image data of buffer item with UID: " << bufferItem.GetUid());
+      return PLUS_FAIL;
+    }
+
+    // Add tracking data
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    bufferItem.GetMatrix(matrix);
+    trackedFrame.SetFrameTransform(igsioTransformName("Tool", "Tracker"), matrix);
+    trackedFrame.SetFrameTransformStatus(igsioTransformName("Tool", "Tracker"), bufferItem.GetStatus());
+  }
+  else
+  {
+    // Create fake image
+    igsioVideoFrame videoFrame;
+    FrameSizeType frameSize = {1, 1, 1};
+    // Don't waste space, create a greyscale image
+    videoFrame.AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+    trackedFrame.SetImageData(videoFrame);
+  }
+
+  const double frameTimestamp = bufferItem.GetFilteredTimestamp(mainSource.LocalTimeOffsetSec);
+
+  // Add filtered timestamp
+  std::ostringstream timestampFieldValue;
+  timestampFieldValue << std::fixed << frameTimestamp;
+  trackedFrame.SetFrameField("Timestamp", timestampFieldValue.str());
+
+  // Add unfiltered timestamp
+  std::ostringstream unfilteredtimestampFieldValue;
+  unfilteredtimestampFieldValue << std::fixed << bufferItem.GetUnfilteredTimestamp(mainSource.LocalTimeOffsetSec);
+  trackedFrame.SetFrameField("UnfilteredTimestamp", unfilteredtimestampFieldValue.str());
+
+  // Add frame number
+  std::ostringstream frameNumberFieldValue;
+  frameNumberFieldValue << std::fixed << bufferItem.GetIndex();
+  trackedFrame.SetFrameField("FrameNumber", frameNumberFieldValue.str());
+
+  if (this->IsVideoSnapshot)
+  {
+    // Add custom fields
+    const igsioFieldMapType& customFields = bufferItem.GetFrameFieldMap();
+    for (igsioFieldMapType::const_iterator cf = customFields.begin(); cf != customFields.end(); ++cf)
+    {
+      trackedFrame.SetFrameField(cf->first, cf->second.second, cf->second.first);
+    }
+    return PLUS_SUCCESS;
+  }
+
+  // Add transforms
+  for (std::vector<SourceSnapshot>::iterator source = this->Sources.begin(); source != this->Sources.end(); ++source)
+  {
+    StreamBufferItem* toolBufferItem = GetItemAtTime(*source, frameTimestamp);
+    if (toolBufferItem == NULL)
+    {
+      LOG_ERROR("Failed to get tracker buffer item from time: " << std::fixed << frameTimestamp);
+      continue;
+    }
+
+    vtkSmartPointer<vtkMatrix4x4> toolMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (toolBufferItem->GetMatrix(toolMatrix) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to get toolMatrix");
+      return PLUS_FAIL;
+    }
+
+    igsioTransformName toolToTrackerTransform(source->Id, this->ToolReferenceFrameName);
+    trackedFrame.SetFrameTransform(toolToTrackerTransform, toolMatrix);
+
+    // Add source status
+    trackedFrame.SetFrameTransformStatus(toolToTrackerTransform, toolBufferItem->GetStatus());
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::GetTrackedFrameList(vtkIGSIOTrackedFrameList* trackedFrameList)
+{
+  if (trackedFrameList == NULL)
+  {
+    LOG_ERROR("Unable to get tracked frames from snapshot: tracked frame list is NULL");
+    return PLUS_FAIL;
+  }
+
+  PlusStatus status = PLUS_SUCCESS;
+  for (unsigned int frameIndex = 0; frameIndex < this->NumberOfFrames; ++frameIndex)
+  {
+    igsioTrackedFrame* trackedFrame = new igsioTrackedFrame;
+    if (this->GetTrackedFrame(frameIndex, *trackedFrame) != PLUS_SUCCESS)
+    {
+      delete trackedFrame;
+      status = PLUS_FAIL;
+      continue;
+    }
+    trackedFrameList->TakeTrackedFrame(trackedFrame);
+  }
+
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::Start(const std::string& filename, bool useCompression /*= false*/)
+{
+  if (this->IsWriting())
+  {
+    LOG_ERROR("Unable to start writing snapshot to " << filename << ": the previous snapshot is still being written");
+    return PLUS_FAIL;
+  }
+  if (this->WriterThread.joinable())
+  {
+    this->WriterThread.join();
+  }
+  if (this->NumberOfFrames == 0)
+  {
+    LOG_ERROR("Unable to write snapshot to " << filename << ": the snapshot contains no frames");
+    return PLUS_FAIL;
+  }
+
+  {
+    std::lock_guard<std::mutex> progressLock(this->ProgressMutex);
+    this->CurrentProgress = Progress();
+    this->CurrentProgress.State = STATE_WRITING;
+    this->CurrentProgress.FileName = vtkPlusConfig::GetInstance()->GetOutputPath(filename);
+    this->CurrentProgress.NumberOfFrames = this->NumberOfFrames;
+  }
+  this->CancelRequested = false;
+  this->StartTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+  this->WriterThread = std::thread(&PlusBufferSnapshotWriter::WriterThreadMain, this, useCompression);
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::Wait()
+{
+  if (this->WriterThread.joinable())
+  {
+    this->WriterThread.join();
+  }
+  return this->GetProgress().State == STATE_COMPLETED ? PLUS_SUCCESS : PLUS_FAIL;
+}
+
+//----------------------------------------------------------------------------
+void PlusBufferSnapshotWriter::Cancel()
+{
+  this->CancelRequested = true;
+  if (this->WriterThread.joinable())
+  {
+    this->WriterThread.join();
+  }
+}
+
+//----------------------------------------------------------------------------
+bool PlusBufferSnapshotWriter::IsWriting() const
+{
+  std::lock_guard<std::mutex> progressLock(this->ProgressMutex);
+  return this->CurrentProgress.State == STATE_WRITING;
+}
+
+//----------------------------------------------------------------------------
+PlusBufferSnapshotWriter::Progress PlusBufferSnapshotWriter::GetProgress() const
+{
+  std::lock_guard<std::mutex> progressLock(this->ProgressMutex);
+  return this->CurrentProgress;
+}
+
+//----------------------------------------------------------------------------
+void PlusBufferSnapshotWriter::SetBatchSize(unsigned int batchSize)
+{
+  this->BatchSize = std::max(batchSize, 1u);
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusBufferSnapshotWriter::GetBatchSize() const
+{
+  return this->BatchSize;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusBufferSnapshotWriter::GetStateAsString(StateType state)
+{
+  switch (state)
+  {
+    case STATE_IDLE:
+      return "Idle";
+    case STATE_WRITING:
+      return "Writing";
+    case STATE_COMPLETED:
+      return "Completed";
+    case STATE_FAILED:
+      return "Failed";
+    case STATE_CANCELLED:
+      return "Cancelled";
+  }
+  return "Unknown";
+}
+
+//----------------------------------------------------------------------------
+void PlusBufferSnapshotWriter::WriterThreadMain(bool useCompression)
+{
+  std::string fileName = this->GetProgress().FileName;
+
+  // Compressed metafiles cannot be appended to, they are written at once
+  PlusStatus status = PLUS_FAIL;
+  if (useCompression && vtkIGSIOMetaImageSequenceIO::CanWriteFile(fileName))
+  {
+    status = this->WriteAllFrames(useCompression);
+  }
+  else
+  {
+    status = this->WriteFramesInBatches(useCompression);
+  }
+
+  std::lock_guard<std::mutex> progressLock(this->ProgressMutex);
+  this->CurrentProgress.ElapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - this->StartTimeSec;
+  if (this->CancelRequested)
+  {
+    LOG_INFO("Writing of buffer snapshot to " << fileName << " is cancelled");
+    this->CurrentProgress.State = STATE_CANCELLED;
+  }
+  else if (status != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write buffer snapshot to " << fileName);
+    this->CurrentProgress.State = STATE_FAILED;
+  }
+  else
+  {
+    LOG_INFO("Buffer snapshot is written to " << fileName << " (" << this->CurrentProgress.NumberOfWrittenFrames << " frames, "
+             << this->CurrentProgress.ElapsedTimeSec << " sec)");
+    this->CurrentProgress.State = STATE_COMPLETED;
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::WriteFramesInBatches(bool useCompression)
+{
+  std::string fileName = this->GetProgress().FileName;
+
+  vtkSmartPointer<vtkIGSIOSequenceIOBase> writer = vtkSmartPointer<vtkIGSIOSequenceIOBase>::Take(vtkIGSIOSequenceIO::CreateSequenceHandlerForFile(fileName));
+  if (writer == NULL)
+  {
+    LOG_ERROR("Could not create writer for file: " << fileName);
+    return PLUS_FAIL;
+  }
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  writer->SetUseCompression(useCompression);
+  writer->SetTrackedFrameList(frames);
+  writer->SetFileName(fileName);
+
+  bool isHeaderPrepared = false;
+  bool isData3D = false;
+  for (unsigned int firstFrameIndex = 0; firstFrameIndex < this->NumberOfFrames; firstFrameIndex += this->BatchSize)
+  {
+    unsigned int numberOfFramesInBatch = std::min(this->BatchSize, this->NumberOfFrames - firstFrameIndex);
+    PlusStatus status = (this->CancelRequested ? PLUS_FAIL : PLUS_SUCCESS);
+    for (unsigned int frameIndex = firstFrameIndex; status == PLUS_SUCCESS && frameIndex < firstFrameIndex + numberOfFramesInBatch; ++frameIndex)
+    {
+      igsioTrackedFrame* trackedFrame = new igsioTrackedFrame;
+      if (this->GetTrackedFrame(frameIndex, *trackedFrame) != PLUS_SUCCESS)
+      {
+        delete trackedFrame;
+        status = PLUS_FAIL;
+        break;
+      }
+      frames->TakeTrackedFrame(trackedFrame);
+    }
+
+    if (status == PLUS_SUCCESS && !isHeaderPrepared)
+    {
+      // Frames are written in the orientation in which they are stored in the buffer
+      writer->SetImageOrientationInFile(frames->GetImageOrientation());
+      if (writer->PrepareHeader() != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Unable to prepare header");
+        return PLUS_FAIL;
+      }
+      isHeaderPrepared = true;
+      isData3D = frames->GetTrackedFrame(0)->GetFrameSize()[2] > 1;
+    }
+
+    if (status == PLUS_SUCCESS && writer->AppendImagesToHeader() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to append image data to header.");
+      status = PLUS_FAIL;
+    }
+    if (status == PLUS_SUCCESS && writer->WriteImages() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to append images to " << fileName);
+      status = PLUS_FAIL;
+    }
+    frames->Clear();
+
+    if (status != PLUS_SUCCESS)
+    {
+      // The file is incomplete, remove it
+      if (isHeaderPrepared)
+      {
+        writer->Discard();
+      }
+      return PLUS_FAIL;
+    }
+
+    this->FramesWritten(firstFrameIndex, numberOfFramesInBatch);
+  }
+
+  // Fix the header to contain the number of written frames
+  writer->UpdateDimensionsCustomStrings(this->NumberOfFrames, isData3D);
+  writer->UpdateFieldInImageHeader(writer->GetDimensionSizeString());
+  writer->UpdateFieldInImageHeader(writer->GetDimensionKindsString());
+  if (writer->FinalizeHeader() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to finalize header of " << fileName);
+    return PLUS_FAIL;
+  }
+  writer->Close();
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusBufferSnapshotWriter::WriteAllFrames(bool useCompression)
+{
+  std::string fileName = this->GetProgress().FileName;
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  PlusStatus status = this->GetTrackedFrameList(frames);
+  if (this->CancelRequested)
+  {
+    return PLUS_FAIL;
+  }
+  if (vtkPlusSequenceIO::Write(fileName, frames, frames->GetImageOrientation(), useCompression) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to save tracked frames to sequence metafile!");
+    return PLUS_FAIL;
+  }
+  frames->Clear();
+  this->FramesWritten(0, this->NumberOfFrames);
+
+  return status;
+}
+
+//----------------------------------------------------------------------------
+void PlusBufferSnapshotWriter::FramesWritten(unsigned int firstFrameIndex, unsigned int numberOfFrames)
+{
+  if (this->IsVideoSnapshot)
+  {
+    // Release the pixel data of the written frames, the buffer may have already replaced it with new frames
+    for (unsigned int frameIndex = firstFrameIndex; frameIndex < firstFrameIndex + numberOfFrames; ++frameIndex)
+    {
+      vtkImageData* image = this->Sources[0].Items[frameIndex].GetFrame().GetImage();
+      if (image != NULL)
+      {
+        image->Initialize();
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> progressLock(this->ProgressMutex);
+  this->CurrentProgress.NumberOfWrittenFrames += numberOfFrames;
+  this->CurrentProgress.ElapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - this->StartTimeSec;
+  LOG_DEBUG("Buffer snapshot writing progress: " << this->CurrentProgress.NumberOfWrittenFrames << " of " << this->CurrentProgress.NumberOfFrames << " frames");
+}
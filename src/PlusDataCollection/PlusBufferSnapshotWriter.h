@@ -0,0 +1,157 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusBufferSnapshotWriter_h
+#define __PlusBufferSnapshotWriter_h
+
+#include "PlusConfigure.h"
+#include "PlusStreamBufferItem.h"
+#include "vtkPlusDataCollectionExport.h"
+
+// STL includes
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class igsioTrackedFrame;
+class vtkIGSIOTrackedFrameList;
+class vtkPlusBuffer;
+class vtkPlusDevice;
+
+/*!
+  \class PlusBufferSnapshotWriter
+  \brief Writes the content of buffers to a sequence file while data acquisition continues.
+
+  Taking a snapshot freezes the items that are in the buffer at that moment: the items are copied while the buffer
+  is locked, but the pixel data is shared with the buffer slots (see vtkPlusBuffer::GetStreamBufferItemSnapshot).
+  The buffer does not write into shared pixel data, it allocates new pixel arrays for the slots that are reused
+  while the snapshot is written. Therefore the snapshot is consistent and taking it only takes a short time.
+
+  Start writes the items on a background thread in small batches, directly from the shared pixel data into the
+  sequence file writer. The pixel data of the written items is released immediately, so the additional memory
+  that is used is limited to the slots that the buffer reused before their items were written.
+  The progress can be queried from any thread.
+
+  The written tracked frames are the same as the frames that vtkPlusBuffer::WriteToSequenceFile and
+  vtkPlusDevice::WriteToolsToSequenceFile write (these methods use a snapshot, too).
+
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport PlusBufferSnapshotWriter
+{
+public:
+  enum StateType
+  {
+    STATE_IDLE,
+    STATE_WRITING,
+    STATE_COMPLETED,
+    STATE_FAILED,
+    STATE_CANCELLED
+  };
+
+  struct Progress
+  {
+    Progress();
+    StateType State;
+    /*! Full path of the written file */
+    std::string FileName;
+    /*! Number of frames in the snapshot */
+    unsigned int NumberOfFrames;
+    unsigned int NumberOfWrittenFrames;
+    double ElapsedTimeSec;
+  };
+
+  PlusBufferSnapshotWriter();
+  /*! Cancels the writing if it is still in progress */
+  virtual ~PlusBufferSnapshotWriter();
+
+  /*! Freeze the current items of a video buffer */
+  PlusStatus TakeVideoSnapshot(vtkPlusBuffer* buffer);
+
+  /*!
+    Freeze the current items of all tools of a device. Each frame contains the transforms of all tools at the time of
+    an item of the first tool. The number of frames is the lowest number of items in the tool buffers.
+  */
+  PlusStatus TakeToolsSnapshot(vtkPlusDevice* device);
+
+  /*! Number of frames in the snapshot */
+  unsigned int GetNumberOfFrames() const;
+
+  /*! Create a tracked frame from the snapshot. Pixel data is shared with the snapshot (it must not be modified). */
+  PlusStatus GetTrackedFrame(unsigned int frameIndex, igsioTrackedFrame& trackedFrame);
+
+  /*! Add all frames of the snapshot to a tracked frame list */
+  PlusStatus GetTrackedFrameList(vtkIGSIOTrackedFrameList* trackedFrameList);
+
+  /*!
+    Start writing the snapshot to a sequence file on a background thread. If the filename is relative then it is
+    relative to the output directory. Compressed metafiles cannot be written in batches, they are written at once.
+  */
+  PlusStatus Start(const std::string& filename, bool useCompression = false);
+
+  /*! Wait until the writing is completed. Returns PLUS_SUCCESS if all frames are written. */
+  PlusStatus Wait();
+
+  /*! Stop writing (the incomplete file is removed) and wait for the background thread */
+  void Cancel();
+
+  bool IsWriting() const;
+
+  Progress GetProgress() const;
+
+  /*! Number of frames that are passed to the sequence file writer at once */
+  void SetBatchSize(unsigned int batchSize);
+  unsigned int GetBatchSize() const;
+
+  static std::string GetStateAsString(StateType state);
+
+protected:
+  struct SourceSnapshot
+  {
+    std::string Id;
+    double LocalTimeOffsetSec;
+    std::vector<StreamBufferItem> Items;
+  };
+
+  /*! Release the snapshot and the results of the previous writing. Must not be called while writing. */
+  void Clear();
+
+  /*! Returns the item of the source that has exactly the specified (global) timestamp, or NULL if there is no such item */
+  static StreamBufferItem* GetItemAtTime(SourceSnapshot& source, double timestamp);
+
+  void WriterThreadMain(bool useCompression);
+
+  /*! Write the frames in batches, appending each batch to the sequence file */
+  PlusStatus WriteFramesInBatches(bool useCompression);
+
+  /*! Write all the frames at once */
+  PlusStatus WriteAllFrames(bool useCompression);
+
+  /*! Update the progress after the frames are written and release the pixel data of the frames */
+  void FramesWritten(unsigned int firstFrameIndex, unsigned int numberOfFrames);
+
+  bool IsVideoSnapshot;
+  std::vector<SourceSnapshot> Sources;
+  unsigned int NumberOfFrames;
+  std::string ToolReferenceFrameName;
+  unsigned int BatchSize;
+
+  std::thread WriterThread;
+  std::atomic<bool> CancelRequested;
+
+  /*! Protects the progress, which is updated by the writer thread and read by other threads */
+  mutable std::mutex ProgressMutex;
+  Progress CurrentProgress;
+  double StartTimeSec;
+
+private:
+  PlusBufferSnapshotWriter(const PlusBufferSnapshotWriter&);
+  void operator=(const PlusBufferSnapshotWriter&);
+};
+
+#endif
@@ -0,0 +1,376 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusCaptureLoopScheduler.h"
+#include "vtkIGSIOAccurateTimer.h"
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <errno.h>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <string.h>
+  #include <sys/mman.h>
+  #include <time.h>
+#endif
+
+namespace
+{
+  std::vector<double> CreateHistogramBinUpperLimitsSec()
+  {
+    const double limitsMs[] = { 0.05, 0.1, 0.2, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0 };
+    std::vector<double> limitsSec;
+    for (unsigned int i = 0; i < sizeof(limitsMs) / sizeof(limitsMs[0]); ++i)
+    {
+      limitsSec.push_back(limitsMs[i] / 1000.0);
+    }
+    return limitsSec;
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::ThreadSettings::ThreadSettings()
+  : SchedulingPolicy(SCHEDULING_POLICY_DEFAULT)
+  , Priority(0)
+  , LockMemory(false)
+{
+}
+
+//----------------------------------------------------------------------------
+bool PlusCaptureLoopScheduler::ThreadSettings::IsDefault() const
+{
+  return this->CpuAffinity.empty() && this->SchedulingPolicy == SCHEDULING_POLICY_DEFAULT && !this->LockMemory;
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::Statistics::Statistics()
+  : NumberOfPeriods(0)
+  , NumberOfOverruns(0)
+  , NumberOfSkippedDeadlines(0)
+  , AverageWakeUpLatencySec(0.0)
+  , MaxWakeUpLatencySec(0.0)
+  , MaxOverrunSec(0.0)
+  , WakeUpLatencyHistogram(GetHistogramBinUpperLimitsSec().size() + 1, 0)
+  , OverrunHistogram(GetHistogramBinUpperLimitsSec().size() + 1, 0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::PlusCaptureLoopScheduler()
+  : PeriodSec(0.0)
+  , NextDeadlineSec(0.0)
+  , TotalWakeUpLatencySec(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::~PlusCaptureLoopScheduler()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureLoopScheduler::Start(double periodSec)
+{
+  this->PeriodSec = std::max(periodSec, 0.0);
+  this->NextDeadlineSec = GetMonotonicTimeSec() + this->PeriodSec;
+
+  std::lock_guard<std::mutex> statisticsLock(this->StatisticsMutex);
+  this->Stats = Statistics();
+  this->TotalWakeUpLatencySec = 0.0;
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureLoopScheduler::WaitForNextDeadline()
+{
+  double currentTimeSec = GetMonotonicTimeSec();
+  if (currentTimeSec < this->NextDeadlineSec)
+  {
+    SleepUntil(this->NextDeadlineSec);
+    double wakeUpLatencySec = std::max(GetMonotonicTimeSec() - this->NextDeadlineSec, 0.0);
+    this->NextDeadlineSec += this->PeriodSec;
+
+    std::lock_guard<std::mutex> statisticsLock(this->StatisticsMutex);
+    this->Stats.NumberOfPeriods++;
+    this->TotalWakeUpLatencySec += wakeUpLatencySec;
+    this->Stats.AverageWakeUpLatencySec = this->TotalWakeUpLatencySec / this->Stats.NumberOfPeriods;
+    this->Stats.MaxWakeUpLatencySec = std::max(this->Stats.MaxWakeUpLatencySec, wakeUpLatencySec);
+    AddToHistogram(this->Stats.WakeUpLatencyHistogram, wakeUpLatencySec);
+    return;
+  }
+
+  // Overrun: start the next iteration now and continue with the first deadline on the grid that is in the future
+  double overrunSec = currentTimeSec - this->NextDeadlineSec;
+  unsigned long long numberOfSkippedDeadlines = 0;
+  if (this->PeriodSec > 0)
+  {
+    numberOfSkippedDeadlines = static_cast<unsigned long long>(std::floor(overrunSec / this->PeriodSec));
+    this->NextDeadlineSec += (numberOfSkippedDeadlines + 1) * this->PeriodSec;
+  }
+  else
+  {
+    this->NextDeadlineSec = currentTimeSec;
+  }
+
+  std::lock_guard<std::mutex> statisticsLock(this->StatisticsMutex);
+  this->Stats.NumberOfPeriods++;
+  this->Stats.NumberOfOverruns++;
+  this->Stats.NumberOfSkippedDeadlines += numberOfSkippedDeadlines;
+  this->Stats.MaxOverrunSec = std::max(this->Stats.MaxOverrunSec, overrunSec);
+  AddToHistogram(this->Stats.OverrunHistogram, overrunSec);
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureLoopScheduler::RecordIteration(double iterationStartTimeSec)
+{
+  double overrunSec = GetMonotonicTimeSec() - iterationStartTimeSec - this->PeriodSec;
+
+  std::lock_guard<std::mutex> statisticsLock(this->StatisticsMutex);
+  this->Stats.NumberOfPeriods++;
+  if (overrunSec > 0)
+  {
+    this->Stats.NumberOfOverruns++;
+    this->Stats.MaxOverrunSec = std::max(this->Stats.MaxOverrunSec, overrunSec);
+    AddToHistogram(this->Stats.OverrunHistogram, overrunSec);
+  }
+}
+
+//----------------------------------------------------------------------------
+double PlusCaptureLoopScheduler::GetTimeUntilNextDeadlineSec() const
+{
+  return this->NextDeadlineSec - GetMonotonicTimeSec();
+}
+
+//----------------------------------------------------------------------------
+double PlusCaptureLoopScheduler::GetPeriodSec() const
+{
+  return this->PeriodSec;
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::Statistics PlusCaptureLoopScheduler::GetStatistics() const
+{
+  std::lock_guard<std::mutex> statisticsLock(this->StatisticsMutex);
+  return this->Stats;
+}
+
+//----------------------------------------------------------------------------
+const std::vector<double>& PlusCaptureLoopScheduler::GetHistogramBinUpperLimitsSec()
+{
+  static const std::vector<double> limitsSec = CreateHistogramBinUpperLimitsSec();
+  return limitsSec;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusCaptureLoopScheduler::GetHistogramAsString(const std::vector<unsigned long long>& histogram)
+{
+  const std::vector<double>& limitsSec = GetHistogramBinUpperLimitsSec();
+  std::ostringstream str;
+  for (unsigned int binIndex = 0; binIndex < histogram.size(); ++binIndex)
+  {
+    if (binIndex > 0)
+    {
+      str << " ";
+    }
+    if (binIndex < limitsSec.size())
+    {
+      str << "<=" << limitsSec[binIndex] * 1000.0 << "ms:" << histogram[binIndex];
+    }
+    else
+    {
+      str << ">" << limitsSec.back() * 1000.0 << "ms:" << histogram[binIndex];
+    }
+  }
+  return str.str();
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureLoopScheduler::AddToHistogram(std::vector<unsigned long long>& histogram, double valueSec)
+{
+  const std::vector<double>& limitsSec = GetHistogramBinUpperLimitsSec();
+  unsigned int binIndex = std::lower_bound(limitsSec.begin(), limitsSec.end(), valueSec) - limitsSec.begin();
+  histogram[binIndex]++;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusCaptureLoopScheduler::ApplyThreadSettings(const ThreadSettings& settings)
+{
+  PlusStatus status = PLUS_SUCCESS;
+#if defined(__linux__)
+  if (!settings.CpuAffinity.empty())
+  {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (std::vector<int>::const_iterator it = settings.CpuAffinity.begin(); it != settings.CpuAffinity.end(); ++it)
+    {
+      if (*it < 0 || *it >= CPU_SETSIZE)
+      {
+        LOG_WARNING("Invalid CPU index in capture thread CPU affinity: " << *it);
+        status = PLUS_FAIL;
+        continue;
+      }
+      CPU_SET(*it, &cpuSet);
+    }
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    if (error != 0)
+    {
+      LOG_WARNING("Failed to set capture thread CPU affinity: " << strerror(error));
+      status = PLUS_FAIL;
+    }
+  }
+
+  if (settings.SchedulingPolicy != SCHEDULING_POLICY_DEFAULT)
+  {
+    int policy = (settings.SchedulingPolicy == SCHEDULING_POLICY_FIFO ? SCHED_FIFO : SCHED_RR);
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = std::min(std::max(settings.Priority, sched_get_priority_min(policy)), sched_get_priority_max(policy));
+    if (param.sched_priority != settings.Priority)
+    {
+      LOG_WARNING("Capture thread priority " << settings.Priority << " is out of range, " << param.sched_priority << " is used instead");
+    }
+    int error = pthread_setschedparam(pthread_self(), policy, &param);
+    if (error != 0)
+    {
+      LOG_WARNING("Failed to set " << GetSchedulingPolicyAsString(settings.SchedulingPolicy) << " scheduling policy with priority " << param.sched_priority
+                  << " for the capture thread: " << strerror(error) << ". Real-time scheduling requires CAP_SYS_NICE capability or a sufficient rtprio limit.");
+      status = PLUS_FAIL;
+    }
+  }
+
+  if (settings.LockMemory)
+  {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+      LOG_WARNING("Failed to lock process memory: " << strerror(errno) << ". Memory locking requires CAP_IPC_LOCK capability or a sufficient memlock limit.");
+      status = PLUS_FAIL;
+    }
+  }
+#elif defined(_WIN32)
+  if (!settings.CpuAffinity.empty())
+  {
+    DWORD_PTR affinityMask = 0;
+    for (std::vector<int>::const_iterator it = settings.CpuAffinity.begin(); it != settings.CpuAffinity.end(); ++it)
+    {
+      if (*it < 0 || *it >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+      {
+        LOG_WARNING("Invalid CPU index in capture thread CPU affinity: " << *it);
+        status = PLUS_FAIL;
+        continue;
+      }
+      affinityMask |= (static_cast<DWORD_PTR>(1) << *it);
+    }
+    if (SetThreadAffinityMask(GetCurrentThread(), affinityMask) == 0)
+    {
+      LOG_WARNING("Failed to set capture thread CPU affinity (error code: " << GetLastError() << ")");
+      status = PLUS_FAIL;
+    }
+  }
+
+  if (settings.SchedulingPolicy != SCHEDULING_POLICY_DEFAULT)
+  {
+    // There are no real-time scheduling policies, the highest thread priority is the closest equivalent
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    {
+      LOG_WARNING("Failed to set capture thread priority (error code: " << GetLastError() << ")");
+      status = PLUS_FAIL;
+    }
+  }
+
+  if (settings.LockMemory)
+  {
+    LOG_WARNING("Locking of process memory is not supported on this platform");
+    status = PLUS_FAIL;
+  }
+#else
+  if (!settings.IsDefault())
+  {
+    LOG_WARNING("Capture thread settings are not supported on this platform");
+    status = PLUS_FAIL;
+  }
+#endif
+  return status;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusCaptureLoopScheduler::GetSchedulingPolicyAsString(SchedulingPolicyType policy)
+{
+  switch (policy)
+  {
+    case SCHEDULING_POLICY_FIFO:
+      return "Fifo";
+    case SCHEDULING_POLICY_ROUND_ROBIN:
+      return "RoundRobin";
+    default:
+      return "Default";
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusCaptureLoopScheduler::GetSchedulingPolicyFromString(const std::string& policyString, SchedulingPolicyType& policy)
+{
+  if (igsioCommon::IsEqualInsensitive(policyString, "Default"))
+  {
+    policy = SCHEDULING_POLICY_DEFAULT;
+  }
+  else if (igsioCommon::IsEqualInsensitive(policyString, "Fifo"))
+  {
+    policy = SCHEDULING_POLICY_FIFO;
+  }
+  else if (igsioCommon::IsEqualInsensitive(policyString, "RoundRobin"))
+  {
+    policy = SCHEDULING_POLICY_ROUND_ROBIN;
+  }
+  else
+  {
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+double PlusCaptureLoopScheduler::GetMonotonicTimeSec()
+{
+#if defined(__linux__)
+  timespec currentTime;
+  clock_gettime(CLOCK_MONOTONIC, &currentTime);
+  return currentTime.tv_sec + currentTime.tv_nsec * 1e-9;
+#else
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureLoopScheduler::SleepUntil(double monotonicTimeSec)
+{
+#if defined(__linux__)
+  timespec deadline;
+  deadline.tv_sec = static_cast<time_t>(std::floor(monotonicTimeSec));
+  deadline.tv_nsec = static_cast<long>((monotonicTimeSec - deadline.tv_sec) * 1e9);
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  // The deadline is absolute, so the sleep can be simply restarted if it is interrupted by a signal
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+  {
+  }
+#else
+  double delaySec = monotonicTimeSec - GetMonotonicTimeSec();
+  if (delaySec > 0)
+  {
+    vtkIGSIOAccurateTimer::Delay(delaySec);
+  }
+#endif
+}
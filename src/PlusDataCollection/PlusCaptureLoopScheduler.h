@@ -0,0 +1,141 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusCaptureLoopScheduler_h
+#define __PlusCaptureLoopScheduler_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusDataCollectionExport.h"
+
+// STL includes
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+  \class PlusCaptureLoopScheduler
+  \brief Runs a periodic loop on absolute deadlines and measures how accurately the deadlines are met.
+
+  The deadlines are on a fixed grid (start time + k * period), so the loop does not drift, even if the
+  iterations take a varying amount of time. Between the iterations the thread sleeps until the next deadline
+  (on Linux with clock_nanosleep on the monotonic clock).
+
+  If an iteration is completed after the next deadline (overrun) then the next iteration starts immediately
+  and the following deadline is the first one on the grid that is still in the future. This way the loop
+  catches up without running a burst of iterations.
+
+  The time between a deadline and the actual wake-up (wake-up latency) and the length of the overruns are
+  collected in histograms. The statistics can be read from any thread.
+
+  The thread settings (CPU affinity, real-time scheduling policy and priority, memory locking) can be applied to
+  the thread that runs the loop. Real-time settings usually require additional privileges (on Linux: CAP_SYS_NICE or
+  an rtprio limit for scheduling, CAP_IPC_LOCK or a memlock limit for memory locking).
+
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport PlusCaptureLoopScheduler
+{
+public:
+  enum SchedulingPolicyType
+  {
+    /*! Default time-sharing scheduling of the operating system */
+    SCHEDULING_POLICY_DEFAULT,
+    /*! Real-time first in, first out scheduling (SCHED_FIFO) */
+    SCHEDULING_POLICY_FIFO,
+    /*! Real-time round-robin scheduling (SCHED_RR) */
+    SCHEDULING_POLICY_ROUND_ROBIN
+  };
+
+  struct ThreadSettings
+  {
+    ThreadSettings();
+    /*! Returns true if none of the settings differs from the operating system defaults */
+    bool IsDefault() const;
+    /*! Indices of the CPUs that the thread may run on. If empty then the thread may run on any CPU. */
+    std::vector<int> CpuAffinity;
+    SchedulingPolicyType SchedulingPolicy;
+    /*! Real-time priority, only used with real-time scheduling policies (on Linux: 1 to 99) */
+    int Priority;
+    /*! Lock all current and future memory pages of the process in RAM to avoid page faults */
+    bool LockMemory;
+  };
+
+  struct Statistics
+  {
+    Statistics();
+    /*! Number of deadlines that were met or overrun, including the iterations recorded by RecordIteration */
+    unsigned long long NumberOfPeriods;
+    /*! Number of iterations that were completed after the next deadline */
+    unsigned long long NumberOfOverruns;
+    /*! Number of deadlines that were skipped because of overruns */
+    unsigned long long NumberOfSkippedDeadlines;
+    double AverageWakeUpLatencySec;
+    double MaxWakeUpLatencySec;
+    double MaxOverrunSec;
+    /*! Number of wake-ups in each bin (see GetHistogramBinUpperLimitsSec). Iterations recorded by RecordIteration have no wake-up latency. */
+    std::vector<unsigned long long> WakeUpLatencyHistogram;
+    /*! Number of overruns in each bin (see GetHistogramBinUpperLimitsSec) */
+    std::vector<unsigned long long> OverrunHistogram;
+  };
+
+  PlusCaptureLoopScheduler();
+  virtual ~PlusCaptureLoopScheduler();
+
+  /*! Set the loop period, clear the statistics, and make the first deadline one period from now */
+  void Start(double periodSec);
+
+  /*! Sleep until the next deadline (if it is not passed yet) and update the statistics */
+  void WaitForNextDeadline();
+
+  /*!
+    Update the statistics with an iteration that is not timed by WaitForNextDeadline (e.g., it is started by new input data).
+    The iteration is counted as an overrun if it took longer than the period since iterationStartTimeSec (time of the monotonic clock).
+  */
+  void RecordIteration(double iterationStartTimeSec);
+
+  /*! Time until the next deadline, negative if the deadline is already passed */
+  double GetTimeUntilNextDeadlineSec() const;
+
+  double GetPeriodSec() const;
+
+  Statistics GetStatistics() const;
+
+  /*! Upper limits of the histogram bins. The last bin collects all values above the last limit. */
+  static const std::vector<double>& GetHistogramBinUpperLimitsSec();
+
+  /*! Returns the histogram in a human-readable form, for example "<=0.05ms:120 <=0.1ms:3 ... >20ms:0" */
+  static std::string GetHistogramAsString(const std::vector<unsigned long long>& histogram);
+
+  /*! Apply the settings to the calling thread. If a setting cannot be applied then a warning is logged and the other settings are still applied. */
+  static PlusStatus ApplyThreadSettings(const ThreadSettings& settings);
+
+  static std::string GetSchedulingPolicyAsString(SchedulingPolicyType policy);
+  static PlusStatus GetSchedulingPolicyFromString(const std::string& policyString, SchedulingPolicyType& policy);
+
+  /*! Time of the monotonic clock that is used for the deadlines */
+  static double GetMonotonicTimeSec();
+
+  /*! Sleep until the specified time of the monotonic clock */
+  static void SleepUntil(double monotonicTimeSec);
+
+protected:
+  /*! Add a value to the histogram bin that it belongs to */
+  static void AddToHistogram(std::vector<unsigned long long>& histogram, double valueSec);
+
+  double PeriodSec;
+  double NextDeadlineSec;
+
+  /*! Protects the statistics, which are updated by the loop thread and read by other threads */
+  mutable std::mutex StatisticsMutex;
+  Statistics Stats;
+  double TotalWakeUpLatencySec;
+
+private:
+  PlusCaptureLoopScheduler(const PlusCaptureLoopScheduler&);
+  void operator=(const PlusCaptureLoopScheduler&);
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusNewItemSignal.h"
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+
+//----------------------------------------------------------------------------
+PlusNewItemSignal::PlusNewItemSignal()
+{
+}
+
+//----------------------------------------------------------------------------
+PlusNewItemSignal::~PlusNewItemSignal()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusNewItemSignal::Notify()
+{
+  {
+    // Acquire the lock so that a waiting thread cannot miss the notification between checking the condition and waiting
+    std::lock_guard<std::mutex> lock(this->Mutex);
+  }
+  this->Condition.notify_all();
+}
+
+//----------------------------------------------------------------------------
+bool PlusNewItemSignal::Wait(const std::function<bool()>& condition, double timeoutSec)
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  return this->Condition.wait_for(lock, std::chrono::duration<double>(std::max(timeoutSec, 0.0)), condition);
+}
@@ -0,0 +1,52 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusNewItemSignal_h
+#define __PlusNewItemSignal_h
+
+#include "vtkPlusDataCollectionExport.h"
+
+// STL includes
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+/*!
+  \class PlusNewItemSignal
+  \brief Wakes up a thread that waits for new items in one or more buffers.
+
+  Each waiting object (channel, device) owns its signal and registers it in the buffers that it reads
+  (see vtkPlusBuffer::AddNewItemSignal). A buffer only notifies the signals that are registered in it,
+  therefore producers of unrelated buffers do not contend for the same lock.
+
+  The producer must update the state that the waiting condition depends on before calling Notify.
+
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport PlusNewItemSignal
+{
+public:
+  PlusNewItemSignal();
+  ~PlusNewItemSignal();
+
+  /*! Wake up the threads that are waiting for the signal */
+  void Notify();
+
+  /*!
+    Wait until a condition is fulfilled. The condition is checked at the beginning and each time the signal is notified.
+    \return Value of the condition (false if the timeout expired)
+  */
+  bool Wait(const std::function<bool()>& condition, double timeoutSec);
+
+private:
+  PlusNewItemSignal(const PlusNewItemSignal&);
+  void operator=(const PlusNewItemSignal&);
+
+  std::mutex Mutex;
+  std::condition_variable Condition;
+};
+
+#endif
@@ -8,6 +8,10 @@
 #include "PlusStreamBufferItem.h"
 #include "vtkMatrix4x4.h"
 
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+
 //----------------------------------------------------------------------------
 //            DataBufferItem
 //----------------------------------------------------------------------------
@@ -17,7 +21,6 @@ StreamBufferItem::StreamBufferItem()
   , Index(0)
   , Uid(0)
   , ValidTransformData(false)
-  , Matrix(vtkSmartPointer<vtkMatrix4x4>::New())
   , Status(TOOL_OK)
 {
 }
@@ -30,7 +33,6 @@ StreamBufferItem::~StreamBufferItem()
 //----------------------------------------------------------------------------
 StreamBufferItem::StreamBufferItem(const StreamBufferItem& dataItem)
 {
-  this->Matrix = vtkSmartPointer<vtkMatrix4x4>::New();
   this->Status = TOOL_OK;
   *this = dataItem;
 }
@@ -44,14 +46,32 @@ StreamBufferItem& StreamBufferItem::operator=(StreamBufferItem const& dataItem)
     return *this;
   }
 
-  this->Frame = dataItem.Frame;
+  if (dataItem.Frame.get() != NULL)
+  {
+    this->GetFrame() = *dataItem.Frame;
+  }
+  else
+  {
+    this->Frame.reset();
+  }
   this->FilteredTimeStamp = dataItem.FilteredTimeStamp;
   this->UnfilteredTimeStamp = dataItem.UnfilteredTimeStamp;
   this->Index = dataItem.Index;
   this->Uid = dataItem.Uid;
-  this->FrameFields = dataItem.FrameFields;
+  this->FrameFields.reset(dataItem.FrameFields.get() != NULL ? new igsioFieldMapType(*dataItem.FrameFields) : NULL);
   this->Status = dataItem.Status;
-  this->Matrix->DeepCopy(dataItem.Matrix);
+  if (dataItem.Matrix.GetPointer() != NULL)
+  {
+    if (this->Matrix.GetPointer() == NULL)
+    {
+      this->Matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    }
+    this->Matrix->DeepCopy(dataItem.Matrix);
+  }
+  else
+  {
+    this->Matrix = NULL;
+  }
   this->ValidTransformData = dataItem.ValidTransformData;
 
   return *this;
@@ -60,8 +80,12 @@ StreamBufferItem& StreamBufferItem::operator=(StreamBufferItem const& dataItem)
 //----------------------------------------------------------------------------
 void StreamBufferItem::SetFrameField(std::string fieldName, std::string fieldValue, igsioFrameFieldFlags flags)
 {
-  this->FrameFields[fieldName].first = flags;
-  this->FrameFields[fieldName].second = fieldValue;
+  if (this->FrameFields.get() == NULL)
+  {
+    this->FrameFields.reset(new igsioFieldMapType);
+  }
+  (*this->FrameFields)[fieldName].first = flags;
+  (*this->FrameFields)[fieldName].second = fieldValue;
 }
 
 //----------------------------------------------------------------------------
@@ -73,15 +97,30 @@ std::string StreamBufferItem::GetFrameField(const std::string& fieldName) const
     return "";
   }
 
+  if (this->FrameFields.get() == NULL)
+  {
+    return "";
+  }
+
   igsioFieldMapType::const_iterator fieldIterator;
-  fieldIterator = this->FrameFields.find(fieldName);
-  if (fieldIterator != this->FrameFields.end())
+  fieldIterator = this->FrameFields->find(fieldName);
+  if (fieldIterator != this->FrameFields->end())
   {
     return fieldIterator->second.second;
   }
   return "";
 }
 
+//----------------------------------------------------------------------------
+igsioFieldMapType StreamBufferItem::GetFrameFieldMap()
+{
+  if (this->FrameFields.get() == NULL)
+  {
+    return igsioFieldMapType();
+  }
+  return *this->FrameFields;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus StreamBufferItem::DeleteFrameField(const char* fieldName)
 {
@@ -91,10 +130,16 @@ PlusStatus StreamBufferItem::DeleteFrameField(const char* fieldName)
     return PLUS_FAIL;
   }
 
-  igsioFieldMapType::iterator field = this->FrameFields.find(fieldName);
-  if (field != this->FrameFields.end())
+  if (this->FrameFields.get() == NULL)
+  {
+    LOG_DEBUG("Failed to delete frame field - could find field " << fieldName);
+    return PLUS_FAIL;
+  }
+
+  igsioFieldMapType::iterator field = this->FrameFields->find(fieldName);
+  if (field != this->FrameFields->end())
   {
-    this->FrameFields.erase(field);
+    this->FrameFields->erase(field);
     return PLUS_SUCCESS;
   }
   LOG_DEBUG("Failed to delete frame field - could find field " << fieldName);
@@ -121,6 +166,93 @@ PlusStatus StreamBufferItem::DeepCopy(StreamBufferItem* dataItem)
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus StreamBufferItem::ShallowCopy(StreamBufferItem* dataItem)
+{
+  if (dataItem == NULL)
+  {
+    LOG_ERROR("Failed to shallow copy data buffer item - buffer item NULL!");
+    return PLUS_FAIL;
+  }
+  if (this == dataItem)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  this->FilteredTimeStamp = dataItem->FilteredTimeStamp;
+  this->UnfilteredTimeStamp = dataItem->UnfilteredTimeStamp;
+  this->Index = dataItem->Index;
+  this->Uid = dataItem->Uid;
+  this->FrameFields.reset(dataItem->FrameFields.get() != NULL ? new igsioFieldMapType(*dataItem->FrameFields) : NULL);
+  this->Status = dataItem->Status;
+  if (dataItem->Matrix.GetPointer() != NULL)
+  {
+    if (this->Matrix.GetPointer() == NULL)
+    {
+      this->Matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    }
+    this->Matrix->DeepCopy(dataItem->Matrix);
+  }
+  else
+  {
+    this->Matrix = NULL;
+  }
+  this->ValidTransformData = dataItem->ValidTransformData;
+
+  if (dataItem->Frame.get() == NULL)
+  {
+    this->Frame.reset();
+    return PLUS_SUCCESS;
+  }
+  return dataItem->ShareFrameWith(this->GetFrame());
+}
+
+//----------------------------------------------------------------------------
+PlusStatus StreamBufferItem::ShareFrameWith(igsioVideoFrame& frame)
+{
+  if (this->Frame.get() == NULL)
+  {
+    // No frame has been set
+    frame = igsioVideoFrame();
+    return PLUS_SUCCESS;
+  }
+
+  if (this->Frame->IsFrameEncoded() || this->Frame->GetImage() == NULL)
+  {
+    // Nothing to share, encoded frames are small enough to be copied
+    frame = *this->Frame;
+    return PLUS_SUCCESS;
+  }
+
+  if (frame.GetImage() == NULL)
+  {
+    // Make sure the frame has an image object that we can shallow copy into
+    FrameSizeType frameSize = {1, 1, 1};
+    if (frame.AllocateFrame(frameSize, this->Frame->GetImage()->GetScalarType(), this->Frame->GetImage()->GetNumberOfScalarComponents()) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to share image data: failed to allocate frame");
+      return PLUS_FAIL;
+    }
+  }
+
+  // ShallowCopy only increments the reference count of the scalar array, pixel data is not copied
+  frame.GetImage()->ShallowCopy(this->Frame->GetImage());
+  frame.SetImageType(this->Frame->GetImageType());
+  frame.SetImageOrientation(this->Frame->GetImageOrientation());
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+igsioVideoFrame& StreamBufferItem::GetFrame()
+{
+  if (this->Frame.get() == NULL)
+  {
+    this->Frame.reset(new igsioVideoFrame);
+  }
+  return *this->Frame;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus StreamBufferItem::SetMatrix(vtkMatrix4x4* matrix)
 {
@@ -132,6 +264,10 @@ PlusStatus StreamBufferItem::SetMatrix(vtkMatrix4x4* matrix)
 
   ValidTransformData = true;
 
+  if (this->Matrix.GetPointer() == NULL)
+  {
+    this->Matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  }
   this->Matrix->DeepCopy(matrix);
 
   return PLUS_SUCCESS;
@@ -146,6 +282,12 @@ PlusStatus StreamBufferItem::GetMatrix(vtkMatrix4x4* outputMatrix)
     return PLUS_FAIL;
   }
 
+  if (this->Matrix.GetPointer() == NULL)
+  {
+    // No matrix has been set
+    outputMatrix->Identity();
+    return PLUS_SUCCESS;
+  }
   outputMatrix->DeepCopy(this->Matrix);
 
   return PLUS_SUCCESS;
@@ -166,5 +308,145 @@ ToolStatus StreamBufferItem::GetStatus() const
 //----------------------------------------------------------------------------
 bool StreamBufferItem::HasValidFieldData() const
 {
-  return this->FrameFields.size() > 0;
-}
\ No newline at end of file
+  return this->FrameFields.get() != NULL && this->FrameFields->size() > 0;
+}
+//----------------------------------------------------------------------------
+//            StreamBufferItemView
+//----------------------------------------------------------------------------
+StreamBufferItemView::StreamBufferItemView()
+  : FilteredTimeStamp(0)
+  , UnfilteredTimeStamp(0)
+  , Index(0)
+  , Uid(0)
+  , ImageType(US_IMG_TYPE_XX)
+  , ImageOrientation(US_IMG_ORIENT_XX)
+{
+}
+
+//----------------------------------------------------------------------------
+StreamBufferItemView::~StreamBufferItemView()
+{
+}
+
+//----------------------------------------------------------------------------
+PlusStatus StreamBufferItemView::ViewItem(StreamBufferItem& item)
+{
+  this->Reset();
+
+  if (!item.HasValidVideoData())
+  {
+    LOG_DEBUG("Unable to create buffer item view: the item has no valid image data");
+    return PLUS_FAIL;
+  }
+
+  igsioVideoFrame& frame = item.GetFrame();
+  if (frame.IsFrameEncoded())
+  {
+    LOG_DEBUG("Unable to create buffer item view: encoded frames are not supported");
+    return PLUS_FAIL;
+  }
+  if (frame.GetImage() == NULL || !frame.IsImageValid())
+  {
+    LOG_DEBUG("Unable to create buffer item view: the item has no valid image data");
+    return PLUS_FAIL;
+  }
+
+  // ShallowCopy only increments the reference count of the scalar array, pixel data is not copied
+  this->Image = vtkSmartPointer<vtkImageData>::New();
+  this->Image->ShallowCopy(frame.GetImage());
+
+  this->FilteredTimeStamp = item.GetFilteredTimestamp(0);
+  this->UnfilteredTimeStamp = item.GetUnfilteredTimestamp(0);
+  this->Index = item.GetIndex();
+  this->Uid = item.GetUid();
+  this->FrameFields = item.GetFrameFieldMap();
+  this->ImageType = frame.GetImageType();
+  this->ImageOrientation = frame.GetImageOrientation();
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void StreamBufferItemView::Reset()
+{
+  this->Image = NULL;
+  this->FrameFields.clear();
+  this->FilteredTimeStamp = 0;
+  this->UnfilteredTimeStamp = 0;
+  this->Index = 0;
+  this->Uid = 0;
+  this->ImageType = US_IMG_TYPE_XX;
+  this->ImageOrientation = US_IMG_ORIENT_XX;
+}
+
+//----------------------------------------------------------------------------
+bool StreamBufferItemView::IsValid() const
+{
+  return this->Image != NULL && this->Image->GetPointData()->GetScalars() != NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* StreamBufferItemView::GetImage() const
+{
+  return this->Image;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus StreamBufferItemView::ShareImageWith(igsioVideoFrame& frame) const
+{
+  if (!this->IsValid())
+  {
+    LOG_ERROR("Unable to share image data: buffer item view is invalid");
+    return PLUS_FAIL;
+  }
+
+  if (frame.GetImage() == NULL)
+  {
+    // Make sure the frame has an image object that we can shallow copy into
+    FrameSizeType frameSize = {1, 1, 1};
+    if (frame.AllocateFrame(frameSize, this->Image->GetScalarType(), this->Image->GetNumberOfScalarComponents()) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to share image data: failed to allocate frame");
+      return PLUS_FAIL;
+    }
+  }
+
+  frame.GetImage()->ShallowCopy(this->Image);
+  frame.SetImageType(this->ImageType);
+  frame.SetImageOrientation(this->ImageOrientation);
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+//            StreamBufferItemReservation
+//----------------------------------------------------------------------------
+StreamBufferItemReservation::StreamBufferItemReservation()
+  : Owner(NULL)
+{
+}
+
+//----------------------------------------------------------------------------
+StreamBufferItemReservation::~StreamBufferItemReservation()
+{
+}
+
+//----------------------------------------------------------------------------
+void* StreamBufferItemReservation::GetScalarPointer()
+{
+  if (!this->IsReserved())
+  {
+    return NULL;
+  }
+  return this->Frame.GetScalarPointer();
+}
+
+//----------------------------------------------------------------------------
+unsigned long StreamBufferItemReservation::GetFrameSizeInBytes()
+{
+  if (!this->IsReserved())
+  {
+    return 0;
+  }
+  return this->Frame.GetFrameSizeInBytes();
+}
@@ -15,9 +15,12 @@ See License.txt for details.
 // VTK includes
 #include <vtkSmartPointer.h>
 
+#include <memory>
 #include <vector>
 
+class vtkImageData;
 class vtkMatrix4x4;
+class vtkPlusBuffer;
 class vtkPlusDevice;
 class vtkPlusChannel;
 class vtkPlusDataSource;
@@ -77,7 +80,7 @@ public:
   /*! Get frame field value */
   std::string GetFrameField(const std::string& fieldName) const;
   /*! Get frame field map */
-  igsioFieldMapType GetFrameFieldMap() {return this->FrameFields;}
+  igsioFieldMapType GetFrameFieldMap();
   /*! Delete frame field */
   PlusStatus DeleteFrameField(const char* fieldName);
   PlusStatus DeleteFrameField(const std::string& fieldName);
@@ -85,7 +88,20 @@ public:
   /*! Copy stream buffer item */
   PlusStatus DeepCopy(StreamBufferItem* dataItem);
 
-  igsioVideoFrame& GetFrame() { return this->Frame; };
+  /*!
+    Copy stream buffer item, but share the pixel data of the video frame instead of copying it (see ShareFrameWith).
+    The buffer does not write into shared pixel data, so the copy remains valid after the buffer slot is reused.
+  */
+  PlusStatus ShallowCopy(StreamBufferItem* dataItem);
+
+  /*!
+    Make a video frame share the pixel data of this item (no pixel data is copied). Encoded frames are copied.
+    The frame must be treated as read-only while the data is shared.
+  */
+  PlusStatus ShareFrameWith(igsioVideoFrame& frame);
+
+  /*! Get the video frame of the item. The frame is allocated on first access. */
+  igsioVideoFrame& GetFrame();
 
   /*! Set tracker matrix */
   PlusStatus SetMatrix(vtkMatrix4x4* matrix);
@@ -102,7 +118,7 @@ public:
   bool HasValidFieldData() const;
   bool HasValidVideoData() const
   {
-    return Frame.IsImageValid();
+    return Frame.get() != NULL && Frame->IsImageValid();
   }
 
 protected:
@@ -115,13 +131,121 @@ protected:
   /*! unique identifier assigned by the storage buffer, it is guaranteed to increase monotonously, by one for each frame that is added to the buffer*/
   BufferItemUidType Uid;
 
-  /*! Custom frame fields */
-  igsioFieldMapType FrameFields;
+  /*! Custom frame fields, allocated when the first field is set (it saves memory in transform buffers) */
+  std::unique_ptr<igsioFieldMapType> FrameFields;
 
   bool ValidTransformData;
-  igsioVideoFrame Frame;
+  /*! Allocated on first access, NULL means empty frame (it saves memory in transform buffers) */
+  std::unique_ptr<igsioVideoFrame> Frame;
+  /*! Allocated when a matrix is set, NULL means identity (it saves memory in buffers that store the transforms elsewhere) */
   vtkSmartPointer<vtkMatrix4x4> Matrix;
   ToolStatus Status;
 };
 
+/*!
+  \class StreamBufferItemView
+  \brief Read-only, reference-counted view of the video frame stored in a buffer item.
+
+  The view shares the pixel array of the buffer slot instead of copying it. While a view (or any image that
+  the view data was shared with) holds a reference to the pixel array, the buffer does not write into that
+  memory: when the slot is reused the buffer detaches it and allocates a new pixel array for the new frame
+  (copy-on-write). Therefore the pixel data of a view never changes and the producer is never blocked by readers.
+
+  Consumers must treat the image as immutable. Encoded (compressed) frames cannot be viewed, use
+  vtkPlusBuffer::GetStreamBufferItem for those.
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport StreamBufferItemView
+{
+public:
+  StreamBufferItemView();
+  virtual ~StreamBufferItemView();
+
+  /*! Set the view to reference the frame stored in a buffer item. Buffer must be locked by the caller. */
+  PlusStatus ViewItem(StreamBufferItem& item);
+
+  /*! Release the reference to the pixel data */
+  void Reset();
+
+  /*! Returns true if the view references valid image data */
+  bool IsValid() const;
+
+  /*! Get the image. The returned image shares the pixel array with the buffer slot, it must not be modified. */
+  vtkImageData* GetImage() const;
+
+  /*!
+    Make the image of a video frame share the pixel data with this view (no pixel data is copied).
+    The frame must be treated as read-only while the data is shared.
+  */
+  PlusStatus ShareImageWith(igsioVideoFrame& frame) const;
+
+  /*! Get filtered timestamp in global time (global = local + offset) */
+  double GetFilteredTimestamp(double localTimeOffsetSec) const { return this->FilteredTimeStamp + localTimeOffsetSec; }
+  /*! Get unfiltered timestamp in global time (global = local + offset) */
+  double GetUnfilteredTimestamp(double localTimeOffsetSec) const { return this->UnfilteredTimeStamp + localTimeOffsetSec; }
+
+  unsigned long GetIndex() const { return this->Index; }
+  BufferItemUidType GetUid() const { return this->Uid; }
+  US_IMAGE_TYPE GetImageType() const { return this->ImageType; }
+  US_IMAGE_ORIENTATION GetImageOrientation() const { return this->ImageOrientation; }
+
+  /*! Get frame field map (copy of the fields at the time the view was created) */
+  const igsioFieldMapType& GetFrameFieldMap() const { return this->FrameFields; }
+
+protected:
+  double FilteredTimeStamp;
+  double UnfilteredTimeStamp;
+  unsigned long Index;
+  BufferItemUidType Uid;
+  igsioFieldMapType FrameFields;
+  US_IMAGE_TYPE ImageType;
+  US_IMAGE_ORIENTATION ImageOrientation;
+  /*! Image object that shares the scalar array of the buffer slot */
+  vtkSmartPointer<vtkImageData> Image;
+};
+
+/*!
+  \class StreamBufferItemReservation
+  \brief Video frame that a producer fills before it is added to a buffer (see vtkPlusBuffer::ReserveItem).
+
+  Adding a frame in two phases keeps the frame conversion out of the buffer lock: vtkPlusBuffer::ReserveItem provides
+  a frame in the format of the buffer, the producer writes into it (decodes, reorients, clips) without locking the buffer,
+  then vtkPlusBuffer::CommitReservedItem swaps the pixel array into the next buffer slot and sets the timestamps and fields
+  under the lock. Readers never see a partially written frame and are only blocked while the pixel array is swapped.
+
+  The pixel array that is swapped out of the slot is reused by later reservations (unless a StreamBufferItemView
+  still references it), so no memory is allocated for the frames during acquisition.
+  A reservation object can be reused for any number of frames.
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport StreamBufferItemReservation
+{
+public:
+  StreamBufferItemReservation();
+  virtual ~StreamBufferItemReservation();
+
+  /*! Returns true between vtkPlusBuffer::ReserveItem and vtkPlusBuffer::CommitReservedItem (or vtkPlusBuffer::ReleaseReservation) */
+  bool IsReserved() const { return this->Owner != NULL; }
+
+  /*! Get the reserved frame. The pixel data may be modified, but the frame size and pixel type must not be changed. */
+  igsioVideoFrame& GetFrame() { return this->Frame; }
+
+  /*! Get the pointer to the first pixel of the reserved frame, NULL if no frame is reserved */
+  void* GetScalarPointer();
+
+  /*! Get the size of the pixel data of the reserved frame, 0 if no frame is reserved */
+  unsigned long GetFrameSizeInBytes();
+
+protected:
+  friend class vtkPlusBuffer;
+
+  igsioVideoFrame Frame;
+  /*! Buffer that the frame is reserved from, NULL if no frame is reserved */
+  vtkPlusBuffer* Owner;
+
+private:
+  StreamBufferItemReservation(const StreamBufferItemReservation&);
+  void operator=(const StreamBufferItemReservation&);
+};
+
 #endif
@@ -0,0 +1,232 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusTransformBufferStorage.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STL includes
+#include <algorithm>
+
+namespace
+{
+  const double IDENTITY_MATRIX_ELEMENTS[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+}
+
+//----------------------------------------------------------------------------
+PlusTransformBufferStorage::PlusTransformBufferStorage()
+  : Capacity(0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusTransformBufferStorage::~PlusTransformBufferStorage()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusTransformBufferStorage::SetCapacity(int capacity)
+{
+  if (capacity < 0)
+  {
+    LOG_ERROR("Invalid transform buffer storage capacity: " << capacity);
+    return;
+  }
+  if (capacity == this->Capacity)
+  {
+    return;
+  }
+
+  // Items are stored in slot (uid % capacity), so they have to be redistributed
+  PlusTransformBufferStorage oldStorage;
+  oldStorage.DeepCopy(*this);
+
+  this->Capacity = capacity;
+  this->Uids.assign(capacity, 0);
+  this->FilteredTimestamps.assign(capacity, 0);
+  this->UnfilteredTimestamps.assign(capacity, 0);
+  this->Indices.assign(capacity, 0);
+  this->Statuses.assign(capacity, TOOL_OK);
+  this->ValidTransforms.assign(capacity, 0);
+  this->Matrices.resize(16 * capacity);
+  for (int i = 0; i < capacity; ++i)
+  {
+    std::copy(IDENTITY_MATRIX_ELEMENTS, IDENTITY_MATRIX_ELEMENTS + 16, this->Matrices.begin() + 16 * i);
+  }
+  this->FrameFields.assign(capacity, CompactFrameFieldList());
+
+  // Keep the most recent items
+  BufferItemUidType latestUid = 0;
+  for (int oldSlot = 0; oldSlot < oldStorage.Capacity; ++oldSlot)
+  {
+    latestUid = std::max(latestUid, oldStorage.Uids[oldSlot]);
+  }
+  for (int oldSlot = 0; oldSlot < oldStorage.Capacity; ++oldSlot)
+  {
+    BufferItemUidType uid = oldStorage.Uids[oldSlot];
+    if (uid == 0 || capacity == 0 || uid + capacity <= latestUid)
+    {
+      continue;
+    }
+    int slot = this->GetSlot(uid);
+    this->Uids[slot] = uid;
+    this->FilteredTimestamps[slot] = oldStorage.FilteredTimestamps[oldSlot];
+    this->UnfilteredTimestamps[slot] = oldStorage.UnfilteredTimestamps[oldSlot];
+    this->Indices[slot] = oldStorage.Indices[oldSlot];
+    this->Statuses[slot] = oldStorage.Statuses[oldSlot];
+    this->ValidTransforms[slot] = oldStorage.ValidTransforms[oldSlot];
+    std::copy(oldStorage.Matrices.begin() + 16 * oldSlot, oldStorage.Matrices.begin() + 16 * (oldSlot + 1), this->Matrices.begin() + 16 * slot);
+    this->FrameFields[slot].swap(oldStorage.FrameFields[oldSlot]);
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusTransformBufferStorage::Clear()
+{
+  std::fill(this->Uids.begin(), this->Uids.end(), 0);
+  for (std::vector<CompactFrameFieldList>::iterator it = this->FrameFields.begin(); it != this->FrameFields.end(); ++it)
+  {
+    CompactFrameFieldList().swap(*it);
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusTransformBufferStorage::DeepCopy(const PlusTransformBufferStorage& storage)
+{
+  this->Capacity = storage.Capacity;
+  this->Uids = storage.Uids;
+  this->FilteredTimestamps = storage.FilteredTimestamps;
+  this->UnfilteredTimestamps = storage.UnfilteredTimestamps;
+  this->Indices = storage.Indices;
+  this->Statuses = storage.Statuses;
+  this->ValidTransforms = storage.ValidTransforms;
+  this->Matrices = storage.Matrices;
+  this->FrameFields = storage.FrameFields;
+  this->FieldNames = storage.FieldNames;
+  this->FieldNameIds = storage.FieldNameIds;
+}
+
+//----------------------------------------------------------------------------
+void PlusTransformBufferStorage::SetItem(BufferItemUidType uid, double filteredTimestamp, double unfilteredTimestamp, unsigned long index,
+    const double* matrixElements, ToolStatus status, const igsioFieldMapType* customFields)
+{
+  if (this->Capacity <= 0)
+  {
+    LOG_ERROR("Failed to store transform buffer item - storage is not allocated");
+    return;
+  }
+
+  int slot = this->GetSlot(uid);
+  this->Uids[slot] = uid;
+  this->FilteredTimestamps[slot] = filteredTimestamp;
+  this->UnfilteredTimestamps[slot] = unfilteredTimestamp;
+  this->Indices[slot] = index;
+  this->Statuses[slot] = status;
+  this->ValidTransforms[slot] = (matrixElements != NULL ? 1 : 0);
+  std::copy(matrixElements != NULL ? matrixElements : IDENTITY_MATRIX_ELEMENTS, (matrixElements != NULL ? matrixElements : IDENTITY_MATRIX_ELEMENTS) + 16, this->Matrices.begin() + 16 * slot);
+
+  this->FrameFields[slot].clear();
+  if (customFields != NULL)
+  {
+    for (igsioFieldMapType::const_iterator it = customFields->begin(); it != customFields->end(); ++it)
+    {
+      CompactFrameField field;
+      field.NameId = this->GetFieldNameId(it->first);
+      field.Flags = it->second.first;
+      field.Value = it->second.second;
+      this->FrameFields[slot].push_back(field);
+      if (it->first.find("Transform") != std::string::npos)
+      {
+        this->ValidTransforms[slot] = 1;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+bool PlusTransformBufferStorage::HasItem(BufferItemUidType uid) const
+{
+  return this->Capacity > 0 && uid != 0 && this->Uids[this->GetSlot(uid)] == uid;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusTransformBufferStorage::SetFrameField(BufferItemUidType uid, const std::string& fieldName, const std::string& fieldValue, igsioFrameFieldFlags flags)
+{
+  if (!this->HasItem(uid))
+  {
+    LOG_ERROR("Failed to set frame field - item is not in the transform buffer storage (Uid: " << uid << ")");
+    return PLUS_FAIL;
+  }
+
+  unsigned short nameId = this->GetFieldNameId(fieldName);
+  CompactFrameFieldList& fields = this->FrameFields[this->GetSlot(uid)];
+  for (CompactFrameFieldList::iterator it = fields.begin(); it != fields.end(); ++it)
+  {
+    if (it->NameId == nameId)
+    {
+      it->Flags = flags;
+      it->Value = fieldValue;
+      return PLUS_SUCCESS;
+    }
+  }
+  CompactFrameField field;
+  field.NameId = nameId;
+  field.Flags = flags;
+  field.Value = fieldValue;
+  fields.push_back(field);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusTransformBufferStorage::GetStreamBufferItem(BufferItemUidType uid, StreamBufferItem* bufferItem) const
+{
+  if (bufferItem == NULL)
+  {
+    LOG_ERROR("Unable to copy transform buffer item into a NULL data buffer item!");
+    return PLUS_FAIL;
+  }
+  if (!this->HasItem(uid))
+  {
+    LOG_ERROR("Failed to get item - item is not in the transform buffer storage (Uid: " << uid << ")");
+    return PLUS_FAIL;
+  }
+
+  int slot = this->GetSlot(uid);
+  bufferItem->SetUid(uid);
+  bufferItem->SetFilteredTimestamp(this->FilteredTimestamps[slot]);
+  bufferItem->SetUnfilteredTimestamp(this->UnfilteredTimestamps[slot]);
+  bufferItem->SetIndex(this->Indices[slot]);
+  bufferItem->SetStatus(this->Statuses[slot]);
+
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  matrix->DeepCopy(&this->Matrices[16 * slot]);
+  bufferItem->SetMatrix(matrix);
+  bufferItem->SetValidTransformData(this->ValidTransforms[slot] != 0);
+
+  const CompactFrameFieldList& fields = this->FrameFields[slot];
+  for (CompactFrameFieldList::const_iterator it = fields.begin(); it != fields.end(); ++it)
+  {
+    bufferItem->SetFrameField(this->FieldNames[it->NameId], it->Value, it->Flags);
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+unsigned short PlusTransformBufferStorage::GetFieldNameId(const std::string& fieldName)
+{
+  std::map<std::string, unsigned short>::iterator it = this->FieldNameIds.find(fieldName);
+  if (it != this->FieldNameIds.end())
+  {
+    return it->second;
+  }
+  unsigned short nameId = static_cast<unsigned short>(this->FieldNames.size());
+  this->FieldNames.push_back(fieldName);
+  this->FieldNameIds[fieldName] = nameId;
+  return nameId;
+}
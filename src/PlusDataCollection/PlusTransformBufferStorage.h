@@ -0,0 +1,104 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusTransformBufferStorage_h
+#define __PlusTransformBufferStorage_h
+
+#include "vtkPlusDataCollectionExport.h"
+#include "PlusStreamBufferItem.h"
+
+// IGSIO includes
+#include <igsioCommon.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+  \class PlusTransformBufferStorage
+  \brief Compact storage of transform-only buffer items.
+
+  Stores the content of tracker buffer items (timestamps, index, transform matrix, status, custom fields)
+  in flat arrays instead of one StreamBufferItem (with its own matrix, video frame and field map objects) per item.
+  Custom field names are interned: each item only stores a small integer key for each of its fields.
+
+  Items are addressed by their UID, the storage keeps the last Capacity items (as the timestamped buffer does).
+  The storage is not thread-safe, the owner buffer must be locked while it is accessed.
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport PlusTransformBufferStorage
+{
+public:
+  PlusTransformBufferStorage();
+  virtual ~PlusTransformBufferStorage();
+
+  /*! Set the number of items that the storage can hold. The most recent items are kept. */
+  void SetCapacity(int capacity);
+  int GetCapacity() const { return this->Capacity; }
+
+  /*! Remove all items */
+  void Clear();
+
+  /*! Copy content of another storage */
+  void DeepCopy(const PlusTransformBufferStorage& storage);
+
+  /*! Store a new item. The previous content of the slot is overwritten. Matrix may be NULL if the item has no valid transform. */
+  void SetItem(BufferItemUidType uid, double filteredTimestamp, double unfilteredTimestamp, unsigned long index,
+               const double* matrixElements, ToolStatus status, const igsioFieldMapType* customFields);
+
+  /*! Returns true if the storage contains the item with the specified uid */
+  bool HasItem(BufferItemUidType uid) const;
+
+  /*! Direct access to the stored values of an item. The item must be in the storage (see HasItem). */
+  double GetFilteredTimestamp(BufferItemUidType uid) const { return this->FilteredTimestamps[this->GetSlot(uid)]; }
+  double GetUnfilteredTimestamp(BufferItemUidType uid) const { return this->UnfilteredTimestamps[this->GetSlot(uid)]; }
+  unsigned long GetIndex(BufferItemUidType uid) const { return this->Indices[this->GetSlot(uid)]; }
+  ToolStatus GetStatus(BufferItemUidType uid) const { return this->Statuses[this->GetSlot(uid)]; }
+  bool HasValidTransformData(BufferItemUidType uid) const { return this->ValidTransforms[this->GetSlot(uid)] != 0; }
+  /*! Returns the 16 elements of the row-major 4x4 matrix of the item */
+  const double* GetMatrixElements(BufferItemUidType uid) const { return &this->Matrices[16 * this->GetSlot(uid)]; }
+
+  /*! Returns true if the item has any custom fields */
+  bool HasFrameFields(BufferItemUidType uid) const { return !this->FrameFields[this->GetSlot(uid)].empty(); }
+
+  /*! Set a custom field of a stored item */
+  PlusStatus SetFrameField(BufferItemUidType uid, const std::string& fieldName, const std::string& fieldValue, igsioFrameFieldFlags flags = FRAMEFIELD_NONE);
+
+  /*! Copy a stored item into a stream buffer item. The video frame of the buffer item is not modified. */
+  PlusStatus GetStreamBufferItem(BufferItemUidType uid, StreamBufferItem* bufferItem) const;
+
+protected:
+  /*! Custom field of an item with interned field name */
+  struct CompactFrameField
+  {
+    unsigned short NameId;
+    igsioFrameFieldFlags Flags;
+    std::string Value;
+  };
+  typedef std::vector<CompactFrameField> CompactFrameFieldList;
+
+  int GetSlot(BufferItemUidType uid) const { return static_cast<int>(uid % this->Capacity); }
+  unsigned short GetFieldNameId(const std::string& fieldName);
+
+  int Capacity;
+
+  std::vector<BufferItemUidType> Uids;
+  std::vector<double> FilteredTimestamps;
+  std::vector<double> UnfilteredTimestamps;
+  std::vector<unsigned long> Indices;
+  std::vector<ToolStatus> Statuses;
+  std::vector<unsigned char> ValidTransforms;
+  /*! 16 elements for each item (row-major 4x4 matrix) */
+  std::vector<double> Matrices;
+  /*! Custom fields of each item, empty for most tracker items (no memory is allocated for empty lists) */
+  std::vector<CompactFrameFieldList> FrameFields;
+
+  /*! Interned custom field names */
+  std::vector<std::string> FieldNames;
+  std::map<std::string, unsigned short> FieldNameIds;
+};
+
+#endif
@@ -0,0 +1,1080 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusSequenceFileStreamer.h"
+
+// IGSIO includes
+#include <igsioVideoFrame.h>
+
+// VTK includes
+#include <vtkType.h>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+  const char INDEX_CACHE_FILE_EXTENSION[] = ".frameindex";
+  const char INDEX_CACHE_FILE_SIGNATURE[] = "PlusSequenceFileStreamerIndex";
+  const int INDEX_CACHE_FILE_VERSION = 1;
+  const char FRAME_FIELD_PREFIX[] = "Seq_Frame";
+
+  //----------------------------------------------------------------------------
+  std::vector<std::string> SplitBySpaces(const std::string& str)
+  {
+    std::vector<std::string> tokens;
+    std::istringstream ss(str);
+    std::string token;
+    while (ss >> token)
+    {
+      tokens.push_back(token);
+    }
+    return tokens;
+  }
+
+  //----------------------------------------------------------------------------
+  igsioCommon::VTKScalarPixelType GetPixelTypeFromMetaImageElementType(const std::string& elementType)
+  {
+    if (elementType == "MET_CHAR") { return VTK_CHAR; }
+    if (elementType == "MET_UCHAR") { return VTK_UNSIGNED_CHAR; }
+    if (elementType == "MET_SHORT") { return VTK_SHORT; }
+    if (elementType == "MET_USHORT") { return VTK_UNSIGNED_SHORT; }
+    if (elementType == "MET_INT") { return VTK_INT; }
+    if (elementType == "MET_UINT") { return VTK_UNSIGNED_INT; }
+    if (elementType == "MET_FLOAT") { return VTK_FLOAT; }
+    if (elementType == "MET_DOUBLE") { return VTK_DOUBLE; }
+    return VTK_VOID;
+  }
+
+  //----------------------------------------------------------------------------
+  igsioCommon::VTKScalarPixelType GetPixelTypeFromNrrdType(const std::string& nrrdType)
+  {
+    if (nrrdType == "signed char" || nrrdType == "int8" || nrrdType == "int8_t") { return VTK_CHAR; }
+    if (nrrdType == "uchar" || nrrdType == "unsigned char" || nrrdType == "uint8" || nrrdType == "uint8_t") { return VTK_UNSIGNED_CHAR; }
+    if (nrrdType == "short" || nrrdType == "short int" || nrrdType == "signed short" || nrrdType == "signed short int" || nrrdType == "int16" || nrrdType == "int16_t") { return VTK_SHORT; }
+    if (nrrdType == "ushort" || nrrdType == "unsigned short" || nrrdType == "unsigned short int" || nrrdType == "uint16" || nrrdType == "uint16_t") { return VTK_UNSIGNED_SHORT; }
+    if (nrrdType == "int" || nrrdType == "signed int" || nrrdType == "int32" || nrrdType == "int32_t") { return VTK_INT; }
+    if (nrrdType == "uint" || nrrdType == "unsigned int" || nrrdType == "uint32" || nrrdType == "uint32_t") { return VTK_UNSIGNED_INT; }
+    if (nrrdType == "float") { return VTK_FLOAT; }
+    if (nrrdType == "double") { return VTK_DOUBLE; }
+    return VTK_VOID;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Store a header field either as an image field or as a field of a frame (Seq_Frame0012_Timestamp => frame 12, Timestamp) */
+  void AddHeaderField(const std::string& name, const std::string& value, std::map<std::string, std::string>& imageFields, std::vector<igsioFieldMapType>& frameFields)
+  {
+    const size_t prefixLength = sizeof(FRAME_FIELD_PREFIX) - 1;
+    if (name.compare(0, prefixLength, FRAME_FIELD_PREFIX) == 0)
+    {
+      size_t separatorPos = name.find('_', prefixLength);
+      int frameIndex = -1;
+      if (separatorPos != std::string::npos && separatorPos > prefixLength
+          && igsioCommon::StringToNumber<int>(name.substr(prefixLength, separatorPos - prefixLength), frameIndex) == PLUS_SUCCESS && frameIndex >= 0)
+      {
+        if (frameIndex >= static_cast<int>(frameFields.size()))
+        {
+          frameFields.resize(frameIndex + 1);
+        }
+        frameFields[frameIndex][name.substr(separatorPos + 1)] = std::make_pair(FRAMEFIELD_NONE, value);
+        return;
+      }
+    }
+    imageFields[name] = value;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string GetField(const std::map<std::string, std::string>& fields, const std::string& name)
+  {
+    std::map<std::string, std::string>::const_iterator fieldIt = fields.find(name);
+    return (fieldIt == fields.end()) ? std::string() : fieldIt->second;
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusSequenceFileStreamer::PlusSequenceFileStreamer()
+  : PrefetchWindowFrames(30)
+  , IndexCacheEnabled(true)
+  , IndexReadFromCache(false)
+  , PixelType(VTK_VOID)
+  , NumberOfScalarComponents(1)
+  , ImageType(US_IMG_BRIGHTNESS)
+  , ImageOrientation(US_IMG_ORIENT_MF)
+  , FrameSizeInBytes(0)
+  , MappedData(NULL)
+  , MappedDataSize(0)
+#ifdef _WIN32
+  , FileHandle(INVALID_HANDLE_VALUE)
+  , FileMappingHandle(NULL)
+#else
+  , FileDescriptor(-1)
+#endif
+  , PageSize(4096)
+  , PrefetchThreadStopRequested(false)
+  , PrefetchRequested(false)
+  , NextFrameIndex(0)
+  , FirstFrameIndex(0)
+  , LastFrameIndex(-1)
+  , Repeat(false)
+{
+  this->FrameSize[0] = 0;
+  this->FrameSize[1] = 0;
+  this->FrameSize[2] = 0;
+#ifdef _WIN32
+  SYSTEM_INFO systemInfo;
+  GetSystemInfo(&systemInfo);
+  this->PageSize = systemInfo.dwPageSize;
+#else
+  long pageSize = sysconf(_SC_PAGESIZE);
+  if (pageSize > 0)
+  {
+    this->PageSize = static_cast<size_t>(pageSize);
+  }
+#endif
+}
+
+//----------------------------------------------------------------------------
+PlusSequenceFileStreamer::~PlusSequenceFileStreamer()
+{
+  this->Close();
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::SetPrefetchWindowFrames(int numberOfFrames)
+{
+  std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+  this->PrefetchWindowFrames = std::max(1, numberOfFrames);
+  this->PrefetchRequested = true;
+  this->PrefetchPositionChanged.notify_one();
+}
+
+//----------------------------------------------------------------------------
+int PlusSequenceFileStreamer::GetPrefetchWindowFrames() const
+{
+  std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+  return this->PrefetchWindowFrames;
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::SetIndexCacheEnabled(bool enabled)
+{
+  this->IndexCacheEnabled = enabled;
+}
+
+//----------------------------------------------------------------------------
+bool PlusSequenceFileStreamer::GetIndexCacheEnabled() const
+{
+  return this->IndexCacheEnabled;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusSequenceFileStreamer::GetIndexCacheFilePath(const std::string& sequenceFilePath)
+{
+  return sequenceFilePath + INDEX_CACHE_FILE_EXTENSION;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSequenceFileStreamer::Open(const std::string& sequenceFilePath)
+{
+  this->Close();
+
+  this->IndexReadFromCache = false;
+  if (this->IndexCacheEnabled && this->ReadIndexFromCache(sequenceFilePath) == PLUS_SUCCESS)
+  {
+    this->IndexReadFromCache = true;
+  }
+  else
+  {
+    if (this->ReadIndexFromHeader(sequenceFilePath) != PLUS_SUCCESS)
+    {
+      this->Frames.clear();
+      return PLUS_FAIL;
+    }
+    if (this->IndexCacheEnabled && this->WriteIndexToCache(sequenceFilePath) != PLUS_SUCCESS)
+    {
+      // The cache is optional (e.g., the directory of the sequence file may be read-only)
+      LOG_DEBUG("Frame index of " << sequenceFilePath << " could not be written to " << GetIndexCacheFilePath(sequenceFilePath));
+    }
+  }
+
+  if (this->Frames.empty())
+  {
+    LOG_INFO("No valid frames are found in " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+
+  if (this->MapDataFile() != PLUS_SUCCESS)
+  {
+    this->Frames.clear();
+    return PLUS_FAIL;
+  }
+
+  if (this->Frames.back().Offset + this->FrameSizeInBytes > this->MappedDataSize)
+  {
+    LOG_INFO("Image data file " << this->DataFilePath << " is shorter than expected");
+    this->Close();
+    return PLUS_FAIL;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+    this->NextFrameIndex = 0;
+    this->FirstFrameIndex = 0;
+    this->LastFrameIndex = static_cast<int>(this->Frames.size()) - 1;
+    this->Repeat = false;
+    this->PrefetchThreadStopRequested = false;
+    this->PrefetchRequested = true;
+  }
+  this->PrefetchThread = std::thread(&PlusSequenceFileStreamer::PrefetchThreadMain, this);
+
+  LOG_INFO("Streaming " << this->Frames.size() << " frames from " << sequenceFilePath
+           << (this->IndexReadFromCache ? " (frame index is read from cache)" : ""));
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::Close()
+{
+  if (this->PrefetchThread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+      this->PrefetchThreadStopRequested = true;
+      this->PrefetchPositionChanged.notify_one();
+    }
+    this->PrefetchThread.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+    this->PrefetchedFrames.clear();
+  }
+  this->UnmapDataFile();
+  this->Frames.clear();
+}
+
+//----------------------------------------------------------------------------
+bool PlusSequenceFileStreamer::IsOpen() const
+{
+  return this->MappedData != NULL;
+}
+
+//----------------------------------------------------------------------------
+int PlusSequenceFileStreamer::GetNumberOfFrames() const
+{
+  return static_cast<int>(this->Frames.size());
+}
+
+//----------------------------------------------------------------------------
+const FrameSizeType& PlusSequenceFileStreamer::GetFrameSize() const
+{
+  return this->FrameSize;
+}
+
+//----------------------------------------------------------------------------
+igsioCommon::VTKScalarPixelType PlusSequenceFileStreamer::GetPixelType() const
+{
+  return this->PixelType;
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusSequenceFileStreamer::GetNumberOfScalarComponents() const
+{
+  return this->NumberOfScalarComponents;
+}
+
+//----------------------------------------------------------------------------
+US_IMAGE_TYPE PlusSequenceFileStreamer::GetImageType() const
+{
+  return this->ImageType;
+}
+
+//----------------------------------------------------------------------------
+US_IMAGE_ORIENTATION PlusSequenceFileStreamer::GetImageOrientation() const
+{
+  return this->ImageOrientation;
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusSequenceFileStreamer::GetFrameSizeInBytes() const
+{
+  return this->FrameSizeInBytes;
+}
+
+//----------------------------------------------------------------------------
+double PlusSequenceFileStreamer::GetFrameTimestamp(int frameIndex) const
+{
+  return this->Frames[frameIndex].Timestamp;
+}
+
+//----------------------------------------------------------------------------
+int PlusSequenceFileStreamer::GetFrameIndexFromTime(double timestamp) const
+{
+  if (this->Frames.empty())
+  {
+    return -1;
+  }
+  int low = 0;
+  int high = static_cast<int>(this->Frames.size()) - 1;
+  if (timestamp <= this->Frames[low].Timestamp)
+  {
+    return low;
+  }
+  if (timestamp >= this->Frames[high].Timestamp)
+  {
+    return high;
+  }
+  // Binary search for the last frame that is not newer than the timestamp
+  while (high - low > 1)
+  {
+    int middle = (low + high) / 2;
+    if (this->Frames[middle].Timestamp <= timestamp)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  return (timestamp - this->Frames[low].Timestamp <= this->Frames[high].Timestamp - timestamp) ? low : high;
+}
+
+//----------------------------------------------------------------------------
+const igsioFieldMapType& PlusSequenceFileStreamer::GetFrameCustomFields(int frameIndex) const
+{
+  return this->Frames[frameIndex].CustomFields;
+}
+
+//----------------------------------------------------------------------------
+const unsigned char* PlusSequenceFileStreamer::GetFramePixelData(int frameIndex) const
+{
+  if (this->MappedData == NULL || frameIndex < 0 || frameIndex >= static_cast<int>(this->Frames.size()))
+  {
+    return NULL;
+  }
+  return this->MappedData + this->Frames[frameIndex].Offset;
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::SetReplayPosition(int nextFrameIndex, int firstFrameIndex, int lastFrameIndex, bool repeat)
+{
+  std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+  if (this->NextFrameIndex == nextFrameIndex && this->FirstFrameIndex == firstFrameIndex
+      && this->LastFrameIndex == lastFrameIndex && this->Repeat == repeat)
+  {
+    return;
+  }
+  this->NextFrameIndex = nextFrameIndex;
+  this->FirstFrameIndex = firstFrameIndex;
+  this->LastFrameIndex = lastFrameIndex;
+  this->Repeat = repeat;
+  this->PrefetchRequested = true;
+  this->PrefetchPositionChanged.notify_one();
+}
+
+//----------------------------------------------------------------------------
+int PlusSequenceFileStreamer::GetNumberOfPrefetchedFrames() const
+{
+  std::lock_guard<std::mutex> lock(this->PrefetchMutex);
+  return static_cast<int>(this->PrefetchedFrames.size());
+}
+
+//----------------------------------------------------------------------------
+bool PlusSequenceFileStreamer::IsIndexReadFromCache() const
+{
+  return this->IndexReadFromCache;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSequenceFileStreamer::ReadIndexFromHeader(const std::string& sequenceFilePath)
+{
+  std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(sequenceFilePath));
+  bool isNrrd = (extension == ".nrrd" || extension == ".nhdr");
+  bool isMetaImage = (extension == ".mha" || extension == ".mhd");
+  if (!isNrrd && !isMetaImage)
+  {
+    LOG_INFO("Streaming is only supported for MetaImage and NRRD sequence files: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+
+  std::ifstream file(sequenceFilePath.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+  {
+    LOG_INFO("Failed to open sequence file: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+
+  std::map<std::string, std::string> imageFields;
+  std::vector<igsioFieldMapType> frameFields;
+  std::string dataFileName;
+  bool headerComplete = false;
+  bool firstLine = true;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (!line.empty() && line[line.size() - 1] == '\r')
+    {
+      line.erase(line.size() - 1);
+    }
+    std::string name;
+    std::string value;
+    if (isNrrd)
+    {
+      if (firstLine)
+      {
+        firstLine = false;
+        if (line.compare(0, 4, "NRRD") != 0)
+        {
+          LOG_INFO("Invalid NRRD file: " << sequenceFilePath);
+          return PLUS_FAIL;
+        }
+        continue;
+      }
+      if (line.empty())
+      {
+        // An empty line separates the header from the data
+        headerComplete = true;
+        break;
+      }
+      if (line[0] == '#')
+      {
+        continue;
+      }
+      // Key/value pairs are separated by ":=", fields by ": "
+      size_t separatorPos = line.find(":=");
+      size_t separatorLength = 2;
+      if (separatorPos == std::string::npos)
+      {
+        separatorPos = line.find(": ");
+      }
+      if (separatorPos == std::string::npos)
+      {
+        continue;
+      }
+      name = igsioCommon::Trim(line.substr(0, separatorPos));
+      value = igsioCommon::Trim(line.substr(separatorPos + separatorLength));
+      if (name == "data file" || name == "datafile")
+      {
+        dataFileName = value;
+      }
+    }
+    else
+    {
+      size_t separatorPos = line.find('=');
+      if (separatorPos == std::string::npos)
+      {
+        continue;
+      }
+      name = igsioCommon::Trim(line.substr(0, separatorPos));
+      value = igsioCommon::Trim(line.substr(separatorPos + 1));
+      if (name == "ElementDataFile")
+      {
+        // ElementDataFile is the last field of the header
+        if (value != "LOCAL")
+        {
+          dataFileName = value;
+        }
+        headerComplete = true;
+        break;
+      }
+    }
+    AddHeaderField(name, value, imageFields, frameFields);
+  }
+
+  // A detached NRRD header may end without an empty line
+  if (!headerComplete && !(isNrrd && !dataFileName.empty()))
+  {
+    LOG_INFO("Incomplete sequence file header: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+
+  unsigned long long dataOffset = 0;
+  if (dataFileName.empty())
+  {
+    std::streamoff headerEnd = file.tellg();
+    if (headerEnd < 0)
+    {
+      LOG_INFO("No image data is found in sequence file: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    dataOffset = static_cast<unsigned long long>(headerEnd);
+    this->DataFilePath = sequenceFilePath;
+  }
+  else
+  {
+    if (dataFileName == "LIST" || dataFileName.find('%') != std::string::npos || dataFileName.find(' ') != std::string::npos)
+    {
+      LOG_INFO("Streaming of image data stored in multiple files is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    this->DataFilePath = vtksys::SystemTools::CollapseFullPath(dataFileName, vtksys::SystemTools::GetFilenamePath(sequenceFilePath));
+  }
+  file.close();
+
+  // Image properties
+  std::vector<unsigned int> frameDimensions;
+  int numberOfFramesInFile = 1;
+  this->NumberOfScalarComponents = 1;
+  bool bigEndian = false;
+  if (isMetaImage)
+  {
+    if (igsioCommon::IsEqualInsensitive(GetField(imageFields, "CompressedData"), "True"))
+    {
+      LOG_INFO("Streaming of compressed image data is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    if (igsioCommon::IsEqualInsensitive(GetField(imageFields, "BinaryData"), "False"))
+    {
+      LOG_INFO("Streaming of ASCII image data is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    std::string headerSize = GetField(imageFields, "HeaderSize");
+    if (!headerSize.empty() && headerSize != "0")
+    {
+      LOG_INFO("Streaming of image data files with HeaderSize is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    bigEndian = igsioCommon::IsEqualInsensitive(GetField(imageFields, "BinaryDataByteOrderMSB"), "True")
+                || igsioCommon::IsEqualInsensitive(GetField(imageFields, "ElementByteOrderMSB"), "True");
+    this->PixelType = GetPixelTypeFromMetaImageElementType(GetField(imageFields, "ElementType"));
+    std::string numberOfChannels = GetField(imageFields, "ElementNumberOfChannels");
+    if (!numberOfChannels.empty() && igsioCommon::StringToNumber<unsigned int>(numberOfChannels, this->NumberOfScalarComponents) != PLUS_SUCCESS)
+    {
+      LOG_INFO("Invalid ElementNumberOfChannels in sequence file: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    std::vector<std::string> dimSize = SplitBySpaces(GetField(imageFields, "DimSize"));
+    for (std::vector<std::string>::iterator dimIt = dimSize.begin(); dimIt != dimSize.end(); ++dimIt)
+    {
+      unsigned int dimension = 0;
+      if (igsioCommon::StringToNumber<unsigned int>(*dimIt, dimension) != PLUS_SUCCESS)
+      {
+        LOG_INFO("Invalid DimSize in sequence file: " << sequenceFilePath);
+        return PLUS_FAIL;
+      }
+      frameDimensions.push_back(dimension);
+    }
+    // The last dimension is the frame index (a 2D image contains a single frame), unless the kinds specify otherwise
+    std::vector<std::string> kinds = SplitBySpaces(GetField(imageFields, "Kinds"));
+    bool lastAxisIsFrameIndex = (kinds.size() == frameDimensions.size()) ? (kinds.back() == "list" || kinds.back() == "time") : (frameDimensions.size() >= 3);
+    if (lastAxisIsFrameIndex)
+    {
+      numberOfFramesInFile = frameDimensions.back();
+      frameDimensions.pop_back();
+    }
+  }
+  else
+  {
+    if (GetField(imageFields, "encoding") != "raw")
+    {
+      LOG_INFO("Streaming of " << GetField(imageFields, "encoding") << " encoded image data is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    std::string byteSkip = GetField(imageFields, "byte skip");
+    std::string lineSkip = GetField(imageFields, "line skip");
+    if ((!byteSkip.empty() && byteSkip != "0") || (!lineSkip.empty() && lineSkip != "0"))
+    {
+      LOG_INFO("Streaming of NRRD files with byte or line skip is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    bigEndian = (GetField(imageFields, "endian") == "big");
+    this->PixelType = GetPixelTypeFromNrrdType(GetField(imageFields, "type"));
+    std::vector<std::string> sizes = SplitBySpaces(GetField(imageFields, "sizes"));
+    std::vector<std::string> kinds = SplitBySpaces(GetField(imageFields, "kinds"));
+    if (kinds.size() != sizes.size())
+    {
+      LOG_INFO("Streaming of NRRD files without kinds of all axes is not supported: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    for (size_t axis = 0; axis < sizes.size(); ++axis)
+    {
+      unsigned int size = 0;
+      if (igsioCommon::StringToNumber<unsigned int>(sizes[axis], size) != PLUS_SUCCESS)
+      {
+        LOG_INFO("Invalid sizes in sequence file: " << sequenceFilePath);
+        return PLUS_FAIL;
+      }
+      if (kinds[axis] == "domain" || kinds[axis] == "space")
+      {
+        frameDimensions.push_back(size);
+      }
+      else if (axis == 0)
+      {
+        // the fastest axis that is not spatial contains the scalar components
+        this->NumberOfScalarComponents = size;
+      }
+      else if (axis == sizes.size() - 1 && (kinds[axis] == "list" || kinds[axis] == "time"))
+      {
+        numberOfFramesInFile = size;
+      }
+      else
+      {
+        LOG_INFO("Unsupported axis kind " << kinds[axis] << " in sequence file: " << sequenceFilePath);
+        return PLUS_FAIL;
+      }
+    }
+  }
+
+  if (this->PixelType == VTK_VOID)
+  {
+    LOG_INFO("Unsupported pixel type in sequence file: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+  unsigned int bytesPerScalar = igsioVideoFrame::GetNumberOfBytesPerScalar(this->PixelType);
+  if (bigEndian && bytesPerScalar > 1)
+  {
+    LOG_INFO("Streaming of big endian image data is not supported: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+  if (frameDimensions.size() < 2 || frameDimensions.size() > 3 || this->NumberOfScalarComponents < 1)
+  {
+    LOG_INFO("Unsupported image dimensions in sequence file: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+  this->FrameSize[0] = frameDimensions[0];
+  this->FrameSize[1] = frameDimensions[1];
+  this->FrameSize[2] = (frameDimensions.size() > 2 ? frameDimensions[2] : 1);
+  unsigned long long frameSizeInBytes = static_cast<unsigned long long>(this->FrameSize[0]) * this->FrameSize[1] * this->FrameSize[2]
+                                        * this->NumberOfScalarComponents * bytesPerScalar;
+  if (frameSizeInBytes == 0 || frameSizeInBytes > std::numeric_limits<unsigned int>::max())
+  {
+    LOG_INFO("Unsupported frame size in sequence file: " << sequenceFilePath);
+    return PLUS_FAIL;
+  }
+  this->FrameSizeInBytes = static_cast<unsigned int>(frameSizeInBytes);
+
+  std::string imageType = GetField(imageFields, "UltrasoundImageType");
+  this->ImageType = imageType.empty() ? US_IMG_BRIGHTNESS : igsioCommon::GetUsImageTypeFromString(imageType);
+  std::string imageOrientation = GetField(imageFields, "UltrasoundImageOrientation");
+  this->ImageOrientation = imageOrientation.empty() ? US_IMG_ORIENT_MF : igsioCommon::GetUsImageOrientationFromString(imageOrientation.c_str());
+
+  // Frame index
+  this->Frames.clear();
+  this->Frames.reserve(numberOfFramesInFile);
+  int numberOfSkippedFrames = 0;
+  for (int frameIndexInFile = 0; frameIndexInFile < numberOfFramesInFile; ++frameIndexInFile)
+  {
+    FrameInfo frame;
+    frame.Offset = dataOffset + frameIndexInFile * frameSizeInBytes;
+    if (frameIndexInFile < static_cast<int>(frameFields.size()))
+    {
+      frame.CustomFields.swap(frameFields[frameIndexInFile]);
+    }
+
+    igsioFieldMapType::iterator imageStatusIt = frame.CustomFields.find("ImageStatus");
+    if (imageStatusIt != frame.CustomFields.end() && imageStatusIt->second.second != "OK")
+    {
+      // no valid image data in this frame
+      numberOfSkippedFrames++;
+      continue;
+    }
+
+    igsioFieldMapType::iterator timestampIt = frame.CustomFields.find("Timestamp");
+    if (timestampIt == frame.CustomFields.end() || igsioCommon::StringToNumber<double>(timestampIt->second.second, frame.Timestamp) != PLUS_SUCCESS)
+    {
+      LOG_INFO("Missing or invalid timestamp of frame " << frameIndexInFile << " in sequence file: " << sequenceFilePath);
+      return PLUS_FAIL;
+    }
+    if (!this->Frames.empty() && frame.Timestamp <= this->Frames.back().Timestamp)
+    {
+      // the buffer would not accept this frame either
+      numberOfSkippedFrames++;
+      continue;
+    }
+
+    // Special fields are not custom fields
+    frame.CustomFields.erase(timestampIt);
+    frame.CustomFields.erase("UnfilteredTimestamp");
+    frame.CustomFields.erase("FrameNumber");
+    frame.CustomFields.erase("ImageStatus");
+
+    this->Frames.push_back(frame);
+  }
+
+  if (numberOfSkippedFrames > 0)
+  {
+    LOG_INFO(numberOfSkippedFrames << " frames without valid image data or with non-increasing timestamp are not replayed from " << sequenceFilePath);
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSequenceFileStreamer::ReadIndexFromCache(const std::string& sequenceFilePath)
+{
+  std::string cacheFilePath = GetIndexCacheFilePath(sequenceFilePath);
+  if (!vtksys::SystemTools::FileExists(cacheFilePath, true))
+  {
+    return PLUS_FAIL;
+  }
+  std::ifstream cache(cacheFilePath.c_str(), std::ios::in | std::ios::binary);
+  if (!cache.is_open())
+  {
+    return PLUS_FAIL;
+  }
+
+  std::string signature;
+  int version = 0;
+  std::string name;
+  unsigned long long sequenceFileSize = 0;
+  long sequenceFileModifiedTime = 0;
+  cache >> signature >> version;
+  if (signature != INDEX_CACHE_FILE_SIGNATURE || version != INDEX_CACHE_FILE_VERSION)
+  {
+    LOG_DEBUG("Unsupported frame index cache file: " << cacheFilePath);
+    return PLUS_FAIL;
+  }
+  cache >> name >> sequenceFileSize >> name >> sequenceFileModifiedTime;
+  if (!cache || sequenceFileSize != vtksys::SystemTools::FileLength(sequenceFilePath)
+      || sequenceFileModifiedTime != vtksys::SystemTools::ModifiedTime(sequenceFilePath))
+  {
+    LOG_DEBUG("Frame index cache file is outdated: " << cacheFilePath);
+    return PLUS_FAIL;
+  }
+
+  std::string dataFileName;
+  unsigned long long dataFileSize = 0;
+  int pixelType = 0;
+  int imageType = 0;
+  int imageOrientation = 0;
+  size_t numberOfFrames = 0;
+  // The data file name may contain spaces, so it is the rest of the line
+  cache >> name;
+  cache.ignore(1);
+  std::getline(cache, dataFileName);
+  cache >> name >> dataFileSize;
+  cache >> name >> this->FrameSize[0] >> this->FrameSize[1] >> this->FrameSize[2];
+  cache >> name >> pixelType >> name >> this->NumberOfScalarComponents;
+  cache >> name >> imageType >> name >> imageOrientation;
+  cache >> name >> this->FrameSizeInBytes >> name >> numberOfFrames;
+  if (!cache)
+  {
+    LOG_DEBUG("Invalid frame index cache file: " << cacheFilePath);
+    return PLUS_FAIL;
+  }
+  this->DataFilePath = (dataFileName == "LOCAL") ? sequenceFilePath
+                       : vtksys::SystemTools::CollapseFullPath(dataFileName, vtksys::SystemTools::GetFilenamePath(sequenceFilePath));
+  if (dataFileSize != vtksys::SystemTools::FileLength(this->DataFilePath))
+  {
+    LOG_DEBUG("Frame index cache file is outdated: " << cacheFilePath);
+    return PLUS_FAIL;
+  }
+  this->PixelType = static_cast<igsioCommon::VTKScalarPixelType>(pixelType);
+  this->ImageType = static_cast<US_IMAGE_TYPE>(imageType);
+  this->ImageOrientation = static_cast<US_IMAGE_ORIENTATION>(imageOrientation);
+
+  this->Frames.clear();
+  this->Frames.resize(numberOfFrames);
+  for (size_t frameIndex = 0; frameIndex < numberOfFrames; ++frameIndex)
+  {
+    FrameInfo& frame = this->Frames[frameIndex];
+    int numberOfFields = 0;
+    cache >> frame.Offset >> frame.Timestamp >> numberOfFields;
+    std::string line;
+    std::getline(cache, line);
+    for (int fieldIndex = 0; fieldIndex < numberOfFields && std::getline(cache, line); ++fieldIndex)
+    {
+      size_t separatorPos = line.find('=');
+      if (separatorPos == std::string::npos)
+      {
+        cache.setstate(std::ios::failbit);
+        break;
+      }
+      frame.CustomFields[line.substr(0, separatorPos)] = std::make_pair(FRAMEFIELD_NONE, line.substr(separatorPos + 1));
+    }
+    if (!cache)
+    {
+      LOG_DEBUG("Invalid frame index cache file: " << cacheFilePath);
+      this->Frames.clear();
+      return PLUS_FAIL;
+    }
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSequenceFileStreamer::WriteIndexToCache(const std::string& sequenceFilePath) const
+{
+  std::string cacheFilePath = GetIndexCacheFilePath(sequenceFilePath);
+  std::ofstream cache(cacheFilePath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!cache.is_open())
+  {
+    return PLUS_FAIL;
+  }
+
+  std::string dataFileName = "LOCAL";
+  if (this->DataFilePath != sequenceFilePath)
+  {
+    dataFileName = vtksys::SystemTools::RelativePath(vtksys::SystemTools::GetFilenamePath(sequenceFilePath), this->DataFilePath);
+  }
+
+  cache << INDEX_CACHE_FILE_SIGNATURE << " " << INDEX_CACHE_FILE_VERSION << "\n";
+  cache << "SequenceFileSize " << static_cast<unsigned long long>(vtksys::SystemTools::FileLength(sequenceFilePath)) << "\n";
+  cache << "SequenceFileModifiedTime " << vtksys::SystemTools::ModifiedTime(sequenceFilePath) << "\n";
+  cache << "DataFile " << dataFileName << "\n";
+  cache << "DataFileSize " << static_cast<unsigned long long>(vtksys::SystemTools::FileLength(this->DataFilePath)) << "\n";
+  cache << "FrameSize " << this->FrameSize[0] << " " << this->FrameSize[1] << " " << this->FrameSize[2] << "\n";
+  cache << "PixelType " << this->PixelType << "\n";
+  cache << "NumberOfScalarComponents " << this->NumberOfScalarComponents << "\n";
+  cache << "ImageType " << this->ImageType << "\n";
+  cache << "ImageOrientation " << this->ImageOrientation << "\n";
+  cache << "FrameSizeInBytes " << this->FrameSizeInBytes << "\n";
+  cache << "NumberOfFrames " << this->Frames.size() << "\n";
+  cache << std::setprecision(std::numeric_limits<double>::digits10 + 2);
+  for (std::vector<FrameInfo>::const_iterator frameIt = this->Frames.begin(); frameIt != this->Frames.end(); ++frameIt)
+  {
+    cache << frameIt->Offset << " " << frameIt->Timestamp << " " << frameIt->CustomFields.size() << "\n";
+    for (igsioFieldMapType::const_iterator fieldIt = frameIt->CustomFields.begin(); fieldIt != frameIt->CustomFields.end(); ++fieldIt)
+    {
+      cache << fieldIt->first << "=" << fieldIt->second.second << "\n";
+    }
+  }
+
+  cache.close();
+  if (!cache)
+  {
+    vtksys::SystemTools::RemoveFile(cacheFilePath);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSequenceFileStreamer::MapDataFile()
+{
+  this->UnmapDataFile();
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(this->DataFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fileHandle == INVALID_HANDLE_VALUE)
+  {
+    LOG_INFO("Failed to open image data file for memory mapping: " << this->DataFilePath);
+    return PLUS_FAIL;
+  }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0 || static_cast<unsigned long long>(fileSize.QuadPart) > std::numeric_limits<SIZE_T>::max())
+  {
+    LOG_INFO("Image data file cannot be memory mapped: " << this->DataFilePath);
+    CloseHandle(fileHandle);
+    return PLUS_FAIL;
+  }
+  HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+  void* data = (mappingHandle != NULL) ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (data == NULL)
+  {
+    LOG_INFO("Failed to memory map image data file: " << this->DataFilePath << " (error code: " << GetLastError() << ")");
+    if (mappingHandle != NULL)
+    {
+      CloseHandle(mappingHandle);
+    }
+    CloseHandle(fileHandle);
+    return PLUS_FAIL;
+  }
+  this->FileHandle = fileHandle;
+  this->FileMappingHandle = mappingHandle;
+  this->MappedDataSize = static_cast<unsigned long long>(fileSize.QuadPart);
+#else
+  int fileDescriptor = open(this->DataFilePath.c_str(), O_RDONLY);
+  if (fileDescriptor < 0)
+  {
+    LOG_INFO("Failed to open image data file for memory mapping: " << this->DataFilePath);
+    return PLUS_FAIL;
+  }
+  struct stat fileStatus;
+  if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size <= 0
+      || static_cast<unsigned long long>(fileStatus.st_size) > std::numeric_limits<size_t>::max())
+  {
+    LOG_INFO("Image data file cannot be memory mapped: " << this->DataFilePath);
+    close(fileDescriptor);
+    return PLUS_FAIL;
+  }
+  void* data = mmap(NULL, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+  if (data == MAP_FAILED)
+  {
+    LOG_INFO("Failed to memory map image data file: " << this->DataFilePath << " (" << strerror(errno) << ")");
+    close(fileDescriptor);
+    return PLUS_FAIL;
+  }
+  this->FileDescriptor = fileDescriptor;
+  this->MappedDataSize = static_cast<unsigned long long>(fileStatus.st_size);
+#endif
+  this->MappedData = static_cast<unsigned char*>(data);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::UnmapDataFile()
+{
+#ifdef _WIN32
+  if (this->MappedData != NULL)
+  {
+    UnmapViewOfFile(this->MappedData);
+  }
+  if (this->FileMappingHandle != NULL)
+  {
+    CloseHandle(this->FileMappingHandle);
+    this->FileMappingHandle = NULL;
+  }
+  if (this->FileHandle != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(this->FileHandle);
+    this->FileHandle = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (this->MappedData != NULL)
+  {
+    munmap(this->MappedData, static_cast<size_t>(this->MappedDataSize));
+  }
+  if (this->FileDescriptor >= 0)
+  {
+    close(this->FileDescriptor);
+    this->FileDescriptor = -1;
+  }
+#endif
+  this->MappedData = NULL;
+  this->MappedDataSize = 0;
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::GetPrefetchWindow(std::vector<int>& frameIndices)
+{
+  frameIndices.clear();
+  int numberOfFrames = static_cast<int>(this->Frames.size());
+  int firstFrameIndex = std::max(0, this->FirstFrameIndex);
+  int lastFrameIndex = std::min(numberOfFrames - 1, this->LastFrameIndex);
+  if (firstFrameIndex > lastFrameIndex)
+  {
+    return;
+  }
+  int frameIndex = this->NextFrameIndex;
+  if (frameIndex < firstFrameIndex || frameIndex > lastFrameIndex)
+  {
+    frameIndex = firstFrameIndex;
+  }
+  int windowSize = std::min(this->PrefetchWindowFrames, lastFrameIndex - firstFrameIndex + 1);
+  for (int i = 0; i < windowSize; ++i)
+  {
+    frameIndices.push_back(frameIndex);
+    frameIndex++;
+    if (frameIndex > lastFrameIndex)
+    {
+      if (!this->Repeat)
+      {
+        break;
+      }
+      frameIndex = firstFrameIndex;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::PrefetchThreadMain()
+{
+  std::vector<int> window;
+  std::vector<int> framesToPrefetch;
+  std::vector<int> framesToRelease;
+  std::unique_lock<std::mutex> lock(this->PrefetchMutex);
+  while (true)
+  {
+    this->PrefetchPositionChanged.wait(lock, [this] { return this->PrefetchThreadStopRequested || this->PrefetchRequested; });
+    if (this->PrefetchThreadStopRequested)
+    {
+      break;
+    }
+    this->PrefetchRequested = false;
+
+    this->GetPrefetchWindow(window);
+    framesToPrefetch.clear();
+    for (std::vector<int>::iterator frameIt = window.begin(); frameIt != window.end(); ++frameIt)
+    {
+      if (this->PrefetchedFrames.find(*frameIt) == this->PrefetchedFrames.end())
+      {
+        framesToPrefetch.push_back(*frameIt);
+      }
+    }
+    framesToRelease.clear();
+    for (std::set<int>::iterator frameIt = this->PrefetchedFrames.begin(); frameIt != this->PrefetchedFrames.end(); ++frameIt)
+    {
+      if (std::find(window.begin(), window.end(), *frameIt) == window.end())
+      {
+        framesToRelease.push_back(*frameIt);
+      }
+    }
+
+    // Access the file without holding the lock, so the replay position can be updated meanwhile
+    lock.unlock();
+    for (std::vector<int>::iterator frameIt = framesToRelease.begin(); frameIt != framesToRelease.end(); ++frameIt)
+    {
+      this->ReleaseFrame(*frameIt);
+    }
+    // The window is ordered by replay time, so the frame that is needed first is read first
+    for (std::vector<int>::iterator frameIt = framesToPrefetch.begin(); frameIt != framesToPrefetch.end(); ++frameIt)
+    {
+      this->PrefetchFrame(*frameIt);
+    }
+    lock.lock();
+
+    for (std::vector<int>::iterator frameIt = framesToRelease.begin(); frameIt != framesToRelease.end(); ++frameIt)
+    {
+      this->PrefetchedFrames.erase(*frameIt);
+    }
+    this->PrefetchedFrames.insert(framesToPrefetch.begin(), framesToPrefetch.end());
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::PrefetchFrame(int frameIndex)
+{
+  const unsigned char* frameData = this->MappedData + this->Frames[frameIndex].Offset;
+#ifndef _WIN32
+  size_t pageOffset = reinterpret_cast<size_t>(frameData) % this->PageSize;
+  madvise(const_cast<unsigned char*>(frameData - pageOffset), this->FrameSizeInBytes + pageOffset, MADV_WILLNEED);
+#endif
+  // Read one byte from each page to make sure that the data is in memory when the frame is replayed
+  volatile unsigned char value = 0;
+  for (size_t position = 0; position < this->FrameSizeInBytes; position += this->PageSize)
+  {
+    value = frameData[position];
+  }
+  value = frameData[this->FrameSizeInBytes - 1];
+  (void)value;
+}
+
+//----------------------------------------------------------------------------
+void PlusSequenceFileStreamer::ReleaseFrame(int frameIndex)
+{
+  // Only release pages that do not contain data of the neighbor frames
+  size_t frameStart = reinterpret_cast<size_t>(this->MappedData + this->Frames[frameIndex].Offset);
+  size_t frameEnd = frameStart + this->FrameSizeInBytes;
+  size_t releaseStart = ((frameStart + this->PageSize - 1) / this->PageSize) * this->PageSize;
+  size_t releaseEnd = (frameEnd / this->PageSize) * this->PageSize;
+  if (releaseEnd <= releaseStart)
+  {
+    return;
+  }
+#ifdef _WIN32
+  // Unlocking pages that are not locked removes them from the working set of the process
+  VirtualUnlock(reinterpret_cast<void*>(releaseStart), releaseEnd - releaseStart);
+#else
+  madvise(reinterpret_cast<void*>(releaseStart), releaseEnd - releaseStart, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,174 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusSequenceFileStreamer_h
+#define __PlusSequenceFileStreamer_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusDataCollectionExport.h"
+
+// IGSIO includes
+#include <igsioCommon.h>
+
+// STL includes
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+  \class PlusSequenceFileStreamer
+  \brief Provides random access to the frames of an uncompressed sequence file without loading the whole file into memory
+
+  The header of the sequence file (.mha, .mhd, .nrrd, .nhdr) is parsed once to build an index of the frames
+  (position of the pixel data in the file, timestamp and custom frame fields). The index can be cached in a
+  small file next to the sequence file (see GetIndexCacheFilePath), so that the header of large files does not have to be
+  parsed again on the next connect. The cache is ignored if the sequence file has been modified since the cache was written.
+
+  The pixel data is memory-mapped. A background thread keeps the pages of a window of frames ahead of the replay
+  position in memory (and releases pages of frames that have been replayed already), so that reading a frame
+  does not have to wait for the disk and the memory usage does not depend on the length of the sequence.
+
+  Only uncompressed, little endian image data is supported. Open fails for other files, in this case the
+  caller should read the file using vtkIGSIOSequenceIO instead.
+
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport PlusSequenceFileStreamer
+{
+public:
+  PlusSequenceFileStreamer();
+  virtual ~PlusSequenceFileStreamer();
+
+  /*! Number of frames that are kept in memory ahead of the replay position */
+  void SetPrefetchWindowFrames(int numberOfFrames);
+  int GetPrefetchWindowFrames() const;
+
+  /*! If enabled then the frame index is read from and written to a cache file next to the sequence file */
+  void SetIndexCacheEnabled(bool enabled);
+  bool GetIndexCacheEnabled() const;
+
+  /*!
+    Build (or read from the cache) the frame index, map the pixel data into memory and start the prefetch thread.
+    Returns PLUS_FAIL if the file cannot be streamed (e.g., compressed image data), without logging an error.
+  */
+  PlusStatus Open(const std::string& sequenceFilePath);
+
+  /*! Stop the prefetch thread and unmap the file */
+  void Close();
+
+  bool IsOpen() const;
+
+  /*! Number of valid frames in the file. Frames without image data or with non-increasing timestamp are not included. */
+  int GetNumberOfFrames() const;
+
+  const FrameSizeType& GetFrameSize() const;
+  igsioCommon::VTKScalarPixelType GetPixelType() const;
+  unsigned int GetNumberOfScalarComponents() const;
+  US_IMAGE_TYPE GetImageType() const;
+  /*! Orientation of the image data in the file */
+  US_IMAGE_ORIENTATION GetImageOrientation() const;
+  unsigned int GetFrameSizeInBytes() const;
+
+  /*! Recorded timestamp of the frame */
+  double GetFrameTimestamp(int frameIndex) const;
+
+  /*! Index of the frame that has the timestamp closest to the specified time */
+  int GetFrameIndexFromTime(double timestamp) const;
+
+  /*! Custom fields of the frame (e.g., transforms). Timestamp and frame number fields are not included. */
+  const igsioFieldMapType& GetFrameCustomFields(int frameIndex) const;
+
+  /*!
+    Pointer to the pixel data of the frame in the mapped file. The pointer remains valid until Close() is called.
+    Frames outside of the prefetch window are read from the disk when the data is accessed.
+  */
+  const unsigned char* GetFramePixelData(int frameIndex) const;
+
+  /*!
+    Inform the prefetch thread about the next frame that will be replayed and the replayed range of frames.
+    If repeat is enabled then the prefetch window continues from the first frame of the range when the end of the range is reached.
+  */
+  void SetReplayPosition(int nextFrameIndex, int firstFrameIndex, int lastFrameIndex, bool repeat);
+
+  /*! Number of frames that the prefetch thread currently keeps in memory */
+  int GetNumberOfPrefetchedFrames() const;
+
+  /*! Returns true if the frame index was read from the cache file in the last Open call */
+  bool IsIndexReadFromCache() const;
+
+  /*! Path of the index cache file that belongs to the sequence file */
+  static std::string GetIndexCacheFilePath(const std::string& sequenceFilePath);
+
+protected:
+  struct FrameInfo
+  {
+    /*! Position of the pixel data in the data file */
+    unsigned long long Offset;
+    double Timestamp;
+    igsioFieldMapType CustomFields;
+  };
+
+  /*! Parse the header of a MetaImage or NRRD file and build the frame index */
+  PlusStatus ReadIndexFromHeader(const std::string& sequenceFilePath);
+
+  PlusStatus ReadIndexFromCache(const std::string& sequenceFilePath);
+  PlusStatus WriteIndexToCache(const std::string& sequenceFilePath) const;
+
+  PlusStatus MapDataFile();
+  void UnmapDataFile();
+
+  void PrefetchThreadMain();
+  /*! Compute the frames that should be in memory for the current replay position */
+  void GetPrefetchWindow(std::vector<int>& frameIndices);
+  void PrefetchFrame(int frameIndex);
+  void ReleaseFrame(int frameIndex);
+
+  int PrefetchWindowFrames;
+  bool IndexCacheEnabled;
+  bool IndexReadFromCache;
+
+  /*! File that contains the pixel data (the sequence file itself if the data is not stored in a separate file) */
+  std::string DataFilePath;
+  FrameSizeType FrameSize;
+  igsioCommon::VTKScalarPixelType PixelType;
+  unsigned int NumberOfScalarComponents;
+  US_IMAGE_TYPE ImageType;
+  US_IMAGE_ORIENTATION ImageOrientation;
+  unsigned int FrameSizeInBytes;
+  std::vector<FrameInfo> Frames;
+
+  /*! Memory-mapped data file */
+  unsigned char* MappedData;
+  unsigned long long MappedDataSize;
+#ifdef _WIN32
+  void* FileHandle;
+  void* FileMappingHandle;
+#else
+  int FileDescriptor;
+#endif
+  size_t PageSize;
+
+  /*! Protects the replay position and the set of prefetched frames */
+  mutable std::mutex PrefetchMutex;
+  std::condition_variable PrefetchPositionChanged;
+  std::thread PrefetchThread;
+  bool PrefetchThreadStopRequested;
+  bool PrefetchRequested;
+  int NextFrameIndex;
+  int FirstFrameIndex;
+  int LastFrameIndex;
+  bool Repeat;
+  std::set<int> PrefetchedFrames;
+
+private:
+  PlusSequenceFileStreamer(const PlusSequenceFileStreamer&);
+  void operator=(const PlusSequenceFileStreamer&);
+};
+
+#endif
@@ -5,6 +5,7 @@ See License.txt for details.
 =========================================================Plus=header=end*/
 
 #include "PlusConfigure.h"
+#include "PlusSequenceFileStreamer.h"
 #include "vtkImageData.h"
 #include "vtkMatrix4x4.h"
 #include "vtkIGSIOSequenceIO.h"
@@ -28,6 +29,10 @@ vtkPlusSavedDataSource::vtkPlusSavedDataSource()
   , LocalVideoBuffer(NULL)
   , UseAllFrameFields(false)
   , UseOriginalTimestamps(false)
+  , EnableStreamingReplay(false)
+  , StreamingReplayPrefetchFrames(30)
+  , StreamingReplayIndexCacheEnabled(true)
+  , Streamer(NULL)
   , LastAddedFrameUid(0)
   , LastAddedLoopIndex(0)
   , SimulatedStream(VIDEO_STREAM)
@@ -69,6 +74,12 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdate()
     frameToBeAddedUid -= numberOfFramesInTheLoop;
   }
 
+  if (this->Streamer != NULL)
+  {
+    // Keep the frames that will be replayed next in memory
+    this->Streamer->SetReplayPosition(frameToBeAddedUid - 1, this->LoopFirstFrameUid - 1, this->LoopLastFrameUid - 1, this->RepeatEnabled);
+  }
+
   PlusStatus status = PLUS_FAIL;
   if (this->UseOriginalTimestamps)
   {
@@ -108,8 +119,9 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
     {
       currentLoopIndex = floor(elapsedTime / loopTime);
       currentFrameTime_Local = this->LoopStartTime_Local + elapsedTime - loopTime * currentLoopIndex;
+      double oldestTimestamp_Local = 0;
       double latestTimestamp_Local = 0;
-      GetLocalBuffer()->GetLatestTimeStamp(latestTimestamp_Local);
+      this->GetReplayTimeRange(oldestTimestamp_Local, latestTimestamp_Local);
       if (currentFrameTime_Local > latestTimestamp_Local)
       {
         // hold the last frame after the end of the buffer
@@ -119,10 +131,9 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
     }
 
     // Get the uid of the frame that has been most recently acquired
-    BufferItemUidType closestFrameUid = 0;
-    GetLocalBuffer()->GetItemUidFromTime(currentFrameTime_Local, closestFrameUid);
+    BufferItemUidType closestFrameUid = this->GetReplayFrameUidFromTime(currentFrameTime_Local);
     double closestFrameTime_Local = 0;
-    GetLocalBuffer()->GetTimeStamp(closestFrameUid, closestFrameTime_Local);
+    this->GetReplayFrameTimestamp(closestFrameUid, closestFrameTime_Local);
     if (closestFrameTime_Local > currentFrameTime_Local)
     {
       // the closest frame is newer than the current time, so don't use this item but the one before
@@ -156,8 +167,9 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
     // TODO: use the UID difference as increment
     this->FrameNumber++;
 
-    StreamBufferItem dataBufferItemToBeAdded;
-    if (GetLocalBuffer()->GetStreamBufferItem(frameToBeAddedUid, &dataBufferItemToBeAdded) != ITEM_OK)
+    // Get the filtered timestamp without any local time offset. Offset will be applied when it is copied to the output stream's buffer.
+    double frameToBeAddedTimestamp_Local = 0;
+    if (this->GetReplayFrameTimestamp(frameToBeAddedUid, frameToBeAddedTimestamp_Local) != PLUS_SUCCESS)
     {
       LOG_ERROR("vtkPlusSavedDataSource: Failed to retrieve item from the buffer, UID=" << frameToBeAddedUid);
       status = PLUS_FAIL;
@@ -165,8 +177,7 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
     }
 
     // Compute the system time corresponding to this frame
-    // Get the filtered timestamp from the buffer without any local time offset. Offset will be applied when it is copied to the output stream's buffer.
-    double filteredTimestamp = dataBufferItemToBeAdded.GetFilteredTimestamp(0.0) + frameToBeAddedLoopIndex * loopTime -
+    double filteredTimestamp = frameToBeAddedTimestamp_Local + frameToBeAddedLoopIndex * loopTime -
                                this->LoopStartTime_Local + this->GetOutputDataSource()->GetStartTime();
     double unfilteredTimestamp = filteredTimestamp; // we ignore unfiltered timestamps
 
@@ -174,12 +185,7 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
     {
       case VIDEO_STREAM:
         {
-          igsioFieldMapType fieldMap;
-          if (this->UseAllFrameFields)
-          {
-            fieldMap = dataBufferItemToBeAdded.GetFrameFieldMap();
-          }
-          if (this->AddVideoItemToVideoSources(this->GetVideoSources(), dataBufferItemToBeAdded.GetFrame(), this->FrameNumber, unfilteredTimestamp, filteredTimestamp, &fieldMap) != PLUS_SUCCESS)
+          if (this->AddReplayFrameToVideoSources(frameToBeAddedUid, unfilteredTimestamp, filteredTimestamp) != PLUS_SUCCESS)
           {
             status = PLUS_FAIL;
           }
@@ -188,7 +194,7 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
       case TRACKER_STREAM:
         {
           // retrieve timestamp from the first active tool and add all the tool matrices corresponding to that timestamp
-          double nextFrameTimestamp = dataBufferItemToBeAdded.GetFilteredTimestamp(0.0);
+          double nextFrameTimestamp = frameToBeAddedTimestamp_Local;
 
           for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
           {
@@ -263,8 +269,8 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateCurrentTimestamp(BufferItemUidT
   }
 
   this->FrameNumber++;
-  StreamBufferItem dataBufferItemToBeAdded;
-  if (GetLocalBuffer()->GetStreamBufferItem(frameToBeAddedUid, &dataBufferItemToBeAdded) != ITEM_OK)
+  double frameToBeAddedTimestamp_Local = 0;
+  if (this->GetReplayFrameTimestamp(frameToBeAddedUid, frameToBeAddedTimestamp_Local) != PLUS_SUCCESS)
   {
     LOG_ERROR("vtkPlusSavedDataSource: Failed to retrieve item from the buffer, UID=" << frameToBeAddedUid);
     return PLUS_FAIL;
@@ -275,14 +281,9 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateCurrentTimestamp(BufferItemUidT
   {
     case VIDEO_STREAM:
       {
-        igsioFieldMapType fieldMap;
-        if (this->UseAllFrameFields)
-        {
-          fieldMap = dataBufferItemToBeAdded.GetFrameFieldMap();
-        }
-        if (this->AddVideoItemToVideoSources(this->GetVideoSources(), dataBufferItemToBeAdded.GetFrame(), this->FrameNumber, UNDEFINED_TIMESTAMP, UNDEFINED_TIMESTAMP, &fieldMap) != PLUS_SUCCESS)
+        // UNDEFINED_TIMESTAMP => use current timestamp
+        if (this->AddReplayFrameToVideoSources(frameToBeAddedUid, UNDEFINED_TIMESTAMP, UNDEFINED_TIMESTAMP) != PLUS_SUCCESS)
         {
-          // UNDEFINED_TIMESTAMP => use current timestamp
           status = PLUS_FAIL;
         }
         break;
@@ -290,7 +291,7 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateCurrentTimestamp(BufferItemUidT
     case TRACKER_STREAM:
       {
         // retrieve timestamp from the first active tool and add all the tool matrices corresponding to that timestamp
-        double nextFrameTimestamp = dataBufferItemToBeAdded.GetTimestamp(0);
+        double nextFrameTimestamp = frameToBeAddedTimestamp_Local;
 
         for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
         {
@@ -380,57 +381,72 @@ PlusStatus vtkPlusSavedDataSource::InternalConnect()
     return PLUS_FAIL;
   }
 
-  vtkSmartPointer<vtkIGSIOTrackedFrameList> savedDataBuffer = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-
-  // Read sequence file into tracked frame list
-  vtkIGSIOSequenceIO::Read(foundAbsoluteImagePath, savedDataBuffer);
-
-  if (savedDataBuffer->GetNumberOfTrackedFrames() < 1)
+  bool streamingReplayActive = false;
+  if (this->EnableStreamingReplay)
   {
-    LOG_ERROR("Failed to connect to saved dataset - there is no frame in the sequence metafile!");
-    return PLUS_FAIL;
+    if (this->SimulatedStream != VIDEO_STREAM)
+    {
+      LOG_WARNING("Streaming replay is only available for image data, the whole sequence file is loaded into memory: " << foundAbsoluteImagePath);
+    }
+    else if (InternalConnectVideoStreaming(foundAbsoluteImagePath) == PLUS_SUCCESS)
+    {
+      streamingReplayActive = true;
+    }
+    else
+    {
+      LOG_WARNING("Streaming replay is not available for this file (see the log for details), the whole sequence file is loaded into memory: " << foundAbsoluteImagePath);
+    }
   }
 
-  PlusStatus status = PLUS_FAIL;
-  switch (this->SimulatedStream)
+  if (!streamingReplayActive)
   {
-    case VIDEO_STREAM:
-      status = InternalConnectVideo(savedDataBuffer);
-      break;
-    case TRACKER_STREAM:
-      status = InternalConnectTracker(savedDataBuffer);
-      break;
-    default:
-      LOG_ERROR("Unknown stream type: " << this->SimulatedStream);
-  }
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> savedDataBuffer = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
 
-  if (status != PLUS_SUCCESS)
-  {
-    return PLUS_FAIL;
+    // Read sequence file into tracked frame list
+    vtkIGSIOSequenceIO::Read(foundAbsoluteImagePath, savedDataBuffer);
+
+    if (savedDataBuffer->GetNumberOfTrackedFrames() < 1)
+    {
+      LOG_ERROR("Failed to connect to saved dataset - there is no frame in the sequence metafile!");
+      return PLUS_FAIL;
+    }
+
+    PlusStatus status = PLUS_FAIL;
+    switch (this->SimulatedStream)
+    {
+      case VIDEO_STREAM:
+        status = InternalConnectVideo(savedDataBuffer);
+        break;
+      case TRACKER_STREAM:
+        status = InternalConnectTracker(savedDataBuffer);
+        break;
+      default:
+        LOG_ERROR("Unknown stream type: " << this->SimulatedStream);
+    }
+
+    if (status != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
   }
 
-  if (GetLocalBuffer() == NULL)
+  // Set the default loop start time and length to match the video buffer start time and length
+
+  double oldestTimestamp_Local = 0;
+  double latestTimestamp_Local = 0;
+  if (this->GetReplayFrameUidRange(this->LoopFirstFrameUid, this->LoopLastFrameUid) != PLUS_SUCCESS
+      || this->GetReplayTimeRange(oldestTimestamp_Local, latestTimestamp_Local) != PLUS_SUCCESS)
   {
     LOG_ERROR("Local buffer is invalid");
     return PLUS_FAIL;
   }
 
-  double oldestTimestamp_Local = 0;
-  GetLocalBuffer()->GetOldestTimeStamp(oldestTimestamp_Local);
-  double latestTimestamp_Local = 0;
-  GetLocalBuffer()->GetLatestTimeStamp(latestTimestamp_Local);
-
-  // Set the default loop start time and length to match the video buffer start time and length
-
-  this->LoopFirstFrameUid = GetLocalBuffer()->GetOldestItemUidInBuffer();
-  this->LoopLastFrameUid = GetLocalBuffer()->GetLatestItemUidInBuffer();
-
   this->LoopStartTime_Local = oldestTimestamp_Local;
 
   // When we reach the last frame we have to wait one frame period before
   // playing the first frame, so we have to add one frame period to the loop length (loopTime)
   double framePeriodSec = 0;
-  double frameRate = GetLocalBuffer()->GetFrameRate();
+  double frameRate = this->GetReplayFrameRate();
   if (frameRate != 0.0)
   {
     framePeriodSec = 1.0 / frameRate;
@@ -503,26 +519,69 @@ PlusStatus vtkPlusSavedDataSource::InternalConnectVideo(vtkIGSIOTrackedFrameList
   this->LocalVideoBuffer->CopyImagesFromTrackedFrameList(savedDataBuffer, vtkPlusBuffer::READ_FILTERED_IGNORE_UNFILTERED_TIMESTAMPS, this->UseAllFrameFields);
   savedDataBuffer->Clear();
 
+  return this->SetupVideoSources(this->LocalVideoBuffer->GetImageOrientation(), this->LocalVideoBuffer->GetFrameSize(),
+                                 this->LocalVideoBuffer->GetNumberOfScalarComponents(), this->LocalVideoBuffer->GetPixelType());
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::InternalConnectVideoStreaming(const std::string& sequenceFilePath)
+{
+  vtkPlusDataSource* outputDataSource = this->GetOutputDataSource();
+  if (outputDataSource == NULL)
+  {
+    return PLUS_FAIL;
+  }
+
+  // Frames are read from the file during replay, the local buffers are not used
+  DeleteLocalBuffers();
+  this->Streamer = new PlusSequenceFileStreamer;
+  this->Streamer->SetPrefetchWindowFrames(this->StreamingReplayPrefetchFrames);
+  this->Streamer->SetIndexCacheEnabled(this->StreamingReplayIndexCacheEnabled);
+  if (this->Streamer->Open(sequenceFilePath) != PLUS_SUCCESS)
+  {
+    DeleteLocalBuffers();
+    return PLUS_FAIL;
+  }
+
+  if (outputDataSource->SetImageType(this->Streamer->GetImageType()) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to set video buffer image type");
+    DeleteLocalBuffers();
+    return PLUS_FAIL;
+  }
+
+  if (this->SetupVideoSources(this->Streamer->GetImageOrientation(), this->Streamer->GetFrameSize(),
+                              this->Streamer->GetNumberOfScalarComponents(), this->Streamer->GetPixelType()) != PLUS_SUCCESS)
+  {
+    DeleteLocalBuffers();
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::SetupVideoSources(US_IMAGE_ORIENTATION imageOrientation, const FrameSizeType& frameSize, unsigned int numberOfScalarComponents, igsioCommon::VTKScalarPixelType pixelType)
+{
   PlusStatus result(PLUS_SUCCESS);
   for (DataSourceContainerIterator it = this->VideoSources.begin(); it != this->VideoSources.end(); ++it)
   {
     vtkPlusDataSource* source(it->second);
 
-    if (source->SetInputImageOrientation(this->LocalVideoBuffer->GetImageOrientation()) != PLUS_SUCCESS)
+    if (source->SetInputImageOrientation(imageOrientation) != PLUS_SUCCESS)
     {
       LOG_ERROR(source->GetId() << ": Failed to set video image orientation");
       result = PLUS_FAIL;
       continue;
     }
 
-    if (source->SetInputFrameSize(this->LocalVideoBuffer->GetFrameSize()) != PLUS_SUCCESS)
+    if (source->SetInputFrameSize(frameSize) != PLUS_SUCCESS)
     {
       LOG_ERROR(source->GetId() << ": Failed to set video image orientation");
       result = PLUS_FAIL;
       continue;
     }
 
-    if (source->SetNumberOfScalarComponents(this->LocalVideoBuffer->GetNumberOfScalarComponents()) != PLUS_SUCCESS)
+    if (source->SetNumberOfScalarComponents(numberOfScalarComponents) != PLUS_SUCCESS)
     {
       LOG_ERROR(source->GetId() << ": Failed to set video image orientation");
       result = PLUS_FAIL;
@@ -531,14 +590,14 @@ PlusStatus vtkPlusSavedDataSource::InternalConnectVideo(vtkIGSIOTrackedFrameList
 
     source->Clear();
 
-    if (source->SetInputFrameSize(this->LocalVideoBuffer->GetFrameSize()) != PLUS_SUCCESS)
+    if (source->SetInputFrameSize(frameSize) != PLUS_SUCCESS)
     {
       LOG_ERROR(source->GetId() << ": Failed to set video image orientation");
       result = PLUS_FAIL;
       continue;
     }
 
-    if (source->SetPixelType(this->LocalVideoBuffer->GetPixelType()) != PLUS_SUCCESS)
+    if (source->SetPixelType(pixelType) != PLUS_SUCCESS)
     {
       LOG_ERROR(source->GetId() << ": Failed to set video image orientation");
       result = PLUS_FAIL;
@@ -671,6 +730,9 @@ PlusStatus vtkPlusSavedDataSource::ReadConfiguration(vtkXMLDataElement* rootConf
 
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(RepeatEnabled, deviceConfig);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(UseOriginalTimestamps, deviceConfig);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableStreamingReplay, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, StreamingReplayPrefetchFrames, deviceConfig);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(StreamingReplayIndexCacheEnabled, deviceConfig);
 
   const char* useData = deviceConfig->GetAttribute("UseData");
   if (useData != NULL)
@@ -708,6 +770,12 @@ PlusStatus vtkPlusSavedDataSource::WriteConfiguration(vtkXMLDataElement* rootCon
   XML_WRITE_CSTRING_ATTRIBUTE_IF_NOT_NULL(SequenceFile, imageAcquisitionConfig);
   XML_WRITE_BOOL_ATTRIBUTE(RepeatEnabled, imageAcquisitionConfig);
   XML_WRITE_BOOL_ATTRIBUTE(UseOriginalTimestamps, imageAcquisitionConfig);
+  if (this->EnableStreamingReplay)
+  {
+    XML_WRITE_BOOL_ATTRIBUTE(EnableStreamingReplay, imageAcquisitionConfig);
+    imageAcquisitionConfig->SetIntAttribute("StreamingReplayPrefetchFrames", this->StreamingReplayPrefetchFrames);
+    XML_WRITE_BOOL_ATTRIBUTE(StreamingReplayIndexCacheEnabled, imageAcquisitionConfig);
+  }
 
   if (this->UseAllFrameFields)
   {
@@ -769,7 +837,7 @@ void vtkPlusSavedDataSource::GetLoopTimeRange(double& loopStartTime, double& loo
 //-----------------------------------------------------------------------------
 void vtkPlusSavedDataSource::SetLoopTimeRange(double loopStartTime, double loopStopTime)
 {
-  if (!this->GetLocalBuffer())
+  if (this->Streamer == NULL && !this->GetLocalBuffer())
   {
     LOG_ERROR("vtkPlusSavedDataSource::SetLoopTimeRange: Invalid local buffer");
     return;
@@ -788,7 +856,7 @@ void vtkPlusSavedDataSource::SetLoopTimeRange(double loopStartTime, double loopS
 //----------------------------------------------------------------------------
 BufferItemUidType vtkPlusSavedDataSource::GetClosestFrameUidWithinTimeRange(double time_Local, double startTime_Local, double stopTime_Local)
 {
-  if (!this->GetLocalBuffer())
+  if (this->Streamer == NULL && !this->GetLocalBuffer())
   {
     LOG_ERROR("vtkPlusSavedDataSource::GetClosestFrameUidWithinTimeRange: Invalid local buffer");
     return 0;
@@ -805,9 +873,8 @@ BufferItemUidType vtkPlusSavedDataSource::GetClosestFrameUidWithinTimeRange(doub
   }
   // time_Local should be also within the local buffer time range
   double oldestTimestamp_Local = 0;
-  this->GetLocalBuffer()->GetOldestTimeStamp(oldestTimestamp_Local);
   double latestTimestamp_Local = 0;
-  this->GetLocalBuffer()->GetLatestTimeStamp(latestTimestamp_Local);
+  this->GetReplayTimeRange(oldestTimestamp_Local, latestTimestamp_Local);
 
   // if the asked time is outside of the loop range then return the closest element in the range
   if (time_Local < oldestTimestamp_Local)
@@ -820,10 +887,9 @@ BufferItemUidType vtkPlusSavedDataSource::GetClosestFrameUidWithinTimeRange(doub
   }
 
   // Get the uid of the frame that has been most recently acquired
-  BufferItemUidType closestFrameUid = 0;
-  this->GetLocalBuffer()->GetItemUidFromTime(time_Local, closestFrameUid);
+  BufferItemUidType closestFrameUid = this->GetReplayFrameUidFromTime(time_Local);
   double closestFrameTime_Local = 0;
-  this->GetLocalBuffer()->GetTimeStamp(closestFrameUid, closestFrameTime_Local);
+  this->GetReplayFrameTimestamp(closestFrameUid, closestFrameTime_Local);
 
   // The closest frame is at the boundary, but it may be just outside the range:
   // use the next/previous frame if the closest frame is on the wrong side of the boundary
@@ -842,6 +908,131 @@ BufferItemUidType vtkPlusSavedDataSource::GetClosestFrameUidWithinTimeRange(doub
   }
 }
 
+//----------------------------------------------------------------------------
+bool vtkPlusSavedDataSource::IsStreamingReplayActive() const
+{
+  return this->Streamer != NULL;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::GetReplayFrameUidRange(BufferItemUidType& oldestFrameUid, BufferItemUidType& latestFrameUid)
+{
+  if (this->Streamer != NULL)
+  {
+    oldestFrameUid = 1;
+    latestFrameUid = this->Streamer->GetNumberOfFrames();
+    return PLUS_SUCCESS;
+  }
+  vtkPlusBuffer* localBuffer = this->GetLocalBuffer();
+  if (localBuffer == NULL)
+  {
+    return PLUS_FAIL;
+  }
+  oldestFrameUid = localBuffer->GetOldestItemUidInBuffer();
+  latestFrameUid = localBuffer->GetLatestItemUidInBuffer();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::GetReplayTimeRange(double& oldestTimestamp_Local, double& latestTimestamp_Local)
+{
+  if (this->Streamer != NULL)
+  {
+    oldestTimestamp_Local = this->Streamer->GetFrameTimestamp(0);
+    latestTimestamp_Local = this->Streamer->GetFrameTimestamp(this->Streamer->GetNumberOfFrames() - 1);
+    return PLUS_SUCCESS;
+  }
+  vtkPlusBuffer* localBuffer = this->GetLocalBuffer();
+  if (localBuffer == NULL)
+  {
+    return PLUS_FAIL;
+  }
+  localBuffer->GetOldestTimeStamp(oldestTimestamp_Local);
+  localBuffer->GetLatestTimeStamp(latestTimestamp_Local);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::GetReplayFrameTimestamp(BufferItemUidType frameUid, double& timestamp_Local)
+{
+  if (this->Streamer != NULL)
+  {
+    if (frameUid < 1 || frameUid > static_cast<BufferItemUidType>(this->Streamer->GetNumberOfFrames()))
+    {
+      return PLUS_FAIL;
+    }
+    timestamp_Local = this->Streamer->GetFrameTimestamp(static_cast<int>(frameUid - 1));
+    return PLUS_SUCCESS;
+  }
+  vtkPlusBuffer* localBuffer = this->GetLocalBuffer();
+  if (localBuffer == NULL || localBuffer->GetTimeStamp(frameUid, timestamp_Local) != ITEM_OK)
+  {
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+BufferItemUidType vtkPlusSavedDataSource::GetReplayFrameUidFromTime(double time_Local)
+{
+  BufferItemUidType frameUid = 0;
+  if (this->Streamer != NULL)
+  {
+    frameUid = this->Streamer->GetFrameIndexFromTime(time_Local) + 1;
+  }
+  else if (this->GetLocalBuffer() != NULL)
+  {
+    this->GetLocalBuffer()->GetItemUidFromTime(time_Local, frameUid);
+  }
+  return frameUid;
+}
+
+//----------------------------------------------------------------------------
+double vtkPlusSavedDataSource::GetReplayFrameRate()
+{
+  if (this->Streamer != NULL)
+  {
+    int numberOfFrames = this->Streamer->GetNumberOfFrames();
+    double duration = this->Streamer->GetFrameTimestamp(numberOfFrames - 1) - this->Streamer->GetFrameTimestamp(0);
+    return (numberOfFrames > 1 && duration > 0) ? (numberOfFrames - 1) / duration : 0.0;
+  }
+  vtkPlusBuffer* localBuffer = this->GetLocalBuffer();
+  return (localBuffer != NULL) ? localBuffer->GetFrameRate() : 0.0;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::AddReplayFrameToVideoSources(BufferItemUidType frameUid, double unfilteredTimestamp, double filteredTimestamp)
+{
+  if (this->Streamer != NULL)
+  {
+    int frameIndex = static_cast<int>(frameUid - 1);
+    void* pixelData = const_cast<unsigned char*>(this->Streamer->GetFramePixelData(frameIndex));
+    if (pixelData == NULL)
+    {
+      LOG_ERROR("vtkPlusSavedDataSource: Failed to retrieve frame from the sequence file, UID=" << frameUid);
+      return PLUS_FAIL;
+    }
+    igsioFieldMapType noFields;
+    const igsioFieldMapType* fieldMap = this->UseAllFrameFields ? &this->Streamer->GetFrameCustomFields(frameIndex) : &noFields;
+    return this->AddVideoItemToVideoSources(this->GetVideoSources(), pixelData, this->Streamer->GetImageOrientation(), this->Streamer->GetFrameSize(),
+                                            this->Streamer->GetPixelType(), this->Streamer->GetNumberOfScalarComponents(), this->Streamer->GetImageType(), 0,
+                                            this->FrameNumber, unfilteredTimestamp, filteredTimestamp, fieldMap);
+  }
+
+  StreamBufferItem dataBufferItemToBeAdded;
+  if (GetLocalBuffer()->GetStreamBufferItem(frameUid, &dataBufferItemToBeAdded) != ITEM_OK)
+  {
+    LOG_ERROR("vtkPlusSavedDataSource: Failed to retrieve item from the buffer, UID=" << frameUid);
+    return PLUS_FAIL;
+  }
+  igsioFieldMapType fieldMap;
+  if (this->UseAllFrameFields)
+  {
+    fieldMap = dataBufferItemToBeAdded.GetFrameFieldMap();
+  }
+  return this->AddVideoItemToVideoSources(this->GetVideoSources(), dataBufferItemToBeAdded.GetFrame(), this->FrameNumber, unfilteredTimestamp, filteredTimestamp, &fieldMap);
+}
+
 //----------------------------------------------------------------------------
 vtkPlusBuffer* vtkPlusSavedDataSource::GetLocalTrackerBuffer()
 {
@@ -858,6 +1049,9 @@ vtkPlusBuffer* vtkPlusSavedDataSource::GetLocalTrackerBuffer()
 //----------------------------------------------------------------------------
 void vtkPlusSavedDataSource::DeleteLocalBuffers()
 {
+  delete this->Streamer;
+  this->Streamer = NULL;
+
   if (this->LocalVideoBuffer != NULL)
   {
     this->LocalVideoBuffer->Delete();
@@ -11,6 +11,7 @@ See License.txt for details.
 
 #include "vtkPlusDevice.h"
 
+class PlusSequenceFileStreamer;
 class vtkPlusBuffer;
 
 class vtkPlusDataCollectionExport vtkPlusSavedDataSource;
@@ -27,6 +28,12 @@ Attributes:
 \li UseOriginalTimestamps: if true then the original timestamps (recorded originally in the source file)
   will be replayed exactly, otherwise only the timestamp difference will be replayed exactly,
   starting from the current time (TRUE|FALSE)
+\li EnableStreamingReplay: if true then the frames of uncompressed image sequence files (.mha, .mhd, .nrrd, .nhdr)
+  are read from the memory-mapped file during replay instead of loading the whole file into memory.
+  Other files are loaded into memory as usual. Only used for image data (UseData=IMAGE or IMAGE_AND_TRANSFORM). (TRUE|FALSE)
+\li StreamingReplayPrefetchFrames: number of frames that are kept in memory ahead of the replayed frame in streaming replay
+\li StreamingReplayIndexCacheEnabled: if true then the frame index of the sequence file is stored in a cache file
+  next to the sequence file, so that the header does not have to be parsed again on the next connect (TRUE|FALSE)
 
 */
 class vtkPlusDataCollectionExport vtkPlusSavedDataSource : public vtkPlusDevice
@@ -73,7 +80,29 @@ public:
   /*! Read the timestamps from the file and use provide them in the output (instead of the current time) */
   vtkBooleanMacro( UseOriginalTimestamps, bool );
 
-  /*! Get local video buffer */
+  /*! Replay image frames directly from the sequence file, without loading the whole file into memory */
+  vtkGetMacro( EnableStreamingReplay, bool );
+  /*! Replay image frames directly from the sequence file, without loading the whole file into memory */
+  vtkSetMacro( EnableStreamingReplay, bool );
+  /*! Replay image frames directly from the sequence file, without loading the whole file into memory */
+  vtkBooleanMacro( EnableStreamingReplay, bool );
+
+  /*! Number of frames that are kept in memory ahead of the replayed frame in streaming replay */
+  vtkGetMacro( StreamingReplayPrefetchFrames, int );
+  /*! Number of frames that are kept in memory ahead of the replayed frame in streaming replay */
+  vtkSetMacro( StreamingReplayPrefetchFrames, int );
+
+  /*! Store the frame index of the sequence file in a cache file for streaming replay */
+  vtkGetMacro( StreamingReplayIndexCacheEnabled, bool );
+  /*! Store the frame index of the sequence file in a cache file for streaming replay */
+  vtkSetMacro( StreamingReplayIndexCacheEnabled, bool );
+  /*! Store the frame index of the sequence file in a cache file for streaming replay */
+  vtkBooleanMacro( StreamingReplayIndexCacheEnabled, bool );
+
+  /*! Returns true if the frames are replayed directly from the sequence file (the local video buffer is not used) */
+  bool IsStreamingReplayActive() const;
+
+  /*! Get local video buffer. It is NULL if streaming replay is active. */
   vtkGetObjectMacro( LocalVideoBuffer, vtkPlusBuffer );
 
   virtual bool IsTracker() const;
@@ -98,9 +127,15 @@ protected:
   /*! Connect to device, in case the output is a video stream */
   virtual PlusStatus InternalConnectVideo( vtkIGSIOTrackedFrameList* savedDataBuffer );
 
+  /*! Connect to device, in case the output is a video stream that is replayed directly from the sequence file */
+  virtual PlusStatus InternalConnectVideoStreaming( const std::string& sequenceFilePath );
+
   /*! Connect to device, in case the output is a tracker stream */
   virtual PlusStatus InternalConnectTracker( vtkIGSIOTrackedFrameList* savedDataBuffer );
 
+  /*! Set the input image format of all video sources */
+  PlusStatus SetupVideoSources( US_IMAGE_ORIENTATION imageOrientation, const FrameSizeType& frameSize, unsigned int numberOfScalarComponents, igsioCommon::VTKScalarPixelType pixelType );
+
   /*! Disconnect from device */
   virtual PlusStatus InternalDisconnect();
 
@@ -115,6 +150,19 @@ protected:
 
   BufferItemUidType GetClosestFrameUidWithinTimeRange( double time_Local, double startTime_Local, double stopTime_Local );
 
+  /*!
+    Access to the replayed frames, either in the local buffer or in the streamed sequence file.
+    In streaming replay the UID of a frame is its index in the file + 1.
+  */
+  PlusStatus GetReplayFrameUidRange( BufferItemUidType& oldestFrameUid, BufferItemUidType& latestFrameUid );
+  PlusStatus GetReplayTimeRange( double& oldestTimestamp_Local, double& latestTimestamp_Local );
+  PlusStatus GetReplayFrameTimestamp( BufferItemUidType frameUid, double& timestamp_Local );
+  BufferItemUidType GetReplayFrameUidFromTime( double time_Local );
+  double GetReplayFrameRate();
+
+  /*! Add a replayed frame to the video sources */
+  PlusStatus AddReplayFrameToVideoSources( BufferItemUidType frameUid, double unfilteredTimestamp, double filteredTimestamp );
+
   /*! Get local tracker buffer */
   vtkPlusBuffer* GetLocalTrackerBuffer();
 
@@ -161,6 +209,18 @@ protected:
   /*! Read the timestamps from the file and use provide them in the output (instead of the current time) */
   bool UseOriginalTimestamps;
 
+  /*! Replay image frames directly from the sequence file, without loading the whole file into memory */
+  bool EnableStreamingReplay;
+
+  /*! Number of frames that are kept in memory ahead of the replayed frame in streaming replay */
+  int StreamingReplayPrefetchFrames;
+
+  /*! Store the frame index of the sequence file in a cache file for streaming replay */
+  bool StreamingReplayIndexCacheEnabled;
+
+  /*! Provides the frames in streaming replay, NULL if the whole file is loaded into the local buffers */
+  PlusSequenceFileStreamer* Streamer;
+
   /*! Buffer item UID of the last added frame in the local buffer */
   BufferItemUidType LastAddedFrameUid;
 
@@ -0,0 +1,181 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusBufferContentionTest.cxx
+  \brief Measures the throughput of buffer readers while a writer thread continuously adds items,
+  with the default (mutex-protected) and the lock-free buffer read mode. Also verifies that the lock-free
+  reads return consistent UIDs and timestamps.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkPlusBuffer.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  struct ContentionResult
+  {
+    ContentionResult() : NumberOfReads(0), NumberOfWrites(0), NumberOfInconsistentReads(0) {}
+    unsigned long long NumberOfReads;
+    unsigned long long NumberOfWrites;
+    unsigned long long NumberOfInconsistentReads;
+  };
+
+  //----------------------------------------------------------------------------
+  // Emulates what vtkPlusChannel::GetTrackedFrame does with each tool buffer: look up the latest
+  // timestamp, then find the item by time and read its timestamp
+  void ReadBuffer(vtkPlusBuffer* buffer, std::atomic<bool>* stop, unsigned long long* numberOfReads, unsigned long long* numberOfInconsistentReads)
+  {
+    unsigned long long reads = 0;
+    unsigned long long inconsistentReads = 0;
+    while (!stop->load())
+    {
+      BufferItemUidType latestUid = buffer->GetLatestItemUidInBuffer();
+      double latestTimestamp = 0;
+      if (buffer->GetTimeStamp(latestUid, latestTimestamp) != ITEM_OK)
+      {
+        continue;
+      }
+      BufferItemUidType uid = 0;
+      if (buffer->GetItemUidFromTime(latestTimestamp, uid) == ITEM_OK && uid != latestUid)
+      {
+        double timestamp = 0;
+        // A newer item may have been added meanwhile, but the item found by time must have the same timestamp
+        if (buffer->GetTimeStamp(uid, timestamp) == ITEM_OK && std::fabs(timestamp - latestTimestamp) > 1e-9)
+        {
+          inconsistentReads++;
+        }
+      }
+      reads++;
+    }
+    *numberOfReads = reads;
+    *numberOfInconsistentReads = inconsistentReads;
+  }
+
+  //----------------------------------------------------------------------------
+  ContentionResult RunContentionTest(bool lockFreeRead, int numberOfReaderThreads, double durationSec)
+  {
+    vtkSmartPointer<vtkPlusBuffer> buffer = vtkSmartPointer<vtkPlusBuffer>::New();
+    buffer->SetBufferSize(500);
+    buffer->SetLockFreeRead(lockFreeRead);
+
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    unsigned long frameNumber = 0;
+    double timestamp = 1.0;
+    // Fill the buffer so that readers can always find items
+    for (; frameNumber < 500; ++frameNumber, timestamp += 0.001)
+    {
+      buffer->AddTimeStampedItem(matrix, TOOL_OK, frameNumber, timestamp, timestamp);
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<unsigned long long> numberOfReads(numberOfReaderThreads, 0);
+    std::vector<unsigned long long> numberOfInconsistentReads(numberOfReaderThreads, 0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < numberOfReaderThreads; ++i)
+    {
+      readers.push_back(std::thread(ReadBuffer, buffer.GetPointer(), &stop, &numberOfReads[i], &numberOfInconsistentReads[i]));
+    }
+
+    ContentionResult result;
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    while (vtkIGSIOAccurateTimer::GetSystemTime() - startTime < durationSec)
+    {
+      buffer->AddTimeStampedItem(matrix, TOOL_OK, frameNumber++, timestamp, timestamp);
+      timestamp += 0.001;
+      result.NumberOfWrites++;
+      // Fast tracking devices provide data at about 1kHz, write a bit faster than that
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    stop = true;
+    for (int i = 0; i < numberOfReaderThreads; ++i)
+    {
+      readers[i].join();
+      result.NumberOfReads += numberOfReads[i];
+      result.NumberOfInconsistentReads += numberOfInconsistentReads[i];
+    }
+    return result;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int numberOfReaderThreads(4);
+  double durationSec(1.0);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--reader-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfReaderThreads, "Number of reader threads (Default: 4).");
+  args.AddArgument("--duration-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &durationSec, "Duration of each measurement in seconds (Default: 1.0).");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (numberOfReaderThreads < 1 || durationSec <= 0)
+  {
+    LOG_ERROR("Invalid arguments: reader-threads must be positive and duration-sec must be larger than 0");
+    return EXIT_FAILURE;
+  }
+
+  int numberOfErrors(0);
+  const bool lockFreeReadModes[2] = { false, true };
+  for (int i = 0; i < 2; ++i)
+  {
+    ContentionResult result = RunContentionTest(lockFreeReadModes[i], numberOfReaderThreads, durationSec);
+    LOG_INFO((lockFreeReadModes[i] ? "Lock-free read" : "Locked read") << " with " << numberOfReaderThreads << " reader threads: "
+             << result.NumberOfReads / durationSec << " reads/sec, " << result.NumberOfWrites / durationSec << " writes/sec");
+    if (result.NumberOfInconsistentReads > 0)
+    {
+      LOG_ERROR(result.NumberOfInconsistentReads << " inconsistent reads in " << (lockFreeReadModes[i] ? "lock-free" : "locked") << " read mode");
+      numberOfErrors++;
+    }
+    if (result.NumberOfReads == 0 || result.NumberOfWrites == 0)
+    {
+      LOG_ERROR("No items were read or written in " << (lockFreeReadModes[i] ? "lock-free" : "locked") << " read mode");
+      numberOfErrors++;
+    }
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusBufferItemViewTest.cxx
+  \brief Verifies that buffer item views share the pixel data with the buffer and that
+  the viewed pixel data is not overwritten when the buffer slot is reused.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusBuffer.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+namespace
+{
+  const unsigned int FRAME_SIZE_X = 64;
+  const unsigned int FRAME_SIZE_Y = 48;
+  const int BUFFER_SIZE = 3;
+
+  //----------------------------------------------------------------------------
+  PlusStatus AddFrame(vtkPlusBuffer* buffer, unsigned char value, long frameNumber)
+  {
+    std::vector<unsigned char> pixels(FRAME_SIZE_X * FRAME_SIZE_Y, value);
+    FrameSizeType frameSize = { FRAME_SIZE_X, FRAME_SIZE_Y, 1 };
+    std::array<int, 3> noClipOrigin = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+    std::array<int, 3> noClipSize = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+    double timestamp = 1.0 + frameNumber * 0.1;
+    return buffer->AddItem(&pixels[0], US_IMG_ORIENT_MF, frameSize, VTK_UNSIGNED_CHAR, 1, US_IMG_BRIGHTNESS, 0, frameNumber,
+                           noClipOrigin, noClipSize, timestamp, timestamp);
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsImageFilledWith(vtkImageData* image, unsigned char value)
+  {
+    unsigned char* pixel = static_cast<unsigned char*>(image->GetScalarPointer());
+    for (unsigned int i = 0; i < FRAME_SIZE_X * FRAME_SIZE_Y; ++i)
+    {
+      if (pixel[i] != value)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  vtkSmartPointer<vtkPlusBuffer> buffer = vtkSmartPointer<vtkPlusBuffer>::New();
+  buffer->SetBufferSize(BUFFER_SIZE);
+  buffer->SetPixelType(VTK_UNSIGNED_CHAR);
+  buffer->SetNumberOfScalarComponents(1);
+  buffer->SetImageType(US_IMG_BRIGHTNESS);
+  buffer->SetImageOrientation(US_IMG_ORIENT_MF);
+  buffer->SetFrameSize(FRAME_SIZE_X, FRAME_SIZE_Y, 1);
+
+  if (AddFrame(buffer, 1, 0) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to add frame to the buffer");
+    return EXIT_FAILURE;
+  }
+
+  StreamBufferItemView view;
+  BufferItemUidType viewedUid = buffer->GetLatestItemUidInBuffer();
+  if (buffer->GetStreamBufferItemView(viewedUid, view) != ITEM_OK || !view.IsValid())
+  {
+    LOG_ERROR("Failed to get view of buffer item " << viewedUid);
+    return EXIT_FAILURE;
+  }
+
+  if (!IsImageFilledWith(view.GetImage(), 1))
+  {
+    LOG_ERROR("View pixel data does not match the added frame");
+    numberOfErrors++;
+  }
+
+  // Share the view with a video frame, as vtkPlusChannel::GetTrackedFrame does
+  igsioVideoFrame sharedFrame;
+  if (view.ShareImageWith(sharedFrame) != PLUS_SUCCESS || sharedFrame.GetImage()->GetScalarPointer() != view.GetImage()->GetScalarPointer())
+  {
+    LOG_ERROR("Video frame does not share the pixel data with the view");
+    numberOfErrors++;
+  }
+
+  // Overwrite every slot of the buffer (including the viewed one) multiple times
+  for (long frameNumber = 1; frameNumber <= 2 * BUFFER_SIZE; ++frameNumber)
+  {
+    if (AddFrame(buffer, static_cast<unsigned char>(10 + frameNumber), frameNumber) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add frame " << frameNumber << " to the buffer");
+      numberOfErrors++;
+    }
+  }
+
+  if (!IsImageFilledWith(view.GetImage(), 1) || !IsImageFilledWith(sharedFrame.GetImage(), 1))
+  {
+    LOG_ERROR("Pixel data referenced by the view was overwritten by the buffer");
+    numberOfErrors++;
+  }
+  if (buffer->GetNumberOfSharedFrameReallocations() != 1)
+  {
+    LOG_ERROR("Unexpected number of shared frame reallocations: " << buffer->GetNumberOfSharedFrameReallocations() << " (expected 1)");
+    numberOfErrors++;
+  }
+
+  // Latest frame in the buffer must contain the latest pixel data
+  StreamBufferItemView latestView;
+  if (buffer->GetStreamBufferItemView(buffer->GetLatestItemUidInBuffer(), latestView) != ITEM_OK || !IsImageFilledWith(latestView.GetImage(), 10 + 2 * BUFFER_SIZE))
+  {
+    LOG_ERROR("Latest buffer item view does not contain the latest frame");
+    numberOfErrors++;
+  }
+
+  // After the views are released the buffer can reuse its pixel arrays again
+  view.Reset();
+  sharedFrame.GetImage()->Initialize();
+  latestView.Reset();
+  for (long frameNumber = 2 * BUFFER_SIZE + 1; frameNumber <= 3 * BUFFER_SIZE; ++frameNumber)
+  {
+    AddFrame(buffer, static_cast<unsigned char>(10 + frameNumber), frameNumber);
+  }
+  if (buffer->GetNumberOfSharedFrameReallocations() != 1)
+  {
+    LOG_ERROR("Pixel array was reallocated although it was not referenced by any view");
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,295 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusBufferReservationTest.cxx
+  \brief Checks that readers of a video buffer are not blocked while large frames are converted into it.
+
+  A producer thread adds 4K RGB frames that have to be flipped vertically (MN to MF orientation). Meanwhile the main thread
+  keeps calling buffer accessors that lock the buffer and measures how long each call takes. Frames are converted into a
+  reserved frame outside the buffer lock (see vtkPlusBuffer::ReserveItem), so the reader latency must stay far below the
+  time needed for adding a frame. The explicit reserve/write/commit and release steps are checked as well.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusBuffer.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+
+namespace
+{
+  const int BUFFER_SIZE = 4;
+  const unsigned int NUMBER_OF_COMPONENTS = 3;
+  /*!
+    Maximum ratio of the 99th percentile of the reader latency and the average time of adding a frame.
+    The bound is generous because of scheduling noise on shared CI machines, it only catches readers that wait for whole frame copies.
+  */
+  const double MAX_READER_LATENCY_RATIO = 0.75;
+
+  //----------------------------------------------------------------------------
+  double GetTimeSec()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  //----------------------------------------------------------------------------
+  unsigned char GetPixel(vtkImageData* image, int x, int y)
+  {
+    return *static_cast<unsigned char*>(image->GetScalarPointer(x, y, 0));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! The marker pixel of the input frame is the first pixel of the first row, all other pixels are 0 */
+  PlusStatus CheckLatestFrame(vtkPlusBuffer* buffer, unsigned char expectedMarker)
+  {
+    StreamBufferItemView view;
+    if (buffer->GetStreamBufferItemView(buffer->GetLatestItemUidInBuffer(), view) != ITEM_OK || !view.IsValid())
+    {
+      LOG_ERROR("Failed to get view of the latest buffer item");
+      return PLUS_FAIL;
+    }
+    // MN to MF orientation conversion flips the rows
+    int lastRow = static_cast<int>(buffer->GetFrameSize()[1]) - 1;
+    if (GetPixel(view.GetImage(), 0, lastRow) != expectedMarker || GetPixel(view.GetImage(), 0, 0) != 0)
+    {
+      LOG_ERROR("Latest frame content is invalid: marker is " << static_cast<int>(GetPixel(view.GetImage(), 0, lastRow))
+                << " (expected " << static_cast<int>(expectedMarker) << "), first pixel is " << static_cast<int>(GetPixel(view.GetImage(), 0, 0)) << " (expected 0)");
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  int frameWidth = 3840;
+  int frameHeight = 2160;
+  int numberOfFrames = 60;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  args.AddArgument("--frame-width", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameWidth, "Width of the added frames (default: 3840)");
+  args.AddArgument("--frame-height", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameHeight, "Height of the added frames (default: 2160)");
+  args.AddArgument("--number-of-frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of frames added while the buffer is read (default: 60)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  vtkSmartPointer<vtkPlusBuffer> buffer = vtkSmartPointer<vtkPlusBuffer>::New();
+  buffer->SetBufferSize(BUFFER_SIZE);
+  buffer->SetPixelType(VTK_UNSIGNED_CHAR);
+  buffer->SetNumberOfScalarComponents(NUMBER_OF_COMPONENTS);
+  buffer->SetImageType(US_IMG_RGB_COLOR);
+  buffer->SetImageOrientation(US_IMG_ORIENT_MF);
+  buffer->SetFrameSize(frameWidth, frameHeight, 1);
+
+  FrameSizeType frameSize = { static_cast<unsigned int>(frameWidth), static_cast<unsigned int>(frameHeight), 1 };
+  std::vector<unsigned char> inputFrame(static_cast<size_t>(frameWidth) * frameHeight * NUMBER_OF_COMPONENTS, 0);
+  const std::array<int, 3> noClipOrigin = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+  const std::array<int, 3> noClipSize = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+
+  //---------------------------------------------------------------------------
+  // Reader latency while frames are added
+  inputFrame[0] = 1;
+  if (buffer->AddItem(&inputFrame[0], US_IMG_ORIENT_MN, frameSize, VTK_UNSIGNED_CHAR, NUMBER_OF_COMPONENTS, US_IMG_RGB_COLOR, 0, 1, noClipOrigin, noClipSize, 1.0, 1.0) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to add the first frame");
+    return EXIT_FAILURE;
+  }
+
+  std::atomic<bool> producerFinished(false);
+  std::atomic<int> numberOfAddErrors(0);
+  double totalAddTimeSec = 0;
+  std::thread producerThread([&]()
+  {
+    for (int frameNumber = 2; frameNumber <= numberOfFrames + 1; ++frameNumber)
+    {
+      inputFrame[0] = static_cast<unsigned char>(frameNumber);
+      double startTimeSec = GetTimeSec();
+      if (buffer->AddItem(&inputFrame[0], US_IMG_ORIENT_MN, frameSize, VTK_UNSIGNED_CHAR, NUMBER_OF_COMPONENTS, US_IMG_RGB_COLOR, 0, frameNumber,
+                          noClipOrigin, noClipSize, frameNumber, frameNumber) != PLUS_SUCCESS)
+      {
+        numberOfAddErrors++;
+      }
+      totalAddTimeSec += GetTimeSec() - startTimeSec;
+    }
+    producerFinished = true;
+  });
+
+  std::vector<double> readerLatenciesSec;
+  while (!producerFinished)
+  {
+    double startTimeSec = GetTimeSec();
+    double latestTimestamp = 0;
+    BufferItemUidType uid = 0;
+    buffer->GetLatestTimeStamp(latestTimestamp);
+    buffer->GetItemUidFromTime(latestTimestamp, uid);
+    buffer->GetLatestItemHasValidVideoData();
+    readerLatenciesSec.push_back(GetTimeSec() - startTimeSec);
+  }
+  producerThread.join();
+
+  if (numberOfAddErrors > 0)
+  {
+    LOG_ERROR(numberOfAddErrors << " frames could not be added to the buffer");
+    numberOfErrors++;
+  }
+  if (CheckLatestFrame(buffer, static_cast<unsigned char>(numberOfFrames + 1)) != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+
+  std::sort(readerLatenciesSec.begin(), readerLatenciesSec.end());
+  double averageAddTimeSec = totalAddTimeSec / numberOfFrames;
+  double medianReaderLatencySec = readerLatenciesSec.empty() ? 0 : readerLatenciesSec[readerLatenciesSec.size() / 2];
+  double percentile99ReaderLatencySec = readerLatenciesSec.empty() ? 0 : readerLatenciesSec[readerLatenciesSec.size() * 99 / 100];
+  double maxReaderLatencySec = readerLatenciesSec.empty() ? 0 : readerLatenciesSec.back();
+  LOG_INFO("Adding a " << frameWidth << "x" << frameHeight << " frame: " << averageAddTimeSec * 1000.0 << " ms on average");
+  LOG_INFO("Reader latency (" << readerLatenciesSec.size() << " reads): median " << medianReaderLatencySec * 1e6 << " us, 99th percentile "
+           << percentile99ReaderLatencySec * 1e6 << " us, maximum " << maxReaderLatencySec * 1e6 << " us");
+  if (std::thread::hardware_concurrency() < 2)
+  {
+    // The reader and the producer compete for the same CPU, the latency also includes the time slices of the producer
+    LOG_INFO("Reader latency is not checked on a single CPU");
+  }
+  else if (percentile99ReaderLatencySec > MAX_READER_LATENCY_RATIO * averageAddTimeSec)
+  {
+    LOG_ERROR("Readers are blocked while frames are added: 99th percentile of reader latency is " << percentile99ReaderLatencySec * 1000.0
+              << " ms, adding a frame takes " << averageAddTimeSec * 1000.0 << " ms");
+    numberOfErrors++;
+  }
+
+  //---------------------------------------------------------------------------
+  // Explicit reserve, write and commit
+  int numberOfItemsBefore = buffer->GetNumberOfItems();
+  BufferItemUidType latestUidBefore = buffer->GetLatestItemUidInBuffer();
+  StreamBufferItemReservation reservation;
+  if (buffer->ReserveItem(reservation) != PLUS_SUCCESS || !reservation.IsReserved()
+      || reservation.GetFrameSizeInBytes() != inputFrame.size())
+  {
+    LOG_ERROR("Failed to reserve a frame");
+    return EXIT_FAILURE;
+  }
+  inputFrame[0] = 200;
+  if (buffer->WriteReservedItem(reservation, &inputFrame[0], US_IMG_ORIENT_MN, frameSize, VTK_UNSIGNED_CHAR, NUMBER_OF_COMPONENTS, US_IMG_RGB_COLOR, 0, noClipOrigin, noClipSize) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write the reserved frame");
+    numberOfErrors++;
+  }
+  if (buffer->GetLatestItemUidInBuffer() != latestUidBefore)
+  {
+    LOG_ERROR("Reserved frame is visible in the buffer before it is committed");
+    numberOfErrors++;
+  }
+  igsioFieldMapType fields;
+  fields["TestField"] = std::make_pair(FRAMEFIELD_NONE, "Committed");
+  double commitTimestamp = numberOfFrames + 10;
+  if (buffer->CommitReservedItem(reservation, numberOfFrames + 10, commitTimestamp, commitTimestamp, &fields) != PLUS_SUCCESS || reservation.IsReserved())
+  {
+    LOG_ERROR("Failed to commit the reserved frame");
+    numberOfErrors++;
+  }
+  if (CheckLatestFrame(buffer, 200) != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  StreamBufferItemView committedView;
+  if (buffer->GetStreamBufferItemView(buffer->GetLatestItemUidInBuffer(), committedView) != ITEM_OK
+      || committedView.GetFrameFieldMap().find("TestField") == committedView.GetFrameFieldMap().end()
+      || committedView.GetFilteredTimestamp(0) != commitTimestamp)
+  {
+    LOG_ERROR("Fields or timestamp of the committed frame are invalid");
+    numberOfErrors++;
+  }
+  committedView.Reset();
+
+  //---------------------------------------------------------------------------
+  // Frames that are written directly (as a decoder does) and released frames
+  std::set<void*> reservedPixelPointers;
+  latestUidBefore = buffer->GetLatestItemUidInBuffer();
+  for (int frameIndex = 0; frameIndex < 5 * BUFFER_SIZE; ++frameIndex)
+  {
+    if (buffer->ReserveItem(reservation) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to reserve frame " << frameIndex);
+      numberOfErrors++;
+      break;
+    }
+    reservedPixelPointers.insert(reservation.GetScalarPointer());
+    if (frameIndex % 2 == 1)
+    {
+      buffer->ReleaseReservation(reservation);
+      continue;
+    }
+    std::fill(static_cast<unsigned char*>(reservation.GetScalarPointer()), static_cast<unsigned char*>(reservation.GetScalarPointer()) + reservation.GetFrameSizeInBytes(), 0);
+    // Direct writes are not reoriented, the marker is written where the converted marker would be
+    *static_cast<unsigned char*>(reservation.GetFrame().GetImage()->GetScalarPointer(0, frameHeight - 1, 0)) = static_cast<unsigned char>(frameIndex);
+    double timestamp = commitTimestamp + 1 + frameIndex;
+    if (buffer->CommitReservedItem(reservation, numberOfFrames + 11 + frameIndex, timestamp, timestamp) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to commit directly written frame " << frameIndex);
+      numberOfErrors++;
+    }
+    if (CheckLatestFrame(buffer, static_cast<unsigned char>(frameIndex)) != PLUS_SUCCESS)
+    {
+      numberOfErrors++;
+    }
+  }
+  if (buffer->GetLatestItemUidInBuffer() != latestUidBefore + 5 * BUFFER_SIZE / 2)
+  {
+    LOG_ERROR("Unexpected number of added items: " << buffer->GetLatestItemUidInBuffer() - latestUidBefore << " (expected " << 5 * BUFFER_SIZE / 2 << ")");
+    numberOfErrors++;
+  }
+  if (buffer->GetNumberOfItems() != std::max(numberOfItemsBefore, BUFFER_SIZE))
+  {
+    LOG_ERROR("Unexpected number of items in the buffer: " << buffer->GetNumberOfItems());
+    numberOfErrors++;
+  }
+  // Pixel arrays are swapped between the reservation and the buffer slots, no new arrays are needed
+  if (reservedPixelPointers.size() > static_cast<size_t>(BUFFER_SIZE + 2))
+  {
+    LOG_ERROR("Pixel arrays are not reused: " << reservedPixelPointers.size() << " different arrays were reserved");
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
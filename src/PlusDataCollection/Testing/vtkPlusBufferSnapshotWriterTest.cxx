@@ -0,0 +1,338 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusBufferSnapshotWriterTest.cxx
+  \brief Checks that buffer snapshots written on a background thread match the files written by the synchronous writers.
+
+  A video buffer and the tool buffers of a device are filled and written with vtkPlusBuffer::WriteToSequenceFile and
+  vtkPlusDevice::WriteToolsToSequenceFile. Then snapshots of the same buffers are written with PlusBufferSnapshotWriter,
+  while new items are added to the buffers (all the slots of the video buffer are reused meanwhile).
+  The written files must contain the same frames.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusBufferSnapshotWriter.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOTrackedFrameList.h"
+#include "vtkPlusBuffer.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusDevice.h"
+#include "vtkPlusSequenceIO.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <cstring>
+
+namespace
+{
+  const int BUFFER_SIZE = 20;
+  const unsigned int FRAME_WIDTH = 64;
+  const unsigned int FRAME_HEIGHT = 48;
+  const char* TEST_FIELD_NAME = "TestField";
+
+  //----------------------------------------------------------------------------
+  PlusStatus AddVideoFrame(vtkPlusBuffer* buffer, int frameNumber)
+  {
+    std::vector<unsigned char> pixels(FRAME_WIDTH * FRAME_HEIGHT);
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+      pixels[i] = static_cast<unsigned char>(i + frameNumber);
+    }
+    FrameSizeType frameSize = { FRAME_WIDTH, FRAME_HEIGHT, 1 };
+    const std::array<int, 3> noClip = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+    igsioFieldMapType fields;
+    fields[TEST_FIELD_NAME] = std::make_pair(FRAMEFIELD_NONE, igsioCommon::ToString<int>(frameNumber * 10));
+    double timestamp = 10.0 + frameNumber * 0.1;
+    return buffer->AddItem(&pixels[0], US_IMG_ORIENT_MF, frameSize, VTK_UNSIGNED_CHAR, 1, US_IMG_BRIGHTNESS, 0, frameNumber,
+                           noClip, noClip, timestamp, timestamp, &fields);
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus AddToolItems(vtkPlusDevice* device, int frameNumber)
+  {
+    double timestamp = 10.0 + frameNumber * 0.02;
+    int toolIndex = 0;
+    for (DataSourceContainerConstIterator it = device->GetToolIteratorBegin(); it != device->GetToolIteratorEnd(); ++it, ++toolIndex)
+    {
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      matrix->SetElement(0, 3, frameNumber);
+      matrix->SetElement(1, 3, toolIndex);
+      ToolStatus status = (frameNumber % 5 == 0 ? TOOL_OUT_OF_VIEW : TOOL_OK);
+      if (it->second->AddTimeStampedItem(matrix, status, frameNumber, timestamp, timestamp) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  void CompareSequenceFiles(const std::string& referenceFileName, const std::string& fileName,
+                            const std::vector<igsioTransformName>& transformNames, int& numberOfErrors)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> referenceFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (vtkPlusSequenceIO::Read(referenceFileName, referenceFrames) != PLUS_SUCCESS || vtkPlusSequenceIO::Read(fileName, frames) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read " << referenceFileName << " or " << fileName);
+      numberOfErrors++;
+      return;
+    }
+    if (referenceFrames->GetNumberOfTrackedFrames() != frames->GetNumberOfTrackedFrames() || frames->GetNumberOfTrackedFrames() == 0)
+    {
+      LOG_ERROR("Number of frames in " << fileName << " is " << frames->GetNumberOfTrackedFrames() << ", expected " << referenceFrames->GetNumberOfTrackedFrames());
+      numberOfErrors++;
+      return;
+    }
+
+    const char* fieldNames[] = { "Timestamp", "UnfilteredTimestamp", "FrameNumber", TEST_FIELD_NAME };
+    for (unsigned int frameIndex = 0; frameIndex < frames->GetNumberOfTrackedFrames(); ++frameIndex)
+    {
+      igsioTrackedFrame* referenceFrame = referenceFrames->GetTrackedFrame(frameIndex);
+      igsioTrackedFrame* frame = frames->GetTrackedFrame(frameIndex);
+      for (size_t fieldIndex = 0; fieldIndex < sizeof(fieldNames) / sizeof(fieldNames[0]); ++fieldIndex)
+      {
+        if (referenceFrame->GetFrameField(fieldNames[fieldIndex]) != frame->GetFrameField(fieldNames[fieldIndex]))
+        {
+          LOG_ERROR(fieldNames[fieldIndex] << " field of frame " << frameIndex << " in " << fileName << " is '" << frame->GetFrameField(fieldNames[fieldIndex])
+                    << "', expected '" << referenceFrame->GetFrameField(fieldNames[fieldIndex]) << "'");
+          numberOfErrors++;
+        }
+      }
+
+      for (std::vector<igsioTransformName>::const_iterator transformName = transformNames.begin(); transformName != transformNames.end(); ++transformName)
+      {
+        vtkSmartPointer<vtkMatrix4x4> referenceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+        vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+        ToolStatus referenceStatus = TOOL_INVALID;
+        ToolStatus status = TOOL_INVALID;
+        if (referenceFrame->GetFrameTransform(*transformName, referenceMatrix) != PLUS_SUCCESS || frame->GetFrameTransform(*transformName, matrix) != PLUS_SUCCESS
+            || referenceFrame->GetFrameTransformStatus(*transformName, referenceStatus) != PLUS_SUCCESS || frame->GetFrameTransformStatus(*transformName, status) != PLUS_SUCCESS)
+        {
+          LOG_ERROR("Failed to get transform " << transformName->GetTransformName() << " of frame " << frameIndex << " from " << fileName);
+          numberOfErrors++;
+          continue;
+        }
+        bool matricesEqual = true;
+        for (int element = 0; element < 16; ++element)
+        {
+          matricesEqual = matricesEqual && referenceMatrix->GetElement(element / 4, element % 4) == matrix->GetElement(element / 4, element % 4);
+        }
+        if (referenceStatus != status || !matricesEqual)
+        {
+          LOG_ERROR("Transform " << transformName->GetTransformName() << " of frame " << frameIndex << " in " << fileName << " differs from the reference");
+          numberOfErrors++;
+        }
+      }
+
+      igsioVideoFrame* referenceImage = referenceFrame->GetImageData();
+      igsioVideoFrame* image = frame->GetImageData();
+      if (referenceImage->GetFrameSizeInBytes() != image->GetFrameSizeInBytes()
+          || memcmp(referenceImage->GetScalarPointer(), image->GetScalarPointer(), image->GetFrameSizeInBytes()) != 0)
+      {
+        LOG_ERROR("Image of frame " << frameIndex << " in " << fileName << " differs from the reference");
+        numberOfErrors++;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CheckProgress(const PlusBufferSnapshotWriter& writer, unsigned int expectedNumberOfFrames, int& numberOfErrors)
+  {
+    PlusBufferSnapshotWriter::Progress progress = writer.GetProgress();
+    if (progress.State != PlusBufferSnapshotWriter::STATE_COMPLETED || progress.NumberOfFrames != expectedNumberOfFrames
+        || progress.NumberOfWrittenFrames != expectedNumberOfFrames)
+    {
+      LOG_ERROR("Unexpected snapshot writer progress: " << PlusBufferSnapshotWriter::GetStateAsString(progress.State) << ", "
+                << progress.NumberOfWrittenFrames << " of " << progress.NumberOfFrames << " frames written (expected " << expectedNumberOfFrames << ")");
+      numberOfErrors++;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+  std::vector<std::string> writtenFileNames;
+
+  //---------------------------------------------------------------------------
+  // Video buffer
+  const char* extensions[] = { ".nrrd", ".mha" };
+  for (size_t extensionIndex = 0; extensionIndex < sizeof(extensions) / sizeof(extensions[0]); ++extensionIndex)
+  {
+    vtkSmartPointer<vtkPlusBuffer> buffer = vtkSmartPointer<vtkPlusBuffer>::New();
+    buffer->SetBufferSize(BUFFER_SIZE);
+    buffer->SetPixelType(VTK_UNSIGNED_CHAR);
+    buffer->SetNumberOfScalarComponents(1);
+    buffer->SetImageType(US_IMG_BRIGHTNESS);
+    buffer->SetImageOrientation(US_IMG_ORIENT_MF);
+    buffer->SetFrameSize(FRAME_WIDTH, FRAME_HEIGHT, 1);
+
+    int frameNumber = 0;
+    for (; frameNumber < BUFFER_SIZE + 5; ++frameNumber)
+    {
+      if (AddVideoFrame(buffer, frameNumber) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to add video frame " << frameNumber);
+        return EXIT_FAILURE;
+      }
+    }
+
+    std::string referenceFileName = vtkPlusConfig::GetInstance()->GetOutputPath(std::string("vtkPlusBufferSnapshotWriterTest_VideoReference") + extensions[extensionIndex]);
+    std::string snapshotFileName = vtkPlusConfig::GetInstance()->GetOutputPath(std::string("vtkPlusBufferSnapshotWriterTest_VideoSnapshot") + extensions[extensionIndex]);
+    writtenFileNames.push_back(referenceFileName);
+    writtenFileNames.push_back(snapshotFileName);
+    if (buffer->WriteToSequenceFile(referenceFileName.c_str(), false) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to write reference file " << referenceFileName);
+      return EXIT_FAILURE;
+    }
+
+    PlusBufferSnapshotWriter writer;
+    writer.SetBatchSize(3);
+    if (writer.TakeVideoSnapshot(buffer) != PLUS_SUCCESS || writer.Start(snapshotFileName) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to start writing snapshot " << snapshotFileName);
+      return EXIT_FAILURE;
+    }
+
+    // Acquisition continues while the snapshot is written, all slots are reused
+    for (int i = 0; i < 2 * BUFFER_SIZE; ++i, ++frameNumber)
+    {
+      if (AddVideoFrame(buffer, frameNumber) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to add video frame " << frameNumber << " while the snapshot is written");
+        numberOfErrors++;
+      }
+    }
+
+    if (writer.Wait() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to write snapshot " << snapshotFileName);
+      numberOfErrors++;
+    }
+    CheckProgress(writer, BUFFER_SIZE, numberOfErrors);
+
+    std::vector<igsioTransformName> transformNames;
+    transformNames.push_back(igsioTransformName("Tool", "Tracker"));
+    CompareSequenceFiles(referenceFileName, snapshotFileName, transformNames, numberOfErrors);
+
+    StreamBufferItem latestItem;
+    if (buffer->GetLatestStreamBufferItem(&latestItem) != ITEM_OK || latestItem.GetIndex() != static_cast<unsigned long>(frameNumber - 1)
+        || *static_cast<unsigned char*>(latestItem.GetFrame().GetScalarPointer()) != static_cast<unsigned char>(frameNumber - 1))
+    {
+      LOG_ERROR("Latest buffer item is invalid after the snapshot is written");
+      numberOfErrors++;
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // Tool buffers
+  vtkSmartPointer<vtkPlusDevice> device = vtkSmartPointer<vtkPlusDevice>::New();
+  device->SetToolReferenceFrameName("Tracker");
+  const char* toolIds[] = { "Probe", "Stylus" };
+  std::vector<igsioTransformName> toolTransformNames;
+  for (size_t toolIndex = 0; toolIndex < sizeof(toolIds) / sizeof(toolIds[0]); ++toolIndex)
+  {
+    vtkSmartPointer<vtkPlusDataSource> tool = vtkSmartPointer<vtkPlusDataSource>::New();
+    tool->SetId(toolIds[toolIndex]);
+    tool->SetType(DATA_SOURCE_TYPE_TOOL);
+    tool->SetBufferSize(BUFFER_SIZE);
+    if (device->AddTool(tool) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add tool " << toolIds[toolIndex]);
+      return EXIT_FAILURE;
+    }
+    toolTransformNames.push_back(igsioTransformName(toolIds[toolIndex], "Tracker"));
+  }
+
+  int toolFrameNumber = 0;
+  for (; toolFrameNumber < BUFFER_SIZE + 5; ++toolFrameNumber)
+  {
+    if (AddToolItems(device, toolFrameNumber) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add tool items " << toolFrameNumber);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::string toolsReferenceFileName = vtkPlusConfig::GetInstance()->GetOutputPath("vtkPlusBufferSnapshotWriterTest_ToolsReference.nrrd");
+  std::string toolsSnapshotFileName = vtkPlusConfig::GetInstance()->GetOutputPath("vtkPlusBufferSnapshotWriterTest_ToolsSnapshot.nrrd");
+  writtenFileNames.push_back(toolsReferenceFileName);
+  writtenFileNames.push_back(toolsSnapshotFileName);
+  if (device->WriteToolsToSequenceFile(toolsReferenceFileName, false) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write reference file " << toolsReferenceFileName);
+    return EXIT_FAILURE;
+  }
+
+  PlusBufferSnapshotWriter toolsWriter;
+  toolsWriter.SetBatchSize(4);
+  if (toolsWriter.TakeToolsSnapshot(device) != PLUS_SUCCESS || toolsWriter.Start(toolsSnapshotFileName) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to start writing snapshot " << toolsSnapshotFileName);
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < BUFFER_SIZE; ++i, ++toolFrameNumber)
+  {
+    if (AddToolItems(device, toolFrameNumber) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add tool items " << toolFrameNumber << " while the snapshot is written");
+      numberOfErrors++;
+    }
+  }
+  if (toolsWriter.Wait() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write snapshot " << toolsSnapshotFileName);
+    numberOfErrors++;
+  }
+  CheckProgress(toolsWriter, BUFFER_SIZE, numberOfErrors);
+  CompareSequenceFiles(toolsReferenceFileName, toolsSnapshotFileName, toolTransformNames, numberOfErrors);
+
+  for (std::vector<std::string>::iterator fileName = writtenFileNames.begin(); fileName != writtenFileNames.end(); ++fileName)
+  {
+    vtksys::SystemTools::RemoveFile(*fileName);
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,304 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusCaptureLoopSchedulerTest.cxx
+  \brief Verifies the absolute deadline scheduling of the data capture thread and reports its timing statistics.
+
+  First a loop is run directly with PlusCaptureLoopScheduler, with one iteration that takes longer than the period:
+  the overrun must be counted, the missed deadlines must be skipped, and the loop must stay on the deadline grid (no drift).
+  The same is repeated with iterations that are recorded without deadlines (as in UpdateOnNewInputData mode).
+  Then a FakeTracker is run at the requested acquisition rate and the wake-up latency and overrun histograms
+  of its data capture thread are reported. The CPU affinity, real-time scheduling and memory locking options
+  can be specified on the command line to compare the jitter with and without them.
+*/
+
+#include "PlusCaptureLoopScheduler.h"
+#include "PlusConfigure.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusDevice.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <chrono>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+  const double SCHEDULER_TEST_PERIOD_SEC = 0.004;
+  const int SCHEDULER_TEST_NUMBER_OF_ITERATIONS = 200;
+  const int SCHEDULER_TEST_OVERRUN_ITERATION = 50;
+  /*!
+    Minimum and maximum ratio of the completed and the expected number of capture loop periods. The bounds are generous, because
+    on busy test machines the thread may be delayed and the acquisition may run longer than the requested duration while it is stopped.
+  */
+  const double MIN_COMPLETED_PERIODS_RATIO = 0.5;
+  const double MAX_COMPLETED_PERIODS_RATIO = 1.5;
+
+  //----------------------------------------------------------------------------
+  unsigned long long GetHistogramTotal(const std::vector<unsigned long long>& histogram)
+  {
+    return std::accumulate(histogram.begin(), histogram.end(), 0ULL);
+  }
+
+  //----------------------------------------------------------------------------
+  int CheckStatisticsConsistency(const PlusCaptureLoopScheduler::Statistics& statistics)
+  {
+    int numberOfErrors = 0;
+    if (GetHistogramTotal(statistics.OverrunHistogram) != statistics.NumberOfOverruns)
+    {
+      LOG_ERROR("Overrun histogram contains " << GetHistogramTotal(statistics.OverrunHistogram) << " items, expected " << statistics.NumberOfOverruns);
+      numberOfErrors++;
+    }
+    if (GetHistogramTotal(statistics.WakeUpLatencyHistogram) + statistics.NumberOfOverruns != statistics.NumberOfPeriods)
+    {
+      LOG_ERROR("Wake-up latency histogram contains " << GetHistogramTotal(statistics.WakeUpLatencyHistogram) << " items, expected "
+                << statistics.NumberOfPeriods - statistics.NumberOfOverruns);
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestSchedulerOverrun()
+  {
+    PlusCaptureLoopScheduler scheduler;
+    double startTimeSec = PlusCaptureLoopScheduler::GetMonotonicTimeSec();
+    scheduler.Start(SCHEDULER_TEST_PERIOD_SEC);
+    for (int iteration = 0; iteration < SCHEDULER_TEST_NUMBER_OF_ITERATIONS; ++iteration)
+    {
+      if (iteration == SCHEDULER_TEST_OVERRUN_ITERATION)
+      {
+        // Simulate an update that takes 2.5 periods
+        std::this_thread::sleep_for(std::chrono::duration<double>(2.5 * SCHEDULER_TEST_PERIOD_SEC));
+      }
+      scheduler.WaitForNextDeadline();
+    }
+    double elapsedTimeSec = PlusCaptureLoopScheduler::GetMonotonicTimeSec() - startTimeSec;
+
+    PlusCaptureLoopScheduler::Statistics statistics = scheduler.GetStatistics();
+    LOG_INFO("Scheduler test: " << statistics.NumberOfPeriods << " periods, " << statistics.NumberOfOverruns << " overruns, "
+             << statistics.NumberOfSkippedDeadlines << " skipped deadlines, elapsed time: " << elapsedTimeSec << " sec");
+
+    int numberOfErrors = CheckStatisticsConsistency(statistics);
+    if (statistics.NumberOfPeriods != SCHEDULER_TEST_NUMBER_OF_ITERATIONS)
+    {
+      LOG_ERROR("Number of periods is " << statistics.NumberOfPeriods << ", expected " << SCHEDULER_TEST_NUMBER_OF_ITERATIONS);
+      numberOfErrors++;
+    }
+    if (statistics.NumberOfOverruns < 1 || statistics.NumberOfSkippedDeadlines < 1)
+    {
+      LOG_ERROR("The simulated overrun is not reported (overruns: " << statistics.NumberOfOverruns << ", skipped deadlines: " << statistics.NumberOfSkippedDeadlines << ")");
+      numberOfErrors++;
+    }
+
+    // Each period ends at a deadline of the grid, so the elapsed time is determined by the number of periods and skipped deadlines
+    double expectedElapsedTimeSec = (statistics.NumberOfPeriods + statistics.NumberOfSkippedDeadlines) * SCHEDULER_TEST_PERIOD_SEC;
+    if (elapsedTimeSec < expectedElapsedTimeSec - 1e-4 || elapsedTimeSec > expectedElapsedTimeSec + SCHEDULER_TEST_PERIOD_SEC + statistics.MaxWakeUpLatencySec)
+    {
+      LOG_ERROR("Loop drifted from the deadline grid: elapsed time is " << elapsedTimeSec << " sec, expected " << expectedElapsedTimeSec << " sec");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestSchedulerRecordIteration()
+  {
+    PlusCaptureLoopScheduler scheduler;
+    scheduler.Start(SCHEDULER_TEST_PERIOD_SEC);
+    for (int iteration = 0; iteration < SCHEDULER_TEST_NUMBER_OF_ITERATIONS; ++iteration)
+    {
+      double iterationStartTimeSec = PlusCaptureLoopScheduler::GetMonotonicTimeSec();
+      if (iteration == SCHEDULER_TEST_OVERRUN_ITERATION)
+      {
+        // Simulate an update that takes 2.5 periods
+        std::this_thread::sleep_for(std::chrono::duration<double>(2.5 * SCHEDULER_TEST_PERIOD_SEC));
+      }
+      scheduler.RecordIteration(iterationStartTimeSec);
+    }
+
+    PlusCaptureLoopScheduler::Statistics statistics = scheduler.GetStatistics();
+    LOG_INFO("Scheduler test without deadlines: " << statistics.NumberOfPeriods << " periods, " << statistics.NumberOfOverruns << " overruns");
+
+    int numberOfErrors = 0;
+    if (statistics.NumberOfPeriods != SCHEDULER_TEST_NUMBER_OF_ITERATIONS)
+    {
+      LOG_ERROR("Number of recorded periods is " << statistics.NumberOfPeriods << ", expected " << SCHEDULER_TEST_NUMBER_OF_ITERATIONS);
+      numberOfErrors++;
+    }
+    if (statistics.NumberOfOverruns < 1 || statistics.MaxOverrunSec < SCHEDULER_TEST_PERIOD_SEC)
+    {
+      LOG_ERROR("The simulated overrun is not reported (overruns: " << statistics.NumberOfOverruns << ", maximum overrun: " << statistics.MaxOverrunSec << " sec)");
+      numberOfErrors++;
+    }
+    if (GetHistogramTotal(statistics.OverrunHistogram) != statistics.NumberOfOverruns || GetHistogramTotal(statistics.WakeUpLatencyHistogram) != 0)
+    {
+      LOG_ERROR("Histograms of the recorded iterations are inconsistent: " << GetHistogramTotal(statistics.OverrunHistogram) << " overruns, "
+                << GetHistogramTotal(statistics.WakeUpLatencyHistogram) << " wake-ups, expected " << statistics.NumberOfOverruns << " overruns and no wake-ups");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestFakeTracker(double acquisitionRate, double durationSec, const std::string& cpuAffinity, const std::string& schedulingPolicy, int priority, bool lockMemory)
+  {
+    std::ostringstream configString;
+    configString << "<PlusConfiguration version=\"2.1\">"
+                 << "  <DataCollection StartupDelaySec=\"0\">"
+                 << "    <Device Id=\"TrackerDevice\" Type=\"FakeTracker\" Mode=\"Default\" ToolReferenceFrame=\"Tracker\" AcquisitionRate=\"" << acquisitionRate << "\"";
+    if (!cpuAffinity.empty())
+    {
+      configString << " CaptureThreadCpuAffinity=\"" << cpuAffinity << "\"";
+    }
+    if (!schedulingPolicy.empty())
+    {
+      configString << " CaptureThreadSchedulingPolicy=\"" << schedulingPolicy << "\" CaptureThreadPriority=\"" << priority << "\"";
+    }
+    if (lockMemory)
+    {
+      configString << " CaptureThreadLockMemory=\"TRUE\"";
+    }
+    configString << ">"
+                 << "      <DataSources>"
+                 << "        <DataSource Type=\"Tool\" Id=\"Reference\" PortName=\"0\" />"
+                 << "        <DataSource Type=\"Tool\" Id=\"Stylus\" PortName=\"1\" />"
+                 << "        <DataSource Type=\"Tool\" Id=\"Stylus-2\" PortName=\"2\" />"
+                 << "        <DataSource Type=\"Tool\" Id=\"Stylus-3\" PortName=\"3\" />"
+                 << "      </DataSources>"
+                 << "      <OutputChannels>"
+                 << "        <OutputChannel Id=\"TrackerStream\">"
+                 << "          <DataSource Id=\"Reference\" />"
+                 << "          <DataSource Id=\"Stylus\" />"
+                 << "          <DataSource Id=\"Stylus-2\" />"
+                 << "          <DataSource Id=\"Stylus-3\" />"
+                 << "        </OutputChannel>"
+                 << "      </OutputChannels>"
+                 << "    </Device>"
+                 << "  </DataCollection>"
+                 << "</PlusConfiguration>";
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(configString.str().c_str()));
+
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+    if (configRootElement == NULL || dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read the configuration");
+      return 1;
+    }
+    vtkPlusDevice* trackerDevice = NULL;
+    if (dataCollector->GetDevice(trackerDevice, "TrackerDevice") != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Tracker device is not found");
+      return 1;
+    }
+    if (trackerDevice->GetCaptureThreadSettings().CpuAffinity.empty() != cpuAffinity.empty()
+        || trackerDevice->GetCaptureThreadSettings().LockMemory != lockMemory)
+    {
+      LOG_ERROR("Capture thread settings are not read from the device configuration");
+      return 1;
+    }
+
+    if (dataCollector->Connect() != PLUS_SUCCESS || dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to start acquisition from the fake tracker");
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(durationSec));
+    dataCollector->Stop();
+    dataCollector->Disconnect();
+
+    PlusCaptureLoopScheduler::Statistics statistics = trackerDevice->GetCaptureLoopStatistics();
+    LOG_INFO("FakeTracker at " << acquisitionRate << " Hz for " << durationSec << " sec: " << statistics.NumberOfPeriods << " periods, "
+             << statistics.NumberOfOverruns << " overruns, " << statistics.NumberOfSkippedDeadlines << " skipped deadlines");
+    LOG_INFO("Wake-up latency: average " << statistics.AverageWakeUpLatencySec * 1000.0 << " ms, maximum " << statistics.MaxWakeUpLatencySec * 1000.0 << " ms");
+    LOG_INFO("Wake-up latency histogram: " << trackerDevice->GetParameter("CaptureLoopWakeUpLatencyHistogram"));
+    LOG_INFO("Overrun histogram: " << trackerDevice->GetParameter("CaptureLoopOverrunHistogram"));
+
+    int numberOfErrors = CheckStatisticsConsistency(statistics);
+    double expectedNumberOfPeriods = acquisitionRate * durationSec;
+    if (statistics.NumberOfPeriods < MIN_COMPLETED_PERIODS_RATIO * expectedNumberOfPeriods)
+    {
+      LOG_ERROR("Only " << statistics.NumberOfPeriods << " capture loop periods were completed, expected about " << expectedNumberOfPeriods);
+      numberOfErrors++;
+    }
+    if (statistics.NumberOfPeriods > MAX_COMPLETED_PERIODS_RATIO * expectedNumberOfPeriods + 2)
+    {
+      LOG_ERROR(statistics.NumberOfPeriods << " capture loop periods were completed, expected about " << expectedNumberOfPeriods);
+      numberOfErrors++;
+    }
+    std::string numberOfPeriodsParameter;
+    std::ostringstream expectedNumberOfPeriodsParameter;
+    expectedNumberOfPeriodsParameter << statistics.NumberOfPeriods;
+    if (trackerDevice->GetParameter("CaptureLoopNumberOfPeriods", numberOfPeriodsParameter) != PLUS_SUCCESS
+        || numberOfPeriodsParameter != expectedNumberOfPeriodsParameter.str())
+    {
+      LOG_ERROR("CaptureLoopNumberOfPeriods parameter is \"" << numberOfPeriodsParameter << "\", expected " << statistics.NumberOfPeriods);
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  double acquisitionRate = 250.0;
+  double durationSec = 2.0;
+  std::string cpuAffinity;
+  std::string schedulingPolicy;
+  int priority = 50;
+  bool lockMemory(false);
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  args.AddArgument("--acquisition-rate", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &acquisitionRate, "Acquisition rate of the fake tracker (default: 250)");
+  args.AddArgument("--duration-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &durationSec, "Duration of the fake tracker acquisition (default: 2)");
+  args.AddArgument("--cpu-affinity", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &cpuAffinity, "Space-separated list of CPU indices that the capture thread may run on (default: any CPU)");
+  args.AddArgument("--scheduling-policy", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &schedulingPolicy, "Scheduling policy of the capture thread: Default, Fifo, or RoundRobin (default: Default)");
+  args.AddArgument("--priority", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &priority, "Real-time priority of the capture thread, used with Fifo and RoundRobin policies (default: 50)");
+  args.AddArgument("--lock-memory", vtksys::CommandLineArguments::NO_ARGUMENT, &lockMemory, "Lock the process memory in RAM");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+  numberOfErrors += TestSchedulerOverrun();
+  numberOfErrors += TestSchedulerRecordIteration();
+  numberOfErrors += TestFakeTracker(acquisitionRate, durationSec, cpuAffinity, schedulingPolicy, priority, lockMemory);
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
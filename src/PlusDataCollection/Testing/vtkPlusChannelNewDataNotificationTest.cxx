@@ -0,0 +1,146 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusChannelNewDataNotificationTest.cxx
+  \brief Verifies that vtkPlusChannel::WaitForNewData wakes up when an item is added to a buffer of the channel,
+  does not miss items that were added before the wait started, and times out if no data is added.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkPlusBuffer.h"
+#include "vtkPlusChannel.h"
+#include "vtkPlusDataSource.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <chrono>
+#include <thread>
+
+namespace
+{
+  const double WAIT_TIMEOUT_SEC = 2.0;
+  const double SHORT_TIMEOUT_SEC = 0.05;
+  const double ITEM_ADD_DELAY_SEC = 0.1;
+  /*! Allowed time between adding an item and waking up (generous, to avoid failures on busy test machines) */
+  const double MAX_WAKE_UP_DELAY_SEC = 0.5;
+
+  //----------------------------------------------------------------------------
+  void AddItemDelayed(vtkPlusDataSource* tool, double delaySec, unsigned long frameNumber, double* addTime)
+  {
+    std::this_thread::sleep_for(std::chrono::duration<double>(delaySec));
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    *addTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    tool->AddTimeStampedItem(matrix, TOOL_OK, frameNumber, 1.0 + frameNumber, 1.0 + frameNumber);
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  vtkSmartPointer<vtkPlusDataSource> tool = vtkSmartPointer<vtkPlusDataSource>::New();
+  tool->SetId("Probe");
+  tool->SetType(DATA_SOURCE_TYPE_TOOL);
+  tool->SetBufferSize(10);
+  vtkSmartPointer<vtkPlusChannel> channel = vtkSmartPointer<vtkPlusChannel>::New();
+  channel->SetChannelId("TrackerStream");
+  channel->AddTool(tool);
+
+  LOG_INFO("Wait times out if no data is added");
+  unsigned long long numberOfAddedItems = channel->GetNumberOfAddedItems();
+  if (channel->WaitForNewData(SHORT_TIMEOUT_SEC, numberOfAddedItems))
+  {
+    LOG_ERROR("WaitForNewData returned new data, but no item was added");
+    numberOfErrors++;
+  }
+
+  LOG_INFO("Wait wakes up when an item is added");
+  double addTime = 0;
+  std::thread producer(AddItemDelayed, tool.GetPointer(), ITEM_ADD_DELAY_SEC, 0, &addTime);
+  bool newDataAvailable = channel->WaitForNewData(WAIT_TIMEOUT_SEC, numberOfAddedItems);
+  double wakeUpTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  producer.join();
+  if (!newDataAvailable)
+  {
+    LOG_ERROR("WaitForNewData timed out, but an item was added");
+    numberOfErrors++;
+  }
+  else if (wakeUpTime - addTime > MAX_WAKE_UP_DELAY_SEC)
+  {
+    LOG_ERROR("WaitForNewData woke up " << wakeUpTime - addTime << " sec after the item was added");
+    numberOfErrors++;
+  }
+  if (numberOfAddedItems != 1)
+  {
+    LOG_ERROR("Number of added items is " << numberOfAddedItems << ", expected 1");
+    numberOfErrors++;
+  }
+
+  LOG_INFO("Items added before the wait are not missed");
+  AddItemDelayed(tool, 0, 1, &addTime);
+  if (!channel->WaitForNewData(SHORT_TIMEOUT_SEC, numberOfAddedItems))
+  {
+    LOG_ERROR("WaitForNewData did not report the item that was added before the call");
+    numberOfErrors++;
+  }
+
+  LOG_INFO("Rejected items do not wake up the waiting thread");
+  // Same timestamp as the previous item, it is not added to the buffer
+  AddItemDelayed(tool, 0, 1, &addTime);
+  if (channel->WaitForNewData(SHORT_TIMEOUT_SEC, numberOfAddedItems))
+  {
+    LOG_ERROR("WaitForNewData returned new data, but the item was not added to the buffer");
+    numberOfErrors++;
+  }
+
+  LOG_INFO("Clearing the buffer does not reset the number of added items");
+  unsigned long long numberOfAddedItemsBeforeClear = channel->GetNumberOfAddedItems();
+  channel->Clear();
+  if (channel->GetNumberOfAddedItems() != numberOfAddedItemsBeforeClear)
+  {
+    LOG_ERROR("Number of added items changed after clearing the buffer");
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
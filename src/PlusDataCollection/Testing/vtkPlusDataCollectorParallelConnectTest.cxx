@@ -0,0 +1,390 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusDataCollectorParallelConnectTest.cxx
+  \brief Verifies that the data collector connects and starts the devices in parallel, in dependency order.
+
+  The device set consists of fake devices with artificial connect latency: three physical devices and two virtual
+  devices, one of them using the output of the other (the virtual devices are listed first in the configuration).
+  Each fake device checks that the devices feeding its input channels are already connected (started) when it is
+  connected (started). The elapsed times are compared to the sum of the connect latencies, and Start must return
+  as soon as all buffers received data, before the startup delay expires.
+  With --failing-device one of the physical devices fails to connect: the virtual devices that depend on it must not be
+  connected and all the other devices must be disconnected (errors are logged in this case).
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusDevice.h"
+#include "vtkPlusDeviceFactory.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+  const double PHYSICAL_DEVICE_CONNECT_LATENCY_SEC = 0.4;
+  const double VIRTUAL_DEVICE_CONNECT_LATENCY_SEC = 0.1;
+  /*! Time after the start of recording when the fake devices start to add data to their buffers */
+  const double DATA_DELAY_SEC = 0.3;
+  /*! Much longer than the time needed for the first data to arrive, Start must not wait this long */
+  const double STARTUP_DELAY_SEC = 5.0;
+  /*! Connecting the devices in parallel must take less than this fraction of the connect latencies of all devices */
+  const double MAX_PARALLEL_CONNECT_TIME_RATIO = 0.75;
+
+  std::atomic<int> NumberOfConnectingDevices(0);
+  std::atomic<int> MaxNumberOfConnectingDevices(0);
+}
+
+//----------------------------------------------------------------------------
+/*!
+  Fake device with artificial connect latency that adds an identity transform to its tools at the acquisition rate.
+  It records whether it was connected or started before the devices that feed its input channels.
+*/
+class vtkPlusLatencyTestDevice : public vtkPlusDevice
+{
+public:
+  static vtkPlusLatencyTestDevice* New();
+  vtkTypeMacro(vtkPlusLatencyTestDevice, vtkPlusDevice);
+
+  virtual bool IsTracker() const { return true; }
+  virtual bool IsVirtual() const { return !this->InputChannels.empty(); }
+
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* rootConfigElement)
+  {
+    XML_FIND_DEVICE_ELEMENT_REQUIRED_FOR_READING(deviceConfig, rootConfigElement);
+    XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, ConnectLatencySec, deviceConfig);
+    XML_READ_BOOL_ATTRIBUTE_OPTIONAL(FailConnect, deviceConfig);
+    return PLUS_SUCCESS;
+  }
+
+  vtkSetMacro(ConnectLatencySec, double);
+  vtkSetMacro(FailConnect, bool);
+
+  bool ConnectAttempted;
+  bool ConnectedBeforeInputs;
+  bool StartedBeforeInputs;
+
+protected:
+  vtkPlusLatencyTestDevice()
+    : ConnectAttempted(false)
+    , ConnectedBeforeInputs(false)
+    , StartedBeforeInputs(false)
+    , ConnectLatencySec(0.0)
+    , FailConnect(false)
+  {
+    this->StartThreadForInternalUpdates = true;
+    this->AcquisitionRate = 50;
+  }
+
+  virtual PlusStatus InternalConnect()
+  {
+    int numberOfConnectingDevices = ++NumberOfConnectingDevices;
+    int maxNumberOfConnectingDevices = MaxNumberOfConnectingDevices;
+    while (numberOfConnectingDevices > maxNumberOfConnectingDevices && !MaxNumberOfConnectingDevices.compare_exchange_weak(maxNumberOfConnectingDevices, numberOfConnectingDevices))
+    {
+    }
+
+    this->ConnectAttempted = true;
+    std::vector<vtkPlusDevice*> inputDevices;
+    this->GetInputDevices(inputDevices);
+    for (std::vector<vtkPlusDevice*>::iterator it = inputDevices.begin(); it != inputDevices.end(); ++it)
+    {
+      if (!(*it)->IsConnected())
+      {
+        this->ConnectedBeforeInputs = true;
+      }
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(this->ConnectLatencySec));
+    --NumberOfConnectingDevices;
+    return this->FailConnect ? PLUS_FAIL : PLUS_SUCCESS;
+  }
+
+  virtual PlusStatus InternalStartRecording()
+  {
+    std::vector<vtkPlusDevice*> inputDevices;
+    this->GetInputDevices(inputDevices);
+    for (std::vector<vtkPlusDevice*>::iterator it = inputDevices.begin(); it != inputDevices.end(); ++it)
+    {
+      if (!(*it)->IsRecording())
+      {
+        this->StartedBeforeInputs = true;
+      }
+    }
+    return PLUS_SUCCESS;
+  }
+
+  virtual PlusStatus InternalUpdate()
+  {
+    double timestamp = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (timestamp - this->GetRecordingStartTime() < DATA_DELAY_SEC)
+    {
+      return PLUS_SUCCESS;
+    }
+    vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+    for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
+    {
+      this->ToolTimeStampedUpdate(it->second->GetId(), identity, TOOL_OK, this->FrameNumber, timestamp);
+    }
+    this->FrameNumber++;
+    return PLUS_SUCCESS;
+  }
+
+  double ConnectLatencySec;
+  bool FailConnect;
+
+private:
+  vtkPlusLatencyTestDevice(const vtkPlusLatencyTestDevice&);
+  void operator=(const vtkPlusLatencyTestDevice&);
+};
+
+vtkStandardNewMacro(vtkPlusLatencyTestDevice);
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  void AppendDevice(std::ostringstream& configString, const std::string& deviceId, double connectLatencySec, bool failConnect, const std::vector<std::string>& inputChannelIds)
+  {
+    configString << "    <Device Id=\"" << deviceId << "\" Type=\"LatencyTestDevice\" ToolReferenceFrame=\"Tracker\""
+                 << " ConnectLatencySec=\"" << connectLatencySec << "\" FailConnect=\"" << (failConnect ? "TRUE" : "FALSE") << "\">"
+                 << "      <DataSources>"
+                 << "        <DataSource Type=\"Tool\" Id=\"" << deviceId << "Tool\" PortName=\"0\" />"
+                 << "      </DataSources>"
+                 << "      <OutputChannels>"
+                 << "        <OutputChannel Id=\"" << deviceId << "Stream\">"
+                 << "          <DataSource Id=\"" << deviceId << "Tool\" />"
+                 << "        </OutputChannel>"
+                 << "      </OutputChannels>";
+    if (!inputChannelIds.empty())
+    {
+      configString << "      <InputChannels>";
+      for (std::vector<std::string>::const_iterator it = inputChannelIds.begin(); it != inputChannelIds.end(); ++it)
+      {
+        configString << "        <InputChannel Id=\"" << *it << "\" />";
+      }
+      configString << "      </InputChannels>";
+    }
+    configString << "    </Device>";
+  }
+
+  //----------------------------------------------------------------------------
+  vtkPlusLatencyTestDevice* GetTestDevice(vtkPlusDataCollector* dataCollector, const std::string& deviceId)
+  {
+    vtkPlusDevice* device = NULL;
+    dataCollector->GetDevice(device, deviceId);
+    return vtkPlusLatencyTestDevice::SafeDownCast(device);
+  }
+
+  //----------------------------------------------------------------------------
+  int TestConnectAndStart(unsigned int numberOfConnectionThreads, bool failingDevice)
+  {
+    // Virtual devices are listed first, so that the configuration order cannot be used as connection order
+    std::ostringstream configString;
+    configString << "<PlusConfiguration version=\"2.1\">"
+                 << "  <DataCollection StartupDelaySec=\"" << STARTUP_DELAY_SEC << "\" NumberOfConnectionThreads=\"" << numberOfConnectionThreads << "\">";
+    AppendDevice(configString, "Mixer", VIRTUAL_DEVICE_CONNECT_LATENCY_SEC, false, { "ProcessorStream", "TrackerBStream" });
+    AppendDevice(configString, "Processor", VIRTUAL_DEVICE_CONNECT_LATENCY_SEC, false, { "CameraStream", "TrackerAStream" });
+    AppendDevice(configString, "Camera", PHYSICAL_DEVICE_CONNECT_LATENCY_SEC, false, std::vector<std::string>());
+    AppendDevice(configString, "TrackerA", PHYSICAL_DEVICE_CONNECT_LATENCY_SEC, failingDevice, std::vector<std::string>());
+    AppendDevice(configString, "TrackerB", PHYSICAL_DEVICE_CONNECT_LATENCY_SEC, false, std::vector<std::string>());
+    configString << "  </DataCollection>"
+                 << "</PlusConfiguration>";
+    // The virtual devices are not connected if a physical device fails
+    const double serialConnectTimeSec = 3 * PHYSICAL_DEVICE_CONNECT_LATENCY_SEC + (failingDevice ? 0 : 2 * VIRTUAL_DEVICE_CONNECT_LATENCY_SEC);
+    const char* deviceIds[] = { "Mixer", "Processor", "Camera", "TrackerA", "TrackerB" };
+
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(configString.str().c_str()));
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+    dataCollector->GetDeviceFactory().RegisterDevice("LatencyTestDevice", "vtkPlusLatencyTestDevice", (vtkPlusDeviceFactory::PointerToDevice)&vtkPlusLatencyTestDevice::New);
+    if (configRootElement == NULL || dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read the configuration");
+      return 1;
+    }
+    if (dataCollector->GetNumberOfConnectionThreads() != numberOfConnectionThreads)
+    {
+      LOG_ERROR("NumberOfConnectionThreads is " << dataCollector->GetNumberOfConnectionThreads() << ", expected " << numberOfConnectionThreads);
+      return 1;
+    }
+
+    NumberOfConnectingDevices = 0;
+    MaxNumberOfConnectingDevices = 0;
+    int numberOfErrors = 0;
+
+    double connectStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    PlusStatus connectStatus = dataCollector->Connect();
+    double connectTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - connectStartTime;
+    LOG_INFO("Connect with " << numberOfConnectionThreads << " connection thread(s)" << (failingDevice ? " and a failing device" : "") << ": "
+             << connectTimeSec << " sec (sum of connect latencies: " << serialConnectTimeSec << " sec), at most "
+             << MaxNumberOfConnectingDevices.load() << " devices were connecting at the same time");
+
+    for (unsigned int i = 0; i < sizeof(deviceIds) / sizeof(deviceIds[0]); ++i)
+    {
+      vtkPlusLatencyTestDevice* device = GetTestDevice(dataCollector, deviceIds[i]);
+      if (device == NULL)
+      {
+        LOG_ERROR("Device " << deviceIds[i] << " is not found");
+        return numberOfErrors + 1;
+      }
+      if (device->ConnectedBeforeInputs)
+      {
+        LOG_ERROR("Device " << deviceIds[i] << " was connected before the devices that feed its input channels");
+        numberOfErrors++;
+      }
+    }
+
+    if (numberOfConnectionThreads == 1)
+    {
+      if (MaxNumberOfConnectingDevices != 1 || connectTimeSec < serialConnectTimeSec - 0.01)
+      {
+        LOG_ERROR("Devices were connected in parallel with one connection thread");
+        numberOfErrors++;
+      }
+    }
+    else
+    {
+      if (MaxNumberOfConnectingDevices < 2 || connectTimeSec > MAX_PARALLEL_CONNECT_TIME_RATIO * serialConnectTimeSec)
+      {
+        LOG_ERROR("Devices were not connected in parallel");
+        numberOfErrors++;
+      }
+    }
+
+    if (failingDevice)
+    {
+      if (connectStatus == PLUS_SUCCESS || dataCollector->GetConnected())
+      {
+        LOG_ERROR("Connect succeeded, although a device failed to connect");
+        numberOfErrors++;
+      }
+      if (GetTestDevice(dataCollector, "Processor")->ConnectAttempted || GetTestDevice(dataCollector, "Mixer")->ConnectAttempted)
+      {
+        LOG_ERROR("Virtual devices were connected, although a device feeding them failed to connect");
+        numberOfErrors++;
+      }
+      if (!GetTestDevice(dataCollector, "Camera")->ConnectAttempted || !GetTestDevice(dataCollector, "TrackerB")->ConnectAttempted)
+      {
+        LOG_ERROR("Independent devices were not connected after a device failed to connect");
+        numberOfErrors++;
+      }
+      for (unsigned int i = 0; i < sizeof(deviceIds) / sizeof(deviceIds[0]); ++i)
+      {
+        if (GetTestDevice(dataCollector, deviceIds[i])->IsConnected())
+        {
+          LOG_ERROR("Device " << deviceIds[i] << " is not disconnected after the connection failed");
+          numberOfErrors++;
+        }
+      }
+      return numberOfErrors;
+    }
+
+    if (connectStatus != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to connect the devices");
+      return numberOfErrors + 1;
+    }
+
+    double startStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to start the devices");
+      return numberOfErrors + 1;
+    }
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startStartTime;
+    LOG_INFO("Start: " << startTimeSec << " sec (data delay: " << DATA_DELAY_SEC << " sec, startup delay: " << STARTUP_DELAY_SEC << " sec)");
+
+    for (unsigned int i = 0; i < sizeof(deviceIds) / sizeof(deviceIds[0]); ++i)
+    {
+      vtkPlusLatencyTestDevice* device = GetTestDevice(dataCollector, deviceIds[i]);
+      if (device->StartedBeforeInputs)
+      {
+        LOG_ERROR("Device " << deviceIds[i] << " was started before the devices that feed its input channels");
+        numberOfErrors++;
+      }
+      vtkPlusDataSource* tool = NULL;
+      if (device->GetTool(std::string(deviceIds[i]) + "Tool", tool) != PLUS_SUCCESS || tool->GetNumberOfItems() < 1)
+      {
+        LOG_ERROR("Buffer of device " << deviceIds[i] << " has not received data when Start returned");
+        numberOfErrors++;
+      }
+    }
+    if (startTimeSec < DATA_DELAY_SEC || startTimeSec > STARTUP_DELAY_SEC / 2)
+    {
+      LOG_ERROR("Start took " << startTimeSec << " sec, expected it to return soon after the data arrived in " << DATA_DELAY_SEC << " sec");
+      numberOfErrors++;
+    }
+
+    dataCollector->Stop();
+    dataCollector->Disconnect();
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  bool failingDevice(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--failing-device", vtksys::CommandLineArguments::NO_ARGUMENT, &failingDevice, "Test that a device failing to connect is handled (errors are logged).");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors = 0;
+
+  // Parallel connection is opt-in
+  vtkSmartPointer<vtkPlusDataCollector> defaultDataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+  if (defaultDataCollector->GetNumberOfConnectionThreads() != 1)
+  {
+    LOG_ERROR("Default NumberOfConnectionThreads is " << defaultDataCollector->GetNumberOfConnectionThreads() << ", expected 1");
+    numberOfErrors++;
+  }
+
+  numberOfErrors += TestConnectAndStart(0, failingDevice);
+  numberOfErrors += TestConnectAndStart(1, failingDevice);
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusSequenceFileStreamerTest.cxx
+  \brief Verifies that PlusSequenceFileStreamer provides the same frames as vtkIGSIOSequenceIO::Read for uncompressed
+  MetaImage and NRRD sequence files, that the frame index is reused from the cache, and that the number of
+  prefetched frames is limited to the prefetch window.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusSequenceFileStreamer.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkPlusSequenceIO.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <igsioVideoFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+  const int NUMBER_OF_FRAMES = 20;
+  const unsigned int FRAME_WIDTH = 64;
+  const unsigned int FRAME_HEIGHT = 48;
+  const int PREFETCH_WINDOW_FRAMES = 5;
+  const double PREFETCH_TIMEOUT_SEC = 2.0;
+
+  //----------------------------------------------------------------------------
+  void CreateTrackedFrameList(vtkIGSIOTrackedFrameList* trackedFrameList)
+  {
+    FrameSizeType frameSize = {FRAME_WIDTH, FRAME_HEIGHT, 1};
+    for (int frameIndex = 0; frameIndex < NUMBER_OF_FRAMES; ++frameIndex)
+    {
+      igsioVideoFrame image;
+      image.AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+      unsigned char* pixel = static_cast<unsigned char*>(image.GetScalarPointer());
+      for (unsigned int y = 0; y < FRAME_HEIGHT; ++y)
+      {
+        for (unsigned int x = 0; x < FRAME_WIDTH; ++x)
+        {
+          *(pixel++) = static_cast<unsigned char>(frameIndex * 3 + x + y * 2);
+        }
+      }
+      image.SetImageOrientation(US_IMG_ORIENT_MF);
+      image.SetImageType(US_IMG_BRIGHTNESS);
+
+      igsioTrackedFrame trackedFrame;
+      trackedFrame.SetImageData(image);
+      trackedFrame.SetTimestamp(1.0 + frameIndex * 0.05);
+      vtkSmartPointer<vtkMatrix4x4> probeToTracker = vtkSmartPointer<vtkMatrix4x4>::New();
+      probeToTracker->SetElement(0, 3, frameIndex * 1.5);
+      trackedFrame.SetFrameTransform(igsioTransformName("Probe", "Tracker"), probeToTracker);
+      trackedFrame.SetFrameTransformStatus(igsioTransformName("Probe", "Tracker"), TOOL_OK);
+      trackedFrameList->AddTrackedFrame(&trackedFrame);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareFrames(PlusSequenceFileStreamer& streamer, vtkIGSIOTrackedFrameList* referenceFrameList, const std::string& description)
+  {
+    int numberOfErrors = 0;
+    if (streamer.GetNumberOfFrames() != static_cast<int>(referenceFrameList->GetNumberOfTrackedFrames()))
+    {
+      LOG_ERROR(description << ": number of frames mismatch (expected: " << referenceFrameList->GetNumberOfTrackedFrames() << ", actual: " << streamer.GetNumberOfFrames() << ")");
+      return 1;
+    }
+    for (int frameIndex = 0; frameIndex < streamer.GetNumberOfFrames(); ++frameIndex)
+    {
+      igsioTrackedFrame* referenceFrame = referenceFrameList->GetTrackedFrame(frameIndex);
+      if (fabs(streamer.GetFrameTimestamp(frameIndex) - referenceFrame->GetTimestamp()) > 1e-6)
+      {
+        LOG_ERROR(description << ": timestamp mismatch in frame " << frameIndex);
+        numberOfErrors++;
+      }
+      if (streamer.GetFrameSizeInBytes() != referenceFrame->GetImageData()->GetFrameSizeInBytes()
+          || memcmp(streamer.GetFramePixelData(frameIndex), referenceFrame->GetImageData()->GetScalarPointer(), streamer.GetFrameSizeInBytes()) != 0)
+      {
+        LOG_ERROR(description << ": pixel data mismatch in frame " << frameIndex);
+        numberOfErrors++;
+      }
+      const igsioFieldMapType& customFields = streamer.GetFrameCustomFields(frameIndex);
+      igsioFieldMapType::const_iterator transformField = customFields.find("ProbeToTrackerTransform");
+      if (transformField == customFields.end() || transformField->second.second != referenceFrame->GetFrameField("ProbeToTrackerTransform"))
+      {
+        LOG_ERROR(description << ": transform mismatch in frame " << frameIndex);
+        numberOfErrors++;
+      }
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestSequenceFile(const std::string& filePath, vtkIGSIOTrackedFrameList* trackedFrameList)
+  {
+    int numberOfErrors = 0;
+    vtksys::SystemTools::RemoveFile(PlusSequenceFileStreamer::GetIndexCacheFilePath(filePath));
+    if (vtkPlusSequenceIO::Write(filePath, trackedFrameList, US_IMG_ORIENT_MF, false) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to write " << filePath);
+      return 1;
+    }
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> referenceFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (vtkPlusSequenceIO::Read(filePath, referenceFrameList) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read " << filePath);
+      return 1;
+    }
+
+    // The first open builds the index from the header, the second one reads it from the cache
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      bool expectIndexFromCache = (pass > 0);
+      PlusSequenceFileStreamer streamer;
+      streamer.SetPrefetchWindowFrames(PREFETCH_WINDOW_FRAMES);
+      if (streamer.Open(filePath) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to open " << filePath << " for streaming");
+        numberOfErrors++;
+        continue;
+      }
+      if (streamer.IsIndexReadFromCache() != expectIndexFromCache)
+      {
+        LOG_ERROR(filePath << ": frame index is " << (expectIndexFromCache ? "not " : "") << "read from the cache");
+        numberOfErrors++;
+      }
+      numberOfErrors += CompareFrames(streamer, referenceFrameList, filePath);
+
+      // Prefetch window wraps around to the beginning of the loop
+      streamer.SetReplayPosition(NUMBER_OF_FRAMES - 2, 0, NUMBER_OF_FRAMES - 1, true);
+      double waitStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      while (streamer.GetNumberOfPrefetchedFrames() != PREFETCH_WINDOW_FRAMES && vtkIGSIOAccurateTimer::GetSystemTime() - waitStartTime < PREFETCH_TIMEOUT_SEC)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      // Wait a bit more to make sure that frames outside of the window have been released
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      if (streamer.GetNumberOfPrefetchedFrames() != PREFETCH_WINDOW_FRAMES)
+      {
+        LOG_ERROR(filePath << ": number of prefetched frames is " << streamer.GetNumberOfPrefetchedFrames() << ", expected " << PREFETCH_WINDOW_FRAMES);
+        numberOfErrors++;
+      }
+    }
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  CreateTrackedFrameList(trackedFrameList);
+
+  LOG_INFO("Streaming uncompressed MetaImage file");
+  numberOfErrors += TestSequenceFile(vtkPlusConfig::GetInstance()->GetOutputPath("SequenceFileStreamerTest.mha"), trackedFrameList);
+
+  LOG_INFO("Streaming uncompressed NRRD file");
+  numberOfErrors += TestSequenceFile(vtkPlusConfig::GetInstance()->GetOutputPath("SequenceFileStreamerTest.nrrd"), trackedFrameList);
+
+  LOG_INFO("Compressed files are not streamed");
+  std::string compressedFilePath = vtkPlusConfig::GetInstance()->GetOutputPath("SequenceFileStreamerTestCompressed.mha");
+  vtksys::SystemTools::RemoveFile(PlusSequenceFileStreamer::GetIndexCacheFilePath(compressedFilePath));
+  if (vtkPlusSequenceIO::Write(compressedFilePath, trackedFrameList, US_IMG_ORIENT_MF, true) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write " << compressedFilePath);
+    numberOfErrors++;
+  }
+  else
+  {
+    PlusSequenceFileStreamer streamer;
+    if (streamer.Open(compressedFilePath) == PLUS_SUCCESS)
+    {
+      LOG_ERROR("Compressed file is opened for streaming");
+      numberOfErrors++;
+    }
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
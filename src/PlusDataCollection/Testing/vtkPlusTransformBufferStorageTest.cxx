@@ -0,0 +1,215 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusTransformBufferStorageTest.cxx
+  \brief Verifies that a buffer with compact transform storage returns the same items (exact, closest and interpolated)
+  as a buffer that stores the transforms in the buffer items.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusBuffer.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <cmath>
+
+namespace
+{
+  const int NUMBER_OF_ITEMS = 300;
+  const int BUFFER_SIZE = 200;
+  const double MATRIX_TOLERANCE = 1e-9;
+
+  //----------------------------------------------------------------------------
+  void FillBuffer(vtkPlusBuffer* buffer)
+  {
+    vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+    for (int i = 0; i < NUMBER_OF_ITEMS; ++i)
+    {
+      transform->Identity();
+      transform->Translate(i * 0.5, -i * 0.25, 10.0);
+      transform->RotateZ(i * 0.8);
+      transform->RotateX(i * 0.3);
+      // Every 10th item is missing, to test that interpolation is not performed across them
+      ToolStatus status = (i % 10 == 9) ? TOOL_MISSING : TOOL_OK;
+      igsioFieldMapType fields;
+      if (i % 3 == 0)
+      {
+        fields["Quality"] = std::make_pair(FRAMEFIELD_NONE, igsioCommon::ToString<int>(i));
+      }
+      double timestamp = 1.0 + i * 0.01;
+      buffer->AddTimeStampedItem(transform->GetMatrix(), status, i, timestamp, timestamp, &fields);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareItems(StreamBufferItem& expected, StreamBufferItem& actual, const std::string& description)
+  {
+    int numberOfErrors = 0;
+    if (expected.GetStatus() != actual.GetStatus())
+    {
+      LOG_ERROR(description << ": status mismatch (expected: " << expected.GetStatus() << ", actual: " << actual.GetStatus() << ")");
+      numberOfErrors++;
+    }
+    if (fabs(expected.GetFilteredTimestamp(0) - actual.GetFilteredTimestamp(0)) > MATRIX_TOLERANCE
+        || fabs(expected.GetUnfilteredTimestamp(0) - actual.GetUnfilteredTimestamp(0)) > MATRIX_TOLERANCE)
+    {
+      LOG_ERROR(description << ": timestamp mismatch");
+      numberOfErrors++;
+    }
+    if (expected.GetIndex() != actual.GetIndex())
+    {
+      LOG_ERROR(description << ": index mismatch (expected: " << expected.GetIndex() << ", actual: " << actual.GetIndex() << ")");
+      numberOfErrors++;
+    }
+    vtkSmartPointer<vtkMatrix4x4> expectedMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    expected.GetMatrix(expectedMatrix);
+    vtkSmartPointer<vtkMatrix4x4> actualMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    actual.GetMatrix(actualMatrix);
+    for (int row = 0; row < 4; ++row)
+    {
+      for (int col = 0; col < 4; ++col)
+      {
+        if (fabs(expectedMatrix->GetElement(row, col) - actualMatrix->GetElement(row, col)) > MATRIX_TOLERANCE)
+        {
+          LOG_ERROR(description << ": matrix mismatch at (" << row << ", " << col << "): expected " << expectedMatrix->GetElement(row, col) << ", actual " << actualMatrix->GetElement(row, col));
+          numberOfErrors++;
+        }
+      }
+    }
+    if (expected.GetFrameField("Quality") != actual.GetFrameField("Quality"))
+    {
+      LOG_ERROR(description << ": custom field mismatch (expected: " << expected.GetFrameField("Quality") << ", actual: " << actual.GetFrameField("Quality") << ")");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareBuffers(vtkPlusBuffer* expectedBuffer, vtkPlusBuffer* actualBuffer)
+  {
+    int numberOfErrors = 0;
+    if (expectedBuffer->GetNumberOfItems() != actualBuffer->GetNumberOfItems())
+    {
+      LOG_ERROR("Number of items mismatch (expected: " << expectedBuffer->GetNumberOfItems() << ", actual: " << actualBuffer->GetNumberOfItems() << ")");
+      return 1;
+    }
+
+    double oldestTimestamp = 0;
+    double latestTimestamp = 0;
+    expectedBuffer->GetOldestTimeStamp(oldestTimestamp);
+    expectedBuffer->GetLatestTimeStamp(latestTimestamp);
+    for (double time = oldestTimestamp; time <= latestTimestamp; time += 0.0037)
+    {
+      StreamBufferItem expectedItem;
+      StreamBufferItem actualItem;
+      if (expectedBuffer->GetStreamBufferItemFromTime(time, &expectedItem, vtkPlusBuffer::INTERPOLATED) != ITEM_OK
+          || actualBuffer->GetStreamBufferItemFromTime(time, &actualItem, vtkPlusBuffer::INTERPOLATED) != ITEM_OK)
+      {
+        LOG_ERROR("Failed to get interpolated item at time " << time);
+        numberOfErrors++;
+        continue;
+      }
+      numberOfErrors += CompareItems(expectedItem, actualItem, "Interpolated item at time " + igsioCommon::ToString<double>(time));
+
+      if (expectedBuffer->GetStreamBufferItemFromTime(time, &expectedItem, vtkPlusBuffer::CLOSEST_TIME) != ITEM_OK
+          || actualBuffer->GetStreamBufferItemFromTime(time, &actualItem, vtkPlusBuffer::CLOSEST_TIME) != ITEM_OK)
+      {
+        LOG_ERROR("Failed to get closest item at time " << time);
+        numberOfErrors++;
+        continue;
+      }
+      numberOfErrors += CompareItems(expectedItem, actualItem, "Closest item at time " + igsioCommon::ToString<double>(time));
+    }
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  vtkSmartPointer<vtkPlusBuffer> referenceBuffer = vtkSmartPointer<vtkPlusBuffer>::New();
+  referenceBuffer->SetBufferSize(BUFFER_SIZE);
+  if (referenceBuffer->GetCompactTransformStorage())
+  {
+    LOG_ERROR("Compact transform storage must be disabled by default");
+    numberOfErrors++;
+  }
+  FillBuffer(referenceBuffer);
+
+  vtkSmartPointer<vtkPlusBuffer> compactBuffer = vtkSmartPointer<vtkPlusBuffer>::New();
+  compactBuffer->SetBufferSize(BUFFER_SIZE);
+  compactBuffer->SetCompactTransformStorage(true);
+  FillBuffer(compactBuffer);
+
+  LOG_INFO("Compare buffer with compact transform storage to reference buffer");
+  numberOfErrors += CompareBuffers(referenceBuffer, compactBuffer);
+
+  LOG_INFO("Compare after enabling compact storage on a buffer that already contains items");
+  vtkSmartPointer<vtkPlusBuffer> convertedBuffer = vtkSmartPointer<vtkPlusBuffer>::New();
+  convertedBuffer->SetBufferSize(BUFFER_SIZE);
+  FillBuffer(convertedBuffer);
+  convertedBuffer->SetCompactTransformStorage(true);
+  numberOfErrors += CompareBuffers(referenceBuffer, convertedBuffer);
+
+  LOG_INFO("Compare after disabling compact storage");
+  convertedBuffer->SetCompactTransformStorage(false);
+  numberOfErrors += CompareBuffers(referenceBuffer, convertedBuffer);
+
+  LOG_INFO("Compare after changing buffer size");
+  referenceBuffer->SetBufferSize(BUFFER_SIZE / 2);
+  compactBuffer->SetBufferSize(BUFFER_SIZE / 2);
+  numberOfErrors += CompareBuffers(referenceBuffer, compactBuffer);
+
+  LOG_INFO("Compare after deep copy");
+  vtkSmartPointer<vtkPlusBuffer> copiedBuffer = vtkSmartPointer<vtkPlusBuffer>::New();
+  copiedBuffer->DeepCopy(compactBuffer);
+  if (!copiedBuffer->GetCompactTransformStorage())
+  {
+    LOG_ERROR("Compact transform storage setting is not copied");
+    numberOfErrors++;
+  }
+  numberOfErrors += CompareBuffers(referenceBuffer, copiedBuffer);
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
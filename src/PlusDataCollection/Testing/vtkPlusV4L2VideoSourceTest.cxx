@@ -0,0 +1,508 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusV4L2VideoSourceTest.cxx
+  \brief Acquires frames from an in-process fake V4L2 device through vtkPlusV4L2VideoSource, without hardware.
+
+  The fake device overwrites the content of a buffer whenever it is queued (the driver may write into a queued
+  buffer at any time), therefore a frame that is requeued before its pixels are copied into the Plus buffer
+  is detected as corrupted. The test also verifies that the number of dropped frames (the fake device skips
+  sequence numbers), the capture latency and the buffer hold time are reported, in MMAP and in DMABUF mode.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusV4L2DeviceInterface.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkPlusChannel.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusV4L2VideoSource.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// OS includes
+#include <errno.h>
+#include <linux/dma-buf.h>
+#include <linux/videodev2.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  const char* FAKE_DEVICE_NAME = "/dev/fake-video";
+  const int DEVICE_FILE_DESCRIPTOR = 100;
+  const int FIRST_DMABUF_FILE_DESCRIPTOR = 200;
+  const unsigned int FRAME_WIDTH = 64;
+  const unsigned int FRAME_HEIGHT = 48;
+  /*! Every DROP_INTERVAL-th frame is skipped by the fake device */
+  const unsigned int DROP_INTERVAL = 5;
+  const double FRAME_PERIOD_SEC = 0.002;
+  /*! Age of the driver timestamp when the buffer is dequeued */
+  const double CAPTURE_DELAY_SEC = 0.005;
+  const unsigned long NUMBER_OF_FRAMES_TO_ACQUIRE = 40;
+  const double ACQUISITION_TIMEOUT_SEC = 10.0;
+  const unsigned char QUEUED_BUFFER_FILL_VALUE = 0xA5;
+
+  //----------------------------------------------------------------------------
+  class FakeV4L2Device : public PlusV4L2DeviceInterface
+  {
+  public:
+    FakeV4L2Device()
+      : Streaming(false)
+      , NextSequence(0)
+      , NumberOfDeliveredFrames(0)
+      , NumberOfSkippedFrames(0)
+      , NumberOfQueueErrors(0)
+      , NumberOfSyncErrors(0)
+      , NumberOfExportedBuffers(0)
+      , NumberOfClosedDmaBufs(0)
+      , NumberOfSyncedFrames(0)
+      , NumberOfBuffersHeld(0)
+      , MaximumNumberOfBuffersHeld(0)
+    {
+    }
+
+    virtual int Stat(const std::string& path, struct stat* st)
+    {
+      if (path != FAKE_DEVICE_NAME)
+      {
+        errno = ENOENT;
+        return -1;
+      }
+      memset(st, 0, sizeof(struct stat));
+      st->st_mode = S_IFCHR;
+      return 0;
+    }
+
+    virtual int Open(const std::string& path, int flags)
+    {
+      return DEVICE_FILE_DESCRIPTOR;
+    }
+
+    virtual int Close(int fd)
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      if (fd >= FIRST_DMABUF_FILE_DESCRIPTOR)
+      {
+        this->NumberOfClosedDmaBufs++;
+      }
+      return 0;
+    }
+
+    virtual int Ioctl(int fd, unsigned long int request, void* arg)
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      if (fd >= FIRST_DMABUF_FILE_DESCRIPTOR)
+      {
+        return this->DmaBufIoctl(fd - FIRST_DMABUF_FILE_DESCRIPTOR, request, arg);
+      }
+      switch (request)
+      {
+        case VIDIOC_QUERYCAP:
+        {
+          v4l2_capability* cap = static_cast<v4l2_capability*>(arg);
+          memset(cap, 0, sizeof(v4l2_capability));
+          cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING | V4L2_CAP_READWRITE;
+          return 0;
+        }
+        case VIDIOC_G_FMT:
+        case VIDIOC_S_FMT:
+        {
+          v4l2_format* format = static_cast<v4l2_format*>(arg);
+          format->fmt.pix.width = FRAME_WIDTH;
+          format->fmt.pix.height = FRAME_HEIGHT;
+          format->fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+          format->fmt.pix.field = V4L2_FIELD_NONE;
+          format->fmt.pix.bytesperline = FRAME_WIDTH;
+          format->fmt.pix.sizeimage = FRAME_WIDTH * FRAME_HEIGHT;
+          return 0;
+        }
+        case VIDIOC_REQBUFS:
+        {
+          v4l2_requestbuffers* req = static_cast<v4l2_requestbuffers*>(arg);
+          this->Buffers.assign(req->count, std::vector<unsigned char>(FRAME_WIDTH * FRAME_HEIGHT, 0));
+          this->BufferQueued.assign(req->count, false);
+          this->BufferSynced.assign(req->count, false);
+          return 0;
+        }
+        case VIDIOC_QUERYBUF:
+        {
+          v4l2_buffer* buf = static_cast<v4l2_buffer*>(arg);
+          buf->length = FRAME_WIDTH * FRAME_HEIGHT;
+          buf->m.offset = buf->index * FRAME_WIDTH * FRAME_HEIGHT;
+          return 0;
+        }
+        case VIDIOC_EXPBUF:
+        {
+          v4l2_exportbuffer* expbuf = static_cast<v4l2_exportbuffer*>(arg);
+          expbuf->fd = FIRST_DMABUF_FILE_DESCRIPTOR + expbuf->index;
+          this->NumberOfExportedBuffers++;
+          return 0;
+        }
+        case VIDIOC_QBUF:
+        {
+          v4l2_buffer* buf = static_cast<v4l2_buffer*>(arg);
+          if (buf->index >= this->Buffers.size() || this->BufferQueued[buf->index] || this->BufferSynced[buf->index])
+          {
+            this->NumberOfQueueErrors++;
+            errno = EINVAL;
+            return -1;
+          }
+          if (this->Streaming)
+          {
+            this->NumberOfBuffersHeld--;
+          }
+          this->BufferQueued[buf->index] = true;
+          this->Queue.push_back(buf->index);
+          // The driver may write into a queued buffer at any time
+          memset(&this->Buffers[buf->index][0], QUEUED_BUFFER_FILL_VALUE, this->Buffers[buf->index].size());
+          return 0;
+        }
+        case VIDIOC_DQBUF:
+        {
+          if (!this->Streaming || this->Queue.empty())
+          {
+            errno = EAGAIN;
+            return -1;
+          }
+          unsigned int index = this->Queue.front();
+          this->Queue.pop_front();
+          this->BufferQueued[index] = false;
+          this->NumberOfBuffersHeld++;
+          this->MaximumNumberOfBuffersHeld = std::max(this->MaximumNumberOfBuffersHeld, this->NumberOfBuffersHeld);
+
+          if ((this->NumberOfDeliveredFrames + 1) % DROP_INTERVAL == 0)
+          {
+            this->NextSequence++;
+            this->NumberOfSkippedFrames++;
+          }
+          uint32_t sequence = this->NextSequence++;
+          std::vector<unsigned char>& pixels = this->Buffers[index];
+          for (size_t i = 0; i < pixels.size(); ++i)
+          {
+            pixels[i] = static_cast<unsigned char>(sequence * 7 + i);
+          }
+          this->NumberOfDeliveredFrames++;
+
+          v4l2_buffer* buf = static_cast<v4l2_buffer*>(arg);
+          buf->index = index;
+          buf->bytesused = static_cast<uint32_t>(pixels.size());
+          buf->sequence = sequence;
+          buf->flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+          timespec now;
+          clock_gettime(CLOCK_MONOTONIC, &now);
+          long long timestampUsec = now.tv_sec * 1000000LL + now.tv_nsec / 1000 - static_cast<long long>(CAPTURE_DELAY_SEC * 1e6);
+          buf->timestamp.tv_sec = timestampUsec / 1000000;
+          buf->timestamp.tv_usec = timestampUsec % 1000000;
+          return 0;
+        }
+        case VIDIOC_STREAMON:
+        {
+          this->Streaming = true;
+          return 0;
+        }
+        case VIDIOC_STREAMOFF:
+        {
+          // All buffers are returned to the application
+          this->Streaming = false;
+          this->Queue.clear();
+          this->BufferQueued.assign(this->BufferQueued.size(), false);
+          this->NumberOfBuffersHeld = 0;
+          return 0;
+        }
+        default:
+        {
+          // Cropping, format enumeration, etc. are not supported
+          errno = EINVAL;
+          return -1;
+        }
+      }
+    }
+
+    virtual void* Mmap(size_t length, int prot, int flags, int fd, off_t offset)
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      size_t index = (fd >= FIRST_DMABUF_FILE_DESCRIPTOR) ? static_cast<size_t>(fd - FIRST_DMABUF_FILE_DESCRIPTOR) : offset / (FRAME_WIDTH * FRAME_HEIGHT);
+      if (index >= this->Buffers.size() || length > this->Buffers[index].size())
+      {
+        errno = EINVAL;
+        return MAP_FAILED;
+      }
+      return &this->Buffers[index][0];
+    }
+
+    virtual int Munmap(void* start, size_t length)
+    {
+      return 0;
+    }
+
+    virtual ssize_t Read(int fd, void* buffer, size_t count)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    virtual int WaitForFrame(int fd, double timeoutSec)
+    {
+      std::this_thread::sleep_for(std::chrono::duration<double>(FRAME_PERIOD_SEC));
+      return 1;
+    }
+
+    std::mutex Mutex;
+    std::vector<std::vector<unsigned char>> Buffers;
+    std::vector<bool> BufferQueued;
+    std::vector<bool> BufferSynced;
+    std::deque<unsigned int> Queue;
+    bool Streaming;
+    uint32_t NextSequence;
+    unsigned long NumberOfDeliveredFrames;
+    unsigned long NumberOfSkippedFrames;
+    int NumberOfQueueErrors;
+    int NumberOfSyncErrors;
+    unsigned int NumberOfExportedBuffers;
+    unsigned int NumberOfClosedDmaBufs;
+    unsigned long NumberOfSyncedFrames;
+    int NumberOfBuffersHeld;
+    int MaximumNumberOfBuffersHeld;
+
+  protected:
+    int DmaBufIoctl(unsigned int index, unsigned long int request, void* arg)
+    {
+      if (request != DMA_BUF_IOCTL_SYNC || index >= this->Buffers.size())
+      {
+        errno = EINVAL;
+        return -1;
+      }
+      dma_buf_sync* sync = static_cast<dma_buf_sync*>(arg);
+      bool start = (sync->flags & DMA_BUF_SYNC_END) == 0;
+      // CPU access is only allowed while the buffer is dequeued, start and end have to be paired
+      if (this->BufferQueued[index] || this->BufferSynced[index] == start)
+      {
+        this->NumberOfSyncErrors++;
+      }
+      this->BufferSynced[index] = start;
+      if (!start)
+      {
+        this->NumberOfSyncedFrames++;
+      }
+      return 0;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  int CheckAcquiredFrames(vtkPlusDataSource* videoSource)
+  {
+    int numberOfErrors = 0;
+    int numberOfCorruptedFrames = 0;
+    for (BufferItemUidType uid = videoSource->GetOldestItemUidInBuffer(); uid <= videoSource->GetLatestItemUidInBuffer(); ++uid)
+    {
+      StreamBufferItem item;
+      if (videoSource->GetStreamBufferItem(uid, &item) != ITEM_OK)
+      {
+        LOG_ERROR("Failed to get buffer item " << uid);
+        numberOfErrors++;
+        continue;
+      }
+      const unsigned char* pixels = static_cast<const unsigned char*>(item.GetFrame().GetScalarPointer());
+      for (unsigned int i = 1; i < FRAME_WIDTH * FRAME_HEIGHT; ++i)
+      {
+        if (pixels[i] != static_cast<unsigned char>(pixels[0] + i))
+        {
+          numberOfCorruptedFrames++;
+          break;
+        }
+      }
+    }
+    if (numberOfCorruptedFrames > 0)
+    {
+      LOG_ERROR(numberOfCorruptedFrames << " frames were overwritten by the device before they were copied into the buffer");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestAcquisition(bool exportDmaBuf)
+  {
+    std::string configString = std::string(
+                                 "<PlusConfiguration version=\"2.1\">"
+                                 "  <DataCollection StartupDelaySec=\"0\">"
+                                 "    <Device Id=\"VideoDevice\" Type=\"V4L2Video\" AcquisitionRate=\"200\" DeviceName=\"") + FAKE_DEVICE_NAME + "\""
+                               "      IOMethod=\"IO_METHOD_MMAP\" ExportDmaBuf=\"" + (exportDmaBuf ? "TRUE" : "FALSE") + "\">"
+                               "      <DataSources>"
+                               "        <DataSource Type=\"Video\" Id=\"Video\" PortUsImageOrientation=\"MF\" ImageType=\"BRIGHTNESS\" BufferSize=\"100\" />"
+                               "      </DataSources>"
+                               "      <OutputChannels>"
+                               "        <OutputChannel Id=\"VideoStream\" VideoDataSourceId=\"Video\" />"
+                               "      </OutputChannels>"
+                               "    </Device>"
+                               "  </DataCollection>"
+                               "</PlusConfiguration>";
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(configString.c_str()));
+
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+    if (configRootElement == NULL || dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read the configuration");
+      return 1;
+    }
+    vtkPlusDevice* device = NULL;
+    dataCollector->GetDevice(device, "VideoDevice");
+    vtkPlusV4L2VideoSource* videoDevice = vtkPlusV4L2VideoSource::SafeDownCast(device);
+    if (videoDevice == NULL)
+    {
+      LOG_ERROR("V4L2 video device is not found");
+      return 1;
+    }
+    std::shared_ptr<FakeV4L2Device> fakeDevice = std::make_shared<FakeV4L2Device>();
+    videoDevice->SetDeviceInterface(fakeDevice);
+
+    if (dataCollector->Connect() != PLUS_SUCCESS || dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to start acquisition from the fake device");
+      return 1;
+    }
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    while (videoDevice->GetNumberOfCapturedFrames() < NUMBER_OF_FRAMES_TO_ACQUIRE && vtkIGSIOAccurateTimer::GetSystemTime() - startTime < ACQUISITION_TIMEOUT_SEC)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    dataCollector->Stop();
+
+    int numberOfErrors = 0;
+    vtkPlusDataSource* videoSource = NULL;
+    if (videoDevice->GetFirstActiveOutputVideoSource(videoSource) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Video source is not found");
+      numberOfErrors++;
+    }
+    else
+    {
+      numberOfErrors += CheckAcquiredFrames(videoSource);
+    }
+
+    LOG_INFO("Captured frames: " << videoDevice->GetNumberOfCapturedFrames() << ", dropped frames: " << videoDevice->GetNumberOfDroppedFrames()
+             << ", average capture latency: " << videoDevice->GetAverageCaptureLatencySec() * 1000 << " ms"
+             << ", average buffer hold time: " << videoDevice->GetAverageBufferHoldTimeSec() * 1000 << " ms"
+             << ", maximum buffer hold time: " << videoDevice->GetMaximumBufferHoldTimeSec() * 1000 << " ms");
+    if (videoDevice->GetNumberOfCapturedFrames() < NUMBER_OF_FRAMES_TO_ACQUIRE)
+    {
+      LOG_ERROR("Only " << videoDevice->GetNumberOfCapturedFrames() << " frames were captured in " << ACQUISITION_TIMEOUT_SEC << " sec");
+      numberOfErrors++;
+    }
+    if (videoDevice->GetNumberOfCapturedFrames() != fakeDevice->NumberOfDeliveredFrames)
+    {
+      LOG_ERROR("Number of captured frames is " << videoDevice->GetNumberOfCapturedFrames() << ", the device delivered " << fakeDevice->NumberOfDeliveredFrames);
+      numberOfErrors++;
+    }
+    if (videoDevice->GetNumberOfDroppedFrames() != fakeDevice->NumberOfSkippedFrames || fakeDevice->NumberOfSkippedFrames == 0)
+    {
+      LOG_ERROR("Number of dropped frames is " << videoDevice->GetNumberOfDroppedFrames() << ", the device skipped " << fakeDevice->NumberOfSkippedFrames);
+      numberOfErrors++;
+    }
+    if (videoDevice->GetAverageCaptureLatencySec() < CAPTURE_DELAY_SEC - 1e-6 || videoDevice->GetAverageCaptureLatencySec() > 1.0)
+    {
+      LOG_ERROR("Average capture latency is " << videoDevice->GetAverageCaptureLatencySec() << " sec, expected at least " << CAPTURE_DELAY_SEC << " sec");
+      numberOfErrors++;
+    }
+    if (videoDevice->GetMaximumBufferHoldTimeSec() <= 0.0 || videoDevice->GetMaximumBufferHoldTimeSec() > 1.0)
+    {
+      LOG_ERROR("Maximum buffer hold time is " << videoDevice->GetMaximumBufferHoldTimeSec() << " sec");
+      numberOfErrors++;
+    }
+    if (fakeDevice->NumberOfQueueErrors != 0)
+    {
+      LOG_ERROR(fakeDevice->NumberOfQueueErrors << " buffers were queued while they were already queued or accessed by the CPU");
+      numberOfErrors++;
+    }
+    if (fakeDevice->MaximumNumberOfBuffersHeld != 1)
+    {
+      LOG_ERROR("Maximum number of buffers held by the application is " << fakeDevice->MaximumNumberOfBuffersHeld << ", expected 1");
+      numberOfErrors++;
+    }
+
+    unsigned int expectedNumberOfExportedBuffers = (exportDmaBuf ? static_cast<unsigned int>(fakeDevice->Buffers.size()) : 0);
+    unsigned long expectedNumberOfSyncedFrames = (exportDmaBuf ? fakeDevice->NumberOfDeliveredFrames : 0);
+    if (fakeDevice->NumberOfExportedBuffers != expectedNumberOfExportedBuffers)
+    {
+      LOG_ERROR("Number of exported buffers is " << fakeDevice->NumberOfExportedBuffers << ", expected " << expectedNumberOfExportedBuffers);
+      numberOfErrors++;
+    }
+    if (fakeDevice->NumberOfSyncedFrames != expectedNumberOfSyncedFrames || fakeDevice->NumberOfSyncErrors != 0)
+    {
+      LOG_ERROR("CPU access to " << fakeDevice->NumberOfSyncedFrames << " frames was synchronized (expected " << expectedNumberOfSyncedFrames << "), "
+                << fakeDevice->NumberOfSyncErrors << " synchronization errors");
+      numberOfErrors++;
+    }
+
+    dataCollector->Disconnect();
+    if (fakeDevice->NumberOfClosedDmaBufs != expectedNumberOfExportedBuffers)
+    {
+      LOG_ERROR("Number of closed DMABUF file descriptors is " << fakeDevice->NumberOfClosedDmaBufs << ", expected " << expectedNumberOfExportedBuffers);
+      numberOfErrors++;
+    }
+
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  LOG_INFO("Acquisition using memory mapped buffers");
+  numberOfErrors += TestAcquisition(false);
+
+  LOG_INFO("Acquisition using exported DMABUF buffers");
+  numberOfErrors += TestAcquisition(true);
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
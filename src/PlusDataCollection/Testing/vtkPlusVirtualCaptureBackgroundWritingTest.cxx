@@ -0,0 +1,234 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusVirtualCaptureBackgroundWritingTest.cxx
+  \brief Records frames with background writing using each write queue full policy (Block, Drop, Spill) and
+  checks that the number of frames in the header of the written file matches the number of recorded frames.
+
+  The write queue is kept small, so that the queue is full most of the time while the frames are queued.
+  Dropped frames must not be counted in the header, spilled frames must be written to the file in their original order.
+  With Spill policy the number of frames that wait in memory for being moved to a temporary file must remain limited.
+*/
+
+#include "PlusConfigure.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOTrackedFrameList.h"
+#include "vtkPlusSequenceIO.h"
+#include "vtkPlusVirtualCapture.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtksys/CommandLineArguments.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <algorithm>
+
+namespace
+{
+  const unsigned int FRAME_WIDTH = 256;
+  const unsigned int FRAME_HEIGHT = 256;
+  const unsigned int NUMBER_OF_BATCHES = 40;
+  const unsigned int FRAMES_PER_BATCH = 3;
+  const unsigned int WRITE_QUEUE_MAX_FRAMES = 4;
+
+  //----------------------------------------------------------------------------
+  /*! Gives access to the write queue, so that frames can be queued without an input channel */
+  class vtkPlusVirtualCaptureQueueTester : public vtkPlusVirtualCapture
+  {
+  public:
+    static vtkPlusVirtualCaptureQueueTester* New();
+    vtkTypeMacro(vtkPlusVirtualCaptureQueueTester, vtkPlusVirtualCapture);
+
+    PlusStatus QueueFrames(vtkIGSIOTrackedFrameList* frames)
+    {
+      if (this->WriteQueueFullPolicy == WRITE_QUEUE_FULL_BLOCK)
+      {
+        // Same as the data capture thread: sampling is postponed until there is space in the queue
+        std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+        this->WriteQueueChanged.wait(queueLock, [this]() { return this->NumberOfQueuedFramesInMemory < this->WriteQueueMaxFrames; });
+      }
+      else if (this->WriteQueueFullPolicy == WRITE_QUEUE_FULL_SPILL)
+      {
+        // Same as the data capture thread: sampling is postponed until the spill thread catches up
+        std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+        this->WriteQueueChanged.wait(queueLock, [this]() { return this->NumberOfQueuedFramesWaitingForSpill < this->WriteQueueMaxFrames; });
+      }
+      return this->QueueFramesForWriting(frames);
+    }
+    unsigned int GetNumberOfQueuedFramesWaitingForSpill()
+    {
+      std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+      return this->NumberOfQueuedFramesWaitingForSpill;
+    }
+    void StopWriting() { this->StopWriterThread(); }
+  };
+  vtkStandardNewMacro(vtkPlusVirtualCaptureQueueTester);
+
+  //----------------------------------------------------------------------------
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> CreateFrames(unsigned int firstFrameNumber)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    for (unsigned int frameNumber = firstFrameNumber; frameNumber < firstFrameNumber + FRAMES_PER_BATCH; ++frameNumber)
+    {
+      igsioTrackedFrame frame;
+      FrameSizeType frameSize = { FRAME_WIDTH, FRAME_HEIGHT, 1 };
+      frame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+      unsigned char* pixels = static_cast<unsigned char*>(frame.GetImageData()->GetScalarPointer());
+      for (unsigned int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; ++i)
+      {
+        pixels[i] = static_cast<unsigned char>(i + frameNumber);
+      }
+      frame.SetTimestamp(10.0 + frameNumber * 0.1);
+      frame.SetFrameField("FrameNumber", igsioCommon::ToString<unsigned int>(frameNumber));
+      frames->AddTrackedFrame(&frame);
+    }
+    return frames;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestWriteQueueFullPolicy(vtkPlusVirtualCapture::WriteQueueFullPolicyType policy, const std::string& policyName)
+  {
+    LOG_INFO("Test background writing with " << policyName << " policy");
+    int numberOfErrors = 0;
+
+    vtkSmartPointer<vtkPlusVirtualCaptureQueueTester> capture = vtkSmartPointer<vtkPlusVirtualCaptureQueueTester>::New();
+    capture->SetDeviceId("CaptureDevice" + policyName);
+    capture->SetEnableBackgroundWriting(true);
+    capture->SetWriteQueueMaxFrames(WRITE_QUEUE_MAX_FRAMES);
+    capture->SetWriteQueueFullPolicy(policy);
+    std::string fileName = "vtkPlusVirtualCaptureBackgroundWritingTest_" + policyName + ".nrrd";
+    if (capture->OpenFile(fileName.c_str()) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to open " << fileName);
+      return 1;
+    }
+
+    // Batches are queued without delay, so the writer thread cannot keep up
+    unsigned int numberOfQueuedFrames = 0;
+    unsigned int maxNumberOfFramesWaitingForSpill = 0;
+    for (unsigned int batchIndex = 0; batchIndex < NUMBER_OF_BATCHES; ++batchIndex)
+    {
+      vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = CreateFrames(batchIndex * FRAMES_PER_BATCH);
+      if (capture->QueueFrames(frames) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to queue frames with " << policyName << " policy");
+        numberOfErrors++;
+      }
+      numberOfQueuedFrames += frames->GetNumberOfTrackedFrames();
+      maxNumberOfFramesWaitingForSpill = std::max(maxNumberOfFramesWaitingForSpill, capture->GetNumberOfQueuedFramesWaitingForSpill());
+    }
+
+    std::string writtenFileName;
+    if (capture->CloseFile(fileName.c_str(), &writtenFileName) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to close " << fileName);
+      return numberOfErrors + 1;
+    }
+    unsigned long long numberOfDroppedFrames = capture->GetNumberOfDroppedFrames();
+    unsigned long long numberOfSpilledFrames = capture->GetNumberOfSpilledFrames();
+    capture->StopWriting();
+    LOG_INFO(policyName << " policy: " << numberOfQueuedFrames << " frames queued, " << numberOfDroppedFrames << " dropped, " << numberOfSpilledFrames << " spilled");
+
+    if (policy != vtkPlusVirtualCapture::WRITE_QUEUE_FULL_DROP && numberOfDroppedFrames != 0)
+    {
+      LOG_ERROR(numberOfDroppedFrames << " frames are dropped with " << policyName << " policy");
+      numberOfErrors++;
+    }
+    if (policy != vtkPlusVirtualCapture::WRITE_QUEUE_FULL_SPILL && numberOfSpilledFrames != 0)
+    {
+      LOG_ERROR(numberOfSpilledFrames << " frames are spilled with " << policyName << " policy");
+      numberOfErrors++;
+    }
+    // A batch is accepted if the limit is not reached yet, so the limit may be exceeded by one batch
+    if (maxNumberOfFramesWaitingForSpill > WRITE_QUEUE_MAX_FRAMES + FRAMES_PER_BATCH)
+    {
+      LOG_ERROR(maxNumberOfFramesWaitingForSpill << " frames were waiting in memory for spilling with " << policyName << " policy, expected at most " << WRITE_QUEUE_MAX_FRAMES + FRAMES_PER_BATCH);
+      numberOfErrors++;
+    }
+
+    // The number of frames is read from the header of the written file
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> writtenFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (vtkPlusSequenceIO::Read(writtenFileName, writtenFrames) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read " << writtenFileName);
+      return numberOfErrors + 1;
+    }
+    unsigned long long expectedNumberOfFrames = numberOfQueuedFrames - numberOfDroppedFrames;
+    if (writtenFrames->GetNumberOfTrackedFrames() != expectedNumberOfFrames)
+    {
+      LOG_ERROR("Number of frames in " << writtenFileName << " is " << writtenFrames->GetNumberOfTrackedFrames() << ", expected " << expectedNumberOfFrames);
+      numberOfErrors++;
+    }
+
+    // Frames must be in the original order, also the ones that were read back from temporary files
+    int previousFrameNumber = -1;
+    for (unsigned int i = 0; i < writtenFrames->GetNumberOfTrackedFrames(); ++i)
+    {
+      int frameNumber = -1;
+      igsioCommon::StringToInt<int>(writtenFrames->GetTrackedFrame(i)->GetFrameField("FrameNumber").c_str(), frameNumber);
+      if (frameNumber <= previousFrameNumber)
+      {
+        LOG_ERROR("Frame " << i << " in " << writtenFileName << " has frame number " << frameNumber << ", previous frame number is " << previousFrameNumber);
+        numberOfErrors++;
+        break;
+      }
+      previousFrameNumber = frameNumber;
+    }
+
+    vtksys::SystemTools::RemoveFile(writtenFileName);
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  // The capture device saves the device set configuration next to the recorded file
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::New();
+  configRootElement->SetName("PlusConfiguration");
+  vtkPlusConfig::GetInstance()->SetDeviceSetConfigurationData(configRootElement);
+
+  int numberOfErrors = 0;
+  numberOfErrors += TestWriteQueueFullPolicy(vtkPlusVirtualCapture::WRITE_QUEUE_FULL_BLOCK, "Block");
+  numberOfErrors += TestWriteQueueFullPolicy(vtkPlusVirtualCapture::WRITE_QUEUE_FULL_DROP, "Drop");
+  numberOfErrors += TestWriteQueueFullPolicy(vtkPlusVirtualCapture::WRITE_QUEUE_FULL_SPILL, "Spill");
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusVirtualVolumeReconstructorBackgroundInsertionTest.cxx
+  \brief Reconstructs the same tracked frames with and without background insertion and checks that the
+  reconstructed volumes are identical and that preview volumes are added to the preview output channel.
+
+  All the frames are queued without delay, so in background insertion mode the insertion thread is still pasting
+  when the reconstructed volume is requested. The volume must contain all the queued frames nevertheless.
+*/
+
+#include "PlusConfigure.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOTrackedFrameList.h"
+#include "vtkPlusChannel.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusVirtualVolumeReconstructor.h"
+#include "vtkPlusVolumeReconstructor.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+  const unsigned int FRAME_WIDTH = 64;
+  const unsigned int FRAME_HEIGHT = 48;
+  const unsigned int NUMBER_OF_BATCHES = 20;
+  const unsigned int FRAMES_PER_BATCH = 3;
+  const int PREVIEW_DOWNSAMPLING_FACTOR = 2;
+
+  //----------------------------------------------------------------------------
+  /*! Gives access to the frame insertion, so that frames can be added without a data collector */
+  class vtkPlusVirtualVolumeReconstructorTester : public vtkPlusVirtualVolumeReconstructor
+  {
+  public:
+    static vtkPlusVirtualVolumeReconstructorTester* New();
+    vtkTypeMacro(vtkPlusVirtualVolumeReconstructorTester, vtkPlusVirtualVolumeReconstructor);
+
+    PlusStatus Configure(vtkXMLDataElement* configRootElement, vtkPlusChannel* inputChannel)
+    {
+      if (this->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+      this->AddInputChannel(inputChannel);
+      return this->NotifyConfigured();
+    }
+
+    PlusStatus SetOutputExtentFromFrameList(vtkIGSIOTrackedFrameList* frames)
+    {
+      std::string errorDetail;
+      if (this->VolumeReconstructor->SetOutputExtentFromFrameList(frames, this->TransformRepository, errorDetail) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to set output extent: " << errorDetail);
+        return PLUS_FAIL;
+      }
+      return PLUS_SUCCESS;
+    }
+
+    /*! Same as the data capture thread after the frames are sampled from the input channel */
+    PlusStatus InsertFrames(vtkIGSIOTrackedFrameList* frames)
+    {
+      if (this->EnableBackgroundInsertion)
+      {
+        this->QueueFramesForInsertion(frames);
+        return PLUS_SUCCESS;
+      }
+      PlusStatus status = this->AddFrames(frames);
+      this->UpdatePreview();
+      return status;
+    }
+  };
+  vtkStandardNewMacro(vtkPlusVirtualVolumeReconstructorTester);
+
+  //----------------------------------------------------------------------------
+  vtkSmartPointer<vtkXMLDataElement> CreateConfiguration()
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration>" << std::endl
+           << "  <DataCollection>" << std::endl
+           << "    <Device Id=\"VolumeReconstructorDevice\" Type=\"VirtualVolumeReconstructor\""
+           << " MaxReconstructionLagSec=\"1000\" PreviewUpdatePeriodSec=\"0.001\" PreviewDownsamplingFactor=\"" << PREVIEW_DOWNSAMPLING_FACTOR << "\">" << std::endl
+           << "      <DataSources>" << std::endl
+           << "        <DataSource Type=\"Video\" Id=\"Preview\" PortUsImageOrientation=\"MF\" />" << std::endl
+           << "      </DataSources>" << std::endl
+           << "      <OutputChannels>" << std::endl
+           << "        <OutputChannel Id=\"PreviewStream\" VideoDataSourceId=\"Preview\" />" << std::endl
+           << "      </OutputChannels>" << std::endl
+           << "      <VolumeReconstruction ImageCoordinateFrame=\"Image\" ReferenceCoordinateFrame=\"Reference\""
+           << " Interpolation=\"LINEAR\" Optimization=\"FULL\" CompoundingMode=\"MEAN\" OutputSpacing=\"0.5 0.5 0.5\""
+           << " FillHoles=\"OFF\" NumberOfThreads=\"2\" />" << std::endl
+           << "    </Device>" << std::endl
+           << "  </DataCollection>" << std::endl
+           << "</PlusConfiguration>" << std::endl;
+    return vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(config.str().c_str()));
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Frames of a linear sweep: each frame is translated along the Z axis of the Reference coordinate system */
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> CreateFrames(unsigned int firstFrameNumber, unsigned int numberOfFrames)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    igsioTransformName imageToReferenceName("Image", "Reference");
+    for (unsigned int frameNumber = firstFrameNumber; frameNumber < firstFrameNumber + numberOfFrames; ++frameNumber)
+    {
+      igsioTrackedFrame frame;
+      FrameSizeType frameSize = { FRAME_WIDTH, FRAME_HEIGHT, 1 };
+      frame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+      unsigned char* pixels = static_cast<unsigned char*>(frame.GetImageData()->GetScalarPointer());
+      for (unsigned int y = 0; y < FRAME_HEIGHT; ++y)
+      {
+        for (unsigned int x = 0; x < FRAME_WIDTH; ++x)
+        {
+          pixels[y * FRAME_WIDTH + x] = static_cast<unsigned char>(1 + (x + 2 * y + 5 * frameNumber) % 250);
+        }
+      }
+      vtkSmartPointer<vtkMatrix4x4> imageToReference = vtkSmartPointer<vtkMatrix4x4>::New();
+      imageToReference->SetElement(0, 0, 0.2);
+      imageToReference->SetElement(1, 1, 0.2);
+      imageToReference->SetElement(2, 3, 0.3 * frameNumber);
+      frame.SetFrameTransform(imageToReferenceName, imageToReference);
+      frame.SetFrameTransformStatus(imageToReferenceName, TOOL_OK);
+      frame.SetTimestamp(10.0 + frameNumber * 0.1);
+      frames->AddTrackedFrame(&frame);
+    }
+    return frames;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Reconstructs the frames and checks that the preview output is produced */
+  PlusStatus ReconstructVolume(bool enableBackgroundInsertion, vtkImageData* reconstructedVolume, int& numberOfErrors)
+  {
+    const std::string modeName = (enableBackgroundInsertion ? "background" : "synchronous");
+    LOG_INFO("Reconstruct volume with " << modeName << " insertion");
+
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = CreateConfiguration();
+    vtkSmartPointer<vtkPlusChannel> inputChannel = vtkSmartPointer<vtkPlusChannel>::New();
+    inputChannel->SetChannelId("InputStream");
+
+    vtkSmartPointer<vtkPlusVirtualVolumeReconstructorTester> reconstructor = vtkSmartPointer<vtkPlusVirtualVolumeReconstructorTester>::New();
+    reconstructor->SetDeviceId("VolumeReconstructorDevice");
+    if (reconstructor->Configure(configRootElement, inputChannel) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to configure the volume reconstructor for " << modeName << " insertion");
+      return PLUS_FAIL;
+    }
+    reconstructor->SetEnableBackgroundInsertion(enableBackgroundInsertion);
+
+    if (reconstructor->SetOutputExtentFromFrameList(CreateFrames(0, NUMBER_OF_BATCHES * FRAMES_PER_BATCH)) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
+
+    // Batches are inserted without delay, so in background mode the insertion thread cannot keep up
+    for (unsigned int batchIndex = 0; batchIndex < NUMBER_OF_BATCHES; ++batchIndex)
+    {
+      vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = CreateFrames(batchIndex * FRAMES_PER_BATCH, FRAMES_PER_BATCH);
+      if (reconstructor->InsertFrames(frames) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to insert frames with " << modeName << " insertion");
+        numberOfErrors++;
+      }
+    }
+
+    std::string errorMessage;
+    if (reconstructor->GetReconstructedVolume(reconstructedVolume, errorMessage) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to get the reconstructed volume with " << modeName << " insertion: " << errorMessage);
+      return PLUS_FAIL;
+    }
+    if (reconstructor->GetInsertionQueueDepth() != 0)
+    {
+      LOG_ERROR(reconstructor->GetInsertionQueueDepth() << " frame lists are still queued after the reconstructed volume is retrieved with " << modeName << " insertion");
+      numberOfErrors++;
+    }
+
+    vtkPlusChannel* previewChannel = NULL;
+    vtkPlusDataSource* previewVideoSource = NULL;
+    if (reconstructor->GetOutputChannelByName(previewChannel, "PreviewStream") != PLUS_SUCCESS || previewChannel->GetVideoSource(previewVideoSource) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Preview video source is not found with " << modeName << " insertion");
+      return PLUS_FAIL;
+    }
+    if (previewVideoSource->GetNumberOfItems() < 1)
+    {
+      LOG_ERROR("No preview volume is generated with " << modeName << " insertion");
+      numberOfErrors++;
+    }
+    int* volumeDimensions = reconstructedVolume->GetDimensions();
+    FrameSizeType previewFrameSize = previewVideoSource->GetInputFrameSize();
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      unsigned int expectedPreviewSize = static_cast<unsigned int>(volumeDimensions[axis] / PREVIEW_DOWNSAMPLING_FACTOR);
+      if (previewFrameSize[axis] != expectedPreviewSize)
+      {
+        LOG_ERROR("Preview volume size along axis " << axis << " is " << previewFrameSize[axis] << " with " << modeName << " insertion, expected " << expectedPreviewSize);
+        numberOfErrors++;
+      }
+    }
+
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareVolumes(vtkImageData* synchronousVolume, vtkImageData* backgroundVolume)
+  {
+    int* synchronousDimensions = synchronousVolume->GetDimensions();
+    int* backgroundDimensions = backgroundVolume->GetDimensions();
+    if (synchronousDimensions[0] != backgroundDimensions[0] || synchronousDimensions[1] != backgroundDimensions[1] || synchronousDimensions[2] != backgroundDimensions[2])
+    {
+      LOG_ERROR("Volume size mismatch: synchronous insertion " << synchronousDimensions[0] << "x" << synchronousDimensions[1] << "x" << synchronousDimensions[2]
+                << ", background insertion " << backgroundDimensions[0] << "x" << backgroundDimensions[1] << "x" << backgroundDimensions[2]);
+      return 1;
+    }
+    vtkDataArray* synchronousScalars = synchronousVolume->GetPointData()->GetScalars();
+    vtkDataArray* backgroundScalars = backgroundVolume->GetPointData()->GetScalars();
+    if (synchronousScalars->GetDataType() != backgroundScalars->GetDataType() || synchronousScalars->GetNumberOfTuples() != backgroundScalars->GetNumberOfTuples()
+        || synchronousScalars->GetNumberOfComponents() != backgroundScalars->GetNumberOfComponents())
+    {
+      LOG_ERROR("Volume scalar type mismatch between synchronous and background insertion");
+      return 1;
+    }
+    double scalarRange[2] = { 0.0, 0.0 };
+    synchronousScalars->GetRange(scalarRange);
+    if (scalarRange[1] <= 0.0)
+    {
+      LOG_ERROR("Reconstructed volume is empty, no frames are pasted into it");
+      return 1;
+    }
+    size_t numberOfBytes = static_cast<size_t>(synchronousScalars->GetNumberOfTuples()) * synchronousScalars->GetNumberOfComponents() * synchronousScalars->GetDataTypeSize();
+    if (memcmp(synchronousScalars->GetVoidPointer(0), backgroundScalars->GetVoidPointer(0), numberOfBytes) != 0)
+    {
+      LOG_ERROR("Reconstructed volume with background insertion differs from the volume with synchronous insertion");
+      return 1;
+    }
+    return 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors = 0;
+  vtkSmartPointer<vtkImageData> synchronousVolume = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkImageData> backgroundVolume = vtkSmartPointer<vtkImageData>::New();
+  if (ReconstructVolume(false, synchronousVolume, numberOfErrors) != PLUS_SUCCESS
+      || ReconstructVolume(true, backgroundVolume, numberOfErrors) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Test failed: volume reconstruction failed");
+    return EXIT_FAILURE;
+  }
+  numberOfErrors += CompareVolumes(synchronousVolume, backgroundVolume);
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
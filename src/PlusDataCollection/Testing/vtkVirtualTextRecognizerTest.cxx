@@ -10,6 +10,147 @@
 #include "vtksys/CommandLineArguments.hxx"
 #include <map>
 
+namespace
+{
+  /// Number of copies of the first field that are added to the configuration, so that multiple regions are recognized in parallel
+  const int NUMBER_OF_FIELD_COPIES = 3;
+  const unsigned int NUMBER_OF_PARALLEL_RECOGNITION_THREADS = NUMBER_OF_FIELD_COPIES + 1;
+
+  //----------------------------------------------------------------------------
+  PlusStatus AddFieldCopies(vtkXMLDataElement* configRootElement, const std::string& deviceId)
+  {
+    vtkXMLDataElement* dataCollectionElement = configRootElement->FindNestedElementWithName("DataCollection");
+    vtkXMLDataElement* deviceElement = (dataCollectionElement != NULL ? dataCollectionElement->FindNestedElementWithNameAndAttribute("Device", "Id", deviceId.c_str()) : NULL);
+    vtkXMLDataElement* textFieldsElement = (deviceElement != NULL ? deviceElement->FindNestedElementWithName("TextFields") : NULL);
+    vtkXMLDataElement* fieldElement = (textFieldsElement != NULL ? textFieldsElement->FindNestedElementWithName("Field") : NULL);
+    if (fieldElement == NULL || fieldElement->GetAttribute("Name") == NULL)
+    {
+      LOG_ERROR("Unable to find the first text field of device " << deviceId << " in the configuration");
+      return PLUS_FAIL;
+    }
+    for (int i = 0; i < NUMBER_OF_FIELD_COPIES; ++i)
+    {
+      vtkSmartPointer<vtkXMLDataElement> fieldCopyElement = vtkSmartPointer<vtkXMLDataElement>::New();
+      fieldCopyElement->DeepCopy(fieldElement);
+      std::string fieldCopyName = std::string(fieldElement->GetAttribute("Name")) + "Copy" + igsioCommon::ToString<int>(i);
+      fieldCopyElement->SetAttribute("Name", fieldCopyName.c_str());
+      textFieldsElement->AddNestedElement(fieldCopyElement);
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+    Recognizes the text of the fields in the acquired frames and returns the recognized value of each field.
+    Also checks that the text of the regions that did not change since their last recognition is not recognized again.
+  */
+  int RecognizeFields(vtkXMLDataElement* configRootElement, const std::string& deviceId, unsigned int numberOfRecognitionThreads, const std::string& fieldValue, std::map<std::string, std::string>& recognizedValues)
+  {
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+
+    if (dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Configuration incorrect for vtkPlusVirtualTextRecognizerTest.");
+      return 1;
+    }
+
+    vtkPlusDevice* device(NULL);
+    if (dataCollector->GetDevice(device, deviceId) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to retrieve recognizer device by Id: " << deviceId);
+      return 1;
+    }
+
+    vtkPlusVirtualTextRecognizer* textRecognizer = vtkPlusVirtualTextRecognizer::SafeDownCast(device);
+    if (textRecognizer == NULL)
+    {
+      LOG_ERROR("Unable to retrieve recognizer device by Id: " << deviceId);
+      return 1;
+    }
+    std::stringstream tessDataPathSS;
+    tessDataPathSS << vtkPlusConfig::GetInstance()->GetImagePath("../../tessdata");
+    textRecognizer->SetTessdataDirectory(vtkPlusConfig::GetInstance()->GetAbsolutePath("", tessDataPathSS.str()));
+    textRecognizer->SetNumberOfRecognitionThreads(numberOfRecognitionThreads);
+
+    if (dataCollector->Connect() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to connect to devices!");
+      return 1;
+    }
+
+    if (dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to start data collection!");
+      dataCollector->Disconnect();
+      return 1;
+    }
+
+    textRecognizer->SetMissingInputGracePeriodSec(0);
+
+#ifdef _WIN32
+    Sleep(500);
+#else
+    usleep(500000);
+#endif
+
+    int numberOfErrors = 0;
+    vtkPlusVirtualTextRecognizer::ChannelFieldListMap map = textRecognizer->GetRecognitionFields();
+    vtkPlusVirtualTextRecognizer::FieldListIterator it = map.begin()->second.begin();
+    if ((*it)->LatestParameterValue != fieldValue)
+    {
+      LOG_ERROR("Direct: Parameter \"" << (*it)->ParameterName << "\" value=\"" << (*it)->LatestParameterValue << "\" does not match expected value=\"" << fieldValue << "\"");
+      numberOfErrors++;
+    }
+
+    igsioTrackedFrame frame;
+    (*device->GetOutputChannelsStart())->GetTrackedFrame(frame);
+
+    if (frame.GetFrameField((*it)->ParameterName).empty() || !igsioCommon::IsEqualInsensitive(frame.GetFrameField((*it)->ParameterName), fieldValue))
+    {
+      LOG_ERROR("Tracked Frame: Parameter \"" << (*it)->ParameterName << "\" value=\"" << (*it)->LatestParameterValue << "\" does not match expected value=\"" << fieldValue << "\"");
+      numberOfErrors++;
+    }
+
+    // Recognition is skipped for unchanged regions, the rate of recognitions is broadcast as a diagnostic field
+    if (frame.GetFrameField("OcrInvocationRate").empty())
+    {
+      LOG_ERROR("Tracked Frame: OcrInvocationRate field is missing");
+      numberOfErrors++;
+    }
+
+    // The recognizer does not process frames after the acquisition is stopped, so the fields can be accessed safely
+    dataCollector->Stop();
+
+    if (textRecognizer->GetTotalOcrInvocationCount() == 0)
+    {
+      LOG_ERROR("No text is recognized with " << numberOfRecognitionThreads << " recognition thread(s)");
+      numberOfErrors++;
+    }
+
+    // The latest frame may differ from the last processed frame, but once it is processed its regions are unchanged
+    vtkPlusChannel* sourceChannel = map.begin()->first;
+    igsioTrackedFrame latestFrame;
+    sourceChannel->GetTrackedFrame(latestFrame);
+    textRecognizer->RecognizeFrame(sourceChannel, latestFrame);
+    unsigned long long ocrInvocationCount = textRecognizer->GetTotalOcrInvocationCount();
+    textRecognizer->RecognizeFrame(sourceChannel, latestFrame);
+    textRecognizer->RecognizeFrame(sourceChannel, latestFrame);
+    if (textRecognizer->GetTotalOcrInvocationCount() != ocrInvocationCount)
+    {
+      LOG_ERROR("Text of unchanged regions is recognized again: OCR invocation count increased from " << ocrInvocationCount << " to " << textRecognizer->GetTotalOcrInvocationCount() << " on identical frames");
+      numberOfErrors++;
+    }
+
+    for (vtkPlusVirtualTextRecognizer::FieldListIterator fieldIt = map.begin()->second.begin(); fieldIt != map.begin()->second.end(); ++fieldIt)
+    {
+      recognizedValues[(*fieldIt)->ParameterName] = (*fieldIt)->LatestParameterValue;
+    }
+
+    dataCollector->Disconnect();
+    return numberOfErrors;
+  }
+}
+
 int main(int argc, char** argv)
 {
   bool printHelp(false);
@@ -56,70 +197,40 @@ int main(int argc, char** argv)
     return EXIT_FAILURE;
   }
 
-  vtkPlusConfig::GetInstance()->SetDeviceSetConfigurationData(configRootElement);
-
-  vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
-
-  if (dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
-  {
-    LOG_ERROR("Configuration incorrect for vtkPlusVirtualTextRecognizerTest.");
-    return EXIT_FAILURE;
-  }
-
-  vtkPlusDevice* device(NULL);
-  if (dataCollector->GetDevice(device, deviceId) != PLUS_SUCCESS)
+  // Copies of the first field have the same region and therefore the same text
+  if (AddFieldCopies(configRootElement, deviceId) != PLUS_SUCCESS)
   {
-    LOG_ERROR("Unable to retrieve recognizer device by Id: " << deviceId);
     return EXIT_FAILURE;
   }
 
-  vtkPlusVirtualTextRecognizer* textRecognizer = vtkPlusVirtualTextRecognizer::SafeDownCast(device);
-  if (textRecognizer == NULL)
-  {
-    LOG_ERROR("Unable to retrieve recognizer device by Id: " << deviceId);
-    return EXIT_FAILURE;
-  }
-  std::stringstream tessDataPathSS;
-  tessDataPathSS << vtkPlusConfig::GetInstance()->GetImagePath("../../tessdata");
-  textRecognizer->SetTessdataDirectory(vtkPlusConfig::GetInstance()->GetAbsolutePath("", tessDataPathSS.str()));
+  vtkPlusConfig::GetInstance()->SetDeviceSetConfigurationData(configRootElement);
 
-  if (dataCollector->Connect() != PLUS_SUCCESS)
-  {
-    LOG_ERROR("Failed to connect to devices!");
-    return EXIT_FAILURE;
-  }
+  std::map<std::string, std::string> serialValues;
+  int numberOfErrors = RecognizeFields(configRootElement, deviceId, 1, fieldValue, serialValues);
+  std::map<std::string, std::string> parallelValues;
+  numberOfErrors += RecognizeFields(configRootElement, deviceId, NUMBER_OF_PARALLEL_RECOGNITION_THREADS, fieldValue, parallelValues);
 
-  if (dataCollector->Start() != PLUS_SUCCESS)
+  // Regions that are recognized in parallel must give the same text as with a single recognition thread
+  if (serialValues.size() < NUMBER_OF_FIELD_COPIES + 1 || parallelValues.size() != serialValues.size())
   {
-    LOG_ERROR("Failed to start data collection!");
-    return EXIT_FAILURE;
+    LOG_ERROR("Number of recognized fields is " << serialValues.size() << " with a single thread and " << parallelValues.size() << " with " << NUMBER_OF_PARALLEL_RECOGNITION_THREADS << " threads, expected at least " << NUMBER_OF_FIELD_COPIES + 1);
+    numberOfErrors++;
   }
-
-  textRecognizer->SetMissingInputGracePeriodSec(0);
-
-#ifdef _WIN32
-  Sleep(500);
-#else
-  usleep(500000);
-#endif
-
-  vtkPlusVirtualTextRecognizer::ChannelFieldListMap map = textRecognizer->GetRecognitionFields();
-  vtkPlusVirtualTextRecognizer::FieldListIterator it = map.begin()->second.begin();
-  if ((*it)->LatestParameterValue != fieldValue)
+  for (std::map<std::string, std::string>::iterator it = serialValues.begin(); it != serialValues.end(); ++it)
   {
-    LOG_ERROR("Direct: Parameter \"" << (*it)->ParameterName << "\" value=\"" << (*it)->LatestParameterValue << "\" does not match expected value=\"" << fieldValue << "\"");
-    return EXIT_FAILURE;
+    if (parallelValues[it->first] != it->second)
+    {
+      LOG_ERROR("Parameter \"" << it->first << "\" value=\"" << parallelValues[it->first] << "\" recognized in parallel does not match value=\"" << it->second << "\" recognized by a single thread");
+      numberOfErrors++;
+    }
   }
 
-  igsioTrackedFrame frame;
-  (*device->GetOutputChannelsStart())->GetTrackedFrame(frame);
-
-  if (frame.GetFrameField((*it)->ParameterName).empty() || !igsioCommon::IsEqualInsensitive(frame.GetFrameField((*it)->ParameterName), fieldValue))
+  if (numberOfErrors != 0)
   {
-    LOG_ERROR("Tracked Frame: Parameter \"" << (*it)->ParameterName << "\" value=\"" << (*it)->LatestParameterValue << "\" does not match expected value=\"" << fieldValue << "\"");
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
     return EXIT_FAILURE;
   }
 
   LOG_INFO("Exit successfully");
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
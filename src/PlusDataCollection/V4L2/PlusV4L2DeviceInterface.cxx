@@ -0,0 +1,85 @@
+/*=Plus=header=begin======================================================
+ Program: Plus
+ Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+ See License.txt for details.
+ =========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusV4L2DeviceInterface.h"
+
+// OS includes
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------
+PlusV4L2DeviceInterface::~PlusV4L2DeviceInterface()
+{
+}
+
+//----------------------------------------------------------------------------
+int PlusV4L2SystemDeviceInterface::Stat(const std::string& path, struct stat* st)
+{
+  return stat(path.c_str(), st);
+}
+
+//----------------------------------------------------------------------------
+int PlusV4L2SystemDeviceInterface::Open(const std::string& path, int flags)
+{
+  return open(path.c_str(), flags, 0);
+}
+
+//----------------------------------------------------------------------------
+int PlusV4L2SystemDeviceInterface::Close(int fd)
+{
+  return close(fd);
+}
+
+//----------------------------------------------------------------------------
+int PlusV4L2SystemDeviceInterface::Ioctl(int fd, unsigned long int request, void* arg)
+{
+  int r;
+
+  do
+  {
+    r = ioctl(fd, request, arg);
+  }
+  while (-1 == r && EINTR == errno);
+
+  return r;
+}
+
+//----------------------------------------------------------------------------
+void* PlusV4L2SystemDeviceInterface::Mmap(size_t length, int prot, int flags, int fd, off_t offset)
+{
+  return mmap(NULL /* start anywhere */, length, prot, flags, fd, offset);
+}
+
+//----------------------------------------------------------------------------
+int PlusV4L2SystemDeviceInterface::Munmap(void* start, size_t length)
+{
+  return munmap(start, length);
+}
+
+//----------------------------------------------------------------------------
+ssize_t PlusV4L2SystemDeviceInterface::Read(int fd, void* buffer, size_t count)
+{
+  return read(fd, buffer, count);
+}
+
+//----------------------------------------------------------------------------
+int PlusV4L2SystemDeviceInterface::WaitForFrame(int fd, double timeoutSec)
+{
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+
+  timeval tv;
+  tv.tv_sec = static_cast<long>(timeoutSec);
+  tv.tv_usec = static_cast<long>((timeoutSec - tv.tv_sec) * 1e6);
+
+  return select(fd + 1, &fds, NULL, NULL, &tv);
+}
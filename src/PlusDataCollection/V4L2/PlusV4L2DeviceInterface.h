@@ -0,0 +1,64 @@
+/*=Plus=header=begin======================================================
+ Program: Plus
+ Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+ See License.txt for details.
+ =========================================================Plus=header=end*/
+
+#ifndef __PlusV4L2DeviceInterface_h
+#define __PlusV4L2DeviceInterface_h
+
+#include "vtkPlusDataCollectionExport.h"
+
+// OS includes
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// STL includes
+#include <string>
+
+/*!
+ \class PlusV4L2DeviceInterface
+ \brief Operating system calls that vtkPlusV4L2VideoSource uses to communicate with a V4L2 device
+
+ The methods have the same semantics as the corresponding system calls: in case of an error -1 (MAP_FAILED for Mmap)
+ is returned and errno is set. vtkPlusV4L2VideoSource uses PlusV4L2SystemDeviceInterface by default, tests can provide
+ an implementation that emulates a device in the same process.
+
+ \ingroup PlusLibDataCollection
+ */
+class vtkPlusDataCollectionExport PlusV4L2DeviceInterface
+{
+public:
+  virtual ~PlusV4L2DeviceInterface();
+
+  virtual int Stat(const std::string& path, struct stat* st) = 0;
+  virtual int Open(const std::string& path, int flags) = 0;
+  virtual int Close(int fd) = 0;
+  /*! ioctl, restarted if it is interrupted by a signal */
+  virtual int Ioctl(int fd, unsigned long int request, void* arg) = 0;
+  virtual void* Mmap(size_t length, int prot, int flags, int fd, off_t offset) = 0;
+  virtual int Munmap(void* start, size_t length) = 0;
+  virtual ssize_t Read(int fd, void* buffer, size_t count) = 0;
+  /*! Wait until a frame can be read from the device. Returns 1 if a frame is available, 0 on timeout, -1 on error. */
+  virtual int WaitForFrame(int fd, double timeoutSec) = 0;
+};
+
+/*!
+ \class PlusV4L2SystemDeviceInterface
+ \brief Communicates with V4L2 devices through the system calls of the operating system
+ \ingroup PlusLibDataCollection
+ */
+class vtkPlusDataCollectionExport PlusV4L2SystemDeviceInterface : public PlusV4L2DeviceInterface
+{
+public:
+  virtual int Stat(const std::string& path, struct stat* st);
+  virtual int Open(const std::string& path, int flags);
+  virtual int Close(int fd);
+  virtual int Ioctl(int fd, unsigned long int request, void* arg);
+  virtual void* Mmap(size_t length, int prot, int flags, int fd, off_t offset);
+  virtual int Munmap(void* start, size_t length);
+  virtual ssize_t Read(int fd, void* buffer, size_t count);
+  virtual int WaitForFrame(int fd, double timeoutSec);
+};
+
+#endif
@@ -6,6 +6,9 @@
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PixelCodec.h"
+#include "PlusV4L2DeviceInterface.h"
+#include "vtkIGSIOAccurateTimer.h"
 #include "vtkPlusV4L2VideoSource.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusDataSource.h"
@@ -14,12 +17,16 @@
 #include <vtkImageData.h>
 #include <vtkObjectFactory.h>
 
+// STL includes
+#include <algorithm>
+
 // OS includes
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <errno.h>
-#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
 #include <sys/mman.h>
+#include <time.h>
 
 //----------------------------------------------------------------------------
 
@@ -29,18 +36,7 @@ vtkStandardNewMacro(vtkPlusV4L2VideoSource);
 
 namespace
 {
-  int xioctl(int fh, unsigned long int request, void* arg)
-  {
-    int r;
-
-    do
-    {
-      r = ioctl(fh, request, arg);
-    }
-    while (-1 == r && EINTR == errno);
-
-    return r;
-  }
+  const double FRAME_WAIT_TIMEOUT_SEC = 2.0;
 }
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
@@ -49,6 +45,8 @@ namespace
 vtkPlusV4L2VideoSource::vtkPlusV4L2VideoSource()
   : DeviceName("")
   , IOMethod(IO_METHOD_READ)
+  , ExportDmaBuf(false)
+  , DeviceInterface(std::make_shared<PlusV4L2SystemDeviceInterface>())
   , FileDescriptor(-1)
   , FrameBuffers(nullptr)
   , BufferCount(0)
@@ -58,6 +56,14 @@ vtkPlusV4L2VideoSource::vtkPlusV4L2VideoSource()
   , PixelFormat(nullptr)
   , FieldOrder(nullptr)
   , DataSource(nullptr)
+  , NumberOfCapturedFrames(0)
+  , NumberOfDroppedFrames(0)
+  , LastSequenceValid(false)
+  , LastSequence(0)
+  , NumberOfCaptureLatencySamples(0)
+  , CaptureLatencySumSec(0.0)
+  , BufferHoldTimeSumSec(0.0)
+  , MaximumBufferHoldTimeSec(0.0)
 {
   memset(this->DeviceFormat.get(), 0, sizeof(struct v4l2_format));
 
@@ -76,7 +82,13 @@ void vtkPlusV4L2VideoSource::PrintSelf(ostream& os, vtkIndent indent)
 
   os << indent << "DeviceName: " << this->DeviceName << std::endl;
   os << indent << "IOMethod: " << this->IOMethodToString(this->IOMethod) << std::endl;
+  os << indent << "ExportDmaBuf: " << (this->ExportDmaBuf ? "TRUE" : "FALSE") << std::endl;
   os << indent << "BufferCount: " << this->BufferCount << std::endl;
+  os << indent << "NumberOfCapturedFrames: " << this->GetNumberOfCapturedFrames() << std::endl;
+  os << indent << "NumberOfDroppedFrames: " << this->GetNumberOfDroppedFrames() << std::endl;
+  os << indent << "AverageCaptureLatencySec: " << this->GetAverageCaptureLatencySec() << std::endl;
+  os << indent << "AverageBufferHoldTimeSec: " << this->GetAverageBufferHoldTimeSec() << std::endl;
+  os << indent << "MaximumBufferHoldTimeSec: " << this->GetMaximumBufferHoldTimeSec() << std::endl;
 
   if (this->FileDescriptor != -1)
   {
@@ -85,7 +97,7 @@ void vtkPlusV4L2VideoSource::PrintSelf(ostream& os, vtkIndent indent)
     struct v4l2_fmtdesc fmtdesc;
     CLEAR(fmtdesc);
     fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    while (ioctl(this->FileDescriptor, VIDIOC_ENUM_FMT, &fmtdesc) == 0)
+    while (this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_ENUM_FMT, &fmtdesc) == 0)
     {
       os << indent << fmtdesc.description << std::endl;
       fmtdesc.index++;
@@ -114,6 +126,8 @@ PlusStatus vtkPlusV4L2VideoSource::ReadConfiguration(vtkXMLDataElement* rootConf
     LOG_WARNING("Unknown method: " << ioMethod << ". Defaulting to " << vtkPlusV4L2VideoSource::IOMethodToString(this->IOMethod));
   }
 
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(ExportDmaBuf, deviceConfig);
+
   int frameSize[2];
   XML_READ_VECTOR_ATTRIBUTE_NONMEMBER_OPTIONAL(int, 2, FrameSize, frameSize, deviceConfig);
   if (deviceConfig->GetAttribute("FrameSize") != nullptr)
@@ -155,6 +169,8 @@ PlusStatus vtkPlusV4L2VideoSource::WriteConfiguration(vtkXMLDataElement* rootCon
 
   deviceConfig->SetAttribute("IOMethod", vtkPlusV4L2VideoSource::IOMethodToString(this->IOMethod).c_str());
 
+  XML_WRITE_BOOL_ATTRIBUTE(ExportDmaBuf, deviceConfig);
+
   int frameSize[2] = { static_cast<int>(this->DeviceFormat->fmt.pix.width), static_cast<int>(this->DeviceFormat->fmt.pix.height) };
   deviceConfig->SetVectorAttribute("FrameSize", 2, frameSize);
 
@@ -178,6 +194,7 @@ PlusStatus vtkPlusV4L2VideoSource::InitRead(unsigned int bufferSize)
 
   this->FrameBuffers[0].length = bufferSize;
   this->FrameBuffers[0].start = malloc(bufferSize);
+  this->FrameBuffers[0].dmaBufFileDescriptor = -1;
 
   if (!this->FrameBuffers[0].start)
   {
@@ -201,7 +218,7 @@ PlusStatus vtkPlusV4L2VideoSource::InitMmap()
   req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   req.memory = V4L2_MEMORY_MMAP;
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_REQBUFS, &req))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_REQBUFS, &req))
   {
     if (EINVAL == errno)
     {
@@ -237,18 +254,43 @@ PlusStatus vtkPlusV4L2VideoSource::InitMmap()
     buf.memory = V4L2_MEMORY_MMAP;
     buf.index = this->BufferCount;
 
-    if (-1 == xioctl(this->FileDescriptor, VIDIOC_QUERYBUF, &buf))
+    if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_QUERYBUF, &buf))
     {
       LOG_ERROR("VIDIOC_QUERYBUF" << ": " << strerror(errno));
       return PLUS_FAIL;
     }
 
-    this->FrameBuffers[this->BufferCount].length = buf.length;
-    this->FrameBuffers[this->BufferCount].start = mmap(NULL /* start anywhere */, buf.length, PROT_READ | PROT_WRITE /* required */, MAP_SHARED /* recommended */, this->FileDescriptor, buf.m.offset);
+    FrameBuffer& frameBuffer = this->FrameBuffers[this->BufferCount];
+    frameBuffer.length = buf.length;
+    frameBuffer.dmaBufFileDescriptor = -1;
+    if (this->ExportDmaBuf)
+    {
+      v4l2_exportbuffer expbuf;
+      CLEAR(expbuf);
+      expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      expbuf.index = buf.index;
+      expbuf.flags = O_RDONLY | O_CLOEXEC;
+      if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_EXPBUF, &expbuf))
+      {
+        LOG_ERROR(this->DeviceName << " does not support exporting buffers as DMABUF. VIDIOC_EXPBUF: " << strerror(errno));
+        return PLUS_FAIL;
+      }
+      frameBuffer.dmaBufFileDescriptor = expbuf.fd;
+      frameBuffer.start = this->DeviceInterface->Mmap(buf.length, PROT_READ, MAP_SHARED, expbuf.fd, 0);
+    }
+    else
+    {
+      frameBuffer.start = this->DeviceInterface->Mmap(buf.length, PROT_READ | PROT_WRITE /* required */, MAP_SHARED /* recommended */, this->FileDescriptor, buf.m.offset);
+    }
 
-    if (MAP_FAILED == this->FrameBuffers[this->BufferCount].start)
+    if (MAP_FAILED == frameBuffer.start)
     {
       LOG_ERROR("mmap" << ": " << strerror(errno));
+      if (frameBuffer.dmaBufFileDescriptor != -1)
+      {
+        this->DeviceInterface->Close(frameBuffer.dmaBufFileDescriptor);
+      }
+      return PLUS_FAIL;
     }
   }
 
@@ -266,7 +308,7 @@ PlusStatus vtkPlusV4L2VideoSource::InitUserp(unsigned int bufferSize)
   req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   req.memory = V4L2_MEMORY_USERPTR;
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_REQBUFS, &req))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_REQBUFS, &req))
   {
     if (EINVAL == errno)
     {
@@ -291,6 +333,7 @@ PlusStatus vtkPlusV4L2VideoSource::InitUserp(unsigned int bufferSize)
   {
     this->FrameBuffers[this->BufferCount].length = bufferSize;
     this->FrameBuffers[this->BufferCount].start = malloc(bufferSize);
+    this->FrameBuffers[this->BufferCount].dmaBufFileDescriptor = -1;
 
     if (!this->FrameBuffers[this->BufferCount].start)
     {
@@ -307,7 +350,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
 {
   // Ensure we can detect the device in the OS
   struct stat st;
-  if (-1 == stat(this->DeviceName.c_str(), &st))
+  if (-1 == this->DeviceInterface->Stat(this->DeviceName, &st))
   {
     LOG_ERROR("Cannot identify " << this->DeviceName << ": " << strerror(errno));
     return PLUS_FAIL;
@@ -319,7 +362,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
   }
 
   // Open the device
-  this->FileDescriptor = open(this->DeviceName.c_str(), O_RDWR | O_NONBLOCK, 0);
+  this->FileDescriptor = this->DeviceInterface->Open(this->DeviceName, O_RDWR | O_NONBLOCK);
   if (-1 == this->FileDescriptor)
   {
     LOG_ERROR("Cannot open " << this->DeviceName << ": " << strerror(errno));
@@ -328,7 +371,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
 
   // Confirm requested device is capable
   v4l2_capability cap;
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_QUERYCAP, &cap))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_QUERYCAP, &cap))
   {
     if (EINVAL == errno)
     {
@@ -347,6 +390,12 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
     return PLUS_FAIL;
   }
 
+  if (this->ExportDmaBuf && this->IOMethod != IO_METHOD_MMAP)
+  {
+    LOG_WARNING("ExportDmaBuf is only supported with IO_METHOD_MMAP. Buffers are not exported.");
+    this->ExportDmaBuf = false;
+  }
+
   switch (this->IOMethod)
   {
     case IO_METHOD_READ:
@@ -379,7 +428,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
   struct v4l2_cropcap cropcap;
   CLEAR(cropcap);
   cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  if (0 == xioctl(this->FileDescriptor, VIDIOC_CROPCAP, &cropcap))
+  if (0 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_CROPCAP, &cropcap))
   {
     struct v4l2_crop crop;
     CLEAR(crop);
@@ -387,7 +436,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
     crop.c = cropcap.defrect;
 
     // TODO : get clip information from data source and set to device
-    if (-1 == xioctl(this->FileDescriptor, VIDIOC_S_CROP, &crop))
+    if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_S_CROP, &crop))
     {
       switch (errno)
       {
@@ -400,7 +449,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
 
   // Retrieve current v4l2 format settings
   this->DeviceFormat->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_G_FMT, this->DeviceFormat.get()))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_G_FMT, this->DeviceFormat.get()))
   {
     LOG_ERROR("VIDIOC_G_FMT" << ": " << strerror(errno));
     return PLUS_FAIL;
@@ -423,10 +472,10 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
     this->DeviceFormat->fmt.pix.field = *this->FieldOrder;
   }
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_S_FMT, this->DeviceFormat.get()))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_S_FMT, this->DeviceFormat.get()))
   {
     LOG_WARNING("Unable to set requested video format. Continuing with existing format: " << strerror(errno));
-    if (-1 == xioctl(this->FileDescriptor, VIDIOC_G_FMT, this->DeviceFormat.get()))
+    if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_G_FMT, this->DeviceFormat.get()))
     {
       LOG_ERROR("VIDIOC_G_FMT" << ": " << strerror(errno));
       return PLUS_FAIL;
@@ -440,7 +489,20 @@ PlusStatus vtkPlusV4L2VideoSource::InternalConnect()
   this->ImageSize[1] = this->DeviceFormat->fmt.pix.height;
   this->ImageSize[2] = 1;
   this->DataSource->SetPixelType(VTK_UNSIGNED_CHAR);
-  this->NumberOfScalarComponents = this->DeviceFormat->fmt.pix.sizeimage / this->DeviceFormat->fmt.pix.width / this->DeviceFormat->fmt.pix.height;
+  if (this->DeviceFormat->fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG)
+  {
+    // sizeimage is only the maximum size of a compressed frame, frames are decoded to the image type of the video source
+    if (!PixelCodec::IsMJPGDecodingSupported())
+    {
+      LOG_ERROR("MJPEG pixel format is not supported. Build Plus with PLUS_USE_LIBJPEG_TURBO enabled or select a different pixel format.");
+      return PLUS_FAIL;
+    }
+    this->NumberOfScalarComponents = (this->DataSource->GetImageType() == US_IMG_RGB_COLOR ? 3 : 1);
+  }
+  else
+  {
+    this->NumberOfScalarComponents = this->DeviceFormat->fmt.pix.sizeimage / this->DeviceFormat->fmt.pix.width / this->DeviceFormat->fmt.pix.height;
+  }
   this->DataSource->SetNumberOfScalarComponents(this->NumberOfScalarComponents);
 
   this->FrameFields["pixelformat"].second = vtkPlusV4L2VideoSource::PixelFormatToString(this->DeviceFormat->fmt.pix.pixelformat);
@@ -481,11 +543,16 @@ PlusStatus vtkPlusV4L2VideoSource::InternalDisconnect()
     {
       for (unsigned int i = 0; i < this->BufferCount; ++i)
       {
-        if (-1 == munmap(this->FrameBuffers[i].start, this->FrameBuffers[i].length))
+        if (-1 == this->DeviceInterface->Munmap(this->FrameBuffers[i].start, this->FrameBuffers[i].length))
         {
           LOG_ERROR("munmap" << ": " << strerror(errno));
           return PLUS_FAIL;
         }
+        if (this->FrameBuffers[i].dmaBufFileDescriptor != -1 && -1 == this->DeviceInterface->Close(this->FrameBuffers[i].dmaBufFileDescriptor))
+        {
+          LOG_ERROR("Close DMABUF" << ": " << strerror(errno));
+          return PLUS_FAIL;
+        }
       }
       break;
     }
@@ -500,8 +567,9 @@ PlusStatus vtkPlusV4L2VideoSource::InternalDisconnect()
   }
 
   free(this->FrameBuffers);
+  this->FrameBuffers = nullptr;
 
-  if (-1 == close(this->FileDescriptor))
+  if (-1 == this->DeviceInterface->Close(this->FileDescriptor))
   {
     LOG_ERROR("Close" << ": " << strerror(errno));
     return PLUS_FAIL;
@@ -516,18 +584,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalDisconnect()
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusV4L2VideoSource::InternalUpdate()
 {
-  fd_set fds;
-  timeval tv;
-  int r;
-
-  FD_ZERO(&fds);
-  FD_SET(this->FileDescriptor, &fds);
-
-  // Timeout
-  tv.tv_sec = 2;
-  tv.tv_usec = 0;
-
-  r = select(this->FileDescriptor + 1, &fds, NULL, NULL, &tv);
+  int r = this->DeviceInterface->WaitForFrame(this->FileDescriptor, FRAME_WAIT_TIMEOUT_SEC);
 
   if (-1 == r)
   {
@@ -541,39 +598,161 @@ PlusStatus vtkPlusV4L2VideoSource::InternalUpdate()
     return PLUS_FAIL;
   }
 
-  unsigned int currentBufferIndex;
-  unsigned int bytesUsed;
-  if (this->ReadFrame(currentBufferIndex, bytesUsed) != PLUS_SUCCESS)
+  v4l2_buffer buf;
+  if (this->ReadFrame(buf) != PLUS_SUCCESS)
   {
     return PLUS_FAIL;
   }
+  double dequeueTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  this->UpdateFrameStatistics(buf);
 
-  if (this->DataSource->AddItem(this->FrameBuffers[currentBufferIndex].start, this->ImageSize, bytesUsed, US_IMG_BRIGHTNESS, this->FrameNumber, UNDEFINED_TIMESTAMP, UNDEFINED_TIMESTAMP, &this->FrameFields) != PLUS_SUCCESS)
+  // The buffer is not queued to the driver while its content is consumed, so the driver cannot overwrite it
+  PlusStatus status = this->AddFrameToBuffer(buf);
+  if (this->RequeueBuffer(buf) != PLUS_SUCCESS)
   {
-    LOG_ERROR("vtkPlusV4L2VideoSource::Unable to add item to the buffer.");
+    status = PLUS_FAIL;
+  }
+
+  double bufferHoldTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - dequeueTime;
+  {
+    std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+    this->BufferHoldTimeSumSec += bufferHoldTimeSec;
+    this->MaximumBufferHoldTimeSec = std::max(this->MaximumBufferHoldTimeSec, bufferHoldTimeSec);
+  }
+
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusV4L2VideoSource::AddFrameToBuffer(const v4l2_buffer& buf)
+{
+  if (buf.index >= this->BufferCount)
+  {
+    LOG_ERROR("Invalid buffer index: " << buf.index);
     return PLUS_FAIL;
   }
 
-  this->FrameNumber++;
+  if (this->FrameBuffers[buf.index].dmaBufFileDescriptor != -1 && this->SyncDmaBuf(buf.index, true) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  void* frameData = this->FrameBuffers[buf.index].start;
+  PlusStatus status = PLUS_SUCCESS;
+  if (this->DeviceFormat->fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG)
+  {
+    // Compressed frames are decoded directly into a frame reserved in the buffer of the data source
+    unsigned long decodedFrameSizeInBytes = static_cast<unsigned long>(this->ImageSize[0]) * this->ImageSize[1] * this->NumberOfScalarComponents;
+    if (this->DataSource->ReserveItem(this->DecodedFrame) != PLUS_SUCCESS || this->DecodedFrame.GetFrameSizeInBytes() != decodedFrameSizeInBytes)
+    {
+      LOG_ERROR("vtkPlusV4L2VideoSource::Unable to reserve a " << decodedFrameSizeInBytes << " byte frame in the buffer.");
+      this->DataSource->ReleaseReservation(this->DecodedFrame);
+      status = PLUS_FAIL;
+    }
+    else
+    {
+      unsigned char* compressedFrame = static_cast<unsigned char*>(frameData);
+      unsigned char* decodedFrame = static_cast<unsigned char*>(this->DecodedFrame.GetScalarPointer());
+      PlusStatus decodingStatus = (this->NumberOfScalarComponents == 3)
+                                  ? PixelCodec::ConvertToBGR24(PixelCodec::ComponentOrder_RGB, PixelCodec::PixelEncoding_MJPG, this->ImageSize[0], this->ImageSize[1], compressedFrame, decodedFrame, buf.bytesused)
+                                  : PixelCodec::ConvertToGray(PixelCodec::PixelEncoding_MJPG, this->ImageSize[0], this->ImageSize[1], compressedFrame, decodedFrame, buf.bytesused);
+      // CommitReservedItem does not know the frame size, it is added to the fields (AddItem sets the same field for uncompressed frames)
+      igsioFieldMapType decodedFrameFields(this->FrameFields);
+      decodedFrameFields["FrameSizeInBytes"].second = igsioCommon::ToString<unsigned long>(decodedFrameSizeInBytes);
+      if (decodingStatus != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Error while decoding the grabbed image");
+        this->DataSource->ReleaseReservation(this->DecodedFrame);
+        status = PLUS_FAIL;
+      }
+      else if (this->DataSource->CommitReservedItem(this->DecodedFrame, this->FrameNumber, UNDEFINED_TIMESTAMP, UNDEFINED_TIMESTAMP, &decodedFrameFields) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("vtkPlusV4L2VideoSource::Unable to add item to the buffer.");
+        status = PLUS_FAIL;
+      }
+    }
+  }
+  // Uncompressed frames are copied from the driver buffer directly into the buffer of the data source
+  else if (this->DataSource->AddItem(frameData, this->ImageSize, buf.bytesused, US_IMG_BRIGHTNESS, this->FrameNumber, UNDEFINED_TIMESTAMP, UNDEFINED_TIMESTAMP, &this->FrameFields) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("vtkPlusV4L2VideoSource::Unable to add item to the buffer.");
+    status = PLUS_FAIL;
+  }
+
+  if (this->FrameBuffers[buf.index].dmaBufFileDescriptor != -1 && this->SyncDmaBuf(buf.index, false) != PLUS_SUCCESS)
+  {
+    status = PLUS_FAIL;
+  }
+
+  if (status == PLUS_SUCCESS)
+  {
+    this->FrameNumber++;
+  }
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusV4L2VideoSource::SyncDmaBuf(unsigned int bufferIndex, bool start)
+{
+  dma_buf_sync sync;
+  CLEAR(sync);
+  sync.flags = (start ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) | DMA_BUF_SYNC_READ;
+  if (-1 == this->DeviceInterface->Ioctl(this->FrameBuffers[bufferIndex].dmaBufFileDescriptor, DMA_BUF_IOCTL_SYNC, &sync))
+  {
+    LOG_ERROR("DMA_BUF_IOCTL_SYNC" << ": " << strerror(errno));
+    return PLUS_FAIL;
+  }
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusV4L2VideoSource::ReadFrame(unsigned int& currentBufferIndex, unsigned int& bytesUsed)
+void vtkPlusV4L2VideoSource::UpdateFrameStatistics(const v4l2_buffer& buf)
+{
+  double captureLatencySec = -1.0;
+  if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+  {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    captureLatencySec = (now.tv_sec - buf.timestamp.tv_sec) + (now.tv_nsec / 1000 - buf.timestamp.tv_usec) * 1e-6;
+  }
+
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  this->NumberOfCapturedFrames++;
+  // Sequence numbers are only provided in the streaming IO methods
+  if (this->IOMethod != IO_METHOD_READ)
+  {
+    if (this->LastSequenceValid && buf.sequence > this->LastSequence + 1)
+    {
+      this->NumberOfDroppedFrames += buf.sequence - this->LastSequence - 1;
+    }
+    this->LastSequence = buf.sequence;
+    this->LastSequenceValid = true;
+  }
+  if (captureLatencySec >= 0.0)
+  {
+    this->CaptureLatencySumSec += captureLatencySec;
+    this->NumberOfCaptureLatencySamples++;
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusV4L2VideoSource::ReadFrame(v4l2_buffer& buf)
 {
+  CLEAR(buf);
+
   switch (this->IOMethod)
   {
     case IO_METHOD_READ:
     {
-      return ReadFrameFileDescriptor(currentBufferIndex, bytesUsed);
+      return ReadFrameFileDescriptor(buf);
     }
     case IO_METHOD_MMAP:
     {
-      return ReadFrameMemoryMap(currentBufferIndex, bytesUsed);
+      return ReadFrameMemoryMap(buf);
     }
     case IO_METHOD_USERPTR:
     {
-      return ReadFrameUserPtr(currentBufferIndex, bytesUsed);
+      return ReadFrameUserPtr(buf);
     }
   }
 
@@ -581,9 +760,10 @@ PlusStatus vtkPlusV4L2VideoSource::ReadFrame(unsigned int& currentBufferIndex, u
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusV4L2VideoSource::ReadFrameFileDescriptor(unsigned int& currentBufferIndex, unsigned int& bytesUsed)
+PlusStatus vtkPlusV4L2VideoSource::ReadFrameFileDescriptor(v4l2_buffer& buf)
 {
-  if (-1 == read(this->FileDescriptor, this->FrameBuffers[0].start, this->FrameBuffers[0].length))
+  ssize_t bytesRead = this->DeviceInterface->Read(this->FileDescriptor, this->FrameBuffers[0].start, this->FrameBuffers[0].length);
+  if (-1 == bytesRead)
   {
     switch (errno)
     {
@@ -603,22 +783,19 @@ PlusStatus vtkPlusV4L2VideoSource::ReadFrameFileDescriptor(unsigned int& current
     }
   }
 
-  currentBufferIndex = 0;
-  bytesUsed = this->FrameBuffers[0].length;
+  buf.index = 0;
+  buf.bytesused = static_cast<uint32_t>(bytesRead);
 
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusV4L2VideoSource::ReadFrameMemoryMap(unsigned int& currentBufferIndex, unsigned int& bytesUsed)
+PlusStatus vtkPlusV4L2VideoSource::ReadFrameMemoryMap(v4l2_buffer& buf)
 {
-  struct v4l2_buffer buf;
-  CLEAR(buf);
-
   buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   buf.memory = V4L2_MEMORY_MMAP;
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_DQBUF, &buf))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_DQBUF, &buf))
   {
     switch (errno)
     {
@@ -638,28 +815,16 @@ PlusStatus vtkPlusV4L2VideoSource::ReadFrameMemoryMap(unsigned int& currentBuffe
     }
   }
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
-  {
-    LOG_ERROR("VIDIOC_QBUF" << ": " << strerror(errno));
-    return PLUS_FAIL;
-  }
-
-  currentBufferIndex = buf.index;
-  bytesUsed = buf.length;
-
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusV4L2VideoSource::ReadFrameUserPtr(unsigned int& currentBufferIndex, unsigned int& bytesUsed)
+PlusStatus vtkPlusV4L2VideoSource::ReadFrameUserPtr(v4l2_buffer& buf)
 {
-  v4l2_buffer buf;
-  CLEAR(buf);
-
   buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   buf.memory = V4L2_MEMORY_USERPTR;
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_DQBUF, &buf))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_DQBUF, &buf))
   {
     switch (errno)
     {
@@ -679,6 +844,8 @@ PlusStatus vtkPlusV4L2VideoSource::ReadFrameUserPtr(unsigned int& currentBufferI
     }
   }
 
+  // The driver may not preserve the index of user pointer buffers, find the buffer by its address
+  unsigned int currentBufferIndex = 0;
   for (currentBufferIndex = 0; currentBufferIndex < this->BufferCount; ++currentBufferIndex)
   {
     if (buf.m.userptr == (unsigned long) this->FrameBuffers[currentBufferIndex].start && buf.length == this->FrameBuffers[currentBufferIndex].length)
@@ -686,18 +853,106 @@ PlusStatus vtkPlusV4L2VideoSource::ReadFrameUserPtr(unsigned int& currentBufferI
       break;
     }
   }
+  if (currentBufferIndex == this->BufferCount)
+  {
+    LOG_ERROR("VIDIOC_DQBUF returned an unknown user pointer buffer");
+    this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_QBUF, &buf);
+    return PLUS_FAIL;
+  }
+  buf.index = currentBufferIndex;
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusV4L2VideoSource::RequeueBuffer(v4l2_buffer& buf)
+{
+  if (this->IOMethod == IO_METHOD_READ)
+  {
+    // The buffer is owned by Plus
+    return PLUS_SUCCESS;
+  }
 
-  if (-1 == xioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
+  if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
   {
     LOG_ERROR("VIDIOC_QBUF" << ": " << strerror(errno));
     return PLUS_FAIL;
   }
 
-  bytesUsed = buf.bytesused;
+  return PLUS_SUCCESS;
+}
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusV4L2VideoSource::SetDeviceInterface(std::shared_ptr<PlusV4L2DeviceInterface> deviceInterface)
+{
+  if (this->Connected)
+  {
+    LOG_ERROR("The device interface of " << this->GetDeviceId() << " cannot be changed while the device is connected.");
+    return PLUS_FAIL;
+  }
+  if (deviceInterface == nullptr)
+  {
+    deviceInterface = std::make_shared<PlusV4L2SystemDeviceInterface>();
+  }
+  this->DeviceInterface = deviceInterface;
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+std::shared_ptr<PlusV4L2DeviceInterface> vtkPlusV4L2VideoSource::GetDeviceInterface() const
+{
+  return this->DeviceInterface;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkPlusV4L2VideoSource::GetNumberOfCapturedFrames()
+{
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  return this->NumberOfCapturedFrames;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkPlusV4L2VideoSource::GetNumberOfDroppedFrames()
+{
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  return this->NumberOfDroppedFrames;
+}
+
+//----------------------------------------------------------------------------
+double vtkPlusV4L2VideoSource::GetAverageCaptureLatencySec()
+{
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  return (this->NumberOfCaptureLatencySamples > 0 ? this->CaptureLatencySumSec / this->NumberOfCaptureLatencySamples : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double vtkPlusV4L2VideoSource::GetAverageBufferHoldTimeSec()
+{
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  return (this->NumberOfCapturedFrames > 0 ? this->BufferHoldTimeSumSec / this->NumberOfCapturedFrames : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double vtkPlusV4L2VideoSource::GetMaximumBufferHoldTimeSec()
+{
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  return this->MaximumBufferHoldTimeSec;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusV4L2VideoSource::ResetFrameStatistics()
+{
+  std::lock_guard<std::mutex> lock(this->FrameStatisticsMutex);
+  this->NumberOfCapturedFrames = 0;
+  this->NumberOfDroppedFrames = 0;
+  this->LastSequenceValid = false;
+  this->LastSequence = 0;
+  this->NumberOfCaptureLatencySamples = 0;
+  this->CaptureLatencySumSec = 0.0;
+  this->BufferHoldTimeSumSec = 0.0;
+  this->MaximumBufferHoldTimeSec = 0.0;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusV4L2VideoSource::NotifyConfigured()
 {
@@ -733,7 +988,7 @@ PlusStatus vtkPlusV4L2VideoSource::InternalStopRecording()
     case IO_METHOD_USERPTR:
     {
       type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      if (-1 == xioctl(this->FileDescriptor, VIDIOC_STREAMOFF, &type))
+      if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_STREAMOFF, &type))
       {
         LOG_ERROR("VIDIOC_STREAMOFF" << ": " << strerror(errno));
         break;
@@ -749,6 +1004,8 @@ PlusStatus vtkPlusV4L2VideoSource::InternalStartRecording()
 {
   enum v4l2_buf_type type;
 
+  this->ResetFrameStatistics();
+
   switch (this->IOMethod)
   {
     case IO_METHOD_MMAP:
@@ -761,14 +1018,14 @@ PlusStatus vtkPlusV4L2VideoSource::InternalStartRecording()
         buf.memory = V4L2_MEMORY_MMAP;
         buf.index = i;
 
-        if (-1 == xioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
+        if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
         {
           LOG_ERROR("VIDIOC_QBUF" << ": " << strerror(errno));
           return PLUS_FAIL;
         }
       }
       type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      if (-1 == xioctl(this->FileDescriptor, VIDIOC_STREAMON, &type))
+      if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_STREAMON, &type))
       {
         LOG_ERROR("VIDIOC_STREAMON" << ": " << strerror(errno));
         return PLUS_FAIL;
@@ -787,14 +1044,14 @@ PlusStatus vtkPlusV4L2VideoSource::InternalStartRecording()
         buf.m.userptr = (unsigned long) this->FrameBuffers[i].start;
         buf.length = this->FrameBuffers[i].length;
 
-        if (-1 == xioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
+        if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_QBUF, &buf))
         {
           LOG_ERROR("VIDIOC_QBUF" << ": " << strerror(errno));
           return PLUS_FAIL;
         }
       }
       type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      if (-1 == xioctl(this->FileDescriptor, VIDIOC_STREAMON, &type))
+      if (-1 == this->DeviceInterface->Ioctl(this->FileDescriptor, VIDIOC_STREAMON, &type))
       {
         LOG_ERROR("VIDIOC_STREAMON" << ": " << strerror(errno));
         return PLUS_FAIL;
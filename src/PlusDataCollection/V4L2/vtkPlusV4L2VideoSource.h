@@ -13,6 +13,12 @@
 // V4L2 includes
 #include <linux/videodev2.h>
 
+// STL includes
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class PlusV4L2DeviceInterface;
 class vtkPlusDataSource;
 
 /*!
@@ -21,6 +27,19 @@ class vtkPlusDataSource;
 
  Requires the PLUS_USE_V4L2 option in CMake.
 
+ MJPEG frames are decoded to RGB24 (if the image type of the video source is RGB_COLOR) or grayscale,
+ which requires the PLUS_USE_LIBJPEG_TURBO option in CMake. They are decoded directly into a frame reserved
+ in the buffer of the video source (see StreamBufferItemReservation), so readers of the buffer are not blocked while decoding.
+
+ In the streaming IO methods (IO_METHOD_MMAP, IO_METHOD_USERPTR) a dequeued buffer is owned by Plus until its
+ content has been copied (or decoded) into the Plus buffer, and it is only queued to the driver afterwards, so that the
+ driver cannot overwrite a frame while it is being read. If ExportDmaBuf is enabled (IO_METHOD_MMAP only), the buffers
+ are exported as DMABUF file descriptors (VIDIOC_EXPBUF), the pixel data is accessed through the DMABUF mapping and
+ CPU access is synchronized with DMA_BUF_IOCTL_SYNC.
+
+ The number of dropped frames (gaps in the frame sequence numbers of the driver), the capture latency (time from the
+ driver timestamp to dequeuing the buffer) and the time while a buffer is held by Plus are recorded during acquisition.
+
  \ingroup PlusLibDataCollection
  */
 
@@ -38,6 +57,7 @@ class vtkPlusDataCollectionExport vtkPlusV4L2VideoSource : public vtkPlusDevice
   {
     void* start;
     size_t length;
+    int dmaBufFileDescriptor; // -1 if the buffer is not exported
   };
 
 public:
@@ -63,15 +83,50 @@ public:
   vtkSetStdStringMacro(DeviceName);
   vtkGetStdStringMacro(DeviceName);
 
+  /*! Export the buffers as DMABUF file descriptors and access the pixel data through them (IO_METHOD_MMAP only) */
+  vtkSetMacro(ExportDmaBuf, bool);
+  vtkGetMacro(ExportDmaBuf, bool);
+
+  /*!
+    Set the interface that is used for communicating with the device. By default the system calls are used.
+    The interface can only be changed while the device is not connected.
+  */
+  PlusStatus SetDeviceInterface(std::shared_ptr<PlusV4L2DeviceInterface> deviceInterface);
+  std::shared_ptr<PlusV4L2DeviceInterface> GetDeviceInterface() const;
+
+  /*! Number of frames that have been read from the device since the recording started */
+  unsigned long GetNumberOfCapturedFrames();
+  /*! Number of frames that the driver skipped (detected from the frame sequence numbers) since the recording started */
+  unsigned long GetNumberOfDroppedFrames();
+  /*! Average time between the driver timestamp of the frames and dequeuing the buffer. Only available if the driver uses monotonic timestamps. */
+  double GetAverageCaptureLatencySec();
+  /*! Average time between dequeuing a buffer and queuing it again to the driver */
+  double GetAverageBufferHoldTimeSec();
+  /*! Maximum time between dequeuing a buffer and queuing it again to the driver */
+  double GetMaximumBufferHoldTimeSec();
+  void ResetFrameStatistics();
+
 protected:
   vtkPlusV4L2VideoSource();
   ~vtkPlusV4L2VideoSource();
 
-  PlusStatus ReadFrame(unsigned int& currentBufferIndex, unsigned int& bytesUsed);
+  /*! Read the next frame. In the streaming IO methods the buffer is dequeued and has to be returned to the driver by RequeueBuffer. */
+  PlusStatus ReadFrame(v4l2_buffer& buf);
+
+  PlusStatus ReadFrameFileDescriptor(v4l2_buffer& buf);
+  PlusStatus ReadFrameMemoryMap(v4l2_buffer& buf);
+  PlusStatus ReadFrameUserPtr(v4l2_buffer& buf);
+
+  /*! Queue a buffer returned by ReadFrame to the driver again, after its content has been consumed */
+  PlusStatus RequeueBuffer(v4l2_buffer& buf);
+
+  /*! Copy (or decode) the content of a dequeued buffer into the buffer of the video source */
+  PlusStatus AddFrameToBuffer(const v4l2_buffer& buf);
+
+  /*! Start or end CPU access to the DMABUF of a buffer */
+  PlusStatus SyncDmaBuf(unsigned int bufferIndex, bool start);
 
-  PlusStatus ReadFrameFileDescriptor(unsigned int& currentBufferIndex, unsigned int& bytesUsed);
-  PlusStatus ReadFrameMemoryMap(unsigned int& currentBufferIndex, unsigned int& bytesUsed);
-  PlusStatus ReadFrameUserPtr(unsigned int& currentBufferIndex, unsigned int& bytesUsed);
+  void UpdateFrameStatistics(const v4l2_buffer& buf);
 
   PlusStatus InitRead(unsigned int bufferSize);
   PlusStatus InitMmap();
@@ -97,6 +152,7 @@ protected:
   // Configuration variables
   std::string                         DeviceName;
   V4L2_IO_METHOD                      IOMethod;
+  bool                                ExportDmaBuf;
   // If not nullptr, override these settings in InternalConnect
   std::shared_ptr<unsigned int>       FormatWidth;
   std::shared_ptr<unsigned int>       FormatHeight;
@@ -104,6 +160,7 @@ protected:
   std::shared_ptr<v4l2_field>         FieldOrder;
 
   // State variables
+  std::shared_ptr<PlusV4L2DeviceInterface> DeviceInterface;
   int                                 FileDescriptor;
   FrameBuffer*                        FrameBuffers;
   unsigned int                        BufferCount;
@@ -114,6 +171,18 @@ protected:
   // Cached state variable (duplicate of DeviceFormat members, for passing to Plus functions)
   FrameSizeType                       ImageSize;
   uint32_t                            NumberOfScalarComponents; // Calculated from device format in InternalConnect
+  StreamBufferItemReservation         DecodedFrame; // Output of the decoder for compressed pixel formats, reserved in the buffer of the video source
+
+  // Frame statistics, updated by the acquisition thread
+  std::mutex                          FrameStatisticsMutex;
+  unsigned long                       NumberOfCapturedFrames;
+  unsigned long                       NumberOfDroppedFrames;
+  bool                                LastSequenceValid;
+  uint32_t                            LastSequence;
+  unsigned long                       NumberOfCaptureLatencySamples;
+  double                              CaptureLatencySumSec;
+  double                              BufferHoldTimeSumSec;
+  double                              MaximumBufferHoldTimeSec;
 };
 
 #endif
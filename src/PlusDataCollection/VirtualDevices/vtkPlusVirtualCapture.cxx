@@ -12,9 +12,14 @@ See License.txt for details.
 #include "vtkPlusDataSource.h"
 #include "vtkIGSIOSequenceIO.h"
 #include "vtkIGSIOTrackedFrameList.h"
+#include "vtkPlusSequenceIO.h"
 #include "vtkPlusVirtualCapture.h"
 #include "vtksys/SystemTools.hxx"
 
+// STL includes
+#include <iomanip>
+#include <sstream>
+
 #ifdef PLUS_USE_VTKVIDEOIO_MKV
 //  #include "vtkPlusMkvSequenceIO.h"
 #endif
@@ -30,6 +35,42 @@ namespace
   static const double WARNING_RECORDING_LAG_SEC = 1.0; // if the recording lags more than this then a warning message will be displayed
   static const double MAX_ALLOWED_RECORDING_LAG_SEC = 3.0; // if the recording lags more than this then it'll skip frames to catch up
   static const unsigned int DISABLE_FRAME_BUFFER = std::numeric_limits<unsigned int>::max();
+  static const double FRAME_RATE_AVERAGING_PERIOD_SEC = 5.0; // actual frame rate is computed from the frames sampled in this period
+
+  static const char* KEY_WRITE_QUEUE_DEPTH = "WriteQueueDepth";
+  static const char* KEY_NUMBER_OF_DROPPED_FRAMES = "NumberOfDroppedFrames";
+  static const char* KEY_NUMBER_OF_SPILLED_FRAMES = "NumberOfSpilledFrames";
+  static const char* KEY_WRITE_THROUGHPUT_FPS = "WriteThroughputFramesPerSec";
+  static const char* KEY_WRITE_THROUGHPUT_MBPS = "WriteThroughputMBPerSec";
+  static const char* KEY_NUMBER_OF_FILES_TO_COMPRESS = "NumberOfFilesToCompress";
+  static const char* KEY_COMPRESSION_PROGRESS_PERCENT = "CompressionProgressPercent";
+  static const double COMPRESSION_PROGRESS_LOG_STEP_PERCENT = 10.0; // compression progress is logged when it increases by this amount
+
+  /*!
+    Suspends sampling of the input channel in background writing mode while the object exists.
+    The update mutex is only locked while the counter is changed, so the data capture thread can still run
+    (which is necessary if recording is stopped meanwhile).
+  */
+  class SamplingSuspender
+  {
+  public:
+    SamplingSuspender(vtkIGSIORecursiveCriticalSection* updateMutex, int& suspendCount)
+      : UpdateMutex(updateMutex)
+      , SuspendCount(suspendCount)
+    {
+      // Once the lock is acquired, the update that may be in progress is completed, and the next one will see the new count
+      igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->UpdateMutex);
+      this->SuspendCount++;
+    }
+    ~SamplingSuspender()
+    {
+      igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->UpdateMutex);
+      this->SuspendCount--;
+    }
+  private:
+    vtkIGSIORecursiveCriticalSection* UpdateMutex;
+    int& SuspendCount;
+  };
 }
 
 //----------------------------------------------------------------------------
@@ -47,6 +88,11 @@ vtkPlusVirtualCapture::vtkPlusVirtualCapture()
   , BaseFilename("TrackedImageSequence.nrrd")
   , Writer(NULL)
   , EnableFileCompression(false)
+  , NumberOfCompressionThreads(1)
+  , CompressCurrentFileInParallel(false)
+  , CompressionThreadStopRequested(false)
+  , CompressionBusy(false)
+  , CompressionProgressPercent(0.0)
   , IsHeaderPrepared(false)
   , TotalFramesRecorded(0)
   , EnableCapturingOnStart(false)
@@ -56,6 +102,24 @@ vtkPlusVirtualCapture::vtkPlusVirtualCapture()
   , WriterAccessMutex(vtkSmartPointer<vtkIGSIORecursiveCriticalSection>::New())
   , GracePeriodLogLevel(vtkPlusLogger::LOG_LEVEL_DEBUG)
   , EncodingFourCC("VP90")
+  , EnableBackgroundWriting(false)
+  , WriteQueueMaxFrames(100)
+  , WriteQueueFullPolicy(WRITE_QUEUE_FULL_BLOCK)
+  , NextWriteQueueItemId(0)
+  , NumberOfQueuedFramesInMemory(0)
+  , NumberOfQueuedFramesInSpillFiles(0)
+  , NumberOfQueuedFramesWaitingForSpill(0)
+  , WriterThreadStopRequested(false)
+  , WriterBusy(false)
+  , WriteFailed(false)
+  , SamplingSuspendCount(0)
+  , DroppingFrames(false)
+  , NumberOfDroppedFrames(0)
+  , NumberOfSpilledFrames(0)
+  , NumberOfSpillFilesCreated(0)
+  , NumberOfWrittenFrames(0)
+  , NumberOfWrittenBytes(0.0)
+  , WriteTimeSec(0.0)
 {
   this->AcquisitionRate = 30.0;
   this->MissingInputGracePeriodSec = 2.0;
@@ -63,16 +127,23 @@ vtkPlusVirtualCapture::vtkPlusVirtualCapture()
 
   // The data capture thread will be used to regularly read the frames and write to disk
   this->StartThreadForInternalUpdates = true;
+  this->UpdateOnNewInputData = true;
 }
 
 //----------------------------------------------------------------------------
 vtkPlusVirtualCapture::~vtkPlusVirtualCapture()
 {
+  // Write the queued frames, the writer thread must not access the members after they are deleted
+  this->StopWriterThread();
+
   if (IsHeaderPrepared)
   {
     this->CloseFile();
   }
 
+  // Closed files are not left uncompressed
+  this->StopCompressionThread();
+
   if (RecordedFrames != NULL)
   {
     this->RecordedFrames->Delete();
@@ -90,6 +161,13 @@ vtkPlusVirtualCapture::~vtkPlusVirtualCapture()
 void vtkPlusVirtualCapture::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "EnableBackgroundWriting: " << (this->EnableBackgroundWriting ? "TRUE" : "FALSE") << std::endl;
+  os << indent << "WriteQueueMaxFrames: " << this->WriteQueueMaxFrames << std::endl;
+  os << indent << "WriteQueueDepth: " << this->GetWriteQueueDepth() << std::endl;
+  os << indent << "NumberOfDroppedFrames: " << this->GetNumberOfDroppedFrames() << std::endl;
+  os << indent << "NumberOfSpilledFrames: " << this->GetNumberOfSpilledFrames() << std::endl;
+  os << indent << "WriteThroughputFramesPerSec: " << this->GetWriteThroughputFramesPerSec() << std::endl;
 }
 
 //----------------------------------------------------------------------------
@@ -105,10 +183,17 @@ PlusStatus vtkPlusVirtualCapture::ReadConfiguration(vtkXMLDataElement* rootConfi
 
   XML_READ_STRING_ATTRIBUTE_OPTIONAL(BaseFilename, deviceConfig);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableFileCompression, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfCompressionThreads, deviceConfig);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableCapturingOnStart, deviceConfig);
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, RequestedFrameRate, deviceConfig);
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, FrameBufferSize, deviceConfig);
   XML_READ_STRING_ATTRIBUTE_OPTIONAL(EncodingFourCC, deviceConfig);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableBackgroundWriting, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, WriteQueueMaxFrames, deviceConfig);
+  XML_READ_ENUM3_ATTRIBUTE_OPTIONAL(WriteQueueFullPolicy, deviceConfig,
+                                    "Block", WRITE_QUEUE_FULL_BLOCK,
+                                    "Drop", WRITE_QUEUE_FULL_DROP,
+                                    "Spill", WRITE_QUEUE_FULL_SPILL);
 
   return PLUS_SUCCESS;
 }
@@ -119,8 +204,28 @@ PlusStatus vtkPlusVirtualCapture::WriteConfiguration(vtkXMLDataElement* rootConf
   XML_FIND_DEVICE_ELEMENT_REQUIRED_FOR_WRITING(deviceElement, rootConfig);
   deviceElement->SetAttribute("EnableCapturing", this->EnableCapturing ? "TRUE" : "FALSE");
   deviceElement->SetAttribute("EnableFileCompression", this->EnableFileCompression ? "TRUE" : "FALSE");
+  if (this->NumberOfCompressionThreads != 1)
+  {
+    deviceElement->SetIntAttribute("NumberOfCompressionThreads", this->NumberOfCompressionThreads);
+  }
   deviceElement->SetAttribute("EnableCaptureOnStart", this->EnableCapturingOnStart ? "TRUE" : "FALSE");
   deviceElement->SetDoubleAttribute("RequestedFrameRate", this->GetRequestedFrameRate());
+  if (this->EnableBackgroundWriting)
+  {
+    deviceElement->SetAttribute("EnableBackgroundWriting", "TRUE");
+    deviceElement->SetIntAttribute("WriteQueueMaxFrames", this->WriteQueueMaxFrames);
+    switch (this->WriteQueueFullPolicy)
+    {
+      case WRITE_QUEUE_FULL_DROP:
+        deviceElement->SetAttribute("WriteQueueFullPolicy", "Drop");
+        break;
+      case WRITE_QUEUE_FULL_SPILL:
+        deviceElement->SetAttribute("WriteQueueFullPolicy", "Spill");
+        break;
+      default:
+        deviceElement->SetAttribute("WriteQueueFullPolicy", "Block");
+    }
+  }
 
   return PLUS_SUCCESS;
 }
@@ -149,6 +254,9 @@ PlusStatus vtkPlusVirtualCapture::InternalDisconnect()
 {
   this->EnableCapturing = false;
 
+  // Let the background writer complete the queued frames, so that it does not access the recorded frames meanwhile
+  this->FlushWriteQueue();
+
   // If outstanding frames to be written, deal with them
   if (this->RecordedFrames->GetNumberOfTrackedFrames() != 0 && this->IsHeaderPrepared)
   {
@@ -168,6 +276,7 @@ PlusStatus vtkPlusVirtualCapture::InternalDisconnect()
     this->ClearRecordedFrames();
   }
   PlusStatus status = this->CloseFile();
+  this->StopWriterThread();
   return status;
 }
 
@@ -211,17 +320,38 @@ PlusStatus vtkPlusVirtualCapture::OpenFile(const char* aFilename)
     LOG_ERROR("Could not create writer for file: " << aFilename);
     return PLUS_FAIL;
   }
-  this->Writer->SetUseCompression(this->EnableFileCompression);
+  // Parallel compression is implemented for NRRD files, other formats are compressed by their writer.
+  // With parallel compression the data is written uncompressed and compressed when the file is closed.
+  std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(this->CurrentFilename));
+  this->CompressCurrentFileInParallel = this->EnableFileCompression && this->NumberOfCompressionThreads != 1 && (extension == ".nrrd" || extension == ".nhdr");
+  this->Writer->SetUseCompression(this->EnableFileCompression && !this->CompressCurrentFileInParallel);
   this->Writer->SetTrackedFrameList(this->RecordedFrames);
   // Need to set the filename before finalizing header, because the pixel data file name depends on the file extension
   this->Writer->SetFileName(vtkPlusConfig::GetInstance()->GetOutputPath(aFilename));
 
+  {
+    // Write queue statistics are reported for the current file
+    std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+    this->WriteFailed = false;
+    this->DroppingFrames = false;
+    this->NumberOfDroppedFrames = 0;
+    this->NumberOfSpilledFrames = 0;
+    this->NumberOfWrittenFrames = 0;
+    this->NumberOfWrittenBytes = 0.0;
+    this->WriteTimeSec = 0.0;
+  }
+
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualCapture::CloseFile(const char* aFilename /* = NULL */, std::string* resultFilename /* = NULL */)
 {
+  // Prevent the data capture thread from queuing more frames until the file is closed,
+  // and write all the queued frames before the header is finalized
+  SamplingSuspender samplingSuspender(this->UpdateMutex, this->SamplingSuspendCount);
+  this->FlushWriteQueue();
+
   // Fix the header to write the correct number of frames
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->WriterAccessMutex);
 
@@ -238,6 +368,9 @@ PlusStatus vtkPlusVirtualCapture::CloseFile(const char* aFilename /* = NULL */,
     this->CurrentFilename = aFilename;
   }
 
+  // A previous recording to the same file may still be compressed in the background
+  this->WaitForFileCompression(this->Writer->GetFileName());
+
   // Do we have any outstanding unwritten data?
   if (this->RecordedFrames->GetNumberOfTrackedFrames() != 0)
   {
@@ -254,8 +387,15 @@ PlusStatus vtkPlusVirtualCapture::CloseFile(const char* aFilename /* = NULL */,
     (*resultFilename) = this->Writer->GetFileName();
   }
 
+  std::string writtenFilePath = this->Writer->GetFileName();
   this->Writer->Close();
 
+  if (this->EnableFileCompression && this->CompressCurrentFileInParallel)
+  {
+    // Compression takes long for large files, so it is done in the background and the next recording can start meanwhile
+    this->QueueFileForCompression(writtenFilePath);
+  }
+
   std::string fullPath = vtkPlusConfig::GetInstance()->GetOutputPath(this->CurrentFilename);
   std::string path = vtksys::SystemTools::GetFilenamePath(fullPath);
   std::string filename = vtksys::SystemTools::GetFilenameWithoutExtension(fullPath);
@@ -330,53 +470,63 @@ PlusStatus vtkPlusVirtualCapture::InternalUpdate()
     this->GracePeriodLogLevel = vtkPlusLogger::LOG_LEVEL_WARNING;
   }
 
-  igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->WriterAccessMutex);
-  if (!this->EnableCapturing)
+  if (this->EnableBackgroundWriting)
   {
-    // While this thread was waiting for the unlock, capturing was disabled, so cancel the update now
-    return PLUS_SUCCESS;
+    if (this->SampleFramesForBackgroundWriting(requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
   }
-
-  int nbFramesBefore = this->RecordedFrames->GetNumberOfTrackedFrames();
-  if (this->GetInputTrackedFrameListSampled(this->LastAlreadyRecordedFrameTimestamp, this->NextFrameToBeRecordedTimestamp, this->RecordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+  else
   {
-    LOG_ERROR("Error while getting tracked frame list from data collector during capturing. Last recorded timestamp: " << std::fixed << this->NextFrameToBeRecordedTimestamp);
-  }
-  int nbFramesAfter = this->RecordedFrames->GetNumberOfTrackedFrames();
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->WriterAccessMutex);
+    if (!this->EnableCapturing)
+    {
+      // While this thread was waiting for the unlock, capturing was disabled, so cancel the update now
+      return PLUS_SUCCESS;
+    }
 
-  // Compute the average frame rate from the ratio of recently acquired frames
-  int frame1Index = this->RecordedFrames->GetNumberOfTrackedFrames() - 1; // index of the latest frame
-  int frame2Index = frame1Index - this->RequestedFrameRate * 5.0 - 1; // index of an earlier acquired frame (go back by approximately 5 seconds + one frame)
-  if (frame2Index < this->FirstFrameIndexInThisSegment)
-  {
-    // make sure we stay in the current recording segment
-    frame2Index = this->FirstFrameIndexInThisSegment;
-  }
-  if (frame1Index > frame2Index)
-  {
-    igsioTrackedFrame* frame1 = this->RecordedFrames->GetTrackedFrame(frame1Index);
-    igsioTrackedFrame* frame2 = this->RecordedFrames->GetTrackedFrame(frame2Index);
-    if (frame1 != NULL && frame2 != NULL)
+    int nbFramesBefore = this->RecordedFrames->GetNumberOfTrackedFrames();
+    if (this->GetInputTrackedFrameListSampled(this->LastAlreadyRecordedFrameTimestamp, this->NextFrameToBeRecordedTimestamp, this->RecordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
     {
-      double frameTimeDiff = frame1->GetTimestamp() - frame2->GetTimestamp();
-      if (frameTimeDiff > 0)
-      {
-        this->ActualFrameRate = (frame1Index - frame2Index) / frameTimeDiff;
-      }
-      else
+      LOG_ERROR("Error while getting tracked frame list from data collector during capturing. Last recorded timestamp: " << std::fixed << this->NextFrameToBeRecordedTimestamp);
+    }
+    int nbFramesAfter = this->RecordedFrames->GetNumberOfTrackedFrames();
+
+    // Compute the average frame rate from the ratio of recently acquired frames
+    int frame1Index = this->RecordedFrames->GetNumberOfTrackedFrames() - 1; // index of the latest frame
+    int frame2Index = frame1Index - this->RequestedFrameRate * 5.0 - 1; // index of an earlier acquired frame (go back by approximately 5 seconds + one frame)
+    if (frame2Index < this->FirstFrameIndexInThisSegment)
+    {
+      // make sure we stay in the current recording segment
+      frame2Index = this->FirstFrameIndexInThisSegment;
+    }
+    if (frame1Index > frame2Index)
+    {
+      igsioTrackedFrame* frame1 = this->RecordedFrames->GetTrackedFrame(frame1Index);
+      igsioTrackedFrame* frame2 = this->RecordedFrames->GetTrackedFrame(frame2Index);
+      if (frame1 != NULL && frame2 != NULL)
       {
-        this->ActualFrameRate = 0;
+        double frameTimeDiff = frame1->GetTimestamp() - frame2->GetTimestamp();
+        if (frameTimeDiff > 0)
+        {
+          this->ActualFrameRate = (frame1Index - frame2Index) / frameTimeDiff;
+        }
+        else
+        {
+          this->ActualFrameRate = 0;
+        }
       }
     }
-  }
 
-  if (this->WriteFrames() != PLUS_SUCCESS)
-  {
-    LOG_ERROR(this->GetDeviceId() << ": Unable to write " << nbFramesAfter - nbFramesBefore << " frames.");
-    return PLUS_FAIL;
-  }
+    if (this->WriteFrames() != PLUS_SUCCESS)
+    {
+      LOG_ERROR(this->GetDeviceId() << ": Unable to write " << nbFramesAfter - nbFramesBefore << " frames.");
+      return PLUS_FAIL;
+    }
 
-  this->TotalFramesRecorded += nbFramesAfter - nbFramesBefore;
+    this->TotalFramesRecorded += nbFramesAfter - nbFramesBefore;
+  }
 
   if (this->TotalFramesRecorded == 0)
   {
@@ -472,7 +622,7 @@ void vtkPlusVirtualCapture::SetEnableFileCompression(bool aFileCompression)
 {
   if (this->Writer != NULL)
   {
-    this->Writer->SetUseCompression(aFileCompression);
+    this->Writer->SetUseCompression(aFileCompression && !this->CompressCurrentFileInParallel);
   }
 
   this->EnableFileCompression = aFileCompression;
@@ -490,6 +640,7 @@ void vtkPlusVirtualCapture::SetEnableCapturing(bool aValue)
     this->LastAlreadyRecordedFrameTimestamp = UNDEFINED_TIMESTAMP;
     this->NextFrameToBeRecordedTimestamp = 0.0;
     this->FirstFrameIndexInThisSegment = this->RecordedFrames->GetNumberOfTrackedFrames();
+    this->RecentFrameTimestamps.clear();
     this->RecordingStartTime = vtkIGSIOAccurateTimer::GetSystemTime(); // reset the starting time for the grace period
   }
 }
@@ -498,9 +649,11 @@ void vtkPlusVirtualCapture::SetEnableCapturing(bool aValue)
 PlusStatus vtkPlusVirtualCapture::Reset()
 {
   {
-    igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->WriterAccessMutex);
-
+    SamplingSuspender samplingSuspender(this->UpdateMutex, this->SamplingSuspendCount);
     this->SetEnableCapturing(false);
+    this->DiscardWriteQueue();
+
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->WriterAccessMutex);
 
     if (this->IsHeaderPrepared)
     {
@@ -539,6 +692,9 @@ PlusStatus vtkPlusVirtualCapture::TakeSnapshot()
     return PLUS_FAIL;
   }
 
+  // Frames that are still in the write queue must be written before the snapshot
+  this->FlushWriteQueue();
+
   igsioTrackedFrame trackedFrame;
   if (this->GetInputTrackedFrame(trackedFrame) != PLUS_SUCCESS)
   {
@@ -603,13 +759,24 @@ PlusStatus vtkPlusVirtualCapture::SetCustomHeaderField(const std::string& fieldN
 
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualCapture::WriteFrames(bool force)
+{
+  if (this->WriteFramesToFile(force) != PLUS_SUCCESS)
+  {
+    this->StopRecording();
+    return PLUS_FAIL;
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualCapture::WriteFramesToFile(bool force)
 {
   if (!this->IsHeaderPrepared && this->RecordedFrames->GetNumberOfTrackedFrames() != 0)
   {
     if (this->Writer->PrepareHeader() != PLUS_SUCCESS)
     {
       LOG_ERROR("Unable to prepare header");
-      this->StopRecording();
       return PLUS_FAIL;
     }
     this->IsHeaderPrepared = true;
@@ -628,13 +795,11 @@ PlusStatus vtkPlusVirtualCapture::WriteFrames(bool force)
     if (this->Writer->AppendImagesToHeader() != PLUS_SUCCESS)
     {
       LOG_ERROR("Unable to append image data to header.");
-      this->StopRecording();
       return PLUS_FAIL;
     }
     if (this->Writer->WriteImages() != PLUS_SUCCESS)
     {
       LOG_ERROR("Unable to append images. Stopping recording at timestamp: " << LastAlreadyRecordedFrameTimestamp);
-      this->StopRecording();
       return PLUS_FAIL;
     }
 
@@ -644,6 +809,606 @@ PlusStatus vtkPlusVirtualCapture::WriteFrames(bool force)
   return PLUS_SUCCESS;
 }
 
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::UpdateActualFrameRate(vtkIGSIOTrackedFrameList* sampledFrames)
+{
+  for (unsigned int i = 0; i < sampledFrames->GetNumberOfTrackedFrames(); ++i)
+  {
+    this->RecentFrameTimestamps.push_back(sampledFrames->GetTrackedFrame(i)->GetTimestamp());
+  }
+  if (this->RecentFrameTimestamps.empty())
+  {
+    return;
+  }
+  // Keep one more frame than the averaging period, as the frame rate is computed from the time differences
+  while (this->RecentFrameTimestamps.size() > 2 && this->RecentFrameTimestamps.back() - this->RecentFrameTimestamps[1] > FRAME_RATE_AVERAGING_PERIOD_SEC)
+  {
+    this->RecentFrameTimestamps.pop_front();
+  }
+  if (this->RecentFrameTimestamps.size() < 2)
+  {
+    return;
+  }
+  double frameTimeDiff = this->RecentFrameTimestamps.back() - this->RecentFrameTimestamps.front();
+  this->ActualFrameRate = (frameTimeDiff > 0 ? (this->RecentFrameTimestamps.size() - 1) / frameTimeDiff : 0);
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualCapture::SampleFramesForBackgroundWriting(double requestedFramePeriodSec, double maxProcessingTimeSec)
+{
+  if (this->SamplingSuspendCount > 0)
+  {
+    // The file is being closed or reset, frames remain in the input buffers until it is completed
+    return PLUS_SUCCESS;
+  }
+
+  if (this->WriteQueueFullPolicy == WRITE_QUEUE_FULL_BLOCK)
+  {
+    std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+    if (this->NumberOfQueuedFramesInMemory >= this->WriteQueueMaxFrames)
+    {
+      // Frames remain in the input buffers and will be sampled when there is space in the queue.
+      // If it takes too long then the recording lag check skips the frames that are not recorded in time.
+      LOG_TRACE(this->GetDeviceId() << ": Write queue is full, sampling of new frames is postponed");
+      return PLUS_SUCCESS;
+    }
+  }
+  else if (this->WriteQueueFullPolicy == WRITE_QUEUE_FULL_SPILL)
+  {
+    std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+    if (this->NumberOfQueuedFramesWaitingForSpill >= this->WriteQueueMaxFrames)
+    {
+      // Frames that wait for spilling are kept in memory, so their number is limited the same way as the write queue
+      LOG_TRACE(this->GetDeviceId() << ": Temporary files cannot be written fast enough, sampling of new frames is postponed");
+      return PLUS_SUCCESS;
+    }
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> sampledFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  sampledFrames->SetValidationRequirements(REQUIRE_UNIQUE_TIMESTAMP);
+  if (this->GetInputTrackedFrameListSampled(this->LastAlreadyRecordedFrameTimestamp, this->NextFrameToBeRecordedTimestamp, sampledFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Error while getting tracked frame list from data collector during capturing. Last recorded timestamp: " << std::fixed << this->NextFrameToBeRecordedTimestamp);
+  }
+  if (sampledFrames->GetNumberOfTrackedFrames() == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  this->UpdateActualFrameRate(sampledFrames);
+
+  return this->QueueFramesForWriting(sampledFrames);
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualCapture::QueueFramesForWriting(vtkIGSIOTrackedFrameList* frames)
+{
+  this->StartWriterThread();
+
+  WriteQueueItem item;
+  item.NumberOfFrames = frames->GetNumberOfTrackedFrames();
+  item.Frames = frames;
+
+  std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+  if (this->WriteFailed)
+  {
+    // Error has been already reported by the writer thread
+    return PLUS_FAIL;
+  }
+
+  // A batch is always accepted into an empty queue, even if it is larger than the queue size
+  bool queueFull = (this->NumberOfQueuedFramesInMemory > 0 && this->NumberOfQueuedFramesInMemory + item.NumberOfFrames > this->WriteQueueMaxFrames);
+  if (queueFull && this->WriteQueueFullPolicy == WRITE_QUEUE_FULL_DROP)
+  {
+    this->NumberOfDroppedFrames += item.NumberOfFrames;
+    bool droppingStarted = !this->DroppingFrames;
+    this->DroppingFrames = true;
+    queueLock.unlock();
+    if (droppingStarted)
+    {
+      LOG_WARNING(this->GetDeviceId() << ": Writing to file cannot keep up with the recording, frames are dropped until there is space in the write queue");
+    }
+    return PLUS_SUCCESS;
+  }
+  this->DroppingFrames = false;
+
+  if (queueFull && this->WriteQueueFullPolicy == WRITE_QUEUE_FULL_SPILL)
+  {
+    // The temporary file is written by the spill thread, so that file writing does not delay sampling
+    item.SpillRequested = true;
+    this->NumberOfQueuedFramesInSpillFiles += item.NumberOfFrames;
+    this->NumberOfQueuedFramesWaitingForSpill += item.NumberOfFrames;
+  }
+  else
+  {
+    this->NumberOfQueuedFramesInMemory += item.NumberOfFrames;
+  }
+
+  item.Id = this->NextWriteQueueItemId++;
+  this->WriteQueue.push_back(item);
+  this->TotalFramesRecorded += item.NumberOfFrames;
+  queueLock.unlock();
+  this->WriteQueueChanged.notify_all();
+
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::FlushWriteQueue()
+{
+  std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+  this->WriteQueueChanged.wait(queueLock, [this]() { return this->WriteQueue.empty() && !this->WriterBusy; });
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::DiscardWriteQueue()
+{
+  std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+  for (std::deque<WriteQueueItem>::iterator it = this->WriteQueue.begin(); it != this->WriteQueue.end(); ++it)
+  {
+    if (!it->SpillRequested)
+    {
+      this->NumberOfQueuedFramesInMemory -= it->NumberOfFrames;
+    }
+    else
+    {
+      this->NumberOfQueuedFramesInSpillFiles -= it->NumberOfFrames;
+      if (it->Frames.GetPointer() != NULL)
+      {
+        // If the spill thread is writing the frames then it removes the temporary file when it finds that the item is discarded
+        this->NumberOfQueuedFramesWaitingForSpill -= it->NumberOfFrames;
+      }
+      else
+      {
+        vtksys::SystemTools::RemoveFile(it->SpillFilePath);
+      }
+    }
+  }
+  this->WriteQueue.clear();
+  this->WriteQueueChanged.wait(queueLock, [this]() { return !this->WriterBusy; });
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::StartWriterThread()
+{
+  if (this->WriterThread.joinable())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+    this->WriterThreadStopRequested = false;
+  }
+  this->WriterThread = std::thread(&vtkPlusVirtualCapture::WriterThreadMain, this);
+  this->SpillThread = std::thread(&vtkPlusVirtualCapture::SpillThreadMain, this);
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::StopWriterThread()
+{
+  if (!this->WriterThread.joinable())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+    this->WriterThreadStopRequested = true;
+  }
+  this->WriteQueueChanged.notify_all();
+  this->WriterThread.join();
+  this->SpillThread.join();
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::WriterThreadMain()
+{
+  while (true)
+  {
+    WriteQueueItem item;
+    bool writeFailedPreviously = false;
+    {
+      std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+      // If the front item is being moved to a temporary file then it is written after the spill thread completed it
+      this->WriteQueueChanged.wait(queueLock, [this]()
+      {
+        return this->WriteQueue.empty() ? this->WriterThreadStopRequested : !this->WriteQueue.front().SpillInProgress;
+      });
+      if (this->WriteQueue.empty())
+      {
+        // Stop is requested and all frames are written
+        return;
+      }
+
+      item = this->WriteQueue.front();
+      this->WriteQueue.pop_front();
+      if (item.SpillRequested && item.Frames.GetPointer() != NULL)
+      {
+        // The spill thread has not got to this item, it is written to the output file directly from memory
+        this->NumberOfQueuedFramesWaitingForSpill -= item.NumberOfFrames;
+      }
+      this->WriterBusy = true;
+      writeFailedPreviously = this->WriteFailed;
+    }
+
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    // After a write error the remaining frames are discarded (the file is not valid anymore)
+    PlusStatus status = (writeFailedPreviously ? PLUS_FAIL : PLUS_SUCCESS);
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> frames = item.Frames;
+    if (writeFailedPreviously)
+    {
+      if (!item.SpillFilePath.empty())
+      {
+        vtksys::SystemTools::RemoveFile(item.SpillFilePath);
+      }
+    }
+    else if (item.Frames.GetPointer() == NULL)
+    {
+      frames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+      status = vtkPlusSequenceIO::Read(item.SpillFilePath, frames);
+      vtksys::SystemTools::RemoveFile(item.SpillFilePath);
+      if (status != PLUS_SUCCESS)
+      {
+        LOG_ERROR(this->GetDeviceId() << ": Failed to read frames from temporary file " << item.SpillFilePath);
+      }
+    }
+
+    double numberOfBytes = 0.0;
+    if (status == PLUS_SUCCESS)
+    {
+      for (unsigned int i = 0; i < frames->GetNumberOfTrackedFrames(); ++i)
+      {
+        igsioTrackedFrame* frame = frames->GetTrackedFrame(i);
+        if (frame->GetImageData()->IsImageValid())
+        {
+          numberOfBytes += frame->GetImageData()->GetFrameSizeInBytes();
+        }
+      }
+
+      igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->WriterAccessMutex);
+      if (this->RecordedFrames->AddTrackedFrameList(frames) != PLUS_SUCCESS)
+      {
+        LOG_ERROR(this->GetDeviceId() << ": Failed to add " << item.NumberOfFrames << " frames to the recorded frame list");
+        status = PLUS_FAIL;
+      }
+      else
+      {
+        status = this->WriteFramesToFile(false);
+      }
+    }
+    double writeTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+
+    bool writeFailureStarted = false;
+    {
+      std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+      if (!item.SpillRequested)
+      {
+        this->NumberOfQueuedFramesInMemory -= item.NumberOfFrames;
+      }
+      else
+      {
+        this->NumberOfQueuedFramesInSpillFiles -= item.NumberOfFrames;
+      }
+      if (status == PLUS_SUCCESS)
+      {
+        this->NumberOfWrittenFrames += item.NumberOfFrames;
+        this->NumberOfWrittenBytes += numberOfBytes;
+        this->WriteTimeSec += writeTimeSec;
+      }
+      else if (!this->WriteFailed)
+      {
+        this->WriteFailed = true;
+        writeFailureStarted = true;
+      }
+      this->WriterBusy = false;
+    }
+    this->WriteQueueChanged.notify_all();
+
+    if (writeFailureStarted)
+    {
+      // Recording is not stopped from this thread (it is controlled by the thread that owns the device), only capturing is disabled
+      LOG_ERROR(this->GetDeviceId() << ": Unable to write frames to file, capturing is disabled.");
+      this->EnableCapturing = false;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::SpillThreadMain()
+{
+  while (true)
+  {
+    WriteQueueItem itemToSpill;
+    {
+      std::unique_lock<std::mutex> queueLock(this->WriteQueueMutex);
+      // The front item is written to the output file next, so only the items behind it are moved to temporary files
+      std::deque<WriteQueueItem>::iterator spillItem = this->WriteQueue.end();
+      this->WriteQueueChanged.wait(queueLock, [this, &spillItem]()
+      {
+        if (this->WriterThreadStopRequested)
+        {
+          return true;
+        }
+        if (this->WriteFailed || this->WriteQueue.size() < 2)
+        {
+          return false;
+        }
+        for (spillItem = this->WriteQueue.begin() + 1; spillItem != this->WriteQueue.end(); ++spillItem)
+        {
+          if (spillItem->SpillRequested && spillItem->Frames.GetPointer() != NULL && !spillItem->SpillInProgress)
+          {
+            return true;
+          }
+        }
+        return false;
+      });
+      if (this->WriterThreadStopRequested)
+      {
+        // The writer thread writes the remaining frames from memory
+        return;
+      }
+      spillItem->SpillInProgress = true;
+      itemToSpill = *spillItem;
+    }
+
+    std::string spillFilePath;
+    PlusStatus spillStatus = this->WriteSpillFile(itemToSpill, spillFilePath);
+
+    {
+      std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+      // The queue may have been discarded meanwhile, so the item is looked up again
+      bool itemFound = false;
+      for (std::deque<WriteQueueItem>::iterator it = this->WriteQueue.begin(); it != this->WriteQueue.end(); ++it)
+      {
+        if (it->Id != itemToSpill.Id)
+        {
+          continue;
+        }
+        itemFound = true;
+        it->SpillInProgress = false;
+        this->NumberOfQueuedFramesWaitingForSpill -= it->NumberOfFrames;
+        if (spillStatus == PLUS_SUCCESS)
+        {
+          it->Frames = NULL;
+          it->SpillFilePath = spillFilePath;
+          this->NumberOfSpilledFrames += it->NumberOfFrames;
+        }
+        else
+        {
+          // The frames are kept in memory
+          it->SpillRequested = false;
+          this->NumberOfQueuedFramesInSpillFiles -= it->NumberOfFrames;
+          this->NumberOfQueuedFramesInMemory += it->NumberOfFrames;
+        }
+        break;
+      }
+      if (!itemFound && spillStatus == PLUS_SUCCESS)
+      {
+        vtksys::SystemTools::RemoveFile(spillFilePath);
+      }
+    }
+    this->WriteQueueChanged.notify_all();
+  }
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualCapture::WriteSpillFile(const WriteQueueItem& item, std::string& spillFilePath)
+{
+  std::ostringstream spillFileName;
+  spillFileName << this->GetDeviceId() << "_WriteQueueSpill_" << this->NumberOfSpillFilesCreated++ << ".mha";
+  spillFilePath = vtkPlusConfig::GetInstance()->GetOutputPath(spillFileName.str());
+  if (vtkPlusSequenceIO::Write(spillFilePath, item.Frames, US_IMG_ORIENT_MF, false) != PLUS_SUCCESS)
+  {
+    LOG_ERROR(this->GetDeviceId() << ": Failed to write " << item.NumberOfFrames << " frames to temporary file " << spillFilePath << ", the frames are kept in memory");
+    vtksys::SystemTools::RemoveFile(spillFilePath);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::QueueFileForCompression(const std::string& filePath)
+{
+  CompressionQueueItem item;
+  item.FilePath = filePath;
+  item.NumberOfThreads = this->NumberOfCompressionThreads;
+  {
+    std::lock_guard<std::mutex> compressionLock(this->CompressionMutex);
+    this->CompressionQueue.push_back(item);
+    if (!this->CompressionThread.joinable())
+    {
+      this->CompressionThreadStopRequested = false;
+      this->CompressionThread = std::thread(&vtkPlusVirtualCapture::CompressionThreadMain, this);
+    }
+  }
+  this->CompressionQueueChanged.notify_all();
+  LOG_INFO(this->GetDeviceId() << ": Recorded file is compressed in the background: " << filePath);
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::WaitForFileCompression(const std::string& filePath)
+{
+  std::unique_lock<std::mutex> compressionLock(this->CompressionMutex);
+  this->CompressionQueueChanged.wait(compressionLock, [this, &filePath]()
+  {
+    for (std::deque<CompressionQueueItem>::const_iterator it = this->CompressionQueue.begin(); it != this->CompressionQueue.end(); ++it)
+    {
+      if (it->FilePath == filePath)
+      {
+        return false;
+      }
+    }
+    return true;
+  });
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::StopCompressionThread()
+{
+  {
+    std::lock_guard<std::mutex> compressionLock(this->CompressionMutex);
+    if (!this->CompressionThread.joinable())
+    {
+      return;
+    }
+    this->CompressionThreadStopRequested = true;
+  }
+  this->CompressionQueueChanged.notify_all();
+  this->CompressionThread.join();
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualCapture::CompressionThreadMain()
+{
+  while (true)
+  {
+    CompressionQueueItem item;
+    {
+      std::unique_lock<std::mutex> compressionLock(this->CompressionMutex);
+      this->CompressionQueueChanged.wait(compressionLock, [this]() { return this->CompressionThreadStopRequested || !this->CompressionQueue.empty(); });
+      if (this->CompressionQueue.empty())
+      {
+        // Stop is requested and all files are compressed
+        return;
+      }
+      // The item stays in the queue while it is compressed, so that the file is not overwritten meanwhile (see WaitForFileCompression)
+      item = this->CompressionQueue.front();
+      this->CompressionBusy = true;
+      this->CompressionProgressPercent = 0.0;
+    }
+
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    double lastLoggedProgressPercent = 0.0;
+    PlusStatus status = vtkPlusSequenceIO::CompressImageDataInParallel(item.FilePath, item.NumberOfThreads, [this, &item, &lastLoggedProgressPercent](double progressPercent)
+    {
+      {
+        std::lock_guard<std::mutex> compressionLock(this->CompressionMutex);
+        this->CompressionProgressPercent = progressPercent;
+      }
+      if (progressPercent - lastLoggedProgressPercent >= COMPRESSION_PROGRESS_LOG_STEP_PERCENT)
+      {
+        LOG_DEBUG(this->GetDeviceId() << ": Compression of " << item.FilePath << " is " << static_cast<int>(progressPercent) << "% completed");
+        lastLoggedProgressPercent = progressPercent;
+      }
+    });
+    if (status == PLUS_SUCCESS)
+    {
+      LOG_INFO(this->GetDeviceId() << ": Recorded file is compressed in " << std::fixed << std::setprecision(1) << vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec << " sec: " << item.FilePath);
+    }
+    else
+    {
+      LOG_ERROR(this->GetDeviceId() << ": Failed to compress recorded file, it is kept uncompressed: " << item.FilePath);
+    }
+
+    {
+      std::lock_guard<std::mutex> compressionLock(this->CompressionMutex);
+      this->CompressionQueue.pop_front();
+      this->CompressionBusy = false;
+      this->CompressionProgressPercent = 0.0;
+    }
+    this->CompressionQueueChanged.notify_all();
+  }
+}
+
+//-----------------------------------------------------------------------------
+unsigned int vtkPlusVirtualCapture::GetWriteQueueDepth() const
+{
+  std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+  return this->NumberOfQueuedFramesInMemory + this->NumberOfQueuedFramesInSpillFiles;
+}
+
+//-----------------------------------------------------------------------------
+unsigned long long vtkPlusVirtualCapture::GetNumberOfDroppedFrames() const
+{
+  std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+  return this->NumberOfDroppedFrames;
+}
+
+//-----------------------------------------------------------------------------
+unsigned long long vtkPlusVirtualCapture::GetNumberOfSpilledFrames() const
+{
+  std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+  return this->NumberOfSpilledFrames;
+}
+
+//-----------------------------------------------------------------------------
+double vtkPlusVirtualCapture::GetWriteThroughputFramesPerSec() const
+{
+  std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+  return (this->WriteTimeSec > 0 ? this->NumberOfWrittenFrames / this->WriteTimeSec : 0.0);
+}
+
+//-----------------------------------------------------------------------------
+double vtkPlusVirtualCapture::GetWriteThroughputMBPerSec() const
+{
+  std::lock_guard<std::mutex> queueLock(this->WriteQueueMutex);
+  return (this->WriteTimeSec > 0 ? this->NumberOfWrittenBytes / this->WriteTimeSec / 1.0e6 : 0.0);
+}
+
+//-----------------------------------------------------------------------------
+unsigned int vtkPlusVirtualCapture::GetNumberOfFilesToCompress() const
+{
+  std::lock_guard<std::mutex> compressionLock(this->CompressionMutex);
+  return static_cast<unsigned int>(this->CompressionQueue.size());
+}
+
+//-----------------------------------------------------------------------------
+double vtkPlusVirtualCapture::GetCompressionProgressPercent() const
+{
+  std::lock_guard<std::mutex> compressionLock(this->CompressionMutex);
+  return (this->CompressionBusy ? this->CompressionProgressPercent : 0.0);
+}
+
+//-----------------------------------------------------------------------------
+std::string vtkPlusVirtualCapture::GetParameter(const std::string& key) const
+{
+  std::string value;
+  if (this->GetParameter(key, value) != PLUS_SUCCESS)
+  {
+    return "";
+  }
+  return value;
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualCapture::GetParameter(const std::string& key, std::string& outValue) const
+{
+  std::ostringstream value;
+  if (igsioCommon::IsEqualInsensitive(key, KEY_WRITE_QUEUE_DEPTH))
+  {
+    value << this->GetWriteQueueDepth();
+  }
+  else if (igsioCommon::IsEqualInsensitive(key, KEY_NUMBER_OF_DROPPED_FRAMES))
+  {
+    value << this->GetNumberOfDroppedFrames();
+  }
+  else if (igsioCommon::IsEqualInsensitive(key, KEY_NUMBER_OF_SPILLED_FRAMES))
+  {
+    value << this->GetNumberOfSpilledFrames();
+  }
+  else if (igsioCommon::IsEqualInsensitive(key, KEY_WRITE_THROUGHPUT_FPS))
+  {
+    value << this->GetWriteThroughputFramesPerSec();
+  }
+  else if (igsioCommon::IsEqualInsensitive(key, KEY_WRITE_THROUGHPUT_MBPS))
+  {
+    value << this->GetWriteThroughputMBPerSec();
+  }
+  else if (igsioCommon::IsEqualInsensitive(key, KEY_NUMBER_OF_FILES_TO_COMPRESS))
+  {
+    value << this->GetNumberOfFilesToCompress();
+  }
+  else if (igsioCommon::IsEqualInsensitive(key, KEY_COMPRESSION_PROGRESS_PERCENT))
+  {
+    value << this->GetCompressionProgressPercent();
+  }
+  else
+  {
+    return Superclass::GetParameter(key, outValue);
+  }
+  outValue = value.str();
+  return PLUS_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 int vtkPlusVirtualCapture::OutputChannelCount() const
 {
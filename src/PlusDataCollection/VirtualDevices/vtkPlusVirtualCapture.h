@@ -10,7 +10,14 @@ See License.txt for details.
 #include "vtkPlusDataCollectionExport.h"
 #include "vtkPlusDevice.h"
 #include "vtkIGSIOSequenceIOBase.h"
+
+// STL includes
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 
 //class vtkIGSIOTrackedFrameList;
 
@@ -23,6 +30,21 @@ See License.txt for details.
 class vtkPlusDataCollectionExport vtkPlusVirtualCapture : public vtkPlusDevice
 {
 public:
+  /*! Action to take if frames are sampled while the write queue is full (only used if background writing is enabled) */
+  enum WriteQueueFullPolicyType
+  {
+    /*! Do not sample new frames until there is space in the queue (if the recording lags behind too much then frames are skipped) */
+    WRITE_QUEUE_FULL_BLOCK,
+    /*! Discard the newly sampled frames */
+    WRITE_QUEUE_FULL_DROP,
+    /*!
+      Move the newly sampled frames to a temporary file, the writer thread reads them back when their turn comes.
+      The temporary file is written by a separate spill thread, so writing of the output file is not delayed.
+      If the spill thread cannot keep up either then sampling of new frames is postponed (as with WRITE_QUEUE_FULL_BLOCK).
+    */
+    WRITE_QUEUE_FULL_SPILL
+  };
+
   static vtkPlusVirtualCapture* New();
   vtkTypeMacro(vtkPlusVirtualCapture, vtkPlusDevice);
   void PrintSelf(ostream& os, vtkIndent indent);
@@ -58,7 +80,7 @@ public:
   virtual int OutputChannelCount() const;
 
   /*! Enables capturing frames. It can be used for pausing the recording. */
-  vtkGetMacro(EnableCapturing, bool);
+  bool GetEnableCapturing() const { return this->EnableCapturing; }
   void SetEnableCapturing(bool aValue);
 
   /*!
@@ -78,6 +100,15 @@ public:
   vtkGetMacro(EnableFileCompression, bool);
   void SetEnableFileCompression(bool aFileCompression);
 
+  /*!
+    Number of threads used for compressing NRRD files (0 = all hardware threads).
+    If it is not 1 then the image data is written uncompressed during recording and compressed in parallel after the file is closed.
+    Compression runs in a background thread, so closing the file does not wait for it (see GetNumberOfFilesToCompress).
+    The value is applied when the next file is opened.
+  */
+  vtkSetMacro(NumberOfCompressionThreads, unsigned int);
+  vtkGetMacro(NumberOfCompressionThreads, unsigned int);
+
   vtkGetStdStringMacro(EncodingFourCC);
   vtkSetStdStringMacro(EncodingFourCC)
 
@@ -89,6 +120,42 @@ public:
   vtkSetMacro(FrameBufferSize, unsigned int);
   vtkGetMacro(FrameBufferSize, unsigned int);
 
+  /*!
+    If enabled then sampled frames are put into a queue and a background thread writes them to file,
+    so that slow file writing does not delay sampling of the input channel.
+  */
+  vtkSetMacro(EnableBackgroundWriting, bool);
+  vtkGetMacro(EnableBackgroundWriting, bool);
+
+  vtkSetMacro(WriteQueueMaxFrames, unsigned int);
+  vtkGetMacro(WriteQueueMaxFrames, unsigned int);
+
+  vtkSetMacro(WriteQueueFullPolicy, WriteQueueFullPolicyType);
+  vtkGetMacro(WriteQueueFullPolicy, WriteQueueFullPolicyType);
+
+  /*! Number of frames waiting to be written (in memory and in temporary files) */
+  unsigned int GetWriteQueueDepth() const;
+  /*! Number of frames discarded because the write queue was full, since the file was opened */
+  unsigned long long GetNumberOfDroppedFrames() const;
+  /*! Number of frames written to temporary files because the write queue was full, since the file was opened */
+  unsigned long long GetNumberOfSpilledFrames() const;
+  /*! Average speed of the background writer while it is writing, since the file was opened */
+  double GetWriteThroughputFramesPerSec() const;
+  double GetWriteThroughputMBPerSec() const;
+
+  /*! Number of closed files that are waiting for parallel compression or being compressed */
+  unsigned int GetNumberOfFilesToCompress() const;
+  /*! Completed percentage of the file that is being compressed, 0 if no file is being compressed */
+  double GetCompressionProgressPercent() const;
+
+  /*!
+    Returns the write queue statistics for the keys WriteQueueDepth, NumberOfDroppedFrames, NumberOfSpilledFrames,
+    WriteThroughputFramesPerSec and WriteThroughputMBPerSec, and the compression status for the keys
+    NumberOfFilesToCompress and CompressionProgressPercent, other keys are handled by the superclass
+  */
+  virtual std::string GetParameter(const std::string& key) const;
+  virtual PlusStatus GetParameter(const std::string& key, std::string& outValue) const;
+
   virtual vtkPlusDataCollector* GetDataCollector() { return this->DataCollector; }
 
   virtual bool IsTracker() const { return false; }
@@ -113,9 +180,47 @@ protected:
   /*!
     Copy frames to memory buffer or disk.
     If force flag is true then data is written to disk immediately.
+    Recording is stopped if writing fails.
   */
   virtual PlusStatus WriteFrames(bool force = false);
 
+  /*! Same as WriteFrames but does not stop recording on failure, therefore it can be called from the background writer thread */
+  PlusStatus WriteFramesToFile(bool force);
+
+  /*! Compute the actual frame rate from the timestamps of the recently sampled frames (used in background writing mode) */
+  void UpdateActualFrameRate(vtkIGSIOTrackedFrameList* sampledFrames);
+
+  /*! Sample the input channel and put the frames into the write queue */
+  PlusStatus SampleFramesForBackgroundWriting(double requestedFramePeriodSec, double maxProcessingTimeSec);
+
+  /*! Add frames to the write queue. If the queue is full then the frames are handled according to WriteQueueFullPolicy. */
+  PlusStatus QueueFramesForWriting(vtkIGSIOTrackedFrameList* frames);
+
+  /*!
+    Wait until all queued frames are written to file.
+    Sampling should be suspended (see SamplingSuspendCount), otherwise new frames may be queued by the data capture thread meanwhile.
+  */
+  void FlushWriteQueue();
+
+  /*! Discard all queued frames and wait until the frames that are being written are completed */
+  void DiscardWriteQueue();
+
+  /*! Start the writer thread and the spill thread */
+  void StartWriterThread();
+  /*! Write all queued frames and stop the writer thread and the spill thread */
+  void StopWriterThread();
+  void WriterThreadMain();
+  /*! Move the frames of the items that are marked for spilling to temporary files */
+  void SpillThreadMain();
+
+  /*! Add a closed file to the compression queue. The compression thread is started if it is not running yet. */
+  void QueueFileForCompression(const std::string& filePath);
+  /*! Wait until the file is compressed, if it is waiting for compression or being compressed */
+  void WaitForFileCompression(const std::string& filePath);
+  /*! Compress all queued files and stop the compression thread */
+  void StopCompressionThread();
+  void CompressionThreadMain();
+
 protected:
   /*! Recorded tracked frame list */
   vtkIGSIOTrackedFrameList* RecordedFrames;
@@ -158,6 +263,30 @@ protected:
   /*! When closing the file, re-read the data from file, and write it compressed */
   bool EnableFileCompression;
 
+  unsigned int NumberOfCompressionThreads;
+
+  /*! If true then the current file is written uncompressed and compressed by multiple threads after it is closed */
+  bool CompressCurrentFileInParallel;
+
+  /*! File that is closed and has to be compressed in the background */
+  struct CompressionQueueItem
+  {
+    CompressionQueueItem() : NumberOfThreads(0) {}
+    std::string FilePath;
+    unsigned int NumberOfThreads;
+  };
+
+  /*! Protects the compression queue and the compression status */
+  mutable std::mutex CompressionMutex;
+  /*! Signaled when files are added to the queue and when the compression of a file is completed */
+  std::condition_variable CompressionQueueChanged;
+  /*! Files waiting for compression, the front item is being compressed if CompressionBusy is set */
+  std::deque<CompressionQueueItem> CompressionQueue;
+  std::thread CompressionThread;
+  bool CompressionThreadStopRequested;
+  bool CompressionBusy;
+  double CompressionProgressPercent;
+
   /*! FourCC code represending the codec to use when writing the file*/
   std::string EncodingFourCC;
 
@@ -170,8 +299,8 @@ protected:
   /*! Whether to start capturing on connect */
   bool EnableCapturingOnStart;
 
-  /*! Internal flag to control capturing */
-  bool EnableCapturing;
+  /*! Internal flag to control capturing. Atomic, because the writer thread disables capturing if writing fails. */
+  std::atomic<bool> EnableCapturing;
 
   unsigned int FrameBufferSize;
 
@@ -182,6 +311,61 @@ protected:
 
   vtkPlusLogger::LogLevelType GracePeriodLogLevel;
 
+  /*! Item of the write queue: frames in memory or the name of a temporary file that contains the frames */
+  struct WriteQueueItem
+  {
+    WriteQueueItem() : Id(0), NumberOfFrames(0), SpillRequested(false), SpillInProgress(false) {}
+    unsigned long long Id;
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> Frames;
+    std::string SpillFilePath;
+    unsigned int NumberOfFrames;
+    /*! The frames are counted as spilled, the spill thread moves them to a temporary file if they are still in memory */
+    bool SpillRequested;
+    /*! The spill thread is writing the frames to a temporary file, the writer thread waits for it before writing the item */
+    bool SpillInProgress;
+  };
+
+  /*! Write the frames of a queue item to a temporary file. Called by the spill thread, without holding WriteQueueMutex. */
+  PlusStatus WriteSpillFile(const WriteQueueItem& item, std::string& spillFilePath);
+
+  bool EnableBackgroundWriting;
+  /*! Maximum number of frames that are kept in memory in the write queue */
+  unsigned int WriteQueueMaxFrames;
+  WriteQueueFullPolicyType WriteQueueFullPolicy;
+
+  /*! Protects the write queue and the write statistics. Must not be locked while waiting for WriterAccessMutex. */
+  mutable std::mutex WriteQueueMutex;
+  /*! Signaled when items are added to or removed from the queue and when the writer thread becomes idle */
+  std::condition_variable WriteQueueChanged;
+  std::deque<WriteQueueItem> WriteQueue;
+  /*! Identifier of the next item that is added to the write queue */
+  unsigned long long NextWriteQueueItemId;
+  unsigned int NumberOfQueuedFramesInMemory;
+  unsigned int NumberOfQueuedFramesInSpillFiles;
+  /*! Number of frames that are marked for spilling but still in memory, sampling is postponed if it reaches WriteQueueMaxFrames */
+  unsigned int NumberOfQueuedFramesWaitingForSpill;
+  std::thread WriterThread;
+  std::thread SpillThread;
+  /*! Stops both the writer thread (after all queued frames are written) and the spill thread */
+  bool WriterThreadStopRequested;
+  /*! True while the writer thread is writing an item that is already removed from the queue */
+  bool WriterBusy;
+  /*! Set if the writer thread failed to write frames, no more frames are queued until the file is reopened */
+  bool WriteFailed;
+  /*! If positive then the data capture thread does not sample frames in background writing mode. Protected by UpdateMutex. */
+  int SamplingSuspendCount;
+  bool DroppingFrames;
+  unsigned long long NumberOfDroppedFrames;
+  unsigned long long NumberOfSpilledFrames;
+  unsigned int NumberOfSpillFilesCreated;
+  unsigned long long NumberOfWrittenFrames;
+  double NumberOfWrittenBytes;
+  /*! Total time the writer thread spent with writing frames */
+  double WriteTimeSec;
+
+  /*! Timestamps of the recently sampled frames, for computing the actual frame rate in background writing mode */
+  std::deque<double> RecentFrameTimestamps;
+
   PlusStatus GetInputTrackedFrame(igsioTrackedFrame& aFrame);
   PlusStatus GetInputTrackedFrameListSampled(double& lastAlreadyRecordedFrameTimestamp, double& nextFrameToBeRecordedTimestamp, vtkIGSIOTrackedFrameList* recordedFrames, double requestedFramePeriodSec, double maxProcessingTimeSec);
   PlusStatus GetLatestInputItemTimestamp(double& timestamp);
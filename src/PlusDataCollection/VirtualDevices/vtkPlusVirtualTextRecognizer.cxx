@@ -11,6 +11,7 @@ See License.txt for details.
 #include "vtkObjectFactory.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusDataSource.h"
+#include "vtkIGSIOAccurateTimer.h"
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtkPlusVirtualTextRecognizer.h"
 
@@ -19,6 +20,12 @@ See License.txt for details.
 #include <tesseract/strngs.h>
 #include <allheaders.h>
 
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 //----------------------------------------------------------------------------
 
 vtkStandardNewMacro(vtkPlusVirtualTextRecognizer);
@@ -36,12 +43,20 @@ namespace
   static const int PARAMETER_DEPTH_BITS = 8;
   static const char* DEFAULT_LANGUAGE = "eng";
   static const int TEXT_RECOGNIZER_MISSING_INPUT_DEFAULT = 1;
+  static const unsigned int NUMBER_OF_RECOGNITION_THREADS_DEFAULT = 2;
+  static const char* OCR_RATE_FIELD_NAME = "OcrInvocationRate";
+  static const double OCR_RATE_MEASUREMENT_PERIOD_SEC = 5.0;
 }
 
 //----------------------------------------------------------------------------
 vtkPlusVirtualTextRecognizer::vtkPlusVirtualTextRecognizer()
   : vtkPlusDevice()
   , Language()
+  , NumberOfRecognitionThreads(NUMBER_OF_RECOGNITION_THREADS_DEFAULT)
+  , OcrInvocationRate(0.0)
+  , OcrInvocationCount(0)
+  , TotalOcrInvocationCount(0)
+  , OcrRateMeasurementStartTime(0.0)
   , TrackedFrames(vtkIGSIOTrackedFrameList::New())
   , OutputChannel(NULL)
 {
@@ -58,11 +73,16 @@ void vtkPlusVirtualTextRecognizer::ClearConfiguration()
     for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
     {
       TextFieldParameter* parameter = *fieldIt;
+      if (parameter->ReceivedFrame != NULL)
+      {
+        pixDestroy(&parameter->ReceivedFrame);
+      }
       delete parameter;
     }
     it->second.clear();
   }
   this->RecognitionFields.clear();
+  this->LatestFrameTimestamps.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -76,6 +96,9 @@ vtkPlusVirtualTextRecognizer::~vtkPlusVirtualTextRecognizer()
 void vtkPlusVirtualTextRecognizer::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfRecognitionThreads: " << this->NumberOfRecognitionThreads << std::endl;
+  os << indent << "OcrInvocationRate: " << this->OcrInvocationRate << std::endl;
+  os << indent << "TotalOcrInvocationCount: " << this->TotalOcrInvocationCount << std::endl;
 }
 
 #ifdef PLUS_TEST_TextRecognizer
@@ -84,46 +107,45 @@ vtkPlusVirtualTextRecognizer::ChannelFieldListMap& vtkPlusVirtualTextRecognizer:
 {
   return this->RecognitionFields;
 }
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualTextRecognizer::RecognizeFrame(vtkPlusChannel* channel, igsioTrackedFrame& frame)
+{
+  FieldList changedParameters;
+  this->FindChangedRegions(frame, this->RecognitionFields[channel], changedParameters);
+  if (!changedParameters.empty())
+  {
+    this->RecognizeText(changedParameters);
+  }
+  this->UpdateOcrInvocationRate(changedParameters.size());
+}
 #endif
 
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualTextRecognizer::InternalUpdate()
 {
-  std::map<double, int> queriedFramesIndexes;
-  std::vector<igsioTrackedFrame*> queriedFrames;
-
   if (!this->HasGracePeriodExpired())
   {
     return PLUS_SUCCESS;
   }
 
+  // Fields are grouped by source channel, so each channel's frame is only retrieved once
+  FieldList changedParameters;
   for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
   {
-    for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
+    igsioTrackedFrame frame;
+    if (this->QueryLatestFrame(it->first, frame) != PLUS_SUCCESS || frame.GetImageData()->GetImage() == NULL)
     {
-      TextFieldParameter* parameter = *fieldIt;
-      igsioTrackedFrame frame;
-
-      // Attempt to find the frame already retrieved
-      PlusStatus result = FindOrQueryFrame(frame, queriedFramesIndexes, parameter, queriedFrames);
-
-      if (result != PLUS_SUCCESS || frame.GetImageData()->GetImage() == NULL)
-      {
-        continue;
-      }
-
-      // We have a frame, let's parse it
-      vtkImageDataToPix(frame, parameter);
-
-      this->TesseractAPI->SetImage(parameter->ReceivedFrame);
-      char* text_out = this->TesseractAPI->GetUTF8Text();
-      std::string textStr(text_out);
-      parameter->LatestParameterValue = igsioCommon::Trim(textStr);
-      delete [] text_out;
-
-      frame.SetFrameField(parameter->ParameterName, parameter->LatestParameterValue);
+      continue;
     }
+    this->FindChangedRegions(frame, it->second, changedParameters);
+  }
+
+  if (!changedParameters.empty())
+  {
+    this->RecognizeText(changedParameters);
   }
+  this->UpdateOcrInvocationRate(changedParameters.size());
 
   // Build the field map to send to the data sources
   igsioFieldMapType fieldMap;
@@ -135,6 +157,8 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalUpdate()
       fieldMap[(*fieldIt)->ParameterName].second = (*fieldIt)->LatestParameterValue;
     }
   }
+  fieldMap[OCR_RATE_FIELD_NAME].first = FRAMEFIELD_NONE;
+  fieldMap[OCR_RATE_FIELD_NAME].second = igsioCommon::ToString<double>(this->OcrInvocationRate);
 
   for (DataSourceContainerIterator it = this->OutputChannel->GetFieldDataSourcesStartIterator(); it != this->OutputChannel->GetFieldDataSourcesEndIterator(); ++it)
   {
@@ -146,83 +170,174 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalUpdate()
 }
 
 //----------------------------------------------------------------------------
-void vtkPlusVirtualTextRecognizer::vtkImageDataToPix(igsioTrackedFrame& frame, TextFieldParameter* parameter)
+bool vtkPlusVirtualTextRecognizer::UpdateScreenRegion(igsioTrackedFrame& frame, TextFieldParameter* parameter)
 {
-  igsioVideoFrame::GetOrientedClippedImage(frame.GetImageData()->GetImage(),
+  if (igsioVideoFrame::GetOrientedClippedImage(frame.GetImageData()->GetImage(),
       igsioVideoFrame::FlipInfoType(),
       frame.GetImageData()->GetImageType(),
       parameter->ScreenRegion,
       parameter->Origin,
-      parameter->Size);
+      parameter->Size) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to clip the region of parameter " << parameter->ParameterName);
+    return false;
+  }
 
-  unsigned int* data = pixGetData(parameter->ReceivedFrame);
-  int wpl = pixGetWpl(parameter->ReceivedFrame);
-  int bpl = ((8 * parameter->Size[0]) + 7) / 8;
-  unsigned int* line;
-  unsigned char val8;
+  int* dimensions = parameter->ScreenRegion->GetDimensions();
+  size_t regionSizeInBytes = static_cast<size_t>(dimensions[0]) * dimensions[1] * dimensions[2]
+                             * parameter->ScreenRegion->GetScalarSize() * parameter->ScreenRegion->GetNumberOfScalarComponents();
+  const unsigned char* regionPixels = static_cast<const unsigned char*>(parameter->ScreenRegion->GetScalarPointer());
+
+  if (parameter->RecognizedRegionPixels.size() == regionSizeInBytes
+      && std::equal(regionPixels, regionPixels + regionSizeInBytes, parameter->RecognizedRegionPixels.begin()))
+  {
+    return false;
+  }
 
+  parameter->RecognizedRegionPixels.assign(regionPixels, regionPixels + regionSizeInBytes);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualTextRecognizer::FindChangedRegions(igsioTrackedFrame& frame, const FieldList& parameters, FieldList& changedParameters)
+{
+  for (FieldList::const_iterator fieldIt = parameters.begin(); fieldIt != parameters.end(); ++fieldIt)
+  {
+    TextFieldParameter* parameter = *fieldIt;
+    if (!this->UpdateScreenRegion(frame, parameter))
+    {
+      // Same pixels as when the text was last recognized, the text cannot have changed
+      continue;
+    }
+    this->ScreenRegionToPix(parameter);
+    changedParameters.push_back(parameter);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualTextRecognizer::ScreenRegionToPix(TextFieldParameter* parameter)
+{
   int extents[6];
   parameter->ScreenRegion->GetExtent(extents);
-  int ySize = extents[3] - extents[2];
+  int width = std::min<int>(extents[1] - extents[0] + 1, pixGetWidth(parameter->ReceivedFrame));
+  int height = std::min<int>(extents[3] - extents[2] + 1, pixGetHeight(parameter->ReceivedFrame));
+  int numberOfScalarComponents = parameter->ScreenRegion->GetNumberOfScalarComponents();
+
+  unsigned int* data = pixGetData(parameter->ReceivedFrame);
+  int wpl = pixGetWpl(parameter->ReceivedFrame);
+
+  // Pix lines are top to bottom, image rows are bottom to top
+  for (int y = 0; y < height; y++)
+  {
+    unsigned char* line = reinterpret_cast<unsigned char*>(data + y * wpl);
+    const unsigned char* row = static_cast<const unsigned char*>(parameter->ScreenRegion->GetScalarPointer(extents[0], extents[2] + height - y - 1, extents[4]));
+    if (numberOfScalarComponents == 1)
+    {
+      memcpy(line, row, width);
+    }
+    else
+    {
+      // Only the first component is used
+      for (int x = 0; x < width; x++)
+      {
+        line[x] = row[x * numberOfScalarComponents];
+      }
+    }
+  }
+
+  // Pixels were copied in memory order, convert them to the byte order of leptonica (no-op on big-endian machines)
+  pixEndianByteSwap(parameter->ReceivedFrame);
+}
 
-  int coords[3] = {0, 0, 0};
-  for (int y = 0; y < ySize; y++)
+//----------------------------------------------------------------------------
+void vtkPlusVirtualTextRecognizer::RecognizeText(const FieldList& parameters)
+{
+  std::atomic<unsigned int> nextParameterIndex(0);
+  auto recognizeParameters = [&parameters, &nextParameterIndex](tesseract::TessBaseAPI * tesseractAPI)
   {
-    coords[1] = ySize - y - 1 + extents[2];
-    line = data + y * wpl;
-    for (int x = 0; x < bpl; x++)
+    for (unsigned int i = nextParameterIndex++; i < parameters.size(); i = nextParameterIndex++)
     {
-      coords[0] = x + extents[0];
-      val8 = (*(unsigned char*)parameter->ScreenRegion->GetScalarPointer(coords));
-      SET_DATA_BYTE(line, x, val8);
+      TextFieldParameter* parameter = parameters[i];
+      tesseractAPI->SetImage(parameter->ReceivedFrame);
+      char* text_out = tesseractAPI->GetUTF8Text();
+      if (text_out == NULL)
+      {
+        // Recognize the region again in the next update
+        parameter->RecognizedRegionPixels.clear();
+        continue;
+      }
+      std::string textStr(text_out);
+      parameter->LatestParameterValue = igsioCommon::Trim(textStr);
+      delete [] text_out;
     }
+  };
+
+  // The calling thread uses the first tesseract instance, additional threads are only started if there is work for them
+  unsigned int numberOfThreads = std::min<unsigned int>(this->TesseractAPIs.size(), parameters.size());
+  std::vector<std::thread> threads;
+  for (unsigned int threadIndex = 1; threadIndex < numberOfThreads; ++threadIndex)
+  {
+    threads.push_back(std::thread(recognizeParameters, this->TesseractAPIs[threadIndex]));
+  }
+  recognizeParameters(this->TesseractAPIs[0]);
+  for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+  {
+    it->join();
   }
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusVirtualTextRecognizer::FindOrQueryFrame(igsioTrackedFrame& frame, std::map<double, int>& QueriedFramesIndexes, TextFieldParameter* parameter, std::vector<igsioTrackedFrame*>& QueriedFrames)
+void vtkPlusVirtualTextRecognizer::UpdateOcrInvocationRate(unsigned int numberOfRecognitions)
+{
+  this->OcrInvocationCount += numberOfRecognitions;
+  this->TotalOcrInvocationCount += numberOfRecognitions;
+  double now = vtkIGSIOAccurateTimer::GetSystemTime();
+  double elapsedTimeSec = now - this->OcrRateMeasurementStartTime;
+  if (elapsedTimeSec < OCR_RATE_MEASUREMENT_PERIOD_SEC)
+  {
+    return;
+  }
+  this->OcrInvocationRate = this->OcrInvocationCount / elapsedTimeSec;
+  this->OcrInvocationCount = 0;
+  this->OcrRateMeasurementStartTime = now;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualTextRecognizer::QueryLatestFrame(vtkPlusChannel* channel, igsioTrackedFrame& frame)
 {
   double mostRecent(-1);
 
-  if (!parameter->SourceChannel->GetVideoDataAvailable())
+  if (!channel->GetVideoDataAvailable())
   {
     LOG_WARNING("Processed data is not generated, as no video data is available yet. Device ID: " << this->GetDeviceId());
     return PLUS_FAIL;
   }
 
-  if (parameter->SourceChannel->GetMostRecentTimestamp(mostRecent) != PLUS_SUCCESS)
+  if (channel->GetMostRecentTimestamp(mostRecent) != PLUS_SUCCESS)
   {
-    LOG_ERROR("Unable to retrieve most recent timestamp for parameter " << parameter->ParameterName);
+    LOG_ERROR("Unable to retrieve most recent timestamp for channel " << channel->GetChannelId());
     return PLUS_FAIL;
   }
 
-  // Search the retrieved frames to see is this timestamp has already been pulled
-  std::map<double, int>::iterator frameIt = QueriedFramesIndexes.find(mostRecent);
-
-  // If it hasn't, go get the latest
-  if (frameIt == QueriedFramesIndexes.end())
+  std::map<vtkPlusChannel*, double>::iterator latestIt = this->LatestFrameTimestamps.find(channel);
+  if (latestIt != this->LatestFrameTimestamps.end() && mostRecent <= latestIt->second)
   {
-    this->TrackedFrames->Clear();
-    double aTimestamp(UNDEFINED_TIMESTAMP);
-    if (parameter->SourceChannel->GetTrackedFrameList(aTimestamp, this->TrackedFrames, 1) != PLUS_SUCCESS)
-    {
-      LOG_INFO("Failed to get tracked frame list from data collector.");
-      return PLUS_FAIL;
-    }
-    double timestamp = TrackedFrames->GetTrackedFrame(0)->GetTimestamp();
-
-    // Copy the frame so it isn't lost when the tracked frame list is cleared
-    frame = (*TrackedFrames->GetTrackedFrame(0));
-
-    // Record the index of this timestamp
-    QueriedFramesIndexes[timestamp] = QueriedFrames.size();
-    QueriedFrames.push_back(&frame);
+    // The regions of this frame are already processed
+    return PLUS_FAIL;
   }
-  else
+
+  this->TrackedFrames->Clear();
+  double aTimestamp(UNDEFINED_TIMESTAMP);
+  if (channel->GetTrackedFrameList(aTimestamp, this->TrackedFrames, 1) != PLUS_SUCCESS)
   {
-    frame = (*QueriedFrames[frameIt->second]);
+    LOG_INFO("Failed to get tracked frame list from data collector.");
+    return PLUS_FAIL;
   }
 
+  // Copy the frame so it isn't lost when the tracked frame list is cleared
+  frame = (*this->TrackedFrames->GetTrackedFrame(0));
+  this->LatestFrameTimestamps[channel] = frame.GetTimestamp();
+
   return PLUS_SUCCESS;
 }
 
@@ -241,13 +356,42 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalConnect()
   vtksys::SystemTools::PutEnv(ss.str());
   LOG_DEBUG("Using tessdata directory: " << this->TessdataDirectory);
 
-  this->TesseractAPI = new tesseract::TessBaseAPI();
-  if (this->TesseractAPI->Init(NULL, Language.c_str(), tesseract::OEM_TESSERACT_CUBE_COMBINED) != 0)
+  // Each recognition thread needs its own tesseract instance, there is no use for more threads than fields
+  unsigned int numberOfFields(0);
+  for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
   {
-    LOG_ERROR("Unable to init tesseract library. Cannot perform text recognition.");
-    return PLUS_FAIL;
+    numberOfFields += it->second.size();
   }
-  this->TesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+  unsigned int numberOfThreads = this->NumberOfRecognitionThreads;
+  if (numberOfThreads == 0)
+  {
+    numberOfThreads = std::thread::hardware_concurrency();
+  }
+  numberOfThreads = std::max<unsigned int>(1, std::min(numberOfThreads, numberOfFields));
+
+  for (unsigned int i = 0; i < numberOfThreads; ++i)
+  {
+    tesseract::TessBaseAPI* tesseractAPI = new tesseract::TessBaseAPI();
+    this->TesseractAPIs.push_back(tesseractAPI);
+    if (tesseractAPI->Init(NULL, Language.c_str(), tesseract::OEM_TESSERACT_CUBE_COMBINED) != 0)
+    {
+      LOG_ERROR("Unable to init tesseract library. Cannot perform text recognition.");
+      for (std::vector<tesseract::TessBaseAPI*>::iterator apiIt = this->TesseractAPIs.begin(); apiIt != this->TesseractAPIs.end(); ++apiIt)
+      {
+        delete *apiIt;
+      }
+      this->TesseractAPIs.clear();
+      return PLUS_FAIL;
+    }
+    tesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+  }
+  LOG_DEBUG("Text recognizer uses " << numberOfThreads << " recognition thread(s)");
+
+  this->LatestFrameTimestamps.clear();
+  this->OcrInvocationRate = 0.0;
+  this->OcrInvocationCount = 0;
+  this->TotalOcrInvocationCount = 0;
+  this->OcrRateMeasurementStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
   return PLUS_SUCCESS;
 }
@@ -255,8 +399,11 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalConnect()
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualTextRecognizer::InternalDisconnect()
 {
-  delete this->TesseractAPI;
-  this->TesseractAPI = NULL;
+  for (std::vector<tesseract::TessBaseAPI*>::iterator it = this->TesseractAPIs.begin(); it != this->TesseractAPIs.end(); ++it)
+  {
+    delete *it;
+  }
+  this->TesseractAPIs.clear();
 
   ClearConfiguration();
 
@@ -286,6 +433,7 @@ PlusStatus vtkPlusVirtualTextRecognizer::ReadConfiguration(vtkXMLDataElement* ro
   this->SetLanguage(DEFAULT_LANGUAGE);
   XML_READ_CSTRING_ATTRIBUTE_OPTIONAL(Language, deviceConfig);
   XML_READ_STRING_ATTRIBUTE_OPTIONAL(TessdataDirectory, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfRecognitionThreads, deviceConfig);
 
   XML_FIND_NESTED_ELEMENT_OPTIONAL(screenFields, deviceConfig, PARAMETER_LIST_TAG_NAME);
 
@@ -350,6 +498,11 @@ PlusStatus vtkPlusVirtualTextRecognizer::WriteConfiguration(vtkXMLDataElement* r
     XML_WRITE_STRING_ATTRIBUTE_IF_NOT_EMPTY(Language, deviceConfig);
   }
 
+  if (this->NumberOfRecognitionThreads != NUMBER_OF_RECOGNITION_THREADS_DEFAULT)
+  {
+    deviceConfig->SetIntAttribute("NumberOfRecognitionThreads", this->NumberOfRecognitionThreads);
+  }
+
   XML_FIND_NESTED_ELEMENT_CREATE_IF_MISSING(screenFields, deviceConfig, PARAMETER_LIST_TAG_NAME);
 
   for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
@@ -21,7 +21,11 @@ typedef struct Pix PIX;
 
 /*!
 \class vtkPlusVirtualTextRecognizer
-\brief
+\brief Recognizes text in regions of the input video frames and broadcasts it as field data
+
+Optical character recognition is only performed on a region if its pixels changed since its text was last recognized.
+Changed regions are recognized in parallel, each thread uses its own tesseract instance.
+The number of recognitions per second is broadcast in the OcrInvocationRate field.
 
 \ingroup PlusLibDataCollection
 */
@@ -34,6 +38,8 @@ public:
   {
   public:
     TextFieldParameter()
+      : ReceivedFrame(NULL)
+      , SourceChannel(NULL)
     {
       this->Origin[0] = 0;
       this->Origin[1] = 0;
@@ -53,6 +59,8 @@ public:
     std::array<int, 3> Origin;
     /// This is only 3d for simplicity in passing to clipping function, OCR is 2d only
     std::array<int, 3> Size;
+    /// Pixels of the region when its text was last recognized, empty if the text has not been recognized yet
+    std::vector<unsigned char> RecognizedRegionPixels;
   };
 
 public:
@@ -93,8 +101,24 @@ public:
   vtkSetStdStringMacro(TessdataDirectory);
   vtkGetStdStringMacro(TessdataDirectory);
 
+  /*!
+    Maximum number of threads (and tesseract instances) that recognize the changed regions (0 = all hardware threads).
+    The value is applied when the device is connected.
+  */
+  vtkSetMacro(NumberOfRecognitionThreads, unsigned int);
+  vtkGetMacro(NumberOfRecognitionThreads, unsigned int);
+
+  /*! Number of character recognitions per second, measured over periods of a few seconds */
+  vtkGetMacro(OcrInvocationRate, double);
+
+  /*! Total number of character recognitions since the device was connected */
+  vtkGetMacro(TotalOcrInvocationCount, unsigned long long);
+
 #ifdef PLUS_TEST_TextRecognizer
   ChannelFieldListMap& GetRecognitionFields();
+
+  /*! Recognize the changed regions of the fields of the channel in the frame, the same way as for new input frames */
+  void RecognizeFrame(vtkPlusChannel* channel, igsioTrackedFrame& frame);
 #endif
 
 protected:
@@ -103,20 +127,41 @@ protected:
   /// Remove any configuration data
   void ClearConfiguration();
 
-  /// Convert a vtkImage data to leptonica pix format
-  void vtkImageDataToPix(igsioTrackedFrame& frame, TextFieldParameter* parameter);
+  /// Get the latest frame of a channel. Returns PLUS_FAIL if there is no new frame since the last call.
+  PlusStatus QueryLatestFrame(vtkPlusChannel* channel, igsioTrackedFrame& frame);
+
+  /// Clip the region of the parameter from the frame. Returns true if the region changed since its text was last recognized.
+  bool UpdateScreenRegion(igsioTrackedFrame& frame, TextFieldParameter* parameter);
 
-  /// If a frame has been queried for this input channel, reuse it instead of getting a new one
-  PlusStatus FindOrQueryFrame(igsioTrackedFrame& frame, std::map<double, int>& queriedFramesIndexes, TextFieldParameter* parameter,
-                              std::vector<igsioTrackedFrame*>& queriedFrames);
+  /// Clip the regions of the parameters from the frame and append the ones that changed since their text was last recognized to changedParameters
+  void FindChangedRegions(igsioTrackedFrame& frame, const FieldList& parameters, FieldList& changedParameters);
+
+  /// Convert the screen region of the parameter to leptonica pix format
+  void ScreenRegionToPix(TextFieldParameter* parameter);
+
+  /// Recognize the text of the parameters in parallel, using the tesseract instance pool
+  void RecognizeText(const FieldList& parameters);
+
+  /// Update the OCR invocation rate after the specified number of recognitions
+  void UpdateOcrInvocationRate(unsigned int numberOfRecognitions);
 
   /// Language used for detection
   std::string                 Language;
 
   std::string                 TessdataDirectory;
 
-  /// Main entry point for the tesseract API
-  tesseract::TessBaseAPI*     TesseractAPI;
+  /// Tesseract instances, one for each recognition thread
+  std::vector<tesseract::TessBaseAPI*> TesseractAPIs;
+
+  unsigned int                NumberOfRecognitionThreads;
+
+  /// Timestamp of the latest processed frame of each source channel
+  std::map<vtkPlusChannel*, double> LatestFrameTimestamps;
+
+  double                      OcrInvocationRate;
+  unsigned int                OcrInvocationCount;
+  unsigned long long          TotalOcrInvocationCount;
+  double                      OcrRateMeasurementStartTime;
 
   vtkIGSIOTrackedFrameList*    TrackedFrames;
 
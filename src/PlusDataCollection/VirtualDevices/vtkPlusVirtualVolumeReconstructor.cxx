@@ -16,11 +16,15 @@ See License.txt for details.
 #include "vtkPlusVolumeReconstructor.h"
 #include "vtksys/SystemTools.hxx"
 
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkImageShrink3D.h>
+
 //----------------------------------------------------------------------------
 
 vtkStandardNewMacro(vtkPlusVirtualVolumeReconstructor);
 
-static const int MAX_ALLOWED_RECONSTRUCTION_LAG_SEC = 3.0; // if the reconstruction lags more than this then it'll skip frames to catch up
+static const double DEFAULT_MAX_ALLOWED_RECONSTRUCTION_LAG_SEC = 3.0; // if the reconstruction lags more than this then it'll skip frames to catch up
 
 //----------------------------------------------------------------------------
 vtkPlusVirtualVolumeReconstructor::vtkPlusVirtualVolumeReconstructor()
@@ -34,9 +38,23 @@ vtkPlusVirtualVolumeReconstructor::vtkPlusVirtualVolumeReconstructor()
   , TotalFramesRecorded(0)
   , EnableReconstruction(false)
   , VolumeReconstructorAccessMutex(vtkSmartPointer<vtkIGSIORecursiveCriticalSection>::New())
+  , EnableBackgroundInsertion(false)
+  , MaxReconstructionLagSec(DEFAULT_MAX_ALLOWED_RECONSTRUCTION_LAG_SEC)
+  , NumberOfQueuedItems(0)
+  , NumberOfCompletedItems(0)
+  , InsertionThreadStopRequested(false)
+  , InsertionBusy(false)
+  , PreviewUpdatePeriodSec(0.0)
+  , PreviewDownsamplingFactor(2)
+  , PreviewChannel(NULL)
+  , PreviewVideoSource(NULL)
+  , PreviewFrameNumber(0)
+  , LastPreviewUpdateTimeSec(0.0)
+  , PreviewOutdated(false)
 {
   // The data capture thread will be used to regularly read the frames and write to disk
   this->StartThreadForInternalUpdates = true;
+  this->UpdateOnNewInputData = true;
 
   this->VolumeReconstructor = vtkSmartPointer<vtkPlusVolumeReconstructor>::New();
   this->TransformRepository = vtkSmartPointer<vtkIGSIOTransformRepository>::New();
@@ -45,6 +63,7 @@ vtkPlusVirtualVolumeReconstructor::vtkPlusVirtualVolumeReconstructor()
 //----------------------------------------------------------------------------
 vtkPlusVirtualVolumeReconstructor::~vtkPlusVirtualVolumeReconstructor()
 {
+  this->StopInsertionThread();
 }
 
 //----------------------------------------------------------------------------
@@ -61,6 +80,15 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::ReadConfiguration(vtkXMLDataElemen
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableReconstruction, deviceConfig);
   XML_READ_CSTRING_ATTRIBUTE_OPTIONAL(OutputVolFilename, deviceConfig);
   XML_READ_CSTRING_ATTRIBUTE_OPTIONAL(OutputVolDeviceName, deviceConfig);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableBackgroundInsertion, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, MaxReconstructionLagSec, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, PreviewUpdatePeriodSec, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, PreviewDownsamplingFactor, deviceConfig);
+  if (this->PreviewDownsamplingFactor < 1)
+  {
+    LOG_WARNING("PreviewDownsamplingFactor must be at least 1, it is changed from " << this->PreviewDownsamplingFactor << " to 1");
+    this->PreviewDownsamplingFactor = 1;
+  }
 
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
   this->VolumeReconstructor->ReadConfiguration(deviceConfig);
@@ -77,6 +105,16 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::WriteConfiguration(vtkXMLDataEleme
 
   deviceElement->SetAttribute("OutputVolFilename", this->OutputVolFilename.c_str());
   deviceElement->SetAttribute("OutputVolDeviceName", this->OutputVolDeviceName.c_str());
+  if (this->EnableBackgroundInsertion)
+  {
+    deviceElement->SetAttribute("EnableBackgroundInsertion", "TRUE");
+  }
+  deviceElement->SetDoubleAttribute("MaxReconstructionLagSec", this->MaxReconstructionLagSec);
+  if (this->PreviewUpdatePeriodSec > 0)
+  {
+    deviceElement->SetDoubleAttribute("PreviewUpdatePeriodSec", this->PreviewUpdatePeriodSec);
+    deviceElement->SetIntAttribute("PreviewDownsamplingFactor", this->PreviewDownsamplingFactor);
+  }
 
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
   this->VolumeReconstructor->WriteConfiguration(deviceElement);
@@ -116,6 +154,7 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalConnect()
 PlusStatus vtkPlusVirtualVolumeReconstructor::InternalDisconnect()
 {
   SetEnableReconstruction(false);
+  this->StopInsertionThread();
   return PLUS_SUCCESS;
 }
 
@@ -165,31 +204,52 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
     LOG_WARNING("RequestedFrameRate is invalid, use default: " << 1 / requestedFramePeriodSec);
   }
 
-  igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
-  if (!this->EnableReconstruction)
-  {
-    // While this thread was waiting for the unlock, capturing was disabled, so cancel the update now
-    return PLUS_SUCCESS;
-  }
-
-  if (this->OutputChannels.empty())
+  if (this->InputChannels.empty())
   {
-    LOG_ERROR("No output channels defined");
+    LOG_ERROR("No input channels defined");
     return PLUS_FAIL;
   }
-  vtkPlusChannel* outputChannel = this->OutputChannels[0];
+  vtkPlusChannel* inputChannel = this->InputChannels[0];
 
   vtkSmartPointer<vtkIGSIOTrackedFrameList> recordedFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-  if (outputChannel->GetTrackedFrameListSampled(m_LastAlreadyRecordedFrameTimestamp, m_NextFrameToBeRecordedTimestamp, recordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+  int nbFramesRecorded = 0;
+  if (this->EnableBackgroundInsertion)
   {
-    LOG_ERROR("Error while getting tracked frame list from data collector during volume reconstruction. Last recorded timestamp: " << std::fixed << m_NextFrameToBeRecordedTimestamp);
+    // Frames are only sampled here and pasted by the insertion thread, so the volume reconstructor does not need to be locked
+    if (inputChannel->GetTrackedFrameListSampled(m_LastAlreadyRecordedFrameTimestamp, m_NextFrameToBeRecordedTimestamp, recordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Error while getting tracked frame list from data collector during volume reconstruction. Last recorded timestamp: " << std::fixed << m_NextFrameToBeRecordedTimestamp);
+    }
+    nbFramesRecorded = recordedFrames->GetNumberOfTrackedFrames();
+    if (nbFramesRecorded > 0)
+    {
+      this->QueueFramesForInsertion(recordedFrames);
+    }
   }
-  int nbFramesRecorded = recordedFrames->GetNumberOfTrackedFrames();
+  else
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+    if (!this->EnableReconstruction)
+    {
+      // While this thread was waiting for the unlock, capturing was disabled, so cancel the update now
+      return PLUS_SUCCESS;
+    }
 
-  if (this->AddFrames(recordedFrames) != PLUS_SUCCESS)
+    if (inputChannel->GetTrackedFrameListSampled(m_LastAlreadyRecordedFrameTimestamp, m_NextFrameToBeRecordedTimestamp, recordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Error while getting tracked frame list from data collector during volume reconstruction. Last recorded timestamp: " << std::fixed << m_NextFrameToBeRecordedTimestamp);
+    }
+    nbFramesRecorded = recordedFrames->GetNumberOfTrackedFrames();
+
+    if (this->AddFrames(recordedFrames) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(this->GetDeviceId() << ": Unable to add " << nbFramesRecorded << " frames for volume reconstruction");
+      return PLUS_FAIL;
+    }
+  }
+  if (!this->EnableBackgroundInsertion)
   {
-    LOG_ERROR(this->GetDeviceId() << ": Unable to add " << nbFramesRecorded << " frames for volume reconstruction");
-    return PLUS_FAIL;
+    this->UpdatePreview();
   }
 
   this->TotalFramesRecorded += nbFramesRecorded;
@@ -202,7 +262,7 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
   }
   double recordingLagSec = vtkIGSIOAccurateTimer::GetSystemTime() - m_NextFrameToBeRecordedTimestamp;
 
-  if (recordingLagSec > MAX_ALLOWED_RECONSTRUCTION_LAG_SEC)
+  if (recordingLagSec > this->MaxReconstructionLagSec)
   {
     LOG_ERROR("Volume reconstruction cannot keep up with the acquisition. Skip " << recordingLagSec << " seconds of the data stream to catch up.");
     m_NextFrameToBeRecordedTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
@@ -217,15 +277,33 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualVolumeReconstructor::NotifyConfigured()
 {
+  this->PreviewChannel = NULL;
+  this->PreviewVideoSource = NULL;
   if (!this->OutputChannels.empty())
   {
-    LOG_WARNING("vtkPlusVirtualCapture is expecting no output channel(s) and there are " << this->OutputChannels.size() << " channels. Output channel information will be dropped.");
-    this->OutputChannels.clear();
+    // A single output channel with a video source can be used for streaming the preview volume
+    vtkPlusDataSource* previewVideoSource = NULL;
+    if (this->OutputChannels.size() == 1 && this->OutputChannels[0]->GetVideoSource(previewVideoSource) == PLUS_SUCCESS)
+    {
+      this->PreviewChannel = this->OutputChannels[0];
+      this->PreviewVideoSource = previewVideoSource;
+      this->PreviewVideoSource->SetInputImageOrientation(US_IMG_ORIENT_MFA);
+      this->PreviewVideoSource->SetImageType(US_IMG_BRIGHTNESS);
+    }
+    else
+    {
+      LOG_WARNING("vtkPlusVirtualVolumeReconstructor is expecting no output channel or one output channel with a video source for the preview volume and there are " << this->OutputChannels.size() << " channels. Output channel information will be dropped.");
+      this->OutputChannels.clear();
+    }
+  }
+  if (this->PreviewUpdatePeriodSec > 0 && this->PreviewVideoSource == NULL)
+  {
+    LOG_WARNING("PreviewUpdatePeriodSec is set but no output channel with a video source is defined. Preview volume will not be generated.");
   }
 
   if (this->InputChannels.empty())
   {
-    LOG_ERROR("No input channel sent to vtkPlusVirtualCapture. Unable to save anything.");
+    LOG_ERROR("No input channel sent to vtkPlusVirtualVolumeReconstructor. Unable to reconstruct anything.");
     return PLUS_FAIL;
   }
   vtkPlusChannel* inputChannel = this->InputChannels[0];
@@ -267,8 +345,10 @@ void vtkPlusVirtualVolumeReconstructor::SetEnableReconstruction(bool aValue)
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualVolumeReconstructor::Reset()
 {
+  this->DiscardInsertionQueue();
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
   this->VolumeReconstructor->Reset();
+  this->PreviewOutdated = false;
   return PLUS_SUCCESS;
 }
 
@@ -287,13 +367,18 @@ int vtkPlusVirtualVolumeReconstructor::OutputChannelCount() const
 {
   // Even though we fake one output channel for easy GetTrackedFrame ability,
   //  we shouldn't return actual output channel size
-  return 0;
+  return (this->PreviewChannel != NULL ? 1 : 0);
 }
 
 //-----------------------------------------------------------------------------
 void vtkPlusVirtualVolumeReconstructor::InternalWriteOutputChannels(vtkXMLDataElement* rootXMLElement)
 {
-  // Do not write anything out, disc capture devices don't have output channels in the config
+  // Only the preview channel is written out, the input channel that is faked as an output channel is not part of the device config
+  if (this->PreviewChannel != NULL)
+  {
+    vtkXMLDataElement* channelElement = this->FindOutputChannelElement(rootXMLElement, this->PreviewChannel->GetChannelId());
+    this->PreviewChannel->WriteConfiguration(channelElement);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -317,6 +402,8 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::GetReconstructedVolumeFromFile(con
     return PLUS_FAIL;
   }
 
+  // Frames from the file are pasted directly, but the frames that are already queued must be completed first
+  this->FlushInsertionQueue();
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
 
   // Determine volume extents automatically
@@ -335,7 +422,7 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::GetReconstructedVolumeFromFile(con
     return PLUS_FAIL;
   }
   // Get output
-  if (GetReconstructedVolume(reconstructedVolume, errorMessage) != PLUS_SUCCESS)
+  if (ExtractReconstructedVolume(reconstructedVolume, errorMessage, true) != PLUS_SUCCESS)
   {
     LOG_INFO(errorMessage);
     return PLUS_FAIL;
@@ -345,6 +432,14 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::GetReconstructedVolumeFromFile(con
 
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualVolumeReconstructor::GetReconstructedVolume(vtkImageData* reconstructedVolume, std::string& outErrorMessage, bool applyHoleFilling/*=true*/)
+{
+  // Include all the frames that have been sampled until now
+  this->FlushInsertionQueue();
+  return this->ExtractReconstructedVolume(reconstructedVolume, outErrorMessage, applyHoleFilling);
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualVolumeReconstructor::ExtractReconstructedVolume(vtkImageData* reconstructedVolume, std::string& outErrorMessage, bool applyHoleFilling)
 {
   outErrorMessage.clear();
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
@@ -402,6 +497,10 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::AddFrames(vtkIGSIOTrackedFrameList
     }
   }
   trackedFrameList->Clear();
+  if (numberOfFramesAddedToVolume > 0)
+  {
+    this->PreviewOutdated = true;
+  }
 
   LOG_DEBUG("Number of frames added to the volume: " << numberOfFramesAddedToVolume << " out of " << numberOfFrames);
 
@@ -454,3 +553,189 @@ void vtkPlusVirtualVolumeReconstructor::SetOutputExtent(int* extent)
 {
   this->VolumeReconstructor->SetOutputExtent(extent);
 }
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlusVirtualVolumeReconstructor::GetInsertionQueueDepth() const
+{
+  std::lock_guard<std::mutex> queueLock(this->InsertionQueueMutex);
+  return this->InsertionQueue.size();
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::QueueFramesForInsertion(vtkIGSIOTrackedFrameList* frames)
+{
+  this->StartInsertionThread();
+
+  InsertionQueueItem item;
+  item.Frames = frames;
+  item.FirstFrameTimestamp = frames->GetTrackedFrame(0)->GetTimestamp();
+  item.LastFrameTimestamp = frames->GetTrackedFrame(frames->GetNumberOfTrackedFrames() - 1)->GetTimestamp();
+
+  int numberOfDroppedFrames = 0;
+  double firstDroppedTimestamp = 0.0;
+  double lastDroppedTimestamp = 0.0;
+  {
+    std::lock_guard<std::mutex> queueLock(this->InsertionQueueMutex);
+    this->InsertionQueue.push_back(item);
+    this->NumberOfQueuedItems++;
+    // The newest frames are always kept, the oldest ones are dropped if pasting cannot keep up with the acquisition
+    while (this->InsertionQueue.size() > 1 && item.LastFrameTimestamp - this->InsertionQueue.front().FirstFrameTimestamp > this->MaxReconstructionLagSec)
+    {
+      if (numberOfDroppedFrames == 0)
+      {
+        firstDroppedTimestamp = this->InsertionQueue.front().FirstFrameTimestamp;
+      }
+      lastDroppedTimestamp = this->InsertionQueue.front().LastFrameTimestamp;
+      numberOfDroppedFrames += this->InsertionQueue.front().Frames->GetNumberOfTrackedFrames();
+      this->InsertionQueue.pop_front();
+      this->NumberOfCompletedItems++;
+    }
+  }
+  this->InsertionQueueChanged.notify_all();
+
+  if (numberOfDroppedFrames > 0)
+  {
+    LOG_ERROR("Volume reconstruction cannot keep up with the acquisition. Skip " << numberOfDroppedFrames << " frames (" << lastDroppedTimestamp - firstDroppedTimestamp << " seconds) of the data stream to catch up.");
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::FlushInsertionQueue()
+{
+  std::unique_lock<std::mutex> queueLock(this->InsertionQueueMutex);
+  // Items that are queued meanwhile are not waited for, so that a continuously running acquisition cannot block the caller
+  unsigned long long numberOfItemsToComplete = this->NumberOfQueuedItems;
+  this->InsertionQueueChanged.wait(queueLock, [this, numberOfItemsToComplete]() { return this->NumberOfCompletedItems >= numberOfItemsToComplete; });
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::DiscardInsertionQueue()
+{
+  std::unique_lock<std::mutex> queueLock(this->InsertionQueueMutex);
+  this->NumberOfCompletedItems += this->InsertionQueue.size();
+  this->InsertionQueue.clear();
+  this->InsertionQueueChanged.notify_all();
+  this->InsertionQueueChanged.wait(queueLock, [this]() { return !this->InsertionBusy; });
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::StartInsertionThread()
+{
+  if (this->InsertionThread.joinable())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> queueLock(this->InsertionQueueMutex);
+    this->InsertionThreadStopRequested = false;
+  }
+  this->InsertionThread = std::thread(&vtkPlusVirtualVolumeReconstructor::InsertionThreadMain, this);
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::StopInsertionThread()
+{
+  if (!this->InsertionThread.joinable())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> queueLock(this->InsertionQueueMutex);
+    this->InsertionThreadStopRequested = true;
+  }
+  this->InsertionQueueChanged.notify_all();
+  this->InsertionThread.join();
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::InsertionThreadMain()
+{
+  while (true)
+  {
+    InsertionQueueItem item;
+    {
+      std::unique_lock<std::mutex> queueLock(this->InsertionQueueMutex);
+      this->InsertionQueueChanged.wait(queueLock, [this]() { return this->InsertionThreadStopRequested || !this->InsertionQueue.empty(); });
+      if (this->InsertionQueue.empty())
+      {
+        // Stop is requested and all frames are pasted
+        return;
+      }
+      item = this->InsertionQueue.front();
+      this->InsertionQueue.pop_front();
+      this->InsertionBusy = true;
+    }
+
+    int numberOfFrames = item.Frames->GetNumberOfTrackedFrames();
+    if (this->AddFrames(item.Frames) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(this->GetDeviceId() << ": Unable to add " << numberOfFrames << " frames for volume reconstruction");
+    }
+    this->UpdatePreview();
+
+    {
+      std::lock_guard<std::mutex> queueLock(this->InsertionQueueMutex);
+      this->NumberOfCompletedItems++;
+      this->InsertionBusy = false;
+    }
+    this->InsertionQueueChanged.notify_all();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::UpdatePreview()
+{
+  if (this->PreviewVideoSource == NULL || this->PreviewUpdatePeriodSec <= 0)
+  {
+    return;
+  }
+
+  vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+    double currentTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (!this->PreviewOutdated || currentTimeSec - this->LastPreviewUpdateTimeSec < this->PreviewUpdatePeriodSec)
+    {
+      return;
+    }
+    // Hole filling would take too long to be repeated during the acquisition, the downsampling fills the small gaps instead
+    std::string errorMessage;
+    if (this->ExtractReconstructedVolume(volume, errorMessage, false) != PLUS_SUCCESS)
+    {
+      return;
+    }
+    this->PreviewOutdated = false;
+    this->LastPreviewUpdateTimeSec = currentTimeSec;
+  }
+
+  vtkImageData* preview = volume;
+  vtkSmartPointer<vtkImageShrink3D> shrink = vtkSmartPointer<vtkImageShrink3D>::New();
+  if (this->PreviewDownsamplingFactor > 1)
+  {
+    // Maximum of each block is used, so that the voxels between the pasted slices do not make the preview darker
+    shrink->SetInputData(volume);
+    shrink->SetShrinkFactors(this->PreviewDownsamplingFactor, this->PreviewDownsamplingFactor, this->PreviewDownsamplingFactor);
+    shrink->SetMaximum(true);
+    shrink->Update();
+    preview = shrink->GetOutput();
+  }
+
+  int* dimensions = preview->GetDimensions();
+  FrameSizeType previewFrameSize = { static_cast<unsigned int>(dimensions[0]), static_cast<unsigned int>(dimensions[1]), static_cast<unsigned int>(dimensions[2]) };
+  if (this->PreviewVideoSource->GetInputFrameSize() != previewFrameSize
+      || this->PreviewVideoSource->GetPixelType() != preview->GetScalarType()
+      || this->PreviewVideoSource->GetNumberOfScalarComponents() != static_cast<unsigned int>(preview->GetNumberOfScalarComponents()))
+  {
+    // Volume size changes when the reconstruction is restarted with a different extent
+    this->PreviewVideoSource->SetInputFrameSize(previewFrameSize);
+    this->PreviewVideoSource->SetPixelType(preview->GetScalarType());
+    this->PreviewVideoSource->SetNumberOfScalarComponents(preview->GetNumberOfScalarComponents());
+  }
+
+  if (this->PreviewVideoSource->AddItem(preview, this->PreviewVideoSource->GetInputImageOrientation(), this->PreviewVideoSource->GetImageType(), this->PreviewFrameNumber) != PLUS_SUCCESS)
+  {
+    LOG_ERROR(this->GetDeviceId() << ": Failed to add preview volume to the video source");
+    return;
+  }
+  this->PreviewFrameNumber++;
+}
@@ -10,13 +10,28 @@ See License.txt for details.
 #include "vtkPlusDataCollectionExport.h"
 
 #include "vtkPlusDevice.h"
+
+// STL includes
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 
 class vtkPlusVolumeReconstructor;
 
 /*!
 \class vtkPlusVirtualVolumeReconstructor
-\brief
+\brief Reconstructs a volume from the frames of the input channel while the acquisition is running
+
+By default the sampled frames are pasted into the volume on the data capture thread. If background insertion is enabled
+then the data capture thread only samples the frames and a separate insertion thread pastes them into the volume,
+in the order they were acquired, so the result is the same as when the frames are pasted on the data capture thread.
+Slow pasting then does not delay the sampling; frames are only skipped if the queued frames span more than
+MaxReconstructionLagSec seconds. Pasting of each frame may use multiple threads, as set in the VolumeReconstruction element.
+
+If an output channel with a video source is defined then a downsampled preview of the volume (without hole filling)
+is added to it periodically, so that it can be broadcast to OpenIGTLink clients while the volume is being acquired.
 
 \ingroup PlusLibDataCollection
 */
@@ -81,6 +96,25 @@ public:
 
   vtkGetMacro(TotalFramesRecorded, long int);
 
+  /*! If enabled then frames are pasted into the volume on a separate thread instead of the data capture thread */
+  vtkSetMacro(EnableBackgroundInsertion, bool);
+  vtkGetMacro(EnableBackgroundInsertion, bool);
+
+  /*! If the reconstruction lags behind the acquisition more than this (in seconds) then frames are skipped to catch up */
+  vtkSetMacro(MaxReconstructionLagSec, double);
+  vtkGetMacro(MaxReconstructionLagSec, double);
+
+  /*! Time between preview volume updates (in seconds). If 0 then no preview is generated. */
+  vtkSetMacro(PreviewUpdatePeriodSec, double);
+  vtkGetMacro(PreviewUpdatePeriodSec, double);
+
+  /*! Each dimension of the preview volume is this many times smaller than the reconstructed volume */
+  vtkSetMacro(PreviewDownsamplingFactor, int);
+  vtkGetMacro(PreviewDownsamplingFactor, int);
+
+  /*! Number of sampled frame lists waiting to be pasted into the volume (only used if background insertion is enabled) */
+  unsigned int GetInsertionQueueDepth() const;
+
 protected:
 
   /*! Read main configuration from xml data */
@@ -115,6 +149,29 @@ protected:
 
   PlusStatus AddFrames(vtkIGSIOTrackedFrameList* trackedFrameList);
 
+  /*! Extract the volume from the reconstructor. Does not wait for the queued frames to be inserted. */
+  PlusStatus ExtractReconstructedVolume(vtkImageData* reconstructedVolume, std::string& outErrorMessage, bool applyHoleFilling);
+
+  /*!
+    Add frames to the insertion queue. If the queued frames span more than MaxReconstructionLagSec then the oldest frames are dropped.
+    The insertion thread is started if it is not running yet.
+  */
+  void QueueFramesForInsertion(vtkIGSIOTrackedFrameList* frames);
+
+  /*! Wait until all the frames that were queued before this call are pasted into the volume. Must not be called while VolumeReconstructorAccessMutex is locked. */
+  void FlushInsertionQueue();
+
+  /*! Discard all queued frames and wait until the frames that are being pasted are completed. Must not be called while VolumeReconstructorAccessMutex is locked. */
+  void DiscardInsertionQueue();
+
+  void StartInsertionThread();
+  /*! Paste all queued frames and stop the insertion thread */
+  void StopInsertionThread();
+  void InsertionThreadMain();
+
+  /*! Add a downsampled copy of the volume to the preview video source if the preview update period has elapsed and new frames were pasted since the last preview */
+  void UpdatePreview();
+
   /*! Get the sampling period length (in seconds). Frames are copied from the devices to the data collection buffer once in every sampling period. */
   double GetSamplingPeriodSec();
 
@@ -155,6 +212,41 @@ protected:
   /*! Mutex instance simultaneous access of writer (writer may be accessed from command processing thread and also the internal update thread) */
   vtkSmartPointer<vtkIGSIORecursiveCriticalSection> VolumeReconstructorAccessMutex;
 
+  bool EnableBackgroundInsertion;
+  double MaxReconstructionLagSec;
+
+  /*! Item of the insertion queue */
+  struct InsertionQueueItem
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> Frames;
+    double FirstFrameTimestamp;
+    double LastFrameTimestamp;
+  };
+
+  /*! Protects the insertion queue. Must not be locked while waiting for VolumeReconstructorAccessMutex. */
+  mutable std::mutex InsertionQueueMutex;
+  /*! Signaled when items are added to or removed from the queue and when the insertion thread becomes idle */
+  std::condition_variable InsertionQueueChanged;
+  std::deque<InsertionQueueItem> InsertionQueue;
+  /*! Number of items added to the queue and number of items that are pasted or dropped, used for waiting for the completion of the queued items */
+  unsigned long long NumberOfQueuedItems;
+  unsigned long long NumberOfCompletedItems;
+  std::thread InsertionThread;
+  bool InsertionThreadStopRequested;
+  /*! True while the insertion thread is pasting an item that is already removed from the queue */
+  bool InsertionBusy;
+
+  double PreviewUpdatePeriodSec;
+  int PreviewDownsamplingFactor;
+  /*! Output channel and video source of the preview volume, NULL if no preview output is defined */
+  vtkPlusChannel* PreviewChannel;
+  vtkPlusDataSource* PreviewVideoSource;
+  long PreviewFrameNumber;
+  /*! Time of the last preview update. Protected by VolumeReconstructorAccessMutex. */
+  double LastPreviewUpdateTimeSec;
+  /*! True if frames were pasted into the volume since the last preview update. Protected by VolumeReconstructorAccessMutex. */
+  bool PreviewOutdated;
+
 private:
   vtkPlusVirtualVolumeReconstructor(const vtkPlusVirtualVolumeReconstructor&);   // Not implemented.
   void operator=(const vtkPlusVirtualVolumeReconstructor&);   // Not implemented.
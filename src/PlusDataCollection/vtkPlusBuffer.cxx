@@ -6,10 +6,14 @@ See License.txt for details.
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PlusBufferSnapshotWriter.h"
+#include "PlusNewItemSignal.h"
+#include "PlusTransformBufferStorage.h"
 #include "igsioMath.h"
 #include "igsioTrackedFrame.h"
 #include "vtkPlusBuffer.h"
 #include "vtkPlusDevice.h"
+#include "vtkPlusLockFreeTimestampedCircularBuffer.h"
 #include "vtkPlusSequenceIO.h"
 #include "vtkIGSIOTrackedFrameList.h"
 
@@ -20,16 +24,46 @@ See License.txt for details.
 #include <vtkMath.h>
 #include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
 #include <vtkUnsignedLongLongArray.h>
 
 // vtkAddon includes
 #include <vtkStreamingVolumeCodec.h>
 
+// STL includes
+#include <algorithm>
+#include <mutex>
+
 static const double NEGLIGIBLE_TIME_DIFFERENCE = 0.00001; // in seconds, used for comparing between exact timestamps
 static const double ANGLE_INTERPOLATION_WARNING_THRESHOLD_DEG = 10; // if the interpolated orientation differs from both the interpolated orientation by more than this threshold then display a warning
+static const size_t MAX_NUMBER_OF_SPARE_FRAME_DATA = 4; // maximum number of pixel arrays that are kept for reuse by reserved frames
 
 vtkStandardNewMacro(vtkPlusBuffer);
 
+/*!
+  Counts the new item and notifies the signals of the buffer when it goes out of scope (if an item was added).
+  It must be created before the buffer lock guard, so that the waiting threads are notified after the buffer is unlocked.
+*/
+class vtkPlusBufferNewItemNotifier
+{
+public:
+  vtkPlusBufferNewItemNotifier(vtkPlusBuffer* buffer)
+    : ItemAdded(false)
+    , Buffer(buffer)
+  {
+  }
+  ~vtkPlusBufferNewItemNotifier()
+  {
+    if (this->ItemAdded)
+    {
+      this->Buffer->NotifyNewItem();
+    }
+  }
+  bool ItemAdded;
+private:
+  vtkPlusBuffer* Buffer;
+};
+
 #define LOCAL_LOG_ERROR(msg) \
 { \
   std::ostringstream msgStream; \
@@ -84,6 +118,10 @@ vtkPlusBuffer::vtkPlusBuffer()
   , StreamBuffer(vtkPlusTimestampedCircularBuffer::New())
   , MaxAllowedTimeDifference(0.5)
   , DescriptiveName(NULL)
+  , NumberOfSharedFrameReallocations(0)
+  , TransformStorage(NULL)
+  , NumberOfAddedItems(0)
+  , HasNewItemSignals(false)
 {
   this->FrameSize[0] = 0;
   this->FrameSize[1] = 0;
@@ -104,6 +142,9 @@ vtkPlusBuffer::~vtkPlusBuffer()
     this->StreamBuffer = NULL;
   }
 
+  delete this->TransformStorage;
+  this->TransformStorage = NULL;
+
   this->SetDescriptiveName(nullptr);
 }
 
@@ -129,6 +170,18 @@ PlusStatus vtkPlusBuffer::AllocateMemoryForFrames()
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
   PlusStatus result = PLUS_SUCCESS;
 
+  if (this->TransformStorage != NULL)
+  {
+    // Items of compact transform buffers do not store frames
+    return result;
+  }
+
+  {
+    // Spare pixel arrays of the previous frame format cannot be reused
+    std::lock_guard<std::mutex> spareFrameDataLock(this->SpareFrameDataMutex);
+    this->SpareFrameData.clear();
+  }
+
   for (int i = 0; i < this->StreamBuffer->GetBufferSize(); ++i)
   {
     if (!this->StreamBuffer->GetBufferItemPointerFromBufferIndex(i)->GetFrame().IsFrameEncoded())
@@ -180,6 +233,13 @@ PlusStatus vtkPlusBuffer::SetBufferSize(int bufsize)
   {
     result = PLUS_FAIL;
   }
+  if (this->TransformStorage != NULL)
+  {
+    // Buffer items do not store frames, only the transform storage has to be resized
+    igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+    this->TransformStorage->SetCapacity(bufsize);
+    return result;
+  }
   if (this->AllocateMemoryForFrames() != PLUS_SUCCESS)
   {
     return PLUS_FAIL;
@@ -354,6 +414,7 @@ PlusStatus vtkPlusBuffer::AddItem(const igsioFieldMapType& fields,
   int bufferIndex(0);
   BufferItemUidType itemUid;
 
+  vtkPlusBufferNewItemNotifier newItemNotifier(this);
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
   if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
@@ -361,6 +422,7 @@ PlusStatus vtkPlusBuffer::AddItem(const igsioFieldMapType& fields,
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to tracker buffer!");
     return PLUS_FAIL;
   }
+  newItemNotifier.ItemAdded = true;
 
   // get the pointer to the correct location in the tracker buffer, where this data needs to be copied
   StreamBufferItem* newObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
@@ -375,6 +437,13 @@ PlusStatus vtkPlusBuffer::AddItem(const igsioFieldMapType& fields,
   newObjectInBuffer->SetIndex(frameNumber);
   newObjectInBuffer->SetUid(itemUid);
 
+  if (this->TransformStorage != NULL)
+  {
+    this->TransformStorage->SetItem(itemUid, filteredTimestamp, unfilteredTimestamp, frameNumber, NULL, TOOL_OK, &fields);
+    newObjectInBuffer->SetValidTransformData(this->TransformStorage->HasValidTransformData(itemUid));
+    return PLUS_SUCCESS;
+  }
+
   // Add custom fields
   for (igsioFieldMapType::const_iterator it = fields.begin(); it != fields.end(); ++it)
   {
@@ -401,6 +470,12 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
                                   const igsioFieldMapType* customFields /*= NULL */,
                                   vtkStreamingVolumeFrame* encodedFrame /*=NULL*/)
 {
+  if (this->TransformStorage != NULL)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to add frame to buffer - compact transform storage is enabled");
+    return PLUS_FAIL;
+  }
+
   if (unfilteredTimestamp == UNDEFINED_TIMESTAMP)
   {
     unfilteredTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
@@ -433,38 +508,38 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
   }
 
   igsioVideoFrame::FlipInfoType flipInfo;
-  if (igsioVideoFrame::GetFlipAxes(usImageOrientation, imageType, this->ImageOrientation, flipInfo) != PLUS_SUCCESS)
+  if (this->GetFrameConversion(usImageOrientation, inputFrameSizeInPx, pixelType, numberOfScalarComponents, imageType, clipRectangleOrigin, clipRectangleSize, flipInfo) != PLUS_SUCCESS)
   {
-    LOG_ERROR("Failed to convert image data to the requested orientation, from " << igsioCommon::GetStringFromUsImageOrientation(usImageOrientation) <<
-              " to " << igsioCommon::GetStringFromUsImageOrientation(this->ImageOrientation));
+    LOG_ERROR("vtkPlusBuffer: Unable to add frame to video buffer - frame format doesn't match!");
     return PLUS_FAIL;
   }
 
-  // Calculate the output frame size to validate that buffer is correctly setup
-  FrameSizeType outputFrameSizeInPx = { inputFrameSizeInPx[0], inputFrameSizeInPx[1], inputFrameSizeInPx[2] };
-  if (igsioCommon::IsClippingRequested(clipRectangleOrigin, clipRectangleSize))
+  if (imageDataPtr != NULL)
   {
-    outputFrameSizeInPx[0] = clipRectangleSize[0];
-    outputFrameSizeInPx[1] = clipRectangleSize[1];
-    outputFrameSizeInPx[2] = clipRectangleSize[2];
-  }
+    // The frame is converted into a reserved frame without locking the buffer, readers are only blocked while it is published
+    StreamBufferItemReservation reservation;
+    if (this->ReserveItem(reservation) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
 
-  if (flipInfo.tranpose == igsioVideoFrame::TRANSPOSE_IJKtoKIJ)
-  {
-    unsigned int temp = outputFrameSizeInPx[0];
-    outputFrameSizeInPx[0] = outputFrameSizeInPx[2];
-    outputFrameSizeInPx[2] = outputFrameSizeInPx[1];
-    outputFrameSizeInPx[1] = temp;
-  }
+    // Skip the numberOfBytesToSkip bytes, e.g. header size
+    unsigned char* byteImageDataPtr = reinterpret_cast<unsigned char*>(imageDataPtr);
+    byteImageDataPtr += numberOfBytesToSkip;
+    if (igsioVideoFrame::GetOrientedClippedImage(byteImageDataPtr, flipInfo, imageType, pixelType, numberOfScalarComponents, inputFrameSizeInPx, reservation.GetFrame(), clipRectangleOrigin, clipRectangleSize) != PLUS_SUCCESS)
+    {
+      this->ReleaseReservation(reservation);
+      LOCAL_LOG_ERROR("Failed to convert input US image to the requested orientation!");
+      return PLUS_FAIL;
+    }
 
-  if (!this->CheckFrameFormat(outputFrameSizeInPx, pixelType, imageType, numberOfScalarComponents))
-  {
-    LOG_ERROR("vtkPlusBuffer: Unable to add frame to video buffer - frame format doesn't match!");
-    return PLUS_FAIL;
+    return this->PublishReservedItem(reservation, imageType, frameNumber, unfilteredTimestamp, filteredTimestamp, customFields);
   }
 
+  // Encoded frames are not converted, only a reference to the frame is stored in the buffer slot
   int bufferIndex(0);
   BufferItemUidType itemUid;
+  vtkPlusBufferNewItemNotifier newItemNotifier(this);
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
   if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
@@ -472,6 +547,7 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to video buffer!");
     return PLUS_FAIL;
   }
+  newItemNotifier.ItemAdded = true;
 
   // get the pointer to the correct location in the frame buffer, where this data needs to be copied
   StreamBufferItem* newObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
@@ -481,37 +557,7 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
     return PLUS_FAIL;
   }
 
-  FrameSizeType receivedFrameSize = { 0, 0, 0 };
-  newObjectInBuffer->GetFrame().GetFrameSize(receivedFrameSize);
-
-  if (imageDataPtr && !encodedFrame &&
-      (outputFrameSizeInPx[0] != receivedFrameSize[0]
-       || outputFrameSizeInPx[1] != receivedFrameSize[1]
-       || outputFrameSizeInPx[2] != receivedFrameSize[2]))
-  {
-    LOCAL_LOG_ERROR("Input frame size is different from buffer frame size (input: " <<
-                    outputFrameSizeInPx[0] << "x" << outputFrameSizeInPx[1] << "x" << outputFrameSizeInPx[2] <<
-                    ",   buffer: " <<
-                    receivedFrameSize[0] << "x" << receivedFrameSize[1] << "x" << receivedFrameSize[2] << ")!");
-    return PLUS_FAIL;
-  }
-
-  // Skip the numberOfBytesToSkip bytes, e.g. header size
-  if (imageDataPtr != NULL)
-  {
-    unsigned char* byteImageDataPtr = reinterpret_cast<unsigned char*>(imageDataPtr);
-    byteImageDataPtr += numberOfBytesToSkip;
-
-    if (igsioVideoFrame::GetOrientedClippedImage(byteImageDataPtr, flipInfo, imageType, pixelType, numberOfScalarComponents, inputFrameSizeInPx, newObjectInBuffer->GetFrame(), clipRectangleOrigin, clipRectangleSize) != PLUS_SUCCESS)
-    {
-      LOCAL_LOG_ERROR("Failed to convert input US image to the requested orientation!");
-      return PLUS_FAIL;
-    }
-  }
-  else if (encodedFrame != NULL)
-  {
-    newObjectInBuffer->GetFrame().SetEncodedFrame(encodedFrame);
-  }
+  newObjectInBuffer->GetFrame().SetEncodedFrame(encodedFrame);
 
   newObjectInBuffer->SetFilteredTimestamp(filteredTimestamp);
   newObjectInBuffer->SetUnfilteredTimestamp(unfilteredTimestamp);
@@ -539,6 +585,12 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr, const FrameSizeType& frameSize, unsigned int inputFrameSizeInBytes, US_IMAGE_TYPE imageType, long frameNumber, double unfilteredTimestamp /*= UNDEFINED_TIMESTAMP*/, double filteredTimestamp /*= UNDEFINED_TIMESTAMP*/, const igsioFieldMapType* customFields /*= NULL*/)
 {
+  if (this->TransformStorage != NULL)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to add frame to buffer - compact transform storage is enabled");
+    return PLUS_FAIL;
+  }
+
   if (unfilteredTimestamp == UNDEFINED_TIMESTAMP)
   {
     unfilteredTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
@@ -576,57 +628,364 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr, const FrameSizeType& frame
     return PLUS_FAIL;
   }
 
-  int bufferIndex(0);
-  BufferItemUidType itemUid;
-  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
-  if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  // The frame is copied into a reserved frame without locking the buffer, readers are only blocked while it is published
+  StreamBufferItemReservation reservation;
+  if (this->ReserveItem(reservation) != PLUS_SUCCESS)
   {
-    // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
-    LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to video buffer!");
     return PLUS_FAIL;
   }
 
-  // get the pointer to the correct location in the frame buffer, where this data needs to be copied
-  StreamBufferItem* newObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
-  if (newObjectInBuffer == NULL)
+  unsigned long bufferFrameSizeBytes = reservation.GetFrameSizeInBytes();
+  if (bufferFrameSizeBytes < inputFrameSizeInBytes)
   {
-    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get pointer to video buffer object from the video buffer for the new frame!");
+    this->ReleaseReservation(reservation);
+    LOCAL_LOG_ERROR("Input frame size is larger than buffer frame size (input: " << inputFrameSizeInBytes << ",   buffer: " << bufferFrameSizeBytes << ")!");
     return PLUS_FAIL;
   }
+  memcpy(reservation.GetScalarPointer(), imageDataPtr, inputFrameSizeInBytes);
 
-  unsigned int bufferFrameSizeBytes = newObjectInBuffer->GetFrame().GetFrameSizeInBytes();
-  if (bufferFrameSizeBytes < inputFrameSizeInBytes)
+  return this->PublishReservedItem(reservation, imageType, frameNumber, unfilteredTimestamp, filteredTimestamp, customFields, inputFrameSizeInBytes);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::GetFrameConversion(US_IMAGE_ORIENTATION usImageOrientation,
+    const FrameSizeType& inputFrameSizeInPx,
+    igsioCommon::VTKScalarPixelType pixelType,
+    unsigned int numberOfScalarComponents,
+    US_IMAGE_TYPE imageType,
+    const std::array<int, 3>& clipRectangleOrigin,
+    const std::array<int, 3>& clipRectangleSize,
+    igsioVideoFrame::FlipInfoType& flipInfo)
+{
+  if (igsioVideoFrame::GetFlipAxes(usImageOrientation, imageType, this->ImageOrientation, flipInfo) != PLUS_SUCCESS)
   {
-    LOCAL_LOG_ERROR("Input frame size is larger than buffer frame size (input: " << inputFrameSizeInBytes << ",   buffer: " << bufferFrameSizeBytes << ")!");
+    LOG_ERROR("Failed to convert image data to the requested orientation, from " << igsioCommon::GetStringFromUsImageOrientation(usImageOrientation) <<
+              " to " << igsioCommon::GetStringFromUsImageOrientation(this->ImageOrientation));
     return PLUS_FAIL;
   }
 
-  newObjectInBuffer->SetFilteredTimestamp(filteredTimestamp);
-  newObjectInBuffer->SetUnfilteredTimestamp(unfilteredTimestamp);
-  newObjectInBuffer->SetIndex(frameNumber);
-  newObjectInBuffer->SetUid(itemUid);
-  newObjectInBuffer->GetFrame().SetImageType(imageType);
-  memcpy(newObjectInBuffer->GetFrame().GetImage()->GetScalarPointer(), imageDataPtr, inputFrameSizeInBytes);
+  // Calculate the output frame size to validate that buffer is correctly setup
+  FrameSizeType outputFrameSizeInPx = { inputFrameSizeInPx[0], inputFrameSizeInPx[1], inputFrameSizeInPx[2] };
+  if (igsioCommon::IsClippingRequested(clipRectangleOrigin, clipRectangleSize))
+  {
+    outputFrameSizeInPx[0] = clipRectangleSize[0];
+    outputFrameSizeInPx[1] = clipRectangleSize[1];
+    outputFrameSizeInPx[2] = clipRectangleSize[2];
+  }
 
-  // Add custom fields
-  if (customFields != NULL)
+  if (flipInfo.tranpose == igsioVideoFrame::TRANSPOSE_IJKtoKIJ)
   {
-    for (igsioFieldMapType::const_iterator it = customFields->begin(); it != customFields->end(); ++it)
+    unsigned int temp = outputFrameSizeInPx[0];
+    outputFrameSizeInPx[0] = outputFrameSizeInPx[2];
+    outputFrameSizeInPx[2] = outputFrameSizeInPx[1];
+    outputFrameSizeInPx[1] = temp;
+  }
+
+  if (!this->CheckFrameFormat(outputFrameSizeInPx, pixelType, imageType, numberOfScalarComponents))
+  {
+    return PLUS_FAIL;
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::ReserveItem(StreamBufferItemReservation& reservation)
+{
+  if (reservation.IsReserved())
+  {
+    // The frame format may have changed since the frame was reserved, start over
+    reservation.Owner->ReleaseReservation(reservation);
+  }
+
+  if (this->TransformStorage != NULL)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to reserve frame - compact transform storage is enabled");
+    return PLUS_FAIL;
+  }
+
+  FrameSizeType frameSize = this->GetFrameSize();
+  vtkIdType numberOfPixels = static_cast<vtkIdType>(frameSize[0]) * frameSize[1] * frameSize[2];
+  if (numberOfPixels == 0)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to reserve frame - frame size of the buffer is not set");
+    return PLUS_FAIL;
+  }
+
+  vtkImageData* image = reservation.Frame.GetImage();
+  int* dimensions = (image != NULL ? image->GetDimensions() : NULL);
+  if (image == NULL || dimensions[0] != static_cast<int>(frameSize[0]) || dimensions[1] != static_cast<int>(frameSize[1]) || dimensions[2] != static_cast<int>(frameSize[2]))
+  {
+    // First reservation or the frame size is changed: allocate a new image
+    if (reservation.Frame.AllocateFrame(frameSize, this->PixelType, this->NumberOfScalarComponents) != PLUS_SUCCESS)
     {
-      newObjectInBuffer->SetFrameField(it->first, it->second.second, it->second.first);
-      std::string name(it->first);
-      if (name.find("Transform") != std::string::npos)
+      LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to allocate memory for the reserved frame");
+      return PLUS_FAIL;
+    }
+    reservation.Owner = this;
+    return PLUS_SUCCESS;
+  }
+
+  // Reuse a pixel array that was swapped out of a buffer slot
+  vtkSmartPointer<vtkDataArray> scalars;
+  {
+    std::lock_guard<std::mutex> spareFrameDataLock(this->SpareFrameDataMutex);
+    while (scalars == NULL && !this->SpareFrameData.empty())
+    {
+      vtkSmartPointer<vtkDataArray> spareScalars = this->SpareFrameData.back();
+      this->SpareFrameData.pop_back();
+      // Arrays of a previous frame format are dropped
+      if (spareScalars->GetDataType() == this->PixelType
+          && spareScalars->GetNumberOfComponents() == static_cast<int>(this->NumberOfScalarComponents)
+          && spareScalars->GetNumberOfTuples() == numberOfPixels)
       {
-        newObjectInBuffer->SetValidTransformData(true);
+        scalars = spareScalars;
       }
     }
   }
+  if (scalars == NULL)
+  {
+    scalars = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(this->PixelType));
+    scalars->SetNumberOfComponents(this->NumberOfScalarComponents);
+    scalars->SetNumberOfTuples(numberOfPixels);
+  }
+  image->GetPointData()->SetScalars(scalars);
+  reservation.Owner = this;
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::WriteReservedItem(StreamBufferItemReservation& reservation,
+    void* imageDataPtr,
+    US_IMAGE_ORIENTATION usImageOrientation,
+    const FrameSizeType& inputFrameSizeInPx,
+    igsioCommon::VTKScalarPixelType pixelType,
+    unsigned int numberOfScalarComponents,
+    US_IMAGE_TYPE imageType,
+    int numberOfBytesToSkip,
+    const std::array<int, 3>& clipRectangleOrigin,
+    const std::array<int, 3>& clipRectangleSize)
+{
+  if (reservation.Owner != this)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to write reserved frame - no frame is reserved from this buffer");
+    return PLUS_FAIL;
+  }
+  if (imageDataPtr == NULL)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to write NULL frame into the reserved frame!");
+    return PLUS_FAIL;
+  }
 
-  newObjectInBuffer->SetFrameField("FrameSizeInBytes", igsioCommon::ToString<unsigned int>(inputFrameSizeInBytes));
+  igsioVideoFrame::FlipInfoType flipInfo;
+  if (this->GetFrameConversion(usImageOrientation, inputFrameSizeInPx, pixelType, numberOfScalarComponents, imageType, clipRectangleOrigin, clipRectangleSize, flipInfo) != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to write reserved frame - frame format doesn't match!");
+    return PLUS_FAIL;
+  }
+
+  unsigned char* byteImageDataPtr = reinterpret_cast<unsigned char*>(imageDataPtr);
+  byteImageDataPtr += numberOfBytesToSkip;
+  if (igsioVideoFrame::GetOrientedClippedImage(byteImageDataPtr, flipInfo, imageType, pixelType, numberOfScalarComponents, inputFrameSizeInPx, reservation.Frame, clipRectangleOrigin, clipRectangleSize) != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("Failed to convert input US image to the requested orientation!");
+    return PLUS_FAIL;
+  }
 
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::CommitReservedItem(StreamBufferItemReservation& reservation,
+    long frameNumber,
+    double unfilteredTimestamp /*= UNDEFINED_TIMESTAMP*/,
+    double filteredTimestamp /*= UNDEFINED_TIMESTAMP*/,
+    const igsioFieldMapType* customFields /*= NULL*/)
+{
+  if (reservation.Owner != this)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to commit reserved frame - no frame is reserved from this buffer");
+    return PLUS_FAIL;
+  }
+
+  if (unfilteredTimestamp == UNDEFINED_TIMESTAMP)
+  {
+    unfilteredTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
+  }
+
+  if (filteredTimestamp == UNDEFINED_TIMESTAMP)
+  {
+    bool filteredTimestampProbablyValid = true;
+    if (this->StreamBuffer->CreateFilteredTimeStampForItem(frameNumber, unfilteredTimestamp, filteredTimestamp, filteredTimestampProbablyValid) != PLUS_SUCCESS)
+    {
+      this->ReleaseReservation(reservation);
+      LOCAL_LOG_WARNING("Failed to create filtered timestamp for video buffer item with item index: " << frameNumber);
+      return PLUS_FAIL;
+    }
+    if (!filteredTimestampProbablyValid)
+    {
+      this->ReleaseReservation(reservation);
+      LOG_INFO("Filtered timestamp is probably invalid for video buffer item with item index=" << frameNumber << ", time=" <<
+               unfilteredTimestamp << ". The item may have been tagged with an inaccurate timestamp, therefore it will not be recorded.");
+      return PLUS_SUCCESS;
+    }
+  }
+  else
+  {
+    this->StreamBuffer->AddToTimeStampReport(frameNumber, unfilteredTimestamp, filteredTimestamp);
+  }
+
+  return this->PublishReservedItem(reservation, this->ImageType, frameNumber, unfilteredTimestamp, filteredTimestamp, customFields);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::ReleaseReservation(StreamBufferItemReservation& reservation)
+{
+  if (reservation.Owner != this)
+  {
+    if (reservation.IsReserved())
+    {
+      LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to release reserved frame - it is reserved from a different buffer");
+    }
+    return;
+  }
+
+  vtkImageData* image = reservation.Frame.GetImage();
+  if (image != NULL)
+  {
+    vtkSmartPointer<vtkDataArray> scalars = image->GetPointData()->GetScalars();
+    image->GetPointData()->SetScalars(NULL);
+    this->AddSpareFrameData(scalars);
+  }
+  reservation.Owner = NULL;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::PublishReservedItem(StreamBufferItemReservation& reservation,
+    US_IMAGE_TYPE imageType,
+    long frameNumber,
+    double unfilteredTimestamp,
+    double filteredTimestamp,
+    const igsioFieldMapType* customFields,
+    unsigned int frameSizeInBytes /*= 0*/)
+{
+  vtkImageData* reservedImage = reservation.Frame.GetImage();
+  vtkSmartPointer<vtkDataArray> reservedScalars = (reservedImage != NULL ? reservedImage->GetPointData()->GetScalars() : NULL);
+  FrameSizeType frameSize = this->GetFrameSize();
+  if (reservedScalars == NULL
+      || reservedImage->GetDimensions()[0] != static_cast<int>(frameSize[0])
+      || reservedImage->GetDimensions()[1] != static_cast<int>(frameSize[1])
+      || reservedImage->GetDimensions()[2] != static_cast<int>(frameSize[2])
+      || reservedScalars->GetDataType() != this->PixelType
+      || reservedScalars->GetNumberOfComponents() != static_cast<int>(this->NumberOfScalarComponents))
+  {
+    this->ReleaseReservation(reservation);
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to add reserved frame to video buffer - frame format of the buffer has changed since the frame was reserved");
+    return PLUS_FAIL;
+  }
+
+  // The reservation gives up its pixel array, the array that is swapped out of the slot can be reused by the next reservation
+  reservedImage->GetPointData()->SetScalars(NULL);
+  reservation.Owner = NULL;
+  vtkSmartPointer<vtkDataArray> replacedScalars;
+  PlusStatus status = PLUS_SUCCESS;
+
+  {
+    int bufferIndex(0);
+    BufferItemUidType itemUid;
+    vtkPlusBufferNewItemNotifier newItemNotifier(this);
+    igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+    if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+    {
+      // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
+      LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to video buffer!");
+      replacedScalars = reservedScalars;
+      status = PLUS_FAIL;
+    }
+    else
+    {
+      newItemNotifier.ItemAdded = true;
+
+      StreamBufferItem* newObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
+      if (newObjectInBuffer == NULL)
+      {
+        LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get pointer to video buffer object from the video buffer for the new frame!");
+        return PLUS_FAIL;
+      }
+
+      vtkImageData* slotImage = newObjectInBuffer->GetFrame().GetImage();
+      if (slotImage == NULL
+          || slotImage->GetDimensions()[0] != static_cast<int>(frameSize[0])
+          || slotImage->GetDimensions()[1] != static_cast<int>(frameSize[1])
+          || slotImage->GetDimensions()[2] != static_cast<int>(frameSize[2]))
+      {
+        // The slot has not been allocated for the current frame format yet (e.g., it stored an encoded frame)
+        if (newObjectInBuffer->GetFrame().AllocateFrame(frameSize, this->PixelType, this->NumberOfScalarComponents) != PLUS_SUCCESS)
+        {
+          LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to allocate memory for the new frame!");
+          return PLUS_FAIL;
+        }
+        slotImage = newObjectInBuffer->GetFrame().GetImage();
+      }
+
+      // Swap the pixel arrays, no pixel data is copied while the buffer is locked
+      replacedScalars = slotImage->GetPointData()->GetScalars();
+      slotImage->GetPointData()->SetScalars(reservedScalars);
+      if (replacedScalars != NULL && replacedScalars->GetReferenceCount() > 1)
+      {
+        // The replaced pixel array is still referenced by a view, the view keeps it.
+        // No new views can be created of it anymore, so it is safe to check the reference count here.
+        replacedScalars = NULL;
+        ++this->NumberOfSharedFrameReallocations;
+      }
+
+      newObjectInBuffer->SetFilteredTimestamp(filteredTimestamp);
+      newObjectInBuffer->SetUnfilteredTimestamp(unfilteredTimestamp);
+      newObjectInBuffer->SetIndex(frameNumber);
+      newObjectInBuffer->SetUid(itemUid);
+      newObjectInBuffer->GetFrame().SetImageType(imageType);
+
+      // Add custom fields
+      if (customFields != NULL)
+      {
+        for (igsioFieldMapType::const_iterator it = customFields->begin(); it != customFields->end(); ++it)
+        {
+          newObjectInBuffer->SetFrameField(it->first, it->second.second, it->second.first);
+          std::string name(it->first);
+          if (name.find("Transform") != std::string::npos)
+          {
+            newObjectInBuffer->SetValidTransformData(true);
+          }
+        }
+      }
+      if (frameSizeInBytes > 0)
+      {
+        newObjectInBuffer->SetFrameField("FrameSizeInBytes", igsioCommon::ToString<unsigned int>(frameSizeInBytes));
+      }
+    }
+  }
+
+  // The spare arrays are updated after the buffer is unlocked
+  reservedScalars = NULL;
+  this->AddSpareFrameData(replacedScalars);
+  return status;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::AddSpareFrameData(vtkSmartPointer<vtkDataArray>& scalars)
+{
+  if (scalars != NULL && scalars->GetReferenceCount() == 1)
+  {
+    std::lock_guard<std::mutex> spareFrameDataLock(this->SpareFrameDataMutex);
+    if (this->SpareFrameData.size() < MAX_NUMBER_OF_SPARE_FRAME_DATA)
+    {
+      this->SpareFrameData.push_back(scalars);
+    }
+  }
+  scalars = NULL;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusBuffer::AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus status, unsigned long frameNumber, double unfilteredTimestamp, double filteredTimestamp/*=UNDEFINED_TIMESTAMP*/, const igsioFieldMapType* customFields /*= NULL*/)
 {
@@ -661,6 +1020,7 @@ PlusStatus vtkPlusBuffer::AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus st
   int bufferIndex(0);
   BufferItemUidType itemUid;
 
+  vtkPlusBufferNewItemNotifier newItemNotifier(this);
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
   if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
@@ -668,6 +1028,7 @@ PlusStatus vtkPlusBuffer::AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus st
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to tracker buffer!");
     return PLUS_FAIL;
   }
+  newItemNotifier.ItemAdded = true;
 
   // get the pointer to the correct location in the tracker buffer, where this data needs to be copied
   StreamBufferItem* newObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
@@ -677,6 +1038,18 @@ PlusStatus vtkPlusBuffer::AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus st
     return PLUS_FAIL;
   }
 
+  if (this->TransformStorage != NULL)
+  {
+    // Only the timestamps are kept in the buffer item, everything else goes into the compact storage
+    newObjectInBuffer->SetFilteredTimestamp(filteredTimestamp);
+    newObjectInBuffer->SetUnfilteredTimestamp(unfilteredTimestamp);
+    newObjectInBuffer->SetIndex(frameNumber);
+    newObjectInBuffer->SetUid(itemUid);
+    newObjectInBuffer->SetValidTransformData(true);
+    this->TransformStorage->SetItem(itemUid, filteredTimestamp, unfilteredTimestamp, frameNumber, &matrix->Element[0][0], status, customFields);
+    return PLUS_SUCCESS;
+  }
+
   PlusStatus itemStatus = newObjectInBuffer->SetMatrix(matrix);
   newObjectInBuffer->SetStatus(status);
   newObjectInBuffer->SetFilteredTimestamp(filteredTimestamp);
@@ -787,15 +1160,89 @@ ItemStatus vtkPlusBuffer::GetStreamBufferItem(BufferItemUidType uid, StreamBuffe
     return ITEM_UNKNOWN_ERROR;
   }
 
+  if (this->TransformStorage != NULL && this->TransformStorage->GetStreamBufferItem(uid, bufferItem) != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_WARNING("Failed to copy data item from the transform storage");
+    return ITEM_UNKNOWN_ERROR;
+  }
+
+  return ITEM_OK;
+}
+
+//----------------------------------------------------------------------------
+ItemStatus vtkPlusBuffer::GetStreamBufferItemView(BufferItemUidType uid, StreamBufferItemView& view)
+{
+  view.Reset();
+
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+
+  StreamBufferItem* dataItem = NULL;
+  ItemStatus itemStatus = this->StreamBuffer->GetBufferItemPointerFromUid(uid, dataItem);
+  if (itemStatus != ITEM_OK)
+  {
+    LOCAL_LOG_WARNING("Failed to retrieve data item");
+    return itemStatus;
+  }
+
+  if (view.ViewItem(*dataItem) != PLUS_SUCCESS)
+  {
+    // Not an error, the caller may fall back to GetStreamBufferItem (e.g., for encoded frames)
+    LOCAL_LOG_DEBUG("Unable to create view of data item " << uid);
+    return ITEM_UNKNOWN_ERROR;
+  }
+
   return ITEM_OK;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::GetStreamBufferItemSnapshot(std::vector<StreamBufferItem>& items)
+{
+  // Items are not copied when the vector is resized from empty
+  items.clear();
+
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+
+  if (this->StreamBuffer->GetNumberOfItems() == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  BufferItemUidType oldestUid = this->StreamBuffer->GetOldestItemUidInBuffer();
+  BufferItemUidType latestUid = this->StreamBuffer->GetLatestItemUidInBuffer();
+  items.resize(static_cast<size_t>(latestUid - oldestUid + 1));
+  for (BufferItemUidType uid = oldestUid; uid <= latestUid; ++uid)
+  {
+    StreamBufferItem& item = items[static_cast<size_t>(uid - oldestUid)];
+    StreamBufferItem* dataItem = NULL;
+    if (this->StreamBuffer->GetBufferItemPointerFromUid(uid, dataItem) != ITEM_OK || item.ShallowCopy(dataItem) != PLUS_SUCCESS)
+    {
+      LOCAL_LOG_ERROR("Unable to get snapshot of data item " << uid);
+      items.clear();
+      return PLUS_FAIL;
+    }
+    if (this->TransformStorage != NULL && this->TransformStorage->GetStreamBufferItem(uid, &item) != PLUS_SUCCESS)
+    {
+      LOCAL_LOG_ERROR("Unable to get snapshot of data item " << uid << " from the transform storage");
+      items.clear();
+      return PLUS_FAIL;
+    }
+  }
+
+  return PLUS_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusBuffer::DeepCopy(vtkPlusBuffer* buffer)
 {
   LOG_TRACE("vtkPlusBuffer::DeepCopy");
 
+  this->SetLockFreeRead(buffer->GetLockFreeRead());
+  this->SetCompactTransformStorage(buffer->GetCompactTransformStorage());
   this->StreamBuffer->DeepCopy(buffer->StreamBuffer);
+  if (this->TransformStorage != NULL)
+  {
+    this->TransformStorage->DeepCopy(*buffer->TransformStorage);
+  }
   if (buffer->GetFrameSize()[0] != -1 && buffer->GetFrameSize()[1] != -1 && buffer->GetFrameSize()[2] != -1)
   {
     this->SetFrameSize(buffer->GetFrameSize());
@@ -811,6 +1258,154 @@ void vtkPlusBuffer::DeepCopy(vtkPlusBuffer* buffer)
 void vtkPlusBuffer::Clear()
 {
   this->StreamBuffer->Clear();
+  if (this->TransformStorage != NULL)
+  {
+    igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+    this->TransformStorage->Clear();
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::SetLockFreeRead(bool enable)
+{
+  if (enable == this->GetLockFreeRead())
+  {
+    return PLUS_SUCCESS;
+  }
+
+  StreamItemCircularBuffer* newStreamBuffer = NULL;
+  if (enable)
+  {
+    newStreamBuffer = vtkPlusLockFreeTimestampedCircularBuffer::New();
+  }
+  else
+  {
+    newStreamBuffer = vtkPlusTimestampedCircularBuffer::New();
+  }
+
+  // Keep the content and settings of the current buffer
+  newStreamBuffer->DeepCopy(this->StreamBuffer);
+  newStreamBuffer->SetTimeStampReporting(this->StreamBuffer->GetTimeStampReporting());
+  newStreamBuffer->SetTimeStampLogging(this->StreamBuffer->GetTimeStampLogging());
+
+  this->StreamBuffer->Delete();
+  this->StreamBuffer = newStreamBuffer;
+
+  LOCAL_LOG_DEBUG("Lock-free buffer read " << (enable ? "enabled" : "disabled"));
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusBuffer::GetLockFreeRead()
+{
+  return vtkPlusLockFreeTimestampedCircularBuffer::SafeDownCast(this->StreamBuffer) != NULL;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::SetCompactTransformStorage(bool enable)
+{
+  if (enable == this->GetCompactTransformStorage())
+  {
+    return PLUS_SUCCESS;
+  }
+
+  {
+    igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+    if (enable)
+    {
+      // Move the items that are already in the buffer into the compact storage
+      this->TransformStorage = new PlusTransformBufferStorage;
+      this->TransformStorage->SetCapacity(this->StreamBuffer->GetBufferSize());
+      for (int i = 0; i < this->StreamBuffer->GetBufferSize(); ++i)
+      {
+        StreamBufferItem* item = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(i);
+        if (item->GetUid() != 0)
+        {
+          vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+          item->GetMatrix(matrix);
+          igsioFieldMapType fields = item->GetFrameFieldMap();
+          this->TransformStorage->SetItem(item->GetUid(), item->GetFilteredTimestamp(0), item->GetUnfilteredTimestamp(0), item->GetIndex(),
+                                          item->HasValidTransformData() ? &matrix->Element[0][0] : NULL, item->GetStatus(), &fields);
+        }
+        // Keep only the members that the timestamped buffer uses, release the frame, matrix and fields
+        StreamBufferItem compactItem;
+        compactItem.SetFilteredTimestamp(item->GetFilteredTimestamp(0));
+        compactItem.SetUnfilteredTimestamp(item->GetUnfilteredTimestamp(0));
+        compactItem.SetIndex(item->GetIndex());
+        compactItem.SetUid(item->GetUid());
+        compactItem.SetValidTransformData(item->HasValidTransformData());
+        *item = compactItem;
+      }
+    }
+    else
+    {
+      // Move the items back into the buffer items
+      for (int i = 0; i < this->StreamBuffer->GetBufferSize(); ++i)
+      {
+        StreamBufferItem* item = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(i);
+        if (this->TransformStorage->HasItem(item->GetUid()))
+        {
+          this->TransformStorage->GetStreamBufferItem(item->GetUid(), item);
+        }
+      }
+      delete this->TransformStorage;
+      this->TransformStorage = NULL;
+    }
+  }
+
+  LOCAL_LOG_DEBUG("Compact transform storage " << (enable ? "enabled" : "disabled"));
+  return enable ? PLUS_SUCCESS : this->AllocateMemoryForFrames();
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusBuffer::GetCompactTransformStorage()
+{
+  return this->TransformStorage != NULL;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusBuffer::GetNumberOfAddedItems() const
+{
+  return this->NumberOfAddedItems;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::AddNewItemSignal(std::shared_ptr<PlusNewItemSignal> signal)
+{
+  if (!signal)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(this->NewItemSignalsMutex);
+  if (std::find(this->NewItemSignals.begin(), this->NewItemSignals.end(), signal) == this->NewItemSignals.end())
+  {
+    this->NewItemSignals.push_back(signal);
+  }
+  this->HasNewItemSignals = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::RemoveNewItemSignal(std::shared_ptr<PlusNewItemSignal> signal)
+{
+  std::lock_guard<std::mutex> lock(this->NewItemSignalsMutex);
+  this->NewItemSignals.erase(std::remove(this->NewItemSignals.begin(), this->NewItemSignals.end(), signal), this->NewItemSignals.end());
+  this->HasNewItemSignals = !this->NewItemSignals.empty();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::NotifyNewItem()
+{
+  // The counter is incremented before the signals are notified, so that the waiting threads cannot miss the new item
+  this->NumberOfAddedItems++;
+  if (!this->HasNewItemSignals)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(this->NewItemSignalsMutex);
+  for (std::vector< std::shared_ptr<PlusNewItemSignal> >::iterator it = this->NewItemSignals.begin(); it != this->NewItemSignals.end(); ++it)
+  {
+    (*it)->Notify();
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -1078,60 +1673,17 @@ PlusStatus vtkPlusBuffer::WriteToSequenceFile(const char* filename, bool useComp
 {
   LOG_TRACE("vtkPlusBuffer::WriteToSequenceFile");
 
-  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-
-  PlusStatus status = PLUS_SUCCESS;
-
-  for (BufferItemUidType frameUid = this->GetOldestItemUidInBuffer(); frameUid <= this->GetLatestItemUidInBuffer(); ++frameUid)
+  // Pixel data is shared with the buffer instead of copied, so the memory usage is not doubled while the file is written
+  PlusBufferSnapshotWriter snapshot;
+  if (snapshot.TakeVideoSnapshot(this) != PLUS_SUCCESS)
   {
-    StreamBufferItem bufferItem;
-    if (this->GetStreamBufferItem(frameUid, &bufferItem) != ITEM_OK)
-    {
-      LOCAL_LOG_ERROR("Unable to get frame from buffer with UID: " << frameUid);
-      status = PLUS_FAIL;
-      continue;
-    }
-
-    igsioTrackedFrame* trackedFrame = new igsioTrackedFrame;
-
-    // Add image data
-    trackedFrame->SetImageData(bufferItem.GetFrame());
-
-    // Add tracking data
-    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
-    bufferItem.GetMatrix(matrix);
-    trackedFrame->SetFrameTransform(igsioTransformName("Tool", "Tracker"), matrix);
-    trackedFrame->SetFrameTransformStatus(igsioTransformName("Tool", "Tracker"), bufferItem.GetStatus());
-
-    // Add filtered timestamp
-    double filteredTimestamp = bufferItem.GetFilteredTimestamp(this->GetLocalTimeOffsetSec());
-    std::ostringstream timestampFieldValue;
-    timestampFieldValue << std::fixed << filteredTimestamp;
-    trackedFrame->SetFrameField("Timestamp", timestampFieldValue.str());
-
-    // Add unfiltered timestamp
-    double unfilteredTimestamp = bufferItem.GetUnfilteredTimestamp(this->GetLocalTimeOffsetSec());
-    std::ostringstream unfilteredtimestampFieldValue;
-    unfilteredtimestampFieldValue << std::fixed << unfilteredTimestamp;
-    trackedFrame->SetFrameField("UnfilteredTimestamp", unfilteredtimestampFieldValue.str());
-
-    // Add frame number
-    unsigned long frameNumber = bufferItem.GetIndex();
-    std::ostringstream frameNumberFieldValue;
-    frameNumberFieldValue << std::fixed << frameNumber;
-    trackedFrame->SetFrameField("FrameNumber", frameNumberFieldValue.str());
-
-    // Add custom fields
-    const igsioFieldMapType& customFields = bufferItem.GetFrameFieldMap();
-    for (igsioFieldMapType::const_iterator cf = customFields.begin(); cf != customFields.end(); ++cf)
-    {
-      trackedFrame->SetFrameField(cf->first, cf->second.second, cf->second.first);
-    }
-
-    // Add tracked frame to the list
-    trackedFrameList->TakeTrackedFrame(trackedFrame);
+    LOCAL_LOG_ERROR("Unable to get frames from buffer");
+    return PLUS_FAIL;
   }
 
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  PlusStatus status = snapshot.GetTrackedFrameList(trackedFrameList);
+
   // Save tracked frames to metafile
   if (vtkPlusSequenceIO::Write(filename, trackedFrameList, trackedFrameList->GetImageOrientation(), useCompression) != PLUS_SUCCESS)
   {
@@ -1155,9 +1707,9 @@ bool vtkPlusBuffer::GetTimeStampReporting()
 }
 
 //----------------------------------------------------------------------------
-// Returns the two buffer items that are closest previous and next buffer items relative to the specified time.
+// Returns the UIDs of the two buffer items that are closest previous and next buffer items relative to the specified time.
 // itemA is the closest item
-PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBufferItem& itemA, StreamBufferItem& itemB)
+PlusStatus vtkPlusBuffer::GetPrevNextBufferItemUidFromTime(double time, BufferItemUidType& itemAuid, BufferItemUidType& itemBuid)
 {
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
 
@@ -1169,7 +1721,8 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
   //   - time difference between the requested time and itemB is below a threshold
 
   // itemA is the item that is the closest to the requested time, get its UID and time
-  BufferItemUidType itemAuid(0);
+  itemAuid = 0;
+  itemBuid = 0;
   ItemStatus status = this->StreamBuffer->GetItemUidFromTime(time, itemAuid);
   if (status != ITEM_OK)
   {
@@ -1186,7 +1739,8 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
     }
     return PLUS_FAIL;
   }
-  status = this->GetStreamBufferItem(itemAuid, &itemA);
+  ToolStatus itemAstatus(TOOL_OK);
+  status = this->GetItemToolStatus(itemAuid, itemAstatus);
   if (status != ITEM_OK)
   {
     LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemAuid);
@@ -1194,7 +1748,7 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
   }
 
   // If tracker is out of view, etc. then we don't have a valid before and after the requested time, so we cannot do interpolation
-  if (itemA.GetStatus() != TOOL_OK)
+  if (itemAstatus != TOOL_OK)
   {
     // tracker is out of view, ...
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Cannot do data interpolation. The closest item to the requested time (time: " << std::fixed << time << ", uid: " << itemAuid << ") is invalid.");
@@ -1213,7 +1767,7 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
   if (fabs(itemAtime - time) < NEGLIGIBLE_TIME_DIFFERENCE)
   {
     //No need for interpolation, it's very close to the closest element
-    itemB.DeepCopy(&itemA);
+    itemBuid = itemAuid;
     return PLUS_SUCCESS;
   }
 
@@ -1225,7 +1779,6 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
   }
 
   // Find the closest item on the other side of the timescale (so that time is between itemAtime and itemBtime)
-  BufferItemUidType itemBuid(0);
   if (time < itemAtime)
   {
     // itemBtime < time <itemAtime
@@ -1257,14 +1810,15 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
     return PLUS_FAIL;
   }
   // Get the item
-  status = this->GetStreamBufferItem(itemBuid, &itemB);
+  ToolStatus itemBstatus(TOOL_OK);
+  status = this->GetItemToolStatus(itemBuid, itemBstatus);
   if (status != ITEM_OK)
   {
     LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemBuid);
     return PLUS_FAIL;
   }
   // If there is no valid element on the other side of the requested time, then we cannot do an interpolation
-  if (itemB.GetStatus() != TOOL_OK)
+  if (itemBstatus != TOOL_OK)
   {
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Cannot get a second element (uid=" << itemBuid << ") on the other side of the requested time (" << std::fixed << time << ")");
     return PLUS_FAIL;
@@ -1273,6 +1827,80 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+// Returns the two buffer items that are closest previous and next buffer items relative to the specified time.
+// itemA is the closest item
+PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBufferItem& itemA, StreamBufferItem& itemB)
+{
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+
+  BufferItemUidType itemAuid(0);
+  BufferItemUidType itemBuid(0);
+  if (this->GetPrevNextBufferItemUidFromTime(time, itemAuid, itemBuid) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  if (this->GetStreamBufferItem(itemAuid, &itemA) != ITEM_OK)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemAuid);
+    return PLUS_FAIL;
+  }
+  if (itemBuid == itemAuid)
+  {
+    itemB.DeepCopy(&itemA);
+    return PLUS_SUCCESS;
+  }
+  if (this->GetStreamBufferItem(itemBuid, &itemB) != ITEM_OK)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemBuid);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+ItemStatus vtkPlusBuffer::GetItemToolStatus(BufferItemUidType uid, ToolStatus& status)
+{
+  StreamBufferItem* item = NULL;
+  ItemStatus itemStatus = this->StreamBuffer->GetBufferItemPointerFromUid(uid, item);
+  if (itemStatus != ITEM_OK)
+  {
+    return itemStatus;
+  }
+  if (this->TransformStorage != NULL)
+  {
+    if (!this->TransformStorage->HasItem(uid))
+    {
+      return ITEM_UNKNOWN_ERROR;
+    }
+    status = this->TransformStorage->GetStatus(uid);
+    return ITEM_OK;
+  }
+  status = item->GetStatus();
+  return ITEM_OK;
+}
+
+//----------------------------------------------------------------------------
+ItemStatus vtkPlusBuffer::GetItemMatrix(BufferItemUidType uid, vtkMatrix4x4* matrix)
+{
+  StreamBufferItem* item = NULL;
+  ItemStatus itemStatus = this->StreamBuffer->GetBufferItemPointerFromUid(uid, item);
+  if (itemStatus != ITEM_OK)
+  {
+    return itemStatus;
+  }
+  if (this->TransformStorage != NULL)
+  {
+    if (!this->TransformStorage->HasItem(uid))
+    {
+      return ITEM_UNKNOWN_ERROR;
+    }
+    matrix->DeepCopy(this->TransformStorage->GetMatrixElements(uid));
+    return ITEM_OK;
+  }
+  return (item->GetMatrix(matrix) == PLUS_SUCCESS ? ITEM_OK : ITEM_UNKNOWN_ERROR);
+}
+
 //----------------------------------------------------------------------------
 ItemStatus vtkPlusBuffer::GetStreamBufferItemFromTime(double time, StreamBufferItem* bufferItem, DataItemTemporalInterpolationType interpolation)
 {
@@ -1293,8 +1921,14 @@ ItemStatus vtkPlusBuffer::GetStreamBufferItemFromTime(double time, StreamBufferI
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusBuffer::ModifyBufferItemFrameField(BufferItemUidType uid, const std::string& key, const std::string& value)
 {
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+
   StreamBufferItem* item;
   auto itemStatus = this->StreamBuffer->GetBufferItemPointerFromUid(uid, item);
+  if (itemStatus == ITEM_OK && this->TransformStorage != NULL)
+  {
+    return this->TransformStorage->SetFrameField(uid, key, value);
+  }
   if (itemStatus == ITEM_OK)
   {
     item->SetFrameField(key, value);
@@ -1364,10 +1998,13 @@ ItemStatus vtkPlusBuffer::GetStreamBufferItemFromClosestTime(double time, Stream
 // The flags correspond to the closest element.
 ItemStatus vtkPlusBuffer::GetInterpolatedStreamBufferItemFromTime(double time, StreamBufferItem* bufferItem)
 {
-  StreamBufferItem itemA;
-  StreamBufferItem itemB;
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
 
-  if (GetPrevNextBufferItemFromTime(time, itemA, itemB) != PLUS_SUCCESS)
+  // Only the UIDs of the neighbors are looked up, their matrices are read directly from the buffer
+  // (the items are not copied)
+  BufferItemUidType itemAuid(0);
+  BufferItemUidType itemBuid(0);
+  if (GetPrevNextBufferItemUidFromTime(time, itemAuid, itemBuid) != PLUS_SUCCESS)
   {
     // cannot get two neighbors, so cannot do interpolation
     // it may be normal (e.g., when tracker out of view), so don't return with an error
@@ -1384,33 +2021,41 @@ ItemStatus vtkPlusBuffer::GetInterpolatedStreamBufferItemFromTime(double time, S
     return ITEM_OK;
   }
 
-  if (itemA.GetUid() == itemB.GetUid())
+  if (itemAuid == itemBuid)
   {
     // exact match, no need for interpolation
-    bufferItem->DeepCopy(&itemA);
+    if (this->GetStreamBufferItem(itemAuid, bufferItem) != ITEM_OK)
+    {
+      LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemAuid);
+      return ITEM_UNKNOWN_ERROR;
+    }
     return ITEM_OK;
   }
 
   //============== Get item weights ==================
 
   double itemAtime(0);
-  if (this->StreamBuffer->GetTimeStamp(itemA.GetUid(), itemAtime) != ITEM_OK)
+  if (this->StreamBuffer->GetTimeStamp(itemAuid, itemAtime) != ITEM_OK)
   {
-    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer timestamp (time: " << std::fixed << time << ", uid: " << itemA.GetUid() << ")");
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer timestamp (time: " << std::fixed << time << ", uid: " << itemAuid << ")");
     return ITEM_UNKNOWN_ERROR;
   }
 
   double itemBtime(0);
-  if (this->StreamBuffer->GetTimeStamp(itemB.GetUid(), itemBtime) != ITEM_OK)
+  if (this->StreamBuffer->GetTimeStamp(itemBuid, itemBtime) != ITEM_OK)
   {
-    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer timestamp (time: " << std::fixed << time << ", uid: " << itemB.GetUid() << ")");
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer timestamp (time: " << std::fixed << time << ", uid: " << itemBuid << ")");
     return ITEM_UNKNOWN_ERROR;
   }
 
   if (fabs(itemAtime - itemBtime) < NEGLIGIBLE_TIME_DIFFERENCE)
   {
     // exact time match, no need for interpolation
-    bufferItem->DeepCopy(&itemA);
+    if (this->GetStreamBufferItem(itemAuid, bufferItem) != ITEM_OK)
+    {
+      LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemAuid);
+      return ITEM_UNKNOWN_ERROR;
+    }
     bufferItem->SetFilteredTimestamp(time);
     bufferItem->SetUnfilteredTimestamp(time);
     return ITEM_OK;
@@ -1422,7 +2067,7 @@ ItemStatus vtkPlusBuffer::GetInterpolatedStreamBufferItemFromTime(double time, S
   //============== Get transform matrices ==================
 
   vtkSmartPointer<vtkMatrix4x4> itemAmatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  if (itemA.GetMatrix(itemAmatrix) != PLUS_SUCCESS)
+  if (this->GetItemMatrix(itemAuid, itemAmatrix) != ITEM_OK)
   {
     LOCAL_LOG_ERROR("Failed to get item A matrix");
     return ITEM_UNKNOWN_ERROR;
@@ -1438,7 +2083,7 @@ ItemStatus vtkPlusBuffer::GetInterpolatedStreamBufferItemFromTime(double time, S
   }
 
   vtkSmartPointer<vtkMatrix4x4> itemBmatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  if (itemB.GetMatrix(itemBmatrix) != PLUS_SUCCESS)
+  if (this->GetItemMatrix(itemBuid, itemBmatrix) != ITEM_OK)
   {
     LOCAL_LOG_ERROR("Failed to get item B matrix");
     return ITEM_UNKNOWN_ERROR;
@@ -1475,13 +2120,24 @@ ItemStatus vtkPlusBuffer::GetInterpolatedStreamBufferItemFromTime(double time, S
 
   //============== Interpolate time ==================
 
-  double itemAunfilteredTimestamp = itemA.GetUnfilteredTimestamp(0.0);   // 0.0 because timestamps in the buffer are in local time
-  double itemBunfilteredTimestamp = itemB.GetUnfilteredTimestamp(0.0);   // 0.0 because timestamps in the buffer are in local time
+  StreamBufferItem* itemA = NULL;
+  StreamBufferItem* itemB = NULL;
+  if (this->StreamBuffer->GetBufferItemPointerFromUid(itemAuid, itemA) != ITEM_OK || this->StreamBuffer->GetBufferItemPointerFromUid(itemBuid, itemB) != ITEM_OK)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer items (uid: " << itemAuid << ", " << itemBuid << ")");
+    return ITEM_UNKNOWN_ERROR;
+  }
+  double itemAunfilteredTimestamp = itemA->GetUnfilteredTimestamp(0.0);   // 0.0 because timestamps in the buffer are in local time
+  double itemBunfilteredTimestamp = itemB->GetUnfilteredTimestamp(0.0);   // 0.0 because timestamps in the buffer are in local time
   double interpolatedUnfilteredTimestamp = itemAunfilteredTimestamp * itemAweight + itemBunfilteredTimestamp * itemBweight;
 
   //============== Write interpolated results into the bufferItem ==================
 
-  bufferItem->DeepCopy(&itemA);
+  if (this->GetStreamBufferItem(itemAuid, bufferItem) != ITEM_OK)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get data buffer item with Uid: " << itemAuid);
+    return ITEM_UNKNOWN_ERROR;
+  }
   bufferItem->SetMatrix(interpolatedMatrix);
   bufferItem->SetFilteredTimestamp(time - this->StreamBuffer->GetLocalTimeOffsetSec());   // global = local + offset => local = global - offset
   bufferItem->SetUnfilteredTimestamp(interpolatedUnfilteredTimestamp);
@@ -1662,6 +2318,12 @@ bool vtkPlusBuffer::GetLatestItemHasValidTransformData()
 //----------------------------------------------------------------------------
 bool vtkPlusBuffer::GetLatestItemHasValidFieldData()
 {
+  if (this->TransformStorage != NULL)
+  {
+    igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+    BufferItemUidType latestUid = this->StreamBuffer->GetLatestItemUidInBuffer();
+    return this->StreamBuffer->GetNumberOfItems() > 0 && this->TransformStorage->HasItem(latestUid) && this->TransformStorage->HasFrameFields(latestUid);
+  }
   return this->StreamBuffer->GetLatestItemHasValidFieldData();
 }
 
@@ -25,7 +25,17 @@ See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
 
 // VTK includes
 #include <vtkObject.h>
+#include <vtkSmartPointer.h>
 
+// STL includes
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class PlusNewItemSignal;
+class PlusTransformBufferStorage;
+class vtkDataArray;
 class vtkPlusDevice;
 enum ToolStatus;
 
@@ -151,6 +161,43 @@ public:
   */
   PlusStatus AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus status, unsigned long frameNumber, double unfilteredTimestamp, double filteredTimestamp = UNDEFINED_TIMESTAMP, const igsioFieldMapType* customFields = NULL);
 
+  /*!
+    Reserve a frame for a new item, in the frame size, pixel type and number of components of the buffer.
+    The frame can be written without locking the buffer (e.g., a compressed frame can be decoded directly into it,
+    or WriteReservedItem can be used to convert it), then it can be added to the buffer by CommitReservedItem.
+    See StreamBufferItemReservation.
+  */
+  virtual PlusStatus ReserveItem(StreamBufferItemReservation& reservation);
+
+  /*!
+    Write a frame into the reserved frame, with the same orientation conversion and clipping as AddItem.
+    The buffer is not locked during the conversion.
+  */
+  virtual PlusStatus WriteReservedItem(StreamBufferItemReservation& reservation,
+                                       void* imageDataPtr,
+                                       US_IMAGE_ORIENTATION usImageOrientation,
+                                       const FrameSizeType& inputFrameSizeInPx,
+                                       igsioCommon::VTKScalarPixelType pixelType,
+                                       unsigned int numberOfScalarComponents,
+                                       US_IMAGE_TYPE imageType,
+                                       int numberOfBytesToSkip,
+                                       const std::array<int, 3>& clipRectangleOrigin,
+                                       const std::array<int, 3>& clipRectangleSize);
+
+  /*!
+    Add the reserved frame to the buffer as a new item. The pixel data is not copied, the pixel array of the reservation
+    is swapped into the next buffer slot, therefore the buffer is locked only for a short time.
+    Timestamps are handled the same way as in AddItem. The reservation is released, even if the item is not added.
+  */
+  virtual PlusStatus CommitReservedItem(StreamBufferItemReservation& reservation,
+                                        long frameNumber,
+                                        double unfilteredTimestamp = UNDEFINED_TIMESTAMP,
+                                        double filteredTimestamp = UNDEFINED_TIMESTAMP,
+                                        const igsioFieldMapType* customFields = NULL);
+
+  /*! Release the reserved frame without adding it to the buffer. The pixel array is kept for later reservations. */
+  virtual void ReleaseReservation(StreamBufferItemReservation& reservation);
+
   /*! Get a frame with the specified frame uid from the buffer */
   virtual ItemStatus GetStreamBufferItem(BufferItemUidType uid, StreamBufferItem* bufferItem);
   /*! Get the most recent frame from the buffer */
@@ -165,6 +212,24 @@ public:
   };
   /*! Get a frame that was acquired at the specified time from buffer */
   virtual ItemStatus GetStreamBufferItemFromTime(double time, StreamBufferItem* bufferItem, DataItemTemporalInterpolationType interpolation);
+
+  /*!
+    Get a read-only view of the frame with the specified frame uid. The pixel data is not copied, the view shares it with the buffer.
+    The buffer never overwrites pixel data that is still referenced by a view (a new pixel array is allocated for the slot instead),
+    therefore the view remains valid after the item is removed from the buffer.
+  */
+  virtual ItemStatus GetStreamBufferItemView(BufferItemUidType uid, StreamBufferItemView& view);
+
+  /*!
+    Get all the items that are in the buffer. The items are copied while the buffer is locked, so the snapshot is consistent.
+    The pixel data is shared with the buffer slots instead of copied (see StreamBufferItem::ShallowCopy), therefore
+    taking a snapshot is fast and new pixel arrays are only allocated for the slots that the buffer reuses while the snapshot is kept.
+  */
+  virtual PlusStatus GetStreamBufferItemSnapshot(std::vector<StreamBufferItem>& items);
+
+  /*! Get the number of times a new pixel array had to be allocated because the slot was still referenced by a view */
+  vtkGetMacro(NumberOfSharedFrameReallocations, unsigned long);
+
   virtual PlusStatus ModifyBufferItemFrameField(BufferItemUidType uid, const std::string& key, const std::string& value);
 
   /*! Get latest timestamp in the buffer */
@@ -253,6 +318,24 @@ public:
   /*! Clear buffer (set the buffer pointer to the first element) */
   virtual void Clear();
 
+  /*!
+    If enabled then item UIDs and timestamps can be read from the buffer without locking it
+    (see vtkPlusLockFreeTimestampedCircularBuffer). Items that are already in the buffer are kept.
+    It should be set during configuration, before data acquisition is started.
+  */
+  virtual PlusStatus SetLockFreeRead(bool enable);
+  virtual bool GetLockFreeRead();
+
+  /*!
+    If enabled then the transforms, tool statuses and custom fields of the items are stored in compact arrays
+    (see PlusTransformBufferStorage) instead of separate matrix and field map objects in each buffer item.
+    The buffer items then only hold the uid, index and timestamps that are needed for time lookups. It reduces the
+    memory footprint and improves the cache locality of tracker buffers. Disabled by default.
+    Video frames cannot be added to the buffer while it is enabled. Items that are already in the buffer are kept.
+  */
+  virtual PlusStatus SetCompactTransformStorage(bool enable);
+  virtual bool GetCompactTransformStorage();
+
   /*! Set number of items used for timestamp filtering (with LSQR mimimizer) */
   virtual void SetAveragedItemsForFiltering(int averagedItemsForFiltering);
 
@@ -311,13 +394,33 @@ public:
   /*! Copy images from a tracked frame buffer. It is useful when data is stored in a metafile and the data is needed as a vtkPlusDataBuffer. */
   PlusStatus CopyImagesFromTrackedFrameList(vtkIGSIOTrackedFrameList* sourceTrackedFrameList, TIMESTAMP_FILTERING_OPTION timestampFiltering, bool copyFrameFields);
 
-  /*! Dump the current state of the video buffer to metafile */
+  /*!
+    Dump the current state of the video buffer to metafile.
+    Use PlusBufferSnapshotWriter to write the buffer on a background thread.
+  */
   virtual PlusStatus WriteToSequenceFile(const char* filename, bool useCompression = false);
 
   vtkGetStringMacro(DescriptiveName);
   vtkSetStringMacro(DescriptiveName);
 
+  /*! Number of items that have been added to the buffer since it was created. It is not reset when the buffer is cleared. */
+  unsigned long long GetNumberOfAddedItems() const;
+
+  /*!
+    Register a signal that is notified each time an item is added to this buffer (after GetNumberOfAddedItems is incremented
+    and the buffer is unlocked). It can be used for waking up a thread as soon as new data is available instead of polling the buffers.
+    Registering the same signal again has no effect.
+  */
+  void AddNewItemSignal(std::shared_ptr<PlusNewItemSignal> signal);
+  /*! Unregister a signal that was registered by AddNewItemSignal */
+  void RemoveNewItemSignal(std::shared_ptr<PlusNewItemSignal> signal);
+
 protected:
+  friend class vtkPlusBufferNewItemNotifier;
+
+  /*! Increment the number of added items and notify the registered signals. The buffer must not be locked. */
+  void NotifyNewItem();
+
   vtkPlusBuffer();
   ~vtkPlusBuffer();
 
@@ -333,6 +436,15 @@ protected:
   /*! Returns the two buffer items that are closest previous and next buffer items relative to the specified time. itemA is the closest item */
   PlusStatus GetPrevNextBufferItemFromTime(double time, StreamBufferItem& itemA, StreamBufferItem& itemB);
 
+  /*! Returns the UIDs of the two buffer items that are closest previous and next buffer items relative to the specified time. itemA is the closest item */
+  PlusStatus GetPrevNextBufferItemUidFromTime(double time, BufferItemUidType& itemAuid, BufferItemUidType& itemBuid);
+
+  /*! Get the tool status of an item without copying the item. Buffer must be locked. */
+  ItemStatus GetItemToolStatus(BufferItemUidType uid, ToolStatus& status);
+
+  /*! Get the transform matrix of an item without copying the item. Buffer must be locked. */
+  ItemStatus GetItemMatrix(BufferItemUidType uid, vtkMatrix4x4* matrix);
+
   /*!
   Interpolate the matrix for the given timestamp from the two nearest transforms in the buffer.
   The rotation is interpolated with SLERP interpolation, and the position is interpolated with linear interpolation.
@@ -346,6 +458,34 @@ protected:
   /*! Get tracker buffer item from the closest timestamp */
   virtual ItemStatus GetStreamBufferItemFromClosestTime(double time, StreamBufferItem* bufferItem);
 
+  /*!
+    Get the flip and transpose that converts an input frame to the buffer orientation and check that the converted
+    (and clipped) frame matches the frame format of the buffer.
+  */
+  PlusStatus GetFrameConversion(US_IMAGE_ORIENTATION usImageOrientation,
+                                const FrameSizeType& inputFrameSizeInPx,
+                                igsioCommon::VTKScalarPixelType pixelType,
+                                unsigned int numberOfScalarComponents,
+                                US_IMAGE_TYPE imageType,
+                                const std::array<int, 3>& clipRectangleOrigin,
+                                const std::array<int, 3>& clipRectangleSize,
+                                igsioVideoFrame::FlipInfoType& flipInfo);
+
+  /*!
+    Swap the pixel array of the reservation into the next buffer slot and set the item properties (timestamps must be already computed).
+    If frameSizeInBytes is not 0 then it is stored in the FrameSizeInBytes field of the item.
+  */
+  PlusStatus PublishReservedItem(StreamBufferItemReservation& reservation,
+                                 US_IMAGE_TYPE imageType,
+                                 long frameNumber,
+                                 double unfilteredTimestamp,
+                                 double filteredTimestamp,
+                                 const igsioFieldMapType* customFields,
+                                 unsigned int frameSizeInBytes = 0);
+
+  /*! Keep a pixel array for later reservations if it is not referenced from anywhere else. The reference of the caller is released. */
+  void AddSpareFrameData(vtkSmartPointer<vtkDataArray>& scalars);
+
 protected:
   /*! Image frame size in pixel */
   FrameSizeType FrameSize;
@@ -371,6 +511,27 @@ protected:
 
   char* DescriptiveName;
 
+  /*! Number of pixel arrays that were reallocated because they were still referenced by a view */
+  unsigned long NumberOfSharedFrameReallocations;
+
+  /*! Storage of transforms, statuses and custom fields if compact transform storage is enabled, NULL otherwise */
+  PlusTransformBufferStorage* TransformStorage;
+
+  /*! Incremented after a new item is added to the buffer and the buffer is unlocked */
+  std::atomic<unsigned long long> NumberOfAddedItems;
+
+  /*! Signals that are notified when an item is added to the buffer */
+  std::vector< std::shared_ptr<PlusNewItemSignal> > NewItemSignals;
+  /*! Protects NewItemSignals. Only the producer of this buffer and the registering threads use it. */
+  std::mutex NewItemSignalsMutex;
+  /*! True if NewItemSignals is not empty, it allows skipping the lock if no thread waits for the items of the buffer */
+  std::atomic<bool> HasNewItemSignals;
+
+  /*! Pixel arrays that were swapped out of the buffer slots or released, reused by ReserveItem */
+  std::vector< vtkSmartPointer<vtkDataArray> > SpareFrameData;
+  /*! Protects SpareFrameData. The buffer must not be locked while this mutex is held. */
+  std::mutex SpareFrameDataMutex;
+
 private:
   vtkPlusBuffer(const vtkPlusBuffer&);
   void operator=(const vtkPlusBuffer&);
@@ -6,6 +6,7 @@ See License.txt for details.
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PlusNewItemSignal.h"
 #ifdef PLUS_RENDERING_ENABLED
 #include "PlusPlotter.h"
 #endif
@@ -39,6 +40,8 @@ vtkPlusChannel::vtkPlusChannel(void)
   , RfProcessor(NULL)
   , BlankImage(vtkImageData::New())
   , SaveRfProcessingParameters(false)
+  , ShareVideoFrameData(false)
+  , NewDataSignal(std::make_shared<PlusNewItemSignal>())
 {
   // Default size for brightness frame
   this->BrightnessFrameSize[0] = 640;
@@ -140,6 +143,8 @@ PlusStatus vtkPlusChannel::ReadConfiguration(vtkXMLDataElement* aChannelElement,
     return PLUS_FAIL;
   }
 
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(ShareVideoFrameData, aChannelElement);
+
   vtkXMLDataElement* rfElement = aChannelElement->FindNestedElementWithName(vtkPlusRfProcessor::GetRfProcessorTagName());
   if (rfElement != NULL)
   {
@@ -231,6 +236,11 @@ PlusStatus vtkPlusChannel::WriteConfiguration(vtkXMLDataElement* aChannelElement
     this->RfProcessor->WriteConfiguration(rfElement);
   }
 
+  if (this->ShareVideoFrameData)
+  {
+    XML_WRITE_BOOL_ATTRIBUTE(ShareVideoFrameData, aChannelElement);
+  }
+
   return PLUS_SUCCESS;
 }
 
@@ -477,6 +487,83 @@ PlusStatus vtkPlusChannel::GetLatestTimestamp(double& aTimestamp) const
 }
 
 
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusChannel::GetNumberOfAddedItems() const
+{
+  if (this->HasVideoSource())
+  {
+    // Tracked frames are generated at the timestamps of the video frames
+    return this->VideoSource->GetBuffer()->GetNumberOfAddedItems();
+  }
+
+  unsigned long long numberOfAddedItems = 0;
+  for (DataSourceContainerConstIterator it = this->GetToolsStartConstIterator(); it != this->GetToolsEndConstIterator(); ++it)
+  {
+    numberOfAddedItems += it->second->GetBuffer()->GetNumberOfAddedItems();
+  }
+  for (DataSourceContainerConstIterator it = this->GetFieldDataSourcesStartConstIterator(); it != this->GetFieldDataSourcesEndConstIterator(); ++it)
+  {
+    numberOfAddedItems += it->second->GetBuffer()->GetNumberOfAddedItems();
+  }
+  return numberOfAddedItems;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusChannel::WaitForNewData(double timeoutSec, unsigned long long& numberOfAddedItems)
+{
+  const unsigned long long numberOfAlreadyProcessedItems = numberOfAddedItems;
+  // The sources of the channel may change, so the signal is registered in the current buffers before each wait
+  this->AddNewDataSignal(this->NewDataSignal);
+  bool newDataAvailable = this->NewDataSignal->Wait([this, numberOfAlreadyProcessedItems]()
+  {
+    return this->GetNumberOfAddedItems() != numberOfAlreadyProcessedItems;
+  }, timeoutSec);
+  numberOfAddedItems = this->GetNumberOfAddedItems();
+  return newDataAvailable;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusChannel::WaitForNewData(double timeoutSec)
+{
+  unsigned long long numberOfAddedItems = this->GetNumberOfAddedItems();
+  return this->WaitForNewData(timeoutSec, numberOfAddedItems);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusChannel::AddNewDataSignal(std::shared_ptr<PlusNewItemSignal> signal) const
+{
+  if (this->HasVideoSource())
+  {
+    this->VideoSource->GetBuffer()->AddNewItemSignal(signal);
+    return;
+  }
+  for (DataSourceContainerConstIterator it = this->GetToolsStartConstIterator(); it != this->GetToolsEndConstIterator(); ++it)
+  {
+    it->second->GetBuffer()->AddNewItemSignal(signal);
+  }
+  for (DataSourceContainerConstIterator it = this->GetFieldDataSourcesStartConstIterator(); it != this->GetFieldDataSourcesEndConstIterator(); ++it)
+  {
+    it->second->GetBuffer()->AddNewItemSignal(signal);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusChannel::RemoveNewDataSignal(std::shared_ptr<PlusNewItemSignal> signal) const
+{
+  if (this->HasVideoSource())
+  {
+    this->VideoSource->GetBuffer()->RemoveNewItemSignal(signal);
+  }
+  for (DataSourceContainerConstIterator it = this->GetToolsStartConstIterator(); it != this->GetToolsEndConstIterator(); ++it)
+  {
+    it->second->GetBuffer()->RemoveNewItemSignal(signal);
+  }
+  for (DataSourceContainerConstIterator it = this->GetFieldDataSourcesStartConstIterator(); it != this->GetFieldDataSourcesEndConstIterator(); ++it)
+  {
+    it->second->GetBuffer()->RemoveNewItemSignal(signal);
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusChannel::ShallowCopy(vtkDataObject* otherObject)
 {
@@ -520,6 +607,7 @@ void vtkPlusChannel::ShallowCopy(const vtkPlusChannel& aChannel)
       continue;
     }
   }
+  this->ShareVideoFrameData = aChannel.ShareVideoFrameData;
 }
 
 //----------------------------------------------------------------------------
@@ -564,25 +652,47 @@ PlusStatus vtkPlusChannel::GetTrackedFrame(double timestamp, igsioTrackedFrame&
       return PLUS_FAIL;
     }
 
-    StreamBufferItem CurrentStreamBufferItem;
-    if (this->VideoSource->GetStreamBufferItem(frameUID, &CurrentStreamBufferItem) != ITEM_OK)
+    StreamBufferItemView frameView;
+    if (this->ShareVideoFrameData && this->VideoSource->GetStreamBufferItemView(frameUID, frameView) == ITEM_OK)
     {
-      LOG_ERROR("Couldn't get video buffer item by frame UID: " << frameUID);
-      return PLUS_FAIL;
-    }
+      // Share the pixel data with the buffer, the buffer does not overwrite it while the tracked frame references it
+      if (frameView.ShareImageWith(*aTrackedFrame.GetImageData()) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Couldn't share video buffer item data by frame UID: " << frameUID);
+        return PLUS_FAIL;
+      }
 
-    // Copy frame
-    igsioVideoFrame frame = CurrentStreamBufferItem.GetFrame();
-    aTrackedFrame.SetImageData(frame);
+      // Copy all custom fields
+      const igsioFieldMapType& fieldMap = frameView.GetFrameFieldMap();
+      for (igsioFieldMapType::const_iterator fieldIterator = fieldMap.begin(); fieldIterator != fieldMap.end(); fieldIterator++)
+      {
+        aTrackedFrame.SetFrameField((*fieldIterator).first, (*fieldIterator).second.second, fieldIterator->second.first);
+      }
 
-    // Copy all custom fields
-    igsioFieldMapType fieldMap = CurrentStreamBufferItem.GetFrameFieldMap();
-    for (igsioFieldMapType::const_iterator fieldIterator = fieldMap.begin(); fieldIterator != fieldMap.end(); fieldIterator++)
-    {
-      aTrackedFrame.SetFrameField((*fieldIterator).first, (*fieldIterator).second.second, fieldIterator->second.first);
+      synchronizedTimestamp = frameView.GetFilteredTimestamp(this->VideoSource->GetLocalTimeOffsetSec());
     }
+    else
+    {
+      // Encoded frames cannot be shared, copy them
+      StreamBufferItem CurrentStreamBufferItem;
+      if (this->VideoSource->GetStreamBufferItem(frameUID, &CurrentStreamBufferItem) != ITEM_OK)
+      {
+        LOG_ERROR("Couldn't get video buffer item by frame UID: " << frameUID);
+        return PLUS_FAIL;
+      }
+
+      // Copy frame
+      aTrackedFrame.SetImageData(CurrentStreamBufferItem.GetFrame());
 
-    synchronizedTimestamp = CurrentStreamBufferItem.GetTimestamp(this->VideoSource->GetLocalTimeOffsetSec());
+      // Copy all custom fields
+      igsioFieldMapType fieldMap = CurrentStreamBufferItem.GetFrameFieldMap();
+      for (igsioFieldMapType::const_iterator fieldIterator = fieldMap.begin(); fieldIterator != fieldMap.end(); fieldIterator++)
+      {
+        aTrackedFrame.SetFrameField((*fieldIterator).first, (*fieldIterator).second.second, fieldIterator->second.first);
+      }
+
+      synchronizedTimestamp = CurrentStreamBufferItem.GetTimestamp(this->VideoSource->GetLocalTimeOffsetSec());
+    }
   }
 
   if (synchronizedTimestamp == 0)
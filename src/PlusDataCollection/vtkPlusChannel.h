@@ -14,7 +14,11 @@
 #include "vtkDataObject.h"
 #include "vtkPlusRfProcessor.h"
 
+// STL includes
+#include <memory>
+
 //class igsioTrackedFrame; 
+class PlusNewItemSignal;
 class vtkPlusHTMLGenerator;
 class vtkPlusDataSource;
 class vtkPlusDevice;
@@ -149,6 +153,32 @@ public:
 
   virtual PlusStatus GetLatestTimestamp(double& aTimestamp) const;
 
+  /*!
+    Get the number of items that have been added to the buffers of the channel. It can be used for detecting new data.
+    If the channel has a video source then only the video frames are counted (tracked frames are generated at the video frame timestamps),
+    otherwise the items of all the tools and field data sources.
+  */
+  unsigned long long GetNumberOfAddedItems() const;
+
+  /*!
+    Wait until new data is added to the channel, instead of polling the buffers at a fixed rate.
+    \param timeoutSec Maximum time to wait
+    \param numberOfAddedItems In: value of GetNumberOfAddedItems() when the data was last processed (the method returns immediately if
+      data has been added since then). Out: current value of GetNumberOfAddedItems().
+    \return true if new data is available, false if the timeout expired
+  */
+  bool WaitForNewData(double timeoutSec, unsigned long long& numberOfAddedItems);
+  /*! Wait until new data is added to the channel after this call. Returns false if the timeout expired. */
+  bool WaitForNewData(double timeoutSec);
+
+  /*!
+    Register a signal in the buffers that are counted by GetNumberOfAddedItems, so that it is notified when new data is added to the channel.
+    Only the producers of these buffers notify the signal (see vtkPlusBuffer::AddNewItemSignal).
+  */
+  void AddNewDataSignal(std::shared_ptr<PlusNewItemSignal> signal) const;
+  /*! Unregister a signal that was registered by AddNewDataSignal */
+  void RemoveNewDataSignal(std::shared_ptr<PlusNewItemSignal> signal) const;
+
   void SetOwnerDevice(vtkPlusDevice* _arg) { this->OwnerDevice = _arg; }
   vtkPlusDevice* GetOwnerDevice() const { return this->OwnerDevice; }
 
@@ -164,6 +194,14 @@ public:
 
   vtkSetMacro(SaveRfProcessingParameters, bool);
 
+  /*!
+    If enabled then GetTrackedFrame shares the pixel data of the video buffer with the output tracked frame
+    instead of copying it. The image data of the returned tracked frames must not be modified.
+  */
+  vtkSetMacro(ShareVideoFrameData, bool);
+  vtkGetMacro(ShareVideoFrameData, bool);
+  vtkBooleanMacro(ShareVideoFrameData, bool);
+
   /*!
     Add generated html report from data acquisition to the existing html report.
     htmlReport and plotter arguments has to be defined by the caller function
@@ -190,6 +228,9 @@ protected:
   /*! If true then RF processing parameters will be saved into the config file */
   bool SaveRfProcessingParameters;
 
+  /*! If true then video frames are returned as read-only views of the buffer, without copying the pixel data */
+  bool ShareVideoFrameData;
+
   /*!
     This tool will be used to provide timestamps if no video data is present
     All the other tools will use the same timestamps and the transforms will be
@@ -199,6 +240,9 @@ protected:
 
   CustomAttributeMap CustomAttributes;
 
+  /*! Signal that WaitForNewData waits for */
+  std::shared_ptr<PlusNewItemSignal> NewDataSignal;
+
   vtkPlusChannel(void);
   virtual ~vtkPlusChannel(void);
 
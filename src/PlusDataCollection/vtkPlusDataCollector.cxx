@@ -6,6 +6,7 @@ See License.txt for details.
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PlusBufferSnapshotWriter.h"
 #include "vtkPlusBuffer.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusDataCollector.h"
@@ -25,7 +26,13 @@ See License.txt for details.
 #endif
 
 // STD includes
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
 #include <set>
+#include <sstream>
+#include <thread>
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -36,10 +43,19 @@ See License.txt for details.
 
 vtkStandardNewMacro(vtkPlusDataCollector);
 
+namespace
+{
+  /*! Period of checking whether the buffers received data after start */
+  const double BUFFER_DATA_POLLING_PERIOD_SEC = 0.01;
+  /*! Devices are connected one after the other by default, as not all device SDKs can be used from multiple threads */
+  const unsigned int DEFAULT_NUMBER_OF_CONNECTION_THREADS = 1;
+}
+
 //----------------------------------------------------------------------------
 vtkPlusDataCollector::vtkPlusDataCollector()
   : vtkObject()
   , StartupDelaySec(0.0)
+  , NumberOfConnectionThreads(DEFAULT_NUMBER_OF_CONNECTION_THREADS)
   , DeviceFactory(vtkSmartPointer<vtkPlusDeviceFactory>::New())
   , Connected(false)
   , Started(false)
@@ -105,6 +121,19 @@ PlusStatus vtkPlusDataCollector::ReadConfiguration(vtkXMLDataElement* aConfig)
     LOG_DEBUG("StartupDelaySec: " << std::fixed << startupDelaySec);
   }
 
+  // Read NumberOfConnectionThreads
+  int numberOfConnectionThreads(DEFAULT_NUMBER_OF_CONNECTION_THREADS);
+  if (dataCollectionElement->GetScalarAttribute("NumberOfConnectionThreads", numberOfConnectionThreads))
+  {
+    if (numberOfConnectionThreads < 0)
+    {
+      LOG_ERROR("Invalid NumberOfConnectionThreads: " << numberOfConnectionThreads << ". It must be 0 (no limit) or positive.");
+      return PLUS_FAIL;
+    }
+    this->SetNumberOfConnectionThreads(numberOfConnectionThreads);
+    LOG_DEBUG("NumberOfConnectionThreads: " << numberOfConnectionThreads);
+  }
+
   std::set<std::string> existingDeviceIds;
 
   for (int i = 0; i < dataCollectionElement->GetNumberOfNestedElements(); ++i)
@@ -281,6 +310,14 @@ PlusStatus vtkPlusDataCollector::WriteConfiguration(vtkXMLDataElement* aConfig)
   }
 
   dataCollectionConfig->SetDoubleAttribute("StartupDelaySec", GetStartupDelaySec());
+  if (this->NumberOfConnectionThreads != DEFAULT_NUMBER_OF_CONNECTION_THREADS)
+  {
+    dataCollectionConfig->SetIntAttribute("NumberOfConnectionThreads", this->NumberOfConnectionThreads);
+  }
+  else
+  {
+    dataCollectionConfig->RemoveAttribute("NumberOfConnectionThreads");
+  }
 
   PlusStatus status = PLUS_SUCCESS;
 
@@ -318,25 +355,23 @@ PlusStatus vtkPlusDataCollector::Start()
 {
   LOG_TRACE("vtkPlusDataCollector::Start()");
 
-  PlusStatus status = PLUS_SUCCESS;
-
   const double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
-  for (DeviceCollectionIterator it = Devices.begin(); it != Devices.end(); ++ it)
+  // Virtual devices are started after the devices that feed them
+  PlusStatus status = this->RunOnDevicesInDependencyOrder("start", [startTime](vtkPlusDevice * device)
   {
-    vtkPlusDevice* device = *it;
-
-    if (device->StartRecording() != PLUS_SUCCESS)
+    PlusStatus deviceStatus = device->StartRecording();
+    if (deviceStatus != PLUS_SUCCESS)
     {
       LOG_ERROR("Failed to start data acquisition for device " << device->GetDeviceId() << ".");
-      status = PLUS_FAIL;
     }
     device->SetStartTime(startTime);
-  }
+    return deviceStatus;
+  });
 
-  LOG_DEBUG("vtkPlusDataCollector::Start -- wait " << std::fixed << this->StartupDelaySec << " sec for buffer init...");
+  LOG_DEBUG("vtkPlusDataCollector::Start -- wait at most " << std::fixed << this->StartupDelaySec << " sec for buffer init...");
 
-  vtkIGSIOAccurateTimer::DelayWithEventProcessing(this->StartupDelaySec);
+  this->WaitForBuffersToReceiveData(this->StartupDelaySec);
 
   this->Started = true;
 
@@ -358,18 +393,16 @@ PlusStatus vtkPlusDataCollector::Connect()
 {
   LOG_TRACE("vtkPlusDataCollector::Connect()");
 
-  PlusStatus status = PLUS_SUCCESS;
-
-  for (DeviceCollectionIterator it = Devices.begin(); it != Devices.end(); ++ it)
+  // Physical devices are connected in parallel, virtual devices after the devices that feed them
+  PlusStatus status = this->RunOnDevicesInDependencyOrder("connect", [](vtkPlusDevice * device)
   {
-    vtkPlusDevice* device = *it;
-
-    if (device->Connect() != PLUS_SUCCESS)
+    PlusStatus deviceStatus = device->Connect();
+    if (deviceStatus != PLUS_SUCCESS)
     {
       LOG_ERROR("Unable to connect device: " << device->GetDeviceId() << ".");
-      status = PLUS_FAIL;
     }
-  }
+    return deviceStatus;
+  });
 
   if (status != PLUS_SUCCESS)
   {
@@ -411,6 +444,205 @@ PlusStatus vtkPlusDataCollector::Disconnect()
   return status;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataCollector::RunOnDevicesInDependencyOrder(const std::string& operationName, const std::function<PlusStatus(vtkPlusDevice*)>& operation)
+{
+  enum DeviceOperationState
+  {
+    OPERATION_PENDING,
+    OPERATION_RUNNING,
+    OPERATION_SUCCEEDED,
+    OPERATION_FAILED,
+    OPERATION_SKIPPED
+  };
+
+  const size_t numberOfDevices = this->Devices.size();
+  if (numberOfDevices == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  // Indices of the devices that feed the input channels of each device
+  std::vector<std::vector<size_t> > inputDeviceIndices(numberOfDevices);
+  for (size_t deviceIndex = 0; deviceIndex < numberOfDevices; ++deviceIndex)
+  {
+    std::vector<vtkPlusDevice*> inputDevices;
+    this->Devices[deviceIndex]->GetInputDevices(inputDevices);
+    for (std::vector<vtkPlusDevice*>::iterator inputIt = inputDevices.begin(); inputIt != inputDevices.end(); ++inputIt)
+    {
+      size_t inputIndex = std::find(this->Devices.begin(), this->Devices.end(), *inputIt) - this->Devices.begin();
+      if (inputIndex != deviceIndex && inputIndex < numberOfDevices
+          && std::find(inputDeviceIndices[deviceIndex].begin(), inputDeviceIndices[deviceIndex].end(), inputIndex) == inputDeviceIndices[deviceIndex].end())
+      {
+        inputDeviceIndices[deviceIndex].push_back(inputIndex);
+      }
+    }
+  }
+
+  std::vector<DeviceOperationState> states(numberOfDevices, OPERATION_PENDING);
+  std::mutex stateMutex;
+  std::condition_variable stateChanged;
+
+  // Returns the index of the next device to run the operation on, or -1 if there is none yet. Must be called with stateMutex locked.
+  auto takeNextDevice = [&]() -> int
+  {
+    bool stateUpdated = true;
+    while (stateUpdated)
+    {
+      stateUpdated = false;
+      for (size_t deviceIndex = 0; deviceIndex < numberOfDevices; ++deviceIndex)
+      {
+        if (states[deviceIndex] != OPERATION_PENDING)
+        {
+          continue;
+        }
+        bool inputsSucceeded = true;
+        bool inputsFailed = false;
+        for (std::vector<size_t>::iterator inputIt = inputDeviceIndices[deviceIndex].begin(); inputIt != inputDeviceIndices[deviceIndex].end(); ++inputIt)
+        {
+          inputsSucceeded = inputsSucceeded && states[*inputIt] == OPERATION_SUCCEEDED;
+          inputsFailed = inputsFailed || states[*inputIt] == OPERATION_FAILED || states[*inputIt] == OPERATION_SKIPPED;
+        }
+        if (inputsFailed)
+        {
+          states[deviceIndex] = OPERATION_SKIPPED;
+          stateUpdated = true;
+        }
+        else if (inputsSucceeded)
+        {
+          states[deviceIndex] = OPERATION_RUNNING;
+          return static_cast<int>(deviceIndex);
+        }
+      }
+    }
+
+    if (std::find(states.begin(), states.end(), OPERATION_RUNNING) == states.end())
+    {
+      // Nothing is running that the pending devices could wait for (their input channels form a loop), run them in configuration order
+      std::vector<DeviceOperationState>::iterator pendingIt = std::find(states.begin(), states.end(), OPERATION_PENDING);
+      if (pendingIt != states.end())
+      {
+        *pendingIt = OPERATION_RUNNING;
+        return static_cast<int>(pendingIt - states.begin());
+      }
+    }
+    return -1;
+  };
+
+  auto runOperations = [&]()
+  {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    while (true)
+    {
+      int deviceIndex = takeNextDevice();
+      if (deviceIndex < 0)
+      {
+        if (std::find(states.begin(), states.end(), OPERATION_PENDING) == states.end())
+        {
+          break;
+        }
+        stateChanged.wait(lock);
+        continue;
+      }
+
+      lock.unlock();
+      PlusStatus result = operation(this->Devices[deviceIndex]);
+      lock.lock();
+
+      states[deviceIndex] = (result == PLUS_SUCCESS ? OPERATION_SUCCEEDED : OPERATION_FAILED);
+      stateChanged.notify_all();
+    }
+  };
+
+  // The calling thread runs operations as well
+  size_t numberOfThreads = (this->NumberOfConnectionThreads > 0 ? std::min<size_t>(this->NumberOfConnectionThreads, numberOfDevices) : numberOfDevices);
+  std::vector<std::thread> threads;
+  for (size_t threadIndex = 1; threadIndex < numberOfThreads; ++threadIndex)
+  {
+    threads.push_back(std::thread(runOperations));
+  }
+  runOperations();
+  for (std::vector<std::thread>::iterator threadIt = threads.begin(); threadIt != threads.end(); ++threadIt)
+  {
+    threadIt->join();
+  }
+
+  std::ostringstream failedDevices;
+  std::ostringstream skippedDevices;
+  for (size_t deviceIndex = 0; deviceIndex < numberOfDevices; ++deviceIndex)
+  {
+    if (states[deviceIndex] == OPERATION_FAILED)
+    {
+      failedDevices << (failedDevices.tellp() > 0 ? ", " : "") << this->Devices[deviceIndex]->GetDeviceId();
+    }
+    else if (states[deviceIndex] == OPERATION_SKIPPED)
+    {
+      skippedDevices << (skippedDevices.tellp() > 0 ? ", " : "") << this->Devices[deviceIndex]->GetDeviceId();
+    }
+  }
+  if (failedDevices.tellp() > 0)
+  {
+    LOG_ERROR("Failed to " << operationName << " devices: " << failedDevices.str()
+              << (skippedDevices.tellp() > 0 ? ". Skipped devices that use their output: " + skippedDevices.str() : std::string()));
+    return PLUS_FAIL;
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDataCollector::WaitForBuffersToReceiveData(double timeoutSec)
+{
+  std::vector<vtkPlusDataSource*> emptySources;
+  for (DeviceCollectionIterator it = this->Devices.begin(); it != this->Devices.end(); ++it)
+  {
+    vtkPlusDevice* device = *it;
+    if (!device->IsRecording())
+    {
+      continue;
+    }
+    for (DataSourceContainerConstIterator sourceIt = device->GetVideoSourceIteratorBegin(); sourceIt != device->GetVideoSourceIteratorEnd(); ++sourceIt)
+    {
+      emptySources.push_back(sourceIt->second);
+    }
+    for (DataSourceContainerConstIterator sourceIt = device->GetToolIteratorBegin(); sourceIt != device->GetToolIteratorEnd(); ++sourceIt)
+    {
+      emptySources.push_back(sourceIt->second);
+    }
+    for (DataSourceContainerConstIterator sourceIt = device->GetFieldDataSourcessIteratorBegin(); sourceIt != device->GetFieldDataSourcessIteratorEnd(); ++sourceIt)
+    {
+      emptySources.push_back(sourceIt->second);
+    }
+  }
+
+  const double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  while (true)
+  {
+    emptySources.erase(std::remove_if(emptySources.begin(), emptySources.end(), [](vtkPlusDataSource * source) { return source->GetNumberOfItems() > 0; }), emptySources.end());
+    double elapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+    if (emptySources.empty())
+    {
+      LOG_DEBUG("All buffers received data in " << std::fixed << elapsedTimeSec << " sec");
+      return;
+    }
+    if (elapsedTimeSec >= timeoutSec)
+    {
+      break;
+    }
+    vtkIGSIOAccurateTimer::DelayWithEventProcessing(std::min(BUFFER_DATA_POLLING_PERIOD_SEC, timeoutSec - elapsedTimeSec));
+  }
+
+  if (timeoutSec > 0)
+  {
+    std::ostringstream emptySourceIds;
+    for (std::vector<vtkPlusDataSource*>::iterator sourceIt = emptySources.begin(); sourceIt != emptySources.end(); ++sourceIt)
+    {
+      emptySourceIds << (sourceIt != emptySources.begin() ? ", " : "") << (*sourceIt)->GetSourceId();
+    }
+    LOG_INFO("No data received within " << std::fixed << timeoutSec << " sec startup delay from: " << emptySourceIds.str());
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusDataCollector::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -479,6 +711,9 @@ PlusStatus vtkPlusDataCollector::DumpBuffersToDirectory(const char* aDirectory)
   // Assemble file names
   std::string dateAndTime = vtksys::SystemTools::GetCurrentDateTime("%Y%m%d_%H%M%S");
 
+  // Snapshots of the buffers are written in parallel on background threads, while the acquisition continues
+  std::list<PlusBufferSnapshotWriter> snapshotWriters;
+  PlusStatus status = PLUS_SUCCESS;
   for (DeviceCollectionIterator it = this->Devices.begin(); it != this->Devices.end(); ++it)
   {
     vtkPlusDevice* device = *it;
@@ -492,13 +727,35 @@ PlusStatus vtkPlusDataCollector::DumpBuffersToDirectory(const char* aDirectory)
       if ((*chanIt)->GetVideoSource(aSource) != PLUS_SUCCESS)
       {
         LOG_ERROR("Unable to retrieve the video source in the device.");
-        return PLUS_FAIL;
+        aSource = NULL;
+        status = PLUS_FAIL;
+        break;
       }
-      aSource->WriteToSequenceFile(outputDeviceBufferSequenceFileName.c_str(), false);
+    }
+    if (aSource == NULL)
+    {
+      continue;
+    }
+
+    snapshotWriters.emplace_back();
+    if (snapshotWriters.back().TakeVideoSnapshot(aSource->GetBuffer()) != PLUS_SUCCESS
+        || snapshotWriters.back().Start(outputDeviceBufferSequenceFileName, false) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to write device buffer to " << outputDeviceBufferSequenceFileName);
+      status = PLUS_FAIL;
     }
   }
 
-  return PLUS_SUCCESS;
+  for (std::list<PlusBufferSnapshotWriter>::iterator writer = snapshotWriters.begin(); writer != snapshotWriters.end(); ++writer)
+  {
+    // Writers that could not be started are already reported
+    if (writer->GetProgress().State != PlusBufferSnapshotWriter::STATE_IDLE && writer->Wait() != PLUS_SUCCESS)
+    {
+      status = PLUS_FAIL;
+    }
+  }
+
+  return status;
 }
 
 //----------------------------------------------------------------------------
@@ -15,6 +15,9 @@ See License.txt for details.
 // VTK includes
 #include <vtkObject.h>
 
+// STL includes
+#include <functional>
+
 //class igsioTrackedFrame; 
 class vtkPlusChannel;
 class vtkPlusDeviceFactory;
@@ -59,6 +62,8 @@ public:
   Start the devices. The device is brought from
   its ground state (i.e. on but not necessarily initialized) into
   full active mode.  This method calls start on the current connected device(s)
+  The devices are started in parallel, in the same order as they are connected (see Connect).
+  Then it waits until the buffers of all started devices received data, for at most StartupDelaySec.
   */
   PlusStatus Start();
 
@@ -69,6 +74,9 @@ public:
 
   /*!
   Connect to device(s). Connection is needed for recording or single frame grabbing
+  The devices are connected on up to NumberOfConnectionThreads threads (one after the other by default). A device is only
+  connected after all the devices that feed its input channels are connected, and it is not connected if any of them failed.
+  If any device fails to connect then all devices are disconnected.
   */
   PlusStatus Connect();
 
@@ -113,9 +121,9 @@ public:
   DeviceCollectionConstIterator GetDeviceConstIteratorEnd() const;
 
   /*!
-    Have each device dump their buffers to disk
+    Have each device dump their buffers to disk. The buffers are written in parallel (see PlusBufferSnapshotWriter),
+    the data collection is not paused meanwhile.
     \param aDirectory directory to dump to
-    \param maxTimeLimitSec Maximum time spent in the function (in sec)
   */
   PlusStatus DumpBuffersToDirectory(const char* aDirectory);
 
@@ -149,18 +157,38 @@ public:
   */
   bool GetConnected() const;
 
-  /*! Set startup delay in sec to give some time to the buffers for proper initialization */
+  /*! Set the maximum time in sec that Start waits for the buffers to receive data */
   vtkSetMacro(StartupDelaySec, double);
-  /*! Get startup delay in sec to give some time to the buffers for proper initialization */
+  /*! Get the maximum time in sec that Start waits for the buffers to receive data */
   vtkGetMacro(StartupDelaySec, double);
 
+  /*!
+    Maximum number of devices that are connected or started at the same time (0 = no limit).
+    By default it is 1: the devices are connected one after the other on the calling thread, as some device SDKs are not thread-safe.
+    Set it to more than 1 (or 0) to connect devices in parallel, if all the device SDKs in the device set can be used from multiple threads.
+  */
+  vtkSetMacro(NumberOfConnectionThreads, unsigned int);
+  vtkGetMacro(NumberOfConnectionThreads, unsigned int);
+
 protected:
   vtkPlusDataCollector();
   virtual ~vtkPlusDataCollector();
 
-  /*! The timestamp filtering methods require some time to initialize. Synchronization will ignore data that are acquired during startup delay. */
+  /*!
+    Call the operation on all devices, on up to NumberOfConnectionThreads threads (including the calling thread).
+    The operation is called on a device after it succeeded on all the devices that feed its input channels.
+    If it failed on any of them then the device is skipped. The failed and skipped devices are reported in one error message.
+  */
+  PlusStatus RunOnDevicesInDependencyOrder(const std::string& operationName, const std::function<PlusStatus(vtkPlusDevice*)>& operation);
+
+  /*! Wait until the buffers of all recording devices received data, with event processing, for at most timeoutSec */
+  void WaitForBuffersToReceiveData(double timeoutSec);
+
+  /*! The timestamp filtering methods require some time to initialize. Start waits at most this long for the buffers to receive data. */
   double StartupDelaySec;
 
+  unsigned int NumberOfConnectionThreads;
+
   vtkSmartPointer<vtkPlusDeviceFactory> DeviceFactory;
 
   DeviceCollection Devices;
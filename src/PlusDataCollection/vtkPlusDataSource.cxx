@@ -391,6 +391,19 @@ PlusStatus vtkPlusDataSource::ReadConfiguration(vtkXMLDataElement* sourceElement
     LOG_DEBUG("Buffer size is not defined in source element \"" << this->GetId() << "\". Using default buffer size: " << this->GetBuffer()->GetBufferSize());
   }
 
+  bool lockFreeBufferRead = false;
+  XML_READ_BOOL_ATTRIBUTE_NONMEMBER_OPTIONAL(LockFreeBufferRead, lockFreeBufferRead, sourceElement);
+  this->GetBuffer()->SetLockFreeRead(lockFreeBufferRead);
+
+  bool compactTransformStorage = false;
+  XML_READ_BOOL_ATTRIBUTE_NONMEMBER_OPTIONAL(CompactTransformStorage, compactTransformStorage, sourceElement);
+  if (compactTransformStorage && this->GetType() != DATA_SOURCE_TYPE_TOOL)
+  {
+    LOG_WARNING("CompactTransformStorage is only supported for Tool data sources, it is ignored for source " << this->GetId());
+    compactTransformStorage = false;
+  }
+  this->GetBuffer()->SetCompactTransformStorage(compactTransformStorage);
+
   int averagedItemsForFiltering = 0;
   if (sourceElement->GetScalarAttribute("AveragedItemsForFiltering", averagedItemsForFiltering))
   {
@@ -462,6 +475,16 @@ PlusStatus vtkPlusDataSource::WriteConfiguration(vtkXMLDataElement* aSourceEleme
     aSourceElement->SetIntAttribute("AveragedItemsForFiltering", this->GetBuffer()->GetAveragedItemsForFiltering());
   }
 
+  if (this->GetBuffer()->GetLockFreeRead())
+  {
+    aSourceElement->SetAttribute("LockFreeBufferRead", "TRUE");
+  }
+
+  if (this->GetBuffer()->GetCompactTransformStorage())
+  {
+    aSourceElement->SetAttribute("CompactTransformStorage", "TRUE");
+  }
+
   // Write custom properties
   if (this->CustomProperties.size() > 0)
   {
@@ -579,6 +602,33 @@ PlusStatus vtkPlusDataSource::AddItem(void* imageDataPtr, const FrameSizeType& f
   return this->GetBuffer()->AddItem(imageDataPtr, frameSize, frameSizeInBytes, imageType, frameNumber, unfilteredTimestamp, filteredTimestamp, customFields);
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::ReserveItem(StreamBufferItemReservation& reservation)
+{
+  return this->GetBuffer()->ReserveItem(reservation);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::WriteReservedItem(StreamBufferItemReservation& reservation, void* imageDataPtr, US_IMAGE_ORIENTATION usImageOrientation, const FrameSizeType& frameSizeInPx,
+    igsioCommon::VTKScalarPixelType pixelType, unsigned int numberOfScalarComponents, US_IMAGE_TYPE imageType, int numberOfBytesToSkip)
+{
+  return this->GetBuffer()->WriteReservedItem(reservation, imageDataPtr, usImageOrientation, frameSizeInPx, pixelType, numberOfScalarComponents, imageType, numberOfBytesToSkip,
+         this->ClipRectangleOrigin, this->ClipRectangleSize);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::CommitReservedItem(StreamBufferItemReservation& reservation, long frameNumber, double unfilteredTimestamp /*= UNDEFINED_TIMESTAMP*/,
+    double filteredTimestamp /*= UNDEFINED_TIMESTAMP*/, const igsioFieldMapType* customFields /*= NULL*/)
+{
+  return this->GetBuffer()->CommitReservedItem(reservation, frameNumber, unfilteredTimestamp, filteredTimestamp, customFields);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDataSource::ReleaseReservation(StreamBufferItemReservation& reservation)
+{
+  this->GetBuffer()->ReleaseReservation(reservation);
+}
+
 //-----------------------------------------------------------------------------
 US_IMAGE_TYPE vtkPlusDataSource::GetImageType()
 {
@@ -813,6 +863,18 @@ ItemStatus vtkPlusDataSource::GetStreamBufferItem(BufferItemUidType uid, StreamB
   return this->GetBuffer()->GetStreamBufferItem(uid, bufferItem);
 }
 
+//-----------------------------------------------------------------------------
+ItemStatus vtkPlusDataSource::GetStreamBufferItemView(BufferItemUidType uid, StreamBufferItemView& view)
+{
+  return this->GetBuffer()->GetStreamBufferItemView(uid, view);
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::GetStreamBufferItemSnapshot(std::vector<StreamBufferItem>& items)
+{
+  return this->GetBuffer()->GetStreamBufferItemSnapshot(items);
+}
+
 //-----------------------------------------------------------------------------
 ItemStatus vtkPlusDataSource::GetLatestStreamBufferItem(StreamBufferItem* bufferItem)
 {
@@ -134,6 +134,10 @@ public:
 
   /*! Get a frame with the specified frame uid from the buffer */
   virtual ItemStatus GetStreamBufferItem(BufferItemUidType uid, StreamBufferItem* bufferItem);
+  /*! Get a read-only view of a frame with the specified frame uid, without copying the pixel data. See vtkPlusBuffer::GetStreamBufferItemView. */
+  virtual ItemStatus GetStreamBufferItemView(BufferItemUidType uid, StreamBufferItemView& view);
+  /*! Get all the items that are in the buffer, without copying the pixel data. See vtkPlusBuffer::GetStreamBufferItemSnapshot. */
+  virtual PlusStatus GetStreamBufferItemSnapshot(std::vector<StreamBufferItem>& items);
   /*! Get the most recent frame from the buffer */
   virtual ItemStatus GetLatestStreamBufferItem(StreamBufferItem* bufferItem);
   /*! Get the oldest frame from buffer */
@@ -253,6 +257,32 @@ public:
   */
   virtual PlusStatus AddItem(const igsioFieldMapType& customFields, long frameNumber, double unfilteredTimestamp = UNDEFINED_TIMESTAMP, double filteredTimestamp = UNDEFINED_TIMESTAMP);
 
+  /*!
+    Reserve a frame for a new item in the output frame format of the source. The frame can be written without locking the buffer,
+    then it can be added by CommitReservedItem. See vtkPlusBuffer::ReserveItem.
+  */
+  virtual PlusStatus ReserveItem(StreamBufferItemReservation& reservation);
+
+  /*! Write a frame into the reserved frame, reoriented and clipped the same way as in AddItem. See vtkPlusBuffer::WriteReservedItem. */
+  virtual PlusStatus WriteReservedItem(StreamBufferItemReservation& reservation,
+                                       void* imageDataPtr,
+                                       US_IMAGE_ORIENTATION usImageOrientation,
+                                       const FrameSizeType& frameSizeInPx,
+                                       igsioCommon::VTKScalarPixelType pixelType,
+                                       unsigned int numberOfScalarComponents,
+                                       US_IMAGE_TYPE imageType,
+                                       int numberOfBytesToSkip);
+
+  /*! Add the reserved frame to the buffer as a new item. See vtkPlusBuffer::CommitReservedItem. */
+  virtual PlusStatus CommitReservedItem(StreamBufferItemReservation& reservation,
+                                        long frameNumber,
+                                        double unfilteredTimestamp = UNDEFINED_TIMESTAMP,
+                                        double filteredTimestamp = UNDEFINED_TIMESTAMP,
+                                        const igsioFieldMapType* customFields = NULL);
+
+  /*! Release the reserved frame without adding it to the buffer */
+  virtual void ReleaseReservation(StreamBufferItemReservation& reservation);
+
   /*!
   Add a matrix plus status to the list, with an exactly known timestamp value (e.g., provided by a high-precision hardware timer).
   If the timestamp is less than or equal to the previous timestamp, then nothing  will be done.
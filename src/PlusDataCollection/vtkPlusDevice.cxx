@@ -6,6 +6,8 @@ See License.txt for details.
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PlusBufferSnapshotWriter.h"
+#include "PlusNewItemSignal.h"
 #include "vtkPlusBuffer.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusDataSource.h"
@@ -26,7 +28,9 @@ See License.txt for details.
 #include <vtksys/SystemTools.hxx>
 
 // STD includes
+#include <algorithm>
 #include <set>
+#include <sstream>
 
 // System includes
 #include <ctype.h>
@@ -114,6 +118,7 @@ vtkStandardNewMacro(vtkPlusDevice);
 
 const int vtkPlusDevice::VIRTUAL_DEVICE_FRAME_RATE = 50;
 static const int FRAME_RATE_AVERAGING = 10;
+static const double DEFAULT_MAXIMUM_UPDATE_RATE_ON_NEW_INPUT_DATA = 100.0;
 const std::string vtkPlusDevice::BMODE_PORT_NAME = "B";
 const std::string vtkPlusDevice::RFMODE_PORT_NAME = "Rf";
 const std::string vtkPlusDevice::PARAMETERS_XML_ELEMENT_TAG = "Parameters";
@@ -139,6 +144,9 @@ vtkPlusDevice::vtkPlusDevice()
   , OutputNeedsInitialization(1)
   , CorrectlyConfigured(true)
   , StartThreadForInternalUpdates(false)
+  , UpdateOnNewInputData(false)
+  , MaximumUpdateRateOnNewInputData(DEFAULT_MAXIMUM_UPDATE_RATE_ON_NEW_INPUT_DATA)
+  , InputDataSignal(std::make_shared<PlusNewItemSignal>())
   , LocalTimeOffsetSec(0.0)
   , MissingInputGracePeriodSec(0.0)
   , RequireImageOrientationInConfiguration(false)
@@ -577,6 +585,12 @@ PlusStatus vtkPlusDevice::SetParameter(const std::string& key, const std::string
 //----------------------------------------------------------------------------
 std::string vtkPlusDevice::GetParameter(const std::string& key) const
 {
+  std::string captureLoopValue;
+  if (this->GetCaptureLoopParameter(key, captureLoopValue) == PLUS_SUCCESS)
+  {
+    return captureLoopValue;
+  }
+
   if (this->Parameters.find(key) != this->Parameters.end())
   {
     return this->Parameters.find(key)->second;
@@ -588,6 +602,11 @@ std::string vtkPlusDevice::GetParameter(const std::string& key) const
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusDevice::GetParameter(const std::string& key, std::string& outValue) const
 {
+  if (this->GetCaptureLoopParameter(key, outValue) == PLUS_SUCCESS)
+  {
+    return PLUS_SUCCESS;
+  }
+
   if (this->Parameters.find(key) != this->Parameters.end())
   {
     outValue = this->Parameters.find(key)->second;
@@ -597,6 +616,74 @@ PlusStatus vtkPlusDevice::GetParameter(const std::string& key, std::string& outV
   return PLUS_FAIL;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDevice::GetCaptureLoopParameter(const std::string& key, std::string& outValue) const
+{
+  if (key.compare(0, 11, "CaptureLoop") != 0)
+  {
+    return PLUS_FAIL;
+  }
+
+  PlusCaptureLoopScheduler::Statistics statistics = this->CaptureLoopScheduler.GetStatistics();
+  std::ostringstream value;
+  if (key == "CaptureLoopNumberOfPeriods")
+  {
+    value << statistics.NumberOfPeriods;
+  }
+  else if (key == "CaptureLoopNumberOfOverruns")
+  {
+    value << statistics.NumberOfOverruns;
+  }
+  else if (key == "CaptureLoopNumberOfSkippedDeadlines")
+  {
+    value << statistics.NumberOfSkippedDeadlines;
+  }
+  else if (key == "CaptureLoopAverageWakeUpLatencySec")
+  {
+    value << statistics.AverageWakeUpLatencySec;
+  }
+  else if (key == "CaptureLoopMaxWakeUpLatencySec")
+  {
+    value << statistics.MaxWakeUpLatencySec;
+  }
+  else if (key == "CaptureLoopMaxOverrunSec")
+  {
+    value << statistics.MaxOverrunSec;
+  }
+  else if (key == "CaptureLoopWakeUpLatencyHistogram")
+  {
+    value << PlusCaptureLoopScheduler::GetHistogramAsString(statistics.WakeUpLatencyHistogram);
+  }
+  else if (key == "CaptureLoopOverrunHistogram")
+  {
+    value << PlusCaptureLoopScheduler::GetHistogramAsString(statistics.OverrunHistogram);
+  }
+  else
+  {
+    return PLUS_FAIL;
+  }
+  outValue = value.str();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::Statistics vtkPlusDevice::GetCaptureLoopStatistics() const
+{
+  return this->CaptureLoopScheduler.GetStatistics();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDevice::SetCaptureThreadSettings(const PlusCaptureLoopScheduler::ThreadSettings& settings)
+{
+  this->CaptureThreadSettings = settings;
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureLoopScheduler::ThreadSettings vtkPlusDevice::GetCaptureThreadSettings() const
+{
+  return this->CaptureThreadSettings;
+}
+
 //-----------------------------------------------------------------------------
 void vtkPlusDevice::DeepCopy(const vtkPlusDevice& device)
 {
@@ -607,6 +694,8 @@ void vtkPlusDevice::DeepCopy(const vtkPlusDevice& device)
   this->CorrectlyConfigured = device.GetCorrectlyConfigured();
   this->LocalTimeOffsetSec = device.GetLocalTimeOffsetSec();
   this->MissingInputGracePeriodSec = device.GetMissingInputGracePeriodSec();
+  this->CaptureThreadSettings = device.GetCaptureThreadSettings();
+  this->MaximumUpdateRateOnNewInputData = device.GetMaximumUpdateRateOnNewInputData();
   this->RequireImageOrientationInConfiguration = device.RequireImageOrientationInConfiguration;
   this->RequirePortNameInDeviceSetConfiguration = device.RequirePortNameInDeviceSetConfiguration;
   this->Parameters = device.Parameters;
@@ -722,87 +811,15 @@ PlusStatus vtkPlusDevice::WriteToolsToSequenceFile(const std::string& filename,
     return PLUS_FAIL;
   }
 
-  // Get the number of items from buffers and use the lowest
-  int numberOfItems(-1);
-  for (DataSourceContainerConstIterator it = this->Tools.begin(); it != this->Tools.end(); ++it)
+  PlusBufferSnapshotWriter snapshot;
+  if (snapshot.TakeToolsSnapshot(this) != PLUS_SUCCESS)
   {
-    if (numberOfItems < 0 || numberOfItems > it->second->GetNumberOfItems())
-    {
-      numberOfItems = it->second->GetNumberOfItems();
-    }
+    LOCAL_LOG_ERROR("Failed to get tracker buffer items");
+    return PLUS_FAIL;
   }
 
   vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-
-  PlusStatus status = PLUS_SUCCESS;
-
-  // Get the first source
-  vtkPlusDataSource* firstActiveTool = this->Tools.begin()->second;
-
-  for (int i = 0 ; i < numberOfItems; i++)
-  {
-    // Create fake image
-    igsioTrackedFrame trackedFrame;
-    igsioVideoFrame videoFrame;
-    FrameSizeType frameSize = {1, 1, 1};
-    // Don't waste space, create a greyscale image
-    videoFrame.AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
-    trackedFrame.SetImageData(videoFrame);
-
-    StreamBufferItem bufferItem;
-    BufferItemUidType uid = firstActiveTool->GetOldestItemUidInBuffer() + i;
-
-    if (firstActiveTool->GetStreamBufferItem(uid, &bufferItem) != ITEM_OK)
-    {
-      LOCAL_LOG_ERROR("Failed to get tracker buffer item with UID: " << uid);
-      continue;
-    }
-
-    const double frameTimestamp = bufferItem.GetFilteredTimestamp(firstActiveTool->GetLocalTimeOffsetSec());
-
-    // Add main source timestamp
-    std::ostringstream timestampFieldValue;
-    timestampFieldValue << std::fixed << frameTimestamp;
-    trackedFrame.SetFrameField("Timestamp", timestampFieldValue.str());
-
-    // Add main source unfiltered timestamp
-    std::ostringstream unfilteredtimestampFieldValue;
-    unfilteredtimestampFieldValue << std::fixed << bufferItem.GetUnfilteredTimestamp(firstActiveTool->GetLocalTimeOffsetSec());
-    trackedFrame.SetFrameField("UnfilteredTimestamp", unfilteredtimestampFieldValue.str());
-
-    // Add main source frameNumber
-    std::ostringstream frameNumberFieldValue;
-    frameNumberFieldValue << std::fixed << bufferItem.GetIndex();
-    trackedFrame.SetFrameField("FrameNumber", frameNumberFieldValue.str());
-
-    // Add transforms
-    for (DataSourceContainerConstIterator it = this->Tools.begin(); it != this->Tools.end(); ++it)
-    {
-      StreamBufferItem toolBufferItem;
-      if (it->second->GetStreamBufferItemFromTime(frameTimestamp, &toolBufferItem, vtkPlusBuffer::EXACT_TIME) != ITEM_OK)
-      {
-        LOCAL_LOG_ERROR("Failed to get tracker buffer item from time: " << std::fixed << frameTimestamp);
-        continue;
-      }
-
-      vtkSmartPointer<vtkMatrix4x4> toolMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-      if (toolBufferItem.GetMatrix(toolMatrix) != PLUS_SUCCESS)
-      {
-        LOCAL_LOG_ERROR("Failed to get toolMatrix");
-        return PLUS_FAIL;
-      }
-
-      igsioTransformName toolToTrackerTransform(it->second->GetId(), this->ToolReferenceFrameName);
-      trackedFrame.SetFrameTransform(toolToTrackerTransform, toolMatrix);
-
-      // Add source status
-      trackedFrame.SetFrameTransformStatus(toolToTrackerTransform, toolBufferItem.GetStatus());
-    }
-
-    // Add tracked frame to the list
-    // This is a debugging/test function, so the additional copying in AddTrackedFrame compared to TakeTrackedFrame is not relevant.
-    trackedFrameList->AddTrackedFrame(&trackedFrame);
-  }
+  PlusStatus status = snapshot.GetTrackedFrameList(trackedFrameList);
 
   // Save tracked frames to metafile
   if (vtkPlusSequenceIO::Write(filename, trackedFrameList, trackedFrameList->GetImageOrientation(), useCompression) != PLUS_SUCCESS)
@@ -1050,6 +1067,8 @@ PlusStatus vtkPlusDevice::ReadConfiguration(vtkXMLDataElement* rootXMLElement)
     LOCAL_LOG_DEBUG("Unable to find acquisition rate in device element when it is required, using default " << this->GetAcquisitionRate());
   }
 
+  deviceXMLElement->GetScalarAttribute("MaximumUpdateRateOnNewInputData", this->MaximumUpdateRateOnNewInputData);
+
   vtkXMLDataElement* outputChannelsElement = deviceXMLElement->FindNestedElementWithName("OutputChannels");
   if (outputChannelsElement != NULL)
   {
@@ -1103,6 +1122,34 @@ PlusStatus vtkPlusDevice::ReadConfiguration(vtkXMLDataElement* rootXMLElement)
     LOCAL_LOG_DEBUG("Local time offset was not defined in device configuration");
   }
 
+  const char* captureThreadCpuAffinity = deviceXMLElement->GetAttribute("CaptureThreadCpuAffinity");
+  if (captureThreadCpuAffinity != NULL)
+  {
+    this->CaptureThreadSettings.CpuAffinity.clear();
+    std::istringstream cpuAffinityStream(captureThreadCpuAffinity);
+    int cpuIndex = 0;
+    while (cpuAffinityStream >> cpuIndex)
+    {
+      this->CaptureThreadSettings.CpuAffinity.push_back(cpuIndex);
+    }
+    if (!cpuAffinityStream.eof())
+    {
+      LOCAL_LOG_ERROR("Invalid CaptureThreadCpuAffinity: \"" << captureThreadCpuAffinity << "\". Expected a space-separated list of CPU indices.");
+    }
+  }
+  const char* captureThreadSchedulingPolicy = deviceXMLElement->GetAttribute("CaptureThreadSchedulingPolicy");
+  if (captureThreadSchedulingPolicy != NULL
+      && PlusCaptureLoopScheduler::GetSchedulingPolicyFromString(captureThreadSchedulingPolicy, this->CaptureThreadSettings.SchedulingPolicy) != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("Invalid CaptureThreadSchedulingPolicy: \"" << captureThreadSchedulingPolicy << "\". Valid values: Default, Fifo, RoundRobin.");
+  }
+  deviceXMLElement->GetScalarAttribute("CaptureThreadPriority", this->CaptureThreadSettings.Priority);
+  const char* captureThreadLockMemory = deviceXMLElement->GetAttribute("CaptureThreadLockMemory");
+  if (captureThreadLockMemory != NULL)
+  {
+    this->CaptureThreadSettings.LockMemory = igsioCommon::IsEqualInsensitive(captureThreadLockMemory, "TRUE");
+  }
+
   // Parameter reading
   XML_FIND_NESTED_ELEMENT_OPTIONAL(parametersElem, deviceXMLElement, vtkPlusDevice::PARAMETERS_XML_ELEMENT_TAG.c_str());
   if (parametersElem)
@@ -1201,6 +1248,30 @@ PlusStatus vtkPlusDevice::WriteConfiguration(vtkXMLDataElement* config)
     deviceDataElement->SetDoubleAttribute("LocalTimeOffsetSec", this->GetLocalTimeOffsetSec());
   }
 
+  if (this->MaximumUpdateRateOnNewInputData != DEFAULT_MAXIMUM_UPDATE_RATE_ON_NEW_INPUT_DATA)
+  {
+    deviceDataElement->SetDoubleAttribute("MaximumUpdateRateOnNewInputData", this->MaximumUpdateRateOnNewInputData);
+  }
+
+  if (!this->CaptureThreadSettings.CpuAffinity.empty())
+  {
+    std::ostringstream cpuAffinity;
+    for (std::vector<int>::const_iterator it = this->CaptureThreadSettings.CpuAffinity.begin(); it != this->CaptureThreadSettings.CpuAffinity.end(); ++it)
+    {
+      cpuAffinity << (it == this->CaptureThreadSettings.CpuAffinity.begin() ? "" : " ") << *it;
+    }
+    deviceDataElement->SetAttribute("CaptureThreadCpuAffinity", cpuAffinity.str().c_str());
+  }
+  if (this->CaptureThreadSettings.SchedulingPolicy != PlusCaptureLoopScheduler::SCHEDULING_POLICY_DEFAULT)
+  {
+    deviceDataElement->SetAttribute("CaptureThreadSchedulingPolicy", PlusCaptureLoopScheduler::GetSchedulingPolicyAsString(this->CaptureThreadSettings.SchedulingPolicy).c_str());
+    deviceDataElement->SetIntAttribute("CaptureThreadPriority", this->CaptureThreadSettings.Priority);
+  }
+  if (this->CaptureThreadSettings.LockMemory)
+  {
+    deviceDataElement->SetAttribute("CaptureThreadLockMemory", "TRUE");
+  }
+
   // Parameters writing
   XML_FIND_NESTED_ELEMENT_CREATE_IF_MISSING(parameterList, deviceDataElement, PARAMETERS_XML_ELEMENT_TAG.c_str());
 
@@ -1361,6 +1432,24 @@ void* vtkPlusDevice::vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data)
   unsigned long updatecount = 0;
   self->ThreadAlive = true;
 
+  if (!self->CaptureThreadSettings.IsDefault())
+  {
+    // Settings that cannot be applied are reported as warnings, the acquisition continues with the default settings
+    PlusCaptureLoopScheduler::ApplyThreadSettings(self->CaptureThreadSettings);
+  }
+  self->CaptureLoopScheduler.Start(1.0 / rate);
+
+  // Only the producers of the input buffers wake up this thread
+  const bool updateOnNewInputData = self->UpdateOnNewInputData && !self->InputChannels.empty();
+  if (updateOnNewInputData)
+  {
+    for (ChannelContainerConstIterator it = self->InputChannels.begin(); it != self->InputChannels.end(); ++it)
+    {
+      (*it)->AddNewDataSignal(self->InputDataSignal);
+    }
+  }
+  const double minimumUpdatePeriodOnNewInputData = 1.0 / std::max(self->MaximumUpdateRateOnNewInputData, rate);
+
   while (self->IsRecording() && self->GetCorrectlyConfigured())
   {
     double newtime = vtkIGSIOAccurateTimer::GetSystemTime();
@@ -1372,6 +1461,10 @@ void* vtkPlusDevice::vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data)
       self->InternalUpdateRate = (FRAME_RATE_AVERAGING / difftime);
     }
 
+    // Data that is added to the inputs during the update is processed in the next iteration without delay
+    unsigned long long numberOfAddedInputItems = updateOnNewInputData ? self->GetNumberOfAddedInputItems() : 0;
+    double iterationStartTimeSec = PlusCaptureLoopScheduler::GetMonotonicTimeSec();
+
     {
       // Lock before update
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(self->UpdateMutex);
@@ -1384,19 +1477,62 @@ void* vtkPlusDevice::vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data)
       self->UpdateTime.Modified();
     }
 
-    double delay = (newtime + 1.0 / rate - vtkIGSIOAccurateTimer::GetSystemTime());
-    if (delay > 0)
+    if (updateOnNewInputData)
     {
-      vtkIGSIOAccurateTimer::Delay(delay);
+      // There are no deadlines to wait for, but the updates are still counted and the ones longer than the period are reported as overruns
+      self->CaptureLoopScheduler.RecordIteration(iterationStartTimeSec);
+
+      // Limit the update rate, data that is added in the meantime is processed in the next update
+      double minimumDelay = (newtime + minimumUpdatePeriodOnNewInputData - vtkIGSIOAccurateTimer::GetSystemTime());
+      if (minimumDelay > 0)
+      {
+        vtkIGSIOAccurateTimer::Delay(minimumDelay);
+      }
+      double delay = (newtime + 1.0 / rate - vtkIGSIOAccurateTimer::GetSystemTime());
+      if (delay > 0)
+      {
+        self->InputDataSignal->Wait([self, numberOfAddedInputItems]()
+        {
+          return self->GetNumberOfAddedInputItems() != numberOfAddedInputItems;
+        }, delay);
+      }
+    }
+    else
+    {
+      // Sleep until an absolute deadline, so that the update period does not drift and overruns are accounted for
+      self->CaptureLoopScheduler.WaitForNextDeadline();
     }
 
     updatecount++;
   }
 
+  if (updateOnNewInputData)
+  {
+    for (ChannelContainerConstIterator it = self->InputChannels.begin(); it != self->InputChannels.end(); ++it)
+    {
+      (*it)->RemoveNewDataSignal(self->InputDataSignal);
+    }
+  }
+
+  PlusCaptureLoopScheduler::Statistics statistics = self->CaptureLoopScheduler.GetStatistics();
+  LOG_DEBUG(self->GetDeviceId() << " data capture thread stopped. Number of overruns: " << statistics.NumberOfOverruns << " of " << statistics.NumberOfPeriods
+            << " periods, wake-up latency: average " << statistics.AverageWakeUpLatencySec * 1000.0 << " ms, maximum " << statistics.MaxWakeUpLatencySec * 1000.0 << " ms");
+
   self->ThreadAlive = false;
   return NULL;
 }
 
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusDevice::GetNumberOfAddedInputItems() const
+{
+  unsigned long long numberOfAddedItems = 0;
+  for (ChannelContainerConstIterator it = this->InputChannels.begin(); it != this->InputChannels.end(); ++it)
+  {
+    numberOfAddedItems += (*it)->GetNumberOfAddedItems();
+  }
+  return numberOfAddedItems;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusDevice::InternalConnect()
 {
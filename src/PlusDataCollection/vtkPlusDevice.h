@@ -9,6 +9,7 @@ See License.txt for details.
 
 // Local includes
 #include "igsioCommon.h"
+#include "PlusCaptureLoopScheduler.h"
 #include "PlusConfigure.h"
 #include "PlusStreamBufferItem.h"
 #include "vtkPlusChannel.h"
@@ -22,8 +23,10 @@ See License.txt for details.
 #include <set>
 
 // STL includes
+#include <memory>
 #include <string>
 
+class PlusNewItemSignal;
 class vtkPlusBuffer;
 class vtkPlusDataCollector;
 class vtkPlusDataSource;
@@ -153,7 +156,10 @@ public:
   /*! Clear all tool buffers */
   void ClearAllBuffers();
 
-  /*! Dump the current state of the device to sequence file (with each tools and buffers) */
+  /*!
+    Dump the current state of the device to sequence file (with each tools and buffers).
+    Use PlusBufferSnapshotWriter to write the tool buffers on a background thread.
+  */
   virtual PlusStatus WriteToolsToSequenceFile(const std::string& filename, bool useCompression = false);
 
   /*! Make this device into a copy of another device. */
@@ -162,6 +168,17 @@ public:
   /*! Get the internal update rate for this tracking system.  This is the number of buffer entry items sent by the device per second (per tool). */
   double GetInternalUpdateRate() const;
 
+  /*!
+    Get the timing statistics of the data capture thread (wake-up latency and overruns of the update deadlines).
+    If UpdateOnNewInputData is enabled then the updates are counted and the overruns are the updates that took longer than
+    the acquisition period, wake-up latency is not measured. The statistics are reset when recording is started.
+  */
+  PlusCaptureLoopScheduler::Statistics GetCaptureLoopStatistics() const;
+
+  /*! CPU affinity, scheduling policy and memory locking settings of the data capture thread, applied when recording is started */
+  void SetCaptureThreadSettings(const PlusCaptureLoopScheduler::ThreadSettings& settings);
+  PlusCaptureLoopScheduler::ThreadSettings GetCaptureThreadSettings() const;
+
   /*! Get the data source object for the specified Id name, checks both video and tools */
   PlusStatus GetDataSource(const char* aSourceId, vtkPlusDataSource*& aSource);
   PlusStatus GetDataSource(const std::string& aSourceId, vtkPlusDataSource*& aSource);
@@ -277,6 +294,11 @@ public:
 
   // Parameter interface
   virtual PlusStatus SetParameter(const std::string& key, const std::string& value);
+  /*!
+    Returns the value of a device parameter. The read-only keys CaptureLoopNumberOfPeriods, CaptureLoopNumberOfOverruns,
+    CaptureLoopNumberOfSkippedDeadlines, CaptureLoopAverageWakeUpLatencySec, CaptureLoopMaxWakeUpLatencySec, CaptureLoopMaxOverrunSec,
+    CaptureLoopWakeUpLatencyHistogram and CaptureLoopOverrunHistogram return the data capture thread timing statistics.
+  */
   virtual std::string GetParameter(const std::string& key) const;
   virtual PlusStatus GetParameter(const std::string& key, std::string& outValue) const;
 
@@ -445,6 +467,9 @@ public:
 protected:
   static void* vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data);
 
+  /*! Get the data capture thread statistics for the read-only CaptureLoop... parameter keys. Returns PLUS_FAIL if the key is not a capture loop statistics key. */
+  PlusStatus GetCaptureLoopParameter(const std::string& key, std::string& outValue) const;
+
   /*! Should be overridden to connect to the hardware */
   virtual PlusStatus InternalConnect();
 
@@ -520,6 +545,15 @@ protected:
   vtkSetMacro(StartThreadForInternalUpdates, bool);
   bool GetStartThreadForInternalUpdates() const;
 
+  vtkSetMacro(UpdateOnNewInputData, bool);
+  vtkGetMacro(UpdateOnNewInputData, bool);
+
+  vtkSetMacro(MaximumUpdateRateOnNewInputData, double);
+  vtkGetMacro(MaximumUpdateRateOnNewInputData, double);
+
+  /*! Get the total number of items that have been added to the input channels (see vtkPlusChannel::GetNumberOfAddedItems) */
+  unsigned long long GetNumberOfAddedInputItems() const;
+
   vtkSetMacro(RecordingStartTime, double);
   double GetRecordingStartTime() const;
 
@@ -587,9 +621,32 @@ protected:
   */
   bool StartThreadForInternalUpdates;
 
+  /*!
+    If enabled, then the data capture thread calls InternalUpdate as soon as new data is added to any of the input channels,
+    instead of waiting for the end of the acquisition period. If no new data is added then InternalUpdate is still called at AcquisitionRate.
+    It reduces the latency of virtual devices that process the data of other devices.
+  */
+  bool UpdateOnNewInputData;
+
+  /*!
+    Maximum rate (in Hz) of the updates that are triggered by new input data (see UpdateOnNewInputData). New data that arrives sooner
+    is processed in the next update, so that a high-rate input (e.g., a tracker that adds an item for each tool) does not run
+    InternalUpdate for each item. If it is lower than AcquisitionRate then AcquisitionRate is used.
+  */
+  double MaximumUpdateRateOnNewInputData;
+
+  /*! Notified when new data is added to the input channels, the data capture thread waits for it if UpdateOnNewInputData is enabled */
+  std::shared_ptr<PlusNewItemSignal> InputDataSignal;
+
   /*! Value to use when mixing data with another temporally calibrated device*/
   double LocalTimeOffsetSec;
 
+  /*! Settings of the data capture thread */
+  PlusCaptureLoopScheduler::ThreadSettings CaptureThreadSettings;
+
+  /*! Schedules the updates of the data capture thread on absolute deadlines and collects timing statistics */
+  PlusCaptureLoopScheduler CaptureLoopScheduler;
+
   /*! Adjust the device reporting behaviour depending on whether or not a grace period has expired */
   double MissingInputGracePeriodSec;
   /*! Adjust the device reporting behaviour depending on whether or not a grace period has expired */
@@ -0,0 +1,366 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusLockFreeTimestampedCircularBuffer.h"
+
+#include "vtkObjectFactory.h"
+
+#include <thread>
+
+vtkStandardNewMacro(vtkPlusLockFreeTimestampedCircularBuffer);
+
+//----------------------------------------------------------------------------
+vtkPlusLockFreeTimestampedCircularBuffer::vtkPlusLockFreeTimestampedCircularBuffer()
+  : Sequence(0)
+  , PublishedItems(NULL)
+  , PublishedBufferSize(0)
+  , PublishedNumberOfItems(0)
+  , PublishedLatestItemBufferIndex(0)
+  , PublishedLatestItemUid(0)
+  , PublishedLocalTimeOffsetSec(0.0)
+  , NumberOfReadRetries(0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlusLockFreeTimestampedCircularBuffer::~vtkPlusLockFreeTimestampedCircularBuffer()
+{
+  delete[] this->PublishedItems.load();
+  this->PublishedItems = NULL;
+  for (std::vector<PublishedItem*>::iterator it = this->RetiredPublishedItems.begin(); it != this->RetiredPublishedItems.end(); ++it)
+  {
+    delete[] *it;
+  }
+  this->RetiredPublishedItems.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfReadRetries: " << this->GetNumberOfReadRetries() << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::BeginPublish()
+{
+  // Odd sequence number indicates that an update is in progress
+  this->Sequence.store(this->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::EndPublish()
+{
+  this->Sequence.store(this->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlusLockFreeTimestampedCircularBuffer::BeginRead() const
+{
+  unsigned int sequence = this->Sequence.load(std::memory_order_acquire);
+  while (sequence & 1)
+  {
+    // The writer only holds the sequence odd for a few stores, so this almost never spins
+    std::this_thread::yield();
+    sequence = this->Sequence.load(std::memory_order_acquire);
+  }
+  return sequence;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusLockFreeTimestampedCircularBuffer::ReadNeedsRetry(unsigned int sequence)
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (this->Sequence.load(std::memory_order_relaxed) == sequence)
+  {
+    return false;
+  }
+  this->NumberOfReadRetries.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::PublishAllItems()
+{
+  // the caller must have locked the buffer
+  int bufferSize = this->GetBufferSize();
+  PublishedItem* items = this->PublishedItems.load(std::memory_order_relaxed);
+  if (bufferSize != this->PublishedBufferSize.load(std::memory_order_relaxed))
+  {
+    if (items != NULL)
+    {
+      // Readers may still access the previous array, keep it until the buffer is destroyed
+      this->RetiredPublishedItems.push_back(items);
+    }
+    items = (bufferSize > 0 ? new PublishedItem[bufferSize] : NULL);
+  }
+
+  this->BeginPublish();
+  for (int i = 0; i < bufferSize; ++i)
+  {
+    items[i].Uid.store(this->BufferItemContainer[i].GetUid(), std::memory_order_relaxed);
+    items[i].FilteredTimestamp.store(this->BufferItemContainer[i].GetFilteredTimestamp(0), std::memory_order_relaxed);
+  }
+  this->PublishedItems.store(items, std::memory_order_relaxed);
+  this->PublishedBufferSize.store(bufferSize, std::memory_order_relaxed);
+  this->PublishedNumberOfItems.store(this->NumberOfItems, std::memory_order_relaxed);
+  int latestItemBufferIndex = (this->WritePointer > 0) ? (this->WritePointer - 1) : (bufferSize - 1);
+  this->PublishedLatestItemBufferIndex.store(latestItemBufferIndex, std::memory_order_relaxed);
+  this->PublishedLatestItemUid.store(this->LatestItemUid, std::memory_order_relaxed);
+  this->PublishedLocalTimeOffsetSec.store(this->LocalTimeOffsetSec, std::memory_order_relaxed);
+  this->EndPublish();
+}
+
+//----------------------------------------------------------------------------
+ItemStatus vtkPlusLockFreeTimestampedCircularBuffer::GetPublishedItem(BufferItemUidType uid, PublishedItem*& item) const
+{
+  item = NULL;
+  int numberOfItems = this->PublishedNumberOfItems.load(std::memory_order_relaxed);
+  BufferItemUidType latestUid = this->PublishedLatestItemUid.load(std::memory_order_relaxed);
+  if (numberOfItems < 1 || uid > latestUid)
+  {
+    return ITEM_NOT_AVAILABLE_YET;
+  }
+  if (uid < latestUid - (numberOfItems - 1))
+  {
+    return ITEM_NOT_AVAILABLE_ANYMORE;
+  }
+  int bufferSize = this->PublishedBufferSize.load(std::memory_order_relaxed);
+  int bufferIndex = this->PublishedLatestItemBufferIndex.load(std::memory_order_relaxed) - static_cast<int>(latestUid - uid);
+  if (bufferIndex < 0)
+  {
+    bufferIndex += bufferSize;
+  }
+  if (bufferIndex < 0 || bufferIndex >= bufferSize)
+  {
+    // Inconsistent values were read, the caller will retry
+    return ITEM_UNKNOWN_ERROR;
+  }
+  item = this->PublishedItems.load(std::memory_order_relaxed) + bufferIndex;
+  return ITEM_OK;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusLockFreeTimestampedCircularBuffer::SetBufferSize(int n)
+{
+  igsioLockGuard<vtkPlusTimestampedCircularBuffer> bufferGuardedLock(this);
+  PlusStatus status = this->Superclass::SetBufferSize(n);
+  this->PublishAllItems();
+  return status;
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusLockFreeTimestampedCircularBuffer::GetNumberOfItems()
+{
+  return this->PublishedNumberOfItems.load(std::memory_order_acquire);
+}
+
+//----------------------------------------------------------------------------
+BufferItemUidType vtkPlusLockFreeTimestampedCircularBuffer::GetLatestItemUidInBuffer()
+{
+  return this->PublishedLatestItemUid.load(std::memory_order_acquire);
+}
+
+//----------------------------------------------------------------------------
+BufferItemUidType vtkPlusLockFreeTimestampedCircularBuffer::GetOldestItemUidInBuffer()
+{
+  for (;;)
+  {
+    unsigned int sequence = this->BeginRead();
+    // LatestItemUid - ( NumberOfItems - 1 ) is the oldest element in the buffer
+    BufferItemUidType oldestUid = this->PublishedLatestItemUid.load(std::memory_order_relaxed) - (this->PublishedNumberOfItems.load(std::memory_order_relaxed) - 1);
+    if (!this->ReadNeedsRetry(sequence))
+    {
+      return oldestUid;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+ItemStatus vtkPlusLockFreeTimestampedCircularBuffer::GetOldestTimeStamp(double& timestamp)
+{
+  // The oldest item may be removed from the buffer at any moment
+  // therefore we need to retrieve its UID and timestamp within a single read
+  for (;;)
+  {
+    unsigned int sequence = this->BeginRead();
+    BufferItemUidType oldestUid = this->PublishedLatestItemUid.load(std::memory_order_relaxed) - (this->PublishedNumberOfItems.load(std::memory_order_relaxed) - 1);
+    PublishedItem* item = NULL;
+    ItemStatus status = this->GetPublishedItem(oldestUid, item);
+    double oldestTimestamp = (item != NULL ? item->FilteredTimestamp.load(std::memory_order_relaxed) + this->PublishedLocalTimeOffsetSec.load(std::memory_order_relaxed) : 0);
+    if (!this->ReadNeedsRetry(sequence))
+    {
+      timestamp = oldestTimestamp;
+      return status;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+ItemStatus vtkPlusLockFreeTimestampedCircularBuffer::GetFilteredTimeStamp(const BufferItemUidType uid, double& filteredTimestamp)
+{
+  for (;;)
+  {
+    unsigned int sequence = this->BeginRead();
+    PublishedItem* item = NULL;
+    ItemStatus status = this->GetPublishedItem(uid, item);
+    double itemTimestamp = (item != NULL ? item->FilteredTimestamp.load(std::memory_order_relaxed) + this->PublishedLocalTimeOffsetSec.load(std::memory_order_relaxed) : 0);
+    if (!this->ReadNeedsRetry(sequence))
+    {
+      if (status == ITEM_NOT_AVAILABLE_ANYMORE || status == ITEM_NOT_AVAILABLE_YET)
+      {
+        LOG_WARNING("Buffer item is not in the buffer (Uid: " << uid << ")!");
+      }
+      filteredTimestamp = itemTimestamp;
+      return status;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Same divide-and-conquer search as in vtkPlusTimestampedCircularBuffer::GetItemUidFromTime,
+// but using the published item timestamps
+ItemStatus vtkPlusLockFreeTimestampedCircularBuffer::GetItemUidFromTime(const double time, BufferItemUidType& uid)
+{
+  for (;;)
+  {
+    unsigned int sequence = this->BeginRead();
+
+    ItemStatus status = ITEM_OK;
+    BufferItemUidType foundUid = 0;
+    int numberOfItems = this->PublishedNumberOfItems.load(std::memory_order_relaxed);
+    BufferItemUidType latestUid = this->PublishedLatestItemUid.load(std::memory_order_relaxed);
+    double localTimeOffsetSec = this->PublishedLocalTimeOffsetSec.load(std::memory_order_relaxed);
+
+    if (numberOfItems < 1)
+    {
+      status = ITEM_NOT_AVAILABLE_YET;
+    }
+    else if (numberOfItems == 1)
+    {
+      // There is only one item, it's the closest one to any timestamp
+      foundUid = latestUid;
+    }
+    else
+    {
+      BufferItemUidType lo = latestUid - (numberOfItems - 1); // oldest item UID
+      BufferItemUidType hi = latestUid; // latest item UID
+      PublishedItem* loItem = NULL;
+      PublishedItem* hiItem = NULL;
+      if (this->GetPublishedItem(lo, loItem) != ITEM_OK || this->GetPublishedItem(hi, hiItem) != ITEM_OK)
+      {
+        status = ITEM_UNKNOWN_ERROR;
+      }
+      else
+      {
+        double tlo = loItem->FilteredTimestamp.load(std::memory_order_relaxed) + localTimeOffsetSec;
+        double thi = hiItem->FilteredTimestamp.load(std::memory_order_relaxed) + localTimeOffsetSec;
+
+        // If the timestamp is slightly out of range then still accept it
+        // (due to errors in conversions there could be slight differences)
+        if (time < tlo - this->NegligibleTimeDifferenceSec)
+        {
+          status = ITEM_NOT_AVAILABLE_ANYMORE;
+        }
+        else if (time > thi + this->NegligibleTimeDifferenceSec)
+        {
+          status = ITEM_NOT_AVAILABLE_YET;
+        }
+        else
+        {
+          while (hi - lo > 1)
+          {
+            BufferItemUidType mid = (lo + hi) / 2;
+            PublishedItem* midItem = NULL;
+            if (this->GetPublishedItem(mid, midItem) != ITEM_OK)
+            {
+              status = ITEM_UNKNOWN_ERROR;
+              break;
+            }
+            double tmid = midItem->FilteredTimestamp.load(std::memory_order_relaxed) + localTimeOffsetSec;
+            if (time < tmid)
+            {
+              hi = mid;
+              thi = tmid;
+            }
+            else
+            {
+              lo = mid;
+              tlo = tmid;
+            }
+          }
+          foundUid = (time - tlo > thi - time) ? hi : lo;
+        }
+      }
+    }
+
+    if (!this->ReadNeedsRetry(sequence))
+    {
+      if (status == ITEM_OK)
+      {
+        uid = foundUid;
+      }
+      return status;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::SetLocalTimeOffsetSec(double offsetSec)
+{
+  igsioLockGuard<vtkPlusTimestampedCircularBuffer> bufferGuardedLock(this);
+  this->Superclass::SetLocalTimeOffsetSec(offsetSec);
+  this->BeginPublish();
+  this->PublishedLocalTimeOffsetSec.store(offsetSec, std::memory_order_relaxed);
+  this->EndPublish();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::DeepCopy(vtkPlusTimestampedCircularBuffer* buffer)
+{
+  this->Superclass::DeepCopy(buffer);
+  igsioLockGuard<vtkPlusTimestampedCircularBuffer> bufferGuardedLock(this);
+  this->PublishAllItems();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusLockFreeTimestampedCircularBuffer::Clear()
+{
+  igsioLockGuard<vtkPlusTimestampedCircularBuffer> bufferGuardedLock(this);
+  this->Superclass::Clear();
+  this->PublishAllItems();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusLockFreeTimestampedCircularBuffer::PrepareForNewItem(const double timestamp, BufferItemUidType& newFrameUid, int& bufferIndex)
+{
+  igsioLockGuard<vtkPlusTimestampedCircularBuffer> bufferGuardedLock(this);
+  if (this->Superclass::PrepareForNewItem(timestamp, newFrameUid, bufferIndex) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  // The timestamp that the buffer item is prepared with is the filtered timestamp of the new item,
+  // so the UID and timestamp can be published right away. The item content is written by the caller
+  // while the buffer is still locked, therefore readers that access the content must lock the buffer.
+  PublishedItem* items = this->PublishedItems.load(std::memory_order_relaxed);
+  if (items == NULL || bufferIndex >= this->PublishedBufferSize.load(std::memory_order_relaxed))
+  {
+    LOG_ERROR("Failed to publish new buffer item - buffer is not allocated (bufferIndex: " << bufferIndex << ").");
+    return PLUS_FAIL;
+  }
+  this->BeginPublish();
+  items[bufferIndex].Uid.store(newFrameUid, std::memory_order_relaxed);
+  items[bufferIndex].FilteredTimestamp.store(timestamp, std::memory_order_relaxed);
+  this->PublishedNumberOfItems.store(this->NumberOfItems, std::memory_order_relaxed);
+  this->PublishedLatestItemBufferIndex.store(bufferIndex, std::memory_order_relaxed);
+  this->PublishedLatestItemUid.store(newFrameUid, std::memory_order_relaxed);
+  this->EndPublish();
+
+  return PLUS_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusLockFreeTimestampedCircularBuffer_h
+#define __vtkPlusLockFreeTimestampedCircularBuffer_h
+
+#include "vtkPlusTimestampedCircularBuffer.h"
+
+#include <atomic>
+#include <vector>
+
+/*!
+  \class vtkPlusLockFreeTimestampedCircularBuffer
+  \brief Timestamped circular buffer that allows reading item UIDs and timestamps without locking the buffer.
+
+  The frequently called accessors (latest/oldest item UID, timestamps, UID lookup by time) are served from
+  a copy of the item UIDs and filtered timestamps that the writer publishes under a sequence lock (seqlock):
+  the writer increments a sequence number before and after updating the published values and readers retry
+  if the sequence number was odd or changed while they were reading. Readers never block the writer and
+  each other, they only retry if an item was added while they were reading.
+
+  Writers are still serialized by the buffer mutex and the item content (image, matrix, fields) must still be
+  accessed with the buffer locked (as in vtkPlusTimestampedCircularBuffer).
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusLockFreeTimestampedCircularBuffer : public vtkPlusTimestampedCircularBuffer
+{
+public:
+  static vtkPlusLockFreeTimestampedCircularBuffer* New();
+  vtkTypeMacro(vtkPlusLockFreeTimestampedCircularBuffer, vtkPlusTimestampedCircularBuffer);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  virtual PlusStatus SetBufferSize(int n);
+  virtual int GetNumberOfItems();
+
+  virtual ItemStatus GetItemUidFromTime(const double time, BufferItemUidType& uid);
+  virtual BufferItemUidType GetLatestItemUidInBuffer();
+  virtual BufferItemUidType GetOldestItemUidInBuffer();
+  virtual ItemStatus GetOldestTimeStamp(double& timestamp);
+  virtual ItemStatus GetFilteredTimeStamp(const BufferItemUidType uid, double& filteredTimestamp);
+
+  virtual void SetLocalTimeOffsetSec(double offsetSec);
+
+  virtual void DeepCopy(vtkPlusTimestampedCircularBuffer* buffer);
+  virtual void Clear();
+
+  virtual PlusStatus PrepareForNewItem(const double timestamp, BufferItemUidType& newFrameUid, int& bufferIndex);
+
+  /*! Number of times a reader had to repeat reading because an item was added meanwhile (for diagnostics) */
+  unsigned long long GetNumberOfReadRetries() const { return this->NumberOfReadRetries.load(std::memory_order_relaxed); }
+
+protected:
+  vtkPlusLockFreeTimestampedCircularBuffer();
+  ~vtkPlusLockFreeTimestampedCircularBuffer();
+
+  /*! UID and filtered timestamp of an item, as seen by the readers */
+  struct PublishedItem
+  {
+    PublishedItem() : Uid(0), FilteredTimestamp(0) {}
+    std::atomic<BufferItemUidType> Uid;
+    std::atomic<double> FilteredTimestamp;
+  };
+
+  /*! Start updating the published values. Buffer must be locked. */
+  void BeginPublish();
+  /*! Finish updating the published values. Buffer must be locked. */
+  void EndPublish();
+
+  /*! Wait until no update is in progress and return the sequence number */
+  unsigned int BeginRead() const;
+  /*! Returns true if the values that have been read since BeginRead may be inconsistent */
+  bool ReadNeedsRetry(unsigned int sequence);
+
+  /*! Publish all items of the buffer (after buffer size change, clear, copy). Buffer must be locked. */
+  void PublishAllItems();
+
+  /*! Find the published item of an UID. Must be called between BeginRead and ReadNeedsRetry. */
+  ItemStatus GetPublishedItem(BufferItemUidType uid, PublishedItem*& item) const;
+
+protected:
+  std::atomic<unsigned int> Sequence;
+
+  std::atomic<PublishedItem*> PublishedItems;
+  std::atomic<int> PublishedBufferSize;
+  std::atomic<int> PublishedNumberOfItems;
+  std::atomic<int> PublishedLatestItemBufferIndex;
+  std::atomic<BufferItemUidType> PublishedLatestItemUid;
+  std::atomic<double> PublishedLocalTimeOffsetSec;
+
+  /*!
+    Arrays of published items that have been replaced because of a buffer size change.
+    They are only deleted in the destructor, as a reader may still be reading them.
+  */
+  std::vector<PublishedItem*> RetiredPublishedItems;
+
+  std::atomic<unsigned long long> NumberOfReadRetries;
+
+private:
+  vtkPlusLockFreeTimestampedCircularBuffer(const vtkPlusLockFreeTimestampedCircularBuffer&);
+  void operator=(const vtkPlusLockFreeTimestampedCircularBuffer&);
+};
+
+#endif
@@ -0,0 +1,345 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+\file vtkPlusForoughiBoneSurfaceProbabilityTest.cxx
+\brief Verifies the bone surface probability computed by vtkPlusForoughiBoneSurfaceProbability.
+
+The output for synthetic images is compared to a straightforward implementation of the original algorithm
+(2D Gaussian convolution, shadow value computed by summing the whole column below each pixel), with different
+image sizes and number of threads.
+
+If an input and a baseline sequence file are specified then the filter is applied to each frame of the input
+sequence (the same way as in EnhanceBone) and the result is compared to the baseline, which was computed
+by the Intel MKL based implementation.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusForoughiBoneSurfaceProbability.h"
+#include "vtkPlusSequenceIO.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <igsioVideoFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// VTK includes
+#include <vtkImageCast.h>
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+  // Maximum difference from the reference implementation (output range is 0..255)
+  const double MAX_REFERENCE_DIFFERENCE = 1e-6;
+  // Maximum difference from the baseline, one gray level is allowed because of rounding differences at the conversion to unsigned char
+  const int MAX_BASELINE_DIFFERENCE = 1;
+
+  //----------------------------------------------------------------------------
+  void NormalizeReference(std::vector<double>& buffer, bool doInverse, double maxValue)
+  {
+    double maxPixelValue = *std::max_element(buffer.begin(), buffer.end()) / maxValue;
+    for (unsigned int i = 0; i < buffer.size(); ++i)
+    {
+      buffer[i] = (doInverse ? maxValue - buffer[i] / maxPixelValue : buffer[i] / maxPixelValue);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Original algorithm, with default filter parameters
+  void ComputeReferenceBoneSurfaceProbability(const double* input, std::vector<double>& output, int nx, int ny)
+  {
+    const double smoothingSigma = 5.0;
+    const double shadowSigma = 6.0;
+    const double boneThreshold = 0.4;
+    const int blurredVSBLoG = 3;
+    const int shadowVSIntensity = 5;
+    const int transducerMargin = 60;
+
+    // 2D convolution with Gaussian kernel, pixels outside of the image are zero
+    int intervall = static_cast<int>(floor(smoothingSigma * 3));
+    std::vector<double> gaussian(nx * ny, 0.0);
+    for (int y = 0; y < ny; ++y)
+    {
+      for (int x = 0; x < nx; ++x)
+      {
+        double sum = 0;
+        for (int ky = std::max(-intervall, -y); ky <= std::min(intervall, ny - 1 - y); ++ky)
+        {
+          for (int kx = std::max(-intervall, -x); kx <= std::min(intervall, nx - 1 - x); ++kx)
+          {
+            sum += exp(-((kx * kx) / (2 * smoothingSigma * smoothingSigma) + (ky * ky) / (2 * smoothingSigma * smoothingSigma))) * input[(x + kx) + (y + ky) * nx];
+          }
+        }
+        gaussian[x + y * nx] = sum;
+      }
+    }
+    NormalizeReference(gaussian, false, 1.0);
+
+    // Laplacian of Gaussian
+    std::vector<double> laplacianOfGaussian(nx * ny, 0.0);
+    for (int y = 0; y < ny; ++y)
+    {
+      for (int x = 0; x < nx; ++x)
+      {
+        double value = 4 * gaussian[x + y * nx];
+        value -= (x > 0 ? gaussian[x - 1 + y * nx] : 0.0);
+        value -= (x < nx - 1 ? gaussian[x + 1 + y * nx] : 0.0);
+        value -= (y > 0 ? gaussian[x + (y - 1) * nx] : 0.0);
+        value -= (y < ny - 1 ? gaussian[x + (y + 1) * nx] : 0.0);
+        laplacianOfGaussian[x + y * nx] = value;
+      }
+    }
+
+    std::vector<double> shadowModel(ny, 0.0);
+    for (int i = 0; i < ny - 5; ++i)
+    {
+      shadowModel[i] = 1 - exp(- (i * i - 1) / (2 * shadowSigma * shadowSigma));
+    }
+
+    // Reflection number and shadow value
+    std::vector<double> reflectionNumbers(nx * ny, 0.0);
+    std::vector<double> shadowValues(nx * ny, 0.0);
+    for (int y = 0; y < ny; ++y)
+    {
+      for (int x = 0; x < nx; ++x)
+      {
+        int pixelIdx = x + y * nx;
+        if (gaussian[pixelIdx] < boneThreshold || pixelIdx <= transducerMargin * nx)
+        {
+          continue;
+        }
+        double laplacian = laplacianOfGaussian[pixelIdx];
+        if ((x == nx - 1 || x == 0 || y == ny - 1 || y == 0) || laplacian <= 0)
+        {
+          laplacian = 0.0;
+        }
+        else
+        {
+          laplacian /= 0.005;
+        }
+        reflectionNumbers[pixelIdx] = pow(gaussian[pixelIdx], blurredVSBLoG) + laplacian;
+        double sumG = 0;
+        double sumGI = 0;
+        for (int i = y; i < ny; ++i)
+        {
+          sumG += shadowModel[i - y];
+          sumGI += shadowModel[i - y] * gaussian[x + i * nx];
+        }
+        shadowValues[pixelIdx] = sumGI / sumG;
+      }
+    }
+    NormalizeReference(reflectionNumbers, false, 1.0);
+    NormalizeReference(shadowValues, true, 1.0);
+
+    output.resize(nx * ny);
+    for (int i = 0; i < nx * ny; ++i)
+    {
+      output[i] = pow(shadowValues[i], shadowVSIntensity) * reflectionNumbers[i];
+    }
+    NormalizeReference(output, false, 255.0);
+  }
+
+  //----------------------------------------------------------------------------
+  // Speckle background with a bright, wavy bone surface and dark shadow below it
+  void GenerateBoneImage(vtkImageData* image, int nx, int ny)
+  {
+    image->SetExtent(0, nx - 1, 0, ny - 1, 0, 0);
+    image->AllocateScalars(VTK_DOUBLE, 1);
+    double* pixel = static_cast<double*>(image->GetScalarPointer());
+    unsigned int randomState = 12345;
+    for (int y = 0; y < ny; ++y)
+    {
+      for (int x = 0; x < nx; ++x)
+      {
+        randomState = randomState * 1103515245 + 12345;
+        double value = 20 + ((randomState >> 16) % 40);
+        int boneSurfaceY = ny * 2 / 3 + static_cast<int>(8 * sin(x * 0.1));
+        if (abs(y - boneSurfaceY) < 3)
+        {
+          value += 200;
+        }
+        else if (y > boneSurfaceY)
+        {
+          value *= 0.2;
+        }
+        *(pixel++) = value;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareToReference(int nx, int ny, int numberOfThreads)
+  {
+    vtkSmartPointer<vtkImageData> inputImage = vtkSmartPointer<vtkImageData>::New();
+    GenerateBoneImage(inputImage, nx, ny);
+
+    vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability> boneSurfaceFilter = vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability>::New();
+    boneSurfaceFilter->SetNumberOfThreads(numberOfThreads);
+    boneSurfaceFilter->ProfilingEnabledOn();
+    boneSurfaceFilter->SetInputData(inputImage);
+    boneSurfaceFilter->Update();
+
+    std::vector<double> referenceOutput;
+    ComputeReferenceBoneSurfaceProbability(static_cast<double*>(inputImage->GetScalarPointer()), referenceOutput, nx, ny);
+
+    int numberOfErrors = 0;
+    const double* output = static_cast<double*>(boneSurfaceFilter->GetOutput()->GetScalarPointer());
+    double maxDifference = 0;
+    for (int i = 0; i < nx * ny; ++i)
+    {
+      maxDifference = std::max(maxDifference, fabs(output[i] - referenceOutput[i]));
+    }
+    LOG_INFO(nx << "x" << ny << " image, " << numberOfThreads << " threads: maximum difference from reference = " << maxDifference);
+    if (!(maxDifference <= MAX_REFERENCE_DIFFERENCE))
+    {
+      LOG_ERROR(nx << "x" << ny << " image, " << numberOfThreads << " threads: difference from reference is too large: " << maxDifference << " (maximum: " << MAX_REFERENCE_DIFFERENCE << ")");
+      numberOfErrors++;
+    }
+
+    std::vector<std::string> stageNames;
+    std::vector<double> stageTimesSec;
+    boneSurfaceFilter->GetStageTimings(stageNames, stageTimesSec);
+    if (stageNames.empty() || boneSurfaceFilter->GetNumberOfTimedFrames() != 1)
+    {
+      LOG_ERROR("Stage timings are not recorded (" << stageNames.size() << " stages, " << boneSurfaceFilter->GetNumberOfTimedFrames() << " frames)");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareToBaseline(const std::string& inputSeqFileName, const std::string& baselineSeqFileName)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> inputFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (vtkPlusSequenceIO::Read(inputSeqFileName, inputFrameList) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to read sequence file: " << inputSeqFileName);
+      return 1;
+    }
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> baselineFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (vtkPlusSequenceIO::Read(baselineSeqFileName, baselineFrameList) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to read sequence file: " << baselineSeqFileName);
+      return 1;
+    }
+    if (inputFrameList->GetNumberOfTrackedFrames() != baselineFrameList->GetNumberOfTrackedFrames())
+    {
+      LOG_ERROR("Number of frames mismatch (input: " << inputFrameList->GetNumberOfTrackedFrames() << ", baseline: " << baselineFrameList->GetNumberOfTrackedFrames() << ")");
+      return 1;
+    }
+
+    vtkSmartPointer<vtkImageCast> castToDouble = vtkSmartPointer<vtkImageCast>::New();
+    castToDouble->SetOutputScalarTypeToDouble();
+    vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability> boneSurfaceFilter = vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability>::New();
+    boneSurfaceFilter->SetInputConnection(castToDouble->GetOutputPort());
+    vtkSmartPointer<vtkImageCast> castToUnsignedChar = vtkSmartPointer<vtkImageCast>::New();
+    castToUnsignedChar->SetOutputScalarTypeToUnsignedChar();
+    castToUnsignedChar->SetInputConnection(boneSurfaceFilter->GetOutputPort());
+
+    int numberOfErrors = 0;
+    for (unsigned int frameIndex = 0; frameIndex < inputFrameList->GetNumberOfTrackedFrames(); ++frameIndex)
+    {
+      castToDouble->SetInputData(inputFrameList->GetTrackedFrame(frameIndex)->GetImageData()->GetImage());
+      castToUnsignedChar->Update();
+
+      vtkImageData* outputImage = castToUnsignedChar->GetOutput();
+      vtkImageData* baselineImage = baselineFrameList->GetTrackedFrame(frameIndex)->GetImageData()->GetImage();
+      int outputDimensions[3] = {0, 0, 0};
+      int baselineDimensions[3] = {0, 0, 0};
+      outputImage->GetDimensions(outputDimensions);
+      baselineImage->GetDimensions(baselineDimensions);
+      if (outputDimensions[0] != baselineDimensions[0] || outputDimensions[1] != baselineDimensions[1] || outputDimensions[2] != baselineDimensions[2]
+          || baselineImage->GetScalarType() != VTK_UNSIGNED_CHAR)
+      {
+        LOG_ERROR("Frame " << frameIndex << ": output image size or type does not match the baseline");
+        numberOfErrors++;
+        continue;
+      }
+
+      const unsigned char* outputPixels = static_cast<unsigned char*>(outputImage->GetScalarPointer());
+      const unsigned char* baselinePixels = static_cast<unsigned char*>(baselineImage->GetScalarPointer());
+      int numberOfPixels = outputDimensions[0] * outputDimensions[1] * outputDimensions[2];
+      int maxDifference = 0;
+      for (int i = 0; i < numberOfPixels; ++i)
+      {
+        maxDifference = std::max(maxDifference, abs(static_cast<int>(outputPixels[i]) - static_cast<int>(baselinePixels[i])));
+      }
+      if (maxDifference > MAX_BASELINE_DIFFERENCE)
+      {
+        LOG_ERROR("Frame " << frameIndex << ": difference from baseline is too large: " << maxDifference << " (maximum: " << MAX_BASELINE_DIFFERENCE << ")");
+        numberOfErrors++;
+      }
+    }
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  std::string inputSeqFileName;
+  std::string baselineSeqFileName;
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--input-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputSeqFileName, "Optional ultrasound sequence to process.");
+  args.AddArgument("--baseline-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &baselineSeqFileName, "Expected bone surface probability sequence (computed from the input sequence by EnhanceBone).");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+  numberOfErrors += CompareToReference(128, 200, 1);
+  numberOfErrors += CompareToReference(97, 241, 3);
+  // Image that is only slightly taller than the transducer margin
+  numberOfErrors += CompareToReference(64, 70, 2);
+
+  if (!inputSeqFileName.empty() || !baselineSeqFileName.empty())
+  {
+    if (inputSeqFileName.empty() || baselineSeqFileName.empty())
+    {
+      LOG_ERROR("Both --input-seq-file and --baseline-seq-file are required for comparison to baseline");
+      numberOfErrors++;
+    }
+    else
+    {
+      numberOfErrors += CompareToBaseline(inputSeqFileName, baselineSeqFileName);
+    }
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+\file vtkPlusRfToBrightnessConvertTest.cxx
+\brief Verifies that the FFT envelope detection method of vtkPlusRfToBrightnessConvert provides the same
+brightness image as the FIR method within the documented tolerance.
+
+The input is synthetic RF_REAL data (Gaussian echo pulses modulated by a carrier, with noise).
+Scan lines with a power of two and with an arbitrary length and an odd number of scan lines
+(one scan line of the last pair is transformed alone) are tested.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusRfToBrightnessConvert.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+  // Documented tolerance of the FFT method compared to the FIR method with the default filter
+  const double MAX_MEAN_ABSOLUTE_DIFFERENCE = 1.5;
+  const int DIFFERENCE_PERCENTILE_THRESHOLD = 4;
+  const double MIN_RATIO_WITHIN_THRESHOLD = 0.95;
+
+  //----------------------------------------------------------------------------
+  void GenerateRfData(vtkImageData* rfImage, int numberOfSamples, int numberOfLines)
+  {
+    rfImage->SetExtent(0, numberOfSamples - 1, 0, numberOfLines - 1, 0, 0);
+    rfImage->AllocateScalars(VTK_SHORT, 1);
+    short* rfPtr = static_cast<short*>(rfImage->GetScalarPointer());
+    unsigned int randomState = 12345;
+    for (int line = 0; line < numberOfLines; line++)
+    {
+      for (int i = 0; i < numberOfSamples; i++)
+      {
+        double envelope = 200.0 * exp(-i / 1000.0);
+        for (int echo = 0; echo < 8; echo++)
+        {
+          double center = (echo * 997 + line * 31) % numberOfSamples;
+          double width = 20.0 + echo * 5.0;
+          envelope += (2000.0 + 3000.0 * echo / 8.0) * exp(-(i - center) * (i - center) / (2 * width * width));
+        }
+        randomState = randomState * 1103515245 + 12345;
+        int noise = static_cast<int>((randomState >> 16) % 101) - 50;
+        double value = envelope * sin(2 * vtkMath::Pi() * 0.12 * i + line) + noise;
+        *(rfPtr++) = static_cast<short>(std::max(-32768.0, std::min(32767.0, value)));
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  int CompareEnvelopeDetectionMethods(int numberOfSamples, int numberOfLines)
+  {
+    vtkSmartPointer<vtkImageData> rfImage = vtkSmartPointer<vtkImageData>::New();
+    GenerateRfData(rfImage, numberOfSamples, numberOfLines);
+
+    vtkSmartPointer<vtkPlusRfToBrightnessConvert> firConverter = vtkSmartPointer<vtkPlusRfToBrightnessConvert>::New();
+    firConverter->SetImageType(US_IMG_RF_REAL);
+    firConverter->SetEnvelopeDetectionMethod(vtkPlusRfToBrightnessConvert::ENVELOPE_DETECTION_FIR);
+    firConverter->SetInputData(rfImage);
+    firConverter->Update();
+
+    vtkSmartPointer<vtkPlusRfToBrightnessConvert> fftConverter = vtkSmartPointer<vtkPlusRfToBrightnessConvert>::New();
+    fftConverter->SetImageType(US_IMG_RF_REAL);
+    fftConverter->SetEnvelopeDetectionMethod(vtkPlusRfToBrightnessConvert::ENVELOPE_DETECTION_FFT);
+    fftConverter->SetInputData(rfImage);
+    fftConverter->Update();
+
+    int firDimensions[3] = {0, 0, 0};
+    int fftDimensions[3] = {0, 0, 0};
+    firConverter->GetOutput()->GetDimensions(firDimensions);
+    fftConverter->GetOutput()->GetDimensions(fftDimensions);
+    if (firDimensions[0] != numberOfSamples || firDimensions[1] != numberOfLines
+        || fftDimensions[0] != numberOfSamples || fftDimensions[1] != numberOfLines)
+    {
+      LOG_ERROR("Unexpected output image size: FIR " << firDimensions[0] << "x" << firDimensions[1] << ", FFT " << fftDimensions[0] << "x" << fftDimensions[1]);
+      return 1;
+    }
+
+    // Samples at the ends of the scan lines are set to zero by the FIR method
+    int numberOfSkippedSamples = firConverter->GetNumberOfHilbertFilterCoeffs() / 2 + 1;
+    const unsigned char* firPtr = static_cast<unsigned char*>(firConverter->GetOutput()->GetScalarPointer());
+    const unsigned char* fftPtr = static_cast<unsigned char*>(fftConverter->GetOutput()->GetScalarPointer());
+    long long sumOfDifferences = 0;
+    long long numberOfComparedSamples = 0;
+    long long numberOfSamplesWithinThreshold = 0;
+    int numberOfNonZeroFftLines = 0;
+    for (int line = 0; line < numberOfLines; line++)
+    {
+      const unsigned char* firLine = firPtr + line * numberOfSamples;
+      const unsigned char* fftLine = fftPtr + line * numberOfSamples;
+      bool nonZeroFftLine = false;
+      for (int i = numberOfSkippedSamples; i < numberOfSamples - numberOfSkippedSamples; i++)
+      {
+        int difference = abs(static_cast<int>(firLine[i]) - static_cast<int>(fftLine[i]));
+        sumOfDifferences += difference;
+        numberOfComparedSamples++;
+        if (difference <= DIFFERENCE_PERCENTILE_THRESHOLD)
+        {
+          numberOfSamplesWithinThreshold++;
+        }
+        if (fftLine[i] != 0)
+        {
+          nonZeroFftLine = true;
+        }
+      }
+      if (nonZeroFftLine)
+      {
+        numberOfNonZeroFftLines++;
+      }
+    }
+
+    int numberOfErrors = 0;
+    double meanAbsoluteDifference = static_cast<double>(sumOfDifferences) / numberOfComparedSamples;
+    double ratioWithinThreshold = static_cast<double>(numberOfSamplesWithinThreshold) / numberOfComparedSamples;
+    LOG_INFO(numberOfSamples << " samples x " << numberOfLines << " lines: mean absolute difference = " << meanAbsoluteDifference
+             << ", " << ratioWithinThreshold * 100 << "% of the samples differ by at most " << DIFFERENCE_PERCENTILE_THRESHOLD << " gray levels");
+    if (meanAbsoluteDifference > MAX_MEAN_ABSOLUTE_DIFFERENCE)
+    {
+      LOG_ERROR("Mean absolute difference between FIR and FFT methods is too large: " << meanAbsoluteDifference << " (maximum: " << MAX_MEAN_ABSOLUTE_DIFFERENCE << ")");
+      numberOfErrors++;
+    }
+    if (ratioWithinThreshold < MIN_RATIO_WITHIN_THRESHOLD)
+    {
+      LOG_ERROR("Too many samples differ between FIR and FFT methods: " << ratioWithinThreshold * 100 << "% within " << DIFFERENCE_PERCENTILE_THRESHOLD << " gray levels (minimum: " << MIN_RATIO_WITHIN_THRESHOLD * 100 << "%)");
+      numberOfErrors++;
+    }
+    if (numberOfNonZeroFftLines != numberOfLines)
+    {
+      LOG_ERROR("Only " << numberOfNonZeroFftLines << " of " << numberOfLines << " scan lines are processed by the FFT method");
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+  numberOfErrors += CompareEnvelopeDetectionMethods(4096, 128);
+  numberOfErrors += CompareEnvelopeDetectionMethods(2000, 127);
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
@@ -9,6 +9,7 @@ See License.txt for details.
 #include "igsioTrackedFrame.h"
 #include "vtkPlusForoughiBoneSurfaceProbability.h"
 #include "vtkImageCast.h"
+#include "vtkIGSIOAccurateTimer.h"
 #include "vtkImageData.h"
 #include "vtkMetaImageReader.h"
 #include "vtkMetaImageWriter.h"
@@ -72,25 +73,57 @@ int main(int argc, char** argv)
 
   vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability> boneSurfaceFilter = vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability>::New();
   boneSurfaceFilter->SetInputConnection(castToDouble->GetOutputPort());
+  boneSurfaceFilter->ProfilingEnabledOn();
   
   vtkSmartPointer<vtkImageCast> castToUnsignedChar = vtkSmartPointer<vtkImageCast>::New();
   castToUnsignedChar->SetOutputScalarTypeToUnsignedChar();
   castToUnsignedChar->SetInputConnection(boneSurfaceFilter->GetOutputPort());
 
+  // Total processing time of each stage
+  double castToDoubleTimeSec = 0;
+  double boneSurfaceTimeSec = 0;
+  double castToUnsignedCharTimeSec = 0;
+
   int numberOfFrames = trackedFrameList->GetNumberOfTrackedFrames();
   LOG_INFO("Processing "<<numberOfFrames<<" frames...");
   for (int frameIndex = 0; frameIndex < numberOfFrames; frameIndex++)
   {
-    TrackedFrame* frame = trackedFrameList->GetTrackedFrame(frameIndex);
+    igsioTrackedFrame* frame = trackedFrameList->GetTrackedFrame(frameIndex);
     vtkImageData* imageData = frame->GetImageData()->GetImage();
 
+    // Stages are updated one by one so that each of them can be timed
+    double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
     castToDouble->SetInputData(imageData);
+    castToDouble->Update();
+    double stageEndTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    castToDoubleTimeSec += stageEndTime - stageStartTime;
+    stageStartTime = stageEndTime;
+    boneSurfaceFilter->Update();
+    stageEndTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    boneSurfaceTimeSec += stageEndTime - stageStartTime;
+    stageStartTime = stageEndTime;
     castToUnsignedChar->Update();
+    castToUnsignedCharTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - stageStartTime;
 
     // Write back the processed output to the input trackedframelist
     frame->GetImageData()->DeepCopyFrom(castToUnsignedChar->GetOutput());
   }
 
+  if (numberOfFrames > 0)
+  {
+    LOG_INFO("Stage CastToDouble: " << castToDoubleTimeSec * 1000.0 / numberOfFrames << " ms/frame");
+    LOG_INFO("Stage BoneSurfaceProbability: " << boneSurfaceTimeSec * 1000.0 / numberOfFrames << " ms/frame");
+    std::vector<std::string> filterStageNames;
+    std::vector<double> filterStageTimesSec;
+    boneSurfaceFilter->GetStageTimings(filterStageNames, filterStageTimesSec);
+    for (unsigned int stageIndex = 0; stageIndex < filterStageNames.size(); ++stageIndex)
+    {
+      LOG_INFO("  " << filterStageNames[stageIndex] << ": " << filterStageTimesSec[stageIndex] * 1000.0 / numberOfFrames << " ms/frame");
+    }
+    LOG_INFO("Stage CastToUnsignedChar: " << castToUnsignedCharTimeSec * 1000.0 / numberOfFrames << " ms/frame");
+    LOG_INFO("Total processing time: " << (castToDoubleTimeSec + boneSurfaceTimeSec + castToUnsignedCharTimeSec) * 1000.0 / numberOfFrames << " ms/frame");
+  }
+
   // Write the new TrackedFrameList to metafile
   LOG_INFO("Writing new sequence to file...");
   if (outputImgSeqFileName.empty())
@@ -12,6 +12,7 @@
 #include "vtksys/CommandLineArguments.hxx"
 
 #include "string"
+#include <vector>
 
 int main(int argc, char **argv)
 {
@@ -128,6 +129,22 @@ int main(int argc, char **argv)
     return EXIT_FAILURE;
   }
 
+  // Report the average processing time of each stage
+  std::vector<std::string> stageNames;
+  std::vector<double> stageTimesSec;
+  boneFilter->GetStageTimings(stageNames, stageTimesSec);
+  int numberOfTimedFrames = boneFilter->GetNumberOfTimedFrames();
+  if (numberOfTimedFrames > 0)
+  {
+    double totalTimeSec = 0;
+    for (unsigned int stageIndex = 0; stageIndex < stageNames.size(); ++stageIndex)
+    {
+      LOG_INFO("Stage " << stageNames[stageIndex] << ": " << stageTimesSec[stageIndex] * 1000.0 / numberOfTimedFrames << " ms/frame");
+      totalTimeSec += stageTimesSec[stageIndex];
+    }
+    LOG_INFO("Total processing time: " << totalTimeSec * 1000.0 / numberOfTimedFrames << " ms/frame (" << numberOfTimedFrames << " frames)");
+  }
+
   LOG_INFO("Writing output to file");
 
   if (saveIntermediateResults)
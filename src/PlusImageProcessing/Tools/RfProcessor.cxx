@@ -8,13 +8,16 @@ See License.txt for details.
 #include "igsioTrackedFrame.h"
 #include "vtkImageData.h" 
 #include "vtkPlusRfProcessor.h"
+#include "vtkPlusRfToBrightnessConvert.h"
 #include "vtkPlusSequenceIO.h"
 #include "vtkSmartPointer.h"
 #include "vtkIGSIOTrackedFrameList.h"
+#include "vtkIGSIOAccurateTimer.h"
 #include "vtkTransform.h"
 #include "vtkXMLUtilities.h"
 #include "vtksys/CommandLineArguments.hxx"
 #include "vtksys/SystemTools.hxx"
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 
@@ -28,6 +31,8 @@ int main(int argc, char **argv)
   std::string outputImgFile;
   std::string operation="BRIGHTNESS_SCAN_CONVERT";
   bool useCompression(true);
+  std::string envelopeDetectionMethod;
+  int benchmarkRepeat = 0;
 
   int verboseLevel=vtkPlusLogger::LOG_LEVEL_UNDEFINED;
 
@@ -40,6 +45,8 @@ int main(int argc, char **argv)
   args.AddArgument("--output-img-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputImgFile, "File name of the generated output brightness image");
   args.AddArgument("--use-compression", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &useCompression, "Use compression when outputting data");
   args.AddArgument("--operation", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &operation, "Processing operation to be applied on the input file (BRIGHTNESS_CONVERT, BRIGHTNESS_SCAN_CONVERT, default: BRIGHTNESS_SCAN_CONVERT");
+  args.AddArgument("--envelope-detection-method", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &envelopeDetectionMethod, "Override the envelope detection method of the brightness conversion (FIR, FFT, default: use the value in the config file)");
+  args.AddArgument("--benchmark-repeat", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &benchmarkRepeat, "If greater than 0 then brightness conversion of all frames is repeated the specified number of times and the throughput is reported (default: 0)");
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
 
 
@@ -139,6 +146,49 @@ int main(int argc, char **argv)
       exit(EXIT_FAILURE); 
     }
 
+    vtkPlusRfToBrightnessConvert* brightnessConverter = rfProcessor->GetRfToBrightnessConverter();
+    if (!envelopeDetectionMethod.empty())
+    {
+      if (STRCASECMP(envelopeDetectionMethod.c_str(), "FIR") == 0)
+      {
+        brightnessConverter->SetEnvelopeDetectionMethod(vtkPlusRfToBrightnessConvert::ENVELOPE_DETECTION_FIR);
+      }
+      else if (STRCASECMP(envelopeDetectionMethod.c_str(), "FFT") == 0)
+      {
+        brightnessConverter->SetEnvelopeDetectionMethod(vtkPlusRfToBrightnessConvert::ENVELOPE_DETECTION_FFT);
+      }
+      else
+      {
+        LOG_ERROR("Unknown envelope detection method: " << envelopeDetectionMethod);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    // Measure brightness conversion throughput (before the RF data in the frames is replaced by the processed output)
+    if (benchmarkRepeat > 0 && frameList->GetNumberOfTrackedFrames() > 0)
+    {
+      long long numberOfRfSamples = 0;
+      double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      for (int repeat = 0; repeat < benchmarkRepeat; repeat++)
+      {
+        for (unsigned int j = 0; j < frameList->GetNumberOfTrackedFrames(); j++)
+        {
+          igsioTrackedFrame* rfFrame = frameList->GetTrackedFrame(j);
+          rfProcessor->SetRfFrame(rfFrame->GetImageData()->GetImage(), rfFrame->GetImageData()->GetImageType());
+          // Force re-execution, even if the same frame is set again
+          brightnessConverter->Modified();
+          rfProcessor->GetBrightnessConvertedImage();
+          numberOfRfSamples += rfFrame->GetImageData()->GetImage()->GetNumberOfPoints();
+        }
+      }
+      double elapsedTimeSec = std::max(vtkIGSIOAccurateTimer::GetSystemTime() - startTime, 1e-6);
+      int numberOfProcessedFrames = benchmarkRepeat * frameList->GetNumberOfTrackedFrames();
+      LOG_INFO("Brightness conversion (" << (brightnessConverter->GetEnvelopeDetectionMethod() == vtkPlusRfToBrightnessConvert::ENVELOPE_DETECTION_FFT ? "FFT" : "FIR")
+               << " envelope detection): " << numberOfProcessedFrames << " frames in " << std::fixed << std::setprecision(3) << elapsedTimeSec << " s, "
+               << std::setprecision(1) << numberOfProcessedFrames / elapsedTimeSec << " frames/s, "
+               << numberOfRfSamples / elapsedTimeSec / 1.0e6 << " million RF samples/s");
+    }
+
     // Process the frames
     for (unsigned int j = 0; j < frameList->GetNumberOfTrackedFrames(); j++)
     {
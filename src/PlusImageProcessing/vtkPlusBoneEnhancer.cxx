@@ -7,30 +7,225 @@ See License.txt for details.
 // Local includes
 #include "PlusConfigure.h"
 #include "PlusMath.h"
+#include "PlusThreadPool.h"
+#include "vtkIGSIOAccurateTimer.h"
 #include "vtkPlusBoneEnhancer.h"
 #include "vtkPlusUsScanConvertCurvilinear.h"
 #include "vtkPlusUsScanConvertLinear.h"
 #include "vtkPlusSequenceIO.h"
 
 // VTK includes
+#include <vtkDataArray.h>
 #include <vtkImageDilateErode3D.h>
 #include <vtkImageGaussianSmooth.h>
 #include <vtkImageIslandRemoval2D.h>
 #include <vtkImageSobel2D.h>
 #include <vtkImageThreshold.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
 #include "vtkImageAlgorithm.h"
 
 #include <igsioTrackedFrame.h>
 #include <igsioVideoFrame.h>
 #include <vtkIGSIOTrackedFrameList.h>
 
-
+// STL includes
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <functional>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkPlusBoneEnhancer);
 
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Copies the pixels of the source image into the destination image, reusing the scalar array of the destination image if possible
+  void CopyImageScalars(vtkImageData* source, vtkImageData* destination)
+  {
+    if (source == destination)
+    {
+      return;
+    }
+    vtkDataArray* sourceScalars = source->GetPointData()->GetScalars();
+    vtkDataArray* destinationScalars = destination->GetPointData()->GetScalars();
+    int* sourceExtent = source->GetExtent();
+    int* destinationExtent = destination->GetExtent();
+    if (sourceScalars == NULL || destinationScalars == NULL
+        || !std::equal(sourceExtent, sourceExtent + 6, destinationExtent)
+        || sourceScalars->GetDataType() != destinationScalars->GetDataType()
+        || sourceScalars->GetNumberOfComponents() != destinationScalars->GetNumberOfComponents()
+        || sourceScalars->GetNumberOfTuples() != destinationScalars->GetNumberOfTuples())
+    {
+      destination->DeepCopy(source);
+      return;
+    }
+    memcpy(destinationScalars->GetVoidPointer(0), sourceScalars->GetVoidPointer(0),
+           sourceScalars->GetNumberOfTuples() * sourceScalars->GetNumberOfComponents() * sourceScalars->GetDataTypeSize());
+    destination->SetSpacing(source->GetSpacing());
+    destination->SetOrigin(source->GetOrigin());
+    destination->Modified();
+  }
+
+  //----------------------------------------------------------------------------
+  // A way of thresholding based on the standard deviation of a scan line: pixels that are darker than 3 standard deviations
+  // below the maximum of the scan line are removed. inputLine and outputLine may point to the same buffer.
+  void ThresholdScanLine(const unsigned char* inputLine, unsigned char* outputLine, int lineLengthPx)
+  {
+    int fatLayerToCut = 20; //The area of fat too close to the transducer should not be considered
+
+    float vInput = 0;
+    int max = 0;
+
+    //values used to calculate the standard deviation
+    int pixelSum = 0;
+    int squearSum = 0;
+    float pixelAverage = 0;
+    float meanDiffSum;
+    float meanDiffAverage;
+    float thresholdValue;
+
+    //determine the average, sum, and max of the row
+    for (int x = lineLengthPx - 1; x >= fatLayerToCut; --x)
+    {
+      vInput = inputLine[x];
+      pixelSum += vInput;
+      squearSum += vInput * vInput;
+
+      if (vInput > max)
+      {
+        max = vInput;
+      }
+    }
+    pixelAverage = pixelSum / (lineLengthPx - fatLayerToCut);
+
+    //determine the standard deviation of the row
+    meanDiffSum = squearSum + (lineLengthPx - fatLayerToCut) * pixelAverage * pixelAverage + (-2 * pixelAverage * pixelSum);
+    meanDiffAverage = meanDiffSum / (lineLengthPx - fatLayerToCut);
+    thresholdValue = max - 3 * pow(meanDiffAverage, 0.5f);
+
+    //if a pixel's value is too low, remove it
+    if (pixelSum != 0)
+    {
+      for (int x = lineLengthPx - 1; x >= 0; --x)
+      {
+        outputLine[x] = ((inputLine[x] < thresholdValue && inputLine[x] != 0) ? 0 : inputLine[x]);
+      }
+    }
+    else if (outputLine != inputLine)
+    {
+      memcpy(outputLine, inputLine, lineLengthPx);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Samples the input pixels of each scan line and optionally thresholds the scan line while it is in the cache
+  template<class T>
+  void SampleScanLines(const T* inputPixels, const vtkIdType* sampleOffsets, unsigned char* linesPixels, unsigned char* thresholdedLinesPixels,
+                       int lineLengthPx, int numberOfScanLines, int numberOfThreads)
+  {
+    PlusThreadPool::ParallelFor(0, numberOfScanLines, numberOfThreads, [ = ](int firstScanLine, int endScanLine)
+    {
+      for (int scanLine = firstScanLine; scanLine < endScanLine; ++scanLine)
+      {
+        const vtkIdType* lineSampleOffsets = sampleOffsets + scanLine * lineLengthPx;
+        unsigned char* linePixels = linesPixels + scanLine * lineLengthPx;
+        for (int pointIndex = 0; pointIndex < lineLengthPx; ++pointIndex)
+        {
+          // Samples outside of the input image are set to 0
+          linePixels[pointIndex] = (lineSampleOffsets[pointIndex] < 0 ? 0 : static_cast<unsigned char>(static_cast<float>(inputPixels[lineSampleOffsets[pointIndex]])));
+        }
+        if (thresholdedLinesPixels != NULL)
+        {
+          ThresholdScanLine(linePixels, thresholdedLinesPixels + scanLine * lineLengthPx, lineLengthPx);
+        }
+      }
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  // Computes the edge magnitude of each pixel of the gradient image and binarizes it using a lookup table
+  template<class T>
+  void BinarizeEdgeScanLines(const T* edgePixels, int numberOfEdgeComponents, unsigned char* magnitudePixels, unsigned char* binaryPixels,
+                             const unsigned char* binarizationTable, int lineLengthPx, int numberOfScanLines, int numberOfThreads)
+  {
+    PlusThreadPool::ParallelFor(0, numberOfScanLines, numberOfThreads, [ = ](int firstScanLine, int endScanLine)
+    {
+      for (int pixelIndex = firstScanLine * lineLengthPx; pixelIndex < endScanLine * lineLengthPx; ++pixelIndex)
+      {
+        // Gradient components are truncated to 8 bits the same way as a float to unsigned char conversion on x86
+        const T* edgePixel = edgePixels + pixelIndex * numberOfEdgeComponents;
+        unsigned char edgeDetectorOutput0 = static_cast<unsigned char>(static_cast<int>(static_cast<float>(edgePixel[0])));
+        unsigned char edgeDetectorOutput1 = static_cast<unsigned char>(static_cast<int>(static_cast<float>(edgePixel[1])));
+        float output = (float)(edgeDetectorOutput0 + edgeDetectorOutput1) / (float)2; // Not mathematically correct, but a quick approximation of sqrt(x^2 + y^2)
+        unsigned char magnitude = (unsigned char)std::max(0, std::min(255, (int)output));
+        if (magnitudePixels != NULL)
+        {
+          magnitudePixels[pixelIndex] = magnitude;
+        }
+        binaryPixels[pixelIndex] = binarizationTable[magnitude];
+      }
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  // Keeps only the outline of the first bone along the scan line (going towards the transducer) and removes all pixels in its shadow.
+  // Returns the position of the first bone pixel, -1 if there is no bone on the scan line.
+  int MarkShadowOutlineInScanLine(unsigned char* linePixels, int lineLengthPx, int boneOutlineDepthPx, int bonePushBackPx)
+  {
+    //When an image is detected, keep up to this many pixles after it
+    int keepInfoCounter = boneOutlineDepthPx + bonePushBackPx;
+    int firstBonePx = -1;
+
+    for (int x = lineLengthPx - 1; x >= 0; --x)
+    {
+      unsigned char* vOutput = linePixels + x;
+
+      //If an image is detected
+      if (*vOutput != 0)
+      {
+        if (keepInfoCounter == 0 || keepInfoCounter > boneOutlineDepthPx)
+        {
+          *vOutput = 0;
+        }
+        if (keepInfoCounter == boneOutlineDepthPx + bonePushBackPx && firstBonePx < 0)
+        {
+          //found the first bone
+          firstBonePx = x;
+        }
+      }
+      if (firstBonePx >= 0 && keepInfoCounter != 0)
+      {
+        if (keepInfoCounter <= boneOutlineDepthPx && *vOutput == 0)
+        {
+          *vOutput = 255;
+        }
+        keepInfoCounter--;
+        if (keepInfoCounter == 0)
+        {
+          // Everything closer to the transducer is removed
+          memset(linePixels, 0, x);
+          break;
+        }
+      }
+    }
+    return firstBonePx;
+  }
+
+  //----------------------------------------------------------------------------
+  std::map<std::string, int> CreateBoneArea(int depth, int xMax, int xMin, int yMax, int yMin)
+  {
+    std::map<std::string, int> boneArea;
+    boneArea["depth"] = depth;  // Store the outline's average x-coordinate
+    boneArea["xMax"] = xMax;    // Store the outline's maximum x-coordinate (Used for efficiency)
+    boneArea["xMin"] = xMin;    // Store the outline's minimum x-coordinate (Used for efficiency)
+    boneArea["yMax"] = yMax;    // Store the outline's maximum y-coordinate
+    boneArea["yMin"] = yMin;    // Store the outline's minimum y-coordinate
+    return boneArea;
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkPlusBoneEnhancer::vtkPlusBoneEnhancer()
 : ScanConverter(NULL),
@@ -56,15 +251,20 @@ vtkPlusBoneEnhancer::vtkPlusBoneEnhancer()
   BonePushBackPx(9),     // Horizontal distance between where a shadow is located, and where the bone begins
 
   LinesImage(NULL),
+  ThresholdedLinesImage(NULL),
+  BinarizedEdgeImage(NULL),
   ProcessedLinesImage(NULL),
   FirstFrame(true),
+  SampledInputNumberOfComponents(0),
+  NumberOfThreads(0),
+  NumberOfTimedFrames(0),
 
   SaveIntermediateResults(false)
 {
 
   this->GaussianSmooth = vtkSmartPointer<vtkImageGaussianSmooth>::New();    // Used to smooth the image
   this->EdgeDetector = vtkSmartPointer<vtkImageSobel2D>::New();             // Used to outline edges of the image
-  this->ImageBinarizer = vtkSmartPointer<vtkImageThreshold>::New();         // Used to convert into a binary image
+  this->ImageBinarizer = vtkSmartPointer<vtkImageThreshold>::New();         // Thresholds used to convert into a binary image
   this->BinaryImageForMorphology = vtkSmartPointer<vtkImageData>::New();    // The Binary image
   this->IslandRemover = vtkSmartPointer<vtkImageIslandRemoval2D>::New();    // Used to remove islands (small isolated groups of pixels)
   this->ImageEroder = vtkSmartPointer<vtkImageDilateErode3D>::New();        // Used to Erode the image
@@ -99,11 +299,17 @@ vtkPlusBoneEnhancer::vtkPlusBoneEnhancer()
   this->ImageDialator->SetDilateValue(255);
 
   this->LinesImage = vtkSmartPointer<vtkImageData>::New();
+  this->ThresholdedLinesImage = vtkSmartPointer<vtkImageData>::New();
+  this->BinarizedEdgeImage = vtkSmartPointer<vtkImageData>::New();
   this->ProcessedLinesImage = vtkSmartPointer<vtkImageData>::New();
 
   this->LinesImage->SetExtent(0, 0, 0, 0, 0, 0);
+  this->ThresholdedLinesImage->SetExtent(0, 0, 0, 0, 0, 0);
+  this->BinarizedEdgeImage->SetExtent(0, 0, 0, 0, 0, 0);
   this->ProcessedLinesImage->SetExtent(0, 0, 0, 0, 0, 0);
 
+  std::fill(this->SampledInputExtent, this->SampledInputExtent + 6, 0);
+
   this->IntermediateImageMap.clear();
 }
 
@@ -119,6 +325,7 @@ vtkPlusBoneEnhancer::~vtkPlusBoneEnhancer()
 void vtkPlusBoneEnhancer::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << std::endl;
 }
 
 //----------------------------------------------------------------------------
@@ -239,10 +446,15 @@ PlusStatus vtkPlusBoneEnhancer::ReadConfiguration(vtkSmartPointer<vtkXMLDataElem
   // Read tags related to scan lines
   XML_READ_SCALAR_ATTRIBUTE_REQUIRED(int, NumberOfScanLines, processingElement);
   XML_READ_SCALAR_ATTRIBUTE_REQUIRED(int, NumberOfSamplesPerScanLine, processingElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfThreads, processingElement);
 
   int rfImageExtent[6] = { 0, this->NumberOfSamplesPerScanLine - 1, 0, this->NumberOfScanLines - 1, 0, 0 };
   this->ScanConverter->SetInputImageExtent(rfImageExtent);
 
+  // Intermediate images and scan line sampling positions are recomputed for the new geometry on the next frame
+  this->FirstFrame = true;
+  this->ScanLineSampleOffsets.clear();
+
   return PLUS_SUCCESS;
 }
 
@@ -256,6 +468,10 @@ PlusStatus vtkPlusBoneEnhancer::WriteConfiguration(vtkSmartPointer<vtkXMLDataEle
   processingElement->SetAttribute("Type", this->GetProcessorTypeName());
   processingElement->SetIntAttribute("NumberOfScanLines", NumberOfScanLines);
   processingElement->SetIntAttribute("NumberOfSamplesPerScanLine", NumberOfSamplesPerScanLine);
+  if (this->NumberOfThreads > 0)
+  {
+    processingElement->SetIntAttribute("NumberOfThreads", this->NumberOfThreads);
+  }
 
   XML_FIND_NESTED_ELEMENT_CREATE_IF_MISSING(scanConversionElement, processingElement, "ScanConversion");
   this->ScanConverter->WriteConfiguration(scanConversionElement);
@@ -286,6 +502,7 @@ PlusStatus vtkPlusBoneEnhancer::WriteConfiguration(vtkSmartPointer<vtkXMLDataEle
   return PLUS_SUCCESS;
 }
 
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusBoneEnhancer::ProcessImageExtents()
 {
@@ -297,48 +514,62 @@ PlusStatus vtkPlusBoneEnhancer::ProcessImageExtents()
     << ", " << linesImageExtent[2] << ", " << linesImageExtent[3]
     << ", " << linesImageExtent[4] << ", " << linesImageExtent[5]);
 
-  this->BinaryImageForMorphology->SetExtent(linesImageExtent);
-  this->BinaryImageForMorphology->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
-
-  this->LinesImage->SetExtent(linesImageExtent);
-  this->LinesImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
-
-  //Set up variables related to image extents
-  int dims[3] = { 0, 0, 0 };
-  this->LinesImage->GetDimensions(dims);
+  // All intermediate images are allocated once and reused for all frames
+  vtkImageData* linesImages[] = { this->LinesImage, this->ThresholdedLinesImage, this->ConversionImage,
+                                  this->BinarizedEdgeImage, this->BinaryImageForMorphology, this->ProcessedLinesImage };
+  for (unsigned int imageIndex = 0; imageIndex < sizeof(linesImages) / sizeof(linesImages[0]); ++imageIndex)
+  {
+    linesImages[imageIndex]->SetExtent(linesImageExtent);
+    linesImages[imageIndex]->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  }
 
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
-// Fills the lines image by subsampling the input image along scanlines.
-// Also computes pixel statistics.
-void vtkPlusBoneEnhancer::FillLinesImage(vtkSmartPointer<vtkImageData> inputImageData)
+PlusStatus vtkPlusBoneEnhancer::PrepareLinesImages(vtkImageData* inputImageData)
 {
+  if (this->ScanConverter == NULL)
+  {
+    LOG_ERROR("Scan converter is not defined");
+    return PLUS_FAIL;
+  }
+
+  if (this->FirstFrame == true)
+  {
+    //set up variables for future loops
+    this->ProcessImageExtents();
+    this->FirstFrame = false;
+  }
+  this->BoneAreasInfo.clear();
+
+  int* inputExtent = inputImageData->GetExtent();
+  int numberOfComponents = inputImageData->GetNumberOfScalarComponents();
+  if (!this->ScanLineSampleOffsets.empty() && std::equal(inputExtent, inputExtent + 6, this->SampledInputExtent)
+      && numberOfComponents == this->SampledInputNumberOfComponents)
+  {
+    // Sampling positions are up-to-date
+    return PLUS_SUCCESS;
+  }
+
+  // The scan line geometry does not change between frames, so the input pixel of each sample is only computed once
   int* linesImageExtent = this->ScanConverter->GetInputImageExtent();
   int lineLengthPx = linesImageExtent[1] - linesImageExtent[0] + 1;
   int numScanLines = linesImageExtent[3] - linesImageExtent[2] + 1;
-
-  // For calculating pixel intensity mean and variance. Algorithm taken from:
-  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
-
-  double mean = 0.0;
-  double sumSquareDiff = 0.0; //named M2 in online notes
-  long pixelCount = 0;
-  double currentValue = 0.0; //temporary value for each loop. //Named value in online notes
-  double valueMeanDiff = 0.0; //Named delta in online notes
+  vtkIdType inputWidthPx = inputExtent[1] - inputExtent[0] + 1;
+  vtkIdType inputHeightPx = inputExtent[3] - inputExtent[2] + 1;
 
   double directionVectorX;
   double directionVectorY;
   int pixelCoordX;
   int pixelCoordY;
 
-  int* inputExtent = inputImageData->GetExtent();
+  this->ScanLineSampleOffsets.resize(lineLengthPx * numScanLines);
   for (int scanLine = 0; scanLine < numScanLines; ++scanLine)
   {
     double start[4] = { 0, 0, 0, 0 };
     double end[4] = { 0, 0, 0, 0 };
-    ScanConverter->GetScanLineEndPoints(scanLine, start, end);
+    this->ScanConverter->GetScanLineEndPoints(scanLine, start, end);
 
     directionVectorX = static_cast<double>(end[0] - start[0]) / (lineLengthPx - 1);
     directionVectorY = static_cast<double>(end[1] - start[1]) / (lineLengthPx - 1);
@@ -346,50 +577,114 @@ void vtkPlusBoneEnhancer::FillLinesImage(vtkSmartPointer<vtkImageData> inputImag
     {
       pixelCoordX = start[0] + directionVectorX * pointIndex;
       pixelCoordY = start[1] + directionVectorY * pointIndex;
+      vtkIdType& sampleOffset = this->ScanLineSampleOffsets[scanLine * lineLengthPx + pointIndex];
       if (pixelCoordX < inputExtent[0] || pixelCoordX > inputExtent[1]
-        || pixelCoordY < inputExtent[2] || pixelCoordY > inputExtent[3])
+          || pixelCoordY < inputExtent[2] || pixelCoordY > inputExtent[3])
       {
-        this->LinesImage->SetScalarComponentFromFloat(pointIndex, scanLine, 0, 0, 0);
-        continue; // outside of the specified extent
+        sampleOffset = -1; // outside of the specified extent
+        continue;
       }
-      currentValue = inputImageData->GetScalarComponentAsDouble(pixelCoordX, pixelCoordY, 0, 0);
-      this->LinesImage->SetScalarComponentFromFloat(pointIndex, scanLine, 0, 0, currentValue);
-
-      ++pixelCount;
-      valueMeanDiff = currentValue - mean;
-      mean = mean + valueMeanDiff / pixelCount;
-      sumSquareDiff = sumSquareDiff + valueMeanDiff * (currentValue - mean);
+      sampleOffset = (((0 - inputExtent[4]) * inputHeightPx + (pixelCoordY - inputExtent[2])) * inputWidthPx + (pixelCoordX - inputExtent[0])) * numberOfComponents;
     }
   }
+
+  std::copy(inputExtent, inputExtent + 6, this->SampledInputExtent);
+  this->SampledInputNumberOfComponents = numberOfComponents;
+  return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
-void vtkPlusBoneEnhancer::VectorImageToUchar(vtkSmartPointer<vtkImageData> inputImage)
+// Fills the lines image by subsampling the input image along scanlines.
+void vtkPlusBoneEnhancer::FillLinesImage(vtkImageData* inputImageData, vtkImageData* thresholdedLinesImage)
 {
-  unsigned char* vOutput = 0;
-  unsigned char edgeDetectorOutput0;
-  unsigned char edgeDetectorOutput1;
-  float output = 0.0;     // Keep this in [0..255] instead [0..1] for possible future optimization.
-  float output2 = 0.0;
+  int* linesImageExtent = this->ScanConverter->GetInputImageExtent();
+  int lineLengthPx = linesImageExtent[1] - linesImageExtent[0] + 1;
+  int numScanLines = linesImageExtent[3] - linesImageExtent[2] + 1;
 
-  int dims[3] = { 0, 0, 0 };
-  this->LinesImage->GetDimensions(dims);
-  this->ConversionImage->SetExtent(this->LinesImage->GetExtent());
-  this->ConversionImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
-  for (int y = dims[1] - 1; y >= 0; --y)
+  unsigned char* linesPixels = static_cast<unsigned char*>(this->LinesImage->GetScalarPointer());
+  unsigned char* thresholdedLinesPixels = NULL;
+  if (thresholdedLinesImage != NULL)
   {
-    // Initialize variables for a new scan line.
+    thresholdedLinesPixels = static_cast<unsigned char*>(thresholdedLinesImage->GetScalarPointer());
+  }
 
-    for (int x = dims[0] - 1; x >= 0; --x)   // Go towards transducer
+  switch (inputImageData->GetScalarType())
+  {
+    vtkTemplateMacro(SampleScanLines(static_cast<const VTK_TT*>(inputImageData->GetScalarPointer()), &this->ScanLineSampleOffsets[0],
+                                     linesPixels, thresholdedLinesPixels, lineLengthPx, numScanLines, this->NumberOfThreads));
+    default:
+      LOG_ERROR("Unsupported input image scalar type: " << inputImageData->GetScalarTypeAsString());
+      return;
+  }
+
+  this->LinesImage->Modified();
+  if (thresholdedLinesImage != NULL)
+  {
+    thresholdedLinesImage->Modified();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::BinarizeEdgeImage(vtkImageData* edgeImage)
+{
+  if (edgeImage->GetNumberOfScalarComponents() < 2)
+  {
+    LOG_ERROR("Edge detector output is expected to have 2 components, found " << edgeImage->GetNumberOfScalarComponents());
+    return;
+  }
+
+  int dims[3] = { 0, 0, 0 };
+  edgeImage->GetDimensions(dims);
+  vtkImageData* outputImages[] = { this->ConversionImage, this->BinarizedEdgeImage };
+  for (unsigned int imageIndex = 0; imageIndex < sizeof(outputImages) / sizeof(outputImages[0]); ++imageIndex)
+  {
+    int* outputExtent = outputImages[imageIndex]->GetExtent();
+    if (!std::equal(outputExtent, outputExtent + 6, edgeImage->GetExtent()) || outputImages[imageIndex]->GetPointData()->GetScalars() == NULL)
     {
-      edgeDetectorOutput0 = static_cast<unsigned char>(inputImage->GetScalarComponentAsFloat(x, y, 0, 0));
-      edgeDetectorOutput1 = static_cast<unsigned char>(inputImage->GetScalarComponentAsFloat(x, y, 0, 1));
-      vOutput = static_cast<unsigned char*>(this->ConversionImage->GetScalarPointer(x, y, 0));
-      output = (float)(edgeDetectorOutput0 + edgeDetectorOutput1) / (float)2;                                         // Not mathematically correct, but a quick approximation of sqrt(x^2 + y^2)
+      outputImages[imageIndex]->SetExtent(edgeImage->GetExtent());
+      outputImages[imageIndex]->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    }
+  }
 
-      *vOutput = (unsigned char)std::max(0, std::min(255, (int)output));
+  // Binarization is done the same way as vtkImageThreshold would do it with the ImageBinarizer settings
+  double lowerThreshold = std::max(0.0, std::min(255.0, this->ImageBinarizer->GetLowerThreshold()));
+  double upperThreshold = std::max(0.0, std::min(255.0, this->ImageBinarizer->GetUpperThreshold()));
+  unsigned char lower = static_cast<unsigned char>(lowerThreshold);
+  unsigned char upper = static_cast<unsigned char>(upperThreshold);
+  unsigned char inValue = static_cast<unsigned char>(std::max(0.0, std::min(255.0, this->ImageBinarizer->GetInValue())));
+  unsigned char outValue = static_cast<unsigned char>(std::max(0.0, std::min(255.0, this->ImageBinarizer->GetOutValue())));
+  unsigned char binarizationTable[256];
+  for (int value = 0; value < 256; ++value)
+  {
+    if (lower <= value && value <= upper)
+    {
+      binarizationTable[value] = (this->ImageBinarizer->GetReplaceIn() ? inValue : static_cast<unsigned char>(value));
+    }
+    else
+    {
+      binarizationTable[value] = (this->ImageBinarizer->GetReplaceOut() ? outValue : static_cast<unsigned char>(value));
     }
   }
+
+  // The edge magnitude image is only needed if it is saved
+  unsigned char* magnitudePixels = NULL;
+  if (this->SaveIntermediateResults)
+  {
+    magnitudePixels = static_cast<unsigned char*>(this->ConversionImage->GetScalarPointer());
+  }
+  unsigned char* binaryPixels = static_cast<unsigned char*>(this->BinarizedEdgeImage->GetScalarPointer());
+
+  switch (edgeImage->GetScalarType())
+  {
+    vtkTemplateMacro(BinarizeEdgeScanLines(static_cast<const VTK_TT*>(edgeImage->GetScalarPointer()), edgeImage->GetNumberOfScalarComponents(),
+                                           magnitudePixels, binaryPixels, binarizationTable, dims[0], dims[1], this->NumberOfThreads));
+    default:
+      LOG_ERROR("Unsupported edge image scalar type: " << edgeImage->GetScalarTypeAsString());
+      return;
+  }
+
+  this->ConversionImage->Modified();
+  this->BinarizedEdgeImage->Modified();
 }
 
 //----------------------------------------------------------------------------
@@ -401,15 +696,24 @@ void vtkPlusBoneEnhancer::MarkShadowOutline(vtkSmartPointer<vtkImageData> inputI
 {
   int dims[3] = { 0, 0, 0 };
   inputImage->GetDimensions(dims);
+  unsigned char* pixels = static_cast<unsigned char*>(inputImage->GetScalarPointer());
 
-  int keepInfoCounter;
-  bool foundBone;
-  unsigned char* vOutput;
+  // Each row is marked independently, the bone areas are collected afterwards from the first bone pixel of each row
+  std::vector<int> firstBonePx(dims[1], -1);
+  int boneOutlineDepthPx = this->BoneOutlineDepthPx;
+  int bonePushBackPx = this->BonePushBackPx;
+  PlusThreadPool::ParallelFor(0, dims[1], this->NumberOfThreads, [&](int firstScanLine, int endScanLine)
+  {
+    for (int y = firstScanLine; y < endScanLine; ++y)
+    {
+      firstBonePx[y] = MarkShadowOutlineInScanLine(pixels + y * dims[0], dims[0], boneOutlineDepthPx, bonePushBackPx);
+    }
+  });
+  inputImage->Modified();
 
   int lastVistedValue = 0;
 
   //Setup variables for recording bone areas
-  std::map<std::string, int> currentBoneArea;
   int boneAreaStart = dims[1] - 1;  //The y coordinate of where the bone outline starts
   int boneDepthSum = 0;             //The sum of the x coordinates of each pixel in the bone outline
   int boneMaxDepth = dims[0] - 1;   //The x coordinate of the right-most pixel in the bone outline
@@ -418,92 +722,46 @@ void vtkPlusBoneEnhancer::MarkShadowOutline(vtkSmartPointer<vtkImageData> inputI
 
   for (int y = dims[1] - 1; y >= 0; --y)
   {
-
-    //When an image is detected, keep up to this many pixles after it
-    keepInfoCounter = this->BoneOutlineDepthPx + this->BonePushBackPx;
-    foundBone = false;
-
-    for (int x = dims[0] - 1; x >= 0; --x)
+    int x = firstBonePx[y];
+    if (x >= 0)
     {
-      vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(x, y, 0));
-
-      //If an image is detected
-      if (*vOutput != 0)
+      //the two bone pixels are far enough appart, save them as being parts of different bone areas
+      if (std::abs(x - lastVistedValue) >= boneAreaDifferenceSlope && y != dims[1] - 1)
       {
-        if (keepInfoCounter == 0 || keepInfoCounter > this->BoneOutlineDepthPx)
-        {
-          *vOutput = 0;
-        }
-
-        if (keepInfoCounter == this->BoneOutlineDepthPx + this->BonePushBackPx)
+        //check if the preveous area had any bone
+        if (boneDepthSum != 0)
         {
-          if (foundBone == false)
-          {
-            //found the first bone
-            foundBone = true;
-
-            //the two bone pixels are far enough appart, save them as being parts of different bone areas
-            if (std::abs(x - lastVistedValue) >= boneAreaDifferenceSlope  && y != dims[1] - 1)
-            {
-              //check if the preveous area had any bone
-              if (boneDepthSum != 0)
-              {
-                //Save info related to where the bone area
-                currentBoneArea["depth"] = boneDepthSum / (boneAreaStart - y);                  // Store the outline's average x-coordinate
-                currentBoneArea["xMax"] = boneMaxDepth;                                         // Store the outline's maximum x-coordinate (Used for efficiency)
-                currentBoneArea["xMin"] = std::max(boneMinDepth - this->BoneOutlineDepthPx, 0); // Store the outline's minimum x-coordinate (Used for efficiency)
-                currentBoneArea["yMax"] = boneAreaStart;                                        // Store the outline's maximum y-coordinate
-                currentBoneArea["yMin"] = y + 1;                                                // Store the outline's minimum y-coordinate
-                this->BoneAreasInfo.push_back(currentBoneArea);
-                currentBoneArea.clear();
-              }
-              boneAreaStart = y;
-              boneDepthSum = 0;
-              boneMaxDepth = x;
-              boneMinDepth = x;
-            }
-            else
-            {
-              if (x > boneMaxDepth)
-              {
-                boneMaxDepth = x;
-              }
-              if (x < boneMinDepth)
-              {
-                boneMinDepth = x;
-              }
-            }
-            boneDepthSum += x;
-            lastVistedValue = x;
-
-          }
+          this->BoneAreasInfo.push_back(CreateBoneArea(boneDepthSum / (boneAreaStart - y), boneMaxDepth,
+                                        std::max(boneMinDepth - this->BoneOutlineDepthPx, 0), boneAreaStart, y + 1));
         }
+        boneAreaStart = y;
+        boneDepthSum = 0;
+        boneMaxDepth = x;
+        boneMinDepth = x;
       }
-      if (foundBone == true && keepInfoCounter != 0)
+      else
       {
-        if (keepInfoCounter <= this->BoneOutlineDepthPx && *vOutput == 0)
+        if (x > boneMaxDepth)
         {
-          *vOutput = 255;
+          boneMaxDepth = x;
+        }
+        if (x < boneMinDepth)
+        {
+          boneMinDepth = x;
         }
-        keepInfoCounter--;
       }
+      boneDepthSum += x;
+      lastVistedValue = x;
     }
-
-    //if no bones were found on this row, but there was a bone before this, save it
-    if (foundBone == false)
+    else
     {
+      //if no bones were found on this row, but there was a bone before this, save it
       lastVistedValue = 0;
       if (boneDepthSum != 0)
       {
-        //Save info related to where the bone area
-        currentBoneArea["depth"] = boneDepthSum / (boneAreaStart - y);                  // Store the outline's average x-coordinate
-        currentBoneArea["xMax"] = boneMaxDepth;                                         // Store the outline's maximum x-coordinate (Used for efficiency)
-        currentBoneArea["xMin"] = std::max(boneMinDepth - this->BoneOutlineDepthPx, 0); // Store the outline's minimum x-coordinate (Used for efficiency)
-        currentBoneArea["yMax"] = boneAreaStart;                                        // Store the outline's maximum y-coordinate
-        currentBoneArea["yMin"] = y + 1;                                                // Store the outline's minimum y-coordinate
-        this->BoneAreasInfo.push_back(currentBoneArea);
+        this->BoneAreasInfo.push_back(CreateBoneArea(boneDepthSum / (boneAreaStart - y), boneMaxDepth,
+                                      std::max(boneMinDepth - this->BoneOutlineDepthPx, 0), boneAreaStart, y + 1));
         boneDepthSum = 0;
-        currentBoneArea.clear();
       }
       boneMaxDepth = dims[0] - 1;
       boneMinDepth = 0;
@@ -515,14 +773,8 @@ void vtkPlusBoneEnhancer::MarkShadowOutline(vtkSmartPointer<vtkImageData> inputI
   //save the last bone that goes off-screen
   if (boneDepthSum != 0)
   {
-    //Save info related to where the bone area
-    currentBoneArea["depth"] = boneDepthSum / (boneAreaStart + 1);                  // Store the outline's average x-coordinate
-    currentBoneArea["xMax"] = boneMaxDepth;                                         // Store the outline's maximum x-coordinate (Used for efficiency)
-    currentBoneArea["xMin"] = std::max(boneMinDepth - this->BoneOutlineDepthPx, 0); // Store the outline's minimum x-coordinate (Used for efficiency)
-    currentBoneArea["yMax"] = boneAreaStart;                                        // Store the outline's maximum y-coordinate
-    currentBoneArea["yMin"] = 0;                                                    // Store the outline's minimum y-coordinate
-    this->BoneAreasInfo.push_back(currentBoneArea);
-    currentBoneArea.clear();
+    this->BoneAreasInfo.push_back(CreateBoneArea(boneDepthSum / (boneAreaStart + 1), boneMaxDepth,
+                                  std::max(boneMinDepth - this->BoneOutlineDepthPx, 0), boneAreaStart, 0));
   }
 }
 
@@ -530,65 +782,24 @@ void vtkPlusBoneEnhancer::MarkShadowOutline(vtkSmartPointer<vtkImageData> inputI
 //a way of threasholding based on the standard deviation of a row
 void vtkPlusBoneEnhancer::ThresholdViaStdDeviation(vtkSmartPointer<vtkImageData> inputImage)
 {
-  int fatLayerToCut = 20; //The area of fat too close to the transducer should not be considered
-
-  float vInput = 0;
-  unsigned char* vOutput = 0;
+  if (inputImage->GetScalarType() != VTK_UNSIGNED_CHAR || inputImage->GetNumberOfScalarComponents() != 1)
+  {
+    LOG_ERROR("Thresholding requires a single-component unsigned char image");
+    return;
+  }
 
   int dims[3] = { 0, 0, 0 };
   inputImage->GetDimensions(dims);
+  unsigned char* pixels = static_cast<unsigned char*>(inputImage->GetScalarPointer());
 
-  int max;
-
-  //values used to calculate the standard deviation
-  int pixelSum;
-  int squearSum;
-  float pixelAverage;
-  float meanDiffSum;
-  float meanDiffAverage;
-  float thresholdValue;
-
-  for (int y = dims[1] - 1; y >= 0; --y)
+  PlusThreadPool::ParallelFor(0, dims[1], this->NumberOfThreads, [&](int firstScanLine, int endScanLine)
   {
-    max = 0;
-
-    pixelSum = 0;
-    squearSum = 0;
-    pixelAverage = 0;
-
-    //determine the average, sum, and max of the row
-    for (int x = dims[0] - 1; x >= fatLayerToCut; --x)
+    for (int y = firstScanLine; y < endScanLine; ++y)
     {
-      vInput = inputImage->GetScalarComponentAsFloat(x, y, 0, 0);
-      pixelSum += vInput;
-      squearSum += vInput * vInput;
-
-      if (vInput > max)
-      {
-        max = vInput;
-      }
+      ThresholdScanLine(pixels + y * dims[0], pixels + y * dims[0], dims[0]);
     }
-    pixelAverage = pixelSum / (dims[0] - fatLayerToCut);
-
-    //determine the standard deviation of the row
-    meanDiffSum = squearSum + (dims[0] - fatLayerToCut) * pixelAverage * pixelAverage + (-2 * pixelAverage * pixelSum);
-    meanDiffAverage = meanDiffSum / (dims[0] - fatLayerToCut);
-    thresholdValue = max - 3 * pow(meanDiffAverage, 0.5f);
-
-
-    //if a pixel's value is too low, remove it
-    if (pixelSum != 0)
-    {
-      for (int x = dims[0] - 1; x >= 0; --x)
-      {
-        vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(x, y, 0));
-        if (*vOutput < thresholdValue && *vOutput != 0)
-        {
-          *vOutput = 0;
-        }
-      }
-    }
-  }
+  });
+  inputImage->Modified();
 }
 
 //----------------------------------------------------------------------------
@@ -620,63 +831,79 @@ void vtkPlusBoneEnhancer::ImageConjunction(vtkSmartPointer<vtkImageData> InputIm
   }
 }
 
-
 //----------------------------------------------------------------------------
 // Processes a given frame and marks potential bone areas.
 PlusStatus vtkPlusBoneEnhancer::ProcessFrame(igsioTrackedFrame* inputFrame, igsioTrackedFrame* outputFrame)
 {
-  //Process the input into a linear image
-  vtkSmartPointer<vtkImageData> intermediateImage = this->UnprocessedFrameToLinearImage(inputFrame);
+  //Process the input into a thresholded linear image
+  if (this->FrameToLinesImage(inputFrame, this->ThresholdedLinesImage) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
   //Remove noise and mark all possible bones
-  this->RemoveNoise(intermediateImage);
+  this->DetectBoneOutline(this->ThresholdedLinesImage);
   //Reconvert the image back into a fan-image and return it
-  this->LinearToFanImage(intermediateImage, outputFrame);
+  this->LinearToFanImage(this->BinaryImageForMorphology, outputFrame);
+  this->NumberOfTimedFrames++;
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
 void vtkPlusBoneEnhancer::LinearToFanImage(vtkSmartPointer<vtkImageData> inputImage, igsioTrackedFrame* outputFrame)
 {
+  double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
   //Setup so that the image can be converted into a fan-image
-  this->ProcessedLinesImage->DeepCopy(inputImage);
+  CopyImageScalars(inputImage, this->ProcessedLinesImage);
   igsioVideoFrame* outputImage = outputFrame->GetImageData();
   this->ScanConverter->SetInputData(this->ProcessedLinesImage);
-  this->ScanConverter->SetOutput(inputImage);
   this->ScanConverter->Update();
 
-  outputImage->DeepCopyFrom(inputImage);
+  outputImage->DeepCopyFrom(this->ScanConverter->GetOutput());
+  this->AddStageTime("ScanConversion", stageStartTime);
 }
 
 //----------------------------------------------------------------------------
-// takes an unprocessed frame image and returns it as a linear image
-vtkSmartPointer<vtkImageData> vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage(igsioTrackedFrame* inputFrame)
+// Samples the scan lines of an unprocessed frame into LinesImage and optionally thresholds them into thresholdedLinesImage
+PlusStatus vtkPlusBoneEnhancer::FrameToLinesImage(igsioTrackedFrame* inputFrame, vtkImageData* thresholdedLinesImage)
 {
-  if (this->FirstFrame == true)
+  double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  vtkImageData* inputImage = inputFrame->GetImageData()->GetImage();
+  if (this->PrepareLinesImages(inputImage) != PLUS_SUCCESS)
   {
-    //set up variables for future loops
-    this->ProcessImageExtents();
-    this->FirstFrame = false;
+    return PLUS_FAIL;
   }
-  this->BoneAreasInfo.clear();
-
-  igsioVideoFrame* inputImage = inputFrame->GetImageData();
-  //an image used to transport output between filters
-  vtkSmartPointer<vtkImageData> intermediateImage = vtkSmartPointer<vtkImageData>::New();
 
-  //Convert the image to a readable non-fan image
-  this->ScanConverter->SetInputData(inputImage->GetImage());
   // Generate lines image.
   if (this->SaveIntermediateResults)
   {
+    this->ScanConverter->SetInputData(inputImage);
     this->AddIntermediateFromFilter("_01Lines_1PreFillLines", this->ScanConverter);
   }
-  this->FillLinesImage(inputImage->GetImage());
+  this->FillLinesImage(inputImage, thresholdedLinesImage);
   if (this->SaveIntermediateResults)
   {
     this->AddIntermediateImage("_01Lines_2FilterEnd", this->LinesImage);
+    if (thresholdedLinesImage != NULL)
+    {
+      this->AddIntermediateImage("_02Threshold_1FilterEnd", thresholdedLinesImage);
+    }
   }
-  intermediateImage->DeepCopy(this->LinesImage);
 
+  this->AddStageTime(thresholdedLinesImage != NULL ? "FillLinesAndThreshold" : "FillLines", stageStartTime);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// takes an unprocessed frame image and returns it as a linear image
+vtkSmartPointer<vtkImageData> vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage(igsioTrackedFrame* inputFrame)
+{
+  //an image used to transport output between filters
+  vtkSmartPointer<vtkImageData> intermediateImage = vtkSmartPointer<vtkImageData>::New();
+  if (this->FrameToLinesImage(inputFrame, NULL) == PLUS_SUCCESS)
+  {
+    intermediateImage->DeepCopy(this->LinesImage);
+  }
   return intermediateImage;
 }
 
@@ -685,6 +912,7 @@ vtkSmartPointer<vtkImageData> vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage
 // bone areas using a white outline.
 void vtkPlusBoneEnhancer::RemoveNoise(vtkSmartPointer<vtkImageData> inputImage)
 {
+  double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
   //Threashold the image based on the standard deviation of a pixel's columns
   this->ThresholdViaStdDeviation(inputImage);
@@ -692,37 +920,46 @@ void vtkPlusBoneEnhancer::RemoveNoise(vtkSmartPointer<vtkImageData> inputImage)
   {
     this->AddIntermediateImage("_02Threshold_1FilterEnd", inputImage);
   }
+  this->AddStageTime("Threshold", stageStartTime);
+
+  this->DetectBoneOutline(inputImage);
+
+  CopyImageScalars(this->BinaryImageForMorphology, inputImage);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::DetectBoneOutline(vtkImageData* thresholdedLinesImage)
+{
+  double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
   //Use gaussian smoothing
-  this->GaussianSmooth->SetInputData(inputImage);
+  this->GaussianSmooth->SetInputData(thresholdedLinesImage);
   if (this->SaveIntermediateResults)
   {
     this->AddIntermediateFromFilter("_03Gaussian_1FilterEnd", this->GaussianSmooth);
   }
+  this->GaussianSmooth->Update();
+  stageStartTime = this->AddStageTime("GaussianSmoothing", stageStartTime);
 
-  //Edge detection
+  //Edge detection, then binarize the edges since we perform morphological operations
   this->EdgeDetector->SetInputConnection(this->GaussianSmooth->GetOutputPort());
   this->EdgeDetector->Update();
-  this->VectorImageToUchar(this->EdgeDetector->GetOutput());
+  this->BinarizeEdgeImage(this->EdgeDetector->GetOutput());
   if (this->SaveIntermediateResults)
   {
     this->AddIntermediateImage("_04EdgeDetector_1FilterEnd", this->ConversionImage);
+    this->AddIntermediateImage("_05BinaryImageForMorphology_1FilterEnd", this->BinarizedEdgeImage);
   }
-
-  // Since we perform morphological operations, we must binarize the image
-  this->ImageBinarizer->SetInputData(this->ConversionImage);
-  if (this->SaveIntermediateResults)
-  {
-    this->AddIntermediateFromFilter("_05BinaryImageForMorphology_1FilterEnd", this->ImageBinarizer);
-  }
+  stageStartTime = this->AddStageTime("EdgeDetection", stageStartTime);
 
   //Remove small clusters of pixels
-  this->IslandRemover->SetInputConnection(this->ImageBinarizer->GetOutputPort());
+  this->IslandRemover->SetInputData(this->BinarizedEdgeImage);
   this->IslandRemover->Update();
   if (this->SaveIntermediateResults)
   {
     this->AddIntermediateImage("_06Island_1FilterEnd", this->IslandRemover->GetOutput());
   }
+  stageStartTime = this->AddStageTime("IslandRemoval", stageStartTime);
 
   //Erode the image
   this->ImageEroder->SetKernelSize(this->ErosionKernelSize[0], this->ErosionKernelSize[1], 1);
@@ -736,11 +973,12 @@ void vtkPlusBoneEnhancer::RemoveNoise(vtkSmartPointer<vtkImageData> inputImage)
   this->ImageDialator->SetKernelSize(this->DilationKernelSize[0], this->DilationKernelSize[1], 1);
   this->ImageDialator->SetInputConnection(this->ImageEroder->GetOutputPort());
   this->ImageDialator->Update();
-  this->BinaryImageForMorphology->DeepCopy(this->ImageDialator->GetOutput());
+  CopyImageScalars(this->ImageDialator->GetOutput(), this->BinaryImageForMorphology);
   if (this->SaveIntermediateResults)
   {
     this->AddIntermediateImage("_08Dilation_1FilterEnd", this->BinaryImageForMorphology);
   }
+  stageStartTime = this->AddStageTime("ErosionDilation", stageStartTime);
 
   //Detect each possible bone area, then subject it to various tests to confirm if it is valid
   this->MarkShadowOutline(this->BinaryImageForMorphology);
@@ -748,16 +986,51 @@ void vtkPlusBoneEnhancer::RemoveNoise(vtkSmartPointer<vtkImageData> inputImage)
   {
     this->AddIntermediateImage("_09PostFilters_1ShadowOutline", this->BinaryImageForMorphology);
   }
+  this->AddStageTime("ShadowOutline", stageStartTime);
 
   // Save all stored intermediate images to mha files in output
   if (this->SaveIntermediateResults)
   {
     this->SaveAllIntermediateResultsToFile();
   }
-  
-  inputImage->DeepCopy(this->BinaryImageForMorphology);
 }
 
+//----------------------------------------------------------------------------
+double vtkPlusBoneEnhancer::AddStageTime(const std::string& stageName, double stageStartTime)
+{
+  double currentTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  for (std::vector<std::pair<std::string, double> >::iterator stageIt = this->StageTimesSec.begin(); stageIt != this->StageTimesSec.end(); ++stageIt)
+  {
+    if (stageIt->first == stageName)
+    {
+      stageIt->second += currentTime - stageStartTime;
+      return currentTime;
+    }
+  }
+  this->StageTimesSec.push_back(std::make_pair(stageName, currentTime - stageStartTime));
+  return currentTime;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::GetStageTimings(std::vector<std::string>& stageNames, std::vector<double>& stageTimesSec) const
+{
+  stageNames.clear();
+  stageTimesSec.clear();
+  for (std::vector<std::pair<std::string, double> >::const_iterator stageIt = this->StageTimesSec.begin(); stageIt != this->StageTimesSec.end(); ++stageIt)
+  {
+    stageNames.push_back(stageIt->first);
+    stageTimesSec.push_back(stageIt->second);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::ResetStageTimings()
+{
+  this->StageTimesSec.clear();
+  this->NumberOfTimedFrames = 0;
+}
+
+
 
 //----------------------------------------------------------------------------
 /*
@@ -16,6 +16,11 @@ See License.txt for details.
 #include <vtkSmartPointer.h>
 #include <vtkSetGet.h>
 
+// STL includes
+#include <string>
+#include <utility>
+#include <vector>
+
 class vtkImageData;
 class vtkImageThreshold;
 class vtkImageGaussianSmooth;
@@ -27,6 +32,13 @@ class vtkPlusUsScanConvert;
 /*!
 \class vtkPlusBoneEnhancer
 \brief Localize bone surfaces in ultrasound images
+
+The pixels along the scan lines are sampled into a lines image, thresholded, smoothed, edge-detected and binarized,
+then the bone outlines are marked and the result is scan converted back to a fan image.
+Sampling and thresholding, edge binarization and shadow outline marking are computed directly on the pixel buffers
+of the scan lines, in parallel over the scan lines. The intermediate images are allocated on the first frame and are
+reused for all subsequent frames. The processing time of each stage is recorded (see GetStageTimings).
+
 \ingroup PlusLibImageProcessingAlgo
 */
 class vtkPlusImageProcessingExport vtkPlusBoneEnhancer : public vtkPlusTrackedFrameProcessor
@@ -87,6 +99,16 @@ public:
   vtkSetVector2Macro(DilationKernelSize, int);
   vtkGetVector2Macro(DilationKernelSize, int);
 
+  /*! Number of threads used for processing the scan lines. If 0 then the number of hardware threads is used. */
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /*! Number of frames processed since the stage timings were reset */
+  vtkGetMacro(NumberOfTimedFrames, int);
+  /*! Get the name and total processing time (in seconds, since the stage timings were reset) of each processing stage, in the order of execution */
+  void GetStageTimings(std::vector<std::string>& stageNames, std::vector<double>& stageTimesSec) const;
+  void ResetStageTimings();
+
   void ThresholdViaStdDeviation(vtkSmartPointer<vtkImageData> inputImage);
 
   vtkImageData* GetProcessedLinesImage() { return (this->ProcessedLinesImage); }
@@ -107,8 +129,26 @@ protected:
   vtkPlusBoneEnhancer();
   virtual ~vtkPlusBoneEnhancer();
 
-  void FillLinesImage(vtkSmartPointer<vtkImageData> inputImageData);
-  void VectorImageToUchar(vtkSmartPointer<vtkImageData> inputImage);
+  /*! Allocate the intermediate images on the first frame and update the scan line sampling positions if the input image geometry is changed */
+  PlusStatus PrepareLinesImages(vtkImageData* inputImageData);
+
+  /*!
+    Fill the lines image by sampling the input image along the scan lines.
+    If thresholdedLinesImage is not NULL then the thresholded scan lines (see ThresholdViaStdDeviation) are written into it in the same pass.
+  */
+  void FillLinesImage(vtkImageData* inputImageData, vtkImageData* thresholdedLinesImage);
+
+  /*! Sample the scan lines of an unprocessed frame into LinesImage (and thresholdedLinesImage, if not NULL) and record the intermediate images */
+  PlusStatus FrameToLinesImage(igsioTrackedFrame* inputFrame, vtkImageData* thresholdedLinesImage);
+
+  /*! Convert the gradient image of the edge detector to an edge magnitude image and binarize it using the ImageBinarizer thresholds */
+  void BinarizeEdgeImage(vtkImageData* edgeImage);
+
+  /*! Smooth, edge-detect, binarize and clean up the thresholded lines image and mark the shadow outlines. The result is stored in BinaryImageForMorphology. */
+  void DetectBoneOutline(vtkImageData* thresholdedLinesImage);
+
+  /*! Add the time elapsed since stageStartTime to the total time of the stage. Returns the current time. */
+  double AddStageTime(const std::string& stageName, double stageStartTime);
 
   void ImageConjunction(vtkSmartPointer<vtkImageData> inputImage, vtkSmartPointer<vtkImageData> maskImage);
 
@@ -159,12 +199,28 @@ protected:
 
   /*! Image for pixels (uchar) along scan lines only */
   vtkSmartPointer<vtkImageData> LinesImage;
+  /*! Lines image after thresholding each scan line */
+  vtkSmartPointer<vtkImageData> ThresholdedLinesImage;
+  /*! Binarized edge magnitude image, input of the morphological operations */
+  vtkSmartPointer<vtkImageData> BinarizedEdgeImage;
   /*! Pixels (float) store probability of belonging to shadow */
   vtkSmartPointer<vtkImageData> ProcessedLinesImage;
 
   std::vector<std::map<std::string, int> > BoneAreasInfo;
   bool FirstFrame;
 
+  /*! Offset of the input pixel of each scan line sample (in the input scalar array, -1 if outside of the input image) */
+  std::vector<vtkIdType> ScanLineSampleOffsets;
+  /*! Extent and number of components of the input image that ScanLineSampleOffsets are computed for */
+  int SampledInputExtent[6];
+  int SampledInputNumberOfComponents;
+
+  int NumberOfThreads;
+
+  /*! Total processing time of each stage, in the order of execution */
+  std::vector<std::pair<std::string, double> > StageTimesSec;
+  int NumberOfTimedFrames;
+
 private:
   vtkPlusBoneEnhancer(const vtkPlusBoneEnhancer&);  // Not implemented.
   void operator=(const vtkPlusBoneEnhancer&);  // Not implemented.
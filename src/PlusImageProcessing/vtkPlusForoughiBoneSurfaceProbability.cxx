@@ -5,35 +5,94 @@ See License.txt for details.
 =========================================================Plus=header=end*/
 
 #include "PlusConfigure.h"
+#include "PlusThreadPool.h"
+#include "vtkIGSIOAccurateTimer.h"
 
 #include "vtkPlusForoughiBoneSurfaceProbability.h"
 
 // VTK includes
-#include "vtkImageCast.h"
-#include <vtkIntArray.h>
-#include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkImageData.h>
-#include <vtkDoubleArray.h>
-#include <vtkTimerLog.h>
 
 // STD includes
-#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
 // Other includes
-#include "mkl.h"
-#ifdef NDEBUG
-  #include <omp.h>
+#ifdef PLUS_USE_INTEL_MKL
+  #include "mkl.h"
 #endif
 
-#define MKL_FREE_IF_NULL(var) \
-  if (var != NULL) \
-  { \
-    mkl_free(var); \
-    var = NULL; \
+vtkStandardNewMacro(vtkPlusForoughiBoneSurfaceProbability);
+
+namespace
+{
+  // Terms of the shadow model that differ from 1 by less than this value are considered to be 1
+  const double SHADOW_MODEL_COMPLEMENT_THRESHOLD = 1e-18;
+
+  // Number of rows at the top of the image where the zero weights at the end of the shadow model are used in the shadow value
+  const int SHADOW_MODEL_ZERO_TAIL_LENGTH = 5;
+
+  //----------------------------------------------------------------------------
+  // Computes value^exponent by repeated squaring, which is much faster than pow() for small integer exponents
+  inline double IntegerPower(double value, int exponent)
+  {
+    if (exponent < 0)
+    {
+      return 1.0 / IntegerPower(value, -exponent);
+    }
+    double result = 1.0;
+    while (exponent > 0)
+    {
+      if (exponent & 1)
+      {
+        result *= value;
+      }
+      value *= value;
+      exponent >>= 1;
+    }
+    return result;
   }
 
-vtkStandardNewMacro(vtkPlusForoughiBoneSurfaceProbability);
+#ifdef PLUS_USE_INTEL_MKL
+  //-----------------------------------------------------------------------------
+  // Copies the central part of the full convolution result, which has the same size as the convolution input
+  void ResizeMatrix(const double* inputBuffer, double* outputBuffer, int xClipping, int yClipping, int xInputSize, int yInputSize)
+  {
+    int xStart = (xClipping + 2 - 1) / 2 - 1;
+    int yStart = (yClipping + 2 - 1) / 2 - 1;
+    int xStop = xInputSize - xStart;
+    int yStop = yInputSize - yStart;
+
+    int idx = 0;
+    for (int y = yStart; y < yStop; ++y)
+    {
+      for (int x = xStart; x < xStop; ++x)
+      {
+        outputBuffer[idx] = inputBuffer[x + y * xInputSize];
+        ++idx;
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  // Performs a 2D convolution using Intel MKL defined by the kernel buffer.
+  void Conv2(const double* inputBuffer, const double* kernelBuffer, double* tempBuffer, double* outputBuffer, int nx, int ny, int kx, int ky)
+  {
+    int inputShape[] = {nx, ny};
+    int kernelShape[] = {kx, ky};
+    int resultShape[] = {nx + kx - 1, ny + ky - 1};
+
+    VSLConvTaskPtr task;
+    vsldConvNewTask(&task, VSL_CONV_MODE_AUTO, 2, inputShape, kernelShape, resultShape);
+    vsldConvExec(task, inputBuffer, NULL, kernelBuffer, NULL, tempBuffer, NULL);
+    vslConvDeleteTask(&task);
+
+    ResizeMatrix(tempBuffer, outputBuffer, kx, ky, nx + kx - 1, ny + ky - 1);
+  }
+#endif
+}
 
 //----------------------------------------------------------------------------
 vtkPlusForoughiBoneSurfaceProbability::vtkPlusForoughiBoneSurfaceProbability()
@@ -44,6 +103,7 @@ vtkPlusForoughiBoneSurfaceProbability::vtkPlusForoughiBoneSurfaceProbability()
   this->ShadowVSIntensity = 5;
   this->SmoothingSigma = 5.0;
   this->TransducerMargin = 60;
+  this->NumberOfThreads = 0;
 
   this->KernelUpdateRequested = true;
 
@@ -52,27 +112,25 @@ vtkPlusForoughiBoneSurfaceProbability::vtkPlusForoughiBoneSurfaceProbability()
   this->FrameSize[1] = 0;
   this->FrameSize[2] = 1;
 
-  this->MklGaussianBuffer = NULL;
-  this->MklLaplacianOfGaussianBuffer = NULL;
-  this->MklGaussianBufferTemp = NULL;
-  this->MklLaplacianOfGaussianBufferTemp = NULL;
-  this->MklReflectionNumberBuffer = NULL;
-  this->MklShadowValueBuffer = NULL;
-  this->MklShadowModel = NULL;
-  this->MklGaussianKernel = NULL;
-  this->MklLaplacianKernel = NULL;
+  this->ProfilingEnabled = false;
+  this->NumberOfTimedFrames = 0;
 }
 
 //----------------------------------------------------------------------------
 vtkPlusForoughiBoneSurfaceProbability::~vtkPlusForoughiBoneSurfaceProbability()
 {
-  DeleteKernels();
-  // mkl_free_buffers();
 }
 
 //----------------------------------------------------------------------------
 void vtkPlusForoughiBoneSurfaceProbability::SimpleExecute(vtkImageData* input, vtkImageData* output)
 {
+  if (input->GetScalarType() != VTK_DOUBLE || input->GetNumberOfScalarComponents() != 1)
+  {
+    LOG_ERROR("vtkPlusForoughiBoneSurfaceProbability requires a single component double scalar type input image, found "
+              << input->GetNumberOfScalarComponents() << " component " << input->GetScalarTypeAsString() << " image");
+    return;
+  }
+
   // Allocate output image
   output->SetExtent(input->GetExtent());
 #if (VTK_MAJOR_VERSION < 6)
@@ -97,113 +155,50 @@ void vtkPlusForoughiBoneSurfaceProbability::SimpleExecute(vtkImageData* input, v
     this->KernelUpdateRequested = false;
   }
 
-  int* dims = input->GetDimensions();
-  unsigned int nx = this->FrameSize[0];
-  unsigned int ny = this->FrameSize[1];
-  unsigned int sliceSize = this->FrameSize[0] * this->FrameSize[1];
-
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  int nx = static_cast<int>(this->FrameSize[0]);
+  int ny = static_cast<int>(this->FrameSize[1]);
+  int sliceSize = nx * ny;
 
   // Loop through each slice
-  for (unsigned int sliceIdx = inputExtent[4]; sliceIdx <= inputExtent[5]; ++sliceIdx)
+  for (int sliceIdx = inputExtent[4]; sliceIdx <= inputExtent[5]; ++sliceIdx)
   {
-    LOG_INFO("---------------");
-    // Index of slice in buffer
-    double* inputSlicePtr = static_cast<double*>(input->GetScalarPointer(0, 0, sliceIdx));
-    double* outputSlicePtr = static_cast<double*>(output->GetScalarPointer(0, 0, sliceIdx));
-
-    // If slice has not all zero pixels...
-    //if (GetMaxPixelValue(inputSlicePtr, sliceSize) > 0) // this is expensive and always true (except error cases)
+    double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+
+    double* inputSlicePtr = static_cast<double*>(input->GetScalarPointer(inputExtent[0], inputExtent[2], sliceIdx));
+    double* outputSlicePtr = static_cast<double*>(output->GetScalarPointer(inputExtent[0], inputExtent[2], sliceIdx));
+
+    // Convolve with Gaussian kernel and normalize result between zero and one
+    GaussianSmooth(inputSlicePtr, &this->GaussianBuffer[0], nx, ny);
+    Normalize(&this->GaussianBuffer[0], sliceSize, false);
+    stageStartTime = this->AddStageTime("GaussianSmoothing", stageStartTime);
+
+    // Convolve blurred image with Laplacian kernel
+    Laplacian(&this->GaussianBuffer[0], &this->LaplacianOfGaussianBuffer[0], nx, ny);
+    stageStartTime = this->AddStageTime("LaplacianOfGaussian", stageStartTime);
+
+    // Calculate reflection number and shadow value, normalize both
+    ComputeReflectionAndShadow(nx, ny);
+    Normalize(&this->ReflectionNumberBuffer[0], sliceSize, false);
+    Normalize(&this->ShadowValueBuffer[0], sliceSize, true);
+    stageStartTime = this->AddStageTime("ReflectionAndShadow", stageStartTime);
+
+    // Calculate BSP and normalize it
+    const double* shadowValues = &this->ShadowValueBuffer[0];
+    const double* reflectionNumbers = &this->ReflectionNumberBuffer[0];
+    int shadowVSIntensity = this->ShadowVSIntensity;
+    PlusThreadPool::ParallelFor(0, ny, this->NumberOfThreads, [ = ](int firstRow, int endRow)
     {
-      // Convolve with Gaussian kernel and normalize result between zero and one
-      timer->StartTimer();
-      Conv2(inputSlicePtr, this->MklGaussianKernel, this->MklGaussianBufferTemp, this->MklGaussianBuffer, static_cast<int>(this->FrameSize[0]), static_cast<int>(this->FrameSize[1]), this->GaussianKernelSize, this->GaussianKernelSize);
-      timer->StopTimer();
-      LOG_INFO("Conv2 1: " << timer->GetElapsedTime());
-
-      timer->StartTimer();
-      Normalize(this->MklGaussianBuffer, sliceSize, false);
-      timer->StopTimer();
-      LOG_INFO("Normalize 1: " << timer->GetElapsedTime());
-
-      // Convolve blurred image with Laplacian kernel
-      timer->StartTimer();
-      Conv2(this->MklGaussianBuffer, this->MklLaplacianKernel, this->MklLaplacianOfGaussianBufferTemp, this->MklLaplacianOfGaussianBuffer, static_cast<int>(this->FrameSize[0]), static_cast<int>(this->FrameSize[1]), 3, 3);
-      timer->StopTimer();
-      LOG_INFO("Conv2 2: " << timer->GetElapsedTime());
-
-      // Main loop calculating reflection number and shadow value
-      timer->StartTimer();
-      double sumG = 0;
-      double sumGI = 0;
-      double sumHist = 0;
-      int i, pixelIdx, x, y;
-#ifdef NDEBUG
-      #pragma omp parallel for reduction(+:sumG,sumGI, sumHist), private(i, x, pixelIdx)
-#endif
-      for (y = 0; y < ny; ++y)
+      for (int pixelIdx = firstRow * nx; pixelIdx < endRow * nx; ++pixelIdx)
       {
-        for (x = 0; x < nx; ++x)
-        {
-          pixelIdx = x + y * nx;
-
-          // Only include pixels with intensity value larger than a specified threshold
-          if (this->MklGaussianBuffer[pixelIdx] >= this->BoneThreshold && pixelIdx > this->TransducerMargin * nx)
-          {
-            // Set outermost border pixels to zero and exclude negative pixels
-            if ((x == nx - 1 || x == 0 || y == ny - 1 || y == 0) || this->MklLaplacianOfGaussianBuffer[pixelIdx] <= 0)
-            {
-              this->MklLaplacianOfGaussianBuffer[pixelIdx] = 0.0;
-            }
-            else
-            {
-              // Divide by small number to increase image intensity (What! :)
-              this->MklLaplacianOfGaussianBuffer[pixelIdx] = this->MklLaplacianOfGaussianBuffer[pixelIdx] / 0.005;
-            }
-
-            // Calculate reflection number
-            this->MklReflectionNumberBuffer[pixelIdx] = pow(this->MklGaussianBuffer[pixelIdx], this->BlurredVSBLoG) + this->MklLaplacianOfGaussianBuffer[pixelIdx];
-
-            // Calculate shadow value
-            sumG = 0;
-            sumGI = 0;
-            for (i = y; i < ny; ++i)
-            {
-              sumG += this->MklShadowModel[i - y];
-              sumGI += this->MklShadowModel[i - y] * this->MklGaussianBuffer[x + i * nx];
-            }
-            this->MklShadowValueBuffer[pixelIdx] = sumGI / sumG;
-          }
-          else
-          {
-            this->MklReflectionNumberBuffer[pixelIdx] = 0.0;
-            this->MklShadowValueBuffer[pixelIdx] = 0.0;
-          }
-        }
+        outputSlicePtr[pixelIdx] = IntegerPower(shadowValues[pixelIdx], shadowVSIntensity) * reflectionNumbers[pixelIdx];
       }
+    });
+    Normalize(outputSlicePtr, sliceSize, false, 255);
+    this->AddStageTime("BoneSurfaceProbability", stageStartTime);
 
-      timer->StopTimer();
-      LOG_INFO("Main processing: " << timer->GetElapsedTime());
-
-      // Normalize both reflection numbers and shadow values
-      timer->StartTimer();
-      Normalize(this->MklReflectionNumberBuffer, sliceSize, false);
-      Normalize(this->MklShadowValueBuffer, sliceSize, true);
-      timer->StopTimer();
-      LOG_INFO("Normalize 2x: " << timer->GetElapsedTime());
-
-      // Calculate BSP
-      timer->StartTimer();
-      vdPowx(sliceSize, this->MklShadowValueBuffer, this->ShadowVSIntensity, this->MklShadowValueBuffer);
-      vdMul(sliceSize, this->MklShadowValueBuffer, this->MklReflectionNumberBuffer, outputSlicePtr);
-      timer->StopTimer();
-      LOG_INFO("Non-linear transform: " << timer->GetElapsedTime());
-
-      // Normalize BSP
-      timer->StartTimer();
-      Normalize(outputSlicePtr, sliceSize, false, 255);
-      timer->StopTimer();
-      LOG_INFO("Normalize 3: " << timer->GetElapsedTime());
+    if (this->ProfilingEnabled)
+    {
+      this->NumberOfTimedFrames++;
     }
   }
 }
@@ -211,114 +206,246 @@ void vtkPlusForoughiBoneSurfaceProbability::SimpleExecute(vtkImageData* input, v
 //-----------------------------------------------------------------------------
 void vtkPlusForoughiBoneSurfaceProbability::UpdateKernels()
 {
-  DeleteKernels();
+  int nx = static_cast<int>(this->FrameSize[0]);
+  int ny = static_cast<int>(this->FrameSize[1]);
+  int sliceSize = nx * ny;
 
   this->GaussianKernelSize = floor(this->SmoothingSigma * 3) * 2 + 1;
+  int intervall = (this->GaussianKernelSize - 1) / 2;
+
+  this->GaussianBuffer.assign(sliceSize, 0.0);
+  this->LaplacianOfGaussianBuffer.assign(sliceSize, 0.0);
+  this->ReflectionNumberBuffer.assign(sliceSize, 0.0);
+  this->ShadowValueBuffer.assign(sliceSize, 0.0);
+  this->ColumnSuffixSumBuffer.assign(nx, 0.0);
+
+  // Calculate Gaussian kernel: exp(-(x^2+y^2)/(2*sigma^2)) = exp(-x^2/(2*sigma^2)) * exp(-y^2/(2*sigma^2))
+  this->GaussianKernel.resize(this->GaussianKernelSize);
+  for (int x = -intervall; x <= intervall; ++x)
+  {
+    this->GaussianKernel[x + intervall] = exp(-(x * x) / (2 * this->SmoothingSigma * this->SmoothingSigma));
+  }
+#ifdef PLUS_USE_INTEL_MKL
+  this->GaussianBufferTemp.assign((nx + this->GaussianKernelSize - 1) * (ny + this->GaussianKernelSize - 1), 0.0);
+  this->GaussianKernel2D.resize(this->GaussianKernelSize * this->GaussianKernelSize);
+  for (int x = 0; x < this->GaussianKernelSize; ++x)
+  {
+    for (int y = 0; y < this->GaussianKernelSize; ++y)
+    {
+      this->GaussianKernel2D[x * this->GaussianKernelSize + y] = this->GaussianKernel[x] * this->GaussianKernel[y];
+    }
+  }
+#else
+  this->GaussianBufferTemp.assign(sliceSize, 0.0);
+  this->GaussianKernel2D.clear();
+#endif
 
-  // Allocating memory for matrices aligned on 64-byte boundary for better performance
-  this->MklGaussianBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklLaplacianOfGaussianBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklGaussianBufferTemp = (double*)mkl_malloc((this->FrameSize[0] + GaussianKernelSize - 1) * (this->FrameSize[1]  + GaussianKernelSize - 1) * sizeof(double), 64);
-  this->MklLaplacianOfGaussianBufferTemp = (double*)mkl_malloc((this->FrameSize[0] + 2) * (this->FrameSize[1]  + 2) * sizeof(double), 64);
-  this->MklReflectionNumberBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklShadowValueBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklShadowModel = (double*)mkl_malloc(this->FrameSize[1] * sizeof(double), 64);
-  this->MklGaussianKernel = (double*)mkl_malloc(GaussianKernelSize * GaussianKernelSize * sizeof(double), 64);
-  this->MklLaplacianKernel = (double*)mkl_malloc(3 * 3 * sizeof(double), 64);
-
-  // Calculate shadow model
-  for (int i = 0; i < this->FrameSize[1]; ++i)
+  // Calculate shadow model and the sum of its weights for each row
+  this->ShadowModel.resize(ny);
+  this->ShadowModelSum.resize(ny);
+  double shadowModelSum = 0.0;
+  for (int i = 0; i < ny; ++i)
   {
-    if (i < this->FrameSize[1] - 5)
+    if (i < ny - SHADOW_MODEL_ZERO_TAIL_LENGTH)
     {
-      this->MklShadowModel[i] = 1 - exp(- (i * i - 1) / (2 * this->ShadowSigma * this->ShadowSigma));
+      this->ShadowModel[i] = 1 - exp(- (i * i - 1) / (2 * this->ShadowSigma * this->ShadowSigma));
     }
     else
     {
-      this->MklShadowModel[i] = 0.0;
+      this->ShadowModel[i] = 0.0;
     }
+    // The shadow value of row y is computed from rows y..ny-1, i.e., the first ny-y terms of the shadow model
+    shadowModelSum += this->ShadowModel[i];
+    this->ShadowModelSum[ny - 1 - i] = shadowModelSum;
   }
 
-  // Calculate Gaussian kernel
-  int idx = 0;
-  int intervall = (GaussianKernelSize - 1) / 2;
-  for (double x = -intervall; x <= intervall; ++x)
+  // Calculate the complement of the shadow model until it becomes negligible
+  this->ShadowModelComplement.clear();
+  for (int i = 0; i < ny; ++i)
   {
-    for (double y = -intervall; y <= intervall; ++y)
+    double complement = exp(- (i * i - 1) / (2 * this->ShadowSigma * this->ShadowSigma));
+    if (i > 1 && complement < SHADOW_MODEL_COMPLEMENT_THRESHOLD)
     {
-      this->MklGaussianKernel [idx] = exp(-((x * x) / (2 * this->SmoothingSigma * this->SmoothingSigma) + (y * y) / (2 * this->SmoothingSigma * this->SmoothingSigma)));
-      ++idx;
+      break;
     }
+    this->ShadowModelComplement.push_back(complement);
   }
-
-  // Calculate Laplacian kernel
-  this->MklLaplacianKernel[0] = 0;
-  this->MklLaplacianKernel[1] = -1;
-  this->MklLaplacianKernel[2] = 0;
-  this->MklLaplacianKernel[3] = -1;
-  this->MklLaplacianKernel[4] = 4;
-  this->MklLaplacianKernel[5] = -1;
-  this->MklLaplacianKernel[6] = 0;
-  this->MklLaplacianKernel[7] = -1;
-  this->MklLaplacianKernel[8] = 0;
 }
 
 //-----------------------------------------------------------------------------
-void vtkPlusForoughiBoneSurfaceProbability::DeleteKernels()
+void vtkPlusForoughiBoneSurfaceProbability::GaussianSmooth(const double* inputBuffer, double* outputBuffer, int nx, int ny)
 {
-  // Free memory
-  MKL_FREE_IF_NULL(this->MklGaussianBuffer);
-  MKL_FREE_IF_NULL(this->MklLaplacianOfGaussianBuffer);
-  MKL_FREE_IF_NULL(this->MklGaussianBufferTemp);
-  MKL_FREE_IF_NULL(this->MklLaplacianOfGaussianBufferTemp);
-  MKL_FREE_IF_NULL(this->MklReflectionNumberBuffer);
-  MKL_FREE_IF_NULL(this->MklShadowValueBuffer);
-  MKL_FREE_IF_NULL(this->MklShadowModel);
-  MKL_FREE_IF_NULL(this->MklGaussianKernel);
-  MKL_FREE_IF_NULL(this->MklLaplacianKernel);
+#ifdef PLUS_USE_INTEL_MKL
+  Conv2(inputBuffer, &this->GaussianKernel2D[0], &this->GaussianBufferTemp[0], outputBuffer, nx, ny, this->GaussianKernelSize, this->GaussianKernelSize);
+#else
+  const double* kernel = &this->GaussianKernel[0];
+  int intervall = (this->GaussianKernelSize - 1) / 2;
+  double* tempBuffer = &this->GaussianBufferTemp[0];
+  int numberOfThreads = this->NumberOfThreads;
+
+  // Convolve the rows. Each kernel position is a separate pass over the row, so that the inner loop can be vectorized.
+  PlusThreadPool::ParallelFor(0, ny, numberOfThreads, [ = ](int firstRow, int endRow)
+  {
+    for (int y = firstRow; y < endRow; ++y)
+    {
+      const double* inputRow = inputBuffer + y * nx;
+      double* tempRow = tempBuffer + y * nx;
+      std::fill(tempRow, tempRow + nx, 0.0);
+      for (int k = -intervall; k <= intervall; ++k)
+      {
+        double weight = kernel[k + intervall];
+        for (int x = std::max(0, -k); x < std::min(nx, nx - k); ++x)
+        {
+          tempRow[x] += weight * inputRow[x + k];
+        }
+      }
+    }
+  });
+
+  // Convolve the columns, processing whole rows at a time
+  PlusThreadPool::ParallelFor(0, ny, numberOfThreads, [ = ](int firstRow, int endRow)
+  {
+    for (int y = firstRow; y < endRow; ++y)
+    {
+      double* outputRow = outputBuffer + y * nx;
+      std::fill(outputRow, outputRow + nx, 0.0);
+      for (int k = std::max(-intervall, -y); k <= std::min(intervall, ny - 1 - y); ++k)
+      {
+        double weight = kernel[k + intervall];
+        const double* tempRow = tempBuffer + (y + k) * nx;
+        for (int x = 0; x < nx; ++x)
+        {
+          outputRow[x] += weight * tempRow[x];
+        }
+      }
+    }
+  });
+#endif
 }
 
 //-----------------------------------------------------------------------------
-// Performs a 2D convolution using Intel MKL defined by the kernel buffer.
-void vtkPlusForoughiBoneSurfaceProbability::Conv2(const double* inputBuffer, const double* kernelBuffer, double* tempBuffer, double* outputBuffer, int nx, int ny, int kx, int ky)
+void vtkPlusForoughiBoneSurfaceProbability::Laplacian(const double* inputBuffer, double* outputBuffer, int nx, int ny)
 {
-  int inputShape[] = {nx, ny};
-  int kernelShape[] = {kx, ky};
-  int resultShape[] = {nx + kx - 1, ny + ky - 1};
-
-  VSLConvTaskPtr task;
-  int status = vsldConvNewTask(&task, VSL_CONV_MODE_AUTO, 2, inputShape, kernelShape, resultShape);
-
-  status = vsldConvExec(task, inputBuffer, NULL, kernelBuffer, NULL, tempBuffer, NULL);
-  vslConvDeleteTask(&task);
-
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  timer->StartTimer();
-  ResizeMatrix(tempBuffer, outputBuffer, kx, ky, nx + kx - 1, ny + ky - 1);
-  timer->StopTimer();
-  LOG_INFO("Resizematrix: " << timer->GetElapsedTime());
+  // Kernel: [0 -1 0; -1 4 -1; 0 -1 0]
+  PlusThreadPool::ParallelFor(0, ny, this->NumberOfThreads, [ = ](int firstRow, int endRow)
+  {
+    for (int y = firstRow; y < endRow; ++y)
+    {
+      const double* inputRow = inputBuffer + y * nx;
+      double* outputRow = outputBuffer + y * nx;
+      for (int x = 0; x < nx; ++x)
+      {
+        outputRow[x] = 4 * inputRow[x];
+      }
+      for (int x = 1; x < nx; ++x)
+      {
+        outputRow[x] -= inputRow[x - 1];
+      }
+      for (int x = 0; x < nx - 1; ++x)
+      {
+        outputRow[x] -= inputRow[x + 1];
+      }
+      if (y > 0)
+      {
+        for (int x = 0; x < nx; ++x)
+        {
+          outputRow[x] -= inputRow[x - nx];
+        }
+      }
+      if (y < ny - 1)
+      {
+        for (int x = 0; x < nx; ++x)
+        {
+          outputRow[x] -= inputRow[x + nx];
+        }
+      }
+    }
+  });
 }
 
 //-----------------------------------------------------------------------------
-void vtkPlusForoughiBoneSurfaceProbability::ResizeMatrix(const double* inputBuffer, double* outputBuffer, int xClipping, int yClipping, int xInputSize, int yInputSize)
+// The shadow value of a pixel is the shadow model weighted average of the pixels below it in the same column:
+//   sum_{i=y..ny-1}(ShadowModel[i-y] * G[x,i]) / sum_{i=y..ny-1}(ShadowModel[i-y])
+// The denominator only depends on the row (ShadowModelSum). Below the first SHADOW_MODEL_ZERO_TAIL_LENGTH rows
+// ShadowModel[i] = 1 - ShadowModelComplement[i] (and ShadowModelComplement is negligible after a few sigmas), therefore
+// the numerator is the sum of the column below the pixel minus a short correction term. The column sums are updated
+// row by row from the bottom of the image, so each column is processed in O(ny) time.
+void vtkPlusForoughiBoneSurfaceProbability::ComputeReflectionAndShadow(int nx, int ny)
 {
-  int xStart = (xClipping + 2 - 1) / 2 - 1;
-  int yStart = (yClipping + 2 - 1) / 2 - 1;
-  int xStop = xInputSize - xStart;
-  int yStop = yInputSize - yStart;
-
-  int idx = 0;
-  for (int y = 0; y < yInputSize; ++y)
+  const double* gaussian = &this->GaussianBuffer[0];
+  double* laplacianOfGaussian = &this->LaplacianOfGaussianBuffer[0];
+  double* reflectionNumbers = &this->ReflectionNumberBuffer[0];
+  double* shadowValues = &this->ShadowValueBuffer[0];
+  double* columnSuffixSums = &this->ColumnSuffixSumBuffer[0];
+  const double* shadowModel = &this->ShadowModel[0];
+  const double* shadowModelSum = &this->ShadowModelSum[0];
+  const double* shadowModelComplement = &this->ShadowModelComplement[0];
+  int shadowModelComplementLength = static_cast<int>(this->ShadowModelComplement.size());
+  double boneThreshold = this->BoneThreshold;
+  int firstBoneRow = this->TransducerMargin;
+  int blurredVSBLoG = this->BlurredVSBLoG;
+
+  // Columns are independent, each thread processes a block of columns
+  PlusThreadPool::ParallelFor(0, nx, this->NumberOfThreads, [ = ](int firstColumn, int endColumn)
   {
-    for (int x = 0; x < xInputSize; ++x)
+    std::fill(columnSuffixSums + firstColumn, columnSuffixSums + endColumn, 0.0);
+    for (int y = ny - 1; y >= 0; --y)
     {
-      if (x >= xStart && x < xStop && y >= yStart && y < yStop)
+      const double* gaussianRow = gaussian + y * nx;
+      for (int x = firstColumn; x < endColumn; ++x)
       {
-        outputBuffer[idx] = inputBuffer[x + y * xInputSize];
-        ++idx;
+        columnSuffixSums[x] += gaussianRow[x];
+      }
+
+      for (int x = firstColumn; x < endColumn; ++x)
+      {
+        int pixelIdx = x + y * nx;
+
+        // Only include pixels with intensity value larger than a specified threshold
+        if (gaussian[pixelIdx] < boneThreshold || pixelIdx <= firstBoneRow * nx)
+        {
+          reflectionNumbers[pixelIdx] = 0.0;
+          shadowValues[pixelIdx] = 0.0;
+          continue;
+        }
+
+        // Set outermost border pixels to zero and exclude negative pixels
+        if ((x == nx - 1 || x == 0 || y == ny - 1 || y == 0) || laplacianOfGaussian[pixelIdx] <= 0)
+        {
+          laplacianOfGaussian[pixelIdx] = 0.0;
+        }
+        else
+        {
+          // Divide by small number to increase image intensity
+          laplacianOfGaussian[pixelIdx] = laplacianOfGaussian[pixelIdx] / 0.005;
+        }
+
+        // Calculate reflection number
+        reflectionNumbers[pixelIdx] = IntegerPower(gaussian[pixelIdx], blurredVSBLoG) + laplacianOfGaussian[pixelIdx];
+
+        // Calculate shadow value
+        double sumGI = 0;
+        if (y < SHADOW_MODEL_ZERO_TAIL_LENGTH)
+        {
+          for (int i = y; i < ny; ++i)
+          {
+            sumGI += shadowModel[i - y] * gaussian[x + i * nx];
+          }
+        }
+        else
+        {
+          sumGI = columnSuffixSums[x];
+          int correctionLength = std::min(shadowModelComplementLength, ny - y);
+          for (int i = 0; i < correctionLength; ++i)
+          {
+            sumGI -= shadowModelComplement[i] * gaussian[pixelIdx + i * nx];
+          }
+        }
+        // The shadow model is all zero if the image is not taller than its zero tail
+        shadowValues[pixelIdx] = (shadowModelSum[y] != 0 ? sumGI / shadowModelSum[y] : 0.0);
       }
     }
-  }
+  });
 }
 
 //-----------------------------------------------------------------------------
@@ -339,6 +466,15 @@ double vtkPlusForoughiBoneSurfaceProbability::GetMaxPixelValue(const double* buf
 void vtkPlusForoughiBoneSurfaceProbability::Normalize(double* buffer, int size, bool doInverse, double maxValue /*=1.0*/)
 {
   double maxPixelValue = GetMaxPixelValue(buffer, size) / maxValue;
+  if (maxPixelValue <= 0)
+  {
+    // All pixels are zero (or negative), avoid division by zero
+    if (doInverse)
+    {
+      std::fill(buffer, buffer + size, maxValue);
+    }
+    return;
+  }
 
   if (!doInverse)
   {
@@ -353,4 +489,43 @@ void vtkPlusForoughiBoneSurfaceProbability::Normalize(double* buffer, int size,
   {
     buffer[i] = maxValue - buffer[i] / maxPixelValue;
   }
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------------
+double vtkPlusForoughiBoneSurfaceProbability::AddStageTime(const std::string& stageName, double stageStartTime)
+{
+  if (!this->ProfilingEnabled)
+  {
+    return stageStartTime;
+  }
+  double currentTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  for (std::vector<std::pair<std::string, double> >::iterator stageIt = this->StageTimesSec.begin(); stageIt != this->StageTimesSec.end(); ++stageIt)
+  {
+    if (stageIt->first == stageName)
+    {
+      stageIt->second += currentTime - stageStartTime;
+      return currentTime;
+    }
+  }
+  this->StageTimesSec.push_back(std::make_pair(stageName, currentTime - stageStartTime));
+  return currentTime;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusForoughiBoneSurfaceProbability::GetStageTimings(std::vector<std::string>& stageNames, std::vector<double>& stageTimesSec) const
+{
+  stageNames.clear();
+  stageTimesSec.clear();
+  for (std::vector<std::pair<std::string, double> >::const_iterator stageIt = this->StageTimesSec.begin(); stageIt != this->StageTimesSec.end(); ++stageIt)
+  {
+    stageNames.push_back(stageIt->first);
+    stageTimesSec.push_back(stageIt->second);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusForoughiBoneSurfaceProbability::ResetStageTimings()
+{
+  this->StageTimesSec.clear();
+  this->NumberOfTimedFrames = 0;
+}
@@ -18,11 +18,17 @@ Foroughi, P., et al. (2007) Ultrasound bone segmentation using dynamic programmi
 
 Implemented (with some modifications) by Mikael Brudfors, March 2014.
 
-The *Intel MKL* code uses double data at this moment, therefore input and output must be double scalar type image.
+The filter uses double data at this moment, therefore input and output must be double scalar type image.
 
-The module uses *OpenMP* and *Intel MKL*. A free trial of *Intel MKL* can be downloaded from here:
+The Gaussian smoothing is computed as two separable 1D convolutions. The shadow value of a pixel (the shadow
+model weighted average of the pixels below it) is computed from a running sum of the column from the bottom of
+the image and a short correction for the first few rows of the shadow model, where it differs from 1. Therefore
+the processing time increases linearly with the image height.
 
-[https://software.intel.com/en-us/intel-mkl/try-buy](https://software.intel.com/en-us/intel-mkl/try-buy)
+If Plus is built with *Intel MKL* (PLUS_USE_INTEL_MKL) then the Gaussian smoothing is computed by MKL.
+Image rows (image columns for the shadow value) are processed on multiple threads (see NumberOfThreads).
+
+Processing time of each stage can be recorded by enabling profiling (see ProfilingEnabled and GetStageTimings).
 
 \ingroup PlusLibImageProcessingAlgo
 */
@@ -32,6 +38,11 @@ The module uses *OpenMP* and *Intel MKL*. A free trial of *Intel MKL* can be dow
 #include "vtkSimpleImageToImageFilter.h"
 #include "vtkSmartPointer.h"
 
+// STL includes
+#include <string>
+#include <utility>
+#include <vector>
+
 class vtkPlusImageProcessingExport vtkPlusForoughiBoneSurfaceProbability : public vtkSimpleImageToImageFilter
 {
 public:
@@ -62,19 +73,39 @@ public:
   vtkSetMacro(TransducerMargin, int);
   vtkGetMacro(TransducerMargin, int);
 
+  /*! Number of threads used for processing the image rows. 0 means the number of hardware threads. */
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /*! If enabled then the processing time of each stage is recorded */
+  vtkSetMacro(ProfilingEnabled, bool);
+  vtkGetMacro(ProfilingEnabled, bool);
+  vtkBooleanMacro(ProfilingEnabled, bool);
+
+  /*! Number of slices processed since the stage timings were reset */
+  vtkGetMacro(NumberOfTimedFrames, int);
+  /*! Get the name and total processing time (in seconds, since the stage timings were reset) of each processing stage, in the order of execution */
+  void GetStageTimings(std::vector<std::string>& stageNames, std::vector<double>& stageTimesSec) const;
+  void ResetStageTimings();
+
 protected:
   vtkPlusForoughiBoneSurfaceProbability();
   virtual ~vtkPlusForoughiBoneSurfaceProbability();
 
   void UpdateKernels();
-  void DeleteKernels();
 
-  void Foroughi2007(double* inputBuffer, double* outputBuffer, double smoothingSigma, int transducerMargin, double shadowSigma, double boneThreshold, int blurredVSBLoG, int shadowVSIntensity, int nx, int ny, int nz);
-  void Conv2(const double* inputBuffer, const double* kernelBuffer, double* tempBuffer, double* outputBuffer, int nx, int ny, int kx, int ky);
-  void ResizeMatrix(const double* inputBuffer, double* outputBuffer, int xClipping, int yClipping, int xInputSize, int yInputSize);
+  /*! Convolve the image with the Gaussian kernel. The result has the same size as the input, pixels outside of the image are considered to be zero. */
+  void GaussianSmooth(const double* inputBuffer, double* outputBuffer, int nx, int ny);
+  /*! Convolve the image with the 3x3 Laplacian kernel. Pixels outside of the image are considered to be zero. */
+  void Laplacian(const double* inputBuffer, double* outputBuffer, int nx, int ny);
+  /*! Compute the reflection number and shadow value of each pixel */
+  void ComputeReflectionAndShadow(int nx, int ny);
   double GetMaxPixelValue(const double* buffer, int size);
   void Normalize(double* buffer, int size, bool doInverse, double maxValue = 1.0);
 
+  /*! Add the time elapsed since stageStartTime to the total time of the stage (if profiling is enabled). Returns the current time. */
+  double AddStageTime(const std::string& stageName, double stageStartTime);
+
   virtual void SimpleExecute(vtkImageData* input, vtkImageData* output);
 
   int BlurredVSBLoG;
@@ -83,21 +114,41 @@ protected:
   int ShadowVSIntensity;
   double SmoothingSigma;
   int TransducerMargin;
+  int NumberOfThreads;
 
   bool KernelUpdateRequested;
 
   int GaussianKernelSize;
   FrameSizeType FrameSize;
 
-  double* MklGaussianBuffer;
-  double* MklLaplacianOfGaussianBuffer;
-  double* MklGaussianBufferTemp;
-  double* MklLaplacianOfGaussianBufferTemp;
-  double* MklReflectionNumberBuffer;
-  double* MklShadowValueBuffer;
-  double* MklShadowModel;
-  double* MklGaussianKernel;
-  double* MklLaplacianKernel;
+  std::vector<double> GaussianBuffer;
+  std::vector<double> LaplacianOfGaussianBuffer;
+  /*! Result of the first pass of the separable Gaussian convolution (full size convolution result if MKL is used) */
+  std::vector<double> GaussianBufferTemp;
+  std::vector<double> ReflectionNumberBuffer;
+  std::vector<double> ShadowValueBuffer;
+  /*! Sum of the pixels of each column from the current row to the bottom of the image */
+  std::vector<double> ColumnSuffixSumBuffer;
+
+  /*! Weight of a pixel in the shadow value of a pixel above it, as a function of their distance */
+  std::vector<double> ShadowModel;
+  /*! Sum of the shadow model weights for each row: the denominator of the shadow value */
+  std::vector<double> ShadowModelSum;
+  /*!
+    Difference of the shadow model from 1 for the first rows (1 - ShadowModel). Beyond the length of this vector
+    the difference is below the double precision and the shadow model is considered to be 1.
+  */
+  std::vector<double> ShadowModelComplement;
+
+  /*! Gaussian kernel along one axis (the 2D Gaussian kernel is separable) */
+  std::vector<double> GaussianKernel;
+  /*! 2D Gaussian kernel, only used if the convolution is computed by MKL */
+  std::vector<double> GaussianKernel2D;
+
+  bool ProfilingEnabled;
+  /*! Total processing time of each stage, in the order of execution */
+  std::vector<std::pair<std::string, double> > StageTimesSec;
+  int NumberOfTimedFrames;
 
 private:
   vtkPlusForoughiBoneSurfaceProbability(const vtkPlusForoughiBoneSurfaceProbability&);  // Not implemented.
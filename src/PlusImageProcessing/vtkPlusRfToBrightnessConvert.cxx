@@ -16,23 +16,232 @@ See License.txt for details.
 #include "vtkMath.h"
 
 #include <math.h>
+#include <string.h>
 
 vtkStandardNewMacro(vtkPlusRfToBrightnessConvert);
 
 const double MIN_BRIGHTNESS_VALUE = 0.0;
 const double MAX_BRIGHTNESS_VALUE = 255.0;
 
+// The compression lookup table is indexed by the sign, exponent and the 7 most significant mantissa bits of a 32-bit float
+const unsigned int COMPRESSION_TABLE_INDEX_SHIFT = 16;
+const unsigned int COMPRESSION_TABLE_SIZE = 1 << 15; // the squared amplitude is never negative, so the sign bit is always 0
+const unsigned int FLOAT_EXPONENT_ALL_ONES_INDEX = 0x7F80; // infinity or NaN
+
+//----------------------------------------------------------------------------
+/*!
+  Radix-2 FFT of a fixed size, with separate arrays for the real and imaginary parts so that
+  the butterfly loops can be vectorized by the compiler.
+  The forward transform (decimation in frequency) takes the input in natural order and returns the
+  spectrum in bit-reversed order, the backward transform (decimation in time) takes the spectrum in
+  bit-reversed order and returns the result in natural order, therefore no reordering is needed
+  if only pointwise operations are performed on the spectrum.
+*/
+class vtkPlusRfToBrightnessConvert::FftPlan
+{
+public:
+  FftPlan(int size)
+    : Size(size)
+  {
+    int log2Size = 0;
+    while ((1 << log2Size) < size)
+    {
+      log2Size++;
+    }
+
+    // Twiddle factors exp(-i*pi*j/h) for each butterfly span h, stored contiguously from index h-1
+    this->TwiddleReal.resize(size);
+    this->TwiddleImag.resize(size);
+    for (int halfSpan = 1; halfSpan < size; halfSpan *= 2)
+    {
+      for (int j = 0; j < halfSpan; j++)
+      {
+        this->TwiddleReal[halfSpan - 1 + j] = static_cast<float>(cos(-vtkMath::Pi() * j / halfSpan));
+        this->TwiddleImag[halfSpan - 1 + j] = static_cast<float>(sin(-vtkMath::Pi() * j / halfSpan));
+      }
+    }
+
+    // Weights of the Hilbert transform in bit-reversed order: -i*sign(k), the 1/N normalization
+    // of the inverse transform is included. Zero frequency and the Nyquist frequency are removed.
+    this->HilbertWeights.resize(size);
+    for (int position = 0; position < size; position++)
+    {
+      int k = 0;
+      for (int bit = 0; bit < log2Size; bit++)
+      {
+        if (position & (1 << bit))
+        {
+          k |= 1 << (log2Size - 1 - bit);
+        }
+      }
+      if (k == 0 || k == size / 2)
+      {
+        this->HilbertWeights[position] = 0.0f;
+      }
+      else
+      {
+        this->HilbertWeights[position] = (k < size / 2 ? 1.0f : -1.0f) / size;
+      }
+    }
+  }
+
+  int GetSize() const { return this->Size; }
+
+  //----------------------------------------------------------------------------
+  /*!
+    Replace the real and imaginary parts by the Hilbert transform of the real and imaginary parts, respectively.
+    As the Hilbert transform is a real linear operator, two real signals can be transformed at once.
+  */
+  void ComputeHilbertTransform(float* re, float* im) const
+  {
+    ForwardTransform(re, im);
+    // Multiply by -i*sign(k) and conjugate, so that the inverse transform can be computed by a forward butterfly network.
+    // The result is then conjugated again by negating the imaginary part when it is used.
+    const float* weights = &this->HilbertWeights[0];
+    for (int k = 0; k < this->Size; k++)
+    {
+      float spectrumReal = re[k];
+      re[k] = im[k] * weights[k];
+      im[k] = spectrumReal * weights[k];
+    }
+    BackwardTransform(re, im);
+    for (int k = 0; k < this->Size; k++)
+    {
+      im[k] = -im[k];
+    }
+  }
+
+protected:
+  //----------------------------------------------------------------------------
+  void ForwardTransform(float* re, float* im) const
+  {
+    for (int halfSpan = this->Size / 2; halfSpan >= 4; halfSpan /= 2)
+    {
+      const float* wr = &this->TwiddleReal[halfSpan - 1];
+      const float* wi = &this->TwiddleImag[halfSpan - 1];
+      for (int start = 0; start < this->Size; start += 2 * halfSpan)
+      {
+        float* ar = re + start;
+        float* ai = im + start;
+        float* br = re + start + halfSpan;
+        float* bi = im + start + halfSpan;
+        for (int j = 0; j < halfSpan; j++)
+        {
+          float dr = ar[j] - br[j];
+          float di = ai[j] - bi[j];
+          ar[j] += br[j];
+          ai[j] += bi[j];
+          br[j] = dr * wr[j] - di * wi[j];
+          bi[j] = dr * wi[j] + di * wr[j];
+        }
+      }
+    }
+    // Last two stages (twiddle factors 1 and -i)
+    for (int start = 0; start < this->Size; start += 4)
+    {
+      float r0 = re[start] + re[start + 2];
+      float i0 = im[start] + im[start + 2];
+      float r2 = re[start] - re[start + 2];
+      float i2 = im[start] - im[start + 2];
+      float r1 = re[start + 1] + re[start + 3];
+      float i1 = im[start + 1] + im[start + 3];
+      float r3 = im[start + 1] - im[start + 3];
+      float i3 = re[start + 3] - re[start + 1];
+      re[start] = r0 + r1;
+      im[start] = i0 + i1;
+      re[start + 1] = r0 - r1;
+      im[start + 1] = i0 - i1;
+      re[start + 2] = r2 + r3;
+      im[start + 2] = i2 + i3;
+      re[start + 3] = r2 - r3;
+      im[start + 3] = i2 - i3;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void BackwardTransform(float* re, float* im) const
+  {
+    // First two stages (twiddle factors 1 and -i)
+    for (int start = 0; start < this->Size; start += 4)
+    {
+      float r0 = re[start] + re[start + 1];
+      float i0 = im[start] + im[start + 1];
+      float r1 = re[start] - re[start + 1];
+      float i1 = im[start] - im[start + 1];
+      float r2 = re[start + 2] + re[start + 3];
+      float i2 = im[start + 2] + im[start + 3];
+      float r3 = re[start + 2] - re[start + 3];
+      float i3 = im[start + 2] - im[start + 3];
+      re[start] = r0 + r2;
+      im[start] = i0 + i2;
+      re[start + 2] = r0 - r2;
+      im[start + 2] = i0 - i2;
+      re[start + 1] = r1 + i3;
+      im[start + 1] = i1 - r3;
+      re[start + 3] = r1 - i3;
+      im[start + 3] = i1 + r3;
+    }
+    for (int halfSpan = 4; halfSpan < this->Size; halfSpan *= 2)
+    {
+      const float* wr = &this->TwiddleReal[halfSpan - 1];
+      const float* wi = &this->TwiddleImag[halfSpan - 1];
+      for (int start = 0; start < this->Size; start += 2 * halfSpan)
+      {
+        float* ar = re + start;
+        float* ai = im + start;
+        float* br = re + start + halfSpan;
+        float* bi = im + start + halfSpan;
+        for (int j = 0; j < halfSpan; j++)
+        {
+          float tr = br[j] * wr[j] - bi[j] * wi[j];
+          float ti = br[j] * wi[j] + bi[j] * wr[j];
+          br[j] = ar[j] - tr;
+          bi[j] = ai[j] - ti;
+          ar[j] += tr;
+          ai[j] += ti;
+        }
+      }
+    }
+  }
+
+  int Size;
+  std::vector<float> TwiddleReal;
+  std::vector<float> TwiddleImag;
+  std::vector<float> HilbertWeights;
+};
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  int GetFftSize(int numberOfSamples)
+  {
+    int fftSize = 4; // the butterfly network requires at least 4 samples
+    while (fftSize < numberOfSamples)
+    {
+      fftSize *= 2;
+    }
+    return fftSize;
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkPlusRfToBrightnessConvert::vtkPlusRfToBrightnessConvert()
 {
   this->ImageType = US_IMG_TYPE_XX;
   this->BrightnessScale = 10.0;
   this->NumberOfHilbertFilterCoeffs = 64;
+  this->EnvelopeDetectionMethod = ENVELOPE_DETECTION_FIR;
+  this->CompressionTableBrightnessScale = 0.0;
 }
 
 //----------------------------------------------------------------------------
 vtkPlusRfToBrightnessConvert::~vtkPlusRfToBrightnessConvert()
 {
+  for (std::map<int, FftPlan*>::iterator planIt = this->FftPlans.begin(); planIt != this->FftPlans.end(); ++planIt)
+  {
+    delete planIt->second;
+  }
+  this->FftPlans.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -101,6 +310,63 @@ int vtkPlusRfToBrightnessConvert::RequestInformation(vtkInformation*,
   return 1;
 }
 
+//----------------------------------------------------------------------------
+int vtkPlusRfToBrightnessConvert::RequestData(vtkInformation* request,
+    vtkInformationVector** inputVector,
+    vtkInformationVector* outputVector)
+{
+  if (this->ImageType == US_IMG_RF_REAL)
+  {
+    if (this->EnvelopeDetectionMethod == ENVELOPE_DETECTION_FFT)
+    {
+      vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+      int inExt[6] = {0};
+      inInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt);
+      PrepareFftEnvelopeDetection(inExt[1] - inExt[0] + 1);
+    }
+    else
+    {
+      ComputeHilbertTransformCoeffs();
+    }
+  }
+  return this->Superclass::RequestData(request, inputVector, outputVector);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusRfToBrightnessConvert::PrepareFftEnvelopeDetection(int numberOfSamplesInScanline)
+{
+  int fftSize = GetFftSize(numberOfSamplesInScanline);
+  if (this->FftPlans.find(fftSize) == this->FftPlans.end())
+  {
+    LOG_DEBUG("Create FFT plan for " << fftSize << " samples");
+    this->FftPlans[fftSize] = new FftPlan(fftSize);
+  }
+
+  if (this->CompressionTable.size() == COMPRESSION_TABLE_SIZE && this->CompressionTableBrightnessScale == this->BrightnessScale)
+  {
+    // already computed for the current brightness scale
+    return;
+  }
+  this->CompressionTable.resize(COMPRESSION_TABLE_SIZE);
+  for (unsigned int index = 0; index < COMPRESSION_TABLE_SIZE; index++)
+  {
+    double brightnessValue = MAX_BRIGHTNESS_VALUE;
+    if (index < FLOAT_EXPONENT_ALL_ONES_INDEX)
+    {
+      // Use the middle of the range of squared amplitude values that are mapped to this index
+      unsigned int squaredAmplitudeBits = (index << COMPRESSION_TABLE_INDEX_SHIFT) | (1 << (COMPRESSION_TABLE_INDEX_SHIFT - 1));
+      float squaredAmplitude = 0;
+      memcpy(&squaredAmplitude, &squaredAmplitudeBits, sizeof(squaredAmplitude));
+      // Same as sqrt(sqrt(sqrt(xt * xt + xht * xht))) * this->BrightnessScale in FIR mode
+      brightnessValue = pow(static_cast<double>(squaredAmplitude), 0.125) * this->BrightnessScale;
+    }
+    if (brightnessValue > MAX_BRIGHTNESS_VALUE) { brightnessValue = MAX_BRIGHTNESS_VALUE; }
+    if (brightnessValue < MIN_BRIGHTNESS_VALUE) { brightnessValue = MIN_BRIGHTNESS_VALUE; }
+    this->CompressionTable[index] = static_cast<unsigned char>(brightnessValue);
+  }
+  this->CompressionTableBrightnessScale = this->BrightnessScale;
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusRfToBrightnessConvert::ThreadedRequestData(
   vtkInformation* vtkNotUsed(request),
@@ -240,7 +506,29 @@ void vtkPlusRfToBrightnessConvert::ThreadedLineByLineHilbertTransform(int inExt[
     return;
   }
 
-  ScalarType* hilbertTransformBuffer = new ScalarType[numberOfRfSamplesInScanline + 1];
+  ScalarType* hilbertTransformBuffer = NULL;
+  const FftPlan* fftPlan = NULL;
+  std::vector<float> fftRealBuffer;
+  std::vector<float> fftImagBuffer;
+  // In FFT mode scan lines are processed in pairs, the first line of a pair is stored until the second one is available
+  ScalarType* pendingFftInPtr = NULL;
+  unsigned char* pendingFftOutPtr = NULL;
+  if (this->ImageType == US_IMG_RF_REAL && this->EnvelopeDetectionMethod == ENVELOPE_DETECTION_FFT)
+  {
+    std::map<int, FftPlan*>::const_iterator planIt = this->FftPlans.find(GetFftSize(numberOfRfSamplesInScanline));
+    if (planIt == this->FftPlans.end())
+    {
+      LOG_ERROR("FFT plan is not available for scan line length " << numberOfRfSamplesInScanline);
+      return;
+    }
+    fftPlan = planIt->second;
+    fftRealBuffer.resize(fftPlan->GetSize());
+    fftImagBuffer.resize(fftPlan->GetSize());
+  }
+  else
+  {
+    hilbertTransformBuffer = new ScalarType[numberOfRfSamplesInScanline + 1];
+  }
   for (int idx2 = outExt[4]; idx2 <= outExt[5]; ++idx2)
   {
     for (int idx1 = outExt[2]; !this->AbortExecute && idx1 <= outExt[3]; ++idx1)
@@ -273,8 +561,25 @@ void vtkPlusRfToBrightnessConvert::ThreadedLineByLineHilbertTransform(int inExt[
           {
             // e.g., Ultrasonix
             // RF data: IIIII..., IIIII...
-            ComputeHilbertTransform(hilbertTransformBuffer, inPtr, numberOfRfSamplesInScanline);
-            ComputeAmplitudeILineQLine(outPtr, inPtr, hilbertTransformBuffer, numberOfRfSamplesInScanline);
+            if (fftPlan != NULL)
+            {
+              if (pendingFftInPtr == NULL)
+              {
+                pendingFftInPtr = inPtr;
+                pendingFftOutPtr = outPtr;
+              }
+              else
+              {
+                ComputeAmplitudeFft(fftPlan, pendingFftOutPtr, outPtr, pendingFftInPtr, inPtr, numberOfRfSamplesInScanline, &fftRealBuffer[0], &fftImagBuffer[0]);
+                pendingFftInPtr = NULL;
+                pendingFftOutPtr = NULL;
+              }
+            }
+            else
+            {
+              ComputeHilbertTransform(hilbertTransformBuffer, inPtr, numberOfRfSamplesInScanline);
+              ComputeAmplitudeILineQLine(outPtr, inPtr, hilbertTransformBuffer, numberOfRfSamplesInScanline);
+            }
             inPtr += numberOfRfSamplesInScanline + inInc1;
             outPtr += numberOfBmodeSamplesInScanline + outInc1;
           }
@@ -294,6 +599,11 @@ void vtkPlusRfToBrightnessConvert::ThreadedLineByLineHilbertTransform(int inExt[
     inPtr += inInc2;
     outPtr += outInc2;
   }
+  if (pendingFftInPtr != NULL)
+  {
+    // odd number of scan lines
+    ComputeAmplitudeFft<ScalarType>(fftPlan, pendingFftOutPtr, NULL, pendingFftInPtr, NULL, numberOfRfSamplesInScanline, &fftRealBuffer[0], &fftImagBuffer[0]);
+  }
   if (!imageTypeValid)
   {
     LOG_ERROR("Unsupported image type for brightness conversion: "<< igsioCommon::GetStringFromUsImageType(this->ImageType));
@@ -306,6 +616,7 @@ void vtkPlusRfToBrightnessConvert::ThreadedLineByLineHilbertTransform(int inExt[
 void vtkPlusRfToBrightnessConvert::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "EnvelopeDetectionMethod: " << (this->EnvelopeDetectionMethod == ENVELOPE_DETECTION_FFT ? "FFT" : "FIR") << std::endl;
 }
 
 //-----------------------------------------------------------------------------
@@ -315,6 +626,9 @@ PlusStatus vtkPlusRfToBrightnessConvert::ReadConfiguration(vtkXMLDataElement* rf
   XML_VERIFY_ELEMENT(rfToBrightnessElement, "RfToBrightnessConversion");
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfHilbertFilterCoeffs, rfToBrightnessElement);
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, BrightnessScale, rfToBrightnessElement);
+  XML_READ_ENUM2_ATTRIBUTE_OPTIONAL(EnvelopeDetectionMethod, rfToBrightnessElement,
+                                    "FIR", ENVELOPE_DETECTION_FIR,
+                                    "FFT", ENVELOPE_DETECTION_FFT);
   return PLUS_SUCCESS;
 }
 
@@ -327,6 +641,7 @@ PlusStatus vtkPlusRfToBrightnessConvert::WriteConfiguration(vtkXMLDataElement* r
 
   rfToBrightnessElement->SetDoubleAttribute("NumberOfHilbertFilterCoeffs", this->NumberOfHilbertFilterCoeffs);
   rfToBrightnessElement->SetDoubleAttribute("BrightnessScale", this->BrightnessScale);
+  rfToBrightnessElement->SetAttribute("EnvelopeDetectionMethod", this->EnvelopeDetectionMethod == ENVELOPE_DETECTION_FFT ? "FFT" : "FIR");
 
   return PLUS_SUCCESS;
 }
@@ -370,8 +685,7 @@ void vtkPlusRfToBrightnessConvert::ComputeHilbertTransformCoeffs()
 template<typename ScalarType>
 PlusStatus vtkPlusRfToBrightnessConvert::ComputeHilbertTransform(ScalarType* hilbertTransformOutput, ScalarType* input, int npt)
 {
-  ComputeHilbertTransformCoeffs(); // update the transform coefficients if needed
-
+  // The transform coefficients are updated in RequestData, before the processing threads are started
   if (npt < this->NumberOfHilbertFilterCoeffs)
   {
     LOG_ERROR("Insufficient data for performing Hilbert transform");
@@ -456,3 +770,58 @@ void vtkPlusRfToBrightnessConvert::ComputeAmplitudeIqLine(unsigned char* ampl, S
     ampl[outputIndex++] = outputValue;
   }
 }
+
+template<typename ScalarType>
+void vtkPlusRfToBrightnessConvert::ComputeAmplitudeFft(const FftPlan* fftPlan, unsigned char* ampl1, unsigned char* ampl2, ScalarType* inputSignal1, ScalarType* inputSignal2, int npt, float* realBuffer, float* imagBuffer)
+{
+  int fftSize = fftPlan->GetSize();
+
+  // First scan line in the real part, second scan line in the imaginary part, padded by zeros
+  for (int i = 0; i < npt; i++)
+  {
+    realBuffer[i] = static_cast<float>(inputSignal1[i]);
+  }
+  if (inputSignal2 != NULL)
+  {
+    for (int i = 0; i < npt; i++)
+    {
+      imagBuffer[i] = static_cast<float>(inputSignal2[i]);
+    }
+  }
+  else
+  {
+    memset(imagBuffer, 0, npt * sizeof(float));
+  }
+  memset(realBuffer + npt, 0, (fftSize - npt) * sizeof(float));
+  memset(imagBuffer + npt, 0, (fftSize - npt) * sizeof(float));
+
+  fftPlan->ComputeHilbertTransform(realBuffer, imagBuffer);
+
+  const unsigned char* compressionTable = &this->CompressionTable[0];
+  unsigned char* ampl[2] = {ampl1, ampl2};
+  ScalarType* inputSignal[2] = {inputSignal1, inputSignal2};
+  float* hilbertTransformed[2] = {realBuffer, imagBuffer};
+  for (int line = 0; line < 2; line++)
+  {
+    if (inputSignal[line] == NULL)
+    {
+      continue;
+    }
+    // Squared amplitude, computed in place
+    float* squaredAmplitude = hilbertTransformed[line];
+    const ScalarType* xt = inputSignal[line];
+    for (int i = 0; i < npt; i++)
+    {
+      float xht = squaredAmplitude[i];
+      squaredAmplitude[i] = static_cast<float>(xt[i]) * static_cast<float>(xt[i]) + xht * xht;
+    }
+    // Dynamic range compression
+    unsigned char* out = ampl[line];
+    for (int i = 0; i < npt; i++)
+    {
+      unsigned int squaredAmplitudeBits = 0;
+      memcpy(&squaredAmplitudeBits, squaredAmplitude + i, sizeof(squaredAmplitudeBits));
+      out[i] = compressionTable[squaredAmplitudeBits >> COMPRESSION_TABLE_INDEX_SHIFT];
+    }
+  }
+}
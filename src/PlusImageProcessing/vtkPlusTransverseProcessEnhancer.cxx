@@ -9,6 +9,7 @@ See License.txt for details.
 #include "PlusMath.h"
 #include "igsioTrackedFrame.h"
 #include "igsioVideoFrame.h"
+#include "vtkIGSIOAccurateTimer.h"
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtkPlusTransverseProcessEnhancer.h"
 #include "vtkPlusUsScanConvertCurvilinear.h"
@@ -24,11 +25,62 @@ See License.txt for details.
 #include <vtkImageThreshold.h>
 #include <vtkObjectFactory.h>
 
+#include <algorithm>
 #include <cmath>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkPlusTransverseProcessEnhancer);
 
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Removes the outline pixels of a bone area: on each row the first bone pixel (going towards the transducer)
+  // and the outline pixels before it are cleared.
+  void RemoveBoneAreaOutline(unsigned char* pixels, int rowLengthPx, std::map<std::string, int>& area, int bonePushBackPx, int boneOutlineDepthPx)
+  {
+    int xMax = area["xMax"];
+    int xMin = area["xMin"];
+    for (int y = area["yMax"]; y >= area["yMin"]; --y)
+    {
+      //search through the area where the pixels are known to be
+      unsigned char* row = pixels + y * rowLengthPx;
+      for (int x = xMax - bonePushBackPx; x >= xMin - bonePushBackPx && x >= 0; --x)
+      {
+        if (row[x] != 0)
+        {
+          //remove all pixels in the outline
+          for (int removeBonex = std::max(0, x - (boneOutlineDepthPx - 1)); removeBonex <= x; ++removeBonex)
+          {
+            row[removeBonex] = 0;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Sum of the pixels of rows [yStart, yEnd] from the last pixel of the row down to xMin. Rows outside of the image are ignored.
+  float SumShadowArea(const unsigned char* pixels, int rowLengthPx, int numberOfRows, int yStart, int yEnd, int xMin)
+  {
+    float sum = 0;
+    int step = (yStart <= yEnd ? 1 : -1);
+    for (int y = yStart; y != yEnd + step; y += step)
+    {
+      if (y < 0 || y >= numberOfRows)
+      {
+        continue;
+      }
+      const unsigned char* row = pixels + y * rowLengthPx;
+      for (int x = rowLengthPx - 1; x >= xMin; --x)
+      {
+        sum += row[x];
+      }
+    }
+    return sum;
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkPlusTransverseProcessEnhancer::vtkPlusTransverseProcessEnhancer() : vtkPlusBoneEnhancer()
 {
@@ -52,23 +104,20 @@ void vtkPlusTransverseProcessEnhancer::RemoveOffCameraBones(vtkSmartPointer<vtkI
 {
   int dims[3] = { 0, 0, 0 };
   inputImage->GetDimensions(dims);
-
-  unsigned char* vOutput = 0;
+  unsigned char* pixels = static_cast<unsigned char*>(inputImage->GetScalarPointer());
 
   int distanceVerticalBuffer = 10;    // For a bone to be valid, it must be this distance from the transducer
   int distanceHorizontalBuffer = 20;  // For a bone to be valid, it must be this distance from the horizontal sides of the frame
   int boneMinSize = 10;               // Minimum bone size a bone must have to be valid
-  std::vector<std::map<std::string, int> > boneAreas = this->BoneAreasInfo;
+  std::vector<std::map<std::string, int> > boneAreas;
+  boneAreas.swap(this->BoneAreasInfo);
 
   int boneHalfLen;
   bool clearArea;
-  bool foundBone;
-
-  this->BoneAreasInfo.clear();
 
   for (int areaIndex = boneAreas.size() - 1; areaIndex >= 0; --areaIndex)
   {
-    std::map<std::string, int> currentArea = boneAreas.at(areaIndex);
+    std::map<std::string, int>& currentArea = boneAreas.at(areaIndex);
 
     clearArea = false;
     boneHalfLen = ((currentArea["yMax"] - currentArea["yMin"]) + 1) / 2;
@@ -97,35 +146,14 @@ void vtkPlusTransverseProcessEnhancer::RemoveOffCameraBones(vtkSmartPointer<vtkI
     //If it does not meet the criteria, remove the bones in this area
     if (clearArea == true)
     {
-      //search through the area where the pixels are known to be
-      for (int y = currentArea["yMax"]; y >= currentArea["yMin"]; --y)
-      {
-        int x = currentArea["xMax"] - this->BonePushBackPx;
-        foundBone = false;
-        while (x >= currentArea["xMin"] - this->BonePushBackPx && x >= 0 && foundBone == false)
-        {
-          vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(x, y, 0));
-          if (*vOutput != 0)
-          {
-            //remove all pixels in the outline
-            *vOutput = 0;
-            for (int removeBonex = std::max(0, x - (this->BoneOutlineDepthPx - 1)); removeBonex < x; ++removeBonex)
-            {
-              vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(removeBonex, y, 0));
-              *vOutput = 0;
-            }
-
-            foundBone = true;
-          }
-          x--;
-        }
-      }
+      RemoveBoneAreaOutline(pixels, dims[0], currentArea, this->BonePushBackPx, this->BoneOutlineDepthPx);
     }
     else
     {
       this->BoneAreasInfo.push_back(currentArea);
     }
   }
+  inputImage->Modified();
 }
 
 //----------------------------------------------------------------------------
@@ -137,9 +165,11 @@ void vtkPlusTransverseProcessEnhancer::CompareShadowAreas(vtkSmartPointer<vtkIma
 {
   int dims[3] = { 0, 0, 0 };
   inputImage->GetDimensions(dims);
+  unsigned char* pixels = static_cast<unsigned char*>(inputImage->GetScalarPointer());
 
-  float vInput = 0;
-  unsigned char* vOutput = 0;
+  int originalDims[3] = { 0, 0, 0 };
+  originalImage->GetDimensions(originalDims);
+  const unsigned char* originalPixels = static_cast<const unsigned char*>(originalImage->GetScalarPointer());
 
   //Variables used for measuring the size and intensity sum for bone, above, and below areas
   int boneLen;
@@ -153,51 +183,24 @@ void vtkPlusTransverseProcessEnhancer::CompareShadowAreas(vtkSmartPointer<vtkIma
   float areaAvgShadow;  //Shadow intensity of the area
   float belowAvgShadow; //Shadow intensity of the below area
 
-  std::map<std::string, int> currentArea;
-  std::vector<std::map<std::string, int> > boneAreas = this->BoneAreasInfo;
-
-  bool foundBone;
-  this->BoneAreasInfo.clear();
+  std::vector<std::map<std::string, int> > boneAreas;
+  boneAreas.swap(this->BoneAreasInfo);
 
   for (int areaIndex = boneAreas.size() - 1; areaIndex >= 0; --areaIndex)
   {
-    currentArea = boneAreas.at(areaIndex);
+    std::map<std::string, int>& currentArea = boneAreas.at(areaIndex);
+    int yMax = currentArea["yMax"];
+    int yMin = currentArea["yMin"];
+    int depth = currentArea["depth"];
 
-    aboveSum = 0;
-    areaSum = 0;
-    belowSum = 0;
-
-    boneLen = (currentArea["yMax"] - currentArea["yMin"]) + 1;
+    boneLen = (yMax - yMin) + 1;
     boneHalfLen = boneLen / 2;
-    boneArea = boneLen * currentArea["depth"];
+    boneArea = boneLen * depth;
 
-    //gather sum of shadow areas from above the area
-    for (int y = currentArea["yMax"] + boneHalfLen; y > currentArea["yMax"]; --y)
-    {
-      for (int x = dims[0] - 1; x >= currentArea["depth"]; --x)
-      {
-        vInput = (originalImage->GetScalarComponentAsFloat(x, y, 0, 0));
-        aboveSum += vInput;
-      }
-    }
-    //gather sum of shadow areas from the area
-    for (int y = currentArea["yMax"]; y >= currentArea["yMin"]; --y)
-    {
-      for (int x = dims[0] - 1; x >= currentArea["depth"]; --x)
-      {
-        vInput = (originalImage->GetScalarComponentAsFloat(x, y, 0, 0));
-        areaSum += vInput;
-      }
-    }
-    //gather sum of shadow areas from below the area
-    for (int y = currentArea["yMin"] - boneHalfLen; y < currentArea["yMin"]; ++y)
-    {
-      for (int x = dims[0] - 1; x >= currentArea["depth"]; --x)
-      {
-        vInput = (originalImage->GetScalarComponentAsFloat(x, y, 0, 0));
-        belowSum += vInput;
-      }
-    }
+    //gather sum of shadow areas from above the area, from the area, and from below the area
+    aboveSum = (boneHalfLen > 0 ? SumShadowArea(originalPixels, originalDims[0], originalDims[1], yMax + boneHalfLen, yMax + 1, depth) : 0);
+    areaSum = (boneLen > 0 ? SumShadowArea(originalPixels, originalDims[0], originalDims[1], yMax, yMin, depth) : 0);
+    belowSum = (boneHalfLen > 0 ? SumShadowArea(originalPixels, originalDims[0], originalDims[1], yMin - boneHalfLen, yMin - 1, depth) : 0);
 
     //Calculate average shadow intensity
     aboveAvgShadow = aboveSum / (boneArea / 2);
@@ -207,64 +210,44 @@ void vtkPlusTransverseProcessEnhancer::CompareShadowAreas(vtkSmartPointer<vtkIma
     //If there is a higher amount of bones around it, remove the area
     if (aboveAvgShadow - areaAvgShadow <= areaAvgShadow / 2 || belowAvgShadow - areaAvgShadow <= areaAvgShadow / 2)
     {
-
-      for (int y = currentArea["yMax"]; y >= currentArea["yMin"]; --y)
-      {
-        //search through the area where the pixels are known to be
-        int x = currentArea["xMax"] - this->BonePushBackPx;
-        foundBone = false;
-        while (x >= currentArea["xMin"] - this->BonePushBackPx && x >= 0 && foundBone == false)
-        {
-          vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(x, y, 0));
-          if (*vOutput != 0)
-          {
-            //remove all pixels in the outline
-            *vOutput = 0;
-
-            for (int removeBonex = std::max(0, x - (this->BoneOutlineDepthPx - 1)); removeBonex < x; ++removeBonex)
-            {
-              vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(removeBonex, y, 0));
-              *vOutput = 0;
-            }
-            foundBone = true;
-          }
-          x--;
-        }
-      }
+      RemoveBoneAreaOutline(pixels, dims[0], currentArea, this->BonePushBackPx, this->BoneOutlineDepthPx);
     }
     else
     {
       this->BoneAreasInfo.push_back(currentArea);
     }
   }
+  inputImage->Modified();
 }
 
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusTransverseProcessEnhancer::ProcessFrame(igsioTrackedFrame* inputFrame, igsioTrackedFrame* outputFrame)
 {
+  // The lines image is not modified by the subsequent steps, so it is used for comparison with the output image
+  if (this->FrameToLinesImage(inputFrame, this->ThresholdedLinesImage) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
 
-  this->BoneAreasInfo.clear();
-
-  vtkSmartPointer<vtkImageData> intermediateImage = vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage(inputFrame);
-  intermediateImage->DeepCopy(this->LinesImage);
-
-  //Save this image so that it can be used for comparison with the output image
-  vtkSmartPointer<vtkImageData> originalImage = vtkSmartPointer<vtkImageData>::New();
-  originalImage->DeepCopy(intermediateImage);
-
-  vtkPlusBoneEnhancer::RemoveNoise(intermediateImage);
+  this->DetectBoneOutline(this->ThresholdedLinesImage);
 
-  this->RemoveOffCameraBones(intermediateImage);
+  double stageStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  this->RemoveOffCameraBones(this->BinaryImageForMorphology);
   if (this->SaveIntermediateResults)
   {
-    this->AddIntermediateImage("_09PostFilters_2PostRemoveOffCamera", intermediateImage);
+    this->AddIntermediateImage("_09PostFilters_2PostRemoveOffCamera", this->BinaryImageForMorphology);
   }
-  this->CompareShadowAreas(originalImage, intermediateImage);
+  stageStartTime = this->AddStageTime("RemoveOffCameraBones", stageStartTime);
+
+  this->CompareShadowAreas(this->LinesImage, this->BinaryImageForMorphology);
   if (this->SaveIntermediateResults)
   {
-    this->AddIntermediateImage("_09PostFilters_3PostCompareShadowAreas", intermediateImage);
+    this->AddIntermediateImage("_09PostFilters_3PostCompareShadowAreas", this->BinaryImageForMorphology);
   }
-  vtkPlusBoneEnhancer::LinearToFanImage(intermediateImage, outputFrame);
+  this->AddStageTime("CompareShadowAreas", stageStartTime);
+
+  vtkPlusBoneEnhancer::LinearToFanImage(this->BinaryImageForMorphology, outputFrame);
+  this->NumberOfTimedFrames++;
 
   return PLUS_SUCCESS;
-}
+}
\ No newline at end of file
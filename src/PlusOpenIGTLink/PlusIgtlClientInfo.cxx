@@ -10,6 +10,10 @@ See License.txt for details.
 // IGTL includes
 #include <igtl_header.h>
 
+// STL includes
+#include <iomanip>
+#include <sstream>
+
 //----------------------------------------------------------------------------
 PlusIgtlClientInfo::PlusIgtlClientInfo()
   : ClientHeaderVersion(IGTL_HEADER_VERSION_1)
@@ -433,3 +437,39 @@ void PlusIgtlClientInfo::SetLastTDATASentTimeStamp(double val)
 {
   this->LastTDATASentTimeStamp = val;
 }
+
+//----------------------------------------------------------------------------
+std::string PlusIgtlClientInfo::GetSubscriptionKey() const
+{
+  // Field separators are characters that do not occur in names
+  std::ostringstream key;
+  key << "v" << this->ClientHeaderVersion << "|";
+  for (std::vector<std::string>::const_iterator it = this->IgtlMessageTypes.begin(); it != this->IgtlMessageTypes.end(); ++it)
+  {
+    key << *it << ";";
+  }
+  key << "|TDATA:" << (this->TDATARequested ? 1 : 0) << ";" << this->TDATAResolution << ";" << std::fixed << std::setprecision(6) << this->LastTDATASentTimeStamp << "|";
+  for (std::vector<igsioTransformName>::const_iterator it = this->TransformNames.begin(); it != this->TransformNames.end(); ++it)
+  {
+    key << it->From() << ">" << it->To() << ";";
+  }
+  key << "|";
+  for (std::vector<std::string>::const_iterator it = this->StringNames.begin(); it != this->StringNames.end(); ++it)
+  {
+    key << *it << ";";
+  }
+  key << "|";
+  for (std::vector<ImageStream>::const_iterator it = this->ImageStreams.begin(); it != this->ImageStreams.end(); ++it)
+  {
+    key << it->Name << ">" << it->EmbeddedTransformToFrame << ";";
+  }
+  key << "|";
+  for (std::vector<VideoStream>::const_iterator it = this->VideoStreams.begin(); it != this->VideoStreams.end(); ++it)
+  {
+    const EncodingParameters& encoding = it->EncodeVideoParameters;
+    key << it->Name << ">" << it->EmbeddedTransformToFrame << ":" << encoding.FourCC << "," << (encoding.Lossless ? 1 : 0) << ","
+        << encoding.MinKeyframeDistance << "," << encoding.MaxKeyframeDistance << "," << encoding.Speed << ","
+        << encoding.RateControl << "," << encoding.DeadlineMode << "," << encoding.TargetBitrate << ";";
+  }
+  return key.str();
+}
@@ -108,6 +108,13 @@ public:
 
   virtual void PrintSelf(ostream& os, vtkIndent indent);
 
+  /*!
+    Get a string that identifies the content that the client receives from the server.
+    Clients with the same subscription key receive exactly the same messages for a tracked frame,
+    therefore the messages only have to be packed (and encoded) once for all of them.
+  */
+  std::string GetSubscriptionKey() const;
+
   /*! IGTL header version supported by the client */
   int GetClientHeaderVersion() const;
   /*! IGTL header version supported by the client */
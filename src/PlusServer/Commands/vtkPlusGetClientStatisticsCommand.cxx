@@ -0,0 +1,100 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusCommandProcessor.h"
+#include "vtkPlusGetClientStatisticsCommand.h"
+#include "vtkPlusOpenIGTLinkServer.h"
+
+vtkStandardNewMacro(vtkPlusGetClientStatisticsCommand);
+
+namespace
+{
+  static const std::string GET_CLIENT_STATISTICS_CMD = "GetClientStatistics";
+
+  //----------------------------------------------------------------------------
+  void AddMetaData(igtl::MessageBase::MetaDataMap& metadata, const std::string& key, const std::string& value)
+  {
+    metadata[key] = std::pair<IANA_ENCODING_TYPE, std::string>(IANA_TYPE_US_ASCII, value);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkPlusGetClientStatisticsCommand::vtkPlusGetClientStatisticsCommand()
+{
+  // It handles only one command, set its name by default
+  this->SetName(GET_CLIENT_STATISTICS_CMD);
+}
+
+//----------------------------------------------------------------------------
+vtkPlusGetClientStatisticsCommand::~vtkPlusGetClientStatisticsCommand()
+{
+
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusGetClientStatisticsCommand::SetNameToGetClientStatistics()
+{
+  this->SetName(GET_CLIENT_STATISTICS_CMD);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusGetClientStatisticsCommand::GetCommandNames(std::list<std::string>& cmdNames)
+{
+  cmdNames.clear();
+  cmdNames.push_back(GET_CLIENT_STATISTICS_CMD);
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusGetClientStatisticsCommand::GetDescription(const std::string& commandName)
+{
+  std::string desc;
+  if (commandName.empty() || igsioCommon::IsEqualInsensitive(commandName, GET_CLIENT_STATISTICS_CMD))
+  {
+    desc += GET_CLIENT_STATISTICS_CMD;
+    desc += ": Get send queue depth, dropped message count, and latency of each connected client.";
+  }
+  return desc;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusGetClientStatisticsCommand::Execute()
+{
+  vtkPlusOpenIGTLinkServer* server = this->CommandProcessor->GetPlusServer();
+  if (server == NULL)
+  {
+    this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", "Invalid server.");
+    return PLUS_FAIL;
+  }
+
+  std::map<int, PlusIgtlClientSendQueue::Statistics> statistics;
+  server->GetClientSendQueueStatistics(statistics);
+
+  igtl::MessageBase::MetaDataMap metadata;
+  std::ostringstream clientIds;
+  for (std::map<int, PlusIgtlClientSendQueue::Statistics>::iterator it = statistics.begin(); it != statistics.end(); ++it)
+  {
+    if (it != statistics.begin())
+    {
+      clientIds << " ";
+    }
+    clientIds << it->first;
+
+    std::string prefix = "Client" + igsioCommon::ToString<int>(it->first);
+    AddMetaData(metadata, prefix + "QueueDepth", igsioCommon::ToString<unsigned int>(it->second.QueueDepth));
+    AddMetaData(metadata, prefix + "MaxQueueDepth", igsioCommon::ToString<unsigned int>(it->second.MaxQueueDepth));
+    AddMetaData(metadata, prefix + "SentMessages", igsioCommon::ToString<unsigned long long>(it->second.NumberOfSentMessages));
+    AddMetaData(metadata, prefix + "DroppedMessages", igsioCommon::ToString<unsigned long long>(it->second.NumberOfDroppedMessages));
+    AddMetaData(metadata, prefix + "SentBytes", igsioCommon::ToString<unsigned long long>(it->second.NumberOfSentBytes));
+    AddMetaData(metadata, prefix + "AverageLatencySec", igsioCommon::ToString<double>(it->second.AverageLatencySec));
+    AddMetaData(metadata, prefix + "MaxLatencySec", igsioCommon::ToString<double>(it->second.MaxLatencySec));
+  }
+  AddMetaData(metadata, "NumberOfClients", igsioCommon::ToString<size_t>(statistics.size()));
+  AddMetaData(metadata, "ClientIds", clientIds.str());
+
+  this->QueueCommandResponse(PLUS_SUCCESS, "Success.", "", &metadata);
+  return PLUS_SUCCESS;
+}
@@ -0,0 +1,51 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusGetClientStatisticsCommand_h
+#define __vtkPlusGetClientStatisticsCommand_h
+
+#include "vtkPlusServerExport.h"
+
+#include "vtkPlusCommand.h"
+
+/*!
+  \class vtkPlusGetClientStatisticsCommand
+  \brief This command returns the send queue statistics (queue depth, dropped messages, latency) of the connected clients
+  \ingroup PlusLibPlusServer
+
+  The statistics are returned in the response metadata. NumberOfClients and ClientIds (space-separated list) are always included,
+  and for each client the values are stored with the "Client<ClientId>" prefix, for example Client3QueueDepth, Client3AverageLatencySec.
+ */
+class vtkPlusServerExport vtkPlusGetClientStatisticsCommand : public vtkPlusCommand
+{
+public:
+
+  static vtkPlusGetClientStatisticsCommand* New();
+  vtkTypeMacro(vtkPlusGetClientStatisticsCommand, vtkPlusCommand);
+  virtual vtkPlusCommand* Clone() { return New(); }
+
+  /*! Executes the command  */
+  virtual PlusStatus Execute();
+
+  /*! Get all the command names that this class can execute */
+  virtual void GetCommandNames(std::list<std::string>& cmdNames);
+
+  /*! Gets the description for the specified command name. */
+  virtual std::string GetDescription(const std::string& commandName);
+
+  void SetNameToGetClientStatistics();
+
+protected:
+  vtkPlusGetClientStatisticsCommand();
+  virtual ~vtkPlusGetClientStatisticsCommand();
+
+private:
+  vtkPlusGetClientStatisticsCommand(const vtkPlusGetClientStatisticsCommand&);
+  void operator=(const vtkPlusGetClientStatisticsCommand&);
+};
+
+
+#endif
@@ -402,6 +402,10 @@ PlusStatus vtkPlusStartStopRecordingCommand::Execute()
     }
     std::ostringstream ss;
     ss << "Recording " << numberOfFramesRecorded << " frames successful to file " << actualOutputFilename;
+    if (captureDevice->GetNumberOfFilesToCompress() > 0)
+    {
+      ss << " (compression is in progress, see the CompressionProgressPercent device parameter)";
+    }
     this->QueueCommandResponse(PLUS_SUCCESS, responseMessageBase + ss.str());
     return PLUS_SUCCESS;
   }
@@ -0,0 +1,241 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusIgtlClientSendQueue.h"
+#include "vtkIGSIOAccurateTimer.h"
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+
+//----------------------------------------------------------------------------
+PlusIgtlClientSendQueue::Statistics::Statistics()
+  : QueueDepth(0)
+  , MaxQueueDepth(0)
+  , NumberOfSentMessages(0)
+  , NumberOfDroppedMessages(0)
+  , NumberOfSentBytes(0)
+  , AverageLatencySec(0.0)
+  , MaxLatencySec(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlClientSendQueue::PlusIgtlClientSendQueue(unsigned int maxNumberOfImageMessages, unsigned int maxNumberOfMessages, DropPolicy dropPolicy)
+  : MaxNumberOfImageMessages(std::max(maxNumberOfImageMessages, 1u))
+  , MaxNumberOfMessages(std::max(maxNumberOfMessages, 1u))
+  , Policy(dropPolicy)
+  , NumberOfImageMessages(0)
+  , Closed(false)
+  , SendFailed(false)
+  , TotalLatencySec(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlClientSendQueue::~PlusIgtlClientSendQueue()
+{
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlClientSendQueue::Push(igtl::MessageBase::Pointer message, MessageCategory category)
+{
+  if (message.IsNull())
+  {
+    return PLUS_SUCCESS;
+  }
+
+  bool wasEmpty = false;
+  std::function<void()> callback;
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    if (this->Closed)
+    {
+      return PLUS_FAIL;
+    }
+
+    if (category == MESSAGE_CATEGORY_IMAGE && this->Policy != DROP_POLICY_NONE && this->NumberOfImageMessages >= this->MaxNumberOfImageMessages)
+    {
+      if (this->Policy == DROP_POLICY_NEWEST_IMAGE)
+      {
+        this->Stats.NumberOfDroppedMessages++;
+        return PLUS_SUCCESS;
+      }
+      this->DropOldestImageMessage();
+    }
+
+    if (this->Items.size() >= this->MaxNumberOfMessages)
+    {
+      return PLUS_FAIL;
+    }
+
+    wasEmpty = this->Items.empty();
+    callback = this->MessageAvailableCallback;
+    QueueItem item;
+    item.Message = message;
+    item.Category = category;
+    item.EnqueueTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    this->Items.push_back(item);
+    if (category == MESSAGE_CATEGORY_IMAGE)
+    {
+      this->NumberOfImageMessages++;
+    }
+    this->Stats.MaxQueueDepth = std::max(this->Stats.MaxQueueDepth, static_cast<unsigned int>(this->Items.size()));
+  }
+  this->MessageAvailable.notify_one();
+  if (wasEmpty && callback)
+  {
+    callback();
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlClientSendQueue::Pop(igtl::MessageBase::Pointer& message, double& enqueueTime, double timeoutSec)
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  if (this->Items.empty() && !this->Closed && timeoutSec > 0)
+  {
+    this->MessageAvailable.wait_for(lock, std::chrono::duration<double>(timeoutSec));
+  }
+  if (this->Items.empty())
+  {
+    return false;
+  }
+
+  const QueueItem& item = this->Items.front();
+  message = item.Message;
+  enqueueTime = item.EnqueueTime;
+  if (item.Category == MESSAGE_CATEGORY_IMAGE)
+  {
+    this->NumberOfImageMessages--;
+  }
+  this->Items.pop_front();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlClientSendQueue::ReportMessageSent(unsigned long long numberOfBytes, double enqueueTime)
+{
+  double latencySec = vtkIGSIOAccurateTimer::GetSystemTime() - enqueueTime;
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Stats.NumberOfSentMessages++;
+  this->Stats.NumberOfSentBytes += numberOfBytes;
+  this->Stats.MaxLatencySec = std::max(this->Stats.MaxLatencySec, latencySec);
+  this->TotalLatencySec += latencySec;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlClientSendQueue::ReportSendFailure()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->SendFailed = true;
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlClientSendQueue::HasSendFailed() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->SendFailed;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlClientSendQueue::SetMessageAvailableCallback(const std::function<void()>& callback)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->MessageAvailableCallback = callback;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlClientSendQueue::Close()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Closed = true;
+  }
+  this->MessageAvailable.notify_all();
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlClientSendQueue::IsClosed() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->Closed;
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlClientSendQueue::Statistics PlusIgtlClientSendQueue::GetStatistics() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  Statistics stats = this->Stats;
+  stats.QueueDepth = static_cast<unsigned int>(this->Items.size());
+  if (stats.NumberOfSentMessages > 0)
+  {
+    stats.AverageLatencySec = this->TotalLatencySec / stats.NumberOfSentMessages;
+  }
+  return stats;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlClientSendQueue::DropOldestImageMessage()
+{
+  for (std::deque<QueueItem>::iterator it = this->Items.begin(); it != this->Items.end(); ++it)
+  {
+    if (it->Category == MESSAGE_CATEGORY_IMAGE)
+    {
+      this->Items.erase(it);
+      this->NumberOfImageMessages--;
+      this->Stats.NumberOfDroppedMessages++;
+      return;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlClientSendQueue::MessageCategory PlusIgtlClientSendQueue::GetMessageCategory(const std::string& messageType)
+{
+  // VIDEO messages are not droppable: encoded frames depend on the previous frames of the stream,
+  // dropping an inter-frame would corrupt the decoded video until the next key frame
+  if (igsioCommon::IsEqualInsensitive(messageType, "IMAGE")
+      || igsioCommon::IsEqualInsensitive(messageType, "USMESSAGE")
+      || igsioCommon::IsEqualInsensitive(messageType, "TRACKEDFRAME"))
+  {
+    return MESSAGE_CATEGORY_IMAGE;
+  }
+  return MESSAGE_CATEGORY_RELIABLE;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusIgtlClientSendQueue::GetDropPolicyAsString(DropPolicy dropPolicy)
+{
+  switch (dropPolicy)
+  {
+    case DROP_POLICY_OLDEST_IMAGE:
+      return "DropOldestImage";
+    case DROP_POLICY_NEWEST_IMAGE:
+      return "DropNewestImage";
+    case DROP_POLICY_NONE:
+      return "None";
+  }
+  return "";
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlClientSendQueue::GetDropPolicyFromString(const std::string& dropPolicyString, DropPolicy& dropPolicy)
+{
+  const DropPolicy policies[3] = { DROP_POLICY_OLDEST_IMAGE, DROP_POLICY_NEWEST_IMAGE, DROP_POLICY_NONE };
+  for (int i = 0; i < 3; ++i)
+  {
+    if (igsioCommon::IsEqualInsensitive(dropPolicyString, GetDropPolicyAsString(policies[i])))
+    {
+      dropPolicy = policies[i];
+      return PLUS_SUCCESS;
+    }
+  }
+  LOG_ERROR("Invalid client send queue drop policy: " << dropPolicyString << ". Valid values: DropOldestImage, DropNewestImage, None.");
+  return PLUS_FAIL;
+}
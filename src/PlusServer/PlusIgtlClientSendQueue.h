@@ -0,0 +1,147 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusIgtlClientSendQueue_h
+#define __PlusIgtlClientSendQueue_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusServerExport.h"
+
+// IGTL includes
+#include <igtlMessageBase.h>
+
+// STL includes
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/*!
+  \class PlusIgtlClientSendQueue
+  \brief Bounded queue of packed OpenIGTLink messages waiting to be sent to one client.
+
+  The broadcasting thread adds messages to the queue of each client and a sender (one per client, or a shared I/O thread)
+  removes them and writes them to the client socket. This way a slow client only delays its own messages.
+
+  Image messages (IMAGE, VIDEO, USMESSAGE, TRACKEDFRAME) may be dropped when the client cannot keep up: the number
+  of queued image messages is limited to MaxNumberOfImageMessages and the drop policy determines which image is discarded.
+  Other messages (transforms, tracking data, strings, status messages, command replies) are never dropped. If the total number
+  of queued messages reaches MaxNumberOfMessages then the client is considered unresponsive and adding a message fails.
+
+  The class is thread-safe.
+  \ingroup PlusLibPlusServer
+*/
+class vtkPlusServerExport PlusIgtlClientSendQueue
+{
+public:
+  enum MessageCategory
+  {
+    /*! Image data that can be dropped if a newer image is available */
+    MESSAGE_CATEGORY_IMAGE,
+    /*! Messages that must be delivered (transforms, tracking data, encoded video, strings, status, command replies) */
+    MESSAGE_CATEGORY_RELIABLE
+  };
+
+  enum DropPolicy
+  {
+    /*! Discard the oldest queued image, so that the client always gets the latest image */
+    DROP_POLICY_OLDEST_IMAGE,
+    /*! Discard the new image if the image limit is reached */
+    DROP_POLICY_NEWEST_IMAGE,
+    /*! Never discard images, only the total message limit applies */
+    DROP_POLICY_NONE
+  };
+
+  struct Statistics
+  {
+    Statistics();
+    /*! Number of messages currently in the queue */
+    unsigned int QueueDepth;
+    /*! Largest number of messages that were in the queue at the same time */
+    unsigned int MaxQueueDepth;
+    unsigned long long NumberOfSentMessages;
+    unsigned long long NumberOfDroppedMessages;
+    unsigned long long NumberOfSentBytes;
+    /*! Time between adding a message to the queue and completing sending it */
+    double AverageLatencySec;
+    double MaxLatencySec;
+  };
+
+  PlusIgtlClientSendQueue(unsigned int maxNumberOfImageMessages, unsigned int maxNumberOfMessages, DropPolicy dropPolicy);
+  virtual ~PlusIgtlClientSendQueue();
+
+  /*!
+    Add a packed message to the queue.
+    Returns PLUS_FAIL if the queue is closed or the message limit is reached (the client cannot keep up with the data stream).
+    Dropping an image message according to the drop policy is not a failure.
+  */
+  PlusStatus Push(igtl::MessageBase::Pointer message, MessageCategory category);
+
+  /*!
+    Remove the oldest message from the queue. Waits at most timeoutSec for a message.
+    Returns false if there was no message in the queue.
+  */
+  bool Pop(igtl::MessageBase::Pointer& message, double& enqueueTime, double timeoutSec);
+
+  /*! Update the statistics after a message removed by Pop has been sent */
+  void ReportMessageSent(unsigned long long numberOfBytes, double enqueueTime);
+
+  /*! Indicate that the message could not be sent. The owner should disconnect the client. */
+  void ReportSendFailure();
+  bool HasSendFailed() const;
+
+  /*!
+    Set a function that is called when a message is added to an empty queue.
+    It is used by senders that do not wait in Pop (such as an event-driven I/O thread) to get notified about new messages.
+  */
+  void SetMessageAvailableCallback(const std::function<void()>& callback);
+
+  /*! Reject all new messages and wake up the waiting sender */
+  void Close();
+  bool IsClosed() const;
+
+  Statistics GetStatistics() const;
+
+  /*! Get the category of a message type (image messages can be dropped, other messages must be delivered) */
+  static MessageCategory GetMessageCategory(const std::string& messageType);
+
+  static std::string GetDropPolicyAsString(DropPolicy dropPolicy);
+  static PlusStatus GetDropPolicyFromString(const std::string& dropPolicyString, DropPolicy& dropPolicy);
+
+protected:
+  struct QueueItem
+  {
+    igtl::MessageBase::Pointer Message;
+    MessageCategory Category;
+    double EnqueueTime;
+  };
+
+  /*! Remove the oldest image message from the queue. The mutex must be locked. */
+  void DropOldestImageMessage();
+
+  mutable std::mutex Mutex;
+  std::condition_variable MessageAvailable;
+  std::function<void()> MessageAvailableCallback;
+  std::deque<QueueItem> Items;
+
+  unsigned int MaxNumberOfImageMessages;
+  unsigned int MaxNumberOfMessages;
+  DropPolicy Policy;
+
+  unsigned int NumberOfImageMessages;
+  bool Closed;
+  bool SendFailed;
+
+  Statistics Stats;
+  double TotalLatencySec;
+
+private:
+  PlusIgtlClientSendQueue(const PlusIgtlClientSendQueue&);
+  void operator=(const PlusIgtlClientSendQueue&);
+};
+
+#endif
@@ -0,0 +1,565 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusIgtlServerReactor.h"
+#include "vtkIGSIORecursiveCriticalSection.h"
+#include "vtkPlusOpenIGTLinkServer.h"
+
+#if defined(__linux__)
+  #include <arpa/inet.h>
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+// STL includes
+#include <cstring>
+
+namespace
+{
+  const int MAX_EVENTS_PER_WAIT = 64;
+  /*! Timeout of waiting for events, only used for checking stop requests */
+  const int EVENT_WAIT_TIMEOUT_MS = 200;
+  const size_t RECEIVE_CHUNK_SIZE = 65536;
+  /*! Maximum number of bytes read from a client per event. Epoll is level-triggered, so the rest is read after the other clients are served. */
+  const size_t MAX_RECEIVE_BYTES_PER_EVENT = 16 * RECEIVE_CHUNK_SIZE;
+  /*! Clients only send commands and small messages, a larger body size indicates a malformed or malicious message */
+  const size_t MAX_MESSAGE_BODY_SIZE = 64 * 1024 * 1024;
+  const int LISTEN_BACKLOG = 16;
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlServerReactor::ClientConnection::ClientConnection()
+  : ClientId(-1)
+  , SocketDescriptor(-1)
+  , Port(0)
+  , Client(NULL)
+  , PendingMessageOffset(0)
+  , PendingMessageEnqueueTime(0)
+  , WaitingForWritable(false)
+  , ReceiveStopped(false)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlServerReactor::PlusIgtlServerReactor(vtkPlusOpenIGTLinkServer* server)
+  : Server(server)
+  , ListeningSocket(-1)
+  , EpollDescriptor(-1)
+  , WakeDescriptor(-1)
+  , StopRequested(false)
+  , Running(false)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlServerReactor::~PlusIgtlServerReactor()
+{
+  this->Stop();
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlServerReactor::IsSupported()
+{
+#if defined(__linux__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlServerReactor::IsRunning() const
+{
+  return this->Running;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::RequestDisconnect(int clientId)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->DisconnectRequestsMutex);
+    this->DisconnectRequests.push_back(clientId);
+  }
+  this->Wake();
+}
+
+#if defined(__linux__)
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlServerReactor::Start(int listeningPort)
+{
+  if (this->Running)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  this->ListeningSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (this->ListeningSocket < 0)
+  {
+    LOG_ERROR("Failed to create listening socket: " << strerror(errno));
+    return PLUS_FAIL;
+  }
+  int reuseAddress = 1;
+  setsockopt(this->ListeningSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(static_cast<uint16_t>(listeningPort));
+  if (bind(this->ListeningSocket, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(this->ListeningSocket, LISTEN_BACKLOG) < 0)
+  {
+    LOG_ERROR("Failed to listen on port " << listeningPort << ": " << strerror(errno));
+    close(this->ListeningSocket);
+    this->ListeningSocket = -1;
+    return PLUS_FAIL;
+  }
+
+  this->EpollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+  this->WakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->EpollDescriptor < 0 || this->WakeDescriptor < 0)
+  {
+    LOG_ERROR("Failed to create epoll event descriptors: " << strerror(errno));
+    this->Stop();
+    return PLUS_FAIL;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = this->ListeningSocket;
+  epoll_ctl(this->EpollDescriptor, EPOLL_CTL_ADD, this->ListeningSocket, &event);
+  event.data.fd = this->WakeDescriptor;
+  epoll_ctl(this->EpollDescriptor, EPOLL_CTL_ADD, this->WakeDescriptor, &event);
+
+  this->HeaderMessage = this->Server->IgtlMessageFactory->CreateHeaderMessage(IGTL_HEADER_VERSION_1);
+
+  this->StopRequested = false;
+  this->Running = true;
+  this->Thread = std::thread(&PlusIgtlServerReactor::Run, this);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::Stop()
+{
+  if (this->Thread.joinable())
+  {
+    this->StopRequested = true;
+    this->Wake();
+    this->Thread.join();
+  }
+
+  // Close the connections (if the thread was not started then there are none)
+  while (!this->Connections.empty())
+  {
+    this->CloseConnection(this->Connections.begin()->first);
+  }
+
+  if (this->ListeningSocket >= 0)
+  {
+    close(this->ListeningSocket);
+    this->ListeningSocket = -1;
+  }
+  if (this->WakeDescriptor >= 0)
+  {
+    close(this->WakeDescriptor);
+    this->WakeDescriptor = -1;
+  }
+  if (this->EpollDescriptor >= 0)
+  {
+    close(this->EpollDescriptor);
+    this->EpollDescriptor = -1;
+  }
+  this->Running = false;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::Wake()
+{
+  if (this->WakeDescriptor >= 0)
+  {
+    uint64_t value = 1;
+    if (write(this->WakeDescriptor, &value, sizeof(value)) < 0)
+    {
+      // The counter is already signaled, the reactor thread will wake up anyway
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::Run()
+{
+  struct epoll_event events[MAX_EVENTS_PER_WAIT];
+  while (!this->StopRequested)
+  {
+    int numberOfEvents = epoll_wait(this->EpollDescriptor, events, MAX_EVENTS_PER_WAIT, EVENT_WAIT_TIMEOUT_MS);
+    if (numberOfEvents < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      LOG_ERROR("Waiting for network events failed: " << strerror(errno));
+      break;
+    }
+
+    std::vector<int> closedSockets;
+    bool sendQueuesChanged = false;
+    for (int i = 0; i < numberOfEvents; ++i)
+    {
+      int socketDescriptor = events[i].data.fd;
+      if (socketDescriptor == this->ListeningSocket)
+      {
+        this->AcceptConnections();
+        continue;
+      }
+      if (socketDescriptor == this->WakeDescriptor)
+      {
+        uint64_t value = 0;
+        if (read(this->WakeDescriptor, &value, sizeof(value)) < 0)
+        {
+          // Counter was reset by a previous read
+        }
+        sendQueuesChanged = true;
+        continue;
+      }
+
+      std::map<int, ClientConnection>::iterator connection = this->Connections.find(socketDescriptor);
+      if (connection == this->Connections.end())
+      {
+        continue;
+      }
+      bool connected = true;
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      {
+        connected = this->ReceiveFromClient(connection->second);
+      }
+      if (connected && (events[i].events & EPOLLOUT))
+      {
+        connected = this->SendToClient(connection->second);
+      }
+      if (!connected)
+      {
+        closedSockets.push_back(socketDescriptor);
+      }
+    }
+
+    if (sendQueuesChanged)
+    {
+      // New messages may be in any of the queues
+      for (std::map<int, ClientConnection>::iterator connection = this->Connections.begin(); connection != this->Connections.end(); ++connection)
+      {
+        if (!connection->second.WaitingForWritable && !this->SendToClient(connection->second))
+        {
+          closedSockets.push_back(connection->first);
+        }
+      }
+
+      std::vector<int> disconnectRequests;
+      {
+        std::lock_guard<std::mutex> lock(this->DisconnectRequestsMutex);
+        disconnectRequests.swap(this->DisconnectRequests);
+      }
+      for (std::vector<int>::iterator clientId = disconnectRequests.begin(); clientId != disconnectRequests.end(); ++clientId)
+      {
+        for (std::map<int, ClientConnection>::iterator connection = this->Connections.begin(); connection != this->Connections.end(); ++connection)
+        {
+          if (connection->second.ClientId == *clientId)
+          {
+            closedSockets.push_back(connection->first);
+            break;
+          }
+        }
+      }
+    }
+
+    for (std::vector<int>::iterator socketDescriptor = closedSockets.begin(); socketDescriptor != closedSockets.end(); ++socketDescriptor)
+    {
+      this->CloseConnection(*socketDescriptor);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::AcceptConnections()
+{
+  while (true)
+  {
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    int socketDescriptor = accept4(this->ListeningSocket, (struct sockaddr*)&address, &addressLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (socketDescriptor < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        LOG_ERROR("Failed to accept client connection: " << strerror(errno));
+      }
+      return;
+    }
+
+    // Messages are small and latency matters more than throughput
+    int noDelay = 1;
+    setsockopt(socketDescriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    ClientConnection connection;
+    connection.SocketDescriptor = socketDescriptor;
+    char addressString[INET_ADDRSTRLEN] = "unknown";
+    inet_ntop(AF_INET, &address.sin_addr, addressString, sizeof(addressString));
+    connection.Address = addressString;
+    connection.Port = ntohs(address.sin_port);
+    {
+      igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->Server->IgtlClientsMutex);
+      connection.Client = this->Server->AddClient(NULL, socketDescriptor);
+      connection.ClientId = connection.Client->ClientId;
+      connection.SendQueue = connection.Client->SendQueue;
+      // The callback must be installed before the client becomes visible to the message producers,
+      // because the queue only notifies when it changes from empty to non-empty
+      connection.SendQueue->SetMessageAvailableCallback(std::bind(&PlusIgtlServerReactor::Wake, this));
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = socketDescriptor;
+    if (epoll_ctl(this->EpollDescriptor, EPOLL_CTL_ADD, socketDescriptor, &event) < 0)
+    {
+      LOG_ERROR("Failed to register client connection: " << strerror(errno));
+      connection.SendQueue->SetMessageAvailableCallback(std::function<void()>());
+      this->Server->RemoveClient(connection.ClientId);
+      close(socketDescriptor);
+      continue;
+    }
+    this->Connections[socketDescriptor] = connection;
+    // Flush the messages that may have been queued before the connection was registered
+    this->Wake();
+
+    LOG_INFO("Received new client connection (client " << connection.ClientId << " at " << connection.Address << ":" << connection.Port
+             << "). Number of connected clients: " << this->Server->GetNumberOfConnectedClients());
+  }
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlServerReactor::ReceiveFromClient(ClientConnection& connection)
+{
+  bool connected = true;
+  unsigned char chunk[RECEIVE_CHUNK_SIZE];
+  size_t bytesReceivedInEvent = 0;
+  // A busy client must not hold the reactor thread, the remaining data is read in the next event
+  while (bytesReceivedInEvent < MAX_RECEIVE_BYTES_PER_EVENT)
+  {
+    ssize_t bytesReceived = recv(connection.SocketDescriptor, chunk, sizeof(chunk), 0);
+    if (bytesReceived > 0)
+    {
+      bytesReceivedInEvent += bytesReceived;
+      if (!connection.ReceiveStopped)
+      {
+        connection.ReceiveBuffer.insert(connection.ReceiveBuffer.end(), chunk, chunk + bytesReceived);
+      }
+      continue;
+    }
+    if (bytesReceived < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (bytesReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      break;
+    }
+    // Connection closed by the client or error
+    connected = false;
+    break;
+  }
+
+  // Process all complete messages
+  size_t headerSize = this->HeaderMessage->GetBufferSize();
+  size_t offset = 0;
+  while (!connection.ReceiveStopped && connection.ReceiveBuffer.size() - offset >= headerSize)
+  {
+    this->HeaderMessage->InitBuffer();
+    memcpy(this->HeaderMessage->GetBufferPointer(), &connection.ReceiveBuffer[offset], headerSize);
+    this->HeaderMessage->Unpack(this->Server->IgtlMessageCrcCheckEnabled);
+    igtlUint64 declaredBodySize = this->HeaderMessage->GetBodySizeToRead();
+    if (declaredBodySize > MAX_MESSAGE_BODY_SIZE)
+    {
+      // The body would be buffered until it is complete, do not let the client make the server allocate any amount of memory
+      LOG_ERROR("Client " << connection.ClientId << " sent a " << this->HeaderMessage->GetMessageType() << " message header with body size " << declaredBodySize
+                << " bytes, which exceeds the maximum of " << MAX_MESSAGE_BODY_SIZE << " bytes. Closing the connection.");
+      connection.ReceiveBuffer.clear();
+      return false;
+    }
+    size_t bodySize = static_cast<size_t>(declaredBodySize);
+    if (connection.ReceiveBuffer.size() - offset - headerSize < bodySize)
+    {
+      // Wait for the rest of the message
+      break;
+    }
+    std::vector<unsigned char> body(connection.ReceiveBuffer.begin() + offset + headerSize, connection.ReceiveBuffer.begin() + offset + headerSize + bodySize);
+    offset += headerSize + bodySize;
+    if (this->Server->ProcessClientMessage(connection.Client, this->HeaderMessage, body) != PLUS_SUCCESS)
+    {
+      // Same as stopping the receiver thread of the client: the client stays connected, but its messages are ignored
+      connection.ReceiveStopped = true;
+    }
+  }
+  if (connection.ReceiveStopped)
+  {
+    connection.ReceiveBuffer.clear();
+  }
+  else if (offset > 0)
+  {
+    connection.ReceiveBuffer.erase(connection.ReceiveBuffer.begin(), connection.ReceiveBuffer.begin() + offset);
+  }
+
+  return connected;
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlServerReactor::SendToClient(ClientConnection& connection)
+{
+  while (true)
+  {
+    if (connection.PendingMessage.IsNull())
+    {
+      if (!connection.SendQueue->Pop(connection.PendingMessage, connection.PendingMessageEnqueueTime, 0))
+      {
+        this->SetWaitingForWritable(connection, false);
+        return true;
+      }
+      connection.PendingMessageOffset = 0;
+    }
+
+    const unsigned char* data = static_cast<const unsigned char*>(connection.PendingMessage->GetBufferPointer());
+    size_t size = static_cast<size_t>(connection.PendingMessage->GetBufferSize());
+    ssize_t bytesSent = send(connection.SocketDescriptor, data + connection.PendingMessageOffset, size - connection.PendingMessageOffset, MSG_NOSIGNAL);
+    if (bytesSent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        // Socket buffer is full, continue when the socket becomes writable
+        this->SetWaitingForWritable(connection, true);
+        return true;
+      }
+      LOG_INFO("Client disconnected - could not send " << connection.PendingMessage->GetMessageType() << " message to client (device name: "
+               << connection.PendingMessage->GetDeviceName() << ").");
+      connection.SendQueue->ReportSendFailure();
+      return false;
+    }
+
+    connection.PendingMessageOffset += bytesSent;
+    if (connection.PendingMessageOffset >= size)
+    {
+      connection.SendQueue->ReportMessageSent(size, connection.PendingMessageEnqueueTime);
+      connection.PendingMessage = NULL;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::SetWaitingForWritable(ClientConnection& connection, bool waiting)
+{
+  if (connection.WaitingForWritable == waiting)
+  {
+    return;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLRDHUP | (waiting ? EPOLLOUT : 0);
+  event.data.fd = connection.SocketDescriptor;
+  epoll_ctl(this->EpollDescriptor, EPOLL_CTL_MOD, connection.SocketDescriptor, &event);
+  connection.WaitingForWritable = waiting;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::CloseConnection(int socketDescriptor)
+{
+  std::map<int, ClientConnection>::iterator connection = this->Connections.find(socketDescriptor);
+  if (connection == this->Connections.end())
+  {
+    // Already closed
+    return;
+  }
+
+  connection->second.SendQueue->SetMessageAvailableCallback(std::function<void()>());
+  this->Server->RemoveClient(connection->second.ClientId);
+  if (this->EpollDescriptor >= 0)
+  {
+    epoll_ctl(this->EpollDescriptor, EPOLL_CTL_DEL, socketDescriptor, NULL);
+  }
+  close(socketDescriptor);
+
+  LOG_INFO("Client disconnected (" << connection->second.Address << ":" << connection->second.Port << "). Number of connected clients: "
+           << this->Server->GetNumberOfConnectedClients());
+  this->Connections.erase(connection);
+}
+
+#else
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlServerReactor::Start(int listeningPort)
+{
+  LOG_ERROR("Event-driven networking is not supported on this platform");
+  return PLUS_FAIL;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::Stop()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::Wake()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::Run()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::AcceptConnections()
+{
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlServerReactor::ReceiveFromClient(ClientConnection& connection)
+{
+  return false;
+}
+
+//----------------------------------------------------------------------------
+bool PlusIgtlServerReactor::SendToClient(ClientConnection& connection)
+{
+  return false;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::SetWaitingForWritable(ClientConnection& connection, bool waiting)
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlServerReactor::CloseConnection(int socketDescriptor)
+{
+}
+
+#endif
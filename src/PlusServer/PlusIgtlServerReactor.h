@@ -0,0 +1,123 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusIgtlServerReactor_h
+#define __PlusIgtlServerReactor_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusServerExport.h"
+#include "PlusIgtlClientSendQueue.h"
+
+// IGTL includes
+#include <igtlMessageHeader.h>
+
+// STL includes
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class vtkPlusOpenIGTLinkServer;
+struct ClientData;
+
+/*!
+  \class PlusIgtlServerReactor
+  \brief Event-driven network I/O for all clients of a vtkPlusOpenIGTLinkServer
+
+  One thread waits for events of the listening socket and all client sockets (using epoll) and handles them as they arrive:
+  accepts new connections, receives messages from the clients and passes complete messages to the server for processing,
+  and writes the messages of the client send queues (PlusIgtlClientSendQueue) to the sockets without blocking.
+  If a socket cannot accept more data, sending is resumed when the socket becomes writable, so a slow client does not
+  delay the other clients and no thread sleeps while waiting for data.
+
+  The reactor is only available on Linux, see IsSupported().
+  \ingroup PlusLibPlusServer
+*/
+class vtkPlusServerExport PlusIgtlServerReactor
+{
+public:
+  PlusIgtlServerReactor(vtkPlusOpenIGTLinkServer* server);
+  virtual ~PlusIgtlServerReactor();
+
+  /*! Returns true if the reactor is available on this platform */
+  static bool IsSupported();
+
+  /*! Create the listening socket and start the reactor thread */
+  PlusStatus Start(int listeningPort);
+
+  /*! Stop the reactor thread, close all client connections and remove the clients from the server */
+  void Stop();
+
+  bool IsRunning() const;
+
+  /*! Request closing the connection of a client. Can be called from any thread. */
+  void RequestDisconnect(int clientId);
+
+protected:
+  struct ClientConnection
+  {
+    ClientConnection();
+    int ClientId;
+    int SocketDescriptor;
+    std::string Address;
+    int Port;
+    /*! Client data in the server's client list. Only the reactor thread removes it from the list. */
+    ClientData* Client;
+    std::shared_ptr<PlusIgtlClientSendQueue> SendQueue;
+    /*! Received bytes that do not form a complete message yet */
+    std::vector<unsigned char> ReceiveBuffer;
+    /*! Message that is being sent and the number of bytes that are already sent from it */
+    igtl::MessageBase::Pointer PendingMessage;
+    size_t PendingMessageOffset;
+    double PendingMessageEnqueueTime;
+    bool WaitingForWritable;
+    /*! Set if processing a message failed, further received data is ignored */
+    bool ReceiveStopped;
+  };
+
+  void Run();
+  void AcceptConnections();
+  /*!
+    Read the available data (at most MAX_RECEIVE_BYTES_PER_EVENT bytes) and process the complete messages.
+    Returns false if the connection is closed or the client sent a header with a body size above MAX_MESSAGE_BODY_SIZE.
+  */
+  bool ReceiveFromClient(ClientConnection& connection);
+  /*! Send queued messages until the queue is empty or the socket cannot accept more data. Returns false if sending failed. */
+  bool SendToClient(ClientConnection& connection);
+  void SetWaitingForWritable(ClientConnection& connection, bool waiting);
+  void CloseConnection(int socketDescriptor);
+  /*! Wake up the reactor thread (from any thread) */
+  void Wake();
+
+  vtkPlusOpenIGTLinkServer* Server;
+
+  int ListeningSocket;
+  int EpollDescriptor;
+  /*! Event file descriptor that is signaled when messages are queued or a disconnect is requested */
+  int WakeDescriptor;
+
+  std::thread Thread;
+  std::atomic<bool> StopRequested;
+  std::atomic<bool> Running;
+
+  /*! Client connections, indexed by socket descriptor. Accessed only from the reactor thread. */
+  std::map<int, ClientConnection> Connections;
+
+  igtl::MessageHeader::Pointer HeaderMessage;
+
+  std::mutex DisconnectRequestsMutex;
+  std::vector<int> DisconnectRequests;
+
+private:
+  PlusIgtlServerReactor(const PlusIgtlServerReactor&);
+  void operator=(const PlusIgtlServerReactor&);
+};
+
+#endif
@@ -0,0 +1,168 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusIgtlClientSendQueueTest.cxx
+  \brief Verifies the drop policies and the message limit of the client send queue: image messages are dropped
+  according to the policy, other messages are never dropped.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusIgtlClientSendQueue.h"
+
+// VTK includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// IGTL includes
+#include <igtlImageMessage.h>
+#include <igtlTransformMessage.h>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  igtl::MessageBase::Pointer CreateMessage(const std::string& messageType, int id)
+  {
+    igtl::MessageBase::Pointer message;
+    if (messageType == "IMAGE")
+    {
+      message = igtl::ImageMessage::New().GetPointer();
+    }
+    else
+    {
+      message = igtl::TransformMessage::New().GetPointer();
+    }
+    message->SetDeviceName(messageType + igsioCommon::ToString<int>(id));
+    return message;
+  }
+
+  //----------------------------------------------------------------------------
+  // Adds 3 transforms and 5 images (alternating) to the queue and returns the device names of the queued messages
+  std::string FillQueue(PlusIgtlClientSendQueue& queue, int& numberOfErrors)
+  {
+    for (int i = 0; i < 5; ++i)
+    {
+      if (i < 3 && queue.Push(CreateMessage("TRANSFORM", i), PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to add transform message " << i);
+        numberOfErrors++;
+      }
+      if (queue.Push(CreateMessage("IMAGE", i), PlusIgtlClientSendQueue::MESSAGE_CATEGORY_IMAGE) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to add image message " << i);
+        numberOfErrors++;
+      }
+    }
+
+    std::string deviceNames;
+    igtl::MessageBase::Pointer message;
+    double enqueueTime = 0;
+    while (queue.Pop(message, enqueueTime, 0))
+    {
+      deviceNames += std::string(deviceNames.empty() ? "" : " ") + message->GetDeviceName();
+      queue.ReportMessageSent(100, enqueueTime);
+    }
+    return deviceNames;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestDropPolicy(PlusIgtlClientSendQueue::DropPolicy dropPolicy, const std::string& expectedDeviceNames, unsigned long long expectedDroppedMessages)
+  {
+    int numberOfErrors = 0;
+    PlusIgtlClientSendQueue queue(2, 100, dropPolicy);
+    std::string deviceNames = FillQueue(queue, numberOfErrors);
+    if (deviceNames != expectedDeviceNames)
+    {
+      LOG_ERROR("Unexpected messages with drop policy " << PlusIgtlClientSendQueue::GetDropPolicyAsString(dropPolicy)
+                << ". Expected: " << expectedDeviceNames << ", actual: " << deviceNames);
+      numberOfErrors++;
+    }
+    PlusIgtlClientSendQueue::Statistics stats = queue.GetStatistics();
+    if (stats.NumberOfDroppedMessages != expectedDroppedMessages || stats.QueueDepth != 0
+        || stats.NumberOfSentMessages != 8 - expectedDroppedMessages || stats.NumberOfSentBytes != 100 * stats.NumberOfSentMessages)
+    {
+      LOG_ERROR("Unexpected statistics with drop policy " << PlusIgtlClientSendQueue::GetDropPolicyAsString(dropPolicy)
+                << ": dropped=" << stats.NumberOfDroppedMessages << ", sent=" << stats.NumberOfSentMessages << ", depth=" << stats.QueueDepth);
+      numberOfErrors++;
+    }
+    return numberOfErrors;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfErrors(0);
+
+  LOG_INFO("Test drop policies");
+  numberOfErrors += TestDropPolicy(PlusIgtlClientSendQueue::DROP_POLICY_OLDEST_IMAGE, "TRANSFORM0 TRANSFORM1 TRANSFORM2 IMAGE3 IMAGE4", 3);
+  numberOfErrors += TestDropPolicy(PlusIgtlClientSendQueue::DROP_POLICY_NEWEST_IMAGE, "TRANSFORM0 IMAGE0 TRANSFORM1 IMAGE1 TRANSFORM2", 3);
+  numberOfErrors += TestDropPolicy(PlusIgtlClientSendQueue::DROP_POLICY_NONE, "TRANSFORM0 IMAGE0 TRANSFORM1 IMAGE1 TRANSFORM2 IMAGE2 IMAGE3 IMAGE4", 0);
+
+  LOG_INFO("Test message limit");
+  PlusIgtlClientSendQueue queue(2, 3, PlusIgtlClientSendQueue::DROP_POLICY_OLDEST_IMAGE);
+  for (int i = 0; i < 3; ++i)
+  {
+    if (queue.Push(CreateMessage("TRANSFORM", i), PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add transform message " << i << " to a queue that is not full");
+      numberOfErrors++;
+    }
+  }
+  if (queue.Push(CreateMessage("TRANSFORM", 3), PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE) == PLUS_SUCCESS)
+  {
+    LOG_ERROR("Adding a message to a full queue did not fail");
+    numberOfErrors++;
+  }
+  queue.Close();
+  igtl::MessageBase::Pointer message;
+  double enqueueTime = 0;
+  if (!queue.Pop(message, enqueueTime, 1.0) || queue.Push(CreateMessage("TRANSFORM", 4), PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE) == PLUS_SUCCESS)
+  {
+    LOG_ERROR("Closed queue must return the remaining messages and reject new messages");
+    numberOfErrors++;
+  }
+
+  if (PlusIgtlClientSendQueue::GetMessageCategory("IMAGE") != PlusIgtlClientSendQueue::MESSAGE_CATEGORY_IMAGE
+      || PlusIgtlClientSendQueue::GetMessageCategory("VIDEO") != PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE
+      || PlusIgtlClientSendQueue::GetMessageCategory("TDATA") != PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE
+      || PlusIgtlClientSendQueue::GetMessageCategory("RTS_COMMAND") != PlusIgtlClientSendQueue::MESSAGE_CATEGORY_RELIABLE)
+  {
+    LOG_ERROR("Unexpected message category");
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
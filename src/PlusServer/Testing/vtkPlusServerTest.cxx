@@ -109,7 +109,7 @@ PlusStatus DisconnectClients(std::vector< vtkSmartPointer<vtkPlusOpenIGTLinkVide
 }
 
 // -------------------------------------------------
-vtkSmartPointer<vtkPlusOpenIGTLinkServer> StartServer(const std::string& inputConfigFileName)
+vtkSmartPointer<vtkPlusOpenIGTLinkServer> StartServer(const std::string& inputConfigFileName, const std::string& networkingMode)
 {
   // Read main configuration file
   std::string configFilePath = inputConfigFileName;
@@ -178,6 +178,12 @@ vtkSmartPointer<vtkPlusOpenIGTLinkServer> StartServer(const std::string& inputCo
       continue;
     }
 
+    if (!networkingMode.empty())
+    {
+      // Override the networking mode of the configuration file
+      serverElement->SetAttribute("NetworkingMode", networkingMode.c_str());
+    }
+
     // This is a PlusServer tag, let's create it
     vtkSmartPointer<vtkPlusOpenIGTLinkServer> server = vtkSmartPointer<vtkPlusOpenIGTLinkServer>::New();
     LOG_DEBUG("Initializing Plus OpenIGTLink server... ");
@@ -199,6 +205,7 @@ int main(int argc, char** argv)
   bool printHelp(false);
   std::string inputConfigFileName;
   std::string testingConfigFileName;
+  std::string networkingMode;
   int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
 
   const double WAIT_TIME_SEC = 5.0;
@@ -211,6 +218,7 @@ int main(int argc, char** argv)
   args.AddArgument("--server-config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputConfigFileName, "Name of the server configuration file.");
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
   args.AddArgument("--testing-config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &testingConfigFileName, "Name of the testing configuration file");
+  args.AddArgument("--networking-mode", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &networkingMode, "Networking mode of the server (ThreadPerClient or Epoll). If not specified then the mode of the server configuration file is used.");
 
   if (!args.Parse())
   {
@@ -244,12 +252,17 @@ int main(int argc, char** argv)
   LOG_INFO("Logging at level " << vtkPlusLogger::Instance()->GetLogLevel() << " (" << vtkPlusLogger::Instance()->GetLogLevelString() << ") to file: " << vtkPlusLogger::Instance()->GetLogFileName());
 
   // Start a server
-  vtkSmartPointer<vtkPlusOpenIGTLinkServer> server = StartServer(inputConfigFileName);
+  vtkSmartPointer<vtkPlusOpenIGTLinkServer> server = StartServer(inputConfigFileName, networkingMode);
   if (server == nullptr)
   {
     LOG_ERROR("Unable to start server.");
     exit(EXIT_FAILURE);
   }
+  if (igsioCommon::IsEqualInsensitive(networkingMode, "Epoll") && server->GetNetworkingMode() != vtkPlusOpenIGTLinkServer::NETWORKING_MODE_EPOLL)
+  {
+    LOG_ERROR("Server is not running in Epoll networking mode");
+    exit(EXIT_FAILURE);
+  }
 
   vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::New();
   if (PlusXmlUtils::ReadDeviceSetConfigurationFromFile(configRootElement, testingConfigFileName.c_str()) == PLUS_FAIL)
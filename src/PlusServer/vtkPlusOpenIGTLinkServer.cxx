@@ -7,6 +7,7 @@ See License.txt for details.
 // Local includes
 #include "PlusConfigure.h"
 #include "PlusCommon.h"
+#include "PlusIgtlServerReactor.h"
 #include "igsioTrackedFrame.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusCommand.h"
@@ -61,12 +62,28 @@ namespace
   const int IGTL_EMPTY_DATA_SIZE = -1;
   const double SERVER_START_CHECK_DELAY_SEC = 2.0;
   const double SERVER_START_CHECK_DELAY_INTERVAL_SEC = 0.05;
+  const double CLIENT_SEND_QUEUE_WAIT_SEC = 0.1;
 
   //----------------------------------------------------------------------------
   // If a frame cannot be retrieved from the device buffers (because it was overwritten by new frames)
   // then we skip a SAMPLING_SKIPPING_MARGIN_SEC long period to allow the application to catch up.
   // This time should be long enough to comfortably retrieve a frame from the buffer.
   const double SAMPLING_SKIPPING_MARGIN_SEC = 0.1;
+
+  //----------------------------------------------------------------------------
+  // Copy a received message body into the buffer of the message. The message header must be set before calling this function.
+  bool CopyMessageBody(igtl::MessageBase* message, const std::vector<unsigned char>& body)
+  {
+    if (message->GetBufferBodySize() != body.size())
+    {
+      return false;
+    }
+    if (!body.empty())
+    {
+      memcpy(message->GetBufferBodyPointer(), &body[0], body.size());
+    }
+    return true;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -107,6 +124,12 @@ vtkPlusOpenIGTLinkServer::vtkPlusOpenIGTLinkServer()
   , MissingInputGracePeriodSec(0.0)
   , BroadcastStartTime(0.0)
   , NewClientConnected(false)
+  , NumberOfMessagePackings(0)
+  , NumberOfClientMessageDeliveries(0)
+  , ClientSendQueueMaxImageMessages(2)
+  , ClientSendQueueMaxMessages(1000)
+  , ClientSendQueueDropPolicy(PlusIgtlClientSendQueue::DROP_POLICY_OLDEST_IMAGE)
+  , NetworkingMode(NETWORKING_MODE_THREAD_PER_CLIENT)
 {
 
 }
@@ -152,6 +175,23 @@ PlusStatus vtkPlusOpenIGTLinkServer::QueueMessageResponseForClient(int clientId,
 void vtkPlusOpenIGTLinkServer::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "Message packings: " << this->NumberOfMessagePackings << std::endl;
+  os << indent << "Client message deliveries: " << this->NumberOfClientMessageDeliveries << std::endl;
+  os << indent << "Message packing deduplication ratio: " << this->GetMessagePackingDeduplicationRatio() << std::endl;
+  os << indent << "Client send queue max image messages: " << this->ClientSendQueueMaxImageMessages << std::endl;
+  os << indent << "Client send queue max messages: " << this->ClientSendQueueMaxMessages << std::endl;
+  os << indent << "Client send queue drop policy: " << PlusIgtlClientSendQueue::GetDropPolicyAsString(this->ClientSendQueueDropPolicy) << std::endl;
+  os << indent << "Networking mode: " << (this->NetworkingMode == NETWORKING_MODE_EPOLL ? "Epoll" : "ThreadPerClient") << std::endl;
+}
+
+//----------------------------------------------------------------------------
+double vtkPlusOpenIGTLinkServer::GetMessagePackingDeduplicationRatio() const
+{
+  if (this->NumberOfMessagePackings == 0)
+  {
+    return 1.0;
+  }
+  return static_cast<double>(this->NumberOfClientMessageDeliveries) / this->NumberOfMessagePackings;
 }
 
 //----------------------------------------------------------------------------
@@ -163,7 +203,31 @@ PlusStatus vtkPlusOpenIGTLinkServer::StartOpenIGTLinkService()
     return PLUS_FAIL;
   }
 
-  if (this->ConnectionReceiverThreadId < 0)
+  if (this->NetworkingMode == NETWORKING_MODE_EPOLL && !PlusIgtlServerReactor::IsSupported())
+  {
+    LOG_WARNING("Epoll networking mode is not supported on this platform. Using ThreadPerClient networking mode.");
+    this->NetworkingMode = NETWORKING_MODE_THREAD_PER_CLIENT;
+  }
+
+  if (this->NetworkingMode == NETWORKING_MODE_EPOLL)
+  {
+    if (!this->Reactor)
+    {
+      this->Reactor.reset(new PlusIgtlServerReactor(this));
+    }
+    if (!this->Reactor->IsRunning())
+    {
+      if (this->Reactor->Start(this->ListeningPort) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Cannot create a server socket.");
+        return PLUS_FAIL;
+      }
+      PrintServerInfo(this);
+      this->ConnectionActive.Request = true;
+      this->ConnectionActive.Respond = true;
+    }
+  }
+  else if (this->ConnectionReceiverThreadId < 0)
   {
     this->ConnectionActive.Request = true;
     this->ConnectionReceiverThreadId = this->Threader->SpawnThread((vtkThreadFunctionType)&ConnectionReceiverThread, this);
@@ -213,6 +277,15 @@ PlusStatus vtkPlusOpenIGTLinkServer::StopOpenIGTLinkService()
     LOG_DEBUG("ConnectionReceiverThread stopped");
   }
 
+  // Stop network reactor (closes the connection of all the clients that it handles)
+  if (this->Reactor && this->Reactor->IsRunning())
+  {
+    this->ConnectionActive.Request = false;
+    this->Reactor->Stop();
+    this->ConnectionActive.Respond = false;
+    LOG_DEBUG("Network reactor stopped");
+  }
+
   // Disconnect clients (stop receiving thread, close socket)
   std::vector< int > clientIds;
   {
@@ -228,6 +301,8 @@ PlusStatus vtkPlusOpenIGTLinkServer::StopOpenIGTLinkService()
     DisconnectClient(*it);
   }
 
+  LOG_DEBUG("Message packing deduplication ratio: " << this->GetMessagePackingDeduplicationRatio()
+            << " (" << this->NumberOfClientMessageDeliveries << " deliveries from " << this->NumberOfMessagePackings << " packings)");
   LOG_INFO("Plus OpenIGTLink server stopped.");
 
   return PLUS_SUCCESS;
@@ -257,38 +332,7 @@ void* vtkPlusOpenIGTLinkServer::ConnectionReceiverThread(vtkMultiThreader::Threa
     {
       // Lock before we change the clients list
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self->IgtlClientsMutex);
-      ClientData newClient;
-      self->IgtlClients.push_back(newClient);
-      self->NewClientConnected = true;
-
-      ClientData* client = &(self->IgtlClients.back());   // get a reference to the client data that is stored in the list
-      client->ClientId = self->ClientIdCounter;
-      self->ClientIdCounter++;
-      client->ClientSocket = newClientSocket;
-      client->ClientSocket->SetReceiveTimeout(self->DefaultClientReceiveTimeoutSec * 1000);
-      client->ClientSocket->SetSendTimeout(self->DefaultClientSendTimeoutSec * 1000);
-      client->ClientInfo = self->DefaultClientInfo;
-      client->Server = self;
-
-      // Setup vtkIGSIOFrameConverters for each stream
-      for (std::vector<PlusIgtlClientInfo::ImageStream>::iterator imageStreamIterator = client->ClientInfo.ImageStreams.begin();
-        imageStreamIterator != client->ClientInfo.ImageStreams.end(); ++imageStreamIterator)
-      {
-        PlusIgtlClientInfo::ImageStream* imageStream = &(*imageStreamIterator);
-        if (!imageStream->FrameConverter)
-        {
-          imageStream->FrameConverter = vtkSmartPointer<vtkIGSIOFrameConverter>::New();
-        }
-      }
-      for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStreamIterator = client->ClientInfo.VideoStreams.begin();
-           videoStreamIterator != client->ClientInfo.VideoStreams.end(); ++videoStreamIterator)
-      {
-        PlusIgtlClientInfo::VideoStream* videoStream = &(*videoStreamIterator);
-        if (!videoStream->FrameConverter)
-        {
-          videoStream->FrameConverter = vtkSmartPointer<vtkIGSIOFrameConverter>::New();
-        }
-      }
+      ClientData* client = self->AddClient(newClientSocket, -1);
 
       int port = 0;
       std::string address = "unknown";
@@ -299,6 +343,9 @@ void* vtkPlusOpenIGTLinkServer::ConnectionReceiverThread(vtkMultiThreader::Threa
 
       client->DataReceiverActive.first = true;
       client->DataReceiverThreadId = self->Threader->SpawnThread((vtkThreadFunctionType)&DataReceiverThread, client);
+
+      client->DataSenderActive.first = true;
+      client->DataSenderThreadId = self->Threader->SpawnThread((vtkThreadFunctionType)&ClientDataSenderThread, client);
     }
   }
 
@@ -314,6 +361,68 @@ void* vtkPlusOpenIGTLinkServer::ConnectionReceiverThread(vtkMultiThreader::Threa
   return NULL;
 }
 
+//----------------------------------------------------------------------------
+ClientData* vtkPlusOpenIGTLinkServer::AddClient(igtl::ClientSocket::Pointer clientSocket, int socketDescriptor)
+{
+  ClientData newClient;
+  this->IgtlClients.push_back(newClient);
+  this->NewClientConnected = true;
+
+  ClientData* client = &(this->IgtlClients.back());   // get a reference to the client data that is stored in the list
+  client->ClientId = this->ClientIdCounter;
+  this->ClientIdCounter++;
+  client->ClientSocket = clientSocket;
+  if (client->ClientSocket.IsNotNull())
+  {
+    client->ClientSocket->SetReceiveTimeout(this->DefaultClientReceiveTimeoutSec * 1000);
+    client->ClientSocket->SetSendTimeout(this->DefaultClientSendTimeoutSec * 1000);
+  }
+  client->SocketDescriptor = socketDescriptor;
+  client->ClientInfo = this->DefaultClientInfo;
+  client->Server = this;
+
+  // Setup vtkIGSIOFrameConverters for each stream
+  for (std::vector<PlusIgtlClientInfo::ImageStream>::iterator imageStreamIterator = client->ClientInfo.ImageStreams.begin();
+    imageStreamIterator != client->ClientInfo.ImageStreams.end(); ++imageStreamIterator)
+  {
+    PlusIgtlClientInfo::ImageStream* imageStream = &(*imageStreamIterator);
+    if (!imageStream->FrameConverter)
+    {
+      imageStream->FrameConverter = vtkSmartPointer<vtkIGSIOFrameConverter>::New();
+    }
+  }
+  for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStreamIterator = client->ClientInfo.VideoStreams.begin();
+       videoStreamIterator != client->ClientInfo.VideoStreams.end(); ++videoStreamIterator)
+  {
+    PlusIgtlClientInfo::VideoStream* videoStream = &(*videoStreamIterator);
+    if (!videoStream->FrameConverter)
+    {
+      videoStream->FrameConverter = vtkSmartPointer<vtkIGSIOFrameConverter>::New();
+    }
+  }
+
+  client->SendQueue = std::make_shared<PlusIgtlClientSendQueue>(this->ClientSendQueueMaxImageMessages, this->ClientSendQueueMaxMessages, this->ClientSendQueueDropPolicy);
+  return client;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::RemoveClient(int clientId)
+{
+  igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+  for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
+  {
+    if (clientIterator->ClientId == clientId)
+    {
+      if (clientIterator->SendQueue)
+      {
+        clientIterator->SendQueue->Close();
+      }
+      this->IgtlClients.erase(clientIterator);
+      return;
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 void* vtkPlusOpenIGTLinkServer::DataSenderThread(vtkMultiThreader::ThreadInfo* data)
 {
@@ -428,8 +537,11 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendLatestFramesToClients(vtkPlusOpenIGTLin
   // Maximize the number of frames to send
   numberOfFramesToGet = std::min(numberOfFramesToGet, self.MaxNumberOfIgtlMessagesToSend);
 
+  unsigned long long numberOfAddedItems = 0;
   if (self.BroadcastChannel != NULL)
   {
+    // Data that is added after this point wakes up the thread if no frames are found now
+    numberOfAddedItems = self.BroadcastChannel->GetNumberOfAddedItems();
     if ((self.BroadcastChannel->HasVideoSource() && !self.BroadcastChannel->GetVideoDataAvailable())
         || (self.BroadcastChannel->ToolCount() > 0 && !self.BroadcastChannel->GetTrackingDataAvailable())
         || (self.BroadcastChannel->FieldCount() > 0 && !self.BroadcastChannel->GetFieldDataAvailable()))
@@ -459,7 +571,15 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendLatestFramesToClients(vtkPlusOpenIGTLin
   // There is no new frame in the buffer
   if (trackedFrameList->GetNumberOfTrackedFrames() == 0)
   {
-    vtkIGSIOAccurateTimer::Delay(DELAY_ON_NO_NEW_FRAMES_SEC);
+    if (self.BroadcastChannel != NULL)
+    {
+      // Wake up as soon as new data arrives (the wait is still limited to allow sending command responses)
+      self.BroadcastChannel->WaitForNewData(DELAY_ON_NO_NEW_FRAMES_SEC, numberOfAddedItems);
+    }
+    else
+    {
+      vtkIGSIOAccurateTimer::Delay(DELAY_ON_NO_NEW_FRAMES_SEC);
+    }
     elapsedTimeSinceLastPacketSentSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
 
     // Send keep alive packet to clients
@@ -500,17 +620,17 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendMessageResponses(vtkPlusOpenIGTLinkServ
     for (ClientIdToMessageListMap::iterator it = self.MessageResponseQueue.begin(); it != self.MessageResponseQueue.end(); ++it)
     {
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self.IgtlClientsMutex);
-      igtl::ClientSocket::Pointer clientSocket = NULL;
+      ClientData* client = NULL;
 
       for (std::list<ClientData>::iterator clientIterator = self.IgtlClients.begin(); clientIterator != self.IgtlClients.end(); ++clientIterator)
       {
         if (clientIterator->ClientId == it->first)
         {
-          clientSocket = clientIterator->ClientSocket;
+          client = &(*clientIterator);
           break;
         }
       }
-      if (clientSocket.IsNull())
+      if (client == NULL)
       {
         LOG_WARNING("Message reply cannot be sent to client " << it->first << ", probably client has been disconnected.");
         continue;
@@ -518,7 +638,11 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendMessageResponses(vtkPlusOpenIGTLinkServ
 
       for (std::vector<igtl::MessageBase::Pointer>::iterator messageIt = it->second.begin(); messageIt != it->second.end(); ++messageIt)
       {
-        clientSocket->Send((*messageIt)->GetBufferPointer(), (*messageIt)->GetBufferSize());
+        if (self.QueueMessageForSending(*client, *messageIt) != PLUS_SUCCESS)
+        {
+          LOG_WARNING("Message reply cannot be sent to client " << it->first << ", client is not responding.");
+          break;
+        }
       }
     }
     self.MessageResponseQueue.clear();
@@ -547,22 +671,25 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendCommandResponses(vtkPlusOpenIGTLinkServ
       // Only send the response to the client that requested the command
       LOG_DEBUG("Send command reply to client " << (*responseIt)->GetClientId() << ": " << igtlResponseMessage->GetDeviceName());
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self.IgtlClientsMutex);
-      igtl::ClientSocket::Pointer clientSocket = NULL;
+      ClientData* client = NULL;
       for (std::list<ClientData>::iterator clientIterator = self.IgtlClients.begin(); clientIterator != self.IgtlClients.end(); ++clientIterator)
       {
         if (clientIterator->ClientId == (*responseIt)->GetClientId())
         {
-          clientSocket = clientIterator->ClientSocket;
+          client = &(*clientIterator);
           break;
         }
       }
 
-      if (clientSocket.IsNull())
+      if (client == NULL)
       {
         LOG_WARNING("Message reply cannot be sent to client " << (*responseIt)->GetClientId() << ", probably client has been disconnected");
         continue;
       }
-      clientSocket->Send(igtlResponseMessage->GetBufferPointer(), igtlResponseMessage->GetBufferSize());
+      if (self.QueueMessageForSending(*client, igtlResponseMessage) != PLUS_SUCCESS)
+      {
+        LOG_WARNING("Message reply cannot be sent to client " << (*responseIt)->GetClientId() << ", client is not responding");
+      }
     }
   }
 
@@ -576,9 +703,6 @@ void* vtkPlusOpenIGTLinkServer::DataReceiverThread(vtkMultiThreader::ThreadInfo*
   client->DataReceiverActive.second = true;
   vtkPlusOpenIGTLinkServer* self = client->Server;
 
-  /*! Store the IDs of recent commands to be able to detect duplicate command IDs */
-  std::deque<uint32_t> previousCommandIds;
-
   // Make copy of frequently used data to avoid locking of client data
   igtl::ClientSocket::Pointer clientSocket = client->ClientSocket;
   int clientId = client->ClientId;
@@ -600,417 +724,490 @@ void* vtkPlusOpenIGTLinkServer::DataReceiverThread(vtkMultiThreader::ThreadInfo*
 
     headerMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
 
+    // Receive the message body
+    std::vector<unsigned char> body(headerMsg->GetBodySizeToRead());
+    if (!body.empty())
     {
-      igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self->IgtlClientsMutex);
-      // Keep track of the highest known version of message ever sent by this client, this is the version that we reply with
-      // (upper bounded by the servers version)
-      if (headerMsg->GetHeaderVersion() > client->ClientInfo.GetClientHeaderVersion())
+      bytesReceived = clientSocket->Receive(&body[0], body.size(), timeout);
+      if (bytesReceived == IGTL_EMPTY_DATA_SIZE || bytesReceived != body.size())
       {
-        client->ClientInfo.SetClientHeaderVersion(std::min<int>(self->GetIGTLHeaderVersion(), headerMsg->GetHeaderVersion()));
+        LOG_ERROR("Failed to receive " << headerMsg->GetMessageType() << " message body from client " << clientId);
+        continue;
       }
     }
 
-    igtl::MessageBase::Pointer bodyMessage = self->IgtlMessageFactory->CreateReceiveMessage(headerMsg);
-    if (bodyMessage.IsNull())
+    if (self->ProcessClientMessage(client, headerMsg, body) != PLUS_SUCCESS)
     {
-      LOG_ERROR("Unable to receive message from client: " << client->ClientId);
-      continue;
+      break;
     }
+  } // ConnectionActive
 
-    if (typeid(*bodyMessage) == typeid(igtl::PlusClientInfoMessage))
-    {
-      igtl::PlusClientInfoMessage::Pointer clientInfoMsg = dynamic_cast<igtl::PlusClientInfoMessage*>(bodyMessage.GetPointer());
-      clientInfoMsg->SetMessageHeader(headerMsg);
-      clientInfoMsg->AllocateBuffer();
+  // Close thread
+  client->DataReceiverActive.second = false;
+  return NULL;
+}
 
-      bool timeout(false);
-      clientSocket->Receive(clientInfoMsg->GetBufferBodyPointer(), clientInfoMsg->GetBufferBodySize(), timeout);
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkServer::ProcessClientMessage(ClientData* client, igtl::MessageHeader::Pointer headerMsg, const std::vector<unsigned char>& body)
+{
+  int clientId = client->ClientId;
 
-      int c = clientInfoMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || clientInfoMsg->GetBufferBodySize() == 0)
-      {
-        // Message received from client, need to lock to modify client info
-        igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self->IgtlClientsMutex);
-        client->ClientInfo = clientInfoMsg->GetClientInfo();
-        LOG_DEBUG("Client info message received from client " << clientId);
-      }
-    }
-    else if (typeid(*bodyMessage) == typeid(igtl::GetStatusMessage))
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+    // Keep track of the highest known version of message ever sent by this client, this is the version that we reply with
+    // (upper bounded by the servers version)
+    if (headerMsg->GetHeaderVersion() > client->ClientInfo.GetClientHeaderVersion())
     {
-      // Just ping server, we can skip message and respond
-      clientSocket->Skip(headerMsg->GetBodySizeToRead(), 0);
-
-      igtl::StatusMessage::Pointer replyMsg = dynamic_cast<igtl::StatusMessage*>(self->IgtlMessageFactory->CreateSendMessage("STATUS", client->ClientInfo.GetClientHeaderVersion()).GetPointer());
-      replyMsg->SetCode(igtl::StatusMessage::STATUS_OK);
-      replyMsg->Pack();
-      clientSocket->Send(replyMsg->GetBufferPointer(), replyMsg->GetBufferSize());
+      client->ClientInfo.SetClientHeaderVersion(std::min<int>(this->GetIGTLHeaderVersion(), headerMsg->GetHeaderVersion()));
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::StringMessage)
-             && vtkPlusCommand::IsCommandDeviceName(headerMsg->GetDeviceName()))
+  }
+
+  igtl::MessageBase::Pointer bodyMessage = this->IgtlMessageFactory->CreateReceiveMessage(headerMsg);
+  if (bodyMessage.IsNull())
+  {
+    LOG_ERROR("Unable to receive message from client: " << client->ClientId);
+    return PLUS_SUCCESS;
+  }
+
+  if (typeid(*bodyMessage) == typeid(igtl::PlusClientInfoMessage))
+  {
+    igtl::PlusClientInfoMessage::Pointer clientInfoMsg = dynamic_cast<igtl::PlusClientInfoMessage*>(bodyMessage.GetPointer());
+    clientInfoMsg->SetMessageHeader(headerMsg);
+    clientInfoMsg->AllocateBuffer();
+
+    CopyMessageBody(clientInfoMsg, body);
+
+    int c = clientInfoMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || clientInfoMsg->GetBufferBodySize() == 0)
     {
-      igtl::StringMessage::Pointer stringMsg = dynamic_cast<igtl::StringMessage*>(bodyMessage.GetPointer());
-      stringMsg->SetMessageHeader(headerMsg);
-      stringMsg->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(stringMsg->GetBufferBodyPointer(), stringMsg->GetBufferBodySize(), timeout);
+      // Message received from client, need to lock to modify client info
+      igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+      client->ClientInfo = clientInfoMsg->GetClientInfo();
+      LOG_DEBUG("Client info message received from client " << clientId);
 
-      // We are receiving old style commands, handle it
-      int c = stringMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || stringMsg->GetBufferBodySize() == 0)
+      // The client may have joined a subscription group whose encoder is in the middle of a stream.
+      // The group has to continue with a key frame, otherwise the client cannot decode anything until the next natural key frame.
+      std::map<std::string, int>::iterator encoderClient = this->SubscriptionEncoderClientIds.find(client->ClientInfo.GetSubscriptionKey());
+      if (encoderClient != this->SubscriptionEncoderClientIds.end())
       {
-        std::string deviceName(headerMsg->GetDeviceName());
-        if (deviceName.empty())
+        for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
         {
-          self->PlusCommandProcessor->QueueStringResponse(PLUS_FAIL, std::string(vtkPlusCommand::DEVICE_NAME_REPLY), clientId, "Unable to read DeviceName.");
-          continue;
+          if (clientIterator->ClientId != encoderClient->second)
+          {
+            continue;
+          }
+          for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStream = clientIterator->ClientInfo.VideoStreams.begin(); videoStream != clientIterator->ClientInfo.VideoStreams.end(); ++videoStream)
+          {
+            if (videoStream->FrameConverter)
+            {
+              videoStream->FrameConverter->RequestKeyFrameOn();
+            }
+          }
         }
+      }
+    }
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::GetStatusMessage))
+  {
+    // Just ping server, respond
+    igtl::StatusMessage::Pointer replyMsg = dynamic_cast<igtl::StatusMessage*>(this->IgtlMessageFactory->CreateSendMessage("STATUS", client->ClientInfo.GetClientHeaderVersion()).GetPointer());
+    replyMsg->SetCode(igtl::StatusMessage::STATUS_OK);
+    replyMsg->Pack();
+    // Only the client's sender thread may write to the socket
+    this->QueueMessageResponseForClient(clientId, replyMsg.GetPointer());
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::StringMessage)
+           && vtkPlusCommand::IsCommandDeviceName(headerMsg->GetDeviceName()))
+  {
+    igtl::StringMessage::Pointer stringMsg = dynamic_cast<igtl::StringMessage*>(bodyMessage.GetPointer());
+    stringMsg->SetMessageHeader(headerMsg);
+    stringMsg->AllocateBuffer();
+    CopyMessageBody(stringMsg, body);
+
+    // We are receiving old style commands, handle it
+    int c = stringMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || stringMsg->GetBufferBodySize() == 0)
+    {
+      std::string deviceName(headerMsg->GetDeviceName());
+      if (deviceName.empty())
+      {
+        this->PlusCommandProcessor->QueueStringResponse(PLUS_FAIL, std::string(vtkPlusCommand::DEVICE_NAME_REPLY), clientId, "Unable to read DeviceName.");
+        return PLUS_SUCCESS;
+      }
 
-        uint32_t uid(0);
-        try
-        {
+      uint32_t uid(0);
+      try
+      {
 #if (_MSC_VER == 1500)
-          std::istringstream ss(vtkPlusCommand::GetUidFromCommandDeviceName(deviceName));
-          ss >> uid;
+        std::istringstream ss(vtkPlusCommand::GetUidFromCommandDeviceName(deviceName));
+        ss >> uid;
 #else
-          uid = std::stoi(vtkPlusCommand::GetUidFromCommandDeviceName(deviceName));
+        uid = std::stoi(vtkPlusCommand::GetUidFromCommandDeviceName(deviceName));
 #endif
-        }
-        catch (std::invalid_argument e)
-        {
-          LOG_ERROR("Unable to extract command UID from device name string.");
-          // Removing support for malformed command strings, reply with error
-          self->PlusCommandProcessor->QueueStringResponse(PLUS_FAIL, std::string(vtkPlusCommand::DEVICE_NAME_REPLY), clientId, "Malformed DeviceName. Expected CMD_cmdId (ex: CMD_001)");
-          continue;
-        }
+      }
+      catch (std::invalid_argument e)
+      {
+        LOG_ERROR("Unable to extract command UID from device name string.");
+        // Removing support for malformed command strings, reply with error
+        this->PlusCommandProcessor->QueueStringResponse(PLUS_FAIL, std::string(vtkPlusCommand::DEVICE_NAME_REPLY), clientId, "Malformed DeviceName. Expected CMD_cmdId (ex: CMD_001)");
+        return PLUS_SUCCESS;
+      }
 
-        deviceName = vtkPlusCommand::GetPrefixFromCommandDeviceName(deviceName);
+      deviceName = vtkPlusCommand::GetPrefixFromCommandDeviceName(deviceName);
 
-        if (std::find(previousCommandIds.begin(), previousCommandIds.end(), uid) != previousCommandIds.end())
-        {
-          // Command already exists
-          LOG_WARNING("Already received a command with id = " << uid << " from client " << clientId << ". This repeated command will be ignored.");
-          continue;
-        }
-        // New command, remember its ID
-        previousCommandIds.push_back(uid);
-        if (previousCommandIds.size() > NUMBER_OF_RECENT_COMMAND_IDS_STORED)
-        {
-          previousCommandIds.pop_front();
-        }
+      if (std::find(client->PreviousCommandIds.begin(), client->PreviousCommandIds.end(), uid) != client->PreviousCommandIds.end())
+      {
+        // Command already exists
+        LOG_WARNING("Already received a command with id = " << uid << " from client " << clientId << ". This repeated command will be ignored.");
+        return PLUS_SUCCESS;
+      }
+      // New command, remember its ID
+      client->PreviousCommandIds.push_back(uid);
+      if (client->PreviousCommandIds.size() > NUMBER_OF_RECENT_COMMAND_IDS_STORED)
+      {
+        client->PreviousCommandIds.pop_front();
+      }
 
-        LOG_DEBUG("Received command from client " << clientId << ", device " << deviceName << " with UID " << uid << ": " << stringMsg->GetString());
+      LOG_DEBUG("Received command from client " << clientId << ", device " << deviceName << " with UID " << uid << ": " << stringMsg->GetString());
 
-        vtkSmartPointer<vtkXMLDataElement> cmdElement = vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(stringMsg->GetString()));
-        std::string commandName = std::string(cmdElement->GetAttribute("Name") == NULL ? "" : cmdElement->GetAttribute("Name"));
+      vtkSmartPointer<vtkXMLDataElement> cmdElement = vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(stringMsg->GetString()));
+      std::string commandName = std::string(cmdElement->GetAttribute("Name") == NULL ? "" : cmdElement->GetAttribute("Name"));
 
-        self->PlusCommandProcessor->QueueCommand(false, clientId, commandName, stringMsg->GetString(), deviceName, uid, stringMsg->GetMetaData());
-      }
+      this->PlusCommandProcessor->QueueCommand(false, clientId, commandName, stringMsg->GetString(), deviceName, uid, stringMsg->GetMetaData());
+    }
 
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::CommandMessage))
+  {
+    igtl::CommandMessage::Pointer commandMsg = dynamic_cast<igtl::CommandMessage*>(bodyMessage.GetPointer());
+    commandMsg->SetMessageHeader(headerMsg);
+    commandMsg->AllocateBuffer();
+    if (!CopyMessageBody(commandMsg, body))
+    {
+      LOG_ERROR("Failed to receive command message from client " << clientId);
+      return PLUS_SUCCESS;
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::CommandMessage))
+
+    int c = commandMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || commandMsg->GetBufferBodySize() == 0)
     {
-      igtl::CommandMessage::Pointer commandMsg = dynamic_cast<igtl::CommandMessage*>(bodyMessage.GetPointer());
-      commandMsg->SetMessageHeader(headerMsg);
-      commandMsg->AllocateBuffer();
-      bool timeout(false);
-      void* bodyPointer(commandMsg->GetBufferBodyPointer());
-      igtlUint64 bodySize(commandMsg->GetBufferBodySize());
+      std::string deviceName(headerMsg->GetDeviceName());
 
-      igtlUint64 bytesReceived = clientSocket->Receive(bodyPointer, bodySize, timeout);
-      if (bytesReceived == IGTL_EMPTY_DATA_SIZE || bytesReceived != bodySize)
+      uint32_t uid;
+      uid = commandMsg->GetCommandId();
+
+      if (std::find(client->PreviousCommandIds.begin(), client->PreviousCommandIds.end(), uid) != client->PreviousCommandIds.end())
       {
-        LOG_ERROR("Failed to receive command message from client " << clientId);
-        continue;
+        // Command already exists
+        LOG_WARNING("Already received a command with id = " << uid << " from client " << clientId << ". This repeated command will be ignored.");
+        return PLUS_SUCCESS;
       }
-
-      int c = commandMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || commandMsg->GetBufferBodySize() == 0)
+      // New command, remember its ID
+      client->PreviousCommandIds.push_back(uid);
+      if (client->PreviousCommandIds.size() > NUMBER_OF_RECENT_COMMAND_IDS_STORED)
       {
-        std::string deviceName(headerMsg->GetDeviceName());
+        client->PreviousCommandIds.pop_front();
+      }
 
-        uint32_t uid;
-        uid = commandMsg->GetCommandId();
+      LOG_DEBUG("Received header version " << commandMsg->GetHeaderVersion() << " command " << commandMsg->GetCommandName()
+                << " from client " << clientId << ", device " << deviceName << " with UID " << uid << ": " << commandMsg->GetCommandContent());
 
-        if (std::find(previousCommandIds.begin(), previousCommandIds.end(), uid) != previousCommandIds.end())
-        {
-          // Command already exists
-          LOG_WARNING("Already received a command with id = " << uid << " from client " << clientId << ". This repeated command will be ignored.");
-          continue;
-        }
-        // New command, remember its ID
-        previousCommandIds.push_back(uid);
-        if (previousCommandIds.size() > NUMBER_OF_RECENT_COMMAND_IDS_STORED)
-        {
-          previousCommandIds.pop_front();
-        }
+      this->PlusCommandProcessor->QueueCommand(true, clientId, commandMsg->GetCommandName(), commandMsg->GetCommandContent(), deviceName, uid, commandMsg->GetMetaData());
+    }
+    else
+    {
+      LOG_ERROR("STRING message unpacking failed for client " << clientId);
+    }
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::StartTrackingDataMessage))
+  {
+    std::string deviceName("");
 
-        LOG_DEBUG("Received header version " << commandMsg->GetHeaderVersion() << " command " << commandMsg->GetCommandName()
-                  << " from client " << clientId << ", device " << deviceName << " with UID " << uid << ": " << commandMsg->GetCommandContent());
+    igtl::StartTrackingDataMessage::Pointer startTracking = dynamic_cast<igtl::StartTrackingDataMessage*>(bodyMessage.GetPointer());
+    startTracking->SetMessageHeader(headerMsg);
+    startTracking->AllocateBuffer();
+    CopyMessageBody(startTracking, body);
 
-        self->PlusCommandProcessor->QueueCommand(true, clientId, commandMsg->GetCommandName(), commandMsg->GetCommandContent(), deviceName, uid, commandMsg->GetMetaData());
-      }
-      else
-      {
-        LOG_ERROR("STRING message unpacking failed for client " << clientId);
-      }
+    int c = startTracking->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || startTracking->GetBufferBodySize() == 0)
+    {
+      client->ClientInfo.SetTDATAResolution(startTracking->GetResolution());
+      client->ClientInfo.SetTDATARequested(true);
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::StartTrackingDataMessage))
+    else
     {
-      std::string deviceName("");
-
-      igtl::StartTrackingDataMessage::Pointer startTracking = dynamic_cast<igtl::StartTrackingDataMessage*>(bodyMessage.GetPointer());
-      startTracking->SetMessageHeader(headerMsg);
-      startTracking->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(startTracking->GetBufferBodyPointer(), startTracking->GetBufferBodySize(), timeout);
+      LOG_ERROR("Client " << clientId << " STT_TDATA failed: could not retrieve startTracking message");
+      return PLUS_FAIL;
+    }
 
-      int c = startTracking->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || startTracking->GetBufferBodySize() == 0)
-      {
-        client->ClientInfo.SetTDATAResolution(startTracking->GetResolution());
-        client->ClientInfo.SetTDATARequested(true);
-      }
-      else
-      {
-        LOG_ERROR("Client " << clientId << " STT_TDATA failed: could not retrieve startTracking message");
-        return NULL;
-      }
+    igtl::MessageBase::Pointer msg = this->IgtlMessageFactory->CreateSendMessage("RTS_TDATA", client->ClientInfo.GetClientHeaderVersion());
+    igtl::RTSTrackingDataMessage* rtsMsg = dynamic_cast<igtl::RTSTrackingDataMessage*>(msg.GetPointer());
+    rtsMsg->SetStatus(0);
+    rtsMsg->Pack();
+    this->QueueMessageResponseForClient(client->ClientId, msg);
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::StopTrackingDataMessage))
+  {
+    igtl::StopTrackingDataMessage::Pointer stopTracking = dynamic_cast<igtl::StopTrackingDataMessage*>(bodyMessage.GetPointer());
+    stopTracking->SetMessageHeader(headerMsg);
+    stopTracking->AllocateBuffer();
+    CopyMessageBody(stopTracking, body);
+
+    client->ClientInfo.SetTDATARequested(false);
+    igtl::MessageBase::Pointer msg = this->IgtlMessageFactory->CreateSendMessage("RTS_TDATA", client->ClientInfo.GetClientHeaderVersion());
+    igtl::RTSTrackingDataMessage* rtsMsg = dynamic_cast<igtl::RTSTrackingDataMessage*>(msg.GetPointer());
+    rtsMsg->SetStatus(0);
+    rtsMsg->Pack();
+    this->QueueMessageResponseForClient(client->ClientId, msg);
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::GetPolyDataMessage))
+  {
+    igtl::GetPolyDataMessage::Pointer polyDataMessage = dynamic_cast<igtl::GetPolyDataMessage*>(bodyMessage.GetPointer());
+    polyDataMessage->SetMessageHeader(headerMsg);
+    polyDataMessage->AllocateBuffer();
+    CopyMessageBody(polyDataMessage, body);
 
-      igtl::MessageBase::Pointer msg = self->IgtlMessageFactory->CreateSendMessage("RTS_TDATA", client->ClientInfo.GetClientHeaderVersion());
-      igtl::RTSTrackingDataMessage* rtsMsg = dynamic_cast<igtl::RTSTrackingDataMessage*>(msg.GetPointer());
-      rtsMsg->SetStatus(0);
-      rtsMsg->Pack();
-      self->QueueMessageResponseForClient(client->ClientId, msg);
-    }
-    else if (typeid(*bodyMessage) == typeid(igtl::StopTrackingDataMessage))
-    {
-      igtl::StopTrackingDataMessage::Pointer stopTracking = dynamic_cast<igtl::StopTrackingDataMessage*>(bodyMessage.GetPointer());
-      stopTracking->SetMessageHeader(headerMsg);
-      stopTracking->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(stopTracking->GetBufferBodyPointer(), stopTracking->GetBufferBodySize(), timeout);
-
-      client->ClientInfo.SetTDATARequested(false);
-      igtl::MessageBase::Pointer msg = self->IgtlMessageFactory->CreateSendMessage("RTS_TDATA", client->ClientInfo.GetClientHeaderVersion());
-      igtl::RTSTrackingDataMessage* rtsMsg = dynamic_cast<igtl::RTSTrackingDataMessage*>(msg.GetPointer());
-      rtsMsg->SetStatus(0);
-      rtsMsg->Pack();
-      self->QueueMessageResponseForClient(client->ClientId, msg);
-    }
-    else if (typeid(*bodyMessage) == typeid(igtl::GetPolyDataMessage))
-    {
-      igtl::GetPolyDataMessage::Pointer polyDataMessage = dynamic_cast<igtl::GetPolyDataMessage*>(bodyMessage.GetPointer());
-      polyDataMessage->SetMessageHeader(headerMsg);
-      polyDataMessage->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(polyDataMessage->GetBufferBodyPointer(), polyDataMessage->GetBufferBodySize(), timeout);
-
-      int c = polyDataMessage->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || polyDataMessage->GetBufferBodySize() == 0)
+    int c = polyDataMessage->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || polyDataMessage->GetBufferBodySize() == 0)
+    {
+      std::string fileName;
+      // Check metadata for requisite parameters, if absent, check deviceName
+      if (polyDataMessage->GetHeaderVersion() > IGTL_HEADER_VERSION_1)
       {
-        std::string fileName;
-        // Check metadata for requisite parameters, if absent, check deviceName
-        if (polyDataMessage->GetHeaderVersion() > IGTL_HEADER_VERSION_1)
-        {
-          if (!polyDataMessage->GetMetaDataElement("filename", fileName))
-          {
-            fileName = polyDataMessage->GetDeviceName();
-            if (fileName.empty())
-            {
-              LOG_ERROR("GetPolyData message sent with no filename in either metadata or deviceName field.");
-              continue;
-            }
-          }
-        }
-        else
+        if (!polyDataMessage->GetMetaDataElement("filename", fileName))
         {
           fileName = polyDataMessage->GetDeviceName();
           if (fileName.empty())
           {
             LOG_ERROR("GetPolyData message sent with no filename in either metadata or deviceName field.");
-            continue;
+            return PLUS_SUCCESS;
           }
         }
+      }
+      else
+      {
+        fileName = polyDataMessage->GetDeviceName();
+        if (fileName.empty())
+        {
+          LOG_ERROR("GetPolyData message sent with no filename in either metadata or deviceName field.");
+          return PLUS_SUCCESS;
+        }
+      }
 
-        vtkSmartPointer<vtkPolyDataReader> reader = vtkSmartPointer<vtkPolyDataReader>::New();
-        reader->SetFileName(fileName.c_str());
-        reader->Update();
+      vtkSmartPointer<vtkPolyDataReader> reader = vtkSmartPointer<vtkPolyDataReader>::New();
+      reader->SetFileName(fileName.c_str());
+      reader->Update();
 
-        auto polyData = reader->GetOutput();
-        if (polyData != nullptr)
-        {
-          igtl::MessageBase::Pointer msg = self->IgtlMessageFactory->CreateSendMessage("POLYDATA", client->ClientInfo.GetClientHeaderVersion());
-          igtl::PolyDataMessage* polyMsg = dynamic_cast<igtl::PolyDataMessage*>(msg.GetPointer());
+      auto polyData = reader->GetOutput();
+      if (polyData != nullptr)
+      {
+        igtl::MessageBase::Pointer msg = this->IgtlMessageFactory->CreateSendMessage("POLYDATA", client->ClientInfo.GetClientHeaderVersion());
+        igtl::PolyDataMessage* polyMsg = dynamic_cast<igtl::PolyDataMessage*>(msg.GetPointer());
 
-          igtlioPolyDataConverter::ContentData data;
-          data.deviceName = "PlusServer";
-          data.polydata = polyData;
+        igtlioPolyDataConverter::ContentData data;
+        data.deviceName = "PlusServer";
+        data.polydata = polyData;
 
-          igtlioBaseConverter::HeaderData header;
-          header.deviceName = "PlusServer";
+        igtlioBaseConverter::HeaderData header;
+        header.deviceName = "PlusServer";
 
-          igtlioPolyDataConverter::toIGTL(header, data, (igtl::PolyDataMessage::Pointer*)&msg);
-          if (!msg->SetMetaDataElement("fileName", IANA_TYPE_US_ASCII, fileName))
-          {
-            LOG_ERROR("Filename too long to be sent back to client. Aborting.");
-            continue;
-          }
-          self->QueueMessageResponseForClient(client->ClientId, msg);
-          continue;
+        igtlioPolyDataConverter::toIGTL(header, data, (igtl::PolyDataMessage::Pointer*)&msg);
+        if (!msg->SetMetaDataElement("fileName", IANA_TYPE_US_ASCII, fileName))
+        {
+          LOG_ERROR("Filename too long to be sent back to client. Aborting.");
+          return PLUS_SUCCESS;
         }
-
-        igtl::MessageBase::Pointer msg = self->IgtlMessageFactory->CreateSendMessage("RTS_POLYDATA", polyDataMessage->GetHeaderVersion());
-        igtl::RTSPolyDataMessage* rtsPolyMsg = dynamic_cast<igtl::RTSPolyDataMessage*>(msg.GetPointer());
-        rtsPolyMsg->SetStatus(false);
-        self->QueueMessageResponseForClient(client->ClientId, rtsPolyMsg);
-      }
-      else
-      {
-        LOG_ERROR("Client " << clientId << " GET_POLYDATA failed: could not retrieve message");
-        return NULL;
+        this->QueueMessageResponseForClient(client->ClientId, msg);
+        return PLUS_SUCCESS;
       }
+
+      igtl::MessageBase::Pointer msg = this->IgtlMessageFactory->CreateSendMessage("RTS_POLYDATA", polyDataMessage->GetHeaderVersion());
+      igtl::RTSPolyDataMessage* rtsPolyMsg = dynamic_cast<igtl::RTSPolyDataMessage*>(msg.GetPointer());
+      rtsPolyMsg->SetStatus(false);
+      this->QueueMessageResponseForClient(client->ClientId, rtsPolyMsg);
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::StatusMessage))
+    else
     {
-      // status message is used as a keep-alive, don't do anything
-      clientSocket->Skip(headerMsg->GetBodySizeToRead(), 0);
+      LOG_ERROR("Client " << clientId << " GET_POLYDATA failed: could not retrieve message");
+      return PLUS_FAIL;
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::GetImageMetaMessage))
-    {
-      igtl::GetImageMetaMessage::Pointer getImageMetaMsg = dynamic_cast<igtl::GetImageMetaMessage*>(bodyMessage.GetPointer());
-      getImageMetaMsg->SetMessageHeader(headerMsg);
-      getImageMetaMsg->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(getImageMetaMsg->GetBufferBodyPointer(), getImageMetaMsg->GetBufferBodySize(), timeout);
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::StatusMessage))
+  {
+    // status message is used as a keep-alive, don't do anything
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::GetImageMetaMessage))
+  {
+    igtl::GetImageMetaMessage::Pointer getImageMetaMsg = dynamic_cast<igtl::GetImageMetaMessage*>(bodyMessage.GetPointer());
+    getImageMetaMsg->SetMessageHeader(headerMsg);
+    getImageMetaMsg->AllocateBuffer();
+    CopyMessageBody(getImageMetaMsg, body);
 
-      int c = getImageMetaMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || getImageMetaMsg->GetBufferBodySize() == 0)
-      {
-        // Image meta message
-        std::string deviceName("");
-        if (headerMsg->GetDeviceName() != NULL)
-        {
-          deviceName = headerMsg->GetDeviceName();
-        }
-        self->PlusCommandProcessor->QueueGetImageMetaData(clientId, deviceName);
-      }
-      else
+    int c = getImageMetaMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || getImageMetaMsg->GetBufferBodySize() == 0)
+    {
+      // Image meta message
+      std::string deviceName("");
+      if (headerMsg->GetDeviceName() != NULL)
       {
-        LOG_ERROR("Client " << clientId << " GET_IMGMETA failed: could not retrieve message");
-        return NULL;
+        deviceName = headerMsg->GetDeviceName();
       }
+      this->PlusCommandProcessor->QueueGetImageMetaData(clientId, deviceName);
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::GetImageMessage))
+    else
     {
-      igtl::GetImageMessage::Pointer getImageMsg = dynamic_cast<igtl::GetImageMessage*>(bodyMessage.GetPointer());
-      getImageMsg->SetMessageHeader(headerMsg);
-      getImageMsg->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(getImageMsg->GetBufferBodyPointer(), getImageMsg->GetBufferBodySize(), timeout);
+      LOG_ERROR("Client " << clientId << " GET_IMGMETA failed: could not retrieve message");
+      return PLUS_FAIL;
+    }
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::GetImageMessage))
+  {
+    igtl::GetImageMessage::Pointer getImageMsg = dynamic_cast<igtl::GetImageMessage*>(bodyMessage.GetPointer());
+    getImageMsg->SetMessageHeader(headerMsg);
+    getImageMsg->AllocateBuffer();
+    CopyMessageBody(getImageMsg, body);
 
-      int c = getImageMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || getImageMsg->GetBufferBodySize() == 0)
+    int c = getImageMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || getImageMsg->GetBufferBodySize() == 0)
+    {
+      std::string deviceName("");
+      if (headerMsg->GetDeviceName() != NULL)
       {
-        std::string deviceName("");
-        if (headerMsg->GetDeviceName() != NULL)
-        {
-          deviceName = headerMsg->GetDeviceName();
-        }
-        else
-        {
-          LOG_ERROR("Please select the image you want to acquire");
-          return NULL;
-        }
-        self->PlusCommandProcessor->QueueGetImage(clientId, deviceName);
+        deviceName = headerMsg->GetDeviceName();
       }
       else
       {
-        LOG_ERROR("Client " << clientId << " GET_IMAGE failed: could not retrieve message");
-        return NULL;
+        LOG_ERROR("Please select the image you want to acquire");
+        return PLUS_FAIL;
       }
-
+      this->PlusCommandProcessor->QueueGetImage(clientId, deviceName);
     }
-    else if (typeid(*bodyMessage) == typeid(igtl::GetPointMessage))
+    else
     {
-      igtl::GetPointMessage* getPointMsg = dynamic_cast<igtl::GetPointMessage*>(bodyMessage.GetPointer());
-      getPointMsg->SetMessageHeader(headerMsg);
-      getPointMsg->AllocateBuffer();
-      bool timeout(false);
-      clientSocket->Receive(getPointMsg->GetBufferBodyPointer(), getPointMsg->GetBufferBodySize(), timeout);
+      LOG_ERROR("Client " << clientId << " GET_IMAGE failed: could not retrieve message");
+      return PLUS_FAIL;
+    }
+
+  }
+  else if (typeid(*bodyMessage) == typeid(igtl::GetPointMessage))
+  {
+    igtl::GetPointMessage* getPointMsg = dynamic_cast<igtl::GetPointMessage*>(bodyMessage.GetPointer());
+    getPointMsg->SetMessageHeader(headerMsg);
+    getPointMsg->AllocateBuffer();
+    CopyMessageBody(getPointMsg, body);
 
-      int c = getPointMsg->Unpack(self->IgtlMessageCrcCheckEnabled);
-      if (c & igtl::MessageHeader::UNPACK_BODY || getPointMsg->GetBufferBodySize() == 0)
+    int c = getPointMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
+    if (c & igtl::MessageHeader::UNPACK_BODY || getPointMsg->GetBufferBodySize() == 0)
+    {
+      std::string fileName;
+      if (!getPointMsg->GetMetaDataElement("Filename", fileName))
       {
-        std::string fileName;
-        if (!getPointMsg->GetMetaDataElement("Filename", fileName))
-        {
-          fileName = getPointMsg->GetDeviceName();
-        }
+        fileName = getPointMsg->GetDeviceName();
+      }
 
-        if (igsioCommon::Tail(fileName, 4) != "fcsv")
-        {
-          LOG_WARNING("Filename does not end in fcsv. GetPoint behaviour may not function correctly.");
-        }
+      if (igsioCommon::Tail(fileName, 4) != "fcsv")
+      {
+        LOG_WARNING("Filename does not end in fcsv. GetPoint behaviour may not function correctly.");
+      }
 
-        if (!vtksys::SystemTools::FileExists(fileName) &&
-            !vtksys::SystemTools::FileExists(vtkPlusConfig::GetInstance()->GetImagePath(fileName)))
-        {
-          LOG_ERROR("File: " << fileName << " requested but does not exist. Cannot get POINT data from it.");
-          return NULL;
-        }
+      if (!vtksys::SystemTools::FileExists(fileName) &&
+          !vtksys::SystemTools::FileExists(vtkPlusConfig::GetInstance()->GetImagePath(fileName)))
+      {
+        LOG_ERROR("File: " << fileName << " requested but does not exist. Cannot get POINT data from it.");
+        return PLUS_FAIL;
+      }
 
-        igtl::MessageBase::Pointer msg = self->IgtlMessageFactory->CreateSendMessage("POINT", client->ClientInfo.GetClientHeaderVersion());
-        igtl::PointMessage* pointMsg = dynamic_cast<igtl::PointMessage*>(msg.GetPointer());
+      igtl::MessageBase::Pointer msg = this->IgtlMessageFactory->CreateSendMessage("POINT", client->ClientInfo.GetClientHeaderVersion());
+      igtl::PointMessage* pointMsg = dynamic_cast<igtl::PointMessage*>(msg.GetPointer());
 
-        std::ifstream t(fileName);
+      std::ifstream t(fileName);
+      if (!t.is_open())
+      {
+        t.open(vtkPlusConfig::GetInstance()->GetImagePath(fileName));
         if (!t.is_open())
         {
-          t.open(vtkPlusConfig::GetInstance()->GetImagePath(fileName));
-          if (!t.is_open())
-          {
-            LOG_ERROR("Cannot read file: " << fileName);
-            return NULL;
-          }
+          LOG_ERROR("Cannot read file: " << fileName);
+          return PLUS_FAIL;
         }
-        std::stringstream buffer;
-        buffer << t.rdbuf();
-        std::vector<std::string> lines = igsioCommon::SplitStringIntoTokens(buffer.str(), '\n', false);
-        for (std::vector<std::string>::iterator it = lines.begin(); it != lines.end(); ++it)
+      }
+      std::stringstream buffer;
+      buffer << t.rdbuf();
+      std::vector<std::string> lines = igsioCommon::SplitStringIntoTokens(buffer.str(), '\n', false);
+      for (std::vector<std::string>::iterator it = lines.begin(); it != lines.end(); ++it)
+      {
+        std::string line = igsioCommon::Trim(*it);
+        if (line[0] == '#')
         {
-          std::string line = igsioCommon::Trim(*it);
-          if (line[0] == '#')
-          {
-            continue;
-          }
-
-          std::vector<std::string> tokens = igsioCommon::SplitStringIntoTokens(line, ',', true);
-          igtl::PointElement::Pointer elem = igtl::PointElement::New();
-          elem->SetPosition(std::stof(tokens[1]), std::stof(tokens[2]), std::stof(tokens[3]));
-          elem->SetName(tokens[0].c_str());
-          elem->SetGroupName("Point");
-          pointMsg->AddPointElement(elem);
+          continue;
         }
 
-        self->QueueMessageResponseForClient(client->ClientId, pointMsg);
-      }
-      else
-      {
-        LOG_ERROR("Client " << clientId << " GET_POINT failed: could not retrieve message");
-        return NULL;
+        std::vector<std::string> tokens = igsioCommon::SplitStringIntoTokens(line, ',', true);
+        igtl::PointElement::Pointer elem = igtl::PointElement::New();
+        elem->SetPosition(std::stof(tokens[1]), std::stof(tokens[2]), std::stof(tokens[3]));
+        elem->SetName(tokens[0].c_str());
+        elem->SetGroupName("Point");
+        pointMsg->AddPointElement(elem);
       }
+
+      this->QueueMessageResponseForClient(client->ClientId, pointMsg);
     }
     else
     {
-      // if the device type is unknown, skip reading.
-      LOG_WARNING("Unknown OpenIGTLink message is received from client " << clientId << ". Device type: " << headerMsg->GetMessageType()
-                  << ". Device name: " << headerMsg->GetDeviceName() << ".");
-      clientSocket->Skip(headerMsg->GetBodySizeToRead(), 0);
+      LOG_ERROR("Client " << clientId << " GET_POINT failed: could not retrieve message");
+      return PLUS_FAIL;
+    }
+  }
+  else
+  {
+    // if the device type is unknown, skip reading.
+    LOG_WARNING("Unknown OpenIGTLink message is received from client " << clientId << ". Device type: " << headerMsg->GetMessageType()
+                << ". Device name: " << headerMsg->GetDeviceName() << ".");
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void* vtkPlusOpenIGTLinkServer::ClientDataSenderThread(vtkMultiThreader::ThreadInfo* data)
+{
+  ClientData* client = (ClientData*)(data->UserData);
+  client->DataSenderActive.second = true;
+  vtkPlusOpenIGTLinkServer* self = client->Server;
+
+  // Make copy of frequently used data to avoid locking of client data
+  igtl::ClientSocket::Pointer clientSocket = client->ClientSocket;
+  std::shared_ptr<PlusIgtlClientSendQueue> sendQueue = client->SendQueue;
+
+  igtl::MessageBase::Pointer message;
+  double enqueueTime = 0;
+  while (client->DataSenderActive.first)
+  {
+    if (!sendQueue->Pop(message, enqueueTime, CLIENT_SEND_QUEUE_WAIT_SEC))
+    {
+      continue;
+    }
+    if (sendQueue->HasSendFailed())
+    {
+      // The client is about to be disconnected, discard the remaining messages
       continue;
     }
-  } // ConnectionActive
 
-  // Close thread
-  client->DataReceiverActive.second = false;
+    int retValue = 0;
+    RETRY_UNTIL_TRUE((retValue = clientSocket->Send(message->GetBufferPointer(), message->GetBufferSize())) != 0, self->NumberOfRetryAttempts, self->DelayBetweenRetryAttemptsSec);
+    if (retValue == 0)
+    {
+      auto ts = igtl::TimeStamp::New();
+      message->GetTimeStamp(ts);
+      LOG_INFO("Client disconnected - could not send " << message->GetMessageType() << " message to client (device name: " << message->GetDeviceName()
+               << "  Timestamp: " << std::fixed << ts->GetTimeStamp() << ").");
+      // The client is removed by the broadcasting thread when it tries to queue the next message
+      sendQueue->ReportSendFailure();
+      continue;
+    }
+    sendQueue->ReportMessageSent(message->GetBufferSize(), enqueueTime);
+  }
+
+  client->DataSenderActive.second = false;
   return NULL;
 }
 
@@ -1055,20 +1252,45 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
     }
     this->NewClientConnected = false;
 
+    // Clients with the same subscription receive the same messages, so messages are packed (and images are encoded)
+    // only once for each subscription and the same message buffers are sent to all clients of the group.
+    std::map<std::string, std::vector<igtl::MessageBase::Pointer> > packedMessagesBySubscription;
+    std::map<std::string, int> subscriptionEncoderClientIds;
     for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
     {
-      igtl::ClientSocket::Pointer clientSocket = (*clientIterator).ClientSocket;
+      std::string subscriptionKey = clientIterator->ClientInfo.GetSubscriptionKey();
+      std::map<std::string, std::vector<igtl::MessageBase::Pointer> >::iterator packedMessages = packedMessagesBySubscription.find(subscriptionKey);
+      if (packedMessages == packedMessagesBySubscription.end())
+      {
+        // First client with this subscription, create IGT messages
+        packedMessages = packedMessagesBySubscription.insert(std::make_pair(subscriptionKey, std::vector<igtl::MessageBase::Pointer>())).first;
 
-      // Create IGT messages
-      std::vector<igtl::MessageBase::Pointer> igtlMessages;
-      std::vector<igtl::MessageBase::Pointer>::iterator igtlMessageIterator;
+        std::map<std::string, int>::iterator previousEncoderClient = this->SubscriptionEncoderClientIds.find(subscriptionKey);
+        if (previousEncoderClient == this->SubscriptionEncoderClientIds.end() || previousEncoderClient->second != clientIterator->ClientId)
+        {
+          // The encoders of this client did not encode the previous frame of the group, the other clients can only decode a key frame
+          for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStream = clientIterator->ClientInfo.VideoStreams.begin(); videoStream != clientIterator->ClientInfo.VideoStreams.end(); ++videoStream)
+          {
+            if (videoStream->FrameConverter)
+            {
+              videoStream->FrameConverter->RequestKeyFrameOn();
+            }
+          }
+        }
+        subscriptionEncoderClientIds[subscriptionKey] = clientIterator->ClientId;
 
-      if (this->IgtlMessageFactory->PackMessages(clientIterator->ClientId, clientIterator->ClientInfo, igtlMessages, trackedFrame, this->SendValidTransformsOnly, this->TransformRepository) != PLUS_SUCCESS)
-      {
-        LOG_WARNING("Failed to pack all IGT messages");
+        if (this->IgtlMessageFactory->PackMessages(clientIterator->ClientId, clientIterator->ClientInfo, packedMessages->second, trackedFrame, this->SendValidTransformsOnly, this->TransformRepository) != PLUS_SUCCESS)
+        {
+          LOG_WARNING("Failed to pack all IGT messages");
+        }
+        this->NumberOfMessagePackings++;
       }
+      this->NumberOfClientMessageDeliveries++;
 
-      // Send all messages to a client
+      const std::vector<igtl::MessageBase::Pointer>& igtlMessages = packedMessages->second;
+      std::vector<igtl::MessageBase::Pointer>::const_iterator igtlMessageIterator;
+
+      // Queue all messages for sending to the client. The packed messages are not modified after this point, so they can be shared by the send queues.
       for (igtlMessageIterator = igtlMessages.begin(); igtlMessageIterator != igtlMessages.end(); ++igtlMessageIterator)
       {
         igtl::MessageBase::Pointer igtlMessage = (*igtlMessageIterator);
@@ -1077,15 +1299,9 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
           continue;
         }
 
-        int retValue = 0;
-        RETRY_UNTIL_TRUE((retValue = clientSocket->Send(igtlMessage->GetBufferPointer(), igtlMessage->GetBufferSize())) != 0, this->NumberOfRetryAttempts, this->DelayBetweenRetryAttemptsSec);
-        if (retValue == 0)
+        if (this->QueueMessageForSending(*clientIterator, igtlMessage) != PLUS_SUCCESS)
         {
           disconnectedClientIds.push_back(clientIterator->ClientId);
-          auto ts = igtl::TimeStamp::New();
-          igtlMessage->GetTimeStamp(ts);
-          LOG_INFO("Client disconnected - could not send " << igtlMessage->GetMessageType() << " message to client (device name: " << igtlMessage->GetDeviceName()
-                   << "  Timestamp: " << std::fixed << ts->GetTimeStamp() << ").");
           break;
         }
 
@@ -1093,6 +1309,7 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
         clientIterator->ClientInfo.SetLastTDATASentTimeStamp(trackedFrame.GetTimestamp());
       }
     }
+    this->SubscriptionEncoderClientIds.swap(subscriptionEncoderClientIds);
   }
 
   // Clean up disconnected clients
@@ -1110,6 +1327,28 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
 //----------------------------------------------------------------------------
 void vtkPlusOpenIGTLinkServer::DisconnectClient(int clientId)
 {
+  // Clients that are handled by the network reactor are disconnected by the reactor thread
+  bool reactorClient = false;
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+    for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
+    {
+      if (clientIterator->ClientId == clientId)
+      {
+        reactorClient = (clientIterator->SocketDescriptor >= 0);
+        break;
+      }
+    }
+  }
+  if (reactorClient)
+  {
+    if (this->Reactor)
+    {
+      this->Reactor->RequestDisconnect(clientId);
+    }
+    return;
+  }
+
   // Stop the client's data receiver thread
   {
     // Request thread stop
@@ -1121,17 +1360,22 @@ void vtkPlusOpenIGTLinkServer::DisconnectClient(int clientId)
         continue;
       }
       clientIterator->DataReceiverActive.first = false;
+      clientIterator->DataSenderActive.first = false;
+      if (clientIterator->SendQueue)
+      {
+        clientIterator->SendQueue->Close();
+      }
       break;
     }
   }
 
-  // Wait for the thread to stop
-  bool clientDataReceiverThreadStillActive = false;
+  // Wait for the threads to stop
+  bool clientThreadStillActive = false;
   do
   {
-    clientDataReceiverThreadStillActive = false;
+    clientThreadStillActive = false;
     {
-      // check if any of the receiver threads are still active
+      // check if the receiver or sender thread of the client is still active
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
       for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
       {
@@ -1144,7 +1388,7 @@ void vtkPlusOpenIGTLinkServer::DisconnectClient(int clientId)
           if (clientIterator->DataReceiverActive.second)
           {
             // thread still running
-            clientDataReceiverThreadStillActive = true;
+            clientThreadStillActive = true;
           }
           else
           {
@@ -1155,17 +1399,29 @@ void vtkPlusOpenIGTLinkServer::DisconnectClient(int clientId)
             this->Threader->TerminateThread(clientIterator->DataReceiverThreadId);
             clientIterator->DataReceiverThreadId = -1;
           }
-          break;
         }
+        if (clientIterator->DataSenderThreadId >= 0)
+        {
+          if (clientIterator->DataSenderActive.second)
+          {
+            clientThreadStillActive = true;
+          }
+          else
+          {
+            this->Threader->TerminateThread(clientIterator->DataSenderThreadId);
+            clientIterator->DataSenderThreadId = -1;
+          }
+        }
+        break;
       }
     }
-    if (clientDataReceiverThreadStillActive)
+    if (clientThreadStillActive)
     {
       // give some time for the threads to finish
       vtkIGSIOAccurateTimer::DelayWithEventProcessing(0.2);
     }
   }
-  while (clientDataReceiverThreadStillActive);
+  while (clientThreadStillActive);
 
   // Close socket and remove client from the list
   int port = 0;
@@ -1210,18 +1466,10 @@ void vtkPlusOpenIGTLinkServer::KeepAlive()
       replyMsg->SetCode(igtl::StatusMessage::STATUS_OK);
       replyMsg->Pack();
 
-      int retValue = 0;
-      RETRY_UNTIL_TRUE(
-        (retValue = clientIterator->ClientSocket->Send(replyMsg->GetPackPointer(), replyMsg->GetPackSize())) != 0,
-        this->NumberOfRetryAttempts, this->DelayBetweenRetryAttemptsSec);
-      if (retValue == 0)
+      if (this->QueueMessageForSending(*clientIterator, replyMsg.GetPointer()) != PLUS_SUCCESS)
       {
         disconnectedClientIds.push_back(clientIterator->ClientId);
-        auto ts = igtl::TimeStamp::New();
-        replyMsg->GetTimeStamp(ts);
-
-        LOG_DEBUG("Client disconnected - could not send " << replyMsg->GetMessageType() << " message to client (device name: " << replyMsg->GetDeviceName()
-                  << "  Timestamp: " << std::fixed <<  ts->GetTimeStamp() << ").");
+        LOG_DEBUG("Client disconnected - could not send " << replyMsg->GetMessageType() << " message to client (device name: " << replyMsg->GetDeviceName() << ").");
       }
     } // clientIterator
   } // unlock client list
@@ -1257,6 +1505,35 @@ PlusStatus vtkPlusOpenIGTLinkServer::GetClientInfo(unsigned int clientId, PlusIg
   return PLUS_FAIL;
 }
 
+//------------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::GetClientSendQueueStatistics(std::map<int, PlusIgtlClientSendQueue::Statistics>& statistics) const
+{
+  statistics.clear();
+  igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+  for (std::list<ClientData>::const_iterator it = this->IgtlClients.begin(); it != this->IgtlClients.end(); ++it)
+  {
+    if (it->SendQueue)
+    {
+      statistics[it->ClientId] = it->SendQueue->GetStatistics();
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkServer::QueueMessageForSending(ClientData& client, igtl::MessageBase::Pointer message)
+{
+  if (!client.SendQueue || client.SendQueue->HasSendFailed())
+  {
+    return PLUS_FAIL;
+  }
+  if (client.SendQueue->Push(message, PlusIgtlClientSendQueue::GetMessageCategory(message->GetMessageType())) != PLUS_SUCCESS)
+  {
+    LOG_INFO("Client " << client.ClientId << " cannot keep up with the data stream - " << this->ClientSendQueueMaxMessages << " messages are waiting to be sent.");
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
 //------------------------------------------------------------------------------
 PlusStatus vtkPlusOpenIGTLinkServer::ReadConfiguration(vtkXMLDataElement* serverElement, const std::string& aFilename)
 {
@@ -1280,6 +1557,15 @@ PlusStatus vtkPlusOpenIGTLinkServer::ReadConfiguration(vtkXMLDataElement* server
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(SendValidTransformsOnly, serverElement);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(IgtlMessageCrcCheckEnabled, serverElement);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(LogWarningOnNoDataAvailable, serverElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, ClientSendQueueMaxImageMessages, serverElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, ClientSendQueueMaxMessages, serverElement);
+  XML_READ_ENUM3_ATTRIBUTE_OPTIONAL(ClientSendQueueDropPolicy, serverElement,
+                                    "DropOldestImage", PlusIgtlClientSendQueue::DROP_POLICY_OLDEST_IMAGE,
+                                    "DropNewestImage", PlusIgtlClientSendQueue::DROP_POLICY_NEWEST_IMAGE,
+                                    "None", PlusIgtlClientSendQueue::DROP_POLICY_NONE);
+  XML_READ_ENUM2_ATTRIBUTE_OPTIONAL(NetworkingMode, serverElement,
+                                    "ThreadPerClient", NETWORKING_MODE_THREAD_PER_CLIENT,
+                                    "Epoll", NETWORKING_MODE_EPOLL);
 
   this->DefaultClientInfo.IgtlMessageTypes.clear();
   this->DefaultClientInfo.TransformNames.clear();
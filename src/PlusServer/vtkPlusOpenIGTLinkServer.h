@@ -10,6 +10,7 @@
 // Local includes
 #include "vtkPlusServerExport.h"
 #include "PlusIgtlClientInfo.h"
+#include "PlusIgtlClientSendQueue.h"
 #include "vtkPlusDataCollector.h"
 #include "vtkPlusIgtlMessageFactory.h"
 #include "vtkIGSIOTransformRepository.h"
@@ -21,6 +22,7 @@
 
 // STL includes
 #include <deque>
+#include <memory>
 
 // OS includes
 #if (_MSC_VER == 1500)
@@ -29,6 +31,7 @@
 
 // IGTL includes
 #include <igtlMessageBase.h>
+#include <igtlMessageHeader.h>
 #include <igtlServerSocket.h>
 
 //class igsioTrackedFrame; 
@@ -38,6 +41,7 @@ class vtkPlusChannel;
 class vtkPlusCommandProcessor;
 class vtkPlusCommandResponse;
 class vtkIGSIORecursiveCriticalSection;
+class PlusIgtlServerReactor;
 //class vtkIGSIOTransformRepository;
 
 struct ClientData
@@ -45,8 +49,11 @@ struct ClientData
   ClientData()
     : ClientId(-1)
     , ClientSocket(NULL)
+    , SocketDescriptor(-1)
     , DataReceiverActive(std::make_pair(false, false))
     , DataReceiverThreadId(-1)
+    , DataSenderActive(std::make_pair(false, false))
+    , DataSenderThreadId(-1)
     , Server(NULL)
   {
   }
@@ -57,6 +64,9 @@ struct ClientData
   /// IGTL client socket instance
   igtl::ClientSocket::Pointer ClientSocket;
 
+  /// Socket of the client if it is handled by the network reactor (-1 if the client has its own receiver and sender threads)
+  int SocketDescriptor;
+
   /// Client specific timeouts
   uint32_t ClientSocketSendTimeout;
   uint32_t ClientSocketReceiveTimeout;
@@ -65,8 +75,18 @@ struct ClientData
   std::pair<bool, bool> DataReceiverActive;
   int DataReceiverThreadId;
 
+  /// Messages waiting to be sent to the client
+  std::shared_ptr<PlusIgtlClientSendQueue> SendQueue;
+
+  /// Active flag for the thread that sends the queued messages (first: request, second: respond )
+  std::pair<bool, bool> DataSenderActive;
+  int DataSenderThreadId;
+
   PlusIgtlClientInfo ClientInfo;
 
+  /// IDs of recent commands to be able to detect duplicate command IDs
+  std::deque<uint32_t> PreviousCommandIds;
+
   vtkPlusOpenIGTLinkServer* Server;
 };
 
@@ -83,13 +103,30 @@ struct ClientData
   requested image and tracking information in the same format as in the DefaultClientInfo element in the device set
   configuration file.
 
+  Messages are not sent to the clients directly by the broadcasting thread but added to a bounded send queue of each client
+  (see PlusIgtlClientSendQueue), which is processed by a sender thread of the client. A slow client therefore does not delay
+  the other clients. If a client cannot keep up, images are dropped as specified by ClientSendQueueDropPolicy, while other messages
+  are kept until ClientSendQueueMaxMessages is reached, then the client is disconnected.
+
+  By default each client has its own receiver and sender thread. If NetworkingMode is set to Epoll (only available on Linux) then
+  a single network reactor thread accepts connections, receives messages, and sends the queued messages of all clients (see PlusIgtlServerReactor).
+
   \ingroup PlusLibPlusServer
 */
 class vtkPlusServerExport vtkPlusOpenIGTLinkServer: public vtkObject
 {
   typedef std::map<int, std::vector<igtl::MessageBase::Pointer> > ClientIdToMessageListMap;
+  friend class PlusIgtlServerReactor;
 
 public:
+  enum NetworkingModeType
+  {
+    /*! Connection receiver thread, and a receiver and a sender thread for each client */
+    NETWORKING_MODE_THREAD_PER_CLIENT,
+    /*! One event-driven (epoll) network thread for all clients */
+    NETWORKING_MODE_EPOLL
+  };
+
   static vtkPlusOpenIGTLinkServer* New();
   vtkTypeMacro(vtkPlusOpenIGTLinkServer, vtkObject);
   virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
@@ -137,6 +174,35 @@ public:
   /*! Get number of connected clients */
   virtual unsigned int GetNumberOfConnectedClients() const;
 
+  /*! Number of times a set of messages was packed for a tracked frame (once for each group of clients with the same subscription) */
+  vtkGetMacro(NumberOfMessagePackings, unsigned long long);
+  /*! Number of times a set of messages was sent to a client for a tracked frame */
+  vtkGetMacro(NumberOfClientMessageDeliveries, unsigned long long);
+  /*!
+    Average number of clients that a packed set of messages was sent to (deduplication ratio).
+    1.0 means that messages were packed separately for each client.
+  */
+  double GetMessagePackingDeduplicationRatio() const;
+
+  /*! Maximum number of image messages waiting to be sent to a client. If the limit is reached, images are dropped according to the drop policy. */
+  vtkSetMacro(ClientSendQueueMaxImageMessages, int);
+  vtkGetMacroConst(ClientSendQueueMaxImageMessages, int);
+
+  /*! Maximum number of messages waiting to be sent to a client. If the limit is reached, the client is disconnected. */
+  vtkSetMacro(ClientSendQueueMaxMessages, int);
+  vtkGetMacroConst(ClientSendQueueMaxMessages, int);
+
+  /*! Determines which image message is discarded if too many image messages are waiting to be sent to a client */
+  vtkSetMacro(ClientSendQueueDropPolicy, PlusIgtlClientSendQueue::DropPolicy);
+  vtkGetMacroConst(ClientSendQueueDropPolicy, PlusIgtlClientSendQueue::DropPolicy);
+
+  /*! Select how client connections are handled. Takes effect when the server is started. */
+  vtkSetMacro(NetworkingMode, NetworkingModeType);
+  vtkGetMacroConst(NetworkingMode, NetworkingModeType);
+
+  /*! Get the send queue statistics of all connected clients (indexed by client ID) */
+  void GetClientSendQueueStatistics(std::map<int, PlusIgtlClientSendQueue::Statistics>& statistics) const;
+
   /*! Retrieve a COPY of client info for a given clientId
     Locks access to the client info for the duration of the function
     */
@@ -184,7 +250,34 @@ protected:
   /*! Thread for receiving control data from clients */
   static void* DataReceiverThread(vtkMultiThreader::ThreadInfo* data);
 
-  /*! Tracked frame interface, sends the selected message type and data to all clients */
+  /*! Thread for sending the queued messages of a client */
+  static void* ClientDataSenderThread(vtkMultiThreader::ThreadInfo* data);
+
+  /*!
+    Process a message received from a client (update client info, queue commands and replies).
+    Returns PLUS_FAIL if no more messages should be processed from the client.
+  */
+  PlusStatus ProcessClientMessage(ClientData* client, igtl::MessageHeader::Pointer headerMsg, const std::vector<unsigned char>& body);
+
+  /*!
+    Add a new client to the client list and create its send queue. Receiver and sender threads are not started.
+    IgtlClientsMutex must be locked by the caller.
+  */
+  ClientData* AddClient(igtl::ClientSocket::Pointer clientSocket, int socketDescriptor);
+
+  /*! Remove a client from the client list without closing its socket */
+  void RemoveClient(int clientId);
+
+  /*!
+    Add a packed message to the send queue of a client.
+    Returns PLUS_FAIL if the client should be disconnected (sending of a previous message failed or the client cannot keep up).
+  */
+  PlusStatus QueueMessageForSending(ClientData& client, igtl::MessageBase::Pointer message);
+
+  /*!
+    Tracked frame interface, sends the selected message type and data to all clients.
+    Messages are packed once for each group of clients that have the same subscription and the packed messages are sent to all clients of the group.
+  */
   virtual PlusStatus SendTrackedFrame(igsioTrackedFrame& trackedFrame);
 
   /*! Converts a command response to an OpenIGTLink message that can be sent to the client */
@@ -193,7 +286,7 @@ protected:
   /*! Send status message to clients to keep alive the connection */
   virtual void KeepAlive();
 
-  /*! Stops client's data receiving thread, closes the socket, and removes the client from the client list */
+  /*! Stops client's data receiving and sending threads, closes the socket, and removes the client from the client list */
   void DisconnectClient(int clientId);
 
   /*! Set IGTL CRC check flag (0: disabled, 1: enabled) */
@@ -334,6 +427,23 @@ private:
   static const float CLIENT_SOCKET_TIMEOUT_SEC;
 
   bool NewClientConnected;
+
+  /*!
+    Client whose video encoders were used for packing the messages of each subscription in the last frame.
+    The encoders are stateful, so if another client's encoders are used for the group, they have to start with a key frame.
+  */
+  std::map<std::string, int> SubscriptionEncoderClientIds;
+
+  unsigned long long NumberOfMessagePackings;
+  unsigned long long NumberOfClientMessageDeliveries;
+
+  int ClientSendQueueMaxImageMessages;
+  int ClientSendQueueMaxMessages;
+  PlusIgtlClientSendQueue::DropPolicy ClientSendQueueDropPolicy;
+
+  NetworkingModeType NetworkingMode;
+  /*! Event-driven network I/O, only used in NETWORKING_MODE_EPOLL */
+  std::unique_ptr<PlusIgtlServerReactor> Reactor;
 };
 
 #endif
\ No newline at end of file
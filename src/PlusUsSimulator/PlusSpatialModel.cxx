@@ -18,7 +18,8 @@ See License.txt for details.
 #include "vtkProbeFilter.h"
 #include "vtkPointData.h"
 #include "vtkIdList.h"
-#include "vtkTriangle.h"
+
+#include <cstring>
 
 // If fraction of the transmitted beam intensity is smaller then this value then we consider the beam to be completely absorbed
 const double MINIMUM_BEAM_INTENSITY = 1e-9;
@@ -33,6 +34,9 @@ PlusSpatialModel::PlusSpatialModel()
   , ModelFileNeedsUpdate(false)
   , ModelToObjectTransform(vtkMatrix4x4::New())
   , ReferenceToObjectTransform(vtkMatrix4x4::New())
+  , ReferenceToModelTransform(vtkMatrix4x4::New())
+  , ModelToReferenceTransform(vtkMatrix4x4::New())
+  , ReferenceToModelTransformValid(false)
   , ObjectCoordinateFrame("")
   , ImagingFrequencyMhz(5.0)
   , DensityKgPerM3(910)
@@ -44,6 +48,7 @@ PlusSpatialModel::PlusSpatialModel()
   , SurfaceSpecularReflectionCoefficient(0.0)
   , SurfaceDiffuseReflectionCoefficient(0.1)
   , ModelLocalizer(vtkModifiedBSPTree::New())
+  , ModelLocalizerMutex(new std::mutex)
   , PolyData(NULL)
 {
 }
@@ -55,6 +60,8 @@ PlusSpatialModel::~PlusSpatialModel()
   SetReferenceToObjectTransform(NULL);
   SetModelLocalizer(NULL);
   SetPolyData(NULL);
+  this->ReferenceToModelTransform->Delete();
+  this->ModelToReferenceTransform->Delete();
 }
 
 //-----------------------------------------------------------------------------
@@ -75,6 +82,10 @@ PlusSpatialModel::PlusSpatialModel(const PlusSpatialModel& model)
   this->ReferenceToObjectTransform = NULL;
   this->ModelLocalizer = NULL;
   this->PolyData = NULL;
+  this->ReferenceToModelTransform = vtkMatrix4x4::New();
+  this->ModelToReferenceTransform = vtkMatrix4x4::New();
+  this->ReferenceToModelTransformValid = false;
+  this->ModelLocalizerMutex = model.ModelLocalizerMutex;
   SetModelToObjectTransform(model.ModelToObjectTransform);
   SetReferenceToObjectTransform(model.ReferenceToObjectTransform);
   SetModelLocalizer(model.ModelLocalizer);
@@ -98,6 +109,8 @@ void PlusSpatialModel::operator=(const PlusSpatialModel& model)
   this->BackscatterDiffuseReflectionCoefficient = model.BackscatterDiffuseReflectionCoefficient;
   this->SurfaceDiffuseReflectionCoefficient = model.SurfaceDiffuseReflectionCoefficient;
   this->SurfaceSpecularReflectionCoefficient = model.SurfaceSpecularReflectionCoefficient;
+  this->ReferenceToModelTransformValid = false;
+  this->ModelLocalizerMutex = model.ModelLocalizerMutex;
   SetModelToObjectTransform(model.ModelToObjectTransform);
   SetReferenceToObjectTransform(model.ReferenceToObjectTransform);
   SetModelLocalizer(model.ModelLocalizer);
@@ -253,9 +266,8 @@ void PlusSpatialModel::CalculateIntensity(std::vector<double>& reflectedIntensit
   }
 
   // Compute attenuation within this model
-  double intensityAttenuationCoefficientdBPerPixel = this->AttenuationCoefficientDbPerCmMhz * (distanceBetweenScanlineSamplePointsMm / 10.0) * this->ImagingFrequencyMhz;
   // intensityAttenuationCoefficientPerPixel: should be close to 1, as it's the ratio of (transmitted beam intensity / incident beam intensity) after traversing through a single pixel
-  double intensityAttenuationCoefficientPerPixel = pow(10.0, -intensityAttenuationCoefficientdBPerPixel / 10.0);
+  double intensityAttenuationCoefficientPerPixel = GetIntensityAttenuationCoefficientPerPixel(distanceBetweenScanlineSamplePointsMm);
   // intensityAttenuatedFractionPerPixel: how big fraction of the intensity is attenuated during traversing through one voxel
   double intensityAttenuatedFractionPerPixel = (1 - intensityAttenuationCoefficientPerPixel);
   // intensityTransmittedFractionPerPixelTwoWay: how big fraction of the intensity is transmitted during traversing through one voxel; takes into account both propagation directions
@@ -313,11 +325,74 @@ void PlusSpatialModel::CalculateIntensity(std::vector<double>& reflectedIntensit
   // TODO: to simulate beamwidth, take into account the incidence angle and disperse the reflection on a larger area if the angle is large
 }
 
+//-----------------------------------------------------------------------------
+double PlusSpatialModel::GetIntensityAttenuationCoefficientPerPixel(double distanceBetweenScanlineSamplePointsMm)
+{
+  double intensityAttenuationCoefficientdBPerPixel = this->AttenuationCoefficientDbPerCmMhz * (distanceBetweenScanlineSamplePointsMm / 10.0) * this->ImagingFrequencyMhz;
+  return pow(10.0, -intensityAttenuationCoefficientdBPerPixel / 10.0);
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus PlusSpatialModel::PrepareForSimulation(double distanceBetweenScanlineSamplePointsMm, unsigned int numberOfSamplesPerScanline)
+{
+  PlusStatus status = UpdateModelFile();
+
+  UpdateReferenceToModelTransform();
+
+  // Fill the attenuation table for the longest possible segment, so that CalculateIntensity never has to update it
+  double intensityAttenuationCoefficientPerPixel = GetIntensityAttenuationCoefficientPerPixel(distanceBetweenScanlineSamplePointsMm);
+  double intensityTransmittedFractionPerPixelTwoWay = intensityAttenuationCoefficientPerPixel * intensityAttenuationCoefficientPerPixel;
+  if (numberOfSamplesPerScanline > 0
+      && (this->PrecomputedAttenuations.size() < numberOfSamplesPerScanline || intensityTransmittedFractionPerPixelTwoWay != this->PrecomputedAttenuations[0]))
+  {
+    UpdatePrecomputedAttenuations(intensityTransmittedFractionPerPixelTwoWay, numberOfSamplesPerScanline);
+  }
+
+  return status;
+}
+
+//-----------------------------------------------------------------------------
+void PlusSpatialModel::UpdateReferenceToModelTransform()
+{
+  double sourceElements[32] = {0};
+  vtkMatrix4x4::DeepCopy(sourceElements, this->ModelToObjectTransform);
+  vtkMatrix4x4::DeepCopy(sourceElements + 16, this->ReferenceToObjectTransform);
+  if (this->ReferenceToModelTransformValid && memcmp(sourceElements, this->ReferenceToModelTransformSourceElements, sizeof(sourceElements)) == 0)
+  {
+    // the model has not moved since the last update
+    return;
+  }
+  memcpy(this->ReferenceToModelTransformSourceElements, sourceElements, sizeof(sourceElements));
+  this->ReferenceToModelTransformValid = true;
+
+  vtkSmartPointer<vtkMatrix4x4> objectToModelMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(this->ModelToObjectTransform, objectToModelMatrix);
+  vtkMatrix4x4::Multiply4x4(objectToModelMatrix, this->ReferenceToObjectTransform, this->ReferenceToModelTransform);
+  vtkMatrix4x4::Invert(this->ReferenceToModelTransform, this->ModelToReferenceTransform);
+}
+
+//-----------------------------------------------------------------------------
+PlusSpatialModel::LineIntersectionWorkspace::LineIntersectionWorkspace()
+  : IntersectionPoints_Model(vtkSmartPointer<vtkPoints>::New())
+  , IntersectionCellIds(vtkSmartPointer<vtkIdList>::New())
+  , Cell(vtkSmartPointer<vtkGenericCell>::New())
+{
+}
+
 //-----------------------------------------------------------------------------
 void PlusSpatialModel::GetLineIntersections(std::deque<LineIntersectionInfo>& lineIntersections, double* scanLineStartPoint_Reference, double* scanLineEndPoint_Reference)
 {
   UpdateModelFile();
+  UpdateReferenceToModelTransform();
+
+  LineIntersectionWorkspace workspace;
+  GetLineIntersections(lineIntersections, scanLineStartPoint_Reference, scanLineEndPoint_Reference, workspace);
+}
 
+//-----------------------------------------------------------------------------
+void PlusSpatialModel::GetLineIntersections(std::deque<LineIntersectionInfo>& lineIntersections, double* scanLineStartPoint_Reference, double* scanLineEndPoint_Reference,
+    LineIntersectionWorkspace& workspace)
+{
   if (this->ModelFile.empty())
   {
     // no model is defined, which means that the model is everywhere
@@ -345,19 +420,27 @@ void PlusSpatialModel::GetLineIntersections(std::deque<LineIntersectionInfo>& li
     searchLineStartPoint_Reference[i] = scanLineStartPoint_Reference[i] - this->TransducerSpatialModelMaxOverlapMm * scanLineDirectionVector_Reference[i] / scanLineDirectionVectorNorm_Reference;
   }
 
-  vtkSmartPointer<vtkMatrix4x4> objectToModelMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  vtkMatrix4x4::Invert(this->ModelToObjectTransform, objectToModelMatrix);
-  vtkSmartPointer<vtkMatrix4x4> referenceToModelMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  vtkMatrix4x4::Multiply4x4(objectToModelMatrix, this->ReferenceToObjectTransform, referenceToModelMatrix);
+  vtkMatrix4x4* referenceToModelMatrix = this->ReferenceToModelTransform;
+  vtkMatrix4x4* modelToReferenceMatrix = this->ModelToReferenceTransform;
 
   double searchLineStartPoint_Model[4] = {0, 0, 0, 1};
   double scanLineEndPoint_Model[4] = {0, 0, 0, 1};
   referenceToModelMatrix->MultiplyPoint(searchLineStartPoint_Reference, searchLineStartPoint_Model);
   referenceToModelMatrix->MultiplyPoint(scanLineEndPoint_Reference, scanLineEndPoint_Model);
 
-  vtkSmartPointer<vtkPoints> intersectionPoints_Model = vtkSmartPointer<vtkPoints>::New();
-  vtkSmartPointer<vtkIdList> intersectionCellIds = vtkSmartPointer<vtkIdList>::New();
-  this->ModelLocalizer->IntersectWithLine(searchLineStartPoint_Model, scanLineEndPoint_Model, 0.0, intersectionPoints_Model, intersectionCellIds);
+  vtkPoints* intersectionPoints_Model = workspace.IntersectionPoints_Model;
+  vtkIdList* intersectionCellIds = workspace.IntersectionCellIds;
+  intersectionPoints_Model->Reset();
+  intersectionCellIds->Reset();
+#if VTK_MAJOR_VERSION > 9 || (VTK_MAJOR_VERSION == 9 && VTK_MINOR_VERSION >= 2)
+  this->ModelLocalizer->IntersectWithLine(searchLineStartPoint_Model, scanLineEndPoint_Model, 0.0, intersectionPoints_Model, intersectionCellIds, workspace.Cell);
+#else
+  {
+    // Older VTK versions use a cell stored in the locator, so concurrent queries are not allowed
+    std::lock_guard<std::mutex> modelLocalizerLock(*this->ModelLocalizerMutex);
+    this->ModelLocalizer->IntersectWithLine(searchLineStartPoint_Model, scanLineEndPoint_Model, 0.0, intersectionPoints_Model, intersectionCellIds);
+  }
+#endif
 
   if (intersectionPoints_Model->GetNumberOfPoints() < 1)
   {
@@ -365,9 +448,6 @@ void PlusSpatialModel::GetLineIntersections(std::deque<LineIntersectionInfo>& li
     return;
   }
 
-  vtkSmartPointer<vtkMatrix4x4> modelToReferenceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  vtkMatrix4x4::Invert(referenceToModelMatrix, modelToReferenceMatrix);
-
   // Measure the distance from the starting point in the reference coordinate system
   double intersectionPoint_Model[4] = {0, 0, 0, 1};
   double intersectionPoint_Reference[4] = {0, 0, 0, 1};
@@ -416,8 +496,9 @@ void PlusSpatialModel::GetLineIntersections(std::deque<LineIntersectionInfo>& li
     intersectionPoints_Model->GetPoint(intersectionPointIndex, intersectionPoint_Model);
     modelToReferenceMatrix->MultiplyPoint(intersectionPoint_Model, intersectionPoint_Reference);
     intersectionInfo.IntersectionDistanceFromStartPointMm = sqrt(vtkMath::Distance2BetweenPoints(scanLineStartPoint_Reference, intersectionPoint_Reference));
-    vtkTriangle* cell = vtkTriangle::SafeDownCast(this->PolyData->GetCell(intersectionCellIds->GetId(intersectionPointIndex)));
-    if (cell != NULL && normals_Model != NULL)
+    vtkGenericCell* cell = workspace.Cell;
+    this->PolyData->GetCell(intersectionCellIds->GetId(intersectionPointIndex), cell);
+    if (cell->GetCellType() == VTK_TRIANGLE && normals_Model != NULL)
     {
       const int NUMBER_OF_POINTS_PER_CELL = 3; // triangle cell
       double pcoords[NUMBER_OF_POINTS_PER_CELL] = {0, 0, 0};
@@ -429,12 +510,8 @@ void PlusSpatialModel::GetLineIntersections(std::deque<LineIntersectionInfo>& li
       double interpolatedNormal_Model[3] = {0, 0, 0};
       for (int pointIndex = 0; pointIndex < NUMBER_OF_POINTS_PER_CELL; pointIndex++)
       {
-        double* normalAtCellCorner = normals_Model->GetTuple3(cell->GetPointId(pointIndex));
-        if (normalAtCellCorner == NULL)
-        {
-          LOG_ERROR("SpatialModel::GetLineIntersections error: invalid normal");
-          continue;
-        }
+        double normalAtCellCorner[3] = {0, 0, 0};
+        normals_Model->GetTuple(cell->GetPointId(pointIndex), normalAtCellCorner);
         interpolatedNormal_Model[0] += normalAtCellCorner[0] * weights[pointIndex];
         interpolatedNormal_Model[1] += normalAtCellCorner[1] * weights[pointIndex];
         interpolatedNormal_Model[2] += normalAtCellCorner[2] * weights[pointIndex];
@@ -511,6 +588,8 @@ PlusStatus PlusSpatialModel::UpdateModelFile()
   polyDataNormalsComputer->Update();
   this->PolyData = polyDataNormalsComputer->GetOutput();
   this->PolyData->Register(NULL);
+  // Build the cell structure now, as GetCell would build it on first use, which is not allowed during concurrent line intersection queries
+  this->PolyData->BuildCells();
 
   this->ModelLocalizer->SetDataSet(this->PolyData);
   this->ModelLocalizer->SetMaxLevel(24);
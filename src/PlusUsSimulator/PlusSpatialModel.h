@@ -7,10 +7,17 @@
 #define __SpatialModel_h
 
 #include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "vtkPlusUsSimulatorExport.h"
 
+#include "vtkGenericCell.h"
+#include "vtkIdList.h"
+#include "vtkPoints.h"
+#include "vtkSmartPointer.h"
+
 class vtkMatrix4x4;
 class vtkModifiedBSPTree;
 class vtkPolyData;
@@ -38,6 +45,18 @@ public:
     double IntersectionIncidenceAngleRad;
   };
 
+  /*!
+    Buffers that GetLineIntersections uses for computing the intersections of one line.
+    Each thread that computes line intersections must use its own workspace.
+  */
+  struct vtkPlusUsSimulatorExport LineIntersectionWorkspace
+  {
+    LineIntersectionWorkspace();
+    vtkSmartPointer<vtkPoints> IntersectionPoints_Model;
+    vtkSmartPointer<vtkIdList> IntersectionCellIds;
+    vtkSmartPointer<vtkGenericCell> Cell;
+  };
+
   PlusSpatialModel();
   virtual ~PlusSpatialModel();
 
@@ -72,6 +91,23 @@ public:
   */
   void GetLineIntersections(std::deque<LineIntersectionInfo>& lineIntersections, double* scanLineStartPoint_Reference, double* scanLineEndPoint_Reference);
 
+  /*!
+    Get all the intersection points of the model and a line, using the provided buffers.
+    This method may be called from multiple threads at the same time (each thread with its own workspace),
+    but PrepareForSimulation must be called before, from a single thread.
+  */
+  void GetLineIntersections(std::deque<LineIntersectionInfo>& lineIntersections, double* scanLineStartPoint_Reference, double* scanLineEndPoint_Reference,
+                            LineIntersectionWorkspace& workspace);
+
+  /*!
+    Load the model file (and build its locator) if needed and update the reference to model transform and the precomputed attenuations
+    for scanlines of the specified length. The reference to model transform is only recomputed if the model to object or reference to
+    object transform has changed since the previous call.
+    After this call GetLineIntersections (with a workspace) and CalculateIntensity (with at most numberOfSamplesPerScanline pixels) do not modify
+    the model, therefore they can be called from multiple threads.
+  */
+  PlusStatus PrepareForSimulation(double distanceBetweenScanlineSamplePointsMm, unsigned int numberOfSamplesPerScanline);
+
   double GetAcousticImpedanceMegarayls();
 
   /*!
@@ -100,6 +136,10 @@ protected:
 
   PlusStatus UpdateModelFile();
   void UpdatePrecomputedAttenuations(double intensityTransmittedFractionPerPixelTwoWay, int numberOfElements);
+  /*! Recompute ReferenceToModelTransform and ModelToReferenceTransform if the model to object or reference to object transform has changed */
+  void UpdateReferenceToModelTransform();
+  /*! Ratio of transmitted beam intensity / incident beam intensity after traversing through a single pixel */
+  double GetIntensityAttenuationCoefficientPerPixel(double distanceBetweenScanlineSamplePointsMm);
 
 protected:
   //PlusStatus LoadModel(const std::string& absoluteImagePath);
@@ -126,6 +166,19 @@ protected:
   */
   vtkMatrix4x4* ReferenceToObjectTransform;
 
+  /*!
+    Transformation matrix from the reference coordinate system to the model coordinate system and its inverse.
+    Computed from ModelToObjectTransform and ReferenceToObjectTransform by UpdateReferenceToModelTransform.
+  */
+  vtkMatrix4x4* ReferenceToModelTransform;
+  vtkMatrix4x4* ModelToReferenceTransform;
+
+  /*! Model to object and reference to object matrix elements that ReferenceToModelTransform is computed from */
+  double ReferenceToModelTransformSourceElements[32];
+
+  /*! It is true if ReferenceToModelTransformSourceElements contains valid values */
+  bool ReferenceToModelTransformValid;
+
   /*! This variable defines the name of the spatial object's coordinate frame */
   std::string ObjectCoordinateFrame;
 
@@ -186,6 +239,9 @@ protected:
 
   vtkModifiedBSPTree* ModelLocalizer;
 
+  /*! Serializes the queries of ModelLocalizer if the VTK version does not support concurrent queries. Shared between the copies of the model. */
+  std::shared_ptr<std::mutex> ModelLocalizerMutex;
+
   /*! Surface mesh. Points are stored in the Model coordinate system (as in the input file) */
   vtkPolyData* PolyData;
 
@@ -0,0 +1,245 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+\file vtkUsSimulatorAlgoBenchmark.cxx
+\brief Measures the frame rate of vtkPlusUsSimulatorAlgo for different number of scanlines and spatial models,
+using a single thread and multiple threads.
+
+The scene contains a background model and sphere models, that are written to the output directory.
+The probe moves between frames while the models remain static. The test fails if the images simulated on
+multiple threads differ from the images simulated on a single thread.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkIGSIOAccurateTimer.h"
+#include "vtkIGSIOTransformRepository.h"
+#include "vtkPlusUsSimulatorAlgo.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSTLWriter.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  const double IMAGE_SPACING_MM = 0.2;
+  const double IMAGING_DEPTH_MM = 60.0;
+  const double TRANSDUCER_WIDTH_MM = 40.0;
+
+  //-----------------------------------------------------------------------------
+  // Writes sphere models that are placed in the imaged region and returns their file names
+  PlusStatus WriteSphereModels(int numberOfSphereModels, std::vector<std::string>& modelFileNames)
+  {
+    modelFileNames.clear();
+    for (int modelIndex = 0; modelIndex < numberOfSphereModels; ++modelIndex)
+    {
+      vtkSmartPointer<vtkSphereSource> sphere = vtkSmartPointer<vtkSphereSource>::New();
+      sphere->SetCenter(8.0 + (modelIndex % 3) * 12.0, 12.0 + (modelIndex / 3) * 14.0, 0.0);
+      sphere->SetRadius(4.0 + (modelIndex % 2) * 1.5);
+      sphere->SetThetaResolution(48);
+      sphere->SetPhiResolution(48);
+
+      std::ostringstream fileName;
+      fileName << "UsSimulatorBenchmarkSphere" << modelIndex << ".stl";
+      std::string modelFileName = vtkPlusConfig::GetInstance()->GetOutputPath(fileName.str());
+      vtkSmartPointer<vtkSTLWriter> writer = vtkSmartPointer<vtkSTLWriter>::New();
+      writer->SetFileName(modelFileName.c_str());
+      writer->SetInputConnection(sphere->GetOutputPort());
+      if (writer->Write() == 0)
+      {
+        LOG_ERROR("Failed to write model file " << modelFileName);
+        return PLUS_FAIL;
+      }
+      modelFileNames.push_back(modelFileName);
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //-----------------------------------------------------------------------------
+  vtkSmartPointer<vtkXMLDataElement> CreateSimulatorConfiguration(int numberOfScanlines, const std::vector<std::string>& modelFileNames)
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration>" << std::endl
+           << "  <vtkPlusUsSimulatorAlgo ImageCoordinateFrame=\"Image\" ReferenceCoordinateFrame=\"Reference\""
+           << " NumberOfScanlines=\"" << numberOfScanlines << "\" NumberOfSamplesPerScanline=\"" << static_cast<int>(IMAGING_DEPTH_MM / IMAGE_SPACING_MM) << "\""
+           << " IncomingIntensityMwPerCm2=\"30\" BrightnessConversionGamma=\"0.2\" BrightnessConversionOffset=\"0\" BrightnessConversionScale=\"30\""
+           << " NoiseAmplitude=\"10\" NoiseFrequency=\"2.5 3.5 1.5\" NoisePhase=\"0 0 0\">" << std::endl
+           << "    <RfProcessing>" << std::endl
+           << "      <ScanConversion TransducerName=\"Benchmark\" TransducerGeometry=\"LINEAR\""
+           << " ImagingDepthMm=\"" << IMAGING_DEPTH_MM << "\" TransducerWidthMm=\"" << TRANSDUCER_WIDTH_MM << "\""
+           << " OutputImageSizePixel=\"" << static_cast<int>(TRANSDUCER_WIDTH_MM / IMAGE_SPACING_MM) << " " << static_cast<int>(IMAGING_DEPTH_MM / IMAGE_SPACING_MM) << "\""
+           << " OutputImageSpacingMmPerPixel=\"" << IMAGE_SPACING_MM << " " << IMAGE_SPACING_MM << "\" />" << std::endl
+           << "    </RfProcessing>" << std::endl
+           << "    <SpatialModel Name=\"Background\" DensityKgPerM3=\"910\" SoundVelocityMPerSec=\"1540\" AttenuationCoefficientDbPerCmMhz=\"0.65\""
+           << " SurfaceReflectionIntensityDecayDbPerMm=\"20\" BackscatterDiffuseReflectionCoefficient=\"0.1\" />" << std::endl;
+    for (unsigned int modelIndex = 0; modelIndex < modelFileNames.size(); ++modelIndex)
+    {
+      config << "    <SpatialModel Name=\"Sphere" << modelIndex << "\" ModelFile=\"" << modelFileNames[modelIndex] << "\""
+             << " DensityKgPerM3=\"1800\" SoundVelocityMPerSec=\"4080\" AttenuationCoefficientDbPerCmMhz=\"7.0\""
+             << " SurfaceReflectionIntensityDecayDbPerMm=\"10\" BackscatterDiffuseReflectionCoefficient=\"0.05\" SurfaceDiffuseReflectionCoefficient=\"0.1\" />" << std::endl;
+    }
+    config << "  </vtkPlusUsSimulatorAlgo>" << std::endl
+           << "</PlusConfiguration>" << std::endl;
+    return vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(config.str().c_str()));
+  }
+
+  //-----------------------------------------------------------------------------
+  // Simulates the frames and returns the achieved frame rate. The simulated images are appended to simulatedPixels.
+  double SimulateFrames(vtkXMLDataElement* config, int numberOfThreads, int numberOfFrames, std::vector<unsigned char>& simulatedPixels, int& numberOfErrors)
+  {
+    vtkSmartPointer<vtkIGSIOTransformRepository> transformRepository = vtkSmartPointer<vtkIGSIOTransformRepository>::New();
+    vtkSmartPointer<vtkPlusUsSimulatorAlgo> usSimulator = vtkSmartPointer<vtkPlusUsSimulatorAlgo>::New();
+    if (usSimulator->ReadConfiguration(config) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read US simulator configuration");
+      numberOfErrors++;
+      return 0;
+    }
+    usSimulator->SetTransformRepository(transformRepository);
+    usSimulator->SetNumberOfThreads(numberOfThreads);
+
+    igsioTransformName imageToReferenceTransformName("Image", "Reference");
+    vtkSmartPointer<vtkMatrix4x4> imageToReferenceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    imageToReferenceMatrix->SetElement(0, 0, IMAGE_SPACING_MM);
+    imageToReferenceMatrix->SetElement(1, 1, IMAGE_SPACING_MM);
+    imageToReferenceMatrix->SetElement(2, 2, IMAGE_SPACING_MM);
+
+    simulatedPixels.clear();
+    double elapsedTimeSec = 0;
+    // The first frame is not included in the frame rate, as the model locators are built for the first frame
+    for (int frameIndex = -1; frameIndex < numberOfFrames; frameIndex++)
+    {
+      // Move the probe, the models remain static
+      imageToReferenceMatrix->SetElement(0, 3, -1.0 + 0.1 * frameIndex);
+      imageToReferenceMatrix->SetElement(2, 3, -0.5 + 0.05 * frameIndex);
+      transformRepository->SetTransform(imageToReferenceTransformName, imageToReferenceMatrix);
+
+      double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      usSimulator->Modified();
+      usSimulator->Update();
+      if (frameIndex >= 0)
+      {
+        elapsedTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+      }
+
+      vtkImageData* simulatedImage = usSimulator->GetOutput();
+      int* dims = simulatedImage->GetDimensions();
+      const unsigned char* pixels = static_cast<unsigned char*>(simulatedImage->GetScalarPointer());
+      if (pixels == NULL || simulatedImage->GetScalarType() != VTK_UNSIGNED_CHAR)
+      {
+        LOG_ERROR("Simulator output image is invalid");
+        numberOfErrors++;
+        return 0;
+      }
+      simulatedPixels.insert(simulatedPixels.end(), pixels, pixels + dims[0] * dims[1] * dims[2]);
+    }
+    return numberOfFrames / std::max(elapsedTimeSec, 1e-6);
+  }
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+  int numberOfFrames = 20;
+  int maxNumberOfSphereModels = 6;
+  int numberOfThreads = 0;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  args.AddArgument("--number-of-frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of simulated frames in each measurement (default: 20)");
+  args.AddArgument("--max-number-of-sphere-models", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxNumberOfSphereModels, "Maximum number of sphere models in the scene, in addition to the background (default: 6)");
+  args.AddArgument("--number-of-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of threads of the multithreaded measurement. If 0 then the number of hardware threads is used (default: 0)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (numberOfThreads <= 0)
+  {
+    numberOfThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  std::vector<std::string> allModelFileNames;
+  if (WriteSphereModels(maxNumberOfSphereModels, allModelFileNames) != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  int numberOfErrors(0);
+  const int numberOfScanlinesList[] = {64, 128, 256};
+  LOG_INFO("Simulating " << numberOfFrames << " frames, multithreaded measurement uses " << numberOfThreads << " threads");
+  LOG_INFO("Scanlines | Models | 1 thread (frames/s) | N threads (frames/s) | Speedup");
+  for (unsigned int scanlinesIndex = 0; scanlinesIndex < sizeof(numberOfScanlinesList) / sizeof(numberOfScanlinesList[0]); ++scanlinesIndex)
+  {
+    int numberOfScanlines = numberOfScanlinesList[scanlinesIndex];
+    for (int numberOfSphereModels = 0; numberOfSphereModels <= maxNumberOfSphereModels; ++numberOfSphereModels)
+    {
+      std::vector<std::string> modelFileNames(allModelFileNames.begin(), allModelFileNames.begin() + numberOfSphereModels);
+      vtkSmartPointer<vtkXMLDataElement> config = CreateSimulatorConfiguration(numberOfScanlines, modelFileNames);
+      if (config == NULL)
+      {
+        LOG_ERROR("Failed to create US simulator configuration");
+        return EXIT_FAILURE;
+      }
+
+      std::vector<unsigned char> singleThreadedPixels;
+      std::vector<unsigned char> multiThreadedPixels;
+      double singleThreadedFrameRate = SimulateFrames(config, 1, numberOfFrames, singleThreadedPixels, numberOfErrors);
+      double multiThreadedFrameRate = SimulateFrames(config, numberOfThreads, numberOfFrames, multiThreadedPixels, numberOfErrors);
+      if (singleThreadedPixels.size() != multiThreadedPixels.size()
+          || (!singleThreadedPixels.empty() && memcmp(&singleThreadedPixels[0], &multiThreadedPixels[0], singleThreadedPixels.size()) != 0))
+      {
+        LOG_ERROR("Images simulated on " << numberOfThreads << " threads differ from the images simulated on a single thread ("
+                  << numberOfScanlines << " scanlines, " << numberOfSphereModels + 1 << " models)");
+        numberOfErrors++;
+      }
+
+      std::ostringstream row;
+      row << std::setw(9) << numberOfScanlines << " | " << std::setw(6) << numberOfSphereModels + 1
+          << " | " << std::setw(19) << std::fixed << std::setprecision(1) << singleThreadedFrameRate
+          << " | " << std::setw(20) << multiThreadedFrameRate
+          << " | " << std::setprecision(2) << multiThreadedFrameRate / std::max(singleThreadedFrameRate, 1e-6);
+      LOG_INFO(row.str());
+    }
+  }
+
+  if (numberOfErrors != 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully!");
+  return EXIT_SUCCESS;
+}
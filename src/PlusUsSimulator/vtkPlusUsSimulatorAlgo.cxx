@@ -7,9 +7,13 @@ See License.txt for details.
 #include "PlusConfigure.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <list>
 #include <map>
+#include <vector>
 
+#include "PlusThreadPool.h"
 #include "vtkPlusUsSimulatorAlgo.h"
 
 #include "vtkImageAlgorithm.h"
@@ -69,6 +73,8 @@ vtkPlusUsSimulatorAlgo::vtkPlusUsSimulatorAlgo()
   this->NoisePhase[1] = 0;
   this->NoisePhase[2] = 0;
 
+  this->NumberOfThreads = 0;
+
   // this->TransducerSpatialModel doesn't have to be initialized, as the default parameters of SpatialModel
   // are for soft tissue that should match the transducer material in acoustic impedance
 }
@@ -90,6 +96,7 @@ vtkPlusUsSimulatorAlgo::~vtkPlusUsSimulatorAlgo()
 void vtkPlusUsSimulatorAlgo::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << std::endl;
 }
 
 //-----------------------------------------------------------------------------
@@ -133,9 +140,7 @@ int vtkPlusUsSimulatorAlgo::RequestData(vtkInformation* request, vtkInformationV
   vtkSmartPointer<vtkImageData> scanLines = vtkSmartPointer<vtkImageData>::New(); // image data containing the scanlines in rows (FM orientation)
   scanLines->SetExtent(0, this->NumberOfSamplesPerScanline - 1, 0, this->NumberOfScanlines - 1, 0, 0);
   scanLines->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
-
-  // Create BSPTree for fast scanline-model intersection computation
-  vtkSmartPointer<vtkPoints> scanLineIntersectionWithModel = vtkSmartPointer<vtkPoints>::New();
+  unsigned char* scanLinesPixels = static_cast<unsigned char*>(scanLines->GetScalarPointer());
 
   vtkPlusUsScanConvert* scanConverter = this->RfProcessor->GetScanConverter();
   if (scanConverter == NULL)
@@ -153,12 +158,9 @@ int vtkPlusUsSimulatorAlgo::RequestData(vtkInformation* request, vtkInformationV
   double distanceBetweenScanlineSamplePointsMm = scanConverter->GetDistanceBetweenScanlineSamplePointsMm();
 
   // Initialize noise generator
-  vtkSmartPointer<vtkLineSource> noiseSamplerLine_Reference = vtkSmartPointer<vtkLineSource>::New();
   vtkSmartPointer<vtkPerlinNoise> noiseFunction = vtkSmartPointer<vtkPerlinNoise>::New();
-  double samplePointPosition_Reference[3] = {0, 0, 0};
   if (this->NoiseAmplitude > 0)
   {
-    noiseSamplerLine_Reference->SetResolution(this->NumberOfSamplesPerScanline - 1);
     noiseFunction->SetAmplitude(this->NoiseAmplitude);
     noiseFunction->SetFrequency(this->NoiseFrequency);
     noiseFunction->SetPhase(this->NoisePhase);
@@ -183,18 +185,6 @@ int vtkPlusUsSimulatorAlgo::RequestData(vtkInformation* request, vtkInformationV
 
     return 0;
   }
-  vtkSmartPointer<vtkMatrix4x4> referenceToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  vtkMatrix4x4::Invert(imageToReferenceMatrix, referenceToImageMatrix);
-
-  // Create a few variables outside the loop to avoid reallocations and to make the code easier to read
-  vtkPoints* samplePointPositions_Reference = 0;
-  // Create a buffer outside the for loop to allow reusing it
-  std::vector<double> intensities;
-  // scanline start/end positions in Image and Reference coordinate systems
-  double scanLineStartPoint_Image[4] = {0, 0, 0, 1};
-  double scanLineEndPoint_Image[4] = {0, 0, 0, 1};
-  double scanLineStartPoint_Reference[4] = {0, 0, 0, 1};
-  double scanLineEndPoint_Reference[4] = {0, 0, 0, 1};
 
   for (std::vector<PlusSpatialModel>::iterator spatialModelIt = this->SpatialModels.begin(); spatialModelIt != this->SpatialModels.end(); ++spatialModelIt)
   {
@@ -210,107 +200,141 @@ int vtkPlusUsSimulatorAlgo::RequestData(vtkInformation* request, vtkInformationV
       }
     }
     spatialModelIt->SetReferenceToObjectTransform(referenceToObjectMatrix);
+    // Models are loaded and their transforms are updated here, so that the scanlines can be computed concurrently.
+    // Model locators are only built once and the transforms are only recomputed if the model has moved.
+    spatialModelIt->PrepareForSimulation(distanceBetweenScanlineSamplePointsMm, this->NumberOfSamplesPerScanline);
   }
 
+  // Compute scanline start/end positions in the Reference coordinate system (4 start point and 4 end point coordinates for each scanline)
+  std::vector<double> scanLineEndPoints_Reference(this->NumberOfScanlines * 8);
+  double scanLineStartPoint_Image[4] = {0, 0, 0, 1};
+  double scanLineEndPoint_Image[4] = {0, 0, 0, 1};
   for (int scanLineIndex = 0; scanLineIndex < this->NumberOfScanlines; scanLineIndex++)
   {
     scanConverter->GetScanLineEndPoints(scanLineIndex, scanLineStartPoint_Image, scanLineEndPoint_Image);
-    imageToReferenceMatrix->MultiplyPoint(scanLineStartPoint_Image, scanLineStartPoint_Reference);
-    imageToReferenceMatrix->MultiplyPoint(scanLineEndPoint_Image, scanLineEndPoint_Reference);
+    imageToReferenceMatrix->MultiplyPoint(scanLineStartPoint_Image, &scanLineEndPoints_Reference[scanLineIndex * 8]);
+    imageToReferenceMatrix->MultiplyPoint(scanLineEndPoint_Image, &scanLineEndPoints_Reference[scanLineIndex * 8 + 4]);
+  }
 
+  std::atomic<bool> scanLineWithoutIntersection(false);
+  PlusThreadPool::ParallelFor(0, this->NumberOfScanlines, this->NumberOfThreads, [&](int firstScanLine, int endScanLine)
+  {
+    // Buffers are created for each thread and reused for all the scanlines of the thread
+    PlusSpatialModel::LineIntersectionWorkspace intersectionWorkspace;
+    std::deque<PlusSpatialModel::LineIntersectionInfo> lineIntersectionsWithModels;
+    std::vector<double> intensities;
+    vtkSmartPointer<vtkLineSource> noiseSamplerLine_Reference = vtkSmartPointer<vtkLineSource>::New();
+    vtkPoints* samplePointPositions_Reference = NULL;
+    double samplePointPosition_Reference[3] = {0, 0, 0};
     if (this->NoiseAmplitude > 0)
     {
-      noiseSamplerLine_Reference->SetPoint1(scanLineStartPoint_Reference);
-      noiseSamplerLine_Reference->SetPoint2(scanLineEndPoint_Reference);
-      noiseSamplerLine_Reference->Update();
-      samplePointPositions_Reference = noiseSamplerLine_Reference->GetOutput()->GetPoints();
+      noiseSamplerLine_Reference->SetResolution(this->NumberOfSamplesPerScanline - 1);
     }
 
-    // Get model intersection positions along the scanline for all the models
-    std::deque<PlusSpatialModel::LineIntersectionInfo> lineIntersectionsWithModels;
-    for (std::vector<PlusSpatialModel>::iterator spatialModelIt = this->SpatialModels.begin(); spatialModelIt != this->SpatialModels.end(); ++spatialModelIt)
+    for (int scanLineIndex = firstScanLine; scanLineIndex < endScanLine; scanLineIndex++)
     {
-      // Append line intersections found with this model to lineIntersectionsWithModels
-      spatialModelIt->GetLineIntersections(lineIntersectionsWithModels, scanLineStartPoint_Reference, scanLineEndPoint_Reference);
-    }
-
-    ConvertLineModelIntersectionsToSegmentDescriptor(lineIntersectionsWithModels);
+      double* scanLineStartPoint_Reference = &scanLineEndPoints_Reference[scanLineIndex * 8];
+      double* scanLineEndPoint_Reference = &scanLineEndPoints_Reference[scanLineIndex * 8 + 4];
 
-    int currentPixelIndex = 0;
-    int scanLineExtent[6] = {0, this->NumberOfSamplesPerScanline - 1, scanLineIndex, scanLineIndex, 0, 0};
-    unsigned char* dstPixelAddress = (unsigned char*)scanLines->GetScalarPointerForExtent(scanLineExtent);
-    double incomingBeamIntensity = this->IncomingIntensityMwPerCm2 * 1000;
-    int numIntersectionPoints = lineIntersectionsWithModels.size();
-    if (numIntersectionPoints < 1)
-    {
-      LOG_ERROR("No intersections with any SpatialObjects. Probably no background object is specified.");
-      return 0;
-    }
-    PlusSpatialModel* previousModel = &this->TransducerSpatialModel;
-    for (vtkIdType intersectionIndex = 0; (intersectionIndex <= numIntersectionPoints) && (currentPixelIndex < this->NumberOfSamplesPerScanline); intersectionIndex++)
-    {
-      // determine end of segment position and pixel color
-      int endOfSegmentPixelIndex = currentPixelIndex;
-      double distanceOfIntersectionPointFromScanLineStartPointMm = 0; // defined here to allow for access later on in code
-      if (intersectionIndex + 1 < numIntersectionPoints)
-      {
-        distanceOfIntersectionPointFromScanLineStartPointMm = lineIntersectionsWithModels[intersectionIndex + 1].IntersectionDistanceFromStartPointMm;
-        endOfSegmentPixelIndex = distanceOfIntersectionPointFromScanLineStartPointMm / distanceBetweenScanlineSamplePointsMm;
-        if (endOfSegmentPixelIndex > this->NumberOfSamplesPerScanline)
-        {
-          // the next intersection point is out of the image
-          endOfSegmentPixelIndex = this->NumberOfSamplesPerScanline;
-        }
-      }
-      else
+      if (this->NoiseAmplitude > 0)
       {
-        // last segment, after all the intersection points
-        endOfSegmentPixelIndex = this->NumberOfSamplesPerScanline;
+        noiseSamplerLine_Reference->SetPoint1(scanLineStartPoint_Reference);
+        noiseSamplerLine_Reference->SetPoint2(scanLineEndPoint_Reference);
+        noiseSamplerLine_Reference->Update();
+        samplePointPositions_Reference = noiseSamplerLine_Reference->GetOutput()->GetPoints();
       }
 
-      int numberOfFilledPixels = endOfSegmentPixelIndex - currentPixelIndex;
-      if (numberOfFilledPixels < 1)
+      // Get model intersection positions along the scanline for all the models
+      lineIntersectionsWithModels.clear();
+      for (std::vector<PlusSpatialModel>::iterator spatialModelIt = this->SpatialModels.begin(); spatialModelIt != this->SpatialModels.end(); ++spatialModelIt)
       {
-        continue;
+        // Append line intersections found with this model to lineIntersectionsWithModels
+        spatialModelIt->GetLineIntersections(lineIntersectionsWithModels, scanLineStartPoint_Reference, scanLineEndPoint_Reference, intersectionWorkspace);
       }
 
-      PlusSpatialModel* currentModel = NULL;
-      if (intersectionIndex < numIntersectionPoints)
+      ConvertLineModelIntersectionsToSegmentDescriptor(lineIntersectionsWithModels);
+
+      int currentPixelIndex = 0;
+      unsigned char* dstPixelAddress = scanLinesPixels + scanLineIndex * this->NumberOfSamplesPerScanline;
+      double incomingBeamIntensity = this->IncomingIntensityMwPerCm2 * 1000;
+      int numIntersectionPoints = lineIntersectionsWithModels.size();
+      if (numIntersectionPoints < 1)
       {
-        currentModel = lineIntersectionsWithModels[intersectionIndex].Model;
+        scanLineWithoutIntersection = true;
+        return;
       }
-      else
+      PlusSpatialModel* previousModel = &this->TransducerSpatialModel;
+      for (vtkIdType intersectionIndex = 0; (intersectionIndex <= numIntersectionPoints) && (currentPixelIndex < this->NumberOfSamplesPerScanline); intersectionIndex++)
       {
-        // the segment after the last intersection point is assumed to belong to the model of the last intersection
-        currentModel = lineIntersectionsWithModels[numIntersectionPoints - 1].Model;
-      }
+        // determine end of segment position and pixel color
+        int endOfSegmentPixelIndex = currentPixelIndex;
+        double distanceOfIntersectionPointFromScanLineStartPointMm = 0; // defined here to allow for access later on in code
+        if (intersectionIndex + 1 < numIntersectionPoints)
+        {
+          distanceOfIntersectionPointFromScanLineStartPointMm = lineIntersectionsWithModels[intersectionIndex + 1].IntersectionDistanceFromStartPointMm;
+          endOfSegmentPixelIndex = distanceOfIntersectionPointFromScanLineStartPointMm / distanceBetweenScanlineSamplePointsMm;
+          if (endOfSegmentPixelIndex > this->NumberOfSamplesPerScanline)
+          {
+            // the next intersection point is out of the image
+            endOfSegmentPixelIndex = this->NumberOfSamplesPerScanline;
+          }
+        }
+        else
+        {
+          // last segment, after all the intersection points
+          endOfSegmentPixelIndex = this->NumberOfSamplesPerScanline;
+        }
 
-      double outgoingBeamIntensity = 0;
-      currentModel->CalculateIntensity(intensities, numberOfFilledPixels, distanceBetweenScanlineSamplePointsMm, previousModel->GetAcousticImpedanceMegarayls(), incomingBeamIntensity, outgoingBeamIntensity, lineIntersectionsWithModels[intersectionIndex].IntersectionIncidenceAngleRad);
-      previousModel = currentModel;
+        int numberOfFilledPixels = endOfSegmentPixelIndex - currentPixelIndex;
+        if (numberOfFilledPixels < 1)
+        {
+          continue;
+        }
 
-      if (this->NoiseAmplitude > 0)
-      {
-        for (int pixelIndex = 0; pixelIndex < numberOfFilledPixels; pixelIndex++)
+        PlusSpatialModel* currentModel = NULL;
+        if (intersectionIndex < numIntersectionPoints)
         {
-          samplePointPositions_Reference->GetPoint(currentPixelIndex + pixelIndex, samplePointPosition_Reference);
-          double noise = noiseFunction->EvaluateFunction(samplePointPosition_Reference);
-          // Noise is multiplicative: NoisySignal = signal + noise * (signal-SignalMean) = signal*(1+noise) - noise*SignalMean;
-          (*dstPixelAddress++) = std::max(std::min(this->BrightnessConversionOffset + this->BrightnessConversionScale * fastPow(intensities[pixelIndex], this->BrightnessConversionGamma) + noise, 255.0), 0.0);
+          currentModel = lineIntersectionsWithModels[intersectionIndex].Model;
         }
-      }
-      else
-      {
-        for (int pixelIndex = 0; pixelIndex < numberOfFilledPixels; pixelIndex++)
+        else
         {
-          (*dstPixelAddress++) = std::max(std::min(this->BrightnessConversionOffset + this->BrightnessConversionScale * fastPow(intensities[pixelIndex], this->BrightnessConversionGamma), 255.0), 0.0);
+          // the segment after the last intersection point is assumed to belong to the model of the last intersection
+          currentModel = lineIntersectionsWithModels[numIntersectionPoints - 1].Model;
         }
-      }
 
-      incomingBeamIntensity = outgoingBeamIntensity;
+        double outgoingBeamIntensity = 0;
+        currentModel->CalculateIntensity(intensities, numberOfFilledPixels, distanceBetweenScanlineSamplePointsMm, previousModel->GetAcousticImpedanceMegarayls(), incomingBeamIntensity, outgoingBeamIntensity, lineIntersectionsWithModels[intersectionIndex].IntersectionIncidenceAngleRad);
+        previousModel = currentModel;
+
+        if (this->NoiseAmplitude > 0)
+        {
+          for (int pixelIndex = 0; pixelIndex < numberOfFilledPixels; pixelIndex++)
+          {
+            samplePointPositions_Reference->GetPoint(currentPixelIndex + pixelIndex, samplePointPosition_Reference);
+            double noise = noiseFunction->EvaluateFunction(samplePointPosition_Reference);
+            // Noise is multiplicative: NoisySignal = signal + noise * (signal-SignalMean) = signal*(1+noise) - noise*SignalMean;
+            (*dstPixelAddress++) = std::max(std::min(this->BrightnessConversionOffset + this->BrightnessConversionScale * fastPow(intensities[pixelIndex], this->BrightnessConversionGamma) + noise, 255.0), 0.0);
+          }
+        }
+        else
+        {
+          for (int pixelIndex = 0; pixelIndex < numberOfFilledPixels; pixelIndex++)
+          {
+            (*dstPixelAddress++) = std::max(std::min(this->BrightnessConversionOffset + this->BrightnessConversionScale * fastPow(intensities[pixelIndex], this->BrightnessConversionGamma), 255.0), 0.0);
+          }
+        }
 
-      currentPixelIndex += numberOfFilledPixels;
+        incomingBeamIntensity = outgoingBeamIntensity;
+
+        currentPixelIndex += numberOfFilledPixels;
+      }
     }
+  });
+
+  if (scanLineWithoutIntersection)
+  {
+    LOG_ERROR("No intersections with any SpatialObjects. Probably no background object is specified.");
+    return 0;
   }
 
   vtkImageData* simulatedUsImage = vtkImageData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
@@ -405,6 +429,7 @@ PlusStatus vtkPlusUsSimulatorAlgo::ReadConfiguration(vtkXMLDataElement* config)
   XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, NoiseAmplitude, usSimulatorAlgoElement);
   XML_READ_VECTOR_ATTRIBUTE_OPTIONAL(double, 3, NoiseFrequency, usSimulatorAlgoElement);
   XML_READ_VECTOR_ATTRIBUTE_OPTIONAL(double, 3, NoisePhase, usSimulatorAlgoElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfThreads, usSimulatorAlgoElement);
   XML_READ_CSTRING_ATTRIBUTE_REQUIRED(ImageCoordinateFrame, usSimulatorAlgoElement);
   XML_READ_CSTRING_ATTRIBUTE_REQUIRED(ReferenceCoordinateFrame, usSimulatorAlgoElement);
 
@@ -104,6 +104,10 @@ public:
   vtkSetVector3Macro(NoiseFrequency, double);
   vtkSetVector3Macro(NoisePhase, double);
 
+  /*! Number of threads used for simulating the scanlines. If 0 then the number of hardware threads is used. */
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
 protected:
   virtual int FillOutputPortInformation(int port, vtkInformation* info);
   virtual int RequestData(vtkInformation* request,
@@ -163,6 +167,9 @@ private:
   double NoiseAmplitude;
   double NoiseFrequency[3];
   double NoisePhase[3];
+
+  /*! Number of threads used for simulating the scanlines. If 0 then the number of hardware threads is used. */
+  int NumberOfThreads;
 };
 
 #endif // __vtkPlusUsSimulatorAlgo_h